@@ -0,0 +1,152 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+#include "bench.h"
+#include <math.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+volatile size_t bench_sink;
+
+// ================ Module ================ //
+
+static const char *bench_module_src =
+  "#fib%zu(i64 %%n) i64 {\n"
+  "  @entry: { %%n i64(2) < @base @rec branch }\n"
+  "  @base: { %%n ret/1 }\n"
+  "  @rec: { %%n i64(1) - fib%zu %%n i64(2) - fib%zu + ret/1 }\n"
+  "}\n"
+  "#sum%zu(i32* %%p, i32 %%n) i32 {\n"
+  "  @entry: { i32(0) %%i0 = i32(0) %%s0 = @head jmp }\n"
+  "  @head: {\n"
+  "    %%i0 @entry %%i1 @body phi/2/1 %%i =\n"
+  "    %%s0 @entry %%s1 @body phi/2/1 %%s =\n"
+  "    %%i %%n < @body @exit branch\n"
+  "  }\n"
+  "  @body: {\n"
+  "    %%p %%i index load %%v =\n"
+  "    %%s %%v + %%s1 =\n"
+  "    %%v i32(2) * %%p %%i index store\n"
+  "    %%i i32(1) + %%i1 =\n"
+  "    @head jmp\n"
+  "  }\n"
+  "  @exit: { %%s ret/1 }\n"
+  "}\n"
+  "#pick%zu(i64 %%x) i64 {\n"
+  "  @entry: { %%x i64(0) < @neg @pos branch }\n"
+  "  @neg: { i64(0) %%x - %%a = @join jmp }\n"
+  "  @pos: { %%x %%b = @join jmp }\n"
+  "  @join: { %%a @neg %%b @pos phi/2/1 %%r = %%r ret/1 }\n"
+  "}\n";
+
+char *bench_module(size_t copies, size_t *functions) {
+  size_t size = 0, capacity = 4096;
+  char *src = malloc(capacity);
+  if (!src) { LLACE_LOG_FATAL("Failed to allocate benchmark module"); }
+  for (size_t i = 0; i < copies; ++i) {
+    for (;;) {
+      int written = snprintf(src + size, capacity - size, bench_module_src, i, i, i, i, i);
+      if ((size_t)written < capacity - size) {
+        size += (size_t)written;
+        break;
+      }
+      capacity *= 2;
+      src = realloc(src, capacity);
+      if (!src) { LLACE_LOG_FATAL("Failed to allocate benchmark module"); }
+    }
+  }
+  src[size] = '\0';
+  if (functions) *functions = copies * 3;
+  return src;
+}
+
+// ================ Runner ================ //
+
+static double bench_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+static size_t bench_live(bool peak) {
+  llace_mem_stats_t stats;
+  llace_mem_total(&stats);
+  return peak ? stats.peak : stats.live;
+}
+
+int bench_order(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Linear between the closest ranks of sorted
+static double bench_percentile(const double *sorted, size_t count, double p) {
+  double rank = p * (double)(count - 1);
+  size_t low = (size_t)rank;
+  if (low + 1 >= count) return sorted[count - 1];
+  return sorted[low] + (sorted[low + 1] - sorted[low]) * (rank - (double)low);
+}
+
+void bench_run(const bench_case_t *bench, const bench_options_t *options, bench_result_t *result) {
+  size_t samples = options->samples ? options->samples : 1;
+  *result = (bench_result_t){ .name = bench->name, .ops = bench->ops, .samples = samples };
+  result->times = malloc(samples * sizeof(double));
+  double *sorted = malloc(samples * sizeof(double));
+  if (!result->times || !sorted) { LLACE_LOG_FATAL("Failed to allocate benchmark samples"); }
+
+  for (size_t i = 0; i < options->warmup + samples; ++i) {
+    void *state = bench->setup ? bench->setup(bench->arg) : NULL;
+    llace_mem_stats_reset();
+    size_t live = bench_live(false);
+    double start = bench_now();
+    bench->run(state);
+    double nanos = bench_now() - start;
+    size_t peak = bench_live(true);
+    if (bench->teardown) bench->teardown(state);
+    if (i < options->warmup) continue;
+
+    result->times[i - options->warmup] = nanos / (double)bench->ops;
+    if (peak > live && peak - live > result->peak_bytes) result->peak_bytes = peak - live;
+  }
+
+  double sum = 0, squares = 0;
+  for (size_t i = 0; i < samples; ++i) sum += result->times[i];
+  result->mean = sum / (double)samples;
+  for (size_t i = 0; i < samples; ++i) squares += (result->times[i] - result->mean) * (result->times[i] - result->mean);
+  result->stddev = samples > 1 ? sqrt(squares / (double)(samples - 1)) : 0;
+
+  memcpy(sorted, result->times, samples * sizeof(double));
+  qsort(sorted, samples, sizeof(double), bench_order);
+  result->median = bench_percentile(sorted, samples, 0.5);
+  result->p95 = bench_percentile(sorted, samples, 0.95);
+  result->ops_per_sec = result->median > 0 ? 1e9 / result->median : 0;
+  free(sorted);
+}
+
+void bench_result_free(bench_result_t *result) {
+  free(result->times);
+  result->times = NULL;
+}
+
+// ================ Output ================ //
+
+void bench_table(FILE *out, const bench_result_t *results, size_t count) {
+  fprintf(out, "%-18s %9s %12s %12s %14s %12s\n", "benchmark", "ops", "median ns", "p95 ns", "ops/s", "peak KiB");
+  for (size_t i = 0; i < count; ++i) {
+    const bench_result_t *r = &results[i];
+    fprintf(out, "%-18s %9zu %12.2f %12.2f %14.0f %12.1f\n", r->name, r->ops, r->median, r->p95, r->ops_per_sec, r->peak_bytes / 1024.0);
+  }
+}
+
+void bench_json(FILE *out, const bench_options_t *options, const bench_result_t *results, size_t count) {
+  fprintf(out, "{\"samples\":%zu,\"warmup\":%zu,\"benchmarks\":[", options->samples, options->warmup);
+  for (size_t i = 0; i < count; ++i) {
+    const bench_result_t *r = &results[i];
+    fprintf(out,
+            "%s\n{\"name\":\"%s\",\"ops\":%zu,\"median_ns\":%.3f,\"p95_ns\":%.3f,\"mean_ns\":%.3f,\"stddev_ns\":%.3f,\"ops_per_sec\":%.1f,"
+            "\"peak_bytes\":%zu,\"times_ns\":[",
+            i ? "," : "", r->name, r->ops, r->median, r->p95, r->mean, r->stddev, r->ops_per_sec, r->peak_bytes);
+    for (size_t s = 0; s < r->samples; ++s) fprintf(out, "%s%.3f", s ? "," : "", r->times[s]);
+    fprintf(out, "]}");
+  }
+  fprintf(out, "\n]}\n");
+}
@@ -0,0 +1,91 @@
+#ifndef LLACE_BENCH_H
+#define LLACE_BENCH_H
+
+#include <llace/llace.h>
+#include <llace/mem.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Microbenchmarks: a case does ops operations per sample, setup and
+// teardown run around every sample untimed. After a few warmup samples
+// the runner keeps the time per operation of each sample and reports the
+// median, the 95th percentile and operations per second, plus the most
+// bytes a sample had live on top of what was there before it.
+
+// ================ Cases ================ //
+
+typedef struct bench_case {
+  const char *name; // suite.case
+  size_t ops;
+  void *(*setup)(const void *arg); // NULL for no state
+  void (*run)(void *state);
+  void (*teardown)(void *state);   // NULL when there is nothing to free
+  const void *arg;                 // handed to setup
+} bench_case_t;
+
+// Results the compiler cannot see through
+extern volatile size_t bench_sink;
+
+// Every suite, cases in a static array
+const bench_case_t *bench_suite_mem(size_t *count);
+const bench_case_t *bench_suite_ir(size_t *count);
+const bench_case_t *bench_suite_codegen(size_t *count);
+
+// A module of copies of a recursive function, a loop over memory with phis and a diamond
+char *bench_module(size_t copies, size_t *functions);
+
+// ================ Generator ================ //
+
+typedef struct bench_shape {
+  uint64_t seed;
+  size_t functions;
+  size_t blocks;      // per function, about
+  size_t insts;       // statements per block outside of loop headers and latches
+  size_t loop_depth;  // of every loop nest, 0 for straight and branching code only
+  double phi_density; // share of diamonds merging their arms with a phi
+  size_t fanout;      // calls from every function into later ones
+} bench_shape_t;
+
+// IR text of a module of the shape, the same for the same seed
+char *bench_generate(const bench_shape_t *shape, size_t *statements);
+
+// ================ Runner ================ //
+
+typedef struct bench_options {
+  size_t samples;
+  size_t warmup;
+  const char *filter; // substring of the names to run, NULL for all
+} bench_options_t;
+
+typedef struct bench_result {
+  const char *name;
+  size_t ops;
+  size_t samples;
+  double median, p95, mean, stddev; // ns per operation
+  double ops_per_sec;               // at the median
+  size_t peak_bytes;
+  double *times;                    // ns per operation of every sample
+} bench_result_t;
+
+void bench_run(const bench_case_t *bench, const bench_options_t *options, bench_result_t *result);
+// Ascending doubles for qsort
+int bench_order(const void *a, const void *b);
+void bench_result_free(bench_result_t *result);
+
+void bench_table(FILE *out, const bench_result_t *results, size_t count);
+void bench_json(FILE *out, const bench_options_t *options, const bench_result_t *results, size_t count);
+
+// ================ Compare ================ //
+
+// Compares results with a JSON file from an earlier run, a table to out. False
+// when the file cannot be read or a case is significantly slower, or peaks
+// higher, by more than threshold (a fraction).
+bool bench_compare(FILE *out, const char *baseline, const bench_result_t *results, size_t count, double threshold);
+
+// ================ Sweep ================ //
+
+// Compile time and peak memory of generated modules as each dimension grows,
+// a table to out and points to json (may be NULL). False if any is superlinear.
+bool bench_sweep(FILE *out, FILE *json, const bench_options_t *options, uint64_t seed);
+
+#endif // LLACE_BENCH_H
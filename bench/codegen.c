@@ -0,0 +1,104 @@
+#include "bench.h"
+#include <llace/ir.h>
+#include <llace/codegen/amd64/amd64.h>
+#include <llace/codegen/jit.h>
+#include <llace/codegen/wasm/wasm.h>
+#include <string.h>
+
+#define BENCH_INSTS 100000 // encoded
+#define BENCH_COPIES 300   // of the module templates, three functions each
+
+#define GPR(r, bytes) LLACE_AMD64_GPR(LLACE_AMD64_##r, bytes)
+#define INST(mn, ...) { .mnemonic = LLACE_AMD64_##mn, .count = sizeof((llace_amd64_operand_t[]){ __VA_ARGS__ }) / sizeof(llace_amd64_operand_t), .ops = { __VA_ARGS__ } }
+
+// ================ Encoding ================ //
+
+static void *bench_buffer_setup(const void *arg) {
+  (void)arg;
+  llace_codebuf_t *buf = malloc(sizeof(llace_codebuf_t));
+  if (!buf) { LLACE_LOG_FATAL("Failed to allocate benchmark buffer"); }
+  llace_codebuf_init(buf, 256);
+  return buf;
+}
+
+static void bench_buffer_teardown(void *state) {
+  llace_codebuf_free(state);
+  free(state);
+}
+
+static void bench_codegen_encode(void *state) {
+  llace_codebuf_t *buf = state;
+  // Registers, immediates, memory forms and prefixes, roughly as selection mixes them
+  const llace_amd64_inst_t insts[] = {
+    INST(ADD, GPR(RAX, 8), GPR(RBX, 8)),
+    INST(SUB, GPR(RAX, 4), LLACE_AMD64_IMM(1000)),
+    INST(MOV, GPR(R12, 8), LLACE_AMD64_BASE(8, LLACE_AMD64_RSP, 8)),
+    INST(MOV, LLACE_AMD64_MEM(4, LLACE_AMD64_RBP, LLACE_AMD64_RCX, 4, 0), GPR(RDX, 4)),
+    INST(MOV, GPR(R9, 2), LLACE_AMD64_IMM(-2)),
+    INST(LEA, GPR(RAX, 8), LLACE_AMD64_RIPREL(0, 0x10)),
+    INST(IMUL, GPR(RCX, 4), GPR(R13, 4), LLACE_AMD64_IMM(12)),
+    INST(SHL, GPR(RDX, 8), GPR(RCX, 1)),
+  };
+  size_t count = sizeof(insts) / sizeof(insts[0]);
+  for (size_t i = 0; i < BENCH_INSTS; ++i) llace_amd64_encode(buf, &insts[i % count], NULL);
+  bench_sink += buf->size;
+}
+
+// ================ Modules ================ //
+
+typedef struct bench_module {
+  llace_ir_context_t ctx;
+  llace_codebuf_t out;
+  llace_jit_t jit;
+} bench_module_t;
+
+static void *bench_module_setup(const void *arg) {
+  (void)arg;
+  bench_module_t *module = malloc(sizeof(bench_module_t));
+  if (!module) { LLACE_LOG_FATAL("Failed to allocate benchmark module"); }
+  char *src = bench_module(BENCH_COPIES, NULL);
+  llace_ir_context_init(&module->ctx);
+  if (llace_ir_parse(&module->ctx, src, strlen(src)) != LLACE_ERROR_NONE) { LLACE_LOG_FATAL("Benchmark module does not parse"); }
+  free(src);
+  llace_codebuf_init(&module->out, 4096);
+  if (llace_jit_init(&module->jit, &module->ctx, NULL) != LLACE_ERROR_NONE) { LLACE_LOG_FATAL("Failed to create benchmark JIT"); }
+  return module;
+}
+
+static void bench_module_teardown(void *state) {
+  bench_module_t *module = state;
+  llace_jit_free(&module->jit);
+  llace_codebuf_free(&module->out);
+  llace_ir_context_free(&module->ctx);
+  free(module);
+}
+
+// Selection, allocation, encoding and linking of every function
+static void bench_codegen_jit(void *state) {
+  bench_module_t *module = state;
+  size_t compiled = 0;
+  for (size_t f = 0; f < LLACE_ARRAY_COUNT(module->ctx.funcmap.funcs); ++f) {
+    void *entry;
+    compiled += llace_jit_add(&module->jit, f, &entry) == LLACE_ERROR_NONE;
+  }
+  bench_sink += compiled;
+}
+
+static void bench_codegen_wasm(void *state) {
+  bench_module_t *module = state;
+  if (llace_wasm_emit(&module->ctx, NULL, &module->out, NULL) != LLACE_ERROR_NONE) { LLACE_LOG_FATAL("Benchmark module does not emit"); }
+  bench_sink += module->out.size;
+}
+
+// ================ Suite ================ //
+
+static const bench_case_t bench_codegen_cases[] = {
+  { "codegen.encode", BENCH_INSTS, bench_buffer_setup, bench_codegen_encode, bench_buffer_teardown, NULL },
+  { "codegen.jit", BENCH_COPIES * 3, bench_module_setup, bench_codegen_jit, bench_module_teardown, NULL },
+  { "codegen.wasm", BENCH_COPIES * 3, bench_module_setup, bench_codegen_wasm, bench_module_teardown, NULL },
+};
+
+const bench_case_t *bench_suite_codegen(size_t *count) {
+  *count = sizeof(bench_codegen_cases) / sizeof(bench_codegen_cases[0]);
+  return bench_codegen_cases;
+}
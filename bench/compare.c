@@ -0,0 +1,161 @@
+#include "bench.h"
+#include <math.h>
+#include <string.h>
+
+#define COMPARE_RESAMPLES 2000
+#define COMPARE_CONFIDENCE 0.95
+
+// The change of every case is the ratio of its median time to the baseline
+// median, with a bootstrap confidence interval over both sets of samples. It
+// is significant when the interval leaves out no change, and a regression
+// when it is significant and slower by more than the threshold. Peak memory
+// is deterministic enough to compare directly against the same threshold.
+
+typedef struct compare_baseline {
+  char name[64];
+  size_t peak_bytes;
+  llace_array_t times; // double, ns per operation
+} compare_baseline_t;
+
+// ================ Baseline ================ //
+
+static char *compare_read(const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (!file) return NULL;
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  rewind(file);
+  char *text = size >= 0 ? malloc((size_t)size + 1) : NULL;
+  if (text) text[fread(text, 1, (size_t)size, file)] = '\0';
+  fclose(file);
+  return text;
+}
+
+// Value of the first "key" in text, past the colon and any space
+static char *compare_key(char *text, const char *key) {
+  char quoted[32];
+  snprintf(quoted, sizeof(quoted), "\"%s\"", key);
+  char *p = strstr(text, quoted);
+  if (!p) return NULL;
+  p += strlen(quoted);
+  while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' || *p == ':') ++p;
+  return p;
+}
+
+// Cases of a file written by bench_json, the ones without samples are skipped
+static bool compare_load(const char *path, llace_array_t *baselines) {
+  char *text = compare_read(path);
+  if (!text) return false;
+  *baselines = LLACE_NEW_ARRAY(compare_baseline_t, 16);
+  for (char *name = compare_key(text, "name"); name && *name == '"';) {
+    char *end = strchr(++name, '"');
+    if (!end) break;
+    char *next = compare_key(end, "name"), saved = next ? next[-1] : 0;
+    if (next) next[-1] = '\0'; // the object ends before the next one
+
+    compare_baseline_t baseline = { .times = LLACE_NEW_ARRAY(double, 32) };
+    snprintf(baseline.name, sizeof(baseline.name), "%.*s", (int)(end - name), name);
+    char *peak = compare_key(end, "peak_bytes"), *times = compare_key(end, "times_ns");
+    if (peak) baseline.peak_bytes = strtoull(peak, NULL, 10);
+    for (char *t = times && *times == '[' ? times + 1 : NULL; t;) {
+      char *after;
+      double value = strtod(t, &after);
+      if (after == t) break;
+      LLACE_ARRAY_PUSH(baseline.times, value);
+      for (t = after; *t == ' ' || *t == '\n' || *t == ','; ++t) {}
+    }
+
+    if (LLACE_ARRAY_IS_EMPTY(baseline.times)) {
+      LLACE_FREE_ARRAY(baseline.times);
+    } else {
+      LLACE_ARRAY_PUSH(*baselines, baseline);
+    }
+    if (next) next[-1] = saved;
+    name = next;
+  }
+  free(text);
+  return true;
+}
+
+static void compare_free(llace_array_t *baselines) {
+  LLACE_ARRAY_FOREACH(compare_baseline_t, baseline, *baselines) LLACE_FREE_ARRAY(baseline->times);
+  LLACE_FREE_ARRAY(*baselines);
+}
+
+// ================ Statistics ================ //
+
+static double compare_median(double *values, size_t count) {
+  qsort(values, count, sizeof(double), bench_order);
+  return count % 2 ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+// xorshift64*, seeded the same every run so the intervals are reproducible
+static size_t compare_draw(uint64_t *state, size_t n) {
+  *state ^= *state >> 12, *state ^= *state << 25, *state ^= *state >> 27;
+  return (size_t)((*state * 0x2545F4914F6CDD1Dull) % n);
+}
+
+// Bounds of the ratio of current to baseline medians
+static void compare_interval(const double *base, size_t base_count, const double *current, size_t current_count, double *low, double *high) {
+  double *ratios = malloc(COMPARE_RESAMPLES * sizeof(double));
+  double *a = malloc(base_count * sizeof(double)), *b = malloc(current_count * sizeof(double));
+  if (!ratios || !a || !b) { LLACE_LOG_FATAL("Failed to allocate bootstrap samples"); }
+  uint64_t state = 0x9E3779B97F4A7C15ull;
+  for (size_t r = 0; r < COMPARE_RESAMPLES; ++r) {
+    for (size_t i = 0; i < base_count; ++i) a[i] = base[compare_draw(&state, base_count)];
+    for (size_t i = 0; i < current_count; ++i) b[i] = current[compare_draw(&state, current_count)];
+    double median = compare_median(a, base_count);
+    ratios[r] = median > 0 ? compare_median(b, current_count) / median : 1;
+  }
+  qsort(ratios, COMPARE_RESAMPLES, sizeof(double), bench_order);
+  double tail = (1 - COMPARE_CONFIDENCE) / 2;
+  *low = ratios[(size_t)(tail * (COMPARE_RESAMPLES - 1))];
+  *high = ratios[(size_t)((1 - tail) * (COMPARE_RESAMPLES - 1))];
+  free(ratios);
+  free(a);
+  free(b);
+}
+
+// ================ Compare ================ //
+
+bool bench_compare(FILE *out, const char *path, const bench_result_t *results, size_t count, double threshold) {
+  llace_array_t baselines;
+  if (!compare_load(path, &baselines)) {
+    fprintf(stderr, "Could not read baseline '%s'\n", path);
+    return false;
+  }
+
+  size_t regressions = 0;
+  fprintf(out, "%-18s %12s %12s %9s %21s %9s  %s\n", "benchmark", "base ns", "current ns", "change", "95% interval", "peak", "verdict");
+  for (size_t i = 0; i < count; ++i) {
+    const bench_result_t *r = &results[i];
+    compare_baseline_t *baseline = NULL;
+    LLACE_ARRAY_FOREACH(compare_baseline_t, b, baselines) if (strcmp(b->name, r->name) == 0) baseline = b;
+    if (!baseline) {
+      fprintf(out, "%-18s %12s %12.2f %9s %21s %9s  new\n", r->name, "-", r->median, "-", "-", "-");
+      continue;
+    }
+
+    size_t base_count = LLACE_ARRAY_COUNT(baseline->times);
+    double *base = malloc(base_count * sizeof(double)), low, high;
+    if (!base) { LLACE_LOG_FATAL("Failed to allocate baseline samples"); }
+    memcpy(base, LLACE_ARRAY_RAW(baseline->times), base_count * sizeof(double));
+    double base_median = compare_median(base, base_count);
+    compare_interval(base, base_count, r->times, r->samples, &low, &high);
+    free(base);
+
+    double change = base_median > 0 ? r->median / base_median - 1 : 0;
+    double memory = baseline->peak_bytes ? (double)r->peak_bytes / (double)baseline->peak_bytes - 1 : (r->peak_bytes ? INFINITY : 0);
+    bool slower = low > 1, faster = high < 1;
+    bool regressed = slower && change > threshold, grew = memory > threshold && r->peak_bytes > baseline->peak_bytes + 4096;
+    const char *verdict = regressed ? "REGRESSION" : slower ? "slower" : faster ? "faster" : "same";
+    regressions += regressed || grew;
+
+    fprintf(out, "%-18s %12.2f %12.2f %+8.1f%% [%+7.1f%%, %+7.1f%%] %+8.1f%%  %s%s\n", r->name, base_median, r->median, change * 100,
+            (low - 1) * 100, (high - 1) * 100, isinf(memory) ? 100.0 : memory * 100, verdict, grew ? ", MEMORY" : "");
+  }
+  compare_free(&baselines);
+
+  if (regressions) fprintf(out, "%zu regressed past %.1f%%\n", regressions, threshold * 100);
+  return regressions == 0;
+}
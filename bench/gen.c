@@ -0,0 +1,238 @@
+#include "bench.h"
+#include <stdarg.h>
+
+#define GEN_RECENT 8    // operands are picked among the latest values in scope
+#define GEN_MAX_DEPTH 8
+
+// Control flow draws from its own stream, so growing the statements keeps the blocks
+enum { GEN_CODE, GEN_FLOW };
+
+// Functions are #g<k>(i64 %v0, i64 %v1) i64, values %v<n> and blocks @b<n>,
+// all in SSA form. A function is a chain of regions after its entry block:
+// straight blocks, diamonds joined with or without a phi, and counted loop
+// nests carrying an index and a sum through phis at every level. Calls only
+// go to later functions, so the call graph has no cycles.
+
+typedef struct gen {
+  const bench_shape_t *shape;
+  char *text;
+  size_t size, capacity;
+  uint64_t state[2];
+
+  size_t fn;
+  size_t vars, blocks;  // next names
+  size_t block;         // open one
+  llace_array_t scope;  // size_t, values that dominate the current block
+  size_t cur;           // value flowing through the function
+  size_t calls;         // left to place in this function
+  size_t statements;
+} gen_t;
+
+// ================ Text ================ //
+
+__attribute__((format(printf, 2, 3)))
+static void gen_printf(gen_t *g, const char *fmt, ...) {
+  for (;;) {
+    va_list args;
+    va_start(args, fmt);
+    int written = vsnprintf(g->text + g->size, g->capacity - g->size, fmt, args);
+    va_end(args);
+    if ((size_t)written < g->capacity - g->size) {
+      g->size += (size_t)written;
+      return;
+    }
+    g->capacity *= 2;
+    g->text = realloc(g->text, g->capacity);
+    if (!g->text) { LLACE_LOG_FATAL("Failed to allocate generated module"); }
+  }
+}
+
+// splitmix64
+static uint64_t gen_next(gen_t *g, int stream) {
+  uint64_t z = (g->state[stream] += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+static size_t gen_below(gen_t *g, int stream, size_t n) {
+  return n ? (size_t)(gen_next(g, stream) % n) : 0;
+}
+
+static size_t gen_var(gen_t *g) {
+  return g->vars++;
+}
+
+static void gen_define(gen_t *g, size_t var) {
+  LLACE_ARRAY_PUSH(g->scope, var);
+  g->cur = var;
+}
+
+// Opens the block, its statements follow
+static void gen_open(gen_t *g, size_t block) {
+  gen_printf(g, "  @b%zu: {", block);
+  g->block = block;
+}
+
+// ================ Statements ================ //
+
+static void gen_operand(gen_t *g) {
+  size_t count = LLACE_ARRAY_COUNT(g->scope);
+  if (gen_below(g, GEN_CODE, 4) == 0) {
+    gen_printf(g, " i64(%zu)", gen_below(g, GEN_CODE, 100) + 1);
+  } else {
+    size_t recent = count < GEN_RECENT ? count : GEN_RECENT;
+    gen_printf(g, " %%v%zu", *LLACE_ARRAY_GET(size_t, g->scope, count - 1 - gen_below(g, GEN_CODE, recent)));
+  }
+}
+
+static void gen_call(gen_t *g) {
+  size_t callee = g->fn + 1 + gen_below(g, GEN_CODE, g->shape->functions - g->fn - 1), var = gen_var(g);
+  gen_printf(g, " %%v%zu", g->cur);
+  gen_operand(g);
+  gen_printf(g, " g%zu %%v%zu =", callee, var);
+  gen_define(g, var);
+  --g->calls;
+  ++g->statements;
+}
+
+// Calls first while the function has some left, then arithmetic on the flowing value
+static void gen_statements(gen_t *g, size_t count) {
+  static const char *ops[] = { "+", "-", "*", "&", "|", "^" };
+  for (size_t i = 0; i < count; ++i) {
+    if (g->calls > 0) {
+      gen_call(g);
+      continue;
+    }
+    size_t var = gen_var(g);
+    gen_printf(g, " %%v%zu", g->cur);
+    gen_operand(g);
+    gen_printf(g, " %s %%v%zu =", ops[gen_below(g, GEN_CODE, sizeof(ops) / sizeof(ops[0]))], var);
+    gen_define(g, var);
+    ++g->statements;
+  }
+}
+
+// ================ Regions ================ //
+
+static void gen_straight(gen_t *g) {
+  size_t next = g->blocks++;
+  gen_printf(g, " @b%zu jmp }\n", next);
+  gen_open(g, next);
+  gen_statements(g, g->shape->insts);
+}
+
+// cur < x ? then : else, merged by a phi at the join when the draw says so
+static void gen_diamond(gen_t *g) {
+  size_t then = g->blocks++, other = g->blocks++, join = g->blocks++;
+  size_t before = g->cur, scope = LLACE_ARRAY_COUNT(g->scope), arms[2];
+  gen_printf(g, " %%v%zu", g->cur);
+  gen_operand(g);
+  gen_printf(g, " < @b%zu @b%zu branch }\n", then, other);
+
+  size_t blocks[2] = { then, other };
+  for (int arm = 0; arm < 2; ++arm) {
+    gen_open(g, blocks[arm]);
+    gen_statements(g, g->shape->insts);
+    arms[arm] = g->cur;
+    gen_printf(g, " @b%zu jmp }\n", join);
+    g->scope.element_count = scope;
+    g->cur = before;
+  }
+
+  gen_open(g, join);
+  if ((double)(gen_next(g, GEN_FLOW) >> 11) * 0x1p-53 < g->shape->phi_density) {
+    size_t var = gen_var(g);
+    gen_printf(g, " %%v%zu @b%zu %%v%zu @b%zu phi/2/1 %%v%zu =", arms[0], then, arms[1], other, var);
+    gen_define(g, var);
+    ++g->statements;
+  }
+  gen_statements(g, g->shape->insts);
+}
+
+// Nested counted loops: level l runs from its header h[l] into h[l+1], the
+// body at the innermost level, and leaves to x[l], which is the latch of
+// level l-1. The outermost exit stays open for the regions after it.
+static void gen_loop(gen_t *g, size_t depth) {
+  size_t h[GEN_MAX_DEPTH] = {0}, x[GEN_MAX_DEPTH] = {0}, init[GEN_MAX_DEPTH] = {0}, index[GEN_MAX_DEPTH] = {0}, step[GEN_MAX_DEPTH] = {0},
+         sum[GEN_MAX_DEPTH] = {0}, next[GEN_MAX_DEPTH] = {0};
+  size_t scope = LLACE_ARRAY_COUNT(g->scope), pred = g->block, carried = g->cur;
+  for (size_t l = 0; l < depth; ++l) {
+    h[l] = g->blocks++, x[l] = g->blocks++;
+    init[l] = gen_var(g), index[l] = gen_var(g), step[l] = gen_var(g), sum[l] = gen_var(g), next[l] = gen_var(g);
+  }
+  size_t body = g->blocks++;
+
+  gen_printf(g, " i64(0) %%v%zu = @b%zu jmp }\n", init[0], h[0]);
+  for (size_t l = 0; l < depth; ++l) {
+    size_t inner = l + 1 < depth, latch = inner ? x[l + 1] : body, enter = inner ? h[l + 1] : body;
+    gen_open(g, h[l]);
+    gen_printf(g, " %%v%zu @b%zu %%v%zu @b%zu phi/2/1 %%v%zu =", init[l], pred, step[l], latch, index[l]);
+    gen_printf(g, " %%v%zu @b%zu %%v%zu @b%zu phi/2/1 %%v%zu =", carried, pred, next[l], latch, sum[l]);
+    if (inner) gen_printf(g, " i64(0) %%v%zu =", init[l + 1]);
+    gen_printf(g, " %%v%zu i64(%zu) < @b%zu @b%zu branch }\n", index[l], gen_below(g, GEN_FLOW, 16) + 4, enter, x[l]);
+    LLACE_ARRAY_PUSH(g->scope, index[l]);
+    gen_define(g, sum[l]);
+    g->statements += 5;
+    pred = h[l], carried = sum[l];
+  }
+
+  gen_open(g, body);
+  gen_statements(g, g->shape->insts);
+  gen_printf(g, " %%v%zu i64(1) + %%v%zu = %%v%zu %%v%zu + %%v%zu = @b%zu jmp }\n", index[depth - 1], step[depth - 1], g->cur,
+             index[depth - 1], next[depth - 1], h[depth - 1]);
+  for (size_t l = depth - 1; l > 0; --l) {
+    gen_open(g, x[l]);
+    gen_printf(g, " %%v%zu i64(1) + %%v%zu = %%v%zu %%v%zu + %%v%zu = @b%zu jmp }\n", index[l - 1], step[l - 1], sum[l], index[l - 1],
+               next[l - 1], h[l - 1]);
+  }
+
+  g->scope.element_count = scope;
+  gen_open(g, x[0]);
+  LLACE_ARRAY_PUSH(g->scope, index[0]);
+  gen_define(g, sum[0]);
+  gen_statements(g, g->shape->insts);
+}
+
+// ================ Module ================ //
+
+static void gen_function(gen_t *g) {
+  const bench_shape_t *shape = g->shape;
+  size_t depth = shape->loop_depth < GEN_MAX_DEPTH ? shape->loop_depth : GEN_MAX_DEPTH;
+  g->vars = 2, g->blocks = 1;
+  g->calls = g->fn + 1 < shape->functions ? shape->fanout : 0;
+  g->scope.element_count = 0;
+  gen_define(g, 1);
+  gen_define(g, 0);
+
+  gen_printf(g, "#g%zu(i64 %%v0, i64 %%v1) i64 {\n", g->fn);
+  gen_open(g, 0);
+  gen_statements(g, shape->insts);
+  for (size_t left = shape->blocks > 1 ? shape->blocks - 1 : 0; left > 0;) {
+    bool loop = depth > 0 && left >= 2 * depth + 1, diamond = left >= 3;
+    size_t kind = gen_below(g, GEN_FLOW, 1 + diamond + loop);
+    if (kind == 2) {
+      gen_loop(g, depth);
+      left -= 2 * depth + 1;
+    } else if (kind == 1) {
+      gen_diamond(g);
+      left -= 3;
+    } else {
+      gen_straight(g);
+      left -= 1;
+    }
+  }
+  while (g->calls > 0) gen_call(g);
+  gen_printf(g, " %%v%zu ret/1 }\n}\n", g->cur);
+}
+
+char *bench_generate(const bench_shape_t *shape, size_t *statements) {
+  gen_t g = { .shape = shape, .capacity = 4096, .state = { shape->seed, ~shape->seed }, .scope = LLACE_NEW_ARRAY(size_t, 64) };
+  g.text = malloc(g.capacity);
+  if (!g.text) { LLACE_LOG_FATAL("Failed to allocate generated module"); }
+  g.text[0] = '\0';
+  for (g.fn = 0; g.fn < shape->functions; ++g.fn) gen_function(&g);
+  LLACE_FREE_ARRAY(g.scope);
+  if (statements) *statements = g.statements;
+  return g.text;
+}
@@ -0,0 +1,113 @@
+#include "bench.h"
+#include <llace/ir.h>
+#include <string.h>
+
+#define BENCH_FUNCTIONS 2000 // built
+#define BENCH_CHAIN 16       // additions per built function
+#define BENCH_COPIES 300     // of the module templates, three functions each
+
+typedef struct bench_ir {
+  llace_ir_context_t ctx;
+  llace_config_t config;
+  char *src;
+  size_t len;
+} bench_ir_t;
+
+static void *bench_ir_setup(bool parsed) {
+  bench_ir_t *ir = malloc(sizeof(bench_ir_t));
+  if (!ir) { LLACE_LOG_FATAL("Failed to allocate benchmark context"); }
+  ir->src = bench_module(BENCH_COPIES, NULL);
+  ir->len = strlen(ir->src);
+  llace_config_init(&ir->config);
+  llace_ir_context_init(&ir->ctx);
+  if (parsed && llace_ir_parse(&ir->ctx, ir->src, ir->len) != LLACE_ERROR_NONE) { LLACE_LOG_FATAL("Benchmark module does not parse"); }
+  return ir;
+}
+
+static void *bench_empty_setup(const void *arg) { (void)arg; return bench_ir_setup(false); }
+static void *bench_parsed_setup(const void *arg) { (void)arg; return bench_ir_setup(true); }
+
+static void bench_ir_teardown(void *state) {
+  bench_ir_t *ir = state;
+  llace_ir_context_free(&ir->ctx);
+  free(ir->src);
+  free(ir);
+}
+
+// ================ Construction ================ //
+
+// #f(i64 %n) i64 { @entry: { %n i64(1) + %v0 = %v0 i64(2) + %v1 = ... %vlast ret/1 } }
+static void bench_ir_build(void *state) {
+  bench_ir_t *ir = state;
+  char name[32];
+  for (size_t f = 0; f < BENCH_FUNCTIONS; ++f) {
+    size_t index, entry, var;
+    snprintf(name, sizeof(name), "f%zu", f);
+    llace_ir_function_new(&ir->ctx, name, &index);
+    llace_ir_function_t *fn = LLACE_IR_FUNCTION(&ir->ctx, index);
+    fn->ret = LLACE_IR_INT(64);
+    llace_ir_variable_new(fn, "n", LLACE_IR_INT(64), (llace_ir_typeattr_t){0}, &var);
+    fn->param_count = 1;
+    llace_ir_block_new(fn, "entry", &entry);
+    llace_ir_basicblock_t *block = LLACE_IR_BLOCK_AT(fn, entry);
+
+    for (size_t i = 0; i < BENCH_CHAIN; ++i) {
+      size_t prev = var;
+      snprintf(name, sizeof(name), "v%zu", i);
+      llace_ir_variable_new(fn, name, LLACE_IR_INT(64), (llace_ir_typeattr_t){0}, &var);
+      LLACE_IR_PUSH(block, LLACE_IR_VAR(prev));
+      LLACE_IR_PUSH(block, LLACE_IR_CONST_INT(LLACE_IR_INT(64), (int64_t)i + 1));
+      LLACE_IR_PUSH(block, LLACE_IR_OP(LLACE_IR_OP_ADD, 2, 1));
+      LLACE_IR_PUSH(block, LLACE_IR_VAR(var));
+      LLACE_IR_PUSH(block, LLACE_IR_OP(LLACE_IR_OP_ASSIGN, 2, 0));
+    }
+    LLACE_IR_PUSH(block, LLACE_IR_VAR(var));
+    LLACE_IR_PUSH(block, LLACE_IR_OP(LLACE_IR_OP_RET, 1, 0));
+  }
+  bench_sink += LLACE_ARRAY_COUNT(ir->ctx.funcmap.funcs);
+}
+
+// ================ Text Form ================ //
+
+static void bench_ir_parse(void *state) {
+  bench_ir_t *ir = state;
+  if (llace_ir_parse(&ir->ctx, ir->src, ir->len) != LLACE_ERROR_NONE) { LLACE_LOG_FATAL("Benchmark module does not parse"); }
+  bench_sink += LLACE_ARRAY_COUNT(ir->ctx.funcmap.funcs);
+}
+
+// ================ Passes ================ //
+
+// The loop and dead code passes over every function, after inlining
+static void bench_ir_passes(void *state) {
+  bench_ir_t *ir = state;
+  llace_ir_inline_stats_t inlined;
+  llace_ir_opt_inline(&ir->ctx, &ir->config, &inlined);
+  size_t changed = 0;
+  for (size_t f = 0; f < LLACE_ARRAY_COUNT(ir->ctx.funcmap.funcs); ++f) {
+    llace_ir_function_t *fn = LLACE_IR_FUNCTION(&ir->ctx, f);
+    llace_ir_licm_stats_t licm;
+    llace_ir_indvar_stats_t indvars;
+    llace_ir_vectorize_stats_t vectorize;
+    llace_ir_slp_stats_t slp;
+    llace_ir_adce_stats_t adce;
+    changed += llace_ir_opt_licm(&ir->ctx, fn, &licm) == LLACE_ERROR_NONE;
+    changed += llace_ir_opt_indvars(&ir->ctx, fn, &indvars) == LLACE_ERROR_NONE;
+    changed += llace_ir_opt_vectorize(&ir->ctx, &ir->config, fn, &vectorize) == LLACE_ERROR_NONE;
+    changed += llace_ir_opt_slp(&ir->ctx, &ir->config, fn, &slp) == LLACE_ERROR_NONE;
+    changed += llace_ir_opt_adce(&ir->ctx, fn, &adce) == LLACE_ERROR_NONE;
+  }
+  bench_sink += changed;
+}
+
+// ================ Suite ================ //
+
+static const bench_case_t bench_ir_cases[] = {
+  { "ir.build", BENCH_FUNCTIONS, bench_empty_setup, bench_ir_build, bench_ir_teardown, NULL },
+  { "ir.parse", BENCH_COPIES * 3, bench_empty_setup, bench_ir_parse, bench_ir_teardown, NULL },
+  { "ir.passes", BENCH_COPIES * 3, bench_parsed_setup, bench_ir_passes, bench_ir_teardown, NULL },
+};
+
+const bench_case_t *bench_suite_ir(size_t *count) {
+  *count = sizeof(bench_ir_cases) / sizeof(bench_ir_cases[0]);
+  return bench_ir_cases;
+}
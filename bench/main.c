@@ -0,0 +1,89 @@
+// Compiler microbenchmarks
+// Usage: bench [--samples N] [--warmup N] [--filter TEXT] [--json FILE] [--sweep] [--seed N]
+//              [--compare FILE] [--threshold PERCENT]
+#include "bench.h"
+#include <string.h>
+
+typedef const bench_case_t *(*bench_suite_t)(size_t *count);
+
+static const bench_suite_t bench_suites[] = { bench_suite_mem, bench_suite_ir, bench_suite_codegen };
+
+static int bench_usage(const char *program) {
+  fprintf(stderr, "Usage: %s [--samples N] [--warmup N] [--filter TEXT] [--json FILE] [--sweep] [--seed N]\n"
+                  "       [--compare FILE] [--threshold PERCENT]\n", program);
+  return 2;
+}
+
+int main(int argc, char *argv[]) {
+  bench_options_t options = { .samples = 21, .warmup = 2 };
+  const char *json = NULL, *baseline = NULL;
+  double threshold = 5;
+  bool sweep = false;
+  uint64_t seed = 1;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--sweep") == 0) {
+      sweep = true;
+      continue;
+    }
+    if (i + 1 >= argc) return bench_usage(argv[0]);
+    if (strcmp(argv[i], "--samples") == 0) options.samples = strtoul(argv[++i], NULL, 10);
+    else if (strcmp(argv[i], "--warmup") == 0) options.warmup = strtoul(argv[++i], NULL, 10);
+    else if (strcmp(argv[i], "--filter") == 0) options.filter = argv[++i];
+    else if (strcmp(argv[i], "--json") == 0) json = argv[++i];
+    else if (strcmp(argv[i], "--seed") == 0) seed = strtoull(argv[++i], NULL, 10);
+    else if (strcmp(argv[i], "--compare") == 0) baseline = argv[++i];
+    else if (strcmp(argv[i], "--threshold") == 0) threshold = strtod(argv[++i], NULL);
+    else return bench_usage(argv[0]);
+  }
+  if (options.samples == 0) return bench_usage(argv[0]);
+
+  if (sweep) {
+    FILE *out = json ? fopen(json, "w") : NULL;
+    if (json && !out) {
+      fprintf(stderr, "Could not open output '%s'\n", json);
+      return 1;
+    }
+    bool linear = bench_sweep(stdout, out, &options, seed);
+    if (out) fclose(out);
+    return linear ? 0 : 1;
+  }
+
+  size_t total = 0, count = 0;
+  for (size_t s = 0; s < sizeof(bench_suites) / sizeof(bench_suites[0]); ++s) {
+    size_t cases;
+    bench_suites[s](&cases);
+    total += cases;
+  }
+  bench_result_t *results = calloc(total, sizeof(bench_result_t));
+  if (!results) { LLACE_LOG_FATAL("Failed to allocate benchmark results"); }
+
+  for (size_t s = 0; s < sizeof(bench_suites) / sizeof(bench_suites[0]); ++s) {
+    size_t cases;
+    const bench_case_t *suite = bench_suites[s](&cases);
+    for (size_t c = 0; c < cases; ++c) {
+      if (options.filter && !strstr(suite[c].name, options.filter)) continue;
+      bench_run(&suite[c], &options, &results[count++]);
+    }
+  }
+
+  int status = 0;
+  if (baseline) {
+    if (!bench_compare(stdout, baseline, results, count, threshold / 100)) status = 1;
+  } else {
+    bench_table(stdout, results, count);
+  }
+  if (json) {
+    FILE *out = fopen(json, "w");
+    if (out) {
+      bench_json(out, &options, results, count);
+      fclose(out);
+    } else {
+      fprintf(stderr, "Could not open output '%s'\n", json);
+      status = 1;
+    }
+  }
+
+  for (size_t i = 0; i < count; ++i) bench_result_free(&results[i]);
+  free(results);
+  return status;
+}
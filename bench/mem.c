@@ -0,0 +1,99 @@
+#include "bench.h"
+#include <llace/detail/strmap.h>
+#include <string.h>
+
+#define BENCH_ARRAY 100000
+#define BENCH_KEYS 16384 // distinct keys
+#define BENCH_LOOKUPS 100000
+
+// ================ Arrays ================ //
+
+static void bench_array_push(void *state) {
+  (void)state;
+  llace_array_t array = LLACE_NEW_ARRAY(size_t, 0);
+  for (size_t i = 0; i < BENCH_ARRAY; ++i) LLACE_ARRAY_PUSH(array, i);
+  bench_sink += LLACE_ARRAY_COUNT(array);
+  LLACE_FREE_ARRAY(array);
+}
+
+static void *bench_array_setup(const void *arg) {
+  (void)arg;
+  llace_array_t *array = malloc(sizeof(llace_array_t));
+  if (!array) { LLACE_LOG_FATAL("Failed to allocate benchmark array"); }
+  *array = LLACE_NEW_ARRAY(size_t, BENCH_ARRAY);
+  for (size_t i = 0; i < BENCH_ARRAY; ++i) LLACE_ARRAY_PUSH(*array, i);
+  return array;
+}
+
+static void bench_array_get(void *state) {
+  llace_array_t *array = state;
+  size_t sum = 0;
+  for (size_t i = 0, index = 0; i < BENCH_ARRAY; ++i, index = (index + 7919) % BENCH_ARRAY) sum += *LLACE_ARRAY_GET(size_t, *array, index);
+  bench_sink += sum;
+}
+
+static void bench_array_teardown(void *state) {
+  LLACE_FREE_ARRAY(*(llace_array_t *)state);
+  free(state);
+}
+
+// ================ String Maps ================ //
+
+typedef struct bench_keys {
+  char names[BENCH_KEYS][16];
+  size_t lens[BENCH_KEYS];
+  llace_strmap_t map;
+} bench_keys_t;
+
+// Identifier-like keys, the map is filled unless empty
+static bench_keys_t *bench_keys(bool fill) {
+  bench_keys_t *keys = malloc(sizeof(bench_keys_t));
+  if (!keys) { LLACE_LOG_FATAL("Failed to allocate benchmark keys"); }
+  for (size_t i = 0; i < BENCH_KEYS; ++i) keys->lens[i] = (size_t)snprintf(keys->names[i], sizeof(keys->names[i]), "%%v%zu.%zu", i * 31 % 97, i);
+  llace_strmap_init(&keys->map, fill ? BENCH_KEYS : 16);
+  for (size_t i = 0; fill && i < BENCH_KEYS; ++i) llace_strmap_put(&keys->map, keys->names[i], keys->lens[i], i);
+  return keys;
+}
+
+static void *bench_lookup_setup(const void *arg) { (void)arg; return bench_keys(true); }
+static void *bench_intern_setup(const void *arg) { (void)arg; return bench_keys(false); }
+
+static void bench_strmap_lookup(void *state) {
+  bench_keys_t *keys = state;
+  size_t found = 0, value;
+  for (size_t i = 0, k = 0; i < BENCH_LOOKUPS; ++i, k = (k + 4099) % BENCH_KEYS) {
+    // every other lookup misses on the last character
+    if (llace_strmap_get(&keys->map, keys->names[k], keys->lens[k] - (i & 1), &value)) found += value;
+  }
+  bench_sink += found;
+}
+
+// Every name is looked up and added the first time, as the parser does with symbols
+static void bench_strmap_intern(void *state) {
+  bench_keys_t *keys = state;
+  size_t next = 0, value;
+  for (size_t i = 0, k = 0; i < BENCH_LOOKUPS; ++i, k = (k * 5 + 1) % BENCH_KEYS) {
+    if (!llace_strmap_get(&keys->map, keys->names[k], keys->lens[k], &value)) llace_strmap_put(&keys->map, keys->names[k], keys->lens[k], next++);
+  }
+  bench_sink += next;
+}
+
+static void bench_keys_teardown(void *state) {
+  bench_keys_t *keys = state;
+  llace_strmap_free(&keys->map);
+  free(keys);
+}
+
+// ================ Suite ================ //
+
+static const bench_case_t bench_mem_cases[] = {
+  { "array.push", BENCH_ARRAY, NULL, bench_array_push, NULL, NULL },
+  { "array.get", BENCH_ARRAY, bench_array_setup, bench_array_get, bench_array_teardown, NULL },
+  { "strmap.lookup", BENCH_LOOKUPS, bench_lookup_setup, bench_strmap_lookup, bench_keys_teardown, NULL },
+  { "strmap.intern", BENCH_LOOKUPS, bench_intern_setup, bench_strmap_intern, bench_keys_teardown, NULL },
+};
+
+const bench_case_t *bench_suite_mem(size_t *count) {
+  *count = sizeof(bench_mem_cases) / sizeof(bench_mem_cases[0]);
+  return bench_mem_cases;
+}
@@ -0,0 +1,196 @@
+#include "bench.h"
+#include <llace/ir.h>
+#include <llace/codegen/jit.h>
+#include <llace/codegen/amd64/amd64.h>
+#include <llace/detail/regalloc.h>
+#include <math.h>
+#include <string.h>
+
+#define SWEEP_POINTS 6        // doublings of the grown dimension
+#define SWEEP_SUPERLINEAR 1.25 // fitted exponent of time or memory over size
+#define SWEEP_TAIL 3           // largest points, fitted again on their own
+#define SWEEP_TAIL_LIMIT 1.5   // exponent over the tail, past it growth is speeding up
+
+// Grows one dimension of a generated module and compiles every size: parse,
+// inlining, the loop and dead code passes and the JIT, or only one stage of
+// it. A power law is fit to time and peak memory against the statements
+// generated, an exponent well above one is superlinear behavior. The largest
+// points are fit once more, a quadratic tail hides in the fit over all of
+// them when the small sizes are cheap.
+
+// ================ Compile ================ //
+
+typedef struct sweep_state {
+  llace_ir_context_t ctx;
+  llace_config_t config;
+  llace_jit_t jit;
+  char *src;
+} sweep_state_t;
+
+static void *sweep_setup(const void *arg) {
+  sweep_state_t *state = malloc(sizeof(sweep_state_t));
+  if (!state) { LLACE_LOG_FATAL("Failed to allocate sweep state"); }
+  state->src = bench_generate(arg, NULL);
+  llace_config_init(&state->config);
+  llace_ir_context_init(&state->ctx);
+  return state;
+}
+
+static void sweep_compile(void *arg) {
+  sweep_state_t *state = arg;
+  llace_ir_context_t *ctx = &state->ctx;
+  if (llace_ir_parse(ctx, state->src, strlen(state->src)) != LLACE_ERROR_NONE) { LLACE_LOG_FATAL("Generated module does not parse"); }
+  llace_ir_inline_stats_t inlined;
+  llace_ir_opt_inline(ctx, &state->config, &inlined);
+  for (size_t f = 0; f < LLACE_ARRAY_COUNT(ctx->funcmap.funcs); ++f) {
+    llace_ir_function_t *fn = LLACE_IR_FUNCTION(ctx, f);
+    llace_ir_licm_stats_t licm;
+    llace_ir_indvar_stats_t indvars;
+    llace_ir_adce_stats_t adce;
+    llace_ir_opt_licm(ctx, fn, &licm);
+    llace_ir_opt_indvars(ctx, fn, &indvars);
+    llace_ir_opt_adce(ctx, fn, &adce);
+  }
+  if (llace_jit_init(&state->jit, ctx, &state->config) != LLACE_ERROR_NONE) { LLACE_LOG_FATAL("Failed to create sweep JIT"); }
+  size_t compiled = 0;
+  for (size_t f = 0; f < LLACE_ARRAY_COUNT(ctx->funcmap.funcs); ++f) {
+    void *entry;
+    compiled += llace_jit_add(&state->jit, f, &entry) == LLACE_ERROR_NONE;
+  }
+  bench_sink += compiled;
+}
+
+static void sweep_teardown(void *arg) {
+  sweep_state_t *state = arg;
+  llace_jit_free(&state->jit);
+  llace_ir_context_free(&state->ctx);
+  free(state->src);
+  free(state);
+}
+
+// ================ Liveness ================ //
+
+// Live intervals of every function of a parsed module, one function large enough shows the per block cost
+static void *sweep_live_setup(const void *arg) {
+  sweep_state_t *state = sweep_setup(arg);
+  if (llace_ir_parse(&state->ctx, state->src, strlen(state->src)) != LLACE_ERROR_NONE) { LLACE_LOG_FATAL("Generated module does not parse"); }
+  return state;
+}
+
+static void sweep_live(void *arg) {
+  sweep_state_t *state = arg;
+  for (size_t f = 0; f < LLACE_ARRAY_COUNT(state->ctx.funcmap.funcs); ++f) {
+    llace_ra_live_t live;
+    if (llace_ra_live_build(&state->ctx, LLACE_IR_FUNCTION(&state->ctx, f), llace_amd64_regset(), &live) != LLACE_ERROR_NONE) continue;
+    bench_sink += LLACE_ARRAY_COUNT(live.intervals);
+    llace_ra_live_free(&live);
+  }
+}
+
+static void sweep_live_teardown(void *arg) {
+  sweep_state_t *state = arg;
+  llace_ir_context_free(&state->ctx);
+  free(state->src);
+  free(state);
+}
+
+// ================ Sweeps ================ //
+
+typedef struct sweep {
+  const char *name;
+  size_t grown; // offset of the dimension in bench_shape_t
+  bench_shape_t base;
+  void *(*setup)(const void *arg);
+  void (*run)(void *state);
+  void (*teardown)(void *state);
+} sweep_t;
+
+static const sweep_t sweeps[] = {
+  { "sweep.functions", offsetof(bench_shape_t, functions), { .functions = 8, .blocks = 16, .insts = 4, .loop_depth = 2, .phi_density = 0.5, .fanout = 2 },
+    sweep_setup, sweep_compile, sweep_teardown },
+  { "sweep.blocks", offsetof(bench_shape_t, blocks), { .functions = 4, .blocks = 16, .insts = 4, .loop_depth = 2, .phi_density = 0.5, .fanout = 2 },
+    sweep_setup, sweep_compile, sweep_teardown },
+  { "sweep.insts", offsetof(bench_shape_t, insts), { .functions = 4, .blocks = 8, .insts = 4, .loop_depth = 2, .phi_density = 0.5, .fanout = 2 },
+    sweep_setup, sweep_compile, sweep_teardown },
+  { "sweep.liveness", offsetof(bench_shape_t, blocks), { .functions = 1, .blocks = 128, .insts = 4, .loop_depth = 2, .phi_density = 0.5, .fanout = 0 },
+    sweep_live_setup, sweep_live, sweep_live_teardown },
+};
+
+// ================ Fit ================ //
+
+// Least squares slope of log y over log x
+static double sweep_exponent(const double *x, const double *y, size_t count) {
+  double mx = 0, my = 0, sxy = 0, sxx = 0;
+  for (size_t i = 0; i < count; ++i) mx += log(x[i]) / count, my += log(y[i]) / count;
+  for (size_t i = 0; i < count; ++i) {
+    sxy += (log(x[i]) - mx) * (log(y[i]) - my);
+    sxx += (log(x[i]) - mx) * (log(x[i]) - mx);
+  }
+  return sxx > 0 ? sxy / sxx : 0;
+}
+
+// ================ Sweep ================ //
+
+bool bench_sweep(FILE *out, FILE *json, const bench_options_t *options, uint64_t seed) {
+  bool linear = true;
+  size_t written = 0;
+  if (json) fprintf(json, "{\"seed\":%llu,\"samples\":%zu,\"sweeps\":[", (unsigned long long)seed, options->samples);
+
+  for (size_t s = 0; s < sizeof(sweeps) / sizeof(sweeps[0]); ++s) {
+    const sweep_t *sweep = &sweeps[s];
+    if (options->filter && !strstr(sweep->name, options->filter)) continue;
+    bench_shape_t shapes[SWEEP_POINTS];
+    bench_result_t results[SWEEP_POINTS];
+    double sizes[SWEEP_POINTS], times[SWEEP_POINTS], bytes[SWEEP_POINTS];
+
+    fprintf(out, "%s, seed %llu\n%10s %12s %12s %12s %12s %12s %8s\n", sweep->name, (unsigned long long)seed, "size", "statements", "median ms",
+            "ns/stmt", "peak KiB", "bytes/stmt", "growth");
+    for (size_t p = 0; p < SWEEP_POINTS; ++p) {
+      shapes[p] = sweep->base;
+      shapes[p].seed = seed;
+      *(size_t *)((char *)&shapes[p] + sweep->grown) <<= p;
+      size_t statements;
+      free(bench_generate(&shapes[p], &statements));
+
+      bench_case_t bench = { sweep->name, statements, sweep->setup, sweep->run, sweep->teardown, &shapes[p] };
+      bench_run(&bench, options, &results[p]);
+      sizes[p] = (double)statements;
+      times[p] = results[p].median * statements;
+      bytes[p] = results[p].peak_bytes ? (double)results[p].peak_bytes : 1;
+      fprintf(out, "%10zu %12zu %12.3f %12.1f %12.1f %12.1f", *(size_t *)((char *)&shapes[p] + sweep->grown), statements, times[p] / 1e6,
+              results[p].median, bytes[p] / 1024.0, bytes[p] / statements);
+      // Exponent of the step from the previous size, two for a doubling that quadruples the time
+      if (p > 0) fprintf(out, " %8.2f", sweep_exponent(&sizes[p - 1], &times[p - 1], 2));
+      fputc('\n', out);
+    }
+
+    const size_t tail = SWEEP_POINTS - SWEEP_TAIL;
+    double time_exponent = sweep_exponent(sizes, times, SWEEP_POINTS), memory_exponent = sweep_exponent(sizes, bytes, SWEEP_POINTS);
+    double time_tail = sweep_exponent(&sizes[tail], &times[tail], SWEEP_TAIL), memory_tail = sweep_exponent(&sizes[tail], &bytes[tail], SWEEP_TAIL);
+    bool superlinear = time_exponent > SWEEP_SUPERLINEAR || memory_exponent > SWEEP_SUPERLINEAR || time_tail > SWEEP_TAIL_LIMIT ||
+                       memory_tail > SWEEP_TAIL_LIMIT;
+    fprintf(out, "time ~ n^%.2f (n^%.2f over the largest %d), memory ~ n^%.2f (n^%.2f)%s\n\n", time_exponent, time_tail, SWEEP_TAIL,
+            memory_exponent, memory_tail, superlinear ? ", SUPERLINEAR" : "");
+    linear &= !superlinear;
+
+    if (json) {
+      fprintf(json,
+              "%s\n{\"name\":\"%s\",\"time_exponent\":%.3f,\"memory_exponent\":%.3f,\"time_tail_exponent\":%.3f,\"memory_tail_exponent\":%.3f,"
+              "\"superlinear\":%s,\"points\":[",
+              written++ ? "," : "", sweep->name, time_exponent, memory_exponent, time_tail, memory_tail, superlinear ? "true" : "false");
+      for (size_t p = 0; p < SWEEP_POINTS; ++p) {
+        const bench_shape_t *shape = &shapes[p];
+        fprintf(json,
+                "%s{\"functions\":%zu,\"blocks\":%zu,\"insts\":%zu,\"loop_depth\":%zu,\"phi_density\":%.2f,\"fanout\":%zu,"
+                "\"statements\":%zu,\"median_ns\":%.1f,\"p95_ns\":%.1f,\"peak_bytes\":%zu}",
+                p ? "," : "", shape->functions, shape->blocks, shape->insts, shape->loop_depth, shape->phi_density, shape->fanout,
+                results[p].ops, times[p], results[p].p95 * results[p].ops, results[p].peak_bytes);
+      }
+      fprintf(json, "]}");
+    }
+    for (size_t p = 0; p < SWEEP_POINTS; ++p) bench_result_free(&results[p]);
+  }
+
+  if (json) fprintf(json, "\n]}\n");
+  return linear;
+}
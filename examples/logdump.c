@@ -0,0 +1,28 @@
+// Renders a binary trace from llace_log_trace_start as text
+// Usage: logdump <trace> [output]
+#include <llace/log.h>
+
+int main(int argc, char *argv[]) {
+  if (argc < 2 || argc > 3) {
+    fprintf(stderr, "Usage: %s <trace> [output]\n", argv[0]);
+    return 2;
+  }
+
+  FILE *in = fopen(argv[1], "rb");
+  if (!in) {
+    fprintf(stderr, "Could not open trace '%s'\n", argv[1]);
+    return 1;
+  }
+  FILE *out = argc == 3 ? fopen(argv[2], "w") : stdout;
+  if (!out) {
+    fprintf(stderr, "Could not open output '%s'\n", argv[2]);
+    fclose(in);
+    return 1;
+  }
+
+  bool ok = llace_log_decode(in, out);
+  if (!ok) fprintf(stderr, "Trace '%s' is malformed or truncated\n", argv[1]);
+  fclose(in);
+  if (out != stdout) fclose(out);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,159 @@
+#ifndef LLACE_CODEGEN_AMD64_H
+#define LLACE_CODEGEN_AMD64_H
+
+#include <llace/codegen/regalloc.h>
+#include <llace/codegen/buffer.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ================ Registers ================ //
+
+// General purpose registers in encoding order
+typedef enum {
+  LLACE_AMD64_RAX, LLACE_AMD64_RCX, LLACE_AMD64_RDX, LLACE_AMD64_RBX,
+  LLACE_AMD64_RSP, LLACE_AMD64_RBP, LLACE_AMD64_RSI, LLACE_AMD64_RDI,
+  LLACE_AMD64_R8,  LLACE_AMD64_R9,  LLACE_AMD64_R10, LLACE_AMD64_R11,
+  LLACE_AMD64_R12, LLACE_AMD64_R13, LLACE_AMD64_R14, LLACE_AMD64_R15,
+} llace_amd64_gpr_t;
+
+// Vector registers are numbered xmm0 - xmm15 in the same way
+
+// System V register set: rax, rcx, rdx and r11 are kept for instruction
+// selection (division, shifts, scratch), xmm14 and xmm15 likewise.
+const llace_regset_t *llace_amd64_regset(void);
+
+// ================ Instructions ================ //
+
+typedef enum {
+  // Integer
+  LLACE_AMD64_MOV, LLACE_AMD64_MOVZX, LLACE_AMD64_MOVSX, LLACE_AMD64_MOVSXD, LLACE_AMD64_LEA,
+  LLACE_AMD64_ADD, LLACE_AMD64_OR, LLACE_AMD64_ADC, LLACE_AMD64_SBB, LLACE_AMD64_AND, LLACE_AMD64_SUB, LLACE_AMD64_XOR, LLACE_AMD64_CMP,
+  LLACE_AMD64_TEST, LLACE_AMD64_NOT, LLACE_AMD64_NEG, LLACE_AMD64_MUL, LLACE_AMD64_IMUL, LLACE_AMD64_DIV, LLACE_AMD64_IDIV,
+  LLACE_AMD64_ROL, LLACE_AMD64_ROR, LLACE_AMD64_SHL, LLACE_AMD64_SHR, LLACE_AMD64_SAR,
+  LLACE_AMD64_CMOVCC, LLACE_AMD64_SETCC, LLACE_AMD64_CDQ, LLACE_AMD64_CQO,
+  // Control flow and stack
+  LLACE_AMD64_PUSH, LLACE_AMD64_POP, LLACE_AMD64_CALL, LLACE_AMD64_RET, LLACE_AMD64_JMP, LLACE_AMD64_JCC,
+  LLACE_AMD64_NOP, LLACE_AMD64_INT3, LLACE_AMD64_UD2,
+  // SSE
+  LLACE_AMD64_MOVD, LLACE_AMD64_MOVQ, LLACE_AMD64_MOVSS, LLACE_AMD64_MOVSD, LLACE_AMD64_MOVAPS, LLACE_AMD64_MOVUPS, LLACE_AMD64_MOVDQA, LLACE_AMD64_MOVDQU,
+  LLACE_AMD64_ADDSS, LLACE_AMD64_ADDSD, LLACE_AMD64_ADDPS, LLACE_AMD64_ADDPD, LLACE_AMD64_SUBSS, LLACE_AMD64_SUBSD, LLACE_AMD64_SUBPS, LLACE_AMD64_SUBPD,
+  LLACE_AMD64_MULSS, LLACE_AMD64_MULSD, LLACE_AMD64_MULPS, LLACE_AMD64_MULPD, LLACE_AMD64_DIVSS, LLACE_AMD64_DIVSD, LLACE_AMD64_DIVPS, LLACE_AMD64_DIVPD,
+  LLACE_AMD64_SQRTSS, LLACE_AMD64_SQRTSD, LLACE_AMD64_UCOMISS, LLACE_AMD64_UCOMISD,
+  LLACE_AMD64_CVTSI2SS, LLACE_AMD64_CVTSI2SD, LLACE_AMD64_CVTTSS2SI, LLACE_AMD64_CVTTSD2SI, LLACE_AMD64_CVTSS2SD, LLACE_AMD64_CVTSD2SS,
+  LLACE_AMD64_ANDPS, LLACE_AMD64_ORPS, LLACE_AMD64_XORPS,
+  LLACE_AMD64_PADDB, LLACE_AMD64_PADDW, LLACE_AMD64_PADDD, LLACE_AMD64_PADDQ, LLACE_AMD64_PSUBB, LLACE_AMD64_PSUBW, LLACE_AMD64_PSUBD, LLACE_AMD64_PSUBQ,
+  LLACE_AMD64_PMULLW, LLACE_AMD64_PMULLD, LLACE_AMD64_PAND, LLACE_AMD64_PANDN, LLACE_AMD64_POR, LLACE_AMD64_PXOR,
+  LLACE_AMD64_PCMPEQD, LLACE_AMD64_PCMPGTD, LLACE_AMD64_PSLLD, LLACE_AMD64_PSRLD, LLACE_AMD64_PSRAD,
+  LLACE_AMD64_PSHUFD, LLACE_AMD64_SHUFPS, LLACE_AMD64_PEXTRD, LLACE_AMD64_PEXTRQ, LLACE_AMD64_PINSRD, LLACE_AMD64_PINSRQ,
+  // AVX, AVX2 and AVX-512 (EVEX when a zmm or xmm16 - xmm31 is used)
+  LLACE_AMD64_VMOVUPS, LLACE_AMD64_VMOVDQU, LLACE_AMD64_VADDPS, LLACE_AMD64_VADDPD, LLACE_AMD64_VSUBPS, LLACE_AMD64_VSUBPD,
+  LLACE_AMD64_VMULPS, LLACE_AMD64_VMULPD, LLACE_AMD64_VDIVPS, LLACE_AMD64_VDIVPD, LLACE_AMD64_VFMADD231PS, LLACE_AMD64_VFMADD231PD,
+  LLACE_AMD64_VPADDB, LLACE_AMD64_VPADDW, LLACE_AMD64_VPADDD, LLACE_AMD64_VPADDQ, LLACE_AMD64_VPSUBB, LLACE_AMD64_VPSUBW, LLACE_AMD64_VPSUBD, LLACE_AMD64_VPSUBQ,
+  LLACE_AMD64_VPMULLW, LLACE_AMD64_VPMULLD,
+  LLACE_AMD64_VPAND, LLACE_AMD64_VPOR, LLACE_AMD64_VPXOR, LLACE_AMD64_VXORPS,
+  LLACE_AMD64_VBROADCASTSS, LLACE_AMD64_VPBROADCASTB, LLACE_AMD64_VPBROADCASTW, LLACE_AMD64_VPBROADCASTD, LLACE_AMD64_VPBROADCASTQ, LLACE_AMD64_VEXTRACTI128, LLACE_AMD64_VZEROUPPER,
+  LLACE_AMD64_MNEMONIC_COUNT
+} llace_amd64_mnemonic_t;
+
+// Condition codes of jcc, setcc and cmovcc in encoding order
+typedef enum {
+  LLACE_AMD64_CC_O, LLACE_AMD64_CC_NO, LLACE_AMD64_CC_B, LLACE_AMD64_CC_AE,
+  LLACE_AMD64_CC_E, LLACE_AMD64_CC_NE, LLACE_AMD64_CC_BE, LLACE_AMD64_CC_A,
+  LLACE_AMD64_CC_S, LLACE_AMD64_CC_NS, LLACE_AMD64_CC_P, LLACE_AMD64_CC_NP,
+  LLACE_AMD64_CC_L, LLACE_AMD64_CC_GE, LLACE_AMD64_CC_LE, LLACE_AMD64_CC_G,
+} llace_amd64_cond_t;
+
+typedef enum {
+  LLACE_AMD64_OPND_NONE,
+  LLACE_AMD64_OPND_GPR,
+  LLACE_AMD64_OPND_VEC,
+  LLACE_AMD64_OPND_MEM,
+  LLACE_AMD64_OPND_IMM,
+  LLACE_AMD64_OPND_REL, // branch target relative to the end of the instruction
+} llace_amd64_opkind_t;
+
+#define LLACE_AMD64_NOREG (-1)
+#define LLACE_AMD64_RIP 16 // memory base for rip relative addressing
+
+typedef struct llace_amd64_operand {
+  llace_amd64_opkind_t kind;
+  uint8_t size;   // bytes: 1, 2, 4, 8 for integers and memory, 16, 32, 64 for vectors
+  uint8_t reg;    // GPR: 0 - 15, VEC: 0 - 31
+  int8_t base;    // MEM: register, LLACE_AMD64_RIP or LLACE_AMD64_NOREG
+  int8_t index;   // MEM: register (not rsp) or LLACE_AMD64_NOREG
+  uint8_t scale;  // MEM: 1, 2, 4, 8
+  int32_t disp;   // MEM: displacement, relative to the end of the instruction for rip
+  int64_t imm;    // IMM, REL
+} llace_amd64_operand_t;
+
+#define LLACE_AMD64_GPR(r, bytes) ((llace_amd64_operand_t){ .kind = LLACE_AMD64_OPND_GPR, .size = (bytes), .reg = (r) })
+#define LLACE_AMD64_VEC(r, bytes) ((llace_amd64_operand_t){ .kind = LLACE_AMD64_OPND_VEC, .size = (bytes), .reg = (r) })
+#define LLACE_AMD64_MEM(bytes, b, i, s, d) ((llace_amd64_operand_t){ .kind = LLACE_AMD64_OPND_MEM, .size = (bytes), .base = (b), .index = (i), .scale = (s), .disp = (d) })
+#define LLACE_AMD64_BASE(bytes, b, d) LLACE_AMD64_MEM(bytes, b, LLACE_AMD64_NOREG, 1, d)
+#define LLACE_AMD64_RIPREL(bytes, d) LLACE_AMD64_MEM(bytes, LLACE_AMD64_RIP, LLACE_AMD64_NOREG, 1, d)
+#define LLACE_AMD64_IMM(value) ((llace_amd64_operand_t){ .kind = LLACE_AMD64_OPND_IMM, .imm = (value) })
+#define LLACE_AMD64_REL(value) ((llace_amd64_operand_t){ .kind = LLACE_AMD64_OPND_REL, .imm = (value) })
+
+typedef struct llace_amd64_inst {
+  llace_amd64_mnemonic_t mnemonic;
+  llace_amd64_cond_t cond; // jcc, setcc, cmovcc
+  uint8_t count;
+  llace_amd64_operand_t ops[4]; // Intel order, destination first
+} llace_amd64_inst_t;
+
+// Where the 32-bit rip displacement or branch offset of an instruction went
+typedef struct llace_amd64_fixup {
+  size_t offset; // of the field in the buffer, SIZE_MAX if the instruction has none
+  size_t end;    // end of the instruction, the field is relative to it
+} llace_amd64_fixup_t;
+
+// Longest encoding of one instruction
+#define LLACE_AMD64_MAX_INST 15
+
+// ================ Encoding ================ //
+
+// Appends the shortest encoding the form table has for the operands (legacy
+// with REX, VEX, or EVEX for 512-bit and upper vector registers). Nothing is
+// written and LLACE_ERROR_BADARG returned if no form matches. fixup may be NULL.
+llace_error_t llace_amd64_encode(llace_codebuf_t *buf, const llace_amd64_inst_t *inst, llace_amd64_fixup_t *fixup);
+
+// ================ Instruction Selection ================ //
+
+// What the rip displacement or branch offset of a selected instruction refers to
+typedef enum {
+  LLACE_AMD64_SYM_NONE,
+  LLACE_AMD64_SYM_LABEL,  // label of the selected code
+  LLACE_AMD64_SYM_FUNC,   // function of the context
+  LLACE_AMD64_SYM_GLOBAL, // global of the context
+} llace_amd64_symkind_t;
+
+typedef struct llace_amd64_minst {
+  llace_amd64_inst_t inst; // rip and rel operands hold 0 until the target is known
+  llace_amd64_symkind_t sym;
+  size_t target; // label, function or global index
+} llace_amd64_minst_t;
+
+typedef struct llace_amd64_code {
+  llace_array_t insts;  // llace_amd64_minst_t: prologue, blocks in allocation order, edge stubs
+  llace_array_t labels; // size_t first instruction per label: one per block (SIZE_MAX if unreachable), then the edge stubs
+  size_t frame;         // bytes of spill slots (and vector scratch) below the saved registers
+  size_t cost;          // summed rule costs of the selected statements
+} llace_amd64_code_t;
+
+// Selects instructions for a function allocated with llace_amd64_regset(),
+// best after llace_isel_fold so comparisons and addresses reach their users.
+// Operands are the allocated registers and rbp based spill slots, temporaries
+// of a statement live in rax, rcx, rdx, r11, xmm14 and xmm15. Vectors of 16
+// and 32 bytes select VEX forms (AVX2, llace_isel_scalarize lowers the rest
+// first), packs and extracts go through 32 bytes of scratch below the spill
+// slots. Stack passed arguments are not selected (LLACE_ERROR_OVERFLOW).
+llace_error_t llace_amd64_select(const llace_ir_context_t *ctx, const llace_ir_function_t *fn, const llace_regalloc_t *ra, llace_amd64_code_t *code);
+void llace_amd64_code_free(llace_amd64_code_t *code);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LLACE_CODEGEN_AMD64_H
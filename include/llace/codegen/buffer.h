@@ -0,0 +1,36 @@
+#ifndef LLACE_CODEGEN_BUFFER_H
+#define LLACE_CODEGEN_BUFFER_H
+
+#include <llace/llace.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ================ Code Buffer ================ //
+
+// Growable byte buffer for emitted code. Emitters reserve the worst case
+// size of what they are about to write and fill it in place, so there is
+// no allocation per instruction once the buffer is large enough.
+typedef struct llace_codebuf {
+  uint8_t *data;
+  size_t size;
+  size_t capacity;
+} llace_codebuf_t;
+
+llace_error_t llace_codebuf_init(llace_codebuf_t *buf, size_t capacity);
+void llace_codebuf_free(llace_codebuf_t *buf);
+// Make room for at least extra more bytes, the capacity doubles
+void llace_codebuf_grow(llace_codebuf_t *buf, size_t extra);
+
+#define LLACE_CODEBUF_RESERVE(buf, extra) do { if ((buf)->capacity - (buf)->size < (extra)) llace_codebuf_grow((buf), (extra)); } while (0)
+
+void llace_codebuf_write(llace_codebuf_t *buf, const void *data, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LLACE_CODEGEN_BUFFER_H
@@ -0,0 +1,101 @@
+#ifndef LLACE_CODEGEN_ELF_H
+#define LLACE_CODEGEN_ELF_H
+
+#include <llace/llace.h>
+#include <llace/mem.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ELF64 relocatable objects for x86-64 Linux. Sections collect borrowed
+// chunks of their contents, nothing is copied: the layout is computed when
+// the object is written and the chunks go straight to the file with
+// writev in one pass, headers and tables through a small staging buffer.
+// Names and chunk data have to stay alive until the object is written.
+
+// ================ Objects ================ //
+
+typedef enum {
+  LLACE_ELF_TEXT,   // .text like: allocated, executable
+  LLACE_ELF_DATA,   // .data like: allocated, writable
+  LLACE_ELF_RODATA, // .rodata like: allocated
+  LLACE_ELF_BSS,    // .bss like: allocated, writable, no file contents
+} llace_elf_sectkind_t;
+
+typedef enum {
+  LLACE_ELF_NOTYPE,
+  LLACE_ELF_OBJECT,
+  LLACE_ELF_FUNC,
+} llace_elf_symkind_t;
+
+// x86-64 relocation types, the value is the ELF one
+typedef enum {
+  LLACE_ELF_R_64 = 1,    // S + A
+  LLACE_ELF_R_PC32 = 2,  // S + A - P
+  LLACE_ELF_R_PLT32 = 4, // L + A - P, calls
+  LLACE_ELF_R_32 = 10,   // S + A, zero extended
+  LLACE_ELF_R_32S = 11,  // S + A, sign extended
+} llace_elf_reltype_t;
+
+#define LLACE_ELF_UNDEF SIZE_MAX // section of undefined symbols
+
+typedef struct llace_elf_chunk {
+  const void *data; // NULL in BSS sections
+  size_t size;
+} llace_elf_chunk_t;
+
+typedef struct llace_elf_reloc {
+  size_t offset; // in the section
+  size_t symbol;
+  llace_elf_reltype_t type;
+  int64_t addend;
+} llace_elf_reloc_t;
+
+typedef struct llace_elf_section {
+  const char *name;
+  llace_elf_sectkind_t kind;
+  size_t align;
+  size_t size;
+  llace_array_t chunks; // llace_elf_chunk_t
+  llace_array_t relocs; // llace_elf_reloc_t
+} llace_elf_section_t;
+
+typedef struct llace_elf_symbol {
+  const char *name;
+  size_t section; // LLACE_ELF_UNDEF if defined elsewhere
+  size_t value, size;
+  llace_elf_symkind_t kind;
+  bool global;
+} llace_elf_symbol_t;
+
+typedef struct llace_elf {
+  llace_array_t sections; // llace_elf_section_t
+  llace_array_t symbols;  // llace_elf_symbol_t
+  struct llace_strmap *names; // symbol name -> index
+} llace_elf_t;
+
+void llace_elf_init(llace_elf_t *elf);
+void llace_elf_free(llace_elf_t *elf);
+
+// New empty section, align is a power of two
+llace_error_t llace_elf_section(llace_elf_t *elf, const char *name, llace_elf_sectkind_t kind, size_t align, size_t *index);
+// Appends size bytes of data (NULL for BSS) to the section, offset receives where they start
+llace_error_t llace_elf_append(llace_elf_t *elf, size_t section, const void *data, size_t size, size_t *offset);
+// Symbols are unique by name, an undefined one may be defined later
+llace_error_t llace_elf_symbol(llace_elf_t *elf, const char *name, size_t section, size_t value, size_t size, llace_elf_symkind_t kind,
+                               bool global, size_t *index);
+llace_error_t llace_elf_reloc(llace_elf_t *elf, size_t section, size_t offset, size_t symbol, llace_elf_reltype_t type, int64_t addend);
+
+// ================ Output ================ //
+
+// Bytes llace_elf_write produces
+size_t llace_elf_size(const llace_elf_t *elf);
+llace_error_t llace_elf_write_fd(const llace_elf_t *elf, int fd);
+llace_error_t llace_elf_write(const llace_elf_t *elf, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LLACE_CODEGEN_ELF_H
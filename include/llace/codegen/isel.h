@@ -0,0 +1,127 @@
+#ifndef LLACE_CODEGEN_ISEL_H
+#define LLACE_CODEGEN_ISEL_H
+
+#include <llace/ir/stack.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Instruction selection by bottom-up rewriting (BURS). Every statement is
+// turned into a tree, the tree is labelled bottom-up with the cheapest rule
+// deriving each nonterminal at every node (dynamic programming over the
+// rule costs), and the cheapest derivation of the start nonterminal at the
+// root is reduced top-down, calling the target for every rule used.
+//
+// Targets describe themselves with a rule table: a rule rewrites a tree
+// pattern into a nonterminal. Patterns are written in prefix order, operators
+// take as many sub-patterns as the tree node has kids, nonterminals match a
+// whole subtree already labelled with that nonterminal:
+//
+//   reg: ADD(reg, imm)  ->  { REG, cost, LLACE_ISEL_ADD, NT(REG), NT(IMM) }
+
+// ================ Trees ================ //
+
+// Tree operators: the IR opcodes, then the leaves
+enum {
+  LLACE_ISEL_CONST = LLACE_IR_OP_COUNT,
+  LLACE_ISEL_VAR,
+  LLACE_ISEL_GLOBAL,
+  LLACE_ISEL_BLOCK,
+  LLACE_ISEL_OP_COUNT
+};
+
+#define LLACE_ISEL_MAX_NT 16
+#define LLACE_ISEL_NOCOST UINT16_MAX
+
+typedef struct llace_isel_node {
+  uint16_t op;
+  const llace_ir_value_t *value; // the leaf or instruction in the block stack
+  llace_ir_type_t type;          // result type, comparisons give i1
+  size_t depth;                  // pointer depth of the result
+  size_t first, count;           // kids in llace_isel_tree_t.kids, in stack order
+  uint16_t cost[LLACE_ISEL_MAX_NT]; // cheapest derivation per nonterminal
+  uint16_t rule[LLACE_ISEL_MAX_NT];
+} llace_isel_node_t;
+
+typedef struct llace_isel_tree {
+  llace_array_t nodes; // llace_isel_node_t, kids before their parents, the root last
+  llace_array_t kids;  // size_t
+} llace_isel_tree_t;
+
+#define LLACE_ISEL_NODE(tree, index) LLACE_ARRAY_GET(llace_isel_node_t, (tree)->nodes, (index))
+#define LLACE_ISEL_KID(tree, node, k) (*LLACE_ARRAY_GET(size_t, (tree)->kids, (node)->first + (k)))
+#define LLACE_ISEL_ROOT(tree) (LLACE_ARRAY_COUNT((tree)->nodes) - 1)
+
+void llace_isel_tree_init(llace_isel_tree_t *tree);
+void llace_isel_tree_free(llace_isel_tree_t *tree);
+// Tree of one statement, phi statements give an empty tree
+llace_error_t llace_isel_tree_build(const llace_ir_context_t *ctx, const llace_ir_function_t *fn, const llace_ir_basicblock_t *block,
+                                    const llace_ir_stmt_t *stmt, llace_isel_tree_t *tree);
+
+// ================ Targets ================ //
+
+#define LLACE_ISEL_NT(nt) (0x80 | (nt)) // pattern symbol of a nonterminal
+#define LLACE_ISEL_IS_NT(sym) (((sym) & 0x80) != 0)
+#define LLACE_ISEL_MAX_PATTERN 8
+
+enum {
+  LLACE_ISEL_VARIADIC = 1 << 0, // the one sub-pattern applies to every kid (calls)
+};
+
+typedef struct llace_isel_rule {
+  uint8_t lhs;  // nonterminal derived
+  uint8_t cost; // instructions, roughly
+  uint8_t pattern[LLACE_ISEL_MAX_PATTERN];
+  uint8_t length;
+  uint8_t flags;
+  uint8_t pred;   // target predicate checked on the pattern root, 0 for none
+  uint16_t action; // target action run when the rule is reduced
+} llace_isel_rule_t;
+
+// A subtree matched by a nonterminal of a pattern, reduced before the rule
+typedef struct llace_isel_leaf {
+  size_t node;
+  uint8_t nt;
+} llace_isel_leaf_t;
+
+typedef struct llace_isel_target {
+  const llace_isel_rule_t *rules;
+  size_t rule_count;
+  uint8_t start; // nonterminal of statements
+  bool (*accept)(void *user, const llace_isel_tree_t *tree, size_t node, unsigned pred);
+  llace_error_t (*reduce)(void *user, const llace_isel_tree_t *tree, size_t node, const llace_isel_rule_t *rule,
+                          const llace_isel_leaf_t *leaves, size_t count);
+} llace_isel_target_t;
+
+// ================ Selection ================ //
+
+// Label every node, false if the root has no derivation of the start nonterminal
+bool llace_isel_label(const llace_isel_target_t *target, void *user, llace_isel_tree_t *tree);
+// Reduce the labelled tree from its root, returns the summed rule costs in cost
+llace_error_t llace_isel_reduce(const llace_isel_target_t *target, void *user, const llace_isel_tree_t *tree, size_t *cost);
+
+// Moves single use definitions into the statement using them (later in the
+// same block, nothing in between that could change what they compute), so
+// comparisons meet their branch and address arithmetic its load or store.
+// Packs take none, every lane is held until the pack. Run before register
+// allocation, the folded variables are left unused.
+llace_error_t llace_isel_fold(llace_ir_function_t *fn, size_t *folded);
+
+// Rewrites vector statements into one scalar statement per lane, unless the
+// target selects every vector of the function (llace_target_cost supports
+// each operation at its width): then only pack lanes that are not variables
+// or integer constants are computed into temporaries first, and scalarized
+// is 0. A NULL target scalarizes every vector. Scalarizing gives every
+// vector variable a scalar variable per lane, splats and packs become those
+// lanes, load<n>/store<n> one access per element (every lane stored after
+// all are computed) and extracts read the lane directly. Vector parameters,
+// returns and call arguments are rejected (LLACE_ERROR_INVLTYPE). Run before
+// folding.
+llace_error_t llace_isel_scalarize(const llace_ir_context_t *ctx, llace_ir_function_t *fn, const llace_target_t *target, size_t *scalarized);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LLACE_CODEGEN_ISEL_H
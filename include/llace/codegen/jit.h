@@ -0,0 +1,73 @@
+#ifndef LLACE_CODEGEN_JIT_H
+#define LLACE_CODEGEN_JIT_H
+
+#include <llace/ir/stack.h>
+#include <llace/codegen/amd64/amd64.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// In-process execution of IR functions on the AMD64 host. Functions are
+// scalarized where the configured target lacks their vectors and folded
+// (in place), allocated, selected and encoded, then
+// copied into one reserved address range so every call and global is in
+// rel32 reach, and the relocations are applied in place. Pages are writable while they are
+// filled and executable after, never both (W^X).
+//
+// Adding a function compiles it together with every function it reaches
+// that is not compiled yet, into one code region. Removing a function
+// returns its region once nothing in it is left, code still calling into
+// a removed function must be removed first.
+
+// ================ Engine ================ //
+
+#define LLACE_JIT_RESERVE ((size_t)1 << 30) // address space reserved for code and globals
+
+typedef struct llace_jit_func {
+  void *entry;   // NULL until compiled
+  size_t region; // code region holding it
+} llace_jit_func_t;
+
+typedef struct llace_jit_region {
+  size_t offset, size; // pages of the reserved range
+  size_t live;         // functions in it not removed yet
+} llace_jit_region_t;
+
+typedef struct llace_jit_stats {
+  size_t functions; // compiled
+  size_t bytes;     // of machine code
+  size_t pages;     // in use, code and globals
+  size_t vector;    // VEX instructions selected for vector statements
+} llace_jit_stats_t;
+
+typedef struct llace_jit {
+  llace_ir_context_t *ctx;
+  llace_config_t config;
+  uint8_t *base;        // reserved range, LLACE_JIT_RESERVE bytes
+  size_t page, used;    // page size, bytes of the range handed out so far
+  llace_array_t free;   // llace_jit_region_t, released ranges to reuse
+  llace_array_t regions; // llace_jit_region_t
+  llace_array_t funcs;   // llace_jit_func_t per function of the context
+  llace_array_t globals; // uint8_t * per global of the context, NULL until referenced
+  uint8_t *data;         // next free byte of the current globals page
+  size_t data_left;
+  llace_jit_stats_t stats;
+} llace_jit_t;
+
+// config may be NULL for the defaults, it picks the register allocator
+llace_error_t llace_jit_init(llace_jit_t *jit, llace_ir_context_t *ctx, const llace_config_t *config);
+void llace_jit_free(llace_jit_t *jit);
+
+// Compiles the function (and what it calls) unless it is already, entry receives the callable code
+llace_error_t llace_jit_add(llace_jit_t *jit, size_t function, void **entry);
+// Frees the code of the function, its region goes back once every function in it is removed
+llace_error_t llace_jit_remove(llace_jit_t *jit, size_t function);
+// Storage of a global, allocated and initialized on first use
+void *llace_jit_global(llace_jit_t *jit, size_t global);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LLACE_CODEGEN_JIT_H
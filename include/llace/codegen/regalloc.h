@@ -0,0 +1,119 @@
+#ifndef LLACE_CODEGEN_REGALLOC_H
+#define LLACE_CODEGEN_REGALLOC_H
+
+#include <llace/ir/stack.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Register allocation works on the IR variables directly, expression
+// temporaries inside a statement are left to instruction selection which
+// evaluates them in the scratch registers of the register set.
+//
+// Statements are numbered in allocation order, every block gets an entry
+// position (phi definitions, incoming moves) followed by two positions per
+// statement: a statement at the even position p reads its operands at p and
+// writes its result at p + 1.
+
+// ================ Register Sets ================ //
+
+typedef enum {
+  LLACE_REGCLASS_GPR, // integers and pointers
+  LLACE_REGCLASS_VEC, // floats and vectors
+  LLACE_REGCLASS_COUNT
+} llace_regclass_t;
+
+typedef struct llace_regset {
+  const uint8_t *regs[LLACE_REGCLASS_COUNT]; // allocatable machine registers, in preference order
+  size_t count[LLACE_REGCLASS_COUNT];
+  const uint8_t *args[LLACE_REGCLASS_COUNT]; // argument registers of the calling convention
+  size_t arg_count[LLACE_REGCLASS_COUNT];
+  uint64_t caller_saved[LLACE_REGCLASS_COUNT]; // machine register bits clobbered by calls
+  uint8_t scratch[LLACE_REGCLASS_COUNT];       // never allocated, breaks move cycles
+} llace_regset_t;
+
+llace_regclass_t llace_regclass_of(llace_ir_type_t type, llace_ir_typeattr_t attr);
+
+// ================ Locations ================ //
+
+typedef enum {
+  LLACE_LOC_NONE,  // not live
+  LLACE_LOC_REG,   // machine register
+  LLACE_LOC_SLOT,  // spill slot of the frame
+  LLACE_LOC_CONST, // constant source of a move
+} llace_lockind_t;
+
+typedef struct llace_loc {
+  llace_lockind_t kind;
+  llace_regclass_t cls;
+  uint32_t index; // machine register or spill slot
+} llace_loc_t;
+
+bool llace_loc_eq(llace_loc_t a, llace_loc_t b);
+
+typedef struct llace_ra_segment {
+  size_t from, to; // positions [from, to)
+  llace_loc_t loc;
+} llace_ra_segment_t;
+
+typedef struct llace_ra_move {
+  size_t var;
+  llace_loc_t from, to;
+  llace_ir_value_t constant; // source of LLACE_LOC_CONST moves
+} llace_ra_move_t;
+
+// Sequential moves at a position (before the statement there) or on a control flow edge
+typedef struct llace_ra_moves {
+  size_t position;   // SIZE_MAX for edge moves
+  size_t pred, succ; // edge blocks
+  size_t first, count;
+} llace_ra_moves_t;
+
+// ================ Allocation ================ //
+
+typedef struct llace_regalloc_stats {
+  size_t spilled;      // variables given a spill slot
+  size_t slots;        // spill slots after coloring
+  size_t spill_stores; // writes to spill slots
+  size_t reloads;      // reads of spill slots
+  size_t moves;        // register to register moves
+  size_t coalesced;    // copies and phi inputs left in place
+} llace_regalloc_stats_t;
+
+typedef struct llace_regalloc {
+  llace_array_t order;    // size_t, blocks in allocation order
+  llace_array_t from;     // size_t per block, entry position, SIZE_MAX if unreachable
+  llace_array_t segments; // llace_array_t (llace_ra_segment_t) per variable, sorted
+  llace_array_t moves;    // llace_ra_move_t
+  llace_array_t groups;   // llace_ra_moves_t
+  size_t slots[LLACE_REGCLASS_COUNT];
+  llace_regalloc_stats_t stats;
+} llace_regalloc_t;
+
+// Position of the statement of a block (llace_ir_block_stmts order)
+#define LLACE_RA_STMT_POS(ra, block, stmt) (*LLACE_ARRAY_GET(size_t, (ra)->from, (block)) + 2 * ((stmt) + 1))
+#define LLACE_RA_SEGMENTS(ra, var) LLACE_ARRAY_GET(llace_array_t, (ra)->segments, (var))
+
+// Linear scan over SSA live intervals (Wimmer & Moessenboeck).
+// Intervals are split when no register is free for their whole lifetime,
+// spilled parts get slots colored by lifetime, copies and phis are coalesced
+// through register hints. Runs in time linear in the function size.
+llace_error_t llace_regalloc_linear(const llace_ir_context_t *ctx, const llace_ir_function_t *fn, const llace_regset_t *regs, llace_regalloc_t *ra);
+// Iterated register coalescing (George & Appel) on the interference of the
+// same live intervals. Coalesces conservatively (Briggs, George), spills the
+// variables with the lowest loop weighted use count per neighbour for their
+// whole lifetime. Quadratic in the worst case, meant for hot code.
+llace_error_t llace_regalloc_color(const llace_ir_context_t *ctx, const llace_ir_function_t *fn, const llace_regset_t *regs, llace_regalloc_t *ra);
+// Allocator selected by config->regalloc
+llace_error_t llace_regalloc(const llace_ir_context_t *ctx, const llace_config_t *config, const llace_ir_function_t *fn, const llace_regset_t *regs, llace_regalloc_t *ra);
+void llace_regalloc_free(llace_regalloc_t *ra);
+
+// Location of a variable at a position, LLACE_LOC_NONE where it is not live
+llace_loc_t llace_regalloc_loc(const llace_regalloc_t *ra, size_t var, size_t position);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LLACE_CODEGEN_REGALLOC_H
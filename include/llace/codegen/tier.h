@@ -0,0 +1,86 @@
+#ifndef LLACE_CODEGEN_TIER_H
+#define LLACE_CODEGEN_TIER_H
+
+#include <llace/ir/stack.h>
+#include <llace/ir/interp.h>
+#include <llace/codegen/jit.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Tiered execution: every function starts in the interpreter, which costs
+// nothing to start. Once its calls or loop iterations cross the thresholds
+// of the configuration it is compiled by the JIT, on a worker thread unless
+// the configuration says otherwise, and its entry in the table is swapped
+// to the machine code. Calls made after the swap, from outside or from
+// interpreted code, run compiled; a call already running stays interpreted.
+//
+// Both tiers share the globals. Only functions whose parameters and return
+// are integers or pointers, at most six parameters, are compiled; the rest
+// stay in the interpreter (LLACE_TIER_PINNED).
+
+// ================ Engine ================ //
+
+typedef enum {
+  LLACE_TIER_INTERP,   // interpreted, counting
+  LLACE_TIER_QUEUED,   // hot, waiting for the compiler
+  LLACE_TIER_COMPILED, // calls go to machine code
+  LLACE_TIER_PINNED,   // stays interpreted, the JIT cannot take it
+} llace_tier_state_t;
+
+typedef struct llace_tier_func {
+  void *entry;      // machine code, NULL while interpreted (atomic)
+  uint8_t state;    // llace_tier_state_t (atomic)
+  uint8_t width;    // bits of the returned word, 0 for void
+  bool sign;        // the returned word is sign extended
+  bool eligible;    // signature the JIT can be called with
+  bool prepared;    // decoded with everything it calls
+  size_t params;
+} llace_tier_func_t;
+
+typedef struct llace_tier_stats {
+  size_t compiled;       // functions swapped to machine code
+  size_t pinned;         // hot functions left in the interpreter
+  uint64_t native_calls; // calls that went to machine code
+} llace_tier_stats_t;
+
+typedef struct llace_tier {
+  llace_ir_context_t *ctx;
+  llace_config_t config;
+  llace_interp_t interp;
+  llace_jit_t jit;
+  llace_array_t funcs; // llace_tier_func_t per function of the context
+
+  // The compiler lock covers the JIT and reading the IR, the JIT folds it in place
+  pthread_mutex_t compile;
+  // The queue lock covers the queue and the worker state
+  pthread_mutex_t lock;
+  pthread_cond_t wake, idle;
+  pthread_t worker;
+  llace_array_t queue; // size_t, functions to compile from head on
+  size_t head;
+  bool started, busy, stop;
+
+  llace_tier_stats_t stats;
+} llace_tier_t;
+
+// config may be NULL for the defaults, the engine must not move after init
+llace_error_t llace_tier_init(llace_tier_t *tier, llace_ir_context_t *ctx, const llace_config_t *config);
+// Stops the worker, waiting for the function it compiles
+void llace_tier_free(llace_tier_t *tier);
+
+// Runs the function in its current tier, result receives the returned word as in llace_interp_call
+llace_error_t llace_tier_call(llace_tier_t *tier, size_t function, const uint64_t *args, size_t count, uint64_t *result);
+// Blocks until every queued function is compiled
+void llace_tier_wait(llace_tier_t *tier);
+llace_tier_state_t llace_tier_state(llace_tier_t *tier, size_t function);
+// Storage of a global, shared by both tiers
+void *llace_tier_global(llace_tier_t *tier, size_t global);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LLACE_CODEGEN_TIER_H
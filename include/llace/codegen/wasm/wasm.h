@@ -0,0 +1,88 @@
+#ifndef LLACE_CODEGEN_WASM_H
+#define LLACE_CODEGEN_WASM_H
+
+#include <llace/ir/stack.h>
+#include <llace/codegen/buffer.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// WebAssembly (wasm32) modules straight from the stack IR. Both are stack
+// machines, so the operands of a statement are emitted in IR order and
+// every op becomes one or two wasm instructions; variables are locals.
+//
+// The control flow graph is structured with blocks, loops and ifs on the
+// dominator tree (Ramsey, "Beyond Relooper"): a block that several edges
+// merge into follows the block opened for it in its dominator, a loop
+// header opens a loop, any other block is inlined at its only edge.
+// Irreducible control flow is rejected.
+//
+// Functions with a body are defined and exported by name, the others are
+// imported from "env". Globals live in the exported linear memory from
+// LLACE_WASM_DATA_BASE on, a global in the IR is its address.
+//
+// Vectors are legalized to the target. With simd128 their lanes are widened
+// to 8, 16, 32 or 64 bits and a vector is split into as many v128 values as
+// it needs, vec4<f32> is one and vec8<i13> is one of i16 lanes; an op takes
+// its simd128 form where the cost table has one and works lane by lane in
+// the v128 otherwise. Without simd128 every lane is a scalar of its own.
+
+// ================ Encoding ================ //
+
+#define LLACE_WASM_MAGIC 0x6D736100u // "\0asm"
+#define LLACE_WASM_VERSION 1u
+#define LLACE_WASM_DATA_BASE 16u // address of the first global, 0 stays null
+#define LLACE_WASM_PAGE 65536u
+
+typedef enum {
+  LLACE_WASM_SECTION_CUSTOM,
+  LLACE_WASM_SECTION_TYPE,
+  LLACE_WASM_SECTION_IMPORT,
+  LLACE_WASM_SECTION_FUNCTION,
+  LLACE_WASM_SECTION_TABLE,
+  LLACE_WASM_SECTION_MEMORY,
+  LLACE_WASM_SECTION_GLOBAL,
+  LLACE_WASM_SECTION_EXPORT,
+  LLACE_WASM_SECTION_START,
+  LLACE_WASM_SECTION_ELEMENT,
+  LLACE_WASM_SECTION_CODE,
+  LLACE_WASM_SECTION_DATA,
+} llace_wasm_section_t;
+
+typedef enum {
+  LLACE_WASM_I32 = 0x7F,
+  LLACE_WASM_I64 = 0x7E,
+  LLACE_WASM_F32 = 0x7D,
+  LLACE_WASM_F64 = 0x7C,
+  LLACE_WASM_V128 = 0x7B,
+} llace_wasm_valtype_t;
+
+void llace_wasm_uleb(llace_codebuf_t *out, uint64_t value);
+void llace_wasm_sleb(llace_codebuf_t *out, int64_t value);
+
+// Sizes are written after what they measure: begin leaves room for a
+// padded five byte LEB128 and returns where, end fills in the bytes since
+void llace_wasm_size_begin(llace_codebuf_t *out, size_t *at);
+void llace_wasm_size_end(llace_codebuf_t *out, size_t at);
+
+// ================ Modules ================ //
+
+typedef struct llace_wasm_stats {
+  size_t functions;  // defined
+  size_t imports;
+  size_t data;       // bytes of globals
+  size_t vector;     // vector ops in simd128
+  size_t scalarized; // vector ops lane by lane
+} llace_wasm_stats_t;
+
+// Appends the module of every function and global of the context to out,
+// target NULL is wasm32 with simd128 and stats may be NULL. On error out
+// holds a partial module.
+llace_error_t llace_wasm_emit(const llace_ir_context_t *ctx, const llace_target_t *target, llace_codebuf_t *out, llace_wasm_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LLACE_CODEGEN_WASM_H
@@ -2,6 +2,9 @@
 #define LLACE_CONFIG_H
 
 #include "llace/llace.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <limits.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -94,6 +97,16 @@ typedef enum {
 
 const char *llace_endian_str(llace_endian_t);
 
+// ================ Target Features ================ //
+
+typedef enum {
+  LLACE_FEATURE_SSE2    = 1 << 0, // 128-bit vectors (amd64 baseline)
+  LLACE_FEATURE_AVX     = 1 << 1, // 256-bit float vectors
+  LLACE_FEATURE_AVX2    = 1 << 2, // 256-bit integer vectors
+  LLACE_FEATURE_AVX512  = 1 << 3, // 512-bit vectors (F, BW, DQ)
+  LLACE_FEATURE_SIMD128 = 1 << 4, // WebAssembly 128-bit vectors
+} llace_feature_t;
+
 // ================ Target Triple ================ //
 
 typedef struct {
@@ -101,6 +114,7 @@ typedef struct {
   llace_os_t os;         // Target operating system
   llace_objfmt_t format; // Object file format
   llace_endian_t endian; // Byte order
+  uint32_t features;     // llace_feature_t bits
   
   // Optional vendor/environment info
   const char *vendor;    // Vendor string (e.g., "pc", "apple", "unknown")
@@ -116,6 +130,34 @@ void llace_target_get_host(llace_target_t *target);
 size_t llace_target_pointer_size(const llace_target_t *target);
 size_t llace_target_word_size(const llace_target_t *target);
 
+// ================ Target Costs ================ //
+
+typedef enum {
+  LLACE_COST_ALU,   // add, sub, logic, compare
+  LLACE_COST_SHIFT, // shl, shr
+  LLACE_COST_MUL,
+  LLACE_COST_DIV,   // div, mod
+  LLACE_COST_LOAD,
+  LLACE_COST_STORE,
+  LLACE_COST_SPLAT,   // broadcast a scalar to every lane
+  LLACE_COST_PACK,    // build a vector from one scalar per lane
+  LLACE_COST_EXTRACT, // read one lane back into a scalar
+} llace_cost_t;
+
+#define LLACE_COST_UNSUPPORTED UINT_MAX
+
+// Widest vector register in bits, 0 without vector support
+size_t llace_target_vector_bits(const llace_target_t *target);
+// Estimated cost of an operation on lanes x bits wide values (lanes 0 or 1 for scalars), LLACE_COST_UNSUPPORTED if it has no instruction
+unsigned llace_target_cost(const llace_target_t *target, llace_cost_t op, size_t bits, size_t lanes, bool is_float);
+
+// ================ Register Allocation ================ //
+
+typedef enum {
+  LLACE_REGALLOC_LINEAR, // linear scan, compile time linear in the function size
+  LLACE_REGALLOC_COLOR,  // iterated register coalescing, slower but spills less
+} llace_regalloc_kind_t;
+
 // ================ Configuration Structure ================ //
 
 typedef struct {
@@ -133,6 +175,17 @@ typedef struct {
   unsigned int generate_debug_info : 1;    // Include debug information
   unsigned int generate_symbol_table : 1;  // Include symbol table
   const char *filename;                    // Output file name
+
+  // Optimization settings
+  unsigned int inline_threshold;           // Largest cost (in stack values) inlined at a call site
+  unsigned int inline_leaf_threshold;      // Leaf functions up to this size are always inlined
+  unsigned int inline_growth;              // How much a caller may grow through inlining (percent)
+  llace_regalloc_kind_t regalloc;          // Register allocator
+
+  // Tiered execution settings
+  unsigned int tier_call_threshold;        // Calls an interpreted function takes before it is compiled
+  unsigned int tier_loop_threshold;        // Loop iterations (back edges) before it is compiled
+  unsigned int tier_background : 1;        // Compile on a worker thread instead of the calling one
 } llace_config_t;
 
 // ================ Configuration Functions ================ //
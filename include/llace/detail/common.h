@@ -0,0 +1,53 @@
+#ifndef LLACE_DETAIL_COMMON_H
+#define LLACE_DETAIL_COMMON_H
+
+// Internal helpers shared between source files, not part of the public API
+
+#include <llace/llace.h>
+#include <llace/mem.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ================ Strings ================ //
+
+// Duplicate a string into a fresh allocation (NULL stays NULL)
+static inline char *llace_strdup(const char *str) {
+  if (str == NULL) return NULL;
+  size_t len = strlen(str) + 1;
+  char *copy = malloc(len);
+  if (copy == NULL) { LLACE_LOG_FATAL("Failed to allocate string of size '%zu'", len); }
+  memcpy(copy, str, len);
+  return copy;
+}
+
+// ================ Bitsets ================ //
+
+// Zero initialized bitset large enough for count bits
+#define LLACE_BITSET_WORDS(count) (((count) + 63) / 64)
+#define LLACE_BITSET_NEW(count) llace_bitset_new(count)
+#define LLACE_BITSET_GET(set, bit) (((set)[(bit) / 64] >> ((bit) % 64)) & 1u)
+#define LLACE_BITSET_SET(set, bit) ((set)[(bit) / 64] |= (UINT64_C(1) << ((bit) % 64)))
+#define LLACE_BITSET_CLEAR(set, bit) ((set)[(bit) / 64] &= ~(UINT64_C(1) << ((bit) % 64)))
+
+static inline uint64_t *llace_bitset_new(size_t count) {
+  uint64_t *set = calloc(LLACE_BITSET_WORDS(count) + 1, sizeof(uint64_t));
+  if (set == NULL) { LLACE_LOG_FATAL("Failed to allocate bitset of '%zu' bits", count); }
+  return set;
+}
+
+// ================ Math ================ //
+
+#define LLACE_MIN(a, b) ((a) < (b) ? (a) : (b))
+#define LLACE_MAX(a, b) ((a) > (b) ? (a) : (b))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LLACE_DETAIL_COMMON_H
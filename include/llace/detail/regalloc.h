@@ -0,0 +1,76 @@
+#ifndef LLACE_DETAIL_REGALLOC_H
+#define LLACE_DETAIL_REGALLOC_H
+
+// Liveness and live intervals shared by the register allocators
+
+#include <llace/ir.h>
+#include <llace/codegen/regalloc.h>
+#include <llace/detail/common.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ================ Live Intervals ================ //
+
+typedef struct llace_ra_range {
+  size_t from, to; // [from, to)
+} llace_ra_range_t;
+
+typedef struct llace_ra_interval {
+  size_t var;            // SIZE_MAX for the fixed interval of a register
+  llace_regclass_t cls;
+  llace_array_t ranges;  // llace_ra_range_t, ascending and disjoint
+  llace_array_t uses;    // size_t positions, ascending
+  llace_loc_t loc;
+  size_t hint;           // interval whose register is preferred, SIZE_MAX if none
+  int hint_reg;          // machine register preferred, -1 if none
+  size_t next;           // next part after a split, SIZE_MAX for the last one
+  size_t cursor;         // first range that may still cover the scan position
+} llace_ra_interval_t;
+
+typedef struct llace_ra_copy {
+  size_t dst, src;  // variables
+  size_t position;  // where src is read, dst is written one later
+} llace_ra_copy_t;
+
+typedef struct llace_ra_live {
+  const llace_ir_function_t *fn;
+  const llace_regset_t *regs;
+  llace_ir_cfg_t cfg;
+  llace_ir_loopinfo_t loops;
+  size_t var_count;
+  size_t end;                                 // one past the last position
+  llace_array_t order;                        // size_t, blocks in allocation order
+  llace_array_t from, to;                     // size_t per block, SIZE_MAX if unreachable
+  llace_array_t live_in;                      // llace_array_t (size_t) per block, ascending variables
+  llace_array_t intervals;                    // llace_ra_interval_t, the variables first
+  size_t fixed[LLACE_REGCLASS_COUNT];         // first fixed interval of each class, one per allocatable register
+  llace_array_t copies;                       // llace_ra_copy_t
+  uint64_t *block_start;                      // positions that begin a block
+} llace_ra_live_t;
+
+#define LLACE_RA_INTERVAL(live, index) LLACE_ARRAY_GET(llace_ra_interval_t, (live)->intervals, (index))
+#define LLACE_RA_START(it) (LLACE_ARRAY_FRONT(llace_ra_range_t, (it)->ranges)->from)
+#define LLACE_RA_END(it) (LLACE_ARRAY_BACK(llace_ra_range_t, (it)->ranges)->to)
+
+// Live intervals from SSA liveness over the CFG in one backwards pass, loops extend their live-in values over the whole loop
+llace_error_t llace_ra_live_build(const llace_ir_context_t *ctx, const llace_ir_function_t *fn, const llace_regset_t *regs, llace_ra_live_t *live);
+void llace_ra_live_free(llace_ra_live_t *live);
+
+bool llace_ra_covers(llace_ra_interval_t *it, size_t position);
+// First position at or after position where both intervals are live, SIZE_MAX if none
+size_t llace_ra_intersect(const llace_ra_interval_t *a, const llace_ra_interval_t *b, size_t position);
+// First use at or after position, SIZE_MAX if none
+size_t llace_ra_next_use(const llace_ra_interval_t *it, size_t position);
+// Move everything from position on into a new interval chained after it, returns its index
+size_t llace_ra_split(llace_ra_live_t *live, size_t index, size_t position);
+
+// Spill slot coloring, segments, resolution moves and statistics of the final assignment
+void llace_ra_finish(llace_ra_live_t *live, llace_regalloc_t *ra);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LLACE_DETAIL_REGALLOC_H
@@ -0,0 +1,38 @@
+#ifndef LLACE_DETAIL_STRMAP_H
+#define LLACE_DETAIL_STRMAP_H
+
+#include <llace/detail/common.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ================ String Map ================ //
+
+// Open addressing map from borrowed strings to indices.
+// Keys are not copied, they have to outlive the map.
+
+typedef struct llace_strmap_slot {
+  const char *key; // NULL if the slot is empty
+  size_t len;
+  uint64_t hash;
+  size_t value;
+} llace_strmap_slot_t;
+
+typedef struct llace_strmap {
+  llace_array_t slots; // llace_strmap_slot_t, capacity is a power of two
+  size_t count;
+} llace_strmap_t;
+
+uint64_t llace_strhash(const char *key, size_t len);
+
+void llace_strmap_init(llace_strmap_t *map, size_t capacity);
+void llace_strmap_free(llace_strmap_t *map);
+bool llace_strmap_get(const llace_strmap_t *map, const char *key, size_t len, size_t *value);
+void llace_strmap_put(llace_strmap_t *map, const char *key, size_t len, size_t value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LLACE_DETAIL_STRMAP_H
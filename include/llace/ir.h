@@ -3,12 +3,9 @@
 
 // Standard header file for In Memory Intermediate Representation
 
-#include <llace/ir/func.h>
-#include <llace/ir/global.h>
-#include <llace/ir/instr.h>
-#include <llace/ir/module.h>
-#include <llace/ir/type.h>
-#include <llace/ir/value.h>
-#include <llace/ir/var.h>
+#include <llace/ir/stack.h>
+#include <llace/ir/analysis.h>
+#include <llace/ir/opt.h>
+#include <llace/ir/interp.h>
 
-#endif // LLACE_IR_H
\ No newline at end of file
+#endif // LLACE_IR_H
@@ -0,0 +1,83 @@
+#ifndef LLACE_IR_ANALYSIS_H
+#define LLACE_IR_ANALYSIS_H
+
+#include <llace/ir/stack.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ================ Control Flow Graph ================ //
+
+typedef struct llace_ir_cfg {
+  size_t block_count;
+  llace_array_t succs; // llace_array_t (size_t) per block, without duplicates
+  llace_array_t preds; // llace_array_t (size_t) per block, without duplicates
+  llace_array_t rpo;   // size_t, reachable blocks in reverse post order
+  llace_array_t order; // size_t per block, position in rpo or SIZE_MAX if unreachable
+  llace_array_t idom;  // size_t per block, the entry is its own idom, SIZE_MAX if unreachable
+  llace_array_t enter; // size_t per block, preorder number in the dominator tree
+  llace_array_t leave; // size_t per block, one past the last preorder number below it
+} llace_ir_cfg_t;
+
+#define LLACE_IR_CFG_SUCCS(cfg, block) LLACE_ARRAY_GET(llace_array_t, (cfg)->succs, (block))
+#define LLACE_IR_CFG_PREDS(cfg, block) LLACE_ARRAY_GET(llace_array_t, (cfg)->preds, (block))
+#define LLACE_IR_CFG_IDOM(cfg, block) (*LLACE_ARRAY_GET(size_t, (cfg)->idom, (block)))
+#define LLACE_IR_CFG_REACHABLE(cfg, block) (*LLACE_ARRAY_GET(size_t, (cfg)->order, (block)) != SIZE_MAX)
+
+// Builds edges, reverse post order and the dominator tree (Cooper, Harvey & Kennedy)
+llace_error_t llace_ir_cfg_build(const llace_ir_function_t *fn, llace_ir_cfg_t *cfg);
+void llace_ir_cfg_free(llace_ir_cfg_t *cfg);
+bool llace_ir_cfg_dominates(const llace_ir_cfg_t *cfg, size_t a, size_t b);
+
+// ================ Loops ================ //
+
+typedef struct llace_ir_loop {
+  size_t header;
+  size_t parent;         // enclosing loop, SIZE_MAX for outermost loops
+  size_t depth;          // nesting depth, 1 for outermost loops
+  llace_array_t blocks;  // size_t, header first, includes nested loop blocks
+  llace_array_t latches; // size_t, blocks with a back edge to the header
+} llace_ir_loop_t;
+
+typedef struct llace_ir_loopinfo {
+  llace_array_t loops;     // llace_ir_loop_t, enclosing loops come before nested ones
+  llace_array_t innermost; // size_t per block, innermost loop containing it or SIZE_MAX
+} llace_ir_loopinfo_t;
+
+#define LLACE_IR_LOOP_AT(info, index) LLACE_ARRAY_GET(llace_ir_loop_t, (info)->loops, (index))
+
+// Natural loops of every back edge (a block jumping to one of its dominators), merged per header
+llace_error_t llace_ir_loops_build(const llace_ir_cfg_t *cfg, llace_ir_loopinfo_t *info);
+void llace_ir_loops_free(llace_ir_loopinfo_t *info);
+bool llace_ir_loop_contains(const llace_ir_loopinfo_t *info, size_t loop, size_t block);
+
+// Predecessor of the header outside the loop whose only successor is the header, SIZE_MAX if none
+size_t llace_ir_loop_preheader(const llace_ir_cfg_t *cfg, const llace_ir_loopinfo_t *info, size_t loop);
+// Give every loop a preheader, returns true if blocks were added (the cfg and loops are stale)
+bool llace_ir_loops_make_preheaders(llace_ir_function_t *fn, const llace_ir_cfg_t *cfg, const llace_ir_loopinfo_t *info);
+
+// ================ Call Graph ================ //
+
+typedef struct llace_ir_callgraph {
+  llace_array_t callees; // llace_array_t (size_t) per function, without duplicates
+  llace_array_t callers; // llace_array_t (size_t) per function, without duplicates
+  llace_array_t sccs;    // llace_array_t (size_t) per strongly connected component, callees before callers
+  llace_array_t scc;     // size_t per function, its component in sccs
+} llace_ir_callgraph_t;
+
+#define LLACE_IR_CALLGRAPH_CALLEES(cg, func) LLACE_ARRAY_GET(llace_array_t, (cg)->callees, (func))
+#define LLACE_IR_CALLGRAPH_CALLERS(cg, func) LLACE_ARRAY_GET(llace_array_t, (cg)->callers, (func))
+#define LLACE_IR_CALLGRAPH_SCC(cg, func) (*LLACE_ARRAY_GET(size_t, (cg)->scc, (func)))
+
+// Call edges and their components (Tarjan), the component list is a bottom-up order
+llace_error_t llace_ir_callgraph_build(const llace_ir_context_t *ctx, llace_ir_callgraph_t *cg);
+void llace_ir_callgraph_free(llace_ir_callgraph_t *cg);
+// Part of a cycle of calls, including a function calling itself
+bool llace_ir_callgraph_recursive(const llace_ir_callgraph_t *cg, size_t func);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LLACE_IR_ANALYSIS_H
@@ -0,0 +1,68 @@
+#ifndef LLACE_IR_INTERP_H
+#define LLACE_IR_INTERP_H
+
+#include <llace/ir/stack.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Direct execution of the stack IR. A function is decoded once, on its
+// first call, into a flat instruction stream: every stack value becomes one
+// instruction holding the address of its handler (direct threading with
+// computed goto, a switch where that is unavailable), types are resolved
+// into the handler choice, jump targets into instruction indices and phis
+// into copies on the incoming edges. The top of the operand stack lives in
+// a local of the dispatch loop, the rest in a frame array.
+//
+// Each decoded function counts its calls and the jumps it takes back to an
+// earlier block, so an embedder can tell which functions are hot.
+//
+// Values travel as 64-bit words: integers sign or zero extended from their
+// width, f32 as its bits in the low half, f64 as its bits, pointers as
+// addresses. Vector types are not interpreted (LLACE_ERROR_INVLTYPE).
+
+// ================ Interpreter ================ //
+
+typedef struct llace_interp_stats {
+  size_t decoded;      // functions decoded
+  size_t instructions; // decoded instructions over all functions
+  size_t calls;        // calls executed, from outside and within
+} llace_interp_stats_t;
+
+typedef struct llace_interp_counts {
+  uint64_t calls;     // times the function was entered
+  uint64_t backedges; // jumps back to an earlier block, loop iterations
+} llace_interp_counts_t;
+
+typedef struct llace_interp {
+  const llace_ir_context_t *ctx;
+  llace_array_t funcs;   // struct llace_interp_func * per function, NULL until decoded
+  llace_array_t globals; // void * per global, NULL until used
+  llace_array_t owned;   // storage allocated for globals here
+  // Storage of a global, NULL to allocate it in the interpreter. Set before
+  // the first call to share globals with compiled code.
+  void *(*resolve)(void *user, size_t global);
+  // Offered every call interpreted code makes, returns true when it ran the callee itself
+  bool (*enter)(void *user, size_t function, const uint64_t *args, size_t count, uint64_t *result);
+  void *user;
+  llace_interp_stats_t stats;
+} llace_interp_t;
+
+llace_error_t llace_interp_init(llace_interp_t *interp, const llace_ir_context_t *ctx);
+void llace_interp_free(llace_interp_t *interp);
+
+// Runs the function on count argument words, result receives the returned word (0 for void)
+llace_error_t llace_interp_call(llace_interp_t *interp, size_t function, const uint64_t *args, size_t count, uint64_t *result);
+// Decodes the function and every function it reaches, running them reads no IR after
+llace_error_t llace_interp_prepare(llace_interp_t *interp, size_t function);
+// Counters of a function, NULL until it is decoded
+const llace_interp_counts_t *llace_interp_counts(const llace_interp_t *interp, size_t function);
+// Storage of a global, allocated and initialized on first use unless resolve provides it
+void *llace_interp_global(llace_interp_t *interp, size_t global);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LLACE_IR_INTERP_H
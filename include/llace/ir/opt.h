@@ -0,0 +1,101 @@
+#ifndef LLACE_IR_OPT_H
+#define LLACE_IR_OPT_H
+
+#include <llace/ir/stack.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ================ Dead Code Elimination ================ //
+
+typedef struct llace_ir_adce_stats {
+  size_t stmts_removed;  // dead statements swept
+  size_t blocks_removed; // unreachable blocks swept
+} llace_ir_adce_stats_t;
+
+// Aggressive dead code elimination.
+// Everything is assumed dead until reached from a root (terminators, stores,
+// calls and _const/_volatile variables), unmarked statements and unreachable
+// blocks are then swept in a single compaction per block.
+llace_error_t llace_ir_opt_adce(const llace_ir_context_t *ctx, llace_ir_function_t *fn, llace_ir_adce_stats_t *stats);
+
+// ================ Inlining ================ //
+
+typedef struct llace_ir_inline_stats {
+  size_t inlined;  // call sites replaced by the callee body
+  size_t uncalled; // functions whose every call site was inlined
+} llace_ir_inline_stats_t;
+
+// Function inlining over the whole context.
+// Functions are visited bottom-up over the call graph components, so callees
+// are already inlined into when their own callers are considered. A call site
+// is inlined when the callee is a leaf within config->inline_leaf_threshold,
+// or when its size minus the call overhead and constant argument bonus stays
+// under config->inline_threshold (raised for call sites inside loops) and the
+// caller stays within config->inline_growth. Recursive calls are never inlined.
+llace_error_t llace_ir_opt_inline(llace_ir_context_t *ctx, const llace_config_t *config, llace_ir_inline_stats_t *stats);
+
+// ================ Loop Optimizations ================ //
+
+typedef struct llace_ir_licm_stats {
+  size_t hoisted;    // statements moved into a preheader
+  size_t preheaders; // preheader blocks created
+} llace_ir_licm_stats_t;
+
+// Loop invariant code motion.
+// Loops get a preheader first, then statements whose operands are all defined
+// outside the loop are hoisted into it, innermost loops first. Loads only move
+// out of the header of loops without stores or calls, divisions only by
+// nonzero constants.
+llace_error_t llace_ir_opt_licm(const llace_ir_context_t *ctx, llace_ir_function_t *fn, llace_ir_licm_stats_t *stats);
+
+typedef struct llace_ir_indvar_stats {
+  size_t reduced; // multiplies replaced by an additive recurrence
+} llace_ir_indvar_stats_t;
+
+// Induction variable strength reduction.
+// For a basic induction variable %i = phi [init], [%i step +] every %i k *
+// with an invariant k becomes its own phi stepped by step * k.
+llace_error_t llace_ir_opt_indvars(const llace_ir_context_t *ctx, llace_ir_function_t *fn, llace_ir_indvar_stats_t *stats);
+
+// ================ Vectorization ================ //
+
+// Target cost of an instruction value over lanes of element (lanes 0 for
+// scalars), 0 for values and bookkeeping that emit no code,
+// LLACE_COST_UNSUPPORTED when the target has no instruction for it.
+unsigned llace_ir_value_cost(const llace_target_t *target, const llace_ir_value_t *value, llace_ir_type_t element, size_t lanes);
+
+typedef struct llace_ir_vectorize_stats {
+  size_t vectorized; // loops given a vector body
+  size_t lanes;      // widest lane count chosen
+} llace_ir_vectorize_stats_t;
+
+// Loop vectorization against config->target.
+// Counted loops of a header and a single body block whose statements are
+// lane-wise arithmetic over base %i index load/store accesses get a vector
+// copy stepping by the widest lane count the target cost query finds cheaper
+// than the scalar loop. Invariant operands are splatted in the preheader,
+// pointers that may overlap a stored one are checked at runtime, and the
+// original loop runs the remaining iterations. Reductions and strided
+// accesses are left scalar.
+llace_error_t llace_ir_opt_vectorize(const llace_ir_context_t *ctx, const llace_config_t *config, llace_ir_function_t *fn, llace_ir_vectorize_stats_t *stats);
+
+typedef struct llace_ir_slp_stats {
+  size_t packed;  // vector statements created
+  size_t scalars; // scalar statements they replaced
+} llace_ir_slp_stats_t;
+
+// Superword level parallelism within basic blocks.
+// Stores to base[k], base[k+1], ... (or assignments whose first load walks
+// consecutive offsets) are grouped, and their expression trees are matched
+// lane by lane into vector loads, splats and lane-wise ops, with unrelated
+// scalars packed. A group is rewritten when the vector tree, including its
+// packs and the extracts of assigned results, is cheaper on config->target.
+llace_error_t llace_ir_opt_slp(const llace_ir_context_t *ctx, const llace_config_t *config, llace_ir_function_t *fn, llace_ir_slp_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LLACE_IR_OPT_H
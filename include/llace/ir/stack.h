@@ -1,10 +1,37 @@
 #ifndef LLACE_IR_STACK_H
 #define LLACE_IR_STACK_H
 
-#ifndef __cplusplus
+#include <llace/llace.h>
+#include <llace/mem.h>
+#include <llace/config.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
 extern "C" {
 #endif
 
+// LLACE IR follows reverse polish notation.
+// Every basic block is a flat stack of values, operands are pushed before the
+// instruction consuming them. A run of values ending in an instruction that
+// produces nothing (assignment, store, branch, ...) forms a statement.
+//
+//   i32(10) %x.0 =                    // %x.0 = 10
+//   %x.0 i32(5) > %cond =             // %cond = %x.0 > 5
+//   %cond @then @else branch          // if (%cond) goto then; else goto else
+//   %a.1 @then %a.2 @else phi/2/1 %a = // %a = phi [%a.1, then], [%a.2, else]
+
+// ================ Types ================ //
+
+typedef enum {
+  LLACE_IR_TYPE_VOID,  // no value
+  LLACE_IR_TYPE_INT,   // signed integer (iN)
+  LLACE_IR_TYPE_UNT,   // unsigned integer (uN)
+  LLACE_IR_TYPE_FLOAT, // floating point (fM.E)
+} llace_ir_typekind_t;
+
 typedef struct llace_ir_typeattr {
   union {
     struct {
@@ -17,7 +44,7 @@ typedef struct llace_ir_typeattr {
 } llace_ir_typeattr_t;
 
 typedef struct llace_ir_type {
-  // Debug Name
+  llace_ir_typekind_t kind;
 
   // Type Information
   union {
@@ -25,58 +52,154 @@ typedef struct llace_ir_type {
     size_t _unt; // unsigned bit width
     struct { size_t mantissa; size_t exponent; } _float; // mantissa bit width, exponent bit width
   };
+  size_t lanes; // vector lane count (vecN<T>), 0 for scalars
 } llace_ir_type_t;
 
+#define LLACE_IR_VOID (llace_ir_type_t){ .kind = LLACE_IR_TYPE_VOID }
+#define LLACE_IR_INT(bits) (llace_ir_type_t){ .kind = LLACE_IR_TYPE_INT, ._int = (bits) }
+#define LLACE_IR_UNT(bits) (llace_ir_type_t){ .kind = LLACE_IR_TYPE_UNT, ._unt = (bits) }
+#define LLACE_IR_FLOAT(m, e) (llace_ir_type_t){ .kind = LLACE_IR_TYPE_FLOAT, ._float = { (m), (e) } }
+
+#define LLACE_IR_IS_VEC(type) ((type).lanes > 0)
+
+bool llace_ir_type_eq(llace_ir_type_t a, llace_ir_type_t b);
+size_t llace_ir_type_bits(llace_ir_type_t type); // storage width in bits, all lanes of a vector
+llace_ir_type_t llace_ir_type_vec(llace_ir_type_t element, size_t lanes); // vecN<element>, lanes 0 gives the element
+// Result of binary arithmetic: the type of its operands, a pointer wins over an offset
+void llace_ir_type_arith(llace_ir_type_t lhs, size_t lhs_depth, llace_ir_type_t rhs, size_t rhs_depth, llace_ir_type_t *type, size_t *depth);
+
+// ================ Instructions ================ //
+
+typedef enum {
+  LLACE_IR_OP_ASSIGN, // value %var =
+  // Arithmetic (2 in, 1 out)
+  LLACE_IR_OP_ADD, LLACE_IR_OP_SUB, LLACE_IR_OP_MUL, LLACE_IR_OP_DIV, LLACE_IR_OP_MOD,
+  LLACE_IR_OP_AND, LLACE_IR_OP_OR, LLACE_IR_OP_XOR, LLACE_IR_OP_SHL, LLACE_IR_OP_SHR,
+  // Comparison (2 in, 1 out)
+  LLACE_IR_OP_EQ, LLACE_IR_OP_NE, LLACE_IR_OP_LT, LLACE_IR_OP_LE, LLACE_IR_OP_GT, LLACE_IR_OP_GE,
+  // Unary (1 in, 1 out)
+  LLACE_IR_OP_NZ, // ! if not zero
+  LLACE_IR_OP_Z,  // !! if zero
+  // Memory
+  LLACE_IR_OP_LOAD,  // ptr load
+  LLACE_IR_OP_STORE, // value ptr store
+  LLACE_IR_OP_INDEX, // ptr index index (&ptr[index])
+  // Vector
+  LLACE_IR_OP_SPLAT,   // value splat<n> (value in every lane)
+  LLACE_IR_OP_PACK,    // value... pack<n> (one value per lane)
+  LLACE_IR_OP_EXTRACT, // vector lane extract
+  // SSA
+  LLACE_IR_OP_PHI,   // (value @block)... phi/n/1
+  LLACE_IR_OP_CALL,  // args... name
+  // Terminators
+  LLACE_IR_OP_JMP,    // @block jmp
+  LLACE_IR_OP_BRANCH, // cond @then @else branch
+  LLACE_IR_OP_RET,    // [value] ret/n
+  LLACE_IR_OP_COUNT
+} llace_ir_opcode_t;
+
+const char *llace_ir_opcode_str(llace_ir_opcode_t op);
+
+typedef struct llace_ir_instr {
+  llace_ir_opcode_t op;
+  uint32_t in;  // stack values consumed (phi consumes value/block pairs)
+  uint32_t out; // stack values produced (0 or 1)
+  union {
+    size_t func;  // callee for LLACE_IR_OP_CALL
+    size_t lanes; // lanes moved by LOAD, STORE, SPLAT and PACK (load<n>), 0 for scalars
+  };
+} llace_ir_instr_t;
+
+// ================ Values ================ //
+
+typedef enum {
+  LLACE_IR_VALUE_CONST, // immediate constant
+  LLACE_IR_VALUE_VAR,   // function local SSA variable
+  LLACE_IR_VALUE_GLOBAL,// address of a global
+  LLACE_IR_VALUE_BLOCK, // basic block label
+  LLACE_IR_VALUE_INSTR, // instruction consuming values
+} llace_ir_valuekind_t;
+
 typedef struct llace_ir_value {
-  // Type
+  llace_ir_valuekind_t kind;
+  llace_ir_type_t type; // constant type
 
   // Value
   union {
-    // Constant
-    // Variable
-    // Global
-    // Function
-    // Instruction
+    int64_t _int;            // Constant (int)
+    uint64_t _unt;           // Constant (unt)
+    double _float;           // Constant (float)
+    size_t var;              // Variable
+    size_t global;           // Global
+    size_t block;            // Basic Block
+    llace_ir_instr_t instr;  // Instruction
   };
 
   // 10 10 +
   // Constant Constant Instruction
 } llace_ir_value_t;
 
-typedef struct llace_ir_variable {
-  // Debug Name
+#define LLACE_IR_CONST_INT(type_, value) (llace_ir_value_t){ .kind = LLACE_IR_VALUE_CONST, .type = (type_), ._int = (value) }
+#define LLACE_IR_CONST_FLOAT(type_, value) (llace_ir_value_t){ .kind = LLACE_IR_VALUE_CONST, .type = (type_), ._float = (value) }
+#define LLACE_IR_VAR(index) (llace_ir_value_t){ .kind = LLACE_IR_VALUE_VAR, .var = (index) }
+#define LLACE_IR_GLOBAL(index) (llace_ir_value_t){ .kind = LLACE_IR_VALUE_GLOBAL, .global = (index) }
+#define LLACE_IR_BLOCK(index) (llace_ir_value_t){ .kind = LLACE_IR_VALUE_BLOCK, .block = (index) }
+#define LLACE_IR_OP(op_, in_, out_) (llace_ir_value_t){ .kind = LLACE_IR_VALUE_INSTR, .instr = { .op = (op_), .in = (in_), .out = (out_) } }
+#define LLACE_IR_VOP(op_, in_, out_, lanes_) (llace_ir_value_t){ .kind = LLACE_IR_VALUE_INSTR, .instr = { .op = (op_), .in = (in_), .out = (out_), .lanes = (lanes_) } }
+#define LLACE_IR_CALL(func_, in_, out_) (llace_ir_value_t){ .kind = LLACE_IR_VALUE_INSTR, .instr = { .op = LLACE_IR_OP_CALL, .in = (in_), .out = (out_), .func = (func_) } }
 
-  // Type
+// Stack values consumed and produced by a value
+#define LLACE_IR_VALUE_IN(value) ((value)->kind == LLACE_IR_VALUE_INSTR ? (size_t)(value)->instr.in : 0)
+#define LLACE_IR_VALUE_OUT(value) ((value)->kind == LLACE_IR_VALUE_INSTR ? (size_t)(value)->instr.out : 1)
+#define LLACE_IR_IS_OP(value, op_) ((value)->kind == LLACE_IR_VALUE_INSTR && (value)->instr.op == (op_))
 
-  // Type Attributes
-} llace_ir_variable_t;
+// Same constant, variable or global
+bool llace_ir_value_same(const llace_ir_value_t *a, const llace_ir_value_t *b);
 
-typedef struct llace_ir_global {
-  // Debug Name
-
-  // Value
+// ================ Symbols ================ //
 
-  // Type
+typedef struct llace_ir_variable {
+  char *name; // Debug Name
+  llace_ir_type_t type; // Type
+  llace_ir_typeattr_t attr; // Type Attributes
+} llace_ir_variable_t;
 
-  // Type Attributes
+typedef struct llace_ir_global {
+  char *name; // Debug Name
+  llace_ir_value_t value; // Initial Value (constant)
+  llace_ir_type_t type; // Type
+  llace_ir_typeattr_t attr; // Type Attributes
 } llace_ir_global_t;
 
 typedef struct llace_ir_basicblock {
+  char *name; // Debug Name
   llace_array_t stack; // llace_ir_value_t
 
   // information for optimize
 } llace_ir_basicblock_t;
 
 typedef struct llace_ir_function {
-  // Debug Name
-  
+  char *name; // Debug Name
+
   // Signature
-  // abi calling convention
+  size_t param_count; // the first param_count variables are the parameters
+  llace_ir_type_t ret; // return type
+  llace_ir_typeattr_t retattr; // return type attributes
+  llace_abi_t abi; // abi calling convention
 
   // Basic Blocks
-
+  llace_array_t blocks; // llace_ir_basicblock_t, blocks[0] is the entry
+  llace_array_t vars; // llace_ir_variable_t
 } llace_ir_function_t;
 
+typedef struct llace_globmap {
+  llace_array_t globals; // llace_ir_global_t
+} llace_globmap_t;
+
+typedef struct llace_funcmap {
+  llace_array_t funcs; // llace_ir_function_t
+} llace_funcmap_t;
+
 typedef struct llace_ir_context {
   // Globals
   llace_globmap_t globmap;
@@ -85,9 +208,71 @@ typedef struct llace_ir_context {
   llace_funcmap_t funcmap;
 } llace_ir_context_t;
 
+#define LLACE_IR_FUNCTION(ctx, index) LLACE_ARRAY_GET(llace_ir_function_t, (ctx)->funcmap.funcs, (index))
+#define LLACE_IR_GLOBAL_AT(ctx, index) LLACE_ARRAY_GET(llace_ir_global_t, (ctx)->globmap.globals, (index))
+#define LLACE_IR_BLOCK_AT(fn, index) LLACE_ARRAY_GET(llace_ir_basicblock_t, (fn)->blocks, (index))
+#define LLACE_IR_VAR_AT(fn, index) LLACE_ARRAY_GET(llace_ir_variable_t, (fn)->vars, (index))
+#define LLACE_IR_STACK_AT(block, index) LLACE_ARRAY_GET(llace_ir_value_t, (block)->stack, (index))
+
+// ================ Construction ================ //
+
+llace_error_t llace_ir_context_init(llace_ir_context_t *ctx);
+void llace_ir_context_free(llace_ir_context_t *ctx);
+
+llace_error_t llace_ir_function_new(llace_ir_context_t *ctx, const char *name, size_t *index);
+bool llace_ir_function_find(const llace_ir_context_t *ctx, const char *name, size_t *index);
+void llace_ir_function_free(llace_ir_function_t *fn);
+
+llace_error_t llace_ir_global_new(llace_ir_context_t *ctx, const char *name, llace_ir_type_t type, llace_ir_typeattr_t attr, size_t *index);
+bool llace_ir_global_find(const llace_ir_context_t *ctx, const char *name, size_t *index);
+
+llace_error_t llace_ir_block_new(llace_ir_function_t *fn, const char *name, size_t *index);
+llace_error_t llace_ir_variable_new(llace_ir_function_t *fn, const char *name, llace_ir_type_t type, llace_ir_typeattr_t attr, size_t *index);
+
+// Push a value onto a basic block stack
+#define LLACE_IR_PUSH(block, value) LLACE_ARRAY_PUSH((block)->stack, (value))
+
+// Insert values into a basic block stack before index
+void llace_ir_block_insert(llace_ir_basicblock_t *block, size_t index, const llace_ir_value_t *values, size_t count);
+
+// ================ Decoding ================ //
+
+typedef struct llace_ir_stmt {
+  size_t begin; // first stack index of the statement
+  size_t end;   // one past the instruction terminating the statement
+} llace_ir_stmt_t;
+
+// Index of the first value of the expression whose root is at index
+size_t llace_ir_expr_begin(const llace_ir_basicblock_t *block, size_t index);
+// Root indices of the operands of the instruction at index, returns the operand count
+size_t llace_ir_operands(const llace_ir_basicblock_t *block, size_t index, size_t *roots, size_t max);
+// Split a block stack into statements (llace_ir_stmt_t), the array is cleared first
+llace_error_t llace_ir_block_stmts(const llace_ir_basicblock_t *block, llace_array_t *stmts);
+
+// Instruction ending the statement
+#define LLACE_IR_STMT_INSTR(block, stmt) (&LLACE_IR_STACK_AT(block, (stmt)->end - 1)->instr)
+// Variable defined by the statement, returns false if it is not an assignment
+bool llace_ir_stmt_def(const llace_ir_basicblock_t *block, const llace_ir_stmt_t *stmt, size_t *var);
+bool llace_ir_op_is_terminator(llace_ir_opcode_t op);
+
+// Index where the terminator statement of a block begins (the stack size if there is none)
+size_t llace_ir_block_term(const llace_ir_basicblock_t *block);
+// Successor blocks of a block (size_t), the array is cleared first
+llace_error_t llace_ir_block_succs(const llace_ir_basicblock_t *block, llace_array_t *succs);
+
+// ================ Validation ================ //
+
+llace_error_t llace_ir_function_verify(const llace_ir_context_t *ctx, const llace_ir_function_t *fn);
+
+// ================ Text Form ================ //
+
+// Parse textual IR into the context, functions referenced before they are defined are declared
+llace_error_t llace_ir_parse(llace_ir_context_t *ctx, const char *src, size_t len);
+void llace_ir_print_function(const llace_ir_context_t *ctx, const llace_ir_function_t *fn, FILE *out);
+void llace_ir_print(const llace_ir_context_t *ctx, FILE *out);
 
-#ifndef __cplusplus
+#ifdef __cplusplus
 }
 #endif
 
-#endif // LLACE_IR_STACK_H
\ No newline at end of file
+#endif // LLACE_IR_STACK_H
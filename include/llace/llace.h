@@ -50,6 +50,9 @@ const char *llace_error_str(llace_error_t error);
 
 #define LLACE_RUNCHECK(func) do { llace_error_t err = func; if (err != LLACE_ERROR_NONE) return err; } while (0);
 
+#define LLACE_CONCAT_(a, b) a##b
+#define LLACE_CONCAT(a, b) LLACE_CONCAT_(a, b)
+
 #ifdef __cplusplus
 }
 #endif
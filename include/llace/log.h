@@ -14,11 +14,48 @@
   #endif
 #endif
 
-#define LLACE_LOG_TRACE(...) llace_log(LLACE_LOG_TRACE, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define LLACE_LOG_DEBUG(...) llace_log(LLACE_LOG_DEBUG, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define LLACE_LOG_INFO(...) llace_log(LLACE_LOG_INFO, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define LLACE_LOG_WARN(...) llace_log(LLACE_LOG_WARN, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
-#define LLACE_LOG_ERROR(...) llace_log(LLACE_LOG_ERROR, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__)
+// Levels below LLACE_LOG_MIN_LEVEL (0 trace .. 5 fatal, as the enum below)
+// compile to nothing, their arguments are still type checked. Fatal always stays.
+#ifndef LLACE_LOG_MIN_LEVEL
+  #define LLACE_LOG_MIN_LEVEL 0
+#endif
+
+// Every site that stays owns a static flag, a disabled site costs its load and one branch.
+// The flag starts unset, the first pass registers the site and settles it against the runtime level.
+#define LLACE_LOG_AT(level, ...) do { \
+    static llace_log_site_t llace_log_site_ = { LLACE_LOG_SITE_NEW, level, __LINE__, __FILE__, NULL }; \
+    if (__builtin_expect(__atomic_load_n(&llace_log_site_.state, __ATOMIC_RELAXED) != LLACE_LOG_SITE_OFF, 0) && \
+        llace_log_site_enabled(&llace_log_site_)) { \
+      llace_log(level, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__); \
+    } \
+  } while (0)
+#define LLACE_LOG_NONE(level, ...) do { if (0) llace_log(level, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__); } while (0)
+
+#if LLACE_LOG_MIN_LEVEL <= 0
+  #define LLACE_LOG_TRACE(...) LLACE_LOG_AT(LLACE_LOG_TRACE, __VA_ARGS__)
+#else
+  #define LLACE_LOG_TRACE(...) LLACE_LOG_NONE(LLACE_LOG_TRACE, __VA_ARGS__)
+#endif
+#if LLACE_LOG_MIN_LEVEL <= 1
+  #define LLACE_LOG_DEBUG(...) LLACE_LOG_AT(LLACE_LOG_DEBUG, __VA_ARGS__)
+#else
+  #define LLACE_LOG_DEBUG(...) LLACE_LOG_NONE(LLACE_LOG_DEBUG, __VA_ARGS__)
+#endif
+#if LLACE_LOG_MIN_LEVEL <= 2
+  #define LLACE_LOG_INFO(...) LLACE_LOG_AT(LLACE_LOG_INFO, __VA_ARGS__)
+#else
+  #define LLACE_LOG_INFO(...) LLACE_LOG_NONE(LLACE_LOG_INFO, __VA_ARGS__)
+#endif
+#if LLACE_LOG_MIN_LEVEL <= 3
+  #define LLACE_LOG_WARN(...) LLACE_LOG_AT(LLACE_LOG_WARN, __VA_ARGS__)
+#else
+  #define LLACE_LOG_WARN(...) LLACE_LOG_NONE(LLACE_LOG_WARN, __VA_ARGS__)
+#endif
+#if LLACE_LOG_MIN_LEVEL <= 4
+  #define LLACE_LOG_ERROR(...) LLACE_LOG_AT(LLACE_LOG_ERROR, __VA_ARGS__)
+#else
+  #define LLACE_LOG_ERROR(...) LLACE_LOG_NONE(LLACE_LOG_ERROR, __VA_ARGS__)
+#endif
 #define LLACE_LOG_FATAL(...) llace_log(LLACE_LOG_FATAL, __FILE__, __LINE__, __FUNCTION__, __VA_ARGS__); abort()
 
 // TODO macro for unimplemented functionality
@@ -29,4 +66,40 @@
 enum { LLACE_LOG_TRACE, LLACE_LOG_DEBUG, LLACE_LOG_INFO, LLACE_LOG_WARN, LLACE_LOG_ERROR, LLACE_LOG_FATAL };
 void llace_log(int level, const char *file, int line, const char *function, const char *fmt, ...);
 
+// Runtime filtering per call site, see LLACE_LOG_AT
+enum { LLACE_LOG_SITE_OFF, LLACE_LOG_SITE_ON, LLACE_LOG_SITE_NEW };
+typedef struct llace_log_site {
+  int state;
+  int level;
+  int line;
+  const char *file;
+  struct llace_log_site *next;
+} llace_log_site_t;
+
+bool llace_log_site_enabled(llace_log_site_t *site);
+void llace_log_level(int level); // sites below it are disabled, starts at LLACE_LOG_MIN_LEVEL, drops every llace_log_enable
+void llace_log_enable(const char *file, int line, bool enable); // the sites of a file (line 0 for all of them) until the next llace_log_level
+
+// Asynchronous logging: llace_log only captures the level, site, the second
+// and the raw arguments (strings copied) into a lock-free ring, a background
+// thread or llace_log_drain formats and writes them. Each format is parsed
+// once, by its address, into how its arguments are read. Formats, files and
+// functions must outlive the drain and never change, as string literals do.
+// Arguments too large to capture are formatted at once, onto the heap when
+// the text is longer than a slot. Fatal messages drain the ring and are
+// written at once.
+bool llace_log_start(bool thread);
+void llace_log_drain(void);
+void llace_log_stop(void); // drains, then synchronous again, no other thread may log meanwhile
+void llace_log_output(FILE *out); // NULL is stdout
+
+// Binary tracing: llace_log registers each site's format once and writes only
+// its id, the seconds and the raw arguments into a buffer per thread, flushed
+// into the file when full, when the thread exits and on stop. It comes before
+// the ring while both run. llace_log_decode renders a trace as the text
+// llace_log writes, examples/logdump.c does so from the command line.
+bool llace_log_trace_start(FILE *out); // out must be binary and stay open until stop
+void llace_log_trace_stop(void); // flushes every thread, no other thread may log meanwhile
+bool llace_log_decode(FILE *in, FILE *out);
+
 #endif // LLACE_LOG_H
\ No newline at end of file
@@ -2,7 +2,10 @@
 #define LLACE_MEM_H
 
 #include <llace/llace.h>
+#include <llace/config.h>
+#include <stdio.h>
 #include <stddef.h>
+#include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -12,6 +15,50 @@ extern "C" {
 
 // This system is mainly to keep memory operations easily updateable
 
+// ================ Accounting ================ //
+
+// Every array and code buffer counts against the tag that was current on its
+// thread when it was first allocated, for as long as it lives. Untagged work
+// counts as general. Names (llace_strdup) and other raw allocations are not counted.
+typedef enum {
+  LLACE_MEM_GENERAL,
+  LLACE_MEM_IR,        // functions, blocks, values and the analyses and passes over them
+  LLACE_MEM_TYPES,
+  LLACE_MEM_SYMBOLS,   // string maps and symbol tables
+  LLACE_MEM_CODEGEN,   // selection, allocation, emitted code and objects
+  LLACE_MEM_DEBUGINFO,
+  LLACE_MEM_TAG_COUNT
+} llace_mem_tag_t;
+
+typedef struct llace_mem_stats {
+  size_t live;   // bytes allocated now
+  size_t peak;   // most bytes live at once
+  size_t allocs; // calls into the allocator
+} llace_mem_stats_t;
+
+const char *llace_mem_tag_name(llace_mem_tag_t tag);
+// Sets the tag of the calling thread, returns the one it replaces
+llace_mem_tag_t llace_mem_tag(llace_mem_tag_t tag);
+// A block of tag bytes went from freed to allocated bytes
+void llace_mem_track(llace_mem_tag_t tag, size_t freed, size_t allocated);
+void llace_mem_stats(llace_mem_tag_t tag, llace_mem_stats_t *stats);
+// Every tag together, the peak is the most bytes live at once over all of them
+void llace_mem_total(llace_mem_stats_t *stats);
+// Peaks fall back to what is live
+void llace_mem_stats_reset(void);
+// Table of every tag
+void llace_mem_summary(FILE *out);
+// The summary through the log when the configuration is verbose
+void llace_mem_report(const llace_config_t *config);
+
+static inline void llace_mem_untag(llace_mem_tag_t *previous) {
+  llace_mem_tag(*previous);
+}
+
+// The rest of the enclosing block allocates under tag
+#define LLACE_MEM_SCOPE(tag) \
+  llace_mem_tag_t LLACE_CONCAT(llace_mem_tag_, __LINE__) __attribute__((cleanup(llace_mem_untag))) = llace_mem_tag(tag)
+
 // ================ Item Allocation ================ //
 
 typedef struct llace_item {
@@ -34,6 +81,7 @@ typedef struct llace_array {
   size_t element_size;
   size_t element_count;
   size_t element_capacity;
+  uint8_t tag; // llace_mem_tag_t its bytes count against
 } llace_array_t;
 
 llace_array_t llace_mem_newarray(size_t element_size, size_t element_capacity);
@@ -88,7 +136,7 @@ void *llace_mem_array_front(const llace_array_t *arr); // beginning of array
 #define LLACE_FREE_ARRAY(array) llace_mem_freearray(&(array))
 
 // Push value to array (by value)
-#define LLACE_ARRAY_PUSH(array, value) do { typeof((value)) val = (value); llace_mem_array_push(&(array), &val); } while (0);
+#define LLACE_ARRAY_PUSH(array, value) do { __typeof__((value)) val = (value); llace_mem_array_push(&(array), &val); } while (0);
 
 // Push value to array (by pointer)
 #define LLACE_ARRAY_PUSHP(array, value_ptr) llace_mem_array_push(&(array), (value_ptr))
@@ -0,0 +1,65 @@
+#ifndef LLACE_PROFILE_H
+#define LLACE_PROFILE_H
+
+#include <llace/llace.h>
+#include <llace/config.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Compile time profiling: LLACE_PROFILE_SCOPE("name") times the rest of the
+// enclosing block on the monotonic clock while profiling runs. Zones nest
+// per thread into a call tree, inclusive and self time per path, and every
+// zone is kept as an event for a Chrome/Perfetto trace_event file. When
+// profiling is off a zone costs a load and a branch at either end.
+// Names must outlive the profile, as string literals do.
+
+// ================ Zones ================ //
+
+typedef struct {
+  uint64_t start; // 0 when the zone was opened while profiling was off
+} llace_profile_zone_t;
+
+extern bool llace_profile_active;
+
+llace_profile_zone_t llace_profile_open(const char *name);
+void llace_profile_close(llace_profile_zone_t *zone);
+
+static inline llace_profile_zone_t llace_profile_begin(const char *name) {
+  if (__builtin_expect(__atomic_load_n(&llace_profile_active, __ATOMIC_RELAXED), 0)) return llace_profile_open(name);
+  return (llace_profile_zone_t){ 0 };
+}
+
+static inline void llace_profile_end(llace_profile_zone_t *zone) {
+  if (__builtin_expect(zone->start != 0, 0)) llace_profile_close(zone);
+}
+
+#define LLACE_PROFILE_SCOPE(name) \
+  llace_profile_zone_t LLACE_CONCAT(llace_profile_zone_, __LINE__) __attribute__((cleanup(llace_profile_end))) = llace_profile_begin(name)
+
+// ================ Profile ================ //
+
+// Starts a fresh profile, no zone may be open on any thread
+void llace_profile_start(void);
+// Zones opened after it are not recorded, those still open are when they close
+void llace_profile_stop(void);
+// Hardware counters (perf_event_open: cycles, instructions, L1d and LLC misses, branch misses)
+// read at both ends of every zone, a system call each; off by default, from the next start.
+// False when none can be opened here, zones are then timed only.
+bool llace_profile_counters(bool enable);
+
+// Chrome trace_event JSON of every zone recorded, one track per thread
+llace_error_t llace_profile_write(FILE *out);
+// Table of the call tree merged over threads: calls, inclusive and self milliseconds, inclusive counters
+void llace_profile_summary(FILE *out);
+// The summary through the log when the configuration is verbose
+void llace_profile_report(const llace_config_t *config);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LLACE_PROFILE_H
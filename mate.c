@@ -6221,6 +6221,12 @@ static void mateInstallExecutable(Executable *executable) {
   StringBuilderAppend(mateState.arena, &builder, &build_dir_path);
   StringBuilderAppend(mateState.arena, &builder, &S("\n"));
 
+  // Object directory, one per executable so its sources never share an object
+  // with the library or another executable (test/main.c and bench/main.c)
+  StringBuilderAppend(mateState.arena, &builder, &S("objdir = $builddir/obj-"));
+  StringBuilderAppend(mateState.arena, &builder, &executable->output);
+  StringBuilderAppend(mateState.arena, &builder, &S("\n"));
+
   // Target
   StringBuilderAppend(mateState.arena, &builder, &S("target = $builddir/"));
   StringBuilderAppend(mateState.arena, &builder, &executable->output);
@@ -6273,7 +6279,7 @@ static void mateInstallExecutable(Executable *executable) {
     String sourceFile = NormalizePathStart(mateState.arena, currSource);
 
     // Source build command
-    StringBuilderAppend(mateState.arena, &builder, &S("build $builddir/"));
+    StringBuilderAppend(mateState.arena, &builder, &S("build $objdir/"));
     StringBuilderAppend(mateState.arena, &builder, &outputFile);
     StringBuilderAppend(mateState.arena, &builder, &S(": compile $cwd/"));
     StringBuilderAppend(mateState.arena, &builder, &sourceFile);
@@ -6281,10 +6287,10 @@ static void mateInstallExecutable(Executable *executable) {
 
     // Add to output files list
     if (outputBuilder.buffer.length == 0) {
-      StringBuilderAppend(mateState.arena, &outputBuilder, &S("$builddir/"));
+      StringBuilderAppend(mateState.arena, &outputBuilder, &S("$objdir/"));
       StringBuilderAppend(mateState.arena, &outputBuilder, &outputFile);
     } else {
-      StringBuilderAppend(mateState.arena, &outputBuilder, &S(" $builddir/"));
+      StringBuilderAppend(mateState.arena, &outputBuilder, &S(" $objdir/"));
       StringBuilderAppend(mateState.arena, &outputBuilder, &outputFile);
     }
   }
@@ -6888,6 +6894,8 @@ i32 main(int argc, const char *argv[]) {
     AddIncludePaths(libllace_dev, "./include");
     AddFile(libllace_dev, "./src/*.c");
     AddFile(libllace_dev, "./src/codegen/*.c");
+    AddFile(libllace_dev, "./src/codegen/amd64/*.c");
+    AddFile(libllace_dev, "./src/codegen/wasm32/*.c");
     AddFile(libllace_dev, "./src/detail/*.c");
     AddFile(libllace_dev, "./src/ir/*.c");
     AddLibraryPaths(libllace_dev, "./build");
@@ -6901,13 +6909,41 @@ i32 main(int argc, const char *argv[]) {
       .error = args.errorfmt,
       .optimization = args.optlevel
     });
-    AddIncludePaths(llace_test, "./include");
+    AddIncludePaths(llace_test, "./include", "./test");
     AddFile(llace_test, "./test/*.c");
     AddFile(llace_test, "./test/codegen/*.c");
     AddFile(llace_test, "./test/ir/*.c");
     AddLibraryPaths(llace_test, "./build");
-    LinkSystemLibraries(llace_test, "llace-dev");
+    LinkSystemLibraries(llace_test, "llace-dev", "pthread");
     InstallExecutable(llace_test);
+
+    Executable llace_logdump = CreateExecutable((ExecutableOptions){
+      .output = "logdump",
+      .std = args.stdlevel,
+      .debug = args.debuglevel,
+      .warnings = args.warninglevel,
+      .error = args.errorfmt,
+      .optimization = args.optlevel
+    });
+    AddIncludePaths(llace_logdump, "./include");
+    AddFile(llace_logdump, "./examples/logdump.c");
+    AddLibraryPaths(llace_logdump, "./build");
+    LinkSystemLibraries(llace_logdump, "llace-dev", "pthread");
+    InstallExecutable(llace_logdump);
+
+    Executable llace_bench = CreateExecutable((ExecutableOptions){
+      .output = "bench",
+      .std = args.stdlevel,
+      .debug = args.debuglevel,
+      .warnings = args.warninglevel,
+      .error = args.errorfmt,
+      .optimization = args.optlevel
+    });
+    AddIncludePaths(llace_bench, "./include");
+    AddFile(llace_bench, "./bench/*.c");
+    AddLibraryPaths(llace_bench, "./build");
+    LinkSystemLibraries(llace_bench, "llace-dev", "pthread", "m");
+    InstallExecutable(llace_bench);
   }
   EndBuild();
   
@@ -0,0 +1,394 @@
+#include <llace/codegen/amd64/amd64.h>
+#include <llace/detail/common.h>
+#include <string.h>
+
+// ================ Form Table ================ //
+
+// Operand classes, where the operand goes in the encoding
+enum {
+  C_NONE,
+  C_R,   // gpr in ModRM.reg
+  C_RM,  // gpr or memory in ModRM.rm
+  C_M,   // memory in ModRM.rm
+  C_OR,  // gpr in the low opcode bits
+  C_CL,  // cl
+  C_X,   // vector in ModRM.reg
+  C_XM,  // vector or memory in ModRM.rm
+  C_XR,  // vector in ModRM.rm
+  C_V,   // vector in VEX/EVEX.vvvv
+  C_I8,  // sign extended imm8
+  C_U8,  // imm8
+  C_IZ,  // imm of the operand size, at most a sign extended imm32
+  C_I64, // imm64
+  C_REL, // rel32
+};
+
+// Operand sizes, one bit per power of two bytes
+#define S8  0x01
+#define S16 0x02
+#define S32 0x04
+#define S64 0x08
+#define SX  0x10
+#define SY  0x20
+#define SZ  0x40
+#define SI  (S16 | S32 | S64)
+#define SA  (S8 | SI)
+#define SV  (SX | SY)
+#define SE  (SX | SY | SZ)
+
+enum { ENC_LEGACY, ENC_VEX };
+enum { PP_NONE, PP_66, PP_F3, PP_F2 };
+enum { MAP_NONE, MAP_0F, MAP_0F38, MAP_0F3A };
+
+enum {
+  F_WBIT = 1 << 0, // byte form at the opcode, wider forms at opcode + 1
+  F_W    = 1 << 1, // REX.W, VEX.W or EVEX.W always set
+  F_EW   = 1 << 2, // EVEX.W set, VEX.W ignored
+  F_D64  = 1 << 3, // 64-bit by default, no REX.W
+  F_CC   = 1 << 4, // condition code added to the opcode
+  F_EVEX = 1 << 5, // has an EVEX form with the same opcode
+  F_T1   = 1 << 6, // EVEX memory operand is one element, no compressed disp8
+};
+
+typedef struct {
+  uint16_t mnemonic;
+  uint8_t enc, pp, map, opcode;
+  int8_t ext; // ModRM.reg digit, -1 for a register operand
+  uint8_t flags;
+  uint8_t ops[4];
+  uint8_t sizes[4];
+} amd64_form_t;
+
+#define FORM(mn, enc, pp, map, op, ext, flags, ops, sizes) { LLACE_AMD64_##mn, enc, pp, map, op, ext, flags, ops, sizes }
+#define O(...) { __VA_ARGS__ }
+
+// Integer operations with the classic ALU encodings: rm,i8 / rm,imm / rm,r / r,rm
+#define ALU(mn, n) \
+  FORM(mn, ENC_LEGACY, PP_NONE, MAP_NONE, 0x83, n, 0, O(C_RM, C_I8), O(SI)), \
+  FORM(mn, ENC_LEGACY, PP_NONE, MAP_NONE, 0x80, n, F_WBIT, O(C_RM, C_IZ), O(SA)), \
+  FORM(mn, ENC_LEGACY, PP_NONE, MAP_NONE, (n) * 8, -1, F_WBIT, O(C_RM, C_R), O(SA, SA)), \
+  FORM(mn, ENC_LEGACY, PP_NONE, MAP_NONE, (n) * 8 + 2, -1, F_WBIT, O(C_R, C_RM), O(SA, SA))
+#define UNARY(mn, n) FORM(mn, ENC_LEGACY, PP_NONE, MAP_NONE, 0xF6, n, F_WBIT, O(C_RM), O(SA))
+#define SHIFT(mn, n) \
+  FORM(mn, ENC_LEGACY, PP_NONE, MAP_NONE, 0xD2, n, F_WBIT, O(C_RM, C_CL), O(SA)), \
+  FORM(mn, ENC_LEGACY, PP_NONE, MAP_NONE, 0xC0, n, F_WBIT, O(C_RM, C_U8), O(SA))
+#define SSE(mn, pp, map, op) FORM(mn, ENC_LEGACY, pp, map, op, -1, 0, O(C_X, C_XM), O(SX, SX))
+#define SSE_MOV(mn, pp, load, store) SSE(mn, pp, MAP_0F, load), FORM(mn, ENC_LEGACY, pp, MAP_0F, store, -1, 0, O(C_XM, C_X), O(SX, SX))
+#define AVX(mn, pp, map, op, flags) FORM(mn, ENC_VEX, pp, map, op, -1, F_EVEX | (flags), O(C_X, C_V, C_XM), O(SE, SE, SE))
+#define AVX_MOV(mn, pp, load, store) \
+  FORM(mn, ENC_VEX, pp, MAP_0F, load, -1, F_EVEX, O(C_X, C_XM), O(SE, SE)), \
+  FORM(mn, ENC_VEX, pp, MAP_0F, store, -1, F_EVEX, O(C_XM, C_X), O(SE, SE))
+
+// Sorted by mnemonic, the forms of one mnemonic in preference order (shorter first)
+static const amd64_form_t amd64_forms[] = {
+  FORM(MOV, ENC_LEGACY, PP_NONE, MAP_NONE, 0x88, -1, F_WBIT, O(C_RM, C_R), O(SA, SA)),
+  FORM(MOV, ENC_LEGACY, PP_NONE, MAP_NONE, 0x8A, -1, F_WBIT, O(C_R, C_RM), O(SA, SA)),
+  FORM(MOV, ENC_LEGACY, PP_NONE, MAP_NONE, 0xB8, -1, 0, O(C_OR, C_IZ), O(S32)),
+  FORM(MOV, ENC_LEGACY, PP_NONE, MAP_NONE, 0xC6, 0, F_WBIT, O(C_RM, C_IZ), O(SA)),
+  FORM(MOV, ENC_LEGACY, PP_NONE, MAP_NONE, 0xB8, -1, 0, O(C_OR, C_I64), O(S64)),
+  FORM(MOVZX, ENC_LEGACY, PP_NONE, MAP_0F, 0xB6, -1, 0, O(C_R, C_RM), O(SI, S8)),
+  FORM(MOVZX, ENC_LEGACY, PP_NONE, MAP_0F, 0xB7, -1, 0, O(C_R, C_RM), O(S32 | S64, S16)),
+  FORM(MOVSX, ENC_LEGACY, PP_NONE, MAP_0F, 0xBE, -1, 0, O(C_R, C_RM), O(SI, S8)),
+  FORM(MOVSX, ENC_LEGACY, PP_NONE, MAP_0F, 0xBF, -1, 0, O(C_R, C_RM), O(S32 | S64, S16)),
+  FORM(MOVSXD, ENC_LEGACY, PP_NONE, MAP_NONE, 0x63, -1, 0, O(C_R, C_RM), O(S64, S32)),
+  FORM(LEA, ENC_LEGACY, PP_NONE, MAP_NONE, 0x8D, -1, 0, O(C_R, C_M), O(SI)),
+  ALU(ADD, 0), ALU(OR, 1), ALU(ADC, 2), ALU(SBB, 3), ALU(AND, 4), ALU(SUB, 5), ALU(XOR, 6), ALU(CMP, 7),
+  FORM(TEST, ENC_LEGACY, PP_NONE, MAP_NONE, 0xF6, 0, F_WBIT, O(C_RM, C_IZ), O(SA)),
+  FORM(TEST, ENC_LEGACY, PP_NONE, MAP_NONE, 0x84, -1, F_WBIT, O(C_RM, C_R), O(SA, SA)),
+  UNARY(NOT, 2), UNARY(NEG, 3), UNARY(MUL, 4),
+  UNARY(IMUL, 5),
+  FORM(IMUL, ENC_LEGACY, PP_NONE, MAP_0F, 0xAF, -1, 0, O(C_R, C_RM), O(SI, SI)),
+  FORM(IMUL, ENC_LEGACY, PP_NONE, MAP_NONE, 0x6B, -1, 0, O(C_R, C_RM, C_I8), O(SI, SI)),
+  FORM(IMUL, ENC_LEGACY, PP_NONE, MAP_NONE, 0x69, -1, 0, O(C_R, C_RM, C_IZ), O(SI, SI)),
+  UNARY(DIV, 6), UNARY(IDIV, 7),
+  SHIFT(ROL, 0), SHIFT(ROR, 1), SHIFT(SHL, 4), SHIFT(SHR, 5), SHIFT(SAR, 7),
+  FORM(CMOVCC, ENC_LEGACY, PP_NONE, MAP_0F, 0x40, -1, F_CC, O(C_R, C_RM), O(SI, SI)),
+  FORM(SETCC, ENC_LEGACY, PP_NONE, MAP_0F, 0x90, 0, F_CC, O(C_RM), O(S8)),
+  FORM(CDQ, ENC_LEGACY, PP_NONE, MAP_NONE, 0x99, -1, 0, O(C_NONE), O(0)),
+  FORM(CQO, ENC_LEGACY, PP_NONE, MAP_NONE, 0x99, -1, F_W, O(C_NONE), O(0)),
+
+  FORM(PUSH, ENC_LEGACY, PP_NONE, MAP_NONE, 0x50, -1, F_D64, O(C_OR), O(S64)),
+  FORM(PUSH, ENC_LEGACY, PP_NONE, MAP_NONE, 0x6A, -1, 0, O(C_I8), O(0)),
+  FORM(PUSH, ENC_LEGACY, PP_NONE, MAP_NONE, 0x68, -1, 0, O(C_IZ), O(0)),
+  FORM(PUSH, ENC_LEGACY, PP_NONE, MAP_NONE, 0xFF, 6, F_D64, O(C_RM), O(S64)),
+  FORM(POP, ENC_LEGACY, PP_NONE, MAP_NONE, 0x58, -1, F_D64, O(C_OR), O(S64)),
+  FORM(POP, ENC_LEGACY, PP_NONE, MAP_NONE, 0x8F, 0, F_D64, O(C_RM), O(S64)),
+  FORM(CALL, ENC_LEGACY, PP_NONE, MAP_NONE, 0xE8, -1, 0, O(C_REL), O(0)),
+  FORM(CALL, ENC_LEGACY, PP_NONE, MAP_NONE, 0xFF, 2, F_D64, O(C_RM), O(S64)),
+  FORM(RET, ENC_LEGACY, PP_NONE, MAP_NONE, 0xC3, -1, 0, O(C_NONE), O(0)),
+  FORM(JMP, ENC_LEGACY, PP_NONE, MAP_NONE, 0xE9, -1, 0, O(C_REL), O(0)),
+  FORM(JMP, ENC_LEGACY, PP_NONE, MAP_NONE, 0xFF, 4, F_D64, O(C_RM), O(S64)),
+  FORM(JCC, ENC_LEGACY, PP_NONE, MAP_0F, 0x80, -1, F_CC, O(C_REL), O(0)),
+  FORM(NOP, ENC_LEGACY, PP_NONE, MAP_NONE, 0x90, -1, 0, O(C_NONE), O(0)),
+  FORM(INT3, ENC_LEGACY, PP_NONE, MAP_NONE, 0xCC, -1, 0, O(C_NONE), O(0)),
+  FORM(UD2, ENC_LEGACY, PP_NONE, MAP_0F, 0x0B, -1, 0, O(C_NONE), O(0)),
+
+  FORM(MOVD, ENC_LEGACY, PP_66, MAP_0F, 0x6E, -1, 0, O(C_X, C_RM), O(SX, S32)),
+  FORM(MOVD, ENC_LEGACY, PP_66, MAP_0F, 0x7E, -1, 0, O(C_RM, C_X), O(S32, SX)),
+  FORM(MOVQ, ENC_LEGACY, PP_66, MAP_0F, 0x6E, -1, 0, O(C_X, C_RM), O(SX, S64)),
+  FORM(MOVQ, ENC_LEGACY, PP_66, MAP_0F, 0x7E, -1, 0, O(C_RM, C_X), O(S64, SX)),
+  SSE_MOV(MOVSS, PP_F3, 0x10, 0x11), SSE_MOV(MOVSD, PP_F2, 0x10, 0x11),
+  SSE_MOV(MOVAPS, PP_NONE, 0x28, 0x29), SSE_MOV(MOVUPS, PP_NONE, 0x10, 0x11),
+  SSE_MOV(MOVDQA, PP_66, 0x6F, 0x7F), SSE_MOV(MOVDQU, PP_F3, 0x6F, 0x7F),
+  SSE(ADDSS, PP_F3, MAP_0F, 0x58), SSE(ADDSD, PP_F2, MAP_0F, 0x58), SSE(ADDPS, PP_NONE, MAP_0F, 0x58), SSE(ADDPD, PP_66, MAP_0F, 0x58),
+  SSE(SUBSS, PP_F3, MAP_0F, 0x5C), SSE(SUBSD, PP_F2, MAP_0F, 0x5C), SSE(SUBPS, PP_NONE, MAP_0F, 0x5C), SSE(SUBPD, PP_66, MAP_0F, 0x5C),
+  SSE(MULSS, PP_F3, MAP_0F, 0x59), SSE(MULSD, PP_F2, MAP_0F, 0x59), SSE(MULPS, PP_NONE, MAP_0F, 0x59), SSE(MULPD, PP_66, MAP_0F, 0x59),
+  SSE(DIVSS, PP_F3, MAP_0F, 0x5E), SSE(DIVSD, PP_F2, MAP_0F, 0x5E), SSE(DIVPS, PP_NONE, MAP_0F, 0x5E), SSE(DIVPD, PP_66, MAP_0F, 0x5E),
+  SSE(SQRTSS, PP_F3, MAP_0F, 0x51), SSE(SQRTSD, PP_F2, MAP_0F, 0x51),
+  SSE(UCOMISS, PP_NONE, MAP_0F, 0x2E), SSE(UCOMISD, PP_66, MAP_0F, 0x2E),
+  FORM(CVTSI2SS, ENC_LEGACY, PP_F3, MAP_0F, 0x2A, -1, 0, O(C_X, C_RM), O(SX, S32 | S64)),
+  FORM(CVTSI2SD, ENC_LEGACY, PP_F2, MAP_0F, 0x2A, -1, 0, O(C_X, C_RM), O(SX, S32 | S64)),
+  FORM(CVTTSS2SI, ENC_LEGACY, PP_F3, MAP_0F, 0x2C, -1, 0, O(C_R, C_XM), O(S32 | S64, SX)),
+  FORM(CVTTSD2SI, ENC_LEGACY, PP_F2, MAP_0F, 0x2C, -1, 0, O(C_R, C_XM), O(S32 | S64, SX)),
+  SSE(CVTSS2SD, PP_F3, MAP_0F, 0x5A), SSE(CVTSD2SS, PP_F2, MAP_0F, 0x5A),
+  SSE(ANDPS, PP_NONE, MAP_0F, 0x54), SSE(ORPS, PP_NONE, MAP_0F, 0x56), SSE(XORPS, PP_NONE, MAP_0F, 0x57),
+  SSE(PADDB, PP_66, MAP_0F, 0xFC), SSE(PADDW, PP_66, MAP_0F, 0xFD), SSE(PADDD, PP_66, MAP_0F, 0xFE), SSE(PADDQ, PP_66, MAP_0F, 0xD4),
+  SSE(PSUBB, PP_66, MAP_0F, 0xF8), SSE(PSUBW, PP_66, MAP_0F, 0xF9), SSE(PSUBD, PP_66, MAP_0F, 0xFA), SSE(PSUBQ, PP_66, MAP_0F, 0xFB),
+  SSE(PMULLW, PP_66, MAP_0F, 0xD5), SSE(PMULLD, PP_66, MAP_0F38, 0x40),
+  SSE(PAND, PP_66, MAP_0F, 0xDB), SSE(PANDN, PP_66, MAP_0F, 0xDF), SSE(POR, PP_66, MAP_0F, 0xEB), SSE(PXOR, PP_66, MAP_0F, 0xEF),
+  SSE(PCMPEQD, PP_66, MAP_0F, 0x76), SSE(PCMPGTD, PP_66, MAP_0F, 0x66),
+  FORM(PSLLD, ENC_LEGACY, PP_66, MAP_0F, 0x72, 6, 0, O(C_XR, C_U8), O(SX)),
+  FORM(PSRLD, ENC_LEGACY, PP_66, MAP_0F, 0x72, 2, 0, O(C_XR, C_U8), O(SX)),
+  FORM(PSRAD, ENC_LEGACY, PP_66, MAP_0F, 0x72, 4, 0, O(C_XR, C_U8), O(SX)),
+  FORM(PSHUFD, ENC_LEGACY, PP_66, MAP_0F, 0x70, -1, 0, O(C_X, C_XM, C_U8), O(SX, SX)),
+  FORM(SHUFPS, ENC_LEGACY, PP_NONE, MAP_0F, 0xC6, -1, 0, O(C_X, C_XM, C_U8), O(SX, SX)),
+  FORM(PEXTRD, ENC_LEGACY, PP_66, MAP_0F3A, 0x16, -1, 0, O(C_RM, C_X, C_U8), O(S32, SX)),
+  FORM(PEXTRQ, ENC_LEGACY, PP_66, MAP_0F3A, 0x16, -1, 0, O(C_RM, C_X, C_U8), O(S64, SX)),
+  FORM(PINSRD, ENC_LEGACY, PP_66, MAP_0F3A, 0x22, -1, 0, O(C_X, C_RM, C_U8), O(SX, S32)),
+  FORM(PINSRQ, ENC_LEGACY, PP_66, MAP_0F3A, 0x22, -1, 0, O(C_X, C_RM, C_U8), O(SX, S64)),
+
+  AVX_MOV(VMOVUPS, PP_NONE, 0x10, 0x11), AVX_MOV(VMOVDQU, PP_F3, 0x6F, 0x7F),
+  AVX(VADDPS, PP_NONE, MAP_0F, 0x58, 0), AVX(VADDPD, PP_66, MAP_0F, 0x58, F_EW),
+  AVX(VSUBPS, PP_NONE, MAP_0F, 0x5C, 0), AVX(VSUBPD, PP_66, MAP_0F, 0x5C, F_EW),
+  AVX(VMULPS, PP_NONE, MAP_0F, 0x59, 0), AVX(VMULPD, PP_66, MAP_0F, 0x59, F_EW),
+  AVX(VDIVPS, PP_NONE, MAP_0F, 0x5E, 0), AVX(VDIVPD, PP_66, MAP_0F, 0x5E, F_EW),
+  AVX(VFMADD231PS, PP_66, MAP_0F38, 0xB8, 0), AVX(VFMADD231PD, PP_66, MAP_0F38, 0xB8, F_W),
+  AVX(VPADDB, PP_66, MAP_0F, 0xFC, 0), AVX(VPADDW, PP_66, MAP_0F, 0xFD, 0), AVX(VPADDD, PP_66, MAP_0F, 0xFE, 0), AVX(VPADDQ, PP_66, MAP_0F, 0xD4, F_EW),
+  AVX(VPSUBB, PP_66, MAP_0F, 0xF8, 0), AVX(VPSUBW, PP_66, MAP_0F, 0xF9, 0), AVX(VPSUBD, PP_66, MAP_0F, 0xFA, 0), AVX(VPSUBQ, PP_66, MAP_0F, 0xFB, F_EW),
+  AVX(VPMULLW, PP_66, MAP_0F, 0xD5, 0), AVX(VPMULLD, PP_66, MAP_0F38, 0x40, 0),
+  AVX(VPAND, PP_66, MAP_0F, 0xDB, 0), AVX(VPOR, PP_66, MAP_0F, 0xEB, 0), AVX(VPXOR, PP_66, MAP_0F, 0xEF, 0), AVX(VXORPS, PP_NONE, MAP_0F, 0x57, 0),
+  FORM(VBROADCASTSS, ENC_VEX, PP_66, MAP_0F38, 0x18, -1, F_EVEX | F_T1, O(C_X, C_XM), O(SE, SX)),
+  FORM(VPBROADCASTB, ENC_VEX, PP_66, MAP_0F38, 0x78, -1, F_EVEX | F_T1, O(C_X, C_XM), O(SE, SX)),
+  FORM(VPBROADCASTW, ENC_VEX, PP_66, MAP_0F38, 0x79, -1, F_EVEX | F_T1, O(C_X, C_XM), O(SE, SX)),
+  FORM(VPBROADCASTD, ENC_VEX, PP_66, MAP_0F38, 0x58, -1, F_EVEX | F_T1, O(C_X, C_XM), O(SE, SX)),
+  FORM(VPBROADCASTQ, ENC_VEX, PP_66, MAP_0F38, 0x59, -1, F_EVEX | F_EW | F_T1, O(C_X, C_XM), O(SE, SX)),
+  FORM(VEXTRACTI128, ENC_VEX, PP_66, MAP_0F3A, 0x39, -1, 0, O(C_XM, C_X, C_U8), O(SX, SY)),
+  FORM(VZEROUPPER, ENC_VEX, PP_NONE, MAP_0F, 0x77, -1, 0, O(C_NONE), O(0)),
+};
+
+#define AMD64_FORM_COUNT (sizeof(amd64_forms) / sizeof(amd64_forms[0]))
+
+// ================ Operand Matching ================ //
+
+static bool amd64_size_ok(uint8_t sizes, uint8_t size) {
+  if (sizes == 0) return true;
+  return size != 0 && (size & (size - 1)) == 0 && size <= 64 && (sizes & size) != 0; // one bit per power of two
+}
+
+static bool amd64_mem_ok(const llace_amd64_operand_t *op) {
+  if (op->kind != LLACE_AMD64_OPND_MEM) return false;
+  if (op->base != LLACE_AMD64_NOREG && (op->base < 0 || op->base > LLACE_AMD64_RIP)) return false;
+  if (op->index != LLACE_AMD64_NOREG && (op->index < 0 || op->index > 15 || op->index == LLACE_AMD64_RSP)) return false;
+  if (op->base == LLACE_AMD64_RIP && op->index != LLACE_AMD64_NOREG) return false;
+  return op->index == LLACE_AMD64_NOREG || op->scale == 1 || op->scale == 2 || op->scale == 4 || op->scale == 8;
+}
+
+static bool amd64_imm_fits(int64_t value, size_t bytes) {
+  switch (bytes) {
+  case 1:  return value >= -128 && value <= 255;
+  case 2:  return value >= -32768 && value <= 65535;
+  default: return value >= INT32_MIN && value <= INT32_MAX;
+  }
+}
+
+static bool amd64_operand_ok(uint8_t cls, uint8_t sizes, const llace_amd64_operand_t *op, size_t osize) {
+  bool gpr = op->kind == LLACE_AMD64_OPND_GPR && op->reg < 16 && amd64_size_ok(sizes, op->size);
+  bool vec = op->kind == LLACE_AMD64_OPND_VEC && op->reg < 32 && amd64_size_ok(sizes, op->size);
+  switch (cls) {
+  case C_R: case C_OR: return gpr;
+  case C_CL:  return op->kind == LLACE_AMD64_OPND_GPR && op->reg == LLACE_AMD64_RCX && op->size == 1;
+  case C_RM:  return gpr || (amd64_mem_ok(op) && amd64_size_ok(sizes, op->size));
+  case C_M:   return amd64_mem_ok(op);
+  case C_X: case C_XR: case C_V: return vec;
+  case C_XM:  return vec || amd64_mem_ok(op);
+  case C_I8:  return op->kind == LLACE_AMD64_OPND_IMM && op->imm >= -128 && op->imm <= 127;
+  case C_U8:  return op->kind == LLACE_AMD64_OPND_IMM && op->imm >= -128 && op->imm <= 255;
+  case C_IZ:  return op->kind == LLACE_AMD64_OPND_IMM && amd64_imm_fits(op->imm, osize);
+  case C_I64: return op->kind == LLACE_AMD64_OPND_IMM;
+  case C_REL: return op->kind == LLACE_AMD64_OPND_REL && op->imm >= INT32_MIN && op->imm <= INT32_MAX;
+  default:    return false;
+  }
+}
+
+// Operand size of the integer operation, from its first gpr or memory operand (0 if none)
+static size_t amd64_osize(const amd64_form_t *form, const llace_amd64_inst_t *inst) {
+  for (size_t i = 0; i < 4 && form->ops[i] != C_NONE; ++i) {
+    uint8_t cls = form->ops[i];
+    if (cls == C_R || cls == C_RM || cls == C_OR) return inst->ops[i].size;
+  }
+  return 0;
+}
+
+static bool amd64_form_ok(const amd64_form_t *form, const llace_amd64_inst_t *inst) {
+  size_t count = 0;
+  while (count < 4 && form->ops[count] != C_NONE) ++count;
+  if (count != inst->count) return false;
+
+  // Integer operands with the same allowed sizes must agree on one
+  size_t osize = amd64_osize(form, inst), first = 4;
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t cls = form->ops[i];
+    if (!amd64_operand_ok(cls, form->sizes[i], &inst->ops[i], osize)) return false;
+    if (cls != C_R && cls != C_RM && cls != C_OR) continue;
+    if (first == 4) first = i;
+    else if (form->sizes[i] == form->sizes[first] && inst->ops[i].size != osize) return false;
+  }
+  return true;
+}
+
+// ================ Emission ================ //
+
+static uint8_t *amd64_put(uint8_t *p, uint64_t value, size_t bytes) {
+  for (size_t i = 0; i < bytes; ++i) *p++ = (uint8_t)(value >> (8 * i));
+  return p;
+}
+
+// ModRM, SIB and displacement, disp8 is scaled by n for EVEX (0 never uses disp8)
+static uint8_t *amd64_modrm(uint8_t *p, uint8_t reg, const llace_amd64_operand_t *rm, size_t n, uint8_t **disp32) {
+  if (rm->kind != LLACE_AMD64_OPND_MEM) {
+    *p++ = (uint8_t)(0xC0 | (reg & 7) << 3 | (rm->reg & 7));
+    return p;
+  }
+  if (rm->base == LLACE_AMD64_RIP) {
+    *p++ = (uint8_t)((reg & 7) << 3 | 5);
+    *disp32 = p;
+    return amd64_put(p, (uint32_t)rm->disp, 4);
+  }
+
+  bool no_base = rm->base == LLACE_AMD64_NOREG;
+  bool sib = rm->index != LLACE_AMD64_NOREG || no_base || (rm->base & 7) == 4;
+  bool disp8 = n > 0 && rm->disp % (int32_t)n == 0 && rm->disp / (int32_t)n >= -128 && rm->disp / (int32_t)n <= 127;
+  uint8_t mod;
+  if (no_base) mod = 0;
+  else if (rm->disp == 0 && (rm->base & 7) != 5) mod = 0;
+  else if (disp8) mod = 1;
+  else mod = 2;
+
+  *p++ = (uint8_t)(mod << 6 | (reg & 7) << 3 | (sib ? 4 : rm->base & 7));
+  if (sib) {
+    uint8_t ss = rm->scale == 8 ? 3 : rm->scale == 4 ? 2 : rm->scale == 2 ? 1 : 0;
+    uint8_t index = rm->index == LLACE_AMD64_NOREG ? 4 : rm->index & 7;
+    *p++ = (uint8_t)(ss << 6 | index << 3 | (no_base ? 5 : rm->base & 7));
+  }
+  if (mod == 1) *p++ = (uint8_t)(int8_t)(rm->disp / (int32_t)n);
+  else if (mod == 2 || no_base) p = amd64_put(p, (uint32_t)rm->disp, 4);
+  return p;
+}
+
+// Binary search for the first form of a mnemonic
+static size_t amd64_first_form(llace_amd64_mnemonic_t mnemonic) {
+  size_t lo = 0, hi = AMD64_FORM_COUNT;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (amd64_forms[mid].mnemonic < mnemonic) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+llace_error_t llace_amd64_encode(llace_codebuf_t *buf, const llace_amd64_inst_t *inst, llace_amd64_fixup_t *fixup) {
+  if (!buf || !inst || inst->count > 4 || inst->mnemonic >= LLACE_AMD64_MNEMONIC_COUNT) {
+    return LLACE_ERROR_BADARG;
+  }
+
+  const amd64_form_t *form = NULL;
+  for (size_t f = amd64_first_form(inst->mnemonic); f < AMD64_FORM_COUNT && amd64_forms[f].mnemonic == inst->mnemonic; ++f) {
+    if (amd64_form_ok(&amd64_forms[f], inst)) { form = &amd64_forms[f]; break; }
+  }
+  if (form == NULL) return LLACE_ERROR_BADARG;
+
+  // Where every operand goes
+  const llace_amd64_operand_t *rm = NULL, *imm = NULL;
+  uint8_t reg = form->ext >= 0 ? (uint8_t)form->ext : 0, vvvv = 0, opreg = 0, imm_size = 0, vsize = 16;
+  bool byte_regs = false, upper = false;
+  size_t osize = amd64_osize(form, inst);
+  for (size_t i = 0; i < inst->count; ++i) {
+    const llace_amd64_operand_t *op = &inst->ops[i];
+    switch (form->ops[i]) {
+    case C_R: case C_X: reg = op->reg; break;
+    case C_RM: case C_M: case C_XM: case C_XR: rm = op; break;
+    case C_OR: opreg = op->reg; break;
+    case C_V: vvvv = op->reg; break;
+    case C_I8: case C_U8: imm = op; imm_size = 1; break;
+    case C_IZ: imm = op; imm_size = osize == 1 ? 1 : osize == 2 ? 2 : 4; break;
+    case C_I64: imm = op; imm_size = 8; break;
+    case C_REL: imm = op; imm_size = 4; break;
+    default: break;
+    }
+    if (op->kind == LLACE_AMD64_OPND_GPR && op->size == 1 && op->reg >= 4) byte_regs = true;
+    if (op->kind == LLACE_AMD64_OPND_VEC) {
+      vsize = LLACE_MAX(vsize, op->size);
+      upper |= op->reg >= 16;
+    }
+  }
+  uint8_t index = rm && rm->kind == LLACE_AMD64_OPND_MEM && rm->index != LLACE_AMD64_NOREG ? (uint8_t)rm->index : 0;
+  uint8_t base = rm == NULL ? opreg : rm->kind != LLACE_AMD64_OPND_MEM ? rm->reg : rm->base >= 0 && rm->base < 16 ? (uint8_t)rm->base : 0;
+
+  bool evex = form->enc == ENC_VEX && (vsize == 64 || upper);
+  if (evex && !(form->flags & F_EVEX)) return LLACE_ERROR_BADARG;
+
+  LLACE_CODEBUF_RESERVE(buf, LLACE_AMD64_MAX_INST);
+  uint8_t *start = buf->data + buf->size, *p = start, *disp32 = NULL;
+  static const uint8_t prefixes[] = { 0, 0x66, 0xF3, 0xF2 };
+
+  if (form->enc == ENC_LEGACY) {
+    bool w = (form->flags & F_W) || (osize == 8 && !(form->flags & F_D64));
+    uint8_t rex = (uint8_t)(0x40 | w << 3 | (reg >> 3 & 1) << 2 | (index >> 3 & 1) << 1 | (base >> 3 & 1));
+    if (osize == 2) *p++ = 0x66;
+    if (form->pp != PP_NONE) *p++ = prefixes[form->pp];
+    if (rex != 0x40 || byte_regs) *p++ = rex;
+    if (form->map != MAP_NONE) *p++ = 0x0F;
+    if (form->map == MAP_0F38) *p++ = 0x38;
+    if (form->map == MAP_0F3A) *p++ = 0x3A;
+  } else if (!evex) {
+    bool w = (form->flags & F_W) != 0;
+    uint8_t r = ~reg >> 3 & 1, x = ~index >> 3 & 1, b = ~base >> 3 & 1, l = vsize == 32;
+    uint8_t tail = (uint8_t)((~vvvv & 15) << 3 | l << 2 | form->pp);
+    if (x && b && !w && form->map == MAP_0F) {
+      *p++ = 0xC5;
+      *p++ = (uint8_t)(r << 7 | tail);
+    } else {
+      *p++ = 0xC4;
+      *p++ = (uint8_t)(r << 7 | x << 6 | b << 5 | form->map);
+      *p++ = (uint8_t)(w << 7 | tail);
+    }
+  } else {
+    bool w = (form->flags & (F_W | F_EW)) != 0;
+    bool rm_vec = rm && rm->kind == LLACE_AMD64_OPND_VEC;
+    uint8_t x = rm_vec ? rm->reg >> 4 & 1 : index >> 3 & 1;
+    uint8_t ll = vsize == 64 ? 2 : vsize == 32 ? 1 : 0;
+    *p++ = 0x62;
+    *p++ = (uint8_t)((~reg >> 3 & 1) << 7 | (~x & 1) << 6 | (~base >> 3 & 1) << 5 | (~reg >> 4 & 1) << 4 | form->map);
+    *p++ = (uint8_t)(w << 7 | (~vvvv & 15) << 3 | 1 << 2 | form->pp);
+    *p++ = (uint8_t)(ll << 5 | (~vvvv >> 4 & 1) << 3);
+  }
+
+  uint8_t opcode = form->opcode;
+  if ((form->flags & F_WBIT) && osize != 1) opcode += 1;
+  if (form->flags & F_CC) opcode += (uint8_t)inst->cond;
+  if (rm == NULL && form->ops[0] == C_OR) opcode += opreg & 7;
+  *p++ = opcode;
+
+  if (rm) p = amd64_modrm(p, reg, rm, evex ? ((form->flags & F_T1) ? 0 : vsize) : 1, &disp32);
+  if (imm) {
+    if (form->ops[inst->count - 1] == C_REL) disp32 = p;
+    p = amd64_put(p, (uint64_t)imm->imm, imm_size);
+  }
+
+  buf->size += (size_t)(p - start);
+  if (fixup) {
+    fixup->offset = disp32 ? (size_t)(disp32 - buf->data) : SIZE_MAX;
+    fixup->end = buf->size;
+  }
+  return LLACE_ERROR_NONE;
+}
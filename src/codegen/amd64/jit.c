@@ -0,0 +1,326 @@
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS, MAP_NORESERVE, madvise
+#include <llace/codegen/jit.h>
+#include <llace/codegen/isel.h>
+#include <llace/profile.h>
+#include <llace/detail/common.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define JIT_FUNC(jit, index) LLACE_ARRAY_GET(llace_jit_func_t, (jit)->funcs, (index))
+#define JIT_REGION(jit, index) LLACE_ARRAY_GET(llace_jit_region_t, (jit)->regions, (index))
+#define JIT_ROUND(jit, size) (((size) + (jit)->page - 1) & ~((jit)->page - 1))
+
+// ================ Pages ================ //
+
+static void jit_unfree(llace_jit_t *jit, size_t index) {
+  *LLACE_ARRAY_GET(llace_jit_region_t, jit->free, index) = *(llace_jit_region_t *)llace_mem_array_back(&jit->free);
+  --jit->free.element_count;
+}
+
+// Pages of the reserved range, first fit among the released ones
+static uint8_t *jit_pages(llace_jit_t *jit, size_t size, int prot, size_t *offset) {
+  size = JIT_ROUND(jit, size);
+  *offset = SIZE_MAX;
+  for (size_t i = 0; i < LLACE_ARRAY_COUNT(jit->free); ++i) {
+    llace_jit_region_t *range = LLACE_ARRAY_GET(llace_jit_region_t, jit->free, i);
+    if (range->size < size) continue;
+    *offset = range->offset;
+    range->offset += size;
+    range->size -= size;
+    if (range->size == 0) jit_unfree(jit, i);
+    break;
+  }
+  if (*offset == SIZE_MAX) {
+    if (LLACE_JIT_RESERVE - jit->used < size) return NULL;
+    *offset = jit->used;
+    jit->used += size;
+  }
+
+  if (mprotect(jit->base + *offset, size, prot) != 0) {
+    LLACE_LOG_ERROR("Failed to map '%zu' bytes of JIT pages", size);
+    return NULL;
+  }
+  jit->stats.pages += size / jit->page;
+  return jit->base + *offset;
+}
+
+static void jit_release(llace_jit_t *jit, size_t offset, size_t size) {
+  madvise(jit->base + offset, size, MADV_DONTNEED);
+  mprotect(jit->base + offset, size, PROT_NONE);
+  jit->stats.pages -= size / jit->page;
+
+  // Merge with released neighbours
+  for (size_t i = 0; i < LLACE_ARRAY_COUNT(jit->free);) {
+    llace_jit_region_t *range = LLACE_ARRAY_GET(llace_jit_region_t, jit->free, i);
+    if (range->offset + range->size == offset || offset + size == range->offset) {
+      offset = LLACE_MIN(offset, range->offset);
+      size += range->size;
+      jit_unfree(jit, i);
+    } else {
+      ++i;
+    }
+  }
+  LLACE_ARRAY_PUSH(jit->free, ((llace_jit_region_t){ .offset = offset, .size = size }));
+}
+
+// ================ Engine ================ //
+
+llace_error_t llace_jit_init(llace_jit_t *jit, llace_ir_context_t *ctx, const llace_config_t *config) {
+  if (!jit || !ctx) {
+    return LLACE_ERROR_BADARG;
+  }
+
+  *jit = (llace_jit_t){ .ctx = ctx, .page = (size_t)sysconf(_SC_PAGESIZE) };
+  if (config) {
+    jit->config = *config;
+  } else {
+    llace_config_init(&jit->config);
+  }
+
+  void *base = mmap(NULL, LLACE_JIT_RESERVE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (base == MAP_FAILED) {
+    LLACE_LOG_ERROR("Failed to reserve '%zu' bytes for the JIT", LLACE_JIT_RESERVE);
+    return LLACE_ERROR_NOMEM;
+  }
+  jit->base = base;
+  jit->free = LLACE_NEW_ARRAY(llace_jit_region_t, 8);
+  jit->regions = LLACE_NEW_ARRAY(llace_jit_region_t, 8);
+  jit->funcs = LLACE_NEW_ARRAY(llace_jit_func_t, 16);
+  jit->globals = LLACE_NEW_ARRAY(uint8_t *, 16);
+  return LLACE_ERROR_NONE;
+}
+
+void llace_jit_free(llace_jit_t *jit) {
+  if (jit->base) munmap(jit->base, LLACE_JIT_RESERVE);
+  LLACE_FREE_ARRAY(jit->free);
+  LLACE_FREE_ARRAY(jit->regions);
+  LLACE_FREE_ARRAY(jit->funcs);
+  LLACE_FREE_ARRAY(jit->globals);
+  *jit = (llace_jit_t){0};
+}
+
+// Functions and globals added to the context since the last call
+static void jit_sync(llace_jit_t *jit) {
+  while (LLACE_ARRAY_COUNT(jit->funcs) < LLACE_ARRAY_COUNT(jit->ctx->funcmap.funcs)) {
+    LLACE_ARRAY_PUSH(jit->funcs, ((llace_jit_func_t){ .entry = NULL, .region = SIZE_MAX }));
+  }
+  while (LLACE_ARRAY_COUNT(jit->globals) < LLACE_ARRAY_COUNT(jit->ctx->globmap.globals)) {
+    LLACE_ARRAY_PUSH(jit->globals, (uint8_t *)NULL);
+  }
+}
+
+void *llace_jit_global(llace_jit_t *jit, size_t global) {
+  jit_sync(jit);
+  if (global >= LLACE_ARRAY_COUNT(jit->globals)) return NULL;
+  uint8_t **slot = LLACE_ARRAY_GET(uint8_t *, jit->globals, global);
+  if (*slot) return *slot;
+
+  const llace_ir_global_t *glob = LLACE_IR_GLOBAL_AT(jit->ctx, global);
+  size_t size = glob->attr.depth > 0 ? 8 : LLACE_MAX(llace_ir_type_bits(glob->type) / 8, (size_t)1), align = 1;
+  while (align < size && align < 64) align *= 2;
+
+  size_t pad = (align - (uintptr_t)jit->data % align) % align;
+  if (jit->data_left < pad + size) {
+    size_t offset;
+    jit->data = jit_pages(jit, size, PROT_READ | PROT_WRITE, &offset);
+    if (jit->data == NULL) { jit->data_left = 0; return NULL; }
+    jit->data_left = JIT_ROUND(jit, size);
+    pad = 0;
+  }
+  *slot = jit->data + pad;
+  jit->data += pad + size;
+  jit->data_left -= pad + size;
+
+  // Pages come zeroed, only constants need writing
+  if (glob->value.kind == LLACE_IR_VALUE_CONST && glob->attr.depth == 0) {
+    if (glob->type.kind == LLACE_IR_TYPE_FLOAT && size == 4) {
+      float value = (float)glob->value._float;
+      memcpy(*slot, &value, sizeof(value));
+    } else {
+      memcpy(*slot, &glob->value._int, LLACE_MIN(size, sizeof(glob->value._int)));
+    }
+  }
+  return *slot;
+}
+
+// ================ Compilation ================ //
+
+// One function of the region being built
+typedef struct jit_unit {
+  size_t function;
+  size_t start;         // in the region
+  llace_amd64_code_t code;
+  size_t *offsets;      // per instruction, then the end
+  llace_array_t fixups; // llace_amd64_fixup_t per instruction
+} jit_unit_t;
+
+// The function and everything it calls that is not compiled yet, unit holds their index + 1
+static llace_error_t jit_collect(llace_jit_t *jit, size_t function, size_t *unit, llace_array_t *units) {
+  llace_array_t work = LLACE_NEW_ARRAY(size_t, 8);
+  LLACE_ARRAY_PUSH(work, function);
+  unit[function] = 1;
+  LLACE_ARRAY_PUSH(*units, ((jit_unit_t){ .function = function }));
+
+  llace_error_t err = LLACE_ERROR_NONE;
+  while (!LLACE_ARRAY_IS_EMPTY(work) && err == LLACE_ERROR_NONE) {
+    size_t f = *(size_t *)llace_mem_array_back(&work);
+    --work.element_count;
+    const llace_ir_function_t *fn = LLACE_IR_FUNCTION(jit->ctx, f);
+    if (LLACE_ARRAY_IS_EMPTY(fn->blocks)) {
+      LLACE_LOG_ERROR("JIT: function '%s' has no body", fn->name);
+      err = LLACE_ERROR_UNRESSYM;
+    }
+    LLACE_ARRAY_FOREACH(llace_ir_basicblock_t, block, fn->blocks) {
+      LLACE_ARRAY_FOREACH(llace_ir_value_t, value, block->stack) {
+        if (!LLACE_IR_IS_OP(value, LLACE_IR_OP_CALL)) continue;
+        size_t callee = value->instr.func;
+        if (unit[callee] != 0 || JIT_FUNC(jit, callee)->entry != NULL) continue;
+        LLACE_ARRAY_PUSH(*units, ((jit_unit_t){ .function = callee }));
+        unit[callee] = LLACE_ARRAY_COUNT(*units);
+        LLACE_ARRAY_PUSH(work, callee);
+      }
+    }
+  }
+  LLACE_FREE_ARRAY(work);
+  return err;
+}
+
+static llace_error_t jit_compile(llace_jit_t *jit, jit_unit_t *unit, llace_codebuf_t *buf) {
+  llace_ir_function_t *fn = LLACE_IR_FUNCTION(jit->ctx, unit->function);
+  llace_regalloc_t ra = {0};
+  LLACE_RUNCHECK(llace_isel_scalarize(jit->ctx, fn, &jit->config.target, NULL));
+  LLACE_RUNCHECK(llace_isel_fold(fn, NULL));
+  llace_error_t err = llace_regalloc(jit->ctx, &jit->config, fn, llace_amd64_regset(), &ra);
+  if (err == LLACE_ERROR_NONE) err = llace_amd64_select(jit->ctx, fn, &ra, &unit->code);
+  llace_regalloc_free(&ra);
+  if (err != LLACE_ERROR_NONE) return err;
+
+  // Functions start 16 byte aligned, int3 in between
+  static const uint8_t int3[16] = { 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC };
+  llace_codebuf_write(buf, int3, (16 - buf->size % 16) % 16);
+  unit->start = buf->size;
+
+  LLACE_PROFILE_SCOPE("encode");
+  size_t count = LLACE_ARRAY_COUNT(unit->code.insts);
+  unit->offsets = malloc((count + 1) * sizeof(size_t));
+  if (unit->offsets == NULL) { LLACE_LOG_FATAL("Failed to allocate '%zu' instruction offsets", count); }
+  unit->fixups = LLACE_NEW_ARRAY(llace_amd64_fixup_t, count);
+  LLACE_CODEBUF_RESERVE(buf, count * LLACE_AMD64_MAX_INST);
+  for (size_t k = 0; k < count; ++k) {
+    llace_amd64_fixup_t fixup;
+    unit->offsets[k] = buf->size;
+    LLACE_RUNCHECK(llace_amd64_encode(buf, &LLACE_ARRAY_GET(llace_amd64_minst_t, unit->code.insts, k)->inst, &fixup));
+    LLACE_ARRAY_PUSHP(unit->fixups, &fixup);
+  }
+  unit->offsets[count] = buf->size;
+  return LLACE_ERROR_NONE;
+}
+
+// Patches the rel32 fields of the unit for the region at code
+static llace_error_t jit_link(llace_jit_t *jit, const jit_unit_t *unit, const jit_unit_t *units, const size_t *unit_of, llace_codebuf_t *buf,
+                              uint8_t *code) {
+  for (size_t k = 0; k < LLACE_ARRAY_COUNT(unit->code.insts); ++k) {
+    const llace_amd64_minst_t *minst = LLACE_ARRAY_GET(llace_amd64_minst_t, unit->code.insts, k);
+    const llace_amd64_fixup_t *fixup = LLACE_ARRAY_GET(llace_amd64_fixup_t, unit->fixups, k);
+    if (minst->sym == LLACE_AMD64_SYM_NONE || fixup->offset == SIZE_MAX) continue;
+
+    const uint8_t *target = NULL;
+    switch (minst->sym) {
+    case LLACE_AMD64_SYM_LABEL: target = code + unit->offsets[*LLACE_ARRAY_GET(size_t, unit->code.labels, minst->target)]; break;
+    case LLACE_AMD64_SYM_FUNC:
+      target = unit_of[minst->target] ? code + units[unit_of[minst->target] - 1].start : JIT_FUNC(jit, minst->target)->entry;
+      break;
+    case LLACE_AMD64_SYM_GLOBAL: target = llace_jit_global(jit, minst->target); break;
+    default: break;
+    }
+    if (target == NULL) return LLACE_ERROR_UNRESSYM;
+
+    // The field may already hold a displacement (rip operands with an offset)
+    int32_t field;
+    memcpy(&field, buf->data + fixup->offset, sizeof(field));
+    int64_t rel = (int64_t)(target - (code + fixup->end)) + field;
+    if (rel < INT32_MIN || rel > INT32_MAX) return LLACE_ERROR_OVERFLOW;
+    field = (int32_t)rel;
+    memcpy(buf->data + fixup->offset, &field, sizeof(field));
+  }
+  return LLACE_ERROR_NONE;
+}
+
+llace_error_t llace_jit_add(llace_jit_t *jit, size_t function, void **entry) {
+  LLACE_PROFILE_SCOPE("jit");
+  LLACE_MEM_SCOPE(LLACE_MEM_CODEGEN);
+  if (!jit || !jit->base) {
+    return LLACE_ERROR_BADARG;
+  }
+  jit_sync(jit);
+  if (function >= LLACE_ARRAY_COUNT(jit->funcs)) {
+    return LLACE_ERROR_INVLFUNC;
+  }
+  if (JIT_FUNC(jit, function)->entry) {
+    if (entry) *entry = JIT_FUNC(jit, function)->entry;
+    return LLACE_ERROR_NONE;
+  }
+
+  size_t *unit_of = calloc(LLACE_ARRAY_COUNT(jit->funcs), sizeof(size_t));
+  if (unit_of == NULL) { LLACE_LOG_FATAL("Failed to allocate the JIT worklist"); }
+  llace_array_t units = LLACE_NEW_ARRAY(jit_unit_t, 4);
+  llace_codebuf_t buf;
+  llace_codebuf_init(&buf, 4096);
+
+  llace_error_t err = jit_collect(jit, function, unit_of, &units);
+  LLACE_ARRAY_FOREACH(jit_unit_t, unit, units) {
+    if (err == LLACE_ERROR_NONE) err = jit_compile(jit, unit, &buf);
+  }
+
+  // Fill the pages while writable, then make them executable
+  size_t offset = SIZE_MAX, size = JIT_ROUND(jit, buf.size);
+  uint8_t *code = err == LLACE_ERROR_NONE ? jit_pages(jit, size, PROT_READ | PROT_WRITE, &offset) : NULL;
+  if (err == LLACE_ERROR_NONE && code == NULL) err = LLACE_ERROR_NOMEM;
+  LLACE_ARRAY_FOREACH(jit_unit_t, unit, units) {
+    if (err == LLACE_ERROR_NONE) err = jit_link(jit, unit, units.data, unit_of, &buf, code);
+  }
+  if (err == LLACE_ERROR_NONE) {
+    memcpy(code, buf.data, buf.size);
+    if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0) err = LLACE_ERROR_NOMEM;
+  }
+
+  if (err == LLACE_ERROR_NONE) {
+    LLACE_ARRAY_PUSH(jit->regions, ((llace_jit_region_t){ .offset = offset, .size = size, .live = LLACE_ARRAY_COUNT(units) }));
+    LLACE_ARRAY_FOREACH(jit_unit_t, unit, units) {
+      *JIT_FUNC(jit, unit->function) = (llace_jit_func_t){ .entry = code + unit->start, .region = LLACE_ARRAY_COUNT(jit->regions) - 1 };
+      LLACE_ARRAY_FOREACH(llace_amd64_minst_t, minst, unit->code.insts) {
+        jit->stats.vector += minst->inst.mnemonic >= LLACE_AMD64_VMOVUPS && minst->inst.mnemonic != LLACE_AMD64_VZEROUPPER;
+      }
+    }
+    jit->stats.functions += LLACE_ARRAY_COUNT(units);
+    jit->stats.bytes += buf.size;
+    if (entry) *entry = JIT_FUNC(jit, function)->entry;
+  } else if (code) {
+    jit_release(jit, offset, size);
+  }
+
+  LLACE_ARRAY_FOREACH(jit_unit_t, unit, units) {
+    llace_amd64_code_free(&unit->code);
+    LLACE_FREE_ARRAY(unit->fixups);
+    free(unit->offsets);
+  }
+  LLACE_FREE_ARRAY(units);
+  llace_codebuf_free(&buf);
+  free(unit_of);
+  return err;
+}
+
+llace_error_t llace_jit_remove(llace_jit_t *jit, size_t function) {
+  if (!jit || function >= LLACE_ARRAY_COUNT(jit->funcs) || JIT_FUNC(jit, function)->entry == NULL) {
+    return LLACE_ERROR_BADARG;
+  }
+
+  llace_jit_func_t *func = JIT_FUNC(jit, function);
+  llace_jit_region_t *region = JIT_REGION(jit, func->region);
+  *func = (llace_jit_func_t){ .entry = NULL, .region = SIZE_MAX };
+  if (--region->live == 0) {
+    jit_release(jit, region->offset, region->size);
+    region->size = 0;
+  }
+  return LLACE_ERROR_NONE;
+}
@@ -0,0 +1,33 @@
+#include <llace/codegen/amd64/amd64.h>
+
+// ================ Register Set ================ //
+
+#define BIT(reg) (UINT64_C(1) << (reg))
+
+// Caller saved registers last, values living across calls land in callee saved ones first
+static const uint8_t gprs[] = {
+  LLACE_AMD64_RBX, LLACE_AMD64_R12, LLACE_AMD64_R13, LLACE_AMD64_R14, LLACE_AMD64_R15,
+  LLACE_AMD64_RSI, LLACE_AMD64_RDI, LLACE_AMD64_R8, LLACE_AMD64_R9, LLACE_AMD64_R10,
+};
+static const uint8_t gpr_args[] = {
+  LLACE_AMD64_RDI, LLACE_AMD64_RSI, LLACE_AMD64_RDX, LLACE_AMD64_RCX, LLACE_AMD64_R8, LLACE_AMD64_R9,
+};
+static const uint8_t vecs[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13 };
+static const uint8_t vec_args[] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+
+static const llace_regset_t amd64_sysv = {
+  .regs = { gprs, vecs },
+  .count = { sizeof(gprs), sizeof(vecs) },
+  .args = { gpr_args, vec_args },
+  .arg_count = { sizeof(gpr_args), sizeof(vec_args) },
+  .caller_saved = {
+    BIT(LLACE_AMD64_RAX) | BIT(LLACE_AMD64_RCX) | BIT(LLACE_AMD64_RDX) | BIT(LLACE_AMD64_RSI) | BIT(LLACE_AMD64_RDI) |
+    BIT(LLACE_AMD64_R8) | BIT(LLACE_AMD64_R9) | BIT(LLACE_AMD64_R10) | BIT(LLACE_AMD64_R11),
+    0xFFFF, // no callee saved xmm registers in System V
+  },
+  .scratch = { LLACE_AMD64_R11, 15 },
+};
+
+const llace_regset_t *llace_amd64_regset(void) {
+  return &amd64_sysv;
+}
@@ -0,0 +1,1580 @@
+#include <llace/codegen/amd64/amd64.h>
+#include <llace/codegen/isel.h>
+#include <llace/profile.h>
+#include <llace/detail/common.h>
+#include <string.h>
+
+// ================ Nonterminals ================ //
+
+enum {
+  NT_STMT,  // statement, nothing left over
+  NT_REG,   // integer in a general purpose register
+  NT_IMM,   // 32-bit immediate
+  NT_MEM,   // integer in memory
+  NT_RM, NT_RI, NT_RMI,
+  NT_ADDR,  // memory operand without a size, what an addressing mode computes
+  NT_COND,  // flags set, the condition holds
+  NT_XMM,   // float in a vector register
+  NT_XM,    // float in a vector register or memory
+  NT_LABEL, // block
+  NT_ARG,   // call argument or pack lane
+  NT_VX,    // vector in an xmm or ymm register
+  NT_VXM,   // vector in a register or memory
+  NT_COUNT
+};
+
+// Predicates checked on the root of a pattern
+enum {
+  P_NONE,
+  P_VAR_REG, P_VAR_MEM, P_VEC_REG, P_VEC_MEM, // variable location at the statement
+  P_IMM, P_INT_CONST, P_FLOAT_CONST,
+  P_SCALE,     // index with an element size an addressing mode can scale by
+  P_DISP,      // constant index whose byte offset fits the displacement
+  P_ADDR_ADD,  // addition an addressing mode can do
+  P_INT, P_FLOAT, // class of the value, the stored one for stores
+  P_INTO_DST,  // operation can run in the register of the assigned variable
+  P_INTO_LEFT, // ... which already holds the left operand
+  P_RMW,       // store to the address it loaded from
+  P_DST_REG,
+  P_RET_INT, P_RET_FLOAT,
+  P_CALL_INT, P_CALL_FLOAT, P_CALL_VOID,
+  P_VX_REG, P_VX_MEM, // vector variable location at the statement
+  P_VX,      // vector of 16 or 32 bytes, the stored one for stores
+  P_VX_ALU,  // lane-wise operation with a VEX instruction
+  P_VX_INTO, // ... assigned to a variable in a register
+};
+
+// Actions run when a rule is reduced
+enum {
+  A_PASS, A_BASE, A_VAR, A_IMM, A_CONST, A_FCONST, A_GLOBAL, A_LABEL,
+  A_FETCH, A_LEA, A_SETCC, A_TESTREG,
+  A_INDEX, A_INDEX_IMM, A_ADD_IMM, A_ADD_REG, A_LOAD,
+  A_BINOP, A_BINOP_SWAP, A_MULIMM, A_DIV, A_SHIFT,
+  A_CMP, A_CMP_SWAP, A_FCMP, A_TEST,
+  A_ASSIGN, A_ASSIGN_LEA, A_ASSIGN_COND, A_ASSIGN_BINOP, A_STORE, A_RMW,
+  A_JMP, A_BRANCH, A_RET, A_CALL,
+  A_VBINOP, A_SPLAT, A_PACK, A_EXTRACT,
+};
+
+// ================ Rules ================ //
+
+#define NT(n) LLACE_ISEL_NT(NT_##n)
+#define OP(o) LLACE_IR_OP_##o
+#define PATTERN(...) { __VA_ARGS__ }, sizeof((uint8_t[]){ __VA_ARGS__ })
+#define RULE(lhs, cost, pred, action, ...) { NT_##lhs, cost, PATTERN(__VA_ARGS__), 0, pred, action }
+#define RULEV(lhs, cost, pred, action, ...) { NT_##lhs, cost, PATTERN(__VA_ARGS__), LLACE_ISEL_VARIADIC, pred, action }
+
+// Integer operation into a register, into the assigned variable, or read-modify-write on memory
+#define INT_BINOP(o) \
+  RULE(REG, 2, 0, A_BINOP, OP(o), NT(REG), NT(RMI)), \
+  RULE(STMT, 2, P_INTO_DST, A_ASSIGN_BINOP, OP(ASSIGN), OP(o), NT(REG), NT(RMI), LLACE_ISEL_VAR), \
+  RULE(STMT, 1, P_INTO_LEFT, A_ASSIGN_BINOP, OP(ASSIGN), OP(o), NT(REG), NT(RMI), LLACE_ISEL_VAR), \
+  RULE(STMT, 1, P_RMW, A_RMW, OP(STORE), OP(o), OP(LOAD), NT(ADDR), NT(RI), NT(ADDR))
+#define FLOAT_BINOP(o) \
+  RULE(XMM, 2, 0, A_BINOP, OP(o), NT(XMM), NT(XM)), \
+  RULE(STMT, 2, P_INTO_DST, A_ASSIGN_BINOP, OP(ASSIGN), OP(o), NT(XMM), NT(XM), LLACE_ISEL_VAR), \
+  RULE(STMT, 1, P_INTO_LEFT, A_ASSIGN_BINOP, OP(ASSIGN), OP(o), NT(XMM), NT(XM), LLACE_ISEL_VAR)
+// Lane-wise operation, three operand VEX forms write any register
+#define VEC_BINOP(o) \
+  RULE(VX, 1, P_VX_ALU, A_VBINOP, OP(o), NT(VX), NT(VXM)), \
+  RULE(STMT, 1, P_VX_INTO, A_ASSIGN_BINOP, OP(ASSIGN), OP(o), NT(VX), NT(VXM), LLACE_ISEL_VAR)
+#define COMPARE(o) \
+  RULE(COND, 1, 0, A_CMP, OP(o), NT(REG), NT(RMI)), \
+  RULE(COND, 1, 0, A_CMP, OP(o), NT(MEM), NT(RI)), \
+  RULE(COND, 1, 0, A_CMP_SWAP, OP(o), NT(IMM), NT(RM)), \
+  RULE(COND, 1, 0, A_FCMP, OP(o), NT(XMM), NT(XM))
+
+static const llace_isel_rule_t amd64_rules[] = {
+  // Leaves
+  RULE(REG, 0, P_VAR_REG, A_VAR, LLACE_ISEL_VAR),
+  RULE(MEM, 0, P_VAR_MEM, A_VAR, LLACE_ISEL_VAR),
+  RULE(XMM, 0, P_VEC_REG, A_VAR, LLACE_ISEL_VAR),
+  RULE(XM, 0, P_VEC_MEM, A_VAR, LLACE_ISEL_VAR),
+  RULE(IMM, 0, P_IMM, A_IMM, LLACE_ISEL_CONST),
+  RULE(REG, 1, P_INT_CONST, A_CONST, LLACE_ISEL_CONST),
+  RULE(XMM, 2, P_FLOAT_CONST, A_FCONST, LLACE_ISEL_CONST),
+  RULE(ADDR, 0, 0, A_GLOBAL, LLACE_ISEL_GLOBAL),
+  RULE(LABEL, 0, 0, A_LABEL, LLACE_ISEL_BLOCK),
+
+  // Chains
+  RULE(RM, 0, 0, A_PASS, NT(REG)),
+  RULE(RM, 0, 0, A_PASS, NT(MEM)),
+  RULE(RI, 0, 0, A_PASS, NT(REG)),
+  RULE(RI, 0, 0, A_PASS, NT(IMM)),
+  RULE(RMI, 0, 0, A_PASS, NT(RM)),
+  RULE(RMI, 0, 0, A_PASS, NT(IMM)),
+  RULE(XM, 0, 0, A_PASS, NT(XMM)),
+  RULE(REG, 1, 0, A_FETCH, NT(MEM)),
+  RULE(XMM, 1, 0, A_FETCH, NT(XM)),
+  RULE(ADDR, 0, 0, A_BASE, NT(REG)),
+  RULE(REG, 1, P_INT, A_LEA, NT(ADDR)),
+  RULE(REG, 2, 0, A_SETCC, NT(COND)),
+  RULE(COND, 1, 0, A_TESTREG, NT(REG)),
+  RULE(ARG, 0, 0, A_PASS, NT(RMI)),
+  RULE(ARG, 0, 0, A_PASS, NT(XM)),
+
+  // Addressing modes and memory operands
+  RULE(ADDR, 0, P_SCALE, A_INDEX, OP(INDEX), NT(REG), NT(REG)),
+  RULE(ADDR, 0, P_DISP, A_INDEX_IMM, OP(INDEX), NT(REG), NT(IMM)),
+  RULE(ADDR, 0, P_ADDR_ADD, A_ADD_IMM, OP(ADD), NT(REG), NT(IMM)),
+  RULE(ADDR, 0, P_ADDR_ADD, A_ADD_REG, OP(ADD), NT(REG), NT(REG)),
+  RULE(MEM, 0, P_INT, A_LOAD, OP(LOAD), NT(ADDR)),
+  RULE(XM, 0, P_FLOAT, A_LOAD, OP(LOAD), NT(ADDR)),
+
+  // Integer arithmetic
+  INT_BINOP(ADD), INT_BINOP(SUB), INT_BINOP(AND), INT_BINOP(OR), INT_BINOP(XOR),
+  RULE(REG, 2, 0, A_BINOP_SWAP, OP(ADD), NT(RMI), NT(REG)),
+  RULE(REG, 2, 0, A_BINOP_SWAP, OP(AND), NT(RMI), NT(REG)),
+  RULE(REG, 2, 0, A_BINOP_SWAP, OP(OR), NT(RMI), NT(REG)),
+  RULE(REG, 2, 0, A_BINOP_SWAP, OP(XOR), NT(RMI), NT(REG)),
+  RULE(REG, 2, 0, A_BINOP, OP(MUL), NT(REG), NT(RM)),
+  RULE(REG, 2, 0, A_BINOP_SWAP, OP(MUL), NT(RM), NT(REG)),
+  RULE(REG, 1, 0, A_MULIMM, OP(MUL), NT(RM), NT(IMM)),
+  RULE(REG, 1, 0, A_MULIMM, OP(MUL), NT(IMM), NT(RM)),
+  RULE(STMT, 2, P_INTO_DST, A_ASSIGN_BINOP, OP(ASSIGN), OP(MUL), NT(REG), NT(RM), LLACE_ISEL_VAR),
+  RULE(STMT, 1, P_INTO_LEFT, A_ASSIGN_BINOP, OP(ASSIGN), OP(MUL), NT(REG), NT(RM), LLACE_ISEL_VAR),
+  RULE(REG, 4, 0, A_DIV, OP(DIV), NT(REG), NT(RM)),
+  RULE(REG, 4, 0, A_DIV, OP(MOD), NT(REG), NT(RM)),
+  RULE(REG, 2, 0, A_SHIFT, OP(SHL), NT(REG), NT(IMM)),
+  RULE(REG, 2, 0, A_SHIFT, OP(SHR), NT(REG), NT(IMM)),
+  RULE(REG, 3, 0, A_SHIFT, OP(SHL), NT(REG), NT(REG)),
+  RULE(REG, 3, 0, A_SHIFT, OP(SHR), NT(REG), NT(REG)),
+
+  // Float arithmetic
+  FLOAT_BINOP(ADD), FLOAT_BINOP(SUB), FLOAT_BINOP(MUL), FLOAT_BINOP(DIV),
+  RULE(XMM, 2, 0, A_BINOP_SWAP, OP(ADD), NT(XM), NT(XMM)),
+  RULE(XMM, 2, 0, A_BINOP_SWAP, OP(MUL), NT(XM), NT(XMM)),
+
+  // Conditions
+  COMPARE(EQ), COMPARE(NE), COMPARE(LT), COMPARE(LE), COMPARE(GT), COMPARE(GE),
+  RULE(COND, 1, 0, A_TEST, OP(NZ), NT(RM)),
+  RULE(COND, 1, 0, A_TEST, OP(Z), NT(RM)),
+
+  // Statements
+  RULE(STMT, 1, 0, A_ASSIGN, OP(ASSIGN), NT(RMI), LLACE_ISEL_VAR),
+  RULE(STMT, 1, 0, A_ASSIGN, OP(ASSIGN), NT(XM), LLACE_ISEL_VAR),
+  RULE(STMT, 1, P_DST_REG, A_ASSIGN_LEA, OP(ASSIGN), NT(ADDR), LLACE_ISEL_VAR),
+  RULE(STMT, 2, 0, A_ASSIGN_COND, OP(ASSIGN), NT(COND), LLACE_ISEL_VAR),
+  RULE(STMT, 1, P_INT, A_STORE, OP(STORE), NT(RI), NT(ADDR)),
+  RULE(STMT, 1, P_FLOAT, A_STORE, OP(STORE), NT(XMM), NT(ADDR)),
+  RULE(STMT, 1, 0, A_JMP, OP(JMP), NT(LABEL)),
+  RULE(STMT, 1, 0, A_BRANCH, OP(BRANCH), NT(COND), NT(LABEL), NT(LABEL)),
+  RULE(STMT, 1, 0, A_RET, OP(RET)),
+  RULE(STMT, 2, P_RET_INT, A_RET, OP(RET), NT(RMI)),
+  RULE(STMT, 2, P_RET_FLOAT, A_RET, OP(RET), NT(XM)),
+  RULEV(REG, 3, P_CALL_INT, A_CALL, OP(CALL), NT(ARG)),
+  RULEV(XMM, 3, P_CALL_FLOAT, A_CALL, OP(CALL), NT(ARG)),
+  RULEV(STMT, 3, P_CALL_VOID, A_CALL, OP(CALL), NT(ARG)),
+
+  // Vectors of 16 and 32 bytes
+  RULE(VX, 0, P_VX_REG, A_VAR, LLACE_ISEL_VAR),
+  RULE(VXM, 0, P_VX_MEM, A_VAR, LLACE_ISEL_VAR),
+  RULE(VXM, 0, 0, A_PASS, NT(VX)),
+  RULE(VX, 1, 0, A_FETCH, NT(VXM)),
+  RULE(VXM, 0, P_VX, A_LOAD, OP(LOAD), NT(ADDR)),
+  RULE(STMT, 1, P_VX, A_STORE, OP(STORE), NT(VX), NT(ADDR)),
+  RULE(STMT, 1, 0, A_ASSIGN, OP(ASSIGN), NT(VXM), LLACE_ISEL_VAR),
+  VEC_BINOP(ADD), VEC_BINOP(SUB), VEC_BINOP(MUL), VEC_BINOP(DIV), VEC_BINOP(AND), VEC_BINOP(OR), VEC_BINOP(XOR),
+  RULE(VX, 1, P_VX_ALU, A_VBINOP, OP(ADD), NT(VXM), NT(VX)),
+  RULE(VX, 1, P_VX_ALU, A_VBINOP, OP(MUL), NT(VXM), NT(VX)),
+  RULE(VX, 1, P_VX_ALU, A_VBINOP, OP(AND), NT(VXM), NT(VX)),
+  RULE(VX, 1, P_VX_ALU, A_VBINOP, OP(OR), NT(VXM), NT(VX)),
+  RULE(VX, 1, P_VX_ALU, A_VBINOP, OP(XOR), NT(VXM), NT(VX)),
+  RULE(VX, 2, P_VX, A_SPLAT, OP(SPLAT), NT(REG)),
+  RULE(VX, 1, P_VX, A_SPLAT, OP(SPLAT), NT(MEM)),
+  RULE(VX, 1, P_VX, A_SPLAT, OP(SPLAT), NT(XM)),
+  RULEV(VX, 4, P_VX, A_PACK, OP(PACK), NT(ARG)),
+  RULE(REG, 2, P_INT, A_EXTRACT, OP(EXTRACT), NT(VXM), NT(IMM)),
+  RULE(XMM, 2, P_FLOAT, A_EXTRACT, OP(EXTRACT), NT(VXM), NT(IMM)),
+};
+
+// ================ State ================ //
+
+typedef struct {
+  llace_amd64_operand_t op;
+  llace_amd64_cond_t cond;   // NT_COND
+  llace_amd64_symkind_t sym; // what a rip operand or label refers to
+  size_t target;
+} amd64_value_t;
+
+typedef struct {
+  const llace_ir_context_t *ctx;
+  const llace_ir_function_t *fn;
+  const llace_regalloc_t *ra;
+  llace_amd64_code_t *code;
+  const llace_isel_tree_t *tree;
+  amd64_value_t *values; // per tree node
+  size_t value_capacity;
+  int holder[LLACE_REGCLASS_COUNT][16]; // tree node holding a temporary register, -1 if free
+  size_t node;                          // node being reduced
+  size_t position, block, next;         // statement position, its block, the block laid out after it
+  uint8_t saved[8];                     // callee saved registers pushed by the prologue
+  size_t saved_count;
+  size_t *group_at;   // moves group before each position, SIZE_MAX if none
+  llace_array_t stubs; // size_t, edge move groups placed after the function
+  bool vectors;        // vector spill slots are 32 bytes, packs and extracts go through scratch
+  int32_t scratch;     // frame offset of the 32 bytes of scratch
+} amd64_sel_t;
+
+static const uint8_t amd64_temps[LLACE_REGCLASS_COUNT][4] = {
+  { LLACE_AMD64_RAX, LLACE_AMD64_RCX, LLACE_AMD64_RDX, LLACE_AMD64_R11 },
+  { 14, 15 },
+};
+static const size_t amd64_temp_count[LLACE_REGCLASS_COUNT] = { 4, 2 };
+
+static const uint8_t amd64_callee_saved[] = { LLACE_AMD64_RBX, LLACE_AMD64_R12, LLACE_AMD64_R13, LLACE_AMD64_R14, LLACE_AMD64_R15 };
+
+#define VALUE(sel, index) (&(sel)->values[(index)])
+#define NODE(tree, index) LLACE_ISEL_NODE(tree, index)
+#define KID(tree, node, k) LLACE_ISEL_NODE(tree, LLACE_ISEL_KID(tree, node, k))
+#define NONE_OP ((llace_amd64_operand_t){ .kind = LLACE_AMD64_OPND_NONE })
+
+// ================ Types ================ //
+
+// Register class of a node, -1 for vectors and void
+static int amd64_class(const llace_isel_node_t *node) {
+  if (node->depth > 0) return LLACE_REGCLASS_GPR;
+  if (LLACE_IR_IS_VEC(node->type) || node->type.kind == LLACE_IR_TYPE_VOID) return -1;
+  return node->type.kind == LLACE_IR_TYPE_FLOAT ? LLACE_REGCLASS_VEC : LLACE_REGCLASS_GPR;
+}
+
+static uint8_t amd64_bytes(llace_ir_type_t type, size_t depth) {
+  if (depth > 0) return 8;
+  size_t bits = llace_ir_type_bits(type);
+  return bits <= 8 ? 1 : bits <= 16 ? 2 : bits <= 32 ? 4 : 8;
+}
+
+static uint8_t amd64_size(const llace_isel_node_t *node) {
+  return amd64_bytes(node->type, node->depth);
+}
+
+static bool amd64_signed(const llace_isel_node_t *node) {
+  return node->depth == 0 && node->type.kind == LLACE_IR_TYPE_INT;
+}
+
+static bool amd64_single(const llace_isel_node_t *node) {
+  return llace_ir_type_bits(node->type) <= 32;
+}
+
+// Bytes of a vector node, 0 for scalars
+static size_t amd64_vbytes(const llace_isel_node_t *node) {
+  if (node->depth > 0 || !LLACE_IR_IS_VEC(node->type)) return 0;
+  return llace_ir_type_bits(node->type) / 8;
+}
+
+// Vectors with VEX encodings, an xmm or ymm register
+static bool amd64_vex(const llace_isel_node_t *node) {
+  size_t bytes = amd64_vbytes(node);
+  return bytes == 16 || bytes == 32;
+}
+
+// Bytes between the elements an index steps over
+static size_t amd64_elem(const llace_isel_tree_t *tree, const llace_isel_node_t *node) {
+  const llace_isel_node_t *ptr = KID(tree, node, 0);
+  if (ptr->depth > 1) return 8;
+  return LLACE_MAX(llace_ir_type_bits(ptr->type) / 8, (size_t)1);
+}
+
+// Immediate as the instruction of that operand size reads it
+static int64_t amd64_imm(int64_t value, uint8_t size) {
+  switch (size) {
+  case 1: return (int8_t)value;
+  case 2: return (int16_t)value;
+  case 4: return (int32_t)value;
+  default: return value;
+  }
+}
+
+static bool amd64_fits32(int64_t value) {
+  return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+// Swapped operands (a < b is b > a) and negation by the low bit of the encoding
+static llace_amd64_cond_t amd64_swap(llace_amd64_cond_t cc) {
+  switch (cc) {
+  case LLACE_AMD64_CC_L:  return LLACE_AMD64_CC_G;
+  case LLACE_AMD64_CC_G:  return LLACE_AMD64_CC_L;
+  case LLACE_AMD64_CC_LE: return LLACE_AMD64_CC_GE;
+  case LLACE_AMD64_CC_GE: return LLACE_AMD64_CC_LE;
+  case LLACE_AMD64_CC_B:  return LLACE_AMD64_CC_A;
+  case LLACE_AMD64_CC_A:  return LLACE_AMD64_CC_B;
+  case LLACE_AMD64_CC_BE: return LLACE_AMD64_CC_AE;
+  case LLACE_AMD64_CC_AE: return LLACE_AMD64_CC_BE;
+  default: return cc;
+  }
+}
+
+#define amd64_negate(cc) ((llace_amd64_cond_t)((cc) ^ 1))
+
+static llace_amd64_cond_t amd64_cond(llace_ir_opcode_t op, bool sign) {
+  switch (op) {
+  case LLACE_IR_OP_EQ: return LLACE_AMD64_CC_E;
+  case LLACE_IR_OP_NE: return LLACE_AMD64_CC_NE;
+  case LLACE_IR_OP_LT: return sign ? LLACE_AMD64_CC_L : LLACE_AMD64_CC_B;
+  case LLACE_IR_OP_LE: return sign ? LLACE_AMD64_CC_LE : LLACE_AMD64_CC_BE;
+  case LLACE_IR_OP_GT: return sign ? LLACE_AMD64_CC_G : LLACE_AMD64_CC_A;
+  default:             return sign ? LLACE_AMD64_CC_GE : LLACE_AMD64_CC_AE;
+  }
+}
+
+static llace_amd64_mnemonic_t amd64_alu(llace_ir_opcode_t op, bool vec, bool single) {
+  switch (op) {
+  case LLACE_IR_OP_ADD: return vec ? (single ? LLACE_AMD64_ADDSS : LLACE_AMD64_ADDSD) : LLACE_AMD64_ADD;
+  case LLACE_IR_OP_SUB: return vec ? (single ? LLACE_AMD64_SUBSS : LLACE_AMD64_SUBSD) : LLACE_AMD64_SUB;
+  case LLACE_IR_OP_MUL: return vec ? (single ? LLACE_AMD64_MULSS : LLACE_AMD64_MULSD) : LLACE_AMD64_IMUL;
+  case LLACE_IR_OP_DIV: return single ? LLACE_AMD64_DIVSS : LLACE_AMD64_DIVSD;
+  case LLACE_IR_OP_AND: return LLACE_AMD64_AND;
+  case LLACE_IR_OP_OR:  return LLACE_AMD64_OR;
+  default:              return LLACE_AMD64_XOR;
+  }
+}
+
+// VEX instruction of a lane-wise operation, LLACE_AMD64_MNEMONIC_COUNT if there is none
+static llace_amd64_mnemonic_t amd64_valu(const llace_isel_node_t *node) {
+  size_t bits = llace_ir_type_bits(llace_ir_type_vec(node->type, 0));
+  if (node->type.kind == LLACE_IR_TYPE_FLOAT) {
+    bool single = bits == 32;
+    switch (node->value->instr.op) {
+    case LLACE_IR_OP_ADD: return single ? LLACE_AMD64_VADDPS : LLACE_AMD64_VADDPD;
+    case LLACE_IR_OP_SUB: return single ? LLACE_AMD64_VSUBPS : LLACE_AMD64_VSUBPD;
+    case LLACE_IR_OP_MUL: return single ? LLACE_AMD64_VMULPS : LLACE_AMD64_VMULPD;
+    case LLACE_IR_OP_DIV: return single ? LLACE_AMD64_VDIVPS : LLACE_AMD64_VDIVPD;
+    default:              return LLACE_AMD64_MNEMONIC_COUNT;
+    }
+  }
+
+  if (bits != 8 && bits != 16 && bits != 32 && bits != 64) return LLACE_AMD64_MNEMONIC_COUNT;
+  int lane = bits == 8 ? 0 : bits == 16 ? 1 : bits == 32 ? 2 : 3; // b, w, d, q
+  switch (node->value->instr.op) {
+  case LLACE_IR_OP_ADD: return (llace_amd64_mnemonic_t)(LLACE_AMD64_VPADDB + lane);
+  case LLACE_IR_OP_SUB: return (llace_amd64_mnemonic_t)(LLACE_AMD64_VPSUBB + lane);
+  case LLACE_IR_OP_MUL: return bits == 16 ? LLACE_AMD64_VPMULLW : bits == 32 ? LLACE_AMD64_VPMULLD : LLACE_AMD64_MNEMONIC_COUNT;
+  case LLACE_IR_OP_AND: return LLACE_AMD64_VPAND;
+  case LLACE_IR_OP_OR:  return LLACE_AMD64_VPOR;
+  case LLACE_IR_OP_XOR: return LLACE_AMD64_VPXOR;
+  default:              return LLACE_AMD64_MNEMONIC_COUNT;
+  }
+}
+
+static llace_amd64_mnemonic_t amd64_vmov(const llace_isel_node_t *node) {
+  return node->type.kind == LLACE_IR_TYPE_FLOAT ? LLACE_AMD64_VMOVUPS : LLACE_AMD64_VMOVDQU;
+}
+
+// ================ Emission ================ //
+
+static llace_amd64_minst_t *amd64_push(amd64_sel_t *sel, llace_amd64_mnemonic_t mn, llace_amd64_cond_t cc, const llace_amd64_operand_t *ops, size_t count) {
+  llace_amd64_minst_t m = { .inst = { .mnemonic = mn, .cond = cc, .count = (uint8_t)count } };
+  if (count != 0) memcpy(m.inst.ops, ops, count * sizeof(*ops));
+  LLACE_ARRAY_PUSHP(sel->code->insts, &m);
+  return LLACE_ARRAY_BACK(llace_amd64_minst_t, sel->code->insts);
+}
+
+#define OPS(...) (llace_amd64_operand_t[]){ __VA_ARGS__ }, sizeof((llace_amd64_operand_t[]){ __VA_ARGS__ }) / sizeof(llace_amd64_operand_t)
+#define EMIT(sel, mn, ...) amd64_push(sel, LLACE_AMD64_##mn, 0, OPS(__VA_ARGS__))
+#define EMIT0(sel, mn) amd64_push(sel, LLACE_AMD64_##mn, 0, NULL, 0)
+#define EMITM(sel, mn, ...) amd64_push(sel, mn, 0, OPS(__VA_ARGS__))
+#define GPR(r, bytes) LLACE_AMD64_GPR(r, bytes)
+#define VEC(r) LLACE_AMD64_VEC(r, 16)
+#define RSP LLACE_AMD64_GPR(LLACE_AMD64_RSP, 8)
+#define STACK(bytes) LLACE_AMD64_BASE(bytes, LLACE_AMD64_RSP, 0)
+
+// The rip operand or label a value brings along
+static void amd64_link(llace_amd64_minst_t *m, const amd64_value_t *value) {
+  if (value->sym == LLACE_AMD64_SYM_NONE) return;
+  m->sym = value->sym;
+  m->target = value->target;
+}
+
+static void amd64_jump(amd64_sel_t *sel, llace_amd64_mnemonic_t mn, llace_amd64_cond_t cc, llace_amd64_symkind_t sym, size_t target) {
+  llace_amd64_minst_t *m = amd64_push(sel, mn, cc, OPS(LLACE_AMD64_REL(0)));
+  m->sym = sym;
+  m->target = target;
+}
+
+static bool amd64_same_op(llace_amd64_operand_t a, llace_amd64_operand_t b) {
+  if (a.kind != b.kind) return false;
+  if (a.kind == LLACE_AMD64_OPND_MEM) return a.base == b.base && a.index == b.index && a.scale == b.scale && a.disp == b.disp;
+  return a.reg == b.reg;
+}
+
+// Register mask of an operand: general purpose registers in the low bits, vector ones above
+static uint32_t amd64_mask(llace_amd64_operand_t op) {
+  switch (op.kind) {
+  case LLACE_AMD64_OPND_GPR: return UINT32_C(1) << op.reg;
+  case LLACE_AMD64_OPND_VEC: return op.reg < 16 ? UINT32_C(1) << (16 + op.reg) : 0;
+  case LLACE_AMD64_OPND_MEM:
+    return (op.base >= 0 && op.base < 16 ? UINT32_C(1) << op.base : 0) | (op.index >= 0 ? UINT32_C(1) << op.index : 0);
+  default: return 0;
+  }
+}
+
+#define BIT(cls, reg) (UINT32_C(1) << ((cls) == LLACE_REGCLASS_GPR ? (reg) : 16 + (reg)))
+
+static bool amd64_is_temp(int cls, int reg) {
+  for (size_t i = 0; i < amd64_temp_count[cls]; ++i) {
+    if (amd64_temps[cls][i] == reg) return true;
+  }
+  return false;
+}
+
+// A free temporary outside avoid, held by the node being reduced
+static llace_error_t amd64_temp(amd64_sel_t *sel, int cls, uint32_t avoid, uint8_t *reg) {
+  for (size_t i = 0; i < amd64_temp_count[cls]; ++i) {
+    uint8_t r = amd64_temps[cls][i];
+    if (sel->holder[cls][r] < 0 && !(avoid & BIT(cls, r))) {
+      sel->holder[cls][r] = (int)sel->node;
+      *reg = r;
+      return LLACE_ERROR_NONE;
+    }
+  }
+  LLACE_LOG_ERROR("Instruction selection ran out of temporary registers in '%s'", sel->fn->name);
+  return LLACE_ERROR_OVERFLOW;
+}
+
+static void amd64_rename(llace_amd64_operand_t *op, int cls, uint8_t from, uint8_t to) {
+  if (cls == LLACE_REGCLASS_VEC) {
+    if (op->kind == LLACE_AMD64_OPND_VEC && op->reg == from) op->reg = to;
+    return;
+  }
+  if (op->kind == LLACE_AMD64_OPND_GPR && op->reg == from) op->reg = to;
+  if (op->kind == LLACE_AMD64_OPND_MEM) {
+    if (op->base == from) op->base = (int8_t)to;
+    if (op->index == from) op->index = (int8_t)to;
+  }
+}
+
+// A fixed temporary for the node being reduced (division, shift counts), its holder moves elsewhere
+static llace_error_t amd64_claim(amd64_sel_t *sel, int cls, uint8_t reg, uint32_t avoid) {
+  int holder = sel->holder[cls][reg];
+  if (holder >= 0 && (size_t)holder != sel->node) {
+    uint8_t to;
+    LLACE_RUNCHECK(amd64_temp(sel, cls, avoid | BIT(cls, reg), &to));
+    sel->holder[cls][to] = holder;
+    if (cls == LLACE_REGCLASS_GPR) EMIT(sel, MOV, GPR(to, 8), GPR(reg, 8));
+    else EMIT(sel, MOVAPS, VEC(to), VEC(reg));
+    amd64_rename(&VALUE(sel, holder)->op, cls, reg, to);
+  }
+  sel->holder[cls][reg] = (int)sel->node;
+  return LLACE_ERROR_NONE;
+}
+
+// Sign or zero extension into a register of 4 or 8 bytes
+static void amd64_extend(amd64_sel_t *sel, uint8_t reg, uint8_t size, llace_amd64_operand_t src, bool sign) {
+  if (src.size >= 4) {
+    if (sign && size == 8 && src.size == 4) EMIT(sel, MOVSXD, GPR(reg, 8), src);
+    else EMIT(sel, MOV, GPR(reg, src.size), src);
+    return;
+  }
+  if (sign) EMIT(sel, MOVSX, GPR(reg, size), src);
+  else EMIT(sel, MOVZX, GPR(reg, 4), src);
+}
+
+// Integer operand of at least size bytes, narrower ones are extended into a temporary
+static llace_error_t amd64_fit(amd64_sel_t *sel, amd64_value_t *value, uint8_t size, bool sign, uint32_t avoid) {
+  llace_amd64_operand_t op = value->op;
+  if (op.kind == LLACE_AMD64_OPND_IMM || op.size == size) return LLACE_ERROR_NONE;
+  if (op.size > size) {
+    value->op.size = size; // the low part
+    return LLACE_ERROR_NONE;
+  }
+
+  uint8_t reg;
+  if (op.kind == LLACE_AMD64_OPND_GPR && amd64_is_temp(LLACE_REGCLASS_GPR, op.reg)) reg = op.reg;
+  else LLACE_RUNCHECK(amd64_temp(sel, LLACE_REGCLASS_GPR, avoid | amd64_mask(op), &reg));
+  amd64_extend(sel, reg, size == 8 ? 8 : 4, op, sign);
+  value->op = GPR(reg, size);
+  value->sym = LLACE_AMD64_SYM_NONE;
+  return LLACE_ERROR_NONE;
+}
+
+// Copy between a register or memory and a register or memory of one class
+static void amd64_copy(amd64_sel_t *sel, int cls, llace_amd64_operand_t dst, llace_amd64_operand_t src, bool single) {
+  if (amd64_same_op(dst, src)) return;
+  if (cls == LLACE_REGCLASS_GPR) {
+    EMIT(sel, MOV, dst, src);
+  } else if (dst.kind == LLACE_AMD64_OPND_VEC && src.kind == LLACE_AMD64_OPND_VEC) {
+    EMIT(sel, MOVAPS, dst, src);
+  } else {
+    EMITM(sel, single ? LLACE_AMD64_MOVSS : LLACE_AMD64_MOVSD, dst, src);
+  }
+}
+
+// ================ Frame ================ //
+
+// Vector slots follow the general purpose ones, 32 bytes each in functions with vectors
+static size_t amd64_vec_slot(const amd64_sel_t *sel) {
+  return sel->vectors ? 32 : 8;
+}
+
+static int32_t amd64_slot(const amd64_sel_t *sel, llace_loc_t loc) {
+  if (loc.cls == LLACE_REGCLASS_GPR) return -(int32_t)(8 * (sel->saved_count + loc.index + 1));
+  return -(int32_t)(8 * (sel->saved_count + sel->ra->slots[LLACE_REGCLASS_GPR]) + amd64_vec_slot(sel) * (loc.index + 1));
+}
+
+static llace_amd64_operand_t amd64_loc(const amd64_sel_t *sel, llace_loc_t loc, uint8_t size) {
+  if (loc.kind == LLACE_LOC_REG) return loc.cls == LLACE_REGCLASS_GPR ? GPR(loc.index, size) : LLACE_AMD64_VEC(loc.index, size > 16 ? size : 16);
+  return LLACE_AMD64_BASE(size, LLACE_AMD64_RBP, amd64_slot(sel, loc));
+}
+
+static void amd64_epilogue(amd64_sel_t *sel) {
+  if (sel->saved_count > 0 || sel->code->frame > 0) {
+    EMIT(sel, LEA, RSP, LLACE_AMD64_BASE(8, LLACE_AMD64_RBP, -(int32_t)(8 * sel->saved_count)));
+  }
+  for (size_t i = sel->saved_count; i > 0; --i) EMIT(sel, POP, GPR(sel->saved[i - 1], 8));
+  EMIT(sel, POP, GPR(LLACE_AMD64_RBP, 8));
+  if (sel->vectors) EMIT0(sel, VZEROUPPER); // no dirty upper halves for the caller's SSE code
+  EMIT0(sel, RET);
+}
+
+// One move of register allocation, rax is free between statements
+static void amd64_move(amd64_sel_t *sel, const llace_ra_move_t *move) {
+  int cls = move->to.cls;
+  llace_amd64_operand_t dst = amd64_loc(sel, move->to, 8);
+  llace_amd64_operand_t rax = GPR(LLACE_AMD64_RAX, 8);
+
+  // Vectors move whole, memory to memory through xmm14 (xmm15 may hold a parked value)
+  const llace_ir_variable_t *var = LLACE_IR_VAR_AT(sel->fn, move->var);
+  if (LLACE_IR_IS_VEC(var->type) && var->attr.depth == 0) {
+    uint8_t size = (uint8_t)(llace_ir_type_bits(var->type) / 8);
+    llace_amd64_operand_t src = amd64_loc(sel, move->from, size), tmp = LLACE_AMD64_VEC(14, size);
+    dst = amd64_loc(sel, move->to, size);
+    if (src.kind == LLACE_AMD64_OPND_MEM && dst.kind == LLACE_AMD64_OPND_MEM) {
+      EMIT(sel, VMOVUPS, tmp, src);
+      src = tmp;
+    }
+    if (!amd64_same_op(dst, src)) EMIT(sel, VMOVUPS, dst, src);
+    return;
+  }
+
+  if (move->from.kind == LLACE_LOC_CONST) {
+    int64_t bits = move->constant._int;
+    if (cls == LLACE_REGCLASS_VEC) {
+      if (llace_ir_type_bits(move->constant.type) <= 32) {
+        float f = (float)move->constant._float;
+        uint32_t raw;
+        memcpy(&raw, &f, sizeof(raw));
+        bits = raw;
+      } else {
+        memcpy(&bits, &move->constant._float, sizeof(bits));
+      }
+    }
+    if (cls == LLACE_REGCLASS_GPR && (dst.kind == LLACE_AMD64_OPND_GPR || amd64_fits32(bits))) {
+      EMIT(sel, MOV, dst, LLACE_AMD64_IMM(bits));
+      return;
+    }
+    EMIT(sel, MOV, rax, LLACE_AMD64_IMM(bits));
+    if (dst.kind == LLACE_AMD64_OPND_VEC) EMIT(sel, MOVQ, dst, rax);
+    else EMIT(sel, MOV, dst, rax);
+    return;
+  }
+
+  llace_amd64_operand_t src = amd64_loc(sel, move->from, 8);
+  if (src.kind == LLACE_AMD64_OPND_MEM && dst.kind == LLACE_AMD64_OPND_MEM) {
+    EMIT(sel, MOV, rax, src);
+    EMIT(sel, MOV, dst, rax);
+    return;
+  }
+  amd64_copy(sel, cls, dst, src, false);
+}
+
+static void amd64_group(amd64_sel_t *sel, size_t group) {
+  const llace_ra_moves_t *moves = LLACE_ARRAY_GET(llace_ra_moves_t, sel->ra->groups, group);
+  for (size_t i = 0; i < moves->count; ++i) amd64_move(sel, LLACE_ARRAY_GET(llace_ra_move_t, sel->ra->moves, moves->first + i));
+}
+
+// Moves of an edge, SIZE_MAX if it needs none
+static size_t amd64_edge(const amd64_sel_t *sel, size_t pred, size_t succ) {
+  for (size_t g = 0; g < LLACE_ARRAY_COUNT(sel->ra->groups); ++g) {
+    const llace_ra_moves_t *moves = LLACE_ARRAY_GET(llace_ra_moves_t, sel->ra->groups, g);
+    if (moves->position == SIZE_MAX && moves->pred == pred && moves->succ == succ && moves->count > 0) return g;
+  }
+  return SIZE_MAX;
+}
+
+// Label a conditional branch takes to succ: the block itself, or a stub doing the edge moves first
+static size_t amd64_edge_label(amd64_sel_t *sel, size_t succ) {
+  size_t group = amd64_edge(sel, sel->block, succ);
+  if (group == SIZE_MAX) return succ;
+  LLACE_ARRAY_PUSH(sel->stubs, group);
+  return LLACE_ARRAY_COUNT(sel->fn->blocks) + LLACE_ARRAY_COUNT(sel->stubs) - 1;
+}
+
+// ================ Predicates ================ //
+
+static bool amd64_same_tree(const llace_isel_tree_t *tree, size_t a, size_t b) {
+  const llace_isel_node_t *x = NODE(tree, a), *y = NODE(tree, b);
+  if (x->op != y->op || x->count != y->count) return false;
+  if (x->op >= LLACE_ISEL_CONST) return x->op != LLACE_ISEL_BLOCK && llace_ir_value_same(x->value, y->value);
+  if (x->value->instr.lanes != y->value->instr.lanes) return false;
+  for (size_t k = 0; k < x->count; ++k) {
+    if (!amd64_same_tree(tree, LLACE_ISEL_KID(tree, x, k), LLACE_ISEL_KID(tree, y, k))) return false;
+  }
+  return true;
+}
+
+// Some variable of the subtree sits in the location at the statement
+static bool amd64_reads_loc(const amd64_sel_t *sel, const llace_isel_tree_t *tree, size_t index, llace_loc_t loc) {
+  const llace_isel_node_t *node = NODE(tree, index);
+  if (node->op == LLACE_ISEL_VAR) return llace_loc_eq(llace_regalloc_loc(sel->ra, node->value->var, sel->position), loc);
+  for (size_t k = 0; k < node->count; ++k) {
+    if (amd64_reads_loc(sel, tree, LLACE_ISEL_KID(tree, node, k), loc)) return true;
+  }
+  return false;
+}
+
+static llace_loc_t amd64_dst(const amd64_sel_t *sel, const llace_isel_tree_t *tree, const llace_isel_node_t *assign) {
+  return llace_regalloc_loc(sel->ra, KID(tree, assign, 1)->value->var, sel->position + 1);
+}
+
+static bool amd64_accept(void *user, const llace_isel_tree_t *tree, size_t index, unsigned pred) {
+  const amd64_sel_t *sel = user;
+  const llace_isel_node_t *node = NODE(tree, index);
+  int cls = amd64_class(node);
+
+  switch (pred) {
+  case P_VAR_REG: case P_VAR_MEM: case P_VEC_REG: case P_VEC_MEM: case P_VX_REG: case P_VX_MEM: {
+    llace_loc_t loc = llace_regalloc_loc(sel->ra, node->value->var, sel->position);
+    bool vec = pred == P_VEC_REG || pred == P_VEC_MEM, reg = pred == P_VAR_REG || pred == P_VEC_REG || pred == P_VX_REG;
+    if (loc.kind != LLACE_LOC_REG && loc.kind != LLACE_LOC_SLOT) return false;
+    if (pred == P_VX_REG || pred == P_VX_MEM) return amd64_vex(node) && (loc.kind == LLACE_LOC_REG) == reg;
+    return cls == (vec ? LLACE_REGCLASS_VEC : LLACE_REGCLASS_GPR) && (loc.kind == LLACE_LOC_REG) == reg;
+  }
+  case P_IMM:
+    return cls == LLACE_REGCLASS_GPR && (amd64_size(node) < 8 || amd64_fits32(node->value->_int));
+  case P_INT_CONST: return cls == LLACE_REGCLASS_GPR;
+  case P_FLOAT_CONST: return cls == LLACE_REGCLASS_VEC;
+  case P_SCALE: {
+    size_t elem = amd64_elem(tree, node);
+    return elem == 1 || elem == 2 || elem == 4 || elem == 8;
+  }
+  case P_DISP: {
+    int64_t offset = KID(tree, node, 1)->value->_int * (int64_t)amd64_elem(tree, node);
+    return amd64_fits32(offset);
+  }
+  case P_ADDR_ADD: {
+    // Full width additions only, the registers of an address are read whole
+    const llace_isel_node_t *rhs = KID(tree, node, 1);
+    if (cls != LLACE_REGCLASS_GPR) return false;
+    return amd64_size(node) < 8 || (amd64_size(KID(tree, node, 0)) == 8 && (rhs->op == LLACE_ISEL_CONST || amd64_size(rhs) == 8));
+  }
+  case P_INT: case P_FLOAT: {
+    int of = node->op == LLACE_IR_OP_STORE ? amd64_class(KID(tree, node, 0)) : cls;
+    return of == (pred == P_INT ? LLACE_REGCLASS_GPR : LLACE_REGCLASS_VEC);
+  }
+  case P_INTO_DST: case P_INTO_LEFT: {
+    llace_loc_t dst = amd64_dst(sel, tree, node);
+    const llace_isel_node_t *op = KID(tree, node, 0);
+    if (dst.kind != LLACE_LOC_REG || (int)dst.cls != amd64_class(op)) return false;
+    if (pred == P_INTO_DST) return !amd64_reads_loc(sel, tree, LLACE_ISEL_KID(tree, op, 1), dst);
+    const llace_isel_node_t *left = KID(tree, op, 0);
+    return left->op == LLACE_ISEL_VAR && llace_loc_eq(llace_regalloc_loc(sel->ra, left->value->var, sel->position), dst);
+  }
+  case P_RMW: {
+    const llace_isel_node_t *load = KID(tree, KID(tree, node, 0), 0);
+    return amd64_class(load) == LLACE_REGCLASS_GPR && amd64_same_tree(tree, LLACE_ISEL_KID(tree, load, 0), LLACE_ISEL_KID(tree, node, 1));
+  }
+  case P_DST_REG: return amd64_dst(sel, tree, node).kind == LLACE_LOC_REG;
+  case P_RET_INT: return amd64_class(KID(tree, node, 0)) == LLACE_REGCLASS_GPR;
+  case P_RET_FLOAT: return amd64_class(KID(tree, node, 0)) == LLACE_REGCLASS_VEC;
+  case P_CALL_VOID: return node->value->instr.out == 0;
+  case P_CALL_INT: return node->value->instr.out == 1 && cls == LLACE_REGCLASS_GPR;
+  case P_CALL_FLOAT: return node->value->instr.out == 1 && cls == LLACE_REGCLASS_VEC;
+  case P_VX: return amd64_vex(node->op == LLACE_IR_OP_STORE ? KID(tree, node, 0) : node);
+  case P_VX_ALU: return amd64_vex(node) && amd64_valu(node) != LLACE_AMD64_MNEMONIC_COUNT;
+  case P_VX_INTO: {
+    const llace_isel_node_t *op = KID(tree, node, 0);
+    return amd64_vex(op) && amd64_valu(op) != LLACE_AMD64_MNEMONIC_COUNT && amd64_dst(sel, tree, node).kind == LLACE_LOC_REG;
+  }
+  default: return false;
+  }
+}
+
+// ================ Actions ================ //
+
+static llace_error_t amd64_binop(amd64_sel_t *sel, const llace_isel_node_t *node, llace_amd64_operand_t dst, amd64_value_t *lhs, amd64_value_t *rhs) {
+  llace_ir_opcode_t op = node->value->instr.op;
+  if (dst.kind == LLACE_AMD64_OPND_VEC) {
+    bool single = amd64_single(node);
+    amd64_copy(sel, LLACE_REGCLASS_VEC, dst, lhs->op, single);
+    amd64_link(EMITM(sel, amd64_alu(op, true, single), dst, rhs->op), rhs);
+    return LLACE_ERROR_NONE;
+  }
+
+  uint8_t size = dst.size;
+  bool sign = amd64_signed(node);
+  LLACE_RUNCHECK(amd64_fit(sel, lhs, size, sign, amd64_mask(dst) | amd64_mask(rhs->op)));
+  LLACE_RUNCHECK(amd64_fit(sel, rhs, size, sign, amd64_mask(dst) | amd64_mask(lhs->op)));
+  amd64_copy(sel, LLACE_REGCLASS_GPR, dst, lhs->op, false);
+  if (rhs->op.kind == LLACE_AMD64_OPND_IMM) rhs->op.imm = amd64_imm(rhs->op.imm, size);
+  amd64_link(EMITM(sel, amd64_alu(op, false, false), dst, rhs->op), rhs);
+  return LLACE_ERROR_NONE;
+}
+
+// Register for the result of the node, reusing a temporary of the operand
+static llace_error_t amd64_result(amd64_sel_t *sel, int cls, llace_amd64_operand_t reuse, uint32_t avoid, uint8_t *reg) {
+  uint8_t kind = cls == LLACE_REGCLASS_GPR ? LLACE_AMD64_OPND_GPR : LLACE_AMD64_OPND_VEC;
+  if (reuse.kind == kind && amd64_is_temp(cls, reuse.reg)) {
+    *reg = reuse.reg;
+    return LLACE_ERROR_NONE;
+  }
+  if (cls == LLACE_REGCLASS_GPR && reuse.kind == LLACE_AMD64_OPND_MEM && !(avoid & amd64_mask(reuse))) {
+    if (reuse.base >= 0 && reuse.base < 16 && amd64_is_temp(cls, reuse.base)) { *reg = (uint8_t)reuse.base; return LLACE_ERROR_NONE; }
+    if (reuse.index >= 0 && amd64_is_temp(cls, reuse.index)) { *reg = (uint8_t)reuse.index; return LLACE_ERROR_NONE; }
+  }
+  return amd64_temp(sel, cls, avoid, reg);
+}
+
+static llace_error_t amd64_div(amd64_sel_t *sel, const llace_isel_node_t *node, const llace_isel_leaf_t *leaves, amd64_value_t *out) {
+  const uint32_t fixed = BIT(LLACE_REGCLASS_GPR, LLACE_AMD64_RAX) | BIT(LLACE_REGCLASS_GPR, LLACE_AMD64_RDX);
+  uint8_t size = LLACE_MAX(amd64_size(node), (uint8_t)4);
+  bool sign = amd64_signed(node);
+  // A dividend already in rax stays there
+  if (sel->holder[LLACE_REGCLASS_GPR][LLACE_AMD64_RAX] == (int)leaves[0].node) sel->holder[LLACE_REGCLASS_GPR][LLACE_AMD64_RAX] = (int)sel->node;
+  LLACE_RUNCHECK(amd64_claim(sel, LLACE_REGCLASS_GPR, LLACE_AMD64_RAX, fixed));
+  LLACE_RUNCHECK(amd64_claim(sel, LLACE_REGCLASS_GPR, LLACE_AMD64_RDX, fixed));
+
+  amd64_value_t *lhs = VALUE(sel, leaves[0].node), *rhs = VALUE(sel, leaves[1].node);
+  LLACE_RUNCHECK(amd64_fit(sel, rhs, size, sign, fixed));
+  if (lhs->op.size < size) {
+    amd64_extend(sel, LLACE_AMD64_RAX, size, lhs->op, sign);
+  } else {
+    llace_amd64_operand_t src = lhs->op;
+    src.size = size;
+    amd64_copy(sel, LLACE_REGCLASS_GPR, GPR(LLACE_AMD64_RAX, size), src, false);
+  }
+  if (!sign) EMIT(sel, XOR, GPR(LLACE_AMD64_RDX, 4), GPR(LLACE_AMD64_RDX, 4));
+  else if (size == 8) EMIT0(sel, CQO);
+  else EMIT0(sel, CDQ);
+  amd64_link(sign ? EMIT(sel, IDIV, rhs->op) : EMIT(sel, DIV, rhs->op), rhs);
+
+  out->op = GPR(node->value->instr.op == LLACE_IR_OP_DIV ? LLACE_AMD64_RAX : LLACE_AMD64_RDX, amd64_size(node));
+  return LLACE_ERROR_NONE;
+}
+
+static llace_error_t amd64_shift(amd64_sel_t *sel, const llace_isel_node_t *node, const llace_isel_leaf_t *leaves, amd64_value_t *out) {
+  uint8_t size = amd64_size(node), reg;
+  bool sign = amd64_signed(node);
+  llace_amd64_mnemonic_t mn = node->value->instr.op == LLACE_IR_OP_SHL ? LLACE_AMD64_SHL : sign ? LLACE_AMD64_SAR : LLACE_AMD64_SHR;
+  llace_amd64_operand_t count;
+
+  if (leaves[1].nt == NT_IMM) {
+    count = LLACE_AMD64_IMM(VALUE(sel, leaves[1].node)->op.imm & (size * 8 - 1));
+  } else {
+    const uint32_t rcx = BIT(LLACE_REGCLASS_GPR, LLACE_AMD64_RCX);
+    LLACE_RUNCHECK(amd64_claim(sel, LLACE_REGCLASS_GPR, LLACE_AMD64_RCX, rcx));
+    amd64_value_t *rhs = VALUE(sel, leaves[1].node);
+    EMIT(sel, MOV, GPR(LLACE_AMD64_RCX, 1), GPR(rhs->op.reg, 1));
+    count = GPR(LLACE_AMD64_RCX, 1);
+  }
+
+  amd64_value_t *lhs = VALUE(sel, leaves[0].node);
+  LLACE_RUNCHECK(amd64_result(sel, LLACE_REGCLASS_GPR, lhs->op, BIT(LLACE_REGCLASS_GPR, LLACE_AMD64_RCX), &reg));
+  LLACE_RUNCHECK(amd64_fit(sel, lhs, size, sign, BIT(LLACE_REGCLASS_GPR, LLACE_AMD64_RCX)));
+  amd64_copy(sel, LLACE_REGCLASS_GPR, GPR(reg, size), lhs->op, false);
+  EMITM(sel, mn, GPR(reg, size), count);
+  out->op = GPR(reg, size);
+  return LLACE_ERROR_NONE;
+}
+
+static llace_error_t amd64_compare(amd64_sel_t *sel, const llace_isel_tree_t *tree, const llace_isel_node_t *node, amd64_value_t *lhs,
+                                   amd64_value_t *rhs, bool swapped, amd64_value_t *out) {
+  const llace_isel_node_t *a = KID(tree, node, 0), *b = KID(tree, node, 1);
+  bool sign = amd64_signed(a);
+  uint8_t size = LLACE_MAX(amd64_size(a), amd64_size(b));
+  LLACE_RUNCHECK(amd64_fit(sel, lhs, size, sign, amd64_mask(rhs->op)));
+  LLACE_RUNCHECK(amd64_fit(sel, rhs, size, sign, amd64_mask(lhs->op)));
+  if (rhs->op.kind == LLACE_AMD64_OPND_IMM) rhs->op.imm = amd64_imm(rhs->op.imm, size);
+
+  llace_amd64_minst_t *m = EMIT(sel, CMP, lhs->op, rhs->op);
+  amd64_link(m, lhs);
+  amd64_link(m, rhs);
+  out->cond = amd64_cond(node->value->instr.op, sign);
+  if (swapped) out->cond = amd64_swap(out->cond);
+  return LLACE_ERROR_NONE;
+}
+
+static void amd64_setcc(amd64_sel_t *sel, llace_amd64_cond_t cc, llace_amd64_operand_t dst) {
+  if (dst.kind == LLACE_AMD64_OPND_MEM) {
+    dst.size = 1;
+    amd64_push(sel, LLACE_AMD64_SETCC, cc, OPS(dst));
+    return;
+  }
+  amd64_push(sel, LLACE_AMD64_SETCC, cc, OPS(GPR(dst.reg, 1)));
+  EMIT(sel, MOVZX, GPR(dst.reg, 4), GPR(dst.reg, 1));
+}
+
+// dst = lhs op rhs, the operand derived as a register goes first whichever side it is on
+static void amd64_vbinop(amd64_sel_t *sel, const llace_isel_node_t *node, llace_amd64_operand_t dst, const llace_isel_leaf_t *leaves,
+                         amd64_value_t *lhs, amd64_value_t *rhs) {
+  if (leaves[0].nt != NT_VX) {
+    amd64_value_t *swap = lhs;
+    lhs = rhs;
+    rhs = swap;
+  }
+  rhs->op.size = dst.size;
+  amd64_link(EMITM(sel, amd64_valu(node), dst, lhs->op, rhs->op), rhs);
+}
+
+// Broadcast of the low element, from memory or a vector register
+static llace_error_t amd64_splat(amd64_sel_t *sel, const llace_isel_tree_t *tree, const llace_isel_node_t *node, amd64_value_t *lhs, amd64_value_t *out) {
+  const llace_isel_node_t *kid = KID(tree, node, 0);
+  uint8_t size = amd64_size(kid), vsize = (uint8_t)amd64_vbytes(node), reg;
+  llace_amd64_mnemonic_t mn = size == 1 ? LLACE_AMD64_VPBROADCASTB : size == 2 ? LLACE_AMD64_VPBROADCASTW :
+                              size == 4 ? LLACE_AMD64_VPBROADCASTD : LLACE_AMD64_VPBROADCASTQ;
+  if (amd64_class(kid) == LLACE_REGCLASS_VEC && size == 4) mn = LLACE_AMD64_VBROADCASTSS;
+
+  llace_amd64_operand_t src = lhs->op;
+  LLACE_RUNCHECK(amd64_result(sel, LLACE_REGCLASS_VEC, src, 0, &reg));
+  if (src.kind == LLACE_AMD64_OPND_GPR) {
+    if (size == 8) EMIT(sel, MOVQ, VEC(reg), GPR(src.reg, 8));
+    else EMIT(sel, MOVD, VEC(reg), GPR(src.reg, 4)); // bytes above the element are not broadcast
+    src = VEC(reg);
+  } else if (src.kind == LLACE_AMD64_OPND_MEM) {
+    src.size = size;
+  }
+  amd64_link(EMITM(sel, mn, LLACE_AMD64_VEC(reg, vsize), src), lhs);
+  *out = (amd64_value_t){ .op = LLACE_AMD64_VEC(reg, vsize) };
+  return LLACE_ERROR_NONE;
+}
+
+// Lanes are written to the scratch area and read back as one vector
+static llace_error_t amd64_pack(amd64_sel_t *sel, const llace_isel_node_t *node, const llace_isel_leaf_t *leaves, size_t count, amd64_value_t *out) {
+  uint8_t vsize = (uint8_t)amd64_vbytes(node), size = (uint8_t)(llace_ir_type_bits(llace_ir_type_vec(node->type, 0)) / 8), reg;
+  for (size_t k = 0; k < count; ++k) {
+    amd64_value_t *lane = VALUE(sel, leaves[k].node);
+    llace_amd64_operand_t dst = LLACE_AMD64_BASE(size, LLACE_AMD64_RBP, sel->scratch + (int32_t)(k * size)), src = lane->op;
+    switch (src.kind) {
+    case LLACE_AMD64_OPND_IMM: EMIT(sel, MOV, dst, LLACE_AMD64_IMM(amd64_imm(src.imm, size))); break;
+    case LLACE_AMD64_OPND_GPR: EMIT(sel, MOV, dst, GPR(src.reg, size)); break;
+    case LLACE_AMD64_OPND_VEC: EMITM(sel, size == 4 ? LLACE_AMD64_MOVSS : LLACE_AMD64_MOVSD, dst, src); break;
+    default:
+      // Memory through a temporary, free again for the next lane
+      LLACE_RUNCHECK(amd64_temp(sel, LLACE_REGCLASS_GPR, amd64_mask(src), &reg));
+      src.size = size;
+      amd64_link(EMIT(sel, MOV, GPR(reg, size), src), lane);
+      EMIT(sel, MOV, dst, GPR(reg, size));
+      sel->holder[LLACE_REGCLASS_GPR][reg] = -1;
+      break;
+    }
+  }
+
+  LLACE_RUNCHECK(amd64_temp(sel, LLACE_REGCLASS_VEC, 0, &reg));
+  EMITM(sel, amd64_vmov(node), LLACE_AMD64_VEC(reg, vsize), LLACE_AMD64_BASE(vsize, LLACE_AMD64_RBP, sel->scratch));
+  *out = (amd64_value_t){ .op = LLACE_AMD64_VEC(reg, vsize) };
+  return LLACE_ERROR_NONE;
+}
+
+// One lane read from memory, a vector in a register is written to the scratch area first
+static llace_error_t amd64_extract(amd64_sel_t *sel, const llace_isel_tree_t *tree, const llace_isel_node_t *node, amd64_value_t *lhs, amd64_value_t *out) {
+  const llace_isel_node_t *vec = KID(tree, node, 0);
+  int64_t lane = KID(tree, node, 1)->value->_int;
+  uint8_t size = amd64_size(node), reg;
+  if (lane < 0 || (size_t)lane >= vec->type.lanes) return LLACE_ERROR_INVLTYPE;
+
+  llace_amd64_operand_t src = lhs->op;
+  if (src.kind == LLACE_AMD64_OPND_VEC) {
+    EMITM(sel, amd64_vmov(vec), LLACE_AMD64_BASE(src.size, LLACE_AMD64_RBP, sel->scratch), src);
+    src = LLACE_AMD64_BASE(0, LLACE_AMD64_RBP, sel->scratch);
+  }
+  src.disp += (int32_t)(lane * size);
+  src.size = size;
+  if (amd64_class(node) == LLACE_REGCLASS_VEC) {
+    LLACE_RUNCHECK(amd64_temp(sel, LLACE_REGCLASS_VEC, 0, &reg));
+    amd64_link(EMITM(sel, size == 4 ? LLACE_AMD64_MOVSS : LLACE_AMD64_MOVSD, VEC(reg), src), lhs);
+    *out = (amd64_value_t){ .op = VEC(reg) };
+  } else {
+    LLACE_RUNCHECK(amd64_result(sel, LLACE_REGCLASS_GPR, src, 0, &reg));
+    amd64_link(EMIT(sel, MOV, GPR(reg, size), src), lhs);
+    *out = (amd64_value_t){ .op = GPR(reg, size) };
+  }
+  return LLACE_ERROR_NONE;
+}
+
+// Start of the subtree of a node, kids come before their parents
+static size_t amd64_subtree(const llace_isel_tree_t *tree, size_t index) {
+  const llace_isel_node_t *node = NODE(tree, index);
+  return node->count > 0 ? amd64_subtree(tree, LLACE_ISEL_KID(tree, node, 0)) : index;
+}
+
+typedef struct {
+  int cls;
+  uint8_t reg;
+} amd64_saved_t;
+
+static void amd64_save(llace_array_t *saved, int cls, uint8_t reg) {
+  LLACE_ARRAY_FOREACH(amd64_saved_t, s, *saved) {
+    if (s->cls == cls && s->reg == reg) return;
+  }
+  amd64_saved_t s = { cls, reg };
+  LLACE_ARRAY_PUSHP(*saved, &s);
+}
+
+// Arguments go through the stack into their registers, caller saved registers still needed after the call around it
+static llace_error_t amd64_call(amd64_sel_t *sel, const llace_isel_tree_t *tree, size_t index, const llace_isel_leaf_t *leaves, size_t count, amd64_value_t *out) {
+  const llace_isel_node_t *node = NODE(tree, index);
+  const llace_regset_t *regs = llace_amd64_regset();
+  size_t first = amd64_subtree(tree, index);
+
+  // Temporaries of other nodes and variables read outside the call
+  llace_array_t saved = LLACE_NEW_ARRAY(amd64_saved_t, 8);
+  for (int cls = 0; cls < LLACE_REGCLASS_COUNT; ++cls) {
+    for (size_t i = 0; i < amd64_temp_count[cls]; ++i) {
+      int holder = sel->holder[cls][amd64_temps[cls][i]];
+      if (holder >= 0 && ((size_t)holder < first || (size_t)holder > index)) amd64_save(&saved, cls, amd64_temps[cls][i]);
+    }
+  }
+  const llace_isel_node_t *root = NODE(tree, LLACE_ISEL_ROOT(tree));
+  size_t dst = root->op == LLACE_IR_OP_ASSIGN ? LLACE_ISEL_KID(tree, root, 1) : SIZE_MAX;
+  for (size_t n = 0; n < LLACE_ARRAY_COUNT(tree->nodes); ++n) {
+    const llace_isel_node_t *var = NODE(tree, n);
+    if (var->op != LLACE_ISEL_VAR || (n >= first && n <= index) || n == dst) continue;
+    llace_loc_t loc = llace_regalloc_loc(sel->ra, var->value->var, sel->position);
+    if (loc.kind == LLACE_LOC_REG && (regs->caller_saved[loc.cls] >> loc.index & 1)) amd64_save(&saved, loc.cls, (uint8_t)loc.index);
+  }
+
+  LLACE_ARRAY_FOREACH(amd64_saved_t, s, saved) {
+    if (s->cls == LLACE_REGCLASS_GPR) {
+      EMIT(sel, PUSH, GPR(s->reg, 8));
+    } else {
+      EMIT(sel, SUB, RSP, LLACE_AMD64_IMM(8));
+      EMIT(sel, MOVSD, STACK(8), VEC(s->reg));
+    }
+  }
+
+  // Push the arguments, then pop them into their registers
+  size_t used[LLACE_REGCLASS_COUNT] = { 0 };
+  llace_error_t err = LLACE_ERROR_NONE;
+  for (size_t k = 0; k < count && err == LLACE_ERROR_NONE; ++k) {
+    const llace_isel_node_t *arg = NODE(tree, leaves[k].node);
+    amd64_value_t *value = VALUE(sel, leaves[k].node);
+    int cls = amd64_class(arg);
+    if (cls < 0) {
+      err = LLACE_ERROR_INVLTYPE;
+      break;
+    }
+    if (used[cls]++ >= regs->arg_count[cls]) {
+      LLACE_LOG_ERROR("Instruction selection does not pass arguments on the stack: call in '%s'", sel->fn->name);
+      err = LLACE_ERROR_OVERFLOW;
+      break;
+    }
+
+    sel->node = leaves[k].node;
+    if (cls == LLACE_REGCLASS_GPR) {
+      if (value->op.kind == LLACE_AMD64_OPND_IMM) {
+        EMIT(sel, PUSH, value->op);
+      } else if (value->op.kind == LLACE_AMD64_OPND_MEM && value->op.size == 8) {
+        amd64_link(EMIT(sel, PUSH, value->op), value);
+      } else {
+        if (value->op.size < 4 || value->op.kind == LLACE_AMD64_OPND_MEM) err = amd64_fit(sel, value, 8, amd64_signed(arg), 0);
+        if (err == LLACE_ERROR_NONE) EMIT(sel, PUSH, GPR(value->op.reg, 8));
+      }
+    } else {
+      llace_amd64_operand_t x = value->op;
+      if (x.kind == LLACE_AMD64_OPND_MEM) {
+        uint8_t reg;
+        if ((err = amd64_temp(sel, LLACE_REGCLASS_VEC, 0, &reg)) != LLACE_ERROR_NONE) break;
+        amd64_link(EMITM(sel, amd64_single(arg) ? LLACE_AMD64_MOVSS : LLACE_AMD64_MOVSD, VEC(reg), x), value);
+        x = VEC(reg);
+      }
+      EMIT(sel, SUB, RSP, LLACE_AMD64_IMM(8));
+      EMIT(sel, MOVSD, STACK(8), x);
+    }
+
+    // Pushed, its temporaries are free for the next arguments
+    for (int c = 0; c < LLACE_REGCLASS_COUNT; ++c) {
+      for (size_t i = 0; i < amd64_temp_count[c]; ++i) {
+        if (sel->holder[c][amd64_temps[c][i]] == (int)leaves[k].node) sel->holder[c][amd64_temps[c][i]] = -1;
+      }
+    }
+  }
+  sel->node = index;
+
+  for (size_t k = count; k > 0 && err == LLACE_ERROR_NONE; --k) {
+    int cls = amd64_class(NODE(tree, leaves[k - 1].node));
+    if (cls < 0) continue;
+    uint8_t reg = regs->args[cls][--used[cls]];
+    if (cls == LLACE_REGCLASS_GPR) {
+      EMIT(sel, POP, GPR(reg, 8));
+    } else {
+      EMIT(sel, MOVSD, VEC(reg), STACK(8));
+      EMIT(sel, ADD, RSP, LLACE_AMD64_IMM(8));
+    }
+  }
+
+  bool pad = LLACE_ARRAY_COUNT(saved) % 2 != 0; // the stack is 16 byte aligned at every statement
+  if (err == LLACE_ERROR_NONE) {
+    if (pad) EMIT(sel, SUB, RSP, LLACE_AMD64_IMM(8));
+    if (sel->vectors) EMIT0(sel, VZEROUPPER);
+    amd64_jump(sel, LLACE_AMD64_CALL, 0, LLACE_AMD64_SYM_FUNC, node->value->instr.func);
+    if (pad) EMIT(sel, ADD, RSP, LLACE_AMD64_IMM(8));
+
+    // The result leaves rax or xmm0 before the saved registers come back
+    int cls = amd64_class(node);
+    out->op = NONE_OP;
+    if (node->value->instr.out == 1 && cls == LLACE_REGCLASS_GPR) {
+      uint8_t reg = LLACE_AMD64_RAX;
+      if (sel->holder[cls][reg] >= 0) err = amd64_temp(sel, cls, 0, &reg);
+      else sel->holder[cls][reg] = (int)index;
+      if (err == LLACE_ERROR_NONE && reg != LLACE_AMD64_RAX) EMIT(sel, MOV, GPR(reg, 8), GPR(LLACE_AMD64_RAX, 8));
+      out->op = GPR(reg, amd64_size(node));
+    } else if (node->value->instr.out == 1 && cls == LLACE_REGCLASS_VEC) {
+      uint8_t reg;
+      err = amd64_temp(sel, cls, 0, &reg);
+      if (err == LLACE_ERROR_NONE) EMIT(sel, MOVAPS, VEC(reg), VEC(0));
+      out->op = VEC(reg);
+    }
+  }
+
+  for (size_t i = LLACE_ARRAY_COUNT(saved); i > 0 && err == LLACE_ERROR_NONE; --i) {
+    const amd64_saved_t *s = LLACE_ARRAY_GET(amd64_saved_t, saved, i - 1);
+    if (s->cls == LLACE_REGCLASS_GPR) {
+      EMIT(sel, POP, GPR(s->reg, 8));
+    } else {
+      EMIT(sel, MOVSD, VEC(s->reg), STACK(8));
+      EMIT(sel, ADD, RSP, LLACE_AMD64_IMM(8));
+    }
+  }
+  LLACE_FREE_ARRAY(saved);
+  return err;
+}
+
+static llace_error_t amd64_assign(amd64_sel_t *sel, const llace_isel_tree_t *tree, const llace_isel_node_t *node, amd64_value_t *src) {
+  const llace_isel_node_t *var = KID(tree, node, 1);
+  llace_loc_t loc = amd64_dst(sel, tree, node);
+  if (loc.kind == LLACE_LOC_NONE) return LLACE_ERROR_NONE; // dead, whatever it calls already ran
+  uint8_t size = amd64_vbytes(var) > 0 ? (uint8_t)amd64_vbytes(var) : amd64_size(var);
+  llace_amd64_operand_t dst = amd64_loc(sel, loc, size);
+
+  if (amd64_vbytes(var) > 0) {
+    if (dst.kind == LLACE_AMD64_OPND_MEM && src->op.kind == LLACE_AMD64_OPND_MEM) {
+      uint8_t reg;
+      LLACE_RUNCHECK(amd64_temp(sel, LLACE_REGCLASS_VEC, 0, &reg));
+      amd64_link(EMITM(sel, amd64_vmov(var), LLACE_AMD64_VEC(reg, size), src->op), src);
+      src->op = LLACE_AMD64_VEC(reg, size);
+      src->sym = LLACE_AMD64_SYM_NONE;
+    }
+    if (!amd64_same_op(dst, src->op)) amd64_link(EMITM(sel, amd64_vmov(var), dst, src->op), src);
+    return LLACE_ERROR_NONE;
+  }
+
+  if (amd64_class(var) == LLACE_REGCLASS_VEC) {
+    bool single = amd64_single(var);
+    if (dst.kind == LLACE_AMD64_OPND_MEM && src->op.kind == LLACE_AMD64_OPND_MEM) {
+      uint8_t reg;
+      LLACE_RUNCHECK(amd64_temp(sel, LLACE_REGCLASS_VEC, 0, &reg));
+      amd64_link(EMITM(sel, single ? LLACE_AMD64_MOVSS : LLACE_AMD64_MOVSD, VEC(reg), src->op), src);
+      src->op = VEC(reg);
+      src->sym = LLACE_AMD64_SYM_NONE;
+    }
+    if (dst.kind == LLACE_AMD64_OPND_MEM) dst.size = single ? 4 : 8;
+    if (!amd64_same_op(dst, src->op)) amd64_link(EMITM(sel, dst.kind == LLACE_AMD64_OPND_VEC && src->op.kind == LLACE_AMD64_OPND_VEC ? LLACE_AMD64_MOVAPS :
+                                                       single ? LLACE_AMD64_MOVSS : LLACE_AMD64_MOVSD, dst, src->op), src);
+    return LLACE_ERROR_NONE;
+  }
+
+  bool sign = amd64_signed(var);
+  if (src->op.kind == LLACE_AMD64_OPND_MEM && src->op.size < size && dst.kind == LLACE_AMD64_OPND_GPR) {
+    amd64_extend(sel, dst.reg, size, src->op, sign);
+    return LLACE_ERROR_NONE;
+  }
+  LLACE_RUNCHECK(amd64_fit(sel, src, size, sign, 0));
+  if (src->op.kind == LLACE_AMD64_OPND_MEM && dst.kind == LLACE_AMD64_OPND_MEM) {
+    uint8_t reg;
+    LLACE_RUNCHECK(amd64_temp(sel, LLACE_REGCLASS_GPR, amd64_mask(src->op), &reg));
+    amd64_link(EMIT(sel, MOV, GPR(reg, size), src->op), src);
+    src->op = GPR(reg, size);
+    src->sym = LLACE_AMD64_SYM_NONE;
+  }
+  if (src->op.kind == LLACE_AMD64_OPND_IMM) src->op.imm = amd64_imm(src->op.imm, size);
+  if (!amd64_same_op(dst, src->op)) amd64_link(EMIT(sel, MOV, dst, src->op), src);
+  return LLACE_ERROR_NONE;
+}
+
+static llace_error_t amd64_ret(amd64_sel_t *sel, const llace_isel_tree_t *tree, const llace_isel_node_t *node, const llace_isel_leaf_t *leaves, size_t count) {
+  if (count > 0) {
+    const llace_isel_node_t *kid = KID(tree, node, 0);
+    amd64_value_t *value = VALUE(sel, leaves[0].node);
+    if (amd64_class(kid) == LLACE_REGCLASS_VEC) {
+      if (value->op.kind == LLACE_AMD64_OPND_VEC) amd64_copy(sel, LLACE_REGCLASS_VEC, VEC(0), value->op, false);
+      else amd64_link(EMITM(sel, amd64_single(kid) ? LLACE_AMD64_MOVSS : LLACE_AMD64_MOVSD, VEC(0), value->op), value);
+    } else {
+      uint8_t size = LLACE_MAX(amd64_size(kid), (uint8_t)4);
+      if (value->op.kind == LLACE_AMD64_OPND_IMM) {
+        EMIT(sel, MOV, GPR(LLACE_AMD64_RAX, size), LLACE_AMD64_IMM(amd64_imm(value->op.imm, size)));
+      } else if (value->op.size < size) {
+        amd64_extend(sel, LLACE_AMD64_RAX, size, value->op, amd64_signed(kid));
+      } else if (!amd64_same_op(GPR(LLACE_AMD64_RAX, size), value->op)) {
+        amd64_link(EMIT(sel, MOV, GPR(LLACE_AMD64_RAX, size), value->op), value);
+      }
+    }
+  }
+  amd64_epilogue(sel);
+  return LLACE_ERROR_NONE;
+}
+
+static llace_error_t amd64_action(amd64_sel_t *sel, const llace_isel_tree_t *tree, size_t index, const llace_isel_rule_t *rule,
+                                  const llace_isel_leaf_t *leaves, size_t count) {
+  const llace_isel_node_t *node = NODE(tree, index);
+  amd64_value_t *out = VALUE(sel, index);
+  amd64_value_t *lhs = count > 0 ? VALUE(sel, leaves[0].node) : NULL;
+  amd64_value_t *rhs = count > 1 ? VALUE(sel, leaves[1].node) : NULL;
+  int cls = amd64_class(node);
+  uint8_t size = cls >= 0 ? amd64_size(node) : (uint8_t)amd64_vbytes(node), reg;
+
+  switch (rule->action) {
+  case A_PASS:
+    return LLACE_ERROR_NONE;
+  case A_BASE:
+    out->op = LLACE_AMD64_BASE(0, out->op.reg, 0);
+    return LLACE_ERROR_NONE;
+  case A_VAR: {
+    llace_loc_t loc = llace_regalloc_loc(sel->ra, node->value->var, sel->position);
+    *out = (amd64_value_t){ .op = amd64_loc(sel, loc, size) };
+    if (out->op.kind == LLACE_AMD64_OPND_MEM && cls == LLACE_REGCLASS_VEC) out->op.size = amd64_single(node) ? 4 : 8;
+    return LLACE_ERROR_NONE;
+  }
+  case A_IMM:
+    *out = (amd64_value_t){ .op = LLACE_AMD64_IMM(amd64_imm(node->value->_int, size)) };
+    return LLACE_ERROR_NONE;
+  case A_CONST: {
+    int64_t value = amd64_imm(node->value->_int, size);
+    LLACE_RUNCHECK(amd64_temp(sel, LLACE_REGCLASS_GPR, 0, &reg));
+    if (value == 0) EMIT(sel, XOR, GPR(reg, 4), GPR(reg, 4));
+    else if (size == 8 && !amd64_fits32(value)) EMIT(sel, MOV, GPR(reg, 8), LLACE_AMD64_IMM(value));
+    else EMIT(sel, MOV, GPR(reg, size == 8 ? 8 : 4), LLACE_AMD64_IMM(size == 8 ? value : amd64_imm(value, 4)));
+    *out = (amd64_value_t){ .op = GPR(reg, size) };
+    return LLACE_ERROR_NONE;
+  }
+  case A_FCONST: {
+    uint8_t gpr;
+    LLACE_RUNCHECK(amd64_temp(sel, LLACE_REGCLASS_GPR, 0, &gpr));
+    LLACE_RUNCHECK(amd64_temp(sel, LLACE_REGCLASS_VEC, 0, &reg));
+    if (amd64_single(node)) {
+      float f = (float)node->value->_float;
+      uint32_t bits;
+      memcpy(&bits, &f, sizeof(bits));
+      EMIT(sel, MOV, GPR(gpr, 4), LLACE_AMD64_IMM((int32_t)bits));
+      EMIT(sel, MOVD, VEC(reg), GPR(gpr, 4));
+    } else {
+      int64_t bits;
+      memcpy(&bits, &node->value->_float, sizeof(bits));
+      EMIT(sel, MOV, GPR(gpr, 8), LLACE_AMD64_IMM(bits));
+      EMIT(sel, MOVQ, VEC(reg), GPR(gpr, 8));
+    }
+    *out = (amd64_value_t){ .op = VEC(reg) };
+    return LLACE_ERROR_NONE;
+  }
+  case A_GLOBAL:
+    *out = (amd64_value_t){ .op = LLACE_AMD64_RIPREL(0, 0), .sym = LLACE_AMD64_SYM_GLOBAL, .target = node->value->global };
+    return LLACE_ERROR_NONE;
+  case A_LABEL:
+    *out = (amd64_value_t){ .sym = LLACE_AMD64_SYM_LABEL, .target = node->value->block };
+    return LLACE_ERROR_NONE;
+
+  case A_FETCH: {
+    llace_amd64_operand_t mem = out->op;
+    if (cls < 0) {
+      if (mem.kind == LLACE_AMD64_OPND_VEC) return LLACE_ERROR_NONE;
+      LLACE_RUNCHECK(amd64_temp(sel, LLACE_REGCLASS_VEC, 0, &reg));
+      amd64_link(EMITM(sel, amd64_vmov(node), LLACE_AMD64_VEC(reg, size), mem), out);
+      *out = (amd64_value_t){ .op = LLACE_AMD64_VEC(reg, size) };
+      return LLACE_ERROR_NONE;
+    }
+    if (cls == LLACE_REGCLASS_VEC) {
+      if (mem.kind == LLACE_AMD64_OPND_VEC) return LLACE_ERROR_NONE;
+      LLACE_RUNCHECK(amd64_temp(sel, LLACE_REGCLASS_VEC, 0, &reg));
+      amd64_link(EMITM(sel, amd64_single(node) ? LLACE_AMD64_MOVSS : LLACE_AMD64_MOVSD, VEC(reg), mem), out);
+      *out = (amd64_value_t){ .op = VEC(reg) };
+      return LLACE_ERROR_NONE;
+    }
+    LLACE_RUNCHECK(amd64_result(sel, LLACE_REGCLASS_GPR, mem, 0, &reg));
+    amd64_link(EMIT(sel, MOV, GPR(reg, size), mem), out);
+    *out = (amd64_value_t){ .op = GPR(reg, size) };
+    return LLACE_ERROR_NONE;
+  }
+  case A_LEA: {
+    llace_amd64_operand_t mem = out->op;
+    uint8_t wide = LLACE_MAX(size, (uint8_t)4);
+    LLACE_RUNCHECK(amd64_result(sel, LLACE_REGCLASS_GPR, mem, 0, &reg));
+    amd64_link(EMIT(sel, LEA, GPR(reg, wide), mem), out);
+    *out = (amd64_value_t){ .op = GPR(reg, size) };
+    return LLACE_ERROR_NONE;
+  }
+  case A_SETCC:
+    LLACE_RUNCHECK(amd64_temp(sel, LLACE_REGCLASS_GPR, 0, &reg));
+    amd64_setcc(sel, out->cond, GPR(reg, 4));
+    *out = (amd64_value_t){ .op = GPR(reg, size) };
+    return LLACE_ERROR_NONE;
+  case A_TESTREG:
+    EMIT(sel, TEST, out->op, out->op);
+    out->cond = LLACE_AMD64_CC_NE;
+    return LLACE_ERROR_NONE;
+
+  case A_INDEX: {
+    size_t elem = amd64_elem(tree, node);
+    LLACE_RUNCHECK(amd64_fit(sel, rhs, 8, amd64_signed(KID(tree, node, 1)), amd64_mask(lhs->op)));
+    *out = (amd64_value_t){ .op = LLACE_AMD64_MEM(0, lhs->op.reg, rhs->op.reg, (uint8_t)elem, 0) };
+    return LLACE_ERROR_NONE;
+  }
+  case A_INDEX_IMM:
+    *out = (amd64_value_t){ .op = LLACE_AMD64_BASE(0, lhs->op.reg, (int32_t)(KID(tree, node, 1)->value->_int * (int64_t)amd64_elem(tree, node))) };
+    return LLACE_ERROR_NONE;
+  case A_ADD_IMM:
+    *out = (amd64_value_t){ .op = LLACE_AMD64_BASE(0, lhs->op.reg, (int32_t)rhs->op.imm) };
+    return LLACE_ERROR_NONE;
+  case A_ADD_REG:
+    *out = (amd64_value_t){ .op = LLACE_AMD64_MEM(0, lhs->op.reg, rhs->op.reg, 1, 0) };
+    return LLACE_ERROR_NONE;
+  case A_LOAD:
+    *out = *lhs;
+    out->op.size = cls == LLACE_REGCLASS_VEC ? (amd64_single(node) ? 4 : 8) : size;
+    return LLACE_ERROR_NONE;
+
+  case A_BINOP_SWAP: {
+    amd64_value_t *swap = lhs;
+    lhs = rhs;
+    rhs = swap;
+  } // fallthrough
+  case A_BINOP: {
+    uint8_t wide = cls == LLACE_REGCLASS_GPR && node->value->instr.op == LLACE_IR_OP_MUL ? LLACE_MAX(size, (uint8_t)2) : size;
+    LLACE_RUNCHECK(amd64_result(sel, cls, lhs->op.kind == LLACE_AMD64_OPND_MEM ? NONE_OP : lhs->op, amd64_mask(rhs->op), &reg));
+    llace_amd64_operand_t dst = cls == LLACE_REGCLASS_GPR ? GPR(reg, wide) : VEC(reg);
+    LLACE_RUNCHECK(amd64_binop(sel, node, dst, lhs, rhs));
+    *out = (amd64_value_t){ .op = cls == LLACE_REGCLASS_GPR ? GPR(reg, size) : dst };
+    return LLACE_ERROR_NONE;
+  }
+  case A_MULIMM: {
+    amd64_value_t *rm = leaves[0].nt == NT_IMM ? rhs : lhs, *imm = leaves[0].nt == NT_IMM ? lhs : rhs;
+    uint8_t wide = LLACE_MAX(size, (uint8_t)2);
+    LLACE_RUNCHECK(amd64_fit(sel, rm, wide, amd64_signed(node), 0));
+    LLACE_RUNCHECK(amd64_result(sel, LLACE_REGCLASS_GPR, rm->op, 0, &reg));
+    amd64_link(EMIT(sel, IMUL, GPR(reg, wide), rm->op, LLACE_AMD64_IMM(amd64_imm(imm->op.imm, wide))), rm);
+    *out = (amd64_value_t){ .op = GPR(reg, size) };
+    return LLACE_ERROR_NONE;
+  }
+  case A_DIV: return amd64_div(sel, node, leaves, out);
+  case A_SHIFT: return amd64_shift(sel, node, leaves, out);
+
+  case A_CMP: return amd64_compare(sel, tree, node, lhs, rhs, false, out);
+  case A_CMP_SWAP: return amd64_compare(sel, tree, node, rhs, lhs, true, out);
+  case A_FCMP: {
+    // Unordered results are not told apart from the ordered ones
+    llace_amd64_minst_t *m = EMITM(sel, amd64_single(KID(tree, node, 0)) ? LLACE_AMD64_UCOMISS : LLACE_AMD64_UCOMISD, lhs->op, rhs->op);
+    amd64_link(m, rhs);
+    out->cond = amd64_cond(node->value->instr.op, false);
+    return LLACE_ERROR_NONE;
+  }
+  case A_TEST: {
+    llace_amd64_minst_t *m = lhs->op.kind == LLACE_AMD64_OPND_GPR ? EMIT(sel, TEST, lhs->op, lhs->op) : EMIT(sel, CMP, lhs->op, LLACE_AMD64_IMM(0));
+    amd64_link(m, lhs);
+    out->cond = node->value->instr.op == LLACE_IR_OP_NZ ? LLACE_AMD64_CC_NE : LLACE_AMD64_CC_E;
+    return LLACE_ERROR_NONE;
+  }
+
+  case A_ASSIGN: return amd64_assign(sel, tree, node, lhs);
+  case A_ASSIGN_LEA: {
+    const llace_isel_node_t *var = KID(tree, node, 1);
+    llace_amd64_operand_t dst = amd64_loc(sel, amd64_dst(sel, tree, node), LLACE_MAX(amd64_size(var), (uint8_t)4));
+    amd64_link(EMIT(sel, LEA, dst, lhs->op), lhs);
+    return LLACE_ERROR_NONE;
+  }
+  case A_ASSIGN_COND: {
+    llace_loc_t loc = amd64_dst(sel, tree, node);
+    if (loc.kind != LLACE_LOC_NONE) amd64_setcc(sel, lhs->cond, amd64_loc(sel, loc, 4));
+    return LLACE_ERROR_NONE;
+  }
+  case A_ASSIGN_BINOP: {
+    const llace_isel_node_t *op = KID(tree, node, 0);
+    if (amd64_vbytes(op) > 0) {
+      amd64_vbinop(sel, op, amd64_loc(sel, amd64_dst(sel, tree, node), (uint8_t)amd64_vbytes(op)), leaves, lhs, rhs);
+      return LLACE_ERROR_NONE;
+    }
+    uint8_t opsize = amd64_size(op);
+    if (op->value->instr.op == LLACE_IR_OP_MUL) opsize = LLACE_MAX(opsize, (uint8_t)2);
+    llace_amd64_operand_t dst = amd64_loc(sel, amd64_dst(sel, tree, node), opsize);
+    return amd64_binop(sel, op, dst, lhs, rhs);
+  }
+  case A_STORE: {
+    const llace_isel_node_t *kid = KID(tree, node, 0);
+    llace_amd64_operand_t mem = rhs->op;
+    if (amd64_vbytes(kid) > 0) {
+      mem.size = (uint8_t)amd64_vbytes(kid);
+      amd64_link(EMITM(sel, amd64_vmov(kid), mem, lhs->op), rhs);
+      return LLACE_ERROR_NONE;
+    }
+    if (amd64_class(kid) == LLACE_REGCLASS_VEC) {
+      mem.size = amd64_single(kid) ? 4 : 8;
+      amd64_link(EMITM(sel, amd64_single(kid) ? LLACE_AMD64_MOVSS : LLACE_AMD64_MOVSD, mem, lhs->op), rhs);
+      return LLACE_ERROR_NONE;
+    }
+    mem.size = amd64_size(kid);
+    if (lhs->op.kind == LLACE_AMD64_OPND_IMM) lhs->op.imm = amd64_imm(lhs->op.imm, mem.size);
+    else lhs->op.size = mem.size;
+    amd64_link(EMIT(sel, MOV, mem, lhs->op), rhs);
+    return LLACE_ERROR_NONE;
+  }
+  case A_RMW: {
+    const llace_isel_node_t *op = KID(tree, node, 0);
+    llace_amd64_operand_t mem = lhs->op;
+    mem.size = amd64_size(op);
+    LLACE_RUNCHECK(amd64_fit(sel, rhs, mem.size, amd64_signed(op), amd64_mask(mem)));
+    if (rhs->op.kind == LLACE_AMD64_OPND_IMM) rhs->op.imm = amd64_imm(rhs->op.imm, mem.size);
+    amd64_link(EMITM(sel, amd64_alu(op->value->instr.op, false, false), mem, rhs->op), lhs);
+    return LLACE_ERROR_NONE;
+  }
+
+  case A_JMP: {
+    size_t succ = lhs->target, group = amd64_edge(sel, sel->block, succ);
+    if (group != SIZE_MAX) amd64_group(sel, group);
+    if (succ != sel->next) amd64_jump(sel, LLACE_AMD64_JMP, 0, LLACE_AMD64_SYM_LABEL, succ);
+    return LLACE_ERROR_NONE;
+  }
+  case A_BRANCH: {
+    llace_amd64_cond_t cc = lhs->cond;
+    size_t then = amd64_edge_label(sel, rhs->target), other = amd64_edge_label(sel, VALUE(sel, leaves[2].node)->target);
+    if (other == sel->next) {
+      amd64_jump(sel, LLACE_AMD64_JCC, cc, LLACE_AMD64_SYM_LABEL, then);
+    } else if (then == sel->next) {
+      amd64_jump(sel, LLACE_AMD64_JCC, amd64_negate(cc), LLACE_AMD64_SYM_LABEL, other);
+    } else {
+      amd64_jump(sel, LLACE_AMD64_JCC, cc, LLACE_AMD64_SYM_LABEL, then);
+      amd64_jump(sel, LLACE_AMD64_JMP, 0, LLACE_AMD64_SYM_LABEL, other);
+    }
+    return LLACE_ERROR_NONE;
+  }
+  case A_RET: return amd64_ret(sel, tree, node, leaves, count);
+  case A_CALL: return amd64_call(sel, tree, index, leaves, count, out);
+
+  case A_VBINOP: {
+    LLACE_RUNCHECK(amd64_result(sel, LLACE_REGCLASS_VEC, (leaves[0].nt == NT_VX ? lhs : rhs)->op, 0, &reg));
+    llace_amd64_operand_t dst = LLACE_AMD64_VEC(reg, size);
+    amd64_vbinop(sel, node, dst, leaves, lhs, rhs);
+    *out = (amd64_value_t){ .op = dst };
+    return LLACE_ERROR_NONE;
+  }
+  case A_SPLAT: return amd64_splat(sel, tree, node, lhs, out);
+  case A_PACK: return amd64_pack(sel, node, leaves, count, out);
+  case A_EXTRACT: return amd64_extract(sel, tree, node, lhs, out);
+  default: return LLACE_ERROR_BADARG;
+  }
+}
+
+// Temporaries of the consumed leaves and of the rule are released, those of the result kept
+static llace_error_t amd64_reduce(void *user, const llace_isel_tree_t *tree, size_t index, const llace_isel_rule_t *rule,
+                                  const llace_isel_leaf_t *leaves, size_t count) {
+  amd64_sel_t *sel = user;
+  sel->node = index;
+  llace_error_t err = amd64_action(sel, tree, index, rule, leaves, count);
+
+  for (int cls = 0; cls < LLACE_REGCLASS_COUNT; ++cls) {
+    for (size_t i = 0; i < amd64_temp_count[cls]; ++i) {
+      int *holder = &sel->holder[cls][amd64_temps[cls][i]];
+      if (*holder < 0) continue;
+      bool consumed = (size_t)*holder == index;
+      for (size_t k = 0; k < count && !consumed; ++k) consumed = leaves[k].node == (size_t)*holder;
+      if (consumed) *holder = -1;
+    }
+  }
+  uint32_t mask = amd64_mask(VALUE(sel, index)->op);
+  for (int cls = 0; cls < LLACE_REGCLASS_COUNT; ++cls) {
+    for (size_t i = 0; i < amd64_temp_count[cls]; ++i) {
+      if (mask & BIT(cls, amd64_temps[cls][i])) sel->holder[cls][amd64_temps[cls][i]] = (int)index;
+    }
+  }
+  return err;
+}
+
+static const llace_isel_target_t amd64_target = {
+  .rules = amd64_rules,
+  .rule_count = sizeof(amd64_rules) / sizeof(amd64_rules[0]),
+  .start = NT_STMT,
+  .accept = amd64_accept,
+  .reduce = amd64_reduce,
+};
+
+// ================ Selection ================ //
+
+// Parameters arrive in the argument registers, the ones allocated elsewhere move through the stack
+static llace_error_t amd64_params(amd64_sel_t *sel) {
+  const llace_regset_t *regs = llace_amd64_regset();
+  size_t entry = *LLACE_ARRAY_GET(size_t, sel->ra->from, 0), used[LLACE_REGCLASS_COUNT] = { 0 };
+  llace_array_t moved = LLACE_NEW_ARRAY(llace_loc_t, 8);
+
+  for (size_t v = 0; v < sel->fn->param_count; ++v) {
+    const llace_ir_variable_t *var = LLACE_IR_VAR_AT(sel->fn, v);
+    llace_regclass_t cls = llace_regclass_of(var->type, var->attr);
+    if (LLACE_IR_IS_VEC(var->type) && var->attr.depth == 0) {
+      LLACE_FREE_ARRAY(moved);
+      return LLACE_ERROR_INVLTYPE;
+    }
+    if (used[cls] >= regs->arg_count[cls]) {
+      LLACE_LOG_ERROR("Instruction selection does not take parameters from the stack: '%s'", sel->fn->name);
+      LLACE_FREE_ARRAY(moved);
+      return LLACE_ERROR_OVERFLOW;
+    }
+    uint8_t arg = regs->args[cls][used[cls]++];
+    llace_loc_t loc = llace_regalloc_loc(sel->ra, v, entry);
+    if (loc.kind == LLACE_LOC_NONE || (loc.kind == LLACE_LOC_REG && loc.cls == cls && loc.index == arg)) continue;
+
+    if (cls == LLACE_REGCLASS_GPR) {
+      EMIT(sel, PUSH, GPR(arg, 8));
+    } else {
+      EMIT(sel, SUB, RSP, LLACE_AMD64_IMM(8));
+      EMIT(sel, MOVSD, STACK(8), VEC(arg));
+    }
+    LLACE_ARRAY_PUSHP(moved, &loc);
+  }
+
+  for (size_t i = LLACE_ARRAY_COUNT(moved); i > 0; --i) {
+    llace_loc_t loc = *LLACE_ARRAY_GET(llace_loc_t, moved, i - 1);
+    if (loc.cls == LLACE_REGCLASS_GPR) {
+      EMIT(sel, POP, amd64_loc(sel, loc, 8));
+    } else if (loc.kind == LLACE_LOC_REG) {
+      EMIT(sel, MOVSD, VEC(loc.index), STACK(8));
+      EMIT(sel, ADD, RSP, LLACE_AMD64_IMM(8));
+    } else {
+      EMIT(sel, POP, amd64_loc(sel, loc, 8));
+    }
+  }
+  LLACE_FREE_ARRAY(moved);
+  return LLACE_ERROR_NONE;
+}
+
+// Vector values llace_isel_scalarize kept whole
+static bool amd64_has_vectors(const llace_ir_function_t *fn) {
+  LLACE_ARRAY_FOREACH(llace_ir_basicblock_t, block, fn->blocks) {
+    LLACE_ARRAY_FOREACH(llace_ir_value_t, value, block->stack) {
+      if (value->kind == LLACE_IR_VALUE_INSTR && (value->instr.lanes > 0 || value->instr.op == LLACE_IR_OP_EXTRACT)) return true;
+      if (value->kind == LLACE_IR_VALUE_VAR && LLACE_IR_IS_VEC(LLACE_IR_VAR_AT(fn, value->var)->type) && LLACE_IR_VAR_AT(fn, value->var)->attr.depth == 0) return true;
+    }
+  }
+  return false;
+}
+
+static void amd64_prologue(amd64_sel_t *sel) {
+  // Callee saved registers the allocation hands out
+  bool used[16] = { false };
+  LLACE_ARRAY_FOREACH(llace_array_t, segments, sel->ra->segments) {
+    LLACE_ARRAY_FOREACH(llace_ra_segment_t, seg, *segments) {
+      if (seg->loc.kind == LLACE_LOC_REG && seg->loc.cls == LLACE_REGCLASS_GPR) used[seg->loc.index] = true;
+    }
+  }
+  sel->saved_count = 0;
+  for (size_t i = 0; i < sizeof(amd64_callee_saved); ++i) {
+    if (used[amd64_callee_saved[i]]) sel->saved[sel->saved_count++] = amd64_callee_saved[i];
+  }
+
+  // Slots below the saved registers, then the scratch area, rsp 16 byte aligned after the prologue
+  size_t frame = 8 * sel->ra->slots[LLACE_REGCLASS_GPR] + amd64_vec_slot(sel) * sel->ra->slots[LLACE_REGCLASS_VEC] + (sel->vectors ? 32 : 0);
+  sel->scratch = -(int32_t)(8 * sel->saved_count + frame);
+  if ((8 * sel->saved_count + frame) % 16 != 0) frame += 8;
+  sel->code->frame = frame;
+
+  EMIT(sel, PUSH, GPR(LLACE_AMD64_RBP, 8));
+  EMIT(sel, MOV, GPR(LLACE_AMD64_RBP, 8), RSP);
+  for (size_t i = 0; i < sel->saved_count; ++i) EMIT(sel, PUSH, GPR(sel->saved[i], 8));
+  if (frame > 0) EMIT(sel, SUB, RSP, LLACE_AMD64_IMM((int64_t)frame));
+}
+
+static llace_error_t amd64_block(amd64_sel_t *sel, llace_isel_tree_t *tree, llace_array_t *stmts, size_t b) {
+  const llace_ir_basicblock_t *block = LLACE_IR_BLOCK_AT(sel->fn, b);
+  size_t from = *LLACE_ARRAY_GET(size_t, sel->ra->from, b), emitted = from;
+  *LLACE_ARRAY_GET(size_t, sel->code->labels, b) = LLACE_ARRAY_COUNT(sel->code->insts);
+  sel->block = b;
+  LLACE_RUNCHECK(llace_ir_block_stmts(block, stmts));
+  if (sel->group_at[from] != SIZE_MAX) amd64_group(sel, sel->group_at[from]);
+
+  for (size_t k = 0; k < LLACE_ARRAY_COUNT(*stmts); ++k) {
+    sel->position = LLACE_RA_STMT_POS(sel->ra, b, k);
+    for (size_t p = emitted + 1; p <= sel->position; ++p) {
+      if (sel->group_at[p] != SIZE_MAX) amd64_group(sel, sel->group_at[p]);
+    }
+    emitted = sel->position;
+
+    LLACE_RUNCHECK(llace_isel_tree_build(sel->ctx, sel->fn, block, LLACE_ARRAY_GET(llace_ir_stmt_t, *stmts, k), tree));
+    size_t count = LLACE_ARRAY_COUNT(tree->nodes);
+    if (count == 0) continue;
+
+    // Dead definitions without calls leave nothing behind
+    const llace_isel_node_t *root = LLACE_ISEL_NODE(tree, LLACE_ISEL_ROOT(tree));
+    if (root->op == LLACE_IR_OP_ASSIGN && amd64_dst(sel, tree, root).kind == LLACE_LOC_NONE) {
+      bool call = false;
+      for (size_t n = 0; n < count; ++n) call |= LLACE_ISEL_NODE(tree, n)->op == LLACE_IR_OP_CALL;
+      if (!call) continue;
+    }
+
+    if (count > sel->value_capacity) {
+      sel->value_capacity = LLACE_MAX(count, 2 * sel->value_capacity);
+      sel->values = realloc(sel->values, sel->value_capacity * sizeof(amd64_value_t));
+      if (sel->values == NULL) { LLACE_LOG_FATAL("Failed to allocate values for '%zu' tree nodes", count); }
+    }
+    memset(sel->values, 0, count * sizeof(amd64_value_t));
+    memset(sel->holder, 0xFF, sizeof(sel->holder));
+    sel->tree = tree;
+
+    if (!llace_isel_label(&amd64_target, sel, tree)) {
+      LLACE_LOG_ERROR("Instruction selection found no rule for statement %zu of block '%s' in '%s'", k, block->name, sel->fn->name);
+      return LLACE_ERROR_INVLTYPE;
+    }
+    LLACE_RUNCHECK(llace_isel_reduce(&amd64_target, sel, tree, &sel->code->cost));
+  }
+  return LLACE_ERROR_NONE;
+}
+
+llace_error_t llace_amd64_select(const llace_ir_context_t *ctx, const llace_ir_function_t *fn, const llace_regalloc_t *ra, llace_amd64_code_t *code) {
+  LLACE_PROFILE_SCOPE("isel");
+  LLACE_MEM_SCOPE(LLACE_MEM_CODEGEN);
+  size_t block_count = LLACE_ARRAY_COUNT(fn->blocks), end = 0;
+  for (size_t b = 0; b < block_count; ++b) {
+    size_t from = *LLACE_ARRAY_GET(size_t, ra->from, b);
+    if (from != SIZE_MAX) end = LLACE_MAX(end, from + 2 * (LLACE_ARRAY_COUNT(LLACE_IR_BLOCK_AT(fn, b)->stack) + 2));
+  }
+
+  code->insts = LLACE_NEW_ARRAY(llace_amd64_minst_t, 64);
+  code->labels = LLACE_NEW_ARRAY(size_t, block_count + 4);
+  code->frame = 0;
+  code->cost = 0;
+  for (size_t b = 0; b < block_count; ++b) LLACE_ARRAY_PUSH(code->labels, (size_t)SIZE_MAX);
+
+  amd64_sel_t sel = { .ctx = ctx, .fn = fn, .ra = ra, .code = code, .stubs = LLACE_NEW_ARRAY(size_t, 4), .vectors = amd64_has_vectors(fn) };
+  sel.group_at = malloc((end + 1) * sizeof(size_t));
+  if (sel.group_at == NULL) { LLACE_LOG_FATAL("Failed to allocate move groups for '%zu' positions", end); }
+  for (size_t p = 0; p <= end; ++p) sel.group_at[p] = SIZE_MAX;
+  for (size_t g = 0; g < LLACE_ARRAY_COUNT(ra->groups); ++g) {
+    const llace_ra_moves_t *moves = LLACE_ARRAY_GET(llace_ra_moves_t, ra->groups, g);
+    if (moves->position != SIZE_MAX && moves->position <= end) sel.group_at[moves->position] = g;
+  }
+
+  llace_isel_tree_t tree;
+  llace_isel_tree_init(&tree);
+  llace_array_t stmts = LLACE_NEW_ARRAY(llace_ir_stmt_t, 16);
+
+  amd64_prologue(&sel);
+  llace_error_t err = amd64_params(&sel);
+  size_t order_count = LLACE_ARRAY_COUNT(ra->order);
+  for (size_t i = 0; i < order_count && err == LLACE_ERROR_NONE; ++i) {
+    sel.next = i + 1 < order_count ? *LLACE_ARRAY_GET(size_t, ra->order, i + 1) : SIZE_MAX;
+    err = amd64_block(&sel, &tree, &stmts, *LLACE_ARRAY_GET(size_t, ra->order, i));
+  }
+
+  // Edge moves of conditional branches, each in a stub jumping on to its block
+  for (size_t s = 0; s < LLACE_ARRAY_COUNT(sel.stubs) && err == LLACE_ERROR_NONE; ++s) {
+    const llace_ra_moves_t *moves = LLACE_ARRAY_GET(llace_ra_moves_t, ra->groups, *LLACE_ARRAY_GET(size_t, sel.stubs, s));
+    LLACE_ARRAY_PUSH(code->labels, LLACE_ARRAY_COUNT(code->insts));
+    amd64_group(&sel, *LLACE_ARRAY_GET(size_t, sel.stubs, s));
+    amd64_jump(&sel, LLACE_AMD64_JMP, 0, LLACE_AMD64_SYM_LABEL, moves->succ);
+  }
+
+  llace_isel_tree_free(&tree);
+  LLACE_FREE_ARRAY(stmts);
+  LLACE_FREE_ARRAY(sel.stubs);
+  free(sel.group_at);
+  free(sel.values);
+  if (err != LLACE_ERROR_NONE) llace_amd64_code_free(code);
+  return err;
+}
+
+void llace_amd64_code_free(llace_amd64_code_t *code) {
+  LLACE_FREE_ARRAY(code->insts);
+  LLACE_FREE_ARRAY(code->labels);
+}
@@ -0,0 +1,38 @@
+#include <llace/codegen/buffer.h>
+#include <llace/detail/common.h>
+
+// ================ Code Buffer ================ //
+
+llace_error_t llace_codebuf_init(llace_codebuf_t *buf, size_t capacity) {
+  if (!buf) {
+    return LLACE_ERROR_BADARG;
+  }
+
+  *buf = (llace_codebuf_t){0};
+  if (capacity > 0) llace_codebuf_grow(buf, capacity);
+  return LLACE_ERROR_NONE;
+}
+
+void llace_codebuf_free(llace_codebuf_t *buf) {
+  free(buf->data);
+  llace_mem_track(LLACE_MEM_CODEGEN, buf->capacity, 0);
+  *buf = (llace_codebuf_t){0};
+}
+
+void llace_codebuf_grow(llace_codebuf_t *buf, size_t extra) {
+  size_t needed = buf->size + extra, capacity = buf->capacity == 0 ? 64 : buf->capacity;
+  while (capacity < needed) capacity *= 2;
+  if (capacity == buf->capacity) return;
+
+  uint8_t *data = realloc(buf->data, capacity);
+  if (data == NULL) { LLACE_LOG_FATAL("Failed to grow code buffer to '%zu' bytes", capacity); }
+  llace_mem_track(LLACE_MEM_CODEGEN, buf->capacity, capacity);
+  buf->data = data;
+  buf->capacity = capacity;
+}
+
+void llace_codebuf_write(llace_codebuf_t *buf, const void *data, size_t size) {
+  LLACE_CODEBUF_RESERVE(buf, size);
+  memcpy(buf->data + buf->size, data, size);
+  buf->size += size;
+}
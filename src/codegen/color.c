@@ -0,0 +1,487 @@
+#include <llace/detail/regalloc.h>
+
+// Iterated register coalescing (George & Appel). Nodes are the variables
+// followed by one precolored node per allocatable register, interference
+// comes from the shared live intervals.
+
+// ================ Interference Graph ================ //
+
+typedef enum {
+  IRC_PRECOLORED,
+  IRC_IGNORED, // never live or volatile
+  IRC_INITIAL,
+  IRC_SIMPLIFY,
+  IRC_FREEZE,
+  IRC_SPILL,
+  IRC_SPILLED,
+  IRC_COALESCED,
+  IRC_COLORED,
+  IRC_STACK,
+} irc_node_state_t;
+
+typedef enum {
+  IRC_MOVE_WORKLIST,
+  IRC_MOVE_ACTIVE,
+  IRC_MOVE_COALESCED,
+  IRC_MOVE_CONSTRAINED,
+  IRC_MOVE_FROZEN,
+} irc_move_state_t;
+
+typedef struct {
+  size_t dst, src;
+  irc_move_state_t state;
+} irc_move_t;
+
+typedef struct {
+  llace_ra_live_t *live;
+  size_t var_count, node_count;
+  irc_node_state_t *state;
+  llace_regclass_t *cls;
+  size_t *degree, *alias, *mark;
+  int *color;         // machine register, -1 if none
+  double *cost;       // spill cost, uses weighted by loop depth
+  uint64_t *matrix;   // node_count x node_count adjacency bits
+  llace_array_t *adj; // llace_array_t (size_t) per variable node
+  llace_array_t *node_moves; // llace_array_t (size_t) per node
+  llace_array_t moves;       // irc_move_t
+  llace_array_t simplify, freeze, spill, stack, worklist_moves; // size_t, entries go stale when the state changes
+  size_t generation;
+} irc_t;
+
+#define IRC_K(irc, node) ((irc)->live->regs->count[(irc)->cls[node]])
+#define IRC_PRECOLORED_DEGREE (SIZE_MAX / 2)
+
+static bool irc_adjacent_bit(const irc_t *irc, size_t u, size_t v) {
+  size_t bit = u * irc->node_count + v;
+  return LLACE_BITSET_GET(irc->matrix, bit);
+}
+
+static void irc_add_edge(irc_t *irc, size_t u, size_t v) {
+  if (u == v || irc_adjacent_bit(irc, u, v)) return;
+  LLACE_BITSET_SET(irc->matrix, u * irc->node_count + v);
+  LLACE_BITSET_SET(irc->matrix, v * irc->node_count + u);
+  if (irc->state[u] != IRC_PRECOLORED) { LLACE_ARRAY_PUSH(irc->adj[u], v); ++irc->degree[u]; }
+  if (irc->state[v] != IRC_PRECOLORED) { LLACE_ARRAY_PUSH(irc->adj[v], u); ++irc->degree[v]; }
+}
+
+static size_t irc_block_of(const llace_ra_live_t *live, size_t position) {
+  size_t lo = 0, hi = LLACE_ARRAY_COUNT(live->order);
+  while (hi - lo > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+    size_t block = *LLACE_ARRAY_GET(size_t, live->order, mid);
+    if (*LLACE_ARRAY_GET(size_t, live->from, block) <= position) lo = mid;
+    else hi = mid;
+  }
+  return *LLACE_ARRAY_GET(size_t, live->order, lo);
+}
+
+static double irc_weight(const llace_ra_live_t *live, size_t position) {
+  size_t loop = *LLACE_ARRAY_GET(size_t, live->loops.innermost, irc_block_of(live, position));
+  size_t depth = loop == SIZE_MAX ? 0 : LLACE_MIN(LLACE_IR_LOOP_AT(&live->loops, loop)->depth, 4);
+  double weight = 1;
+  while (depth--) weight *= 10;
+  return weight;
+}
+
+static void irc_add_move(irc_t *irc, size_t dst, size_t src) {
+  if (dst == src || irc->cls[dst] != irc->cls[src]) return;
+  if (irc->state[dst] == IRC_IGNORED || irc->state[src] == IRC_IGNORED) return;
+  irc_move_t move = { dst, src, IRC_MOVE_WORKLIST };
+  size_t index = LLACE_ARRAY_COUNT(irc->moves);
+  LLACE_ARRAY_PUSHP(irc->moves, &move);
+  LLACE_ARRAY_PUSH(irc->node_moves[dst], index);
+  LLACE_ARRAY_PUSH(irc->node_moves[src], index);
+  LLACE_ARRAY_PUSH(irc->worklist_moves, index);
+}
+
+typedef struct {
+  size_t start, interval;
+} irc_start_t;
+
+static int irc_start_compare(const void *a, const void *b) {
+  const irc_start_t *sa = a, *sb = b;
+  return sa->start < sb->start ? -1 : sa->start > sb->start ? 1 : 0;
+}
+
+static void irc_build(irc_t *irc) {
+  llace_ra_live_t *live = irc->live;
+  const llace_ir_function_t *fn = live->fn;
+
+  for (size_t n = 0; n < irc->node_count; ++n) {
+    irc->alias[n] = n;
+    irc->color[n] = -1;
+    irc->adj[n] = LLACE_NEW_ARRAY(size_t, 0);
+    irc->node_moves[n] = LLACE_NEW_ARRAY(size_t, 0);
+    if (n >= irc->var_count) {
+      const llace_ra_interval_t *fixed = LLACE_RA_INTERVAL(live, live->fixed[0] + n - irc->var_count);
+      irc->state[n] = IRC_PRECOLORED;
+      irc->cls[n] = fixed->cls;
+      irc->color[n] = (int)fixed->loc.index;
+      irc->degree[n] = IRC_PRECOLORED_DEGREE;
+      continue;
+    }
+    const llace_ra_interval_t *it = LLACE_RA_INTERVAL(live, n);
+    irc->cls[n] = it->cls;
+    irc->state[n] = LLACE_ARRAY_IS_EMPTY(it->ranges) || LLACE_IR_VAR_AT(fn, n)->attr.attr._volatile ? IRC_IGNORED : IRC_INITIAL;
+    irc->cost[n] = 1; // the definition
+    LLACE_ARRAY_FOREACH(size_t, use, it->uses) irc->cost[n] += irc_weight(live, *use);
+  }
+
+  // Sweep the intervals by start, only the ones still alive can interfere
+  llace_array_t sorted = LLACE_NEW_ARRAY(irc_start_t, irc->node_count);
+  for (size_t n = 0; n < irc->node_count; ++n) {
+    irc_start_t entry = { .interval = n < irc->var_count ? n : live->fixed[0] + n - irc->var_count };
+    const llace_ra_interval_t *it = LLACE_RA_INTERVAL(live, entry.interval);
+    if (irc->state[n] == IRC_IGNORED || LLACE_ARRAY_IS_EMPTY(it->ranges)) continue;
+    entry.start = LLACE_RA_START(it);
+    LLACE_ARRAY_PUSHP(sorted, &entry);
+  }
+  qsort(LLACE_ARRAY_RAW(sorted), LLACE_ARRAY_COUNT(sorted), sizeof(irc_start_t), irc_start_compare);
+
+  llace_array_t active = LLACE_NEW_ARRAY(size_t, 16);
+  LLACE_ARRAY_FOREACH(irc_start_t, entry, sorted) {
+    const llace_ra_interval_t *it = LLACE_RA_INTERVAL(live, entry->interval);
+    size_t start = entry->start, node = entry->interval < irc->var_count ? entry->interval : entry->interval - live->fixed[0] + irc->var_count;
+    for (size_t a = 0; a < LLACE_ARRAY_COUNT(active);) {
+      size_t other = *LLACE_ARRAY_GET(size_t, active, a);
+      const llace_ra_interval_t *ot = LLACE_RA_INTERVAL(live, other);
+      if (LLACE_RA_END(ot) <= start) {
+        *LLACE_ARRAY_GET(size_t, active, a) = *LLACE_ARRAY_BACK(size_t, active);
+        --active.element_count;
+        continue;
+      }
+      size_t other_node = other < irc->var_count ? other : other - live->fixed[0] + irc->var_count;
+      bool both_fixed = other_node >= irc->var_count && node >= irc->var_count;
+      if (!both_fixed && ot->cls == it->cls && llace_ra_intersect(it, ot, start) != SIZE_MAX) irc_add_edge(irc, node, other_node);
+      ++a;
+    }
+    LLACE_ARRAY_PUSH(active, entry->interval);
+  }
+  LLACE_FREE_ARRAY(active);
+  LLACE_FREE_ARRAY(sorted);
+
+  // Copies, phi inputs and parameters arriving in their ABI register
+  LLACE_ARRAY_FOREACH(llace_ra_copy_t, copy, live->copies) irc_add_move(irc, copy->dst, copy->src);
+  LLACE_ARRAY_FOREACH(size_t, b, live->order) {
+    const llace_ir_basicblock_t *block = LLACE_IR_BLOCK_AT(fn, *b);
+    LLACE_ARRAY_FOREACH(llace_ir_value_t, value, block->stack) {
+      if (!LLACE_IR_IS_OP(value, LLACE_IR_OP_PHI) || value[1].kind != LLACE_IR_VALUE_VAR) continue;
+      const llace_ir_value_t *pairs = value - value->instr.in;
+      for (size_t p = 0; p < value->instr.in; p += 2) {
+        if (pairs[p].kind == LLACE_IR_VALUE_VAR) irc_add_move(irc, value[1].var, pairs[p].var);
+      }
+    }
+  }
+  for (size_t v = 0; v < irc->var_count; ++v) {
+    int reg = LLACE_RA_INTERVAL(live, v)->hint_reg;
+    for (size_t n = irc->var_count; n < irc->node_count && reg >= 0; ++n) {
+      if (irc->cls[n] == irc->cls[v] && irc->color[n] == reg) irc_add_move(irc, v, n);
+    }
+  }
+}
+
+// ================ Worklists ================ //
+
+static size_t irc_alias(const irc_t *irc, size_t n) {
+  while (irc->state[n] == IRC_COALESCED) n = irc->alias[n];
+  return n;
+}
+
+static bool irc_move_pending(const irc_t *irc, size_t move) {
+  irc_move_state_t state = LLACE_ARRAY_GET(irc_move_t, irc->moves, move)->state;
+  return state == IRC_MOVE_WORKLIST || state == IRC_MOVE_ACTIVE;
+}
+
+static bool irc_move_related(const irc_t *irc, size_t n) {
+  LLACE_ARRAY_FOREACH(size_t, move, irc->node_moves[n]) {
+    if (irc_move_pending(irc, *move)) return true;
+  }
+  return false;
+}
+
+static bool irc_removed(const irc_t *irc, size_t n) {
+  return irc->state[n] == IRC_STACK || irc->state[n] == IRC_COALESCED;
+}
+
+static void irc_push(irc_t *irc, size_t n, irc_node_state_t state) {
+  irc->state[n] = state;
+  switch (state) {
+  case IRC_SIMPLIFY: LLACE_ARRAY_PUSH(irc->simplify, n); break;
+  case IRC_FREEZE:   LLACE_ARRAY_PUSH(irc->freeze, n); break;
+  case IRC_SPILL:    LLACE_ARRAY_PUSH(irc->spill, n); break;
+  case IRC_STACK:    LLACE_ARRAY_PUSH(irc->stack, n); break;
+  default: break;
+  }
+}
+
+// Next entry of a worklist still in the state it was pushed with
+static size_t irc_pop(irc_t *irc, llace_array_t *list, irc_node_state_t state) {
+  while (!LLACE_ARRAY_IS_EMPTY(*list)) {
+    size_t n = *LLACE_ARRAY_BACK(size_t, *list);
+    --list->element_count;
+    if (irc->state[n] == state) return n;
+  }
+  return SIZE_MAX;
+}
+
+static void irc_enable_moves(irc_t *irc, size_t n) {
+  LLACE_ARRAY_FOREACH(size_t, move, irc->node_moves[n]) {
+    irc_move_t *m = LLACE_ARRAY_GET(irc_move_t, irc->moves, *move);
+    if (m->state != IRC_MOVE_ACTIVE) continue;
+    m->state = IRC_MOVE_WORKLIST;
+    LLACE_ARRAY_PUSH(irc->worklist_moves, *move);
+  }
+}
+
+static void irc_decrement_degree(irc_t *irc, size_t m) {
+  if (irc->state[m] == IRC_PRECOLORED) return;
+  size_t degree = irc->degree[m]--;
+  if (degree != IRC_K(irc, m)) return;
+
+  irc_enable_moves(irc, m);
+  LLACE_ARRAY_FOREACH(size_t, t, irc->adj[m]) {
+    if (!irc_removed(irc, *t)) irc_enable_moves(irc, *t);
+  }
+  if (irc->state[m] == IRC_SPILL) irc_push(irc, m, irc_move_related(irc, m) ? IRC_FREEZE : IRC_SIMPLIFY);
+}
+
+static void irc_add_worklist(irc_t *irc, size_t u) {
+  if (irc->state[u] == IRC_FREEZE && !irc_move_related(irc, u) && irc->degree[u] < IRC_K(irc, u)) irc_push(irc, u, IRC_SIMPLIFY);
+}
+
+// George: every neighbour of t is harmless for the precolored r
+static bool irc_ok(const irc_t *irc, size_t t, size_t r) {
+  return irc->degree[t] < IRC_K(irc, t) || irc->state[t] == IRC_PRECOLORED || irc_adjacent_bit(irc, t, r);
+}
+
+// Briggs: fewer than K significant neighbours after the merge
+static bool irc_conservative(irc_t *irc, size_t u, size_t v) {
+  size_t k = 0, limit = IRC_K(irc, u), nodes[2] = { u, v };
+  ++irc->generation;
+  for (size_t i = 0; i < 2; ++i) {
+    LLACE_ARRAY_FOREACH(size_t, t, irc->adj[nodes[i]]) {
+      if (irc_removed(irc, *t) || irc->mark[*t] == irc->generation) continue;
+      irc->mark[*t] = irc->generation;
+      if (irc->degree[*t] >= IRC_K(irc, *t) && ++k >= limit) return false;
+    }
+  }
+  return true;
+}
+
+static void irc_combine(irc_t *irc, size_t u, size_t v) {
+  irc->state[v] = IRC_COALESCED;
+  irc->alias[v] = u;
+  LLACE_ARRAY_FOREACH(size_t, move, irc->node_moves[v]) LLACE_ARRAY_PUSH(irc->node_moves[u], *move);
+  irc_enable_moves(irc, v);
+  irc->cost[u] += irc->cost[v];
+
+  for (size_t i = 0; i < LLACE_ARRAY_COUNT(irc->adj[v]); ++i) {
+    size_t t = *LLACE_ARRAY_GET(size_t, irc->adj[v], i);
+    if (irc_removed(irc, t)) continue;
+    irc_add_edge(irc, t, u);
+    irc_decrement_degree(irc, t);
+  }
+  if (irc->degree[u] >= IRC_K(irc, u) && irc->state[u] == IRC_FREEZE) irc_push(irc, u, IRC_SPILL);
+}
+
+static void irc_coalesce(irc_t *irc, size_t index) {
+  irc_move_t *move = LLACE_ARRAY_GET(irc_move_t, irc->moves, index);
+  size_t x = irc_alias(irc, move->dst), y = irc_alias(irc, move->src);
+  size_t u = irc->state[y] == IRC_PRECOLORED ? y : x, v = u == y ? x : y;
+
+  if (u == v) {
+    move->state = IRC_MOVE_COALESCED;
+    irc_add_worklist(irc, u);
+    return;
+  }
+  if (irc->state[v] == IRC_PRECOLORED || irc_adjacent_bit(irc, u, v)) {
+    move->state = IRC_MOVE_CONSTRAINED;
+    irc_add_worklist(irc, u);
+    irc_add_worklist(irc, v);
+    return;
+  }
+
+  bool safe;
+  if (irc->state[u] == IRC_PRECOLORED) {
+    safe = true;
+    for (size_t i = 0; i < LLACE_ARRAY_COUNT(irc->adj[v]) && safe; ++i) {
+      size_t t = *LLACE_ARRAY_GET(size_t, irc->adj[v], i);
+      safe = irc_removed(irc, t) || irc_ok(irc, t, u);
+    }
+  } else {
+    safe = irc_conservative(irc, u, v);
+  }
+  if (!safe) {
+    move->state = IRC_MOVE_ACTIVE;
+    return;
+  }
+  move->state = IRC_MOVE_COALESCED;
+  irc_combine(irc, u, v);
+  irc_add_worklist(irc, u);
+}
+
+static void irc_freeze_moves(irc_t *irc, size_t u) {
+  LLACE_ARRAY_FOREACH(size_t, index, irc->node_moves[u]) {
+    irc_move_t *move = LLACE_ARRAY_GET(irc_move_t, irc->moves, *index);
+    if (!irc_move_pending(irc, *index)) continue;
+    size_t x = irc_alias(irc, move->dst), y = irc_alias(irc, move->src);
+    size_t v = y == irc_alias(irc, u) ? x : y;
+    move->state = IRC_MOVE_FROZEN;
+    if (irc->state[v] == IRC_FREEZE && !irc_move_related(irc, v) && irc->degree[v] < IRC_K(irc, v)) irc_push(irc, v, IRC_SIMPLIFY);
+  }
+}
+
+static void irc_simplify(irc_t *irc, size_t n) {
+  irc_push(irc, n, IRC_STACK);
+  LLACE_ARRAY_FOREACH(size_t, m, irc->adj[n]) {
+    if (!irc_removed(irc, *m)) irc_decrement_degree(irc, *m);
+  }
+}
+
+// Cheapest to spill: low weighted use count for many neighbours
+static size_t irc_select_spill(irc_t *irc) {
+  size_t best = SIZE_MAX;
+  for (size_t i = 0; i < LLACE_ARRAY_COUNT(irc->spill);) {
+    size_t n = *LLACE_ARRAY_GET(size_t, irc->spill, i);
+    if (irc->state[n] != IRC_SPILL) {
+      *LLACE_ARRAY_GET(size_t, irc->spill, i) = *LLACE_ARRAY_BACK(size_t, irc->spill);
+      --irc->spill.element_count;
+      continue;
+    }
+    if (best == SIZE_MAX || irc->cost[n] / (double)irc->degree[n] < irc->cost[best] / (double)irc->degree[best]) best = n;
+    ++i;
+  }
+  return best;
+}
+
+// ================ Coloring ================ //
+
+static void irc_assign_colors(irc_t *irc) {
+  const llace_regset_t *regs = irc->live->regs;
+  while (!LLACE_ARRAY_IS_EMPTY(irc->stack)) {
+    size_t n = *LLACE_ARRAY_BACK(size_t, irc->stack);
+    --irc->stack.element_count;
+
+    uint64_t taken = 0;
+    LLACE_ARRAY_FOREACH(size_t, w, irc->adj[n]) {
+      size_t a = irc_alias(irc, *w);
+      if (irc->state[a] == IRC_COLORED || irc->state[a] == IRC_PRECOLORED) taken |= UINT64_C(1) << irc->color[a];
+    }
+
+    // Frozen moves still prefer their partner's register
+    int color = -1;
+    for (size_t i = 0; i < LLACE_ARRAY_COUNT(irc->node_moves[n]) && color < 0; ++i) {
+      const irc_move_t *move = LLACE_ARRAY_GET(irc_move_t, irc->moves, *LLACE_ARRAY_GET(size_t, irc->node_moves[n], i));
+      size_t partner = irc_alias(irc, irc_alias(irc, move->dst) == n ? move->src : move->dst);
+      int want = irc->color[partner];
+      if (want >= 0 && (irc->state[partner] == IRC_COLORED || irc->state[partner] == IRC_PRECOLORED) && !(taken >> want & 1)) color = want;
+    }
+    for (size_t r = 0; r < regs->count[irc->cls[n]] && color < 0; ++r) {
+      if (!(taken >> regs->regs[irc->cls[n]][r] & 1)) color = regs->regs[irc->cls[n]][r];
+    }
+
+    if (color < 0) {
+      irc->state[n] = IRC_SPILLED;
+    } else {
+      irc->state[n] = IRC_COLORED;
+      irc->color[n] = color;
+    }
+  }
+}
+
+llace_error_t llace_regalloc_color(const llace_ir_context_t *ctx, const llace_ir_function_t *fn, const llace_regset_t *regs, llace_regalloc_t *ra) {
+  if (!ctx || !fn || !regs || !ra) {
+    return LLACE_ERROR_BADARG;
+  }
+  for (size_t c = 0; c < LLACE_REGCLASS_COUNT; ++c) {
+    if (regs->count[c] > 64) return LLACE_ERROR_BADARG;
+  }
+
+  llace_ra_live_t live;
+  LLACE_RUNCHECK(llace_ra_live_build(ctx, fn, regs, &live));
+
+  irc_t irc = { .live = &live, .var_count = live.var_count, .node_count = LLACE_ARRAY_COUNT(live.intervals) };
+  size_t n_count = irc.node_count;
+  irc.state = calloc(n_count, sizeof(*irc.state));
+  irc.cls = calloc(n_count, sizeof(*irc.cls));
+  irc.degree = calloc(n_count, sizeof(*irc.degree));
+  irc.alias = calloc(n_count, sizeof(*irc.alias));
+  irc.mark = calloc(n_count, sizeof(*irc.mark));
+  irc.color = calloc(n_count, sizeof(*irc.color));
+  irc.cost = calloc(n_count, sizeof(*irc.cost));
+  irc.adj = calloc(n_count, sizeof(*irc.adj));
+  irc.node_moves = calloc(n_count, sizeof(*irc.node_moves));
+  if (!irc.state || !irc.cls || !irc.degree || !irc.alias || !irc.mark || !irc.color || !irc.cost || !irc.adj || !irc.node_moves) {
+    LLACE_LOG_FATAL("Failed to allocate interference graph of '%zu' nodes", n_count);
+  }
+  irc.matrix = LLACE_BITSET_NEW(n_count * n_count);
+  irc.moves = LLACE_NEW_ARRAY(irc_move_t, 16);
+  irc.simplify = LLACE_NEW_ARRAY(size_t, n_count);
+  irc.freeze = LLACE_NEW_ARRAY(size_t, 16);
+  irc.spill = LLACE_NEW_ARRAY(size_t, 16);
+  irc.stack = LLACE_NEW_ARRAY(size_t, n_count);
+  irc.worklist_moves = LLACE_NEW_ARRAY(size_t, 16);
+
+  irc_build(&irc);
+  for (size_t n = 0; n < irc.var_count; ++n) {
+    if (irc.state[n] != IRC_INITIAL) continue;
+    if (irc.degree[n] >= IRC_K(&irc, n)) irc_push(&irc, n, IRC_SPILL);
+    else irc_push(&irc, n, irc_move_related(&irc, n) ? IRC_FREEZE : IRC_SIMPLIFY);
+  }
+
+  for (;;) {
+    size_t n;
+    if ((n = irc_pop(&irc, &irc.simplify, IRC_SIMPLIFY)) != SIZE_MAX) {
+      irc_simplify(&irc, n);
+    } else if (!LLACE_ARRAY_IS_EMPTY(irc.worklist_moves)) {
+      size_t move = *LLACE_ARRAY_BACK(size_t, irc.worklist_moves);
+      --irc.worklist_moves.element_count;
+      if (LLACE_ARRAY_GET(irc_move_t, irc.moves, move)->state == IRC_MOVE_WORKLIST) irc_coalesce(&irc, move);
+    } else if ((n = irc_pop(&irc, &irc.freeze, IRC_FREEZE)) != SIZE_MAX) {
+      irc_push(&irc, n, IRC_SIMPLIFY);
+      irc_freeze_moves(&irc, n);
+    } else if ((n = irc_select_spill(&irc)) != SIZE_MAX) {
+      irc_push(&irc, n, IRC_SIMPLIFY);
+      irc_freeze_moves(&irc, n);
+    } else {
+      break;
+    }
+  }
+  irc_assign_colors(&irc);
+
+  // Actual spills live in memory for their whole lifetime, the rest keeps one register
+  for (size_t v = 0; v < irc.var_count; ++v) {
+    llace_ra_interval_t *it = LLACE_RA_INTERVAL(&live, v);
+    if (irc.state[v] == IRC_IGNORED) {
+      if (!LLACE_ARRAY_IS_EMPTY(it->ranges)) it->loc = (llace_loc_t){ .kind = LLACE_LOC_SLOT, .cls = it->cls };
+      continue;
+    }
+    size_t a = irc_alias(&irc, v);
+    if (irc.state[a] == IRC_SPILLED) it->loc = (llace_loc_t){ .kind = LLACE_LOC_SLOT, .cls = it->cls };
+    else it->loc = (llace_loc_t){ .kind = LLACE_LOC_REG, .cls = it->cls, .index = (uint32_t)irc.color[a] };
+  }
+  llace_ra_finish(&live, ra);
+
+  for (size_t n = 0; n < n_count; ++n) {
+    LLACE_FREE_ARRAY(irc.adj[n]);
+    LLACE_FREE_ARRAY(irc.node_moves[n]);
+  }
+  free(irc.state);
+  free(irc.cls);
+  free(irc.degree);
+  free(irc.alias);
+  free(irc.mark);
+  free(irc.color);
+  free(irc.cost);
+  free(irc.adj);
+  free(irc.node_moves);
+  free(irc.matrix);
+  LLACE_FREE_ARRAY(irc.moves);
+  LLACE_FREE_ARRAY(irc.simplify);
+  LLACE_FREE_ARRAY(irc.freeze);
+  LLACE_FREE_ARRAY(irc.spill);
+  LLACE_FREE_ARRAY(irc.stack);
+  LLACE_FREE_ARRAY(irc.worklist_moves);
+  llace_ra_live_free(&live);
+  return LLACE_ERROR_NONE;
+}
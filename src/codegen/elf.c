@@ -0,0 +1,437 @@
+#include <llace/codegen/elf.h>
+#include <llace/profile.h>
+#include <llace/detail/common.h>
+#include <llace/detail/strmap.h>
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// ================ Objects ================ //
+
+#define ELF_SECTION(elf, index) LLACE_ARRAY_GET(llace_elf_section_t, (elf)->sections, (index))
+#define ELF_SYMBOL(elf, index) LLACE_ARRAY_GET(llace_elf_symbol_t, (elf)->symbols, (index))
+
+void llace_elf_init(llace_elf_t *elf) {
+  LLACE_MEM_SCOPE(LLACE_MEM_CODEGEN);
+  elf->sections = LLACE_NEW_ARRAY(llace_elf_section_t, 8);
+  llace_mem_tag(LLACE_MEM_SYMBOLS);
+  elf->symbols = LLACE_NEW_ARRAY(llace_elf_symbol_t, 32);
+  elf->names = malloc(sizeof(llace_strmap_t));
+  if (elf->names == NULL) { LLACE_LOG_FATAL("Failed to allocate the ELF symbol map"); }
+  llace_strmap_init(elf->names, 32);
+}
+
+void llace_elf_free(llace_elf_t *elf) {
+  LLACE_ARRAY_FOREACH(llace_elf_section_t, section, elf->sections) {
+    LLACE_FREE_ARRAY(section->chunks);
+    LLACE_FREE_ARRAY(section->relocs);
+  }
+  LLACE_FREE_ARRAY(elf->sections);
+  LLACE_FREE_ARRAY(elf->symbols);
+  if (elf->names) llace_strmap_free(elf->names);
+  free(elf->names);
+  elf->names = NULL;
+}
+
+llace_error_t llace_elf_section(llace_elf_t *elf, const char *name, llace_elf_sectkind_t kind, size_t align, size_t *index) {
+  LLACE_MEM_SCOPE(LLACE_MEM_CODEGEN);
+  if (!elf || !name || !*name || kind > LLACE_ELF_BSS) {
+    return LLACE_ERROR_BADARG;
+  }
+  if (align == 0 || (align & (align - 1)) != 0) {
+    return LLACE_ERROR_BADALLIGN;
+  }
+  LLACE_ARRAY_FOREACH(llace_elf_section_t, section, elf->sections) {
+    if (strcmp(section->name, name) == 0) return LLACE_ERROR_INVLSECT;
+  }
+
+  llace_elf_section_t section = {
+    .name = name, .kind = kind, .align = align,
+    .chunks = LLACE_NEW_ARRAY(llace_elf_chunk_t, 4),
+    .relocs = LLACE_NEW_ARRAY(llace_elf_reloc_t, 8),
+  };
+  LLACE_ARRAY_PUSHP(elf->sections, &section);
+  if (index) *index = LLACE_ARRAY_COUNT(elf->sections) - 1;
+  return LLACE_ERROR_NONE;
+}
+
+llace_error_t llace_elf_append(llace_elf_t *elf, size_t section, const void *data, size_t size, size_t *offset) {
+  if (!elf) {
+    return LLACE_ERROR_BADARG;
+  }
+  if (section >= LLACE_ARRAY_COUNT(elf->sections)) {
+    return LLACE_ERROR_SECT404;
+  }
+  llace_elf_section_t *sect = ELF_SECTION(elf, section);
+  if ((sect->kind == LLACE_ELF_BSS) != (data == NULL)) {
+    return LLACE_ERROR_INVLSECT;
+  }
+
+  if (offset) *offset = sect->size;
+  if (size == 0) return LLACE_ERROR_NONE;
+  llace_elf_chunk_t *last = LLACE_ARRAY_IS_EMPTY(sect->chunks) ? NULL : llace_mem_array_back(&sect->chunks);
+  if (last && (data == NULL || (const uint8_t *)last->data + last->size == data)) {
+    last->size += size; // contiguous with the previous chunk
+  } else {
+    LLACE_ARRAY_PUSH(sect->chunks, ((llace_elf_chunk_t){ .data = data, .size = size }));
+  }
+  sect->size += size;
+  return LLACE_ERROR_NONE;
+}
+
+llace_error_t llace_elf_symbol(llace_elf_t *elf, const char *name, size_t section, size_t value, size_t size, llace_elf_symkind_t kind,
+                               bool global, size_t *index) {
+  if (!elf || !name || !*name || kind > LLACE_ELF_FUNC) {
+    return LLACE_ERROR_BADARG;
+  }
+  if (section != LLACE_ELF_UNDEF && section >= LLACE_ARRAY_COUNT(elf->sections)) {
+    return LLACE_ERROR_SECT404;
+  }
+  if (section == LLACE_ELF_UNDEF ? !global : value > ELF_SECTION(elf, section)->size) {
+    return LLACE_ERROR_INVLSYM;
+  }
+
+  llace_elf_symbol_t symbol = { .name = name, .section = section, .value = value, .size = size, .kind = kind, .global = global };
+  size_t len = strlen(name), existing;
+  if (llace_strmap_get(elf->names, name, len, &existing)) {
+    llace_elf_symbol_t *old = ELF_SYMBOL(elf, existing);
+    if (section != LLACE_ELF_UNDEF) {
+      if (old->section != LLACE_ELF_UNDEF) return LLACE_ERROR_SYMDUP;
+      *old = symbol; // defines an earlier reference
+    }
+    if (index) *index = existing;
+    return LLACE_ERROR_NONE;
+  }
+
+  LLACE_ARRAY_PUSHP(elf->symbols, &symbol);
+  llace_strmap_put(elf->names, name, len, LLACE_ARRAY_COUNT(elf->symbols) - 1);
+  if (index) *index = LLACE_ARRAY_COUNT(elf->symbols) - 1;
+  return LLACE_ERROR_NONE;
+}
+
+llace_error_t llace_elf_reloc(llace_elf_t *elf, size_t section, size_t offset, size_t symbol, llace_elf_reltype_t type, int64_t addend) {
+  if (!elf) {
+    return LLACE_ERROR_BADARG;
+  }
+  if (section >= LLACE_ARRAY_COUNT(elf->sections)) {
+    return LLACE_ERROR_SECT404;
+  }
+  if (symbol >= LLACE_ARRAY_COUNT(elf->symbols)) {
+    return LLACE_ERROR_SYM404;
+  }
+  llace_elf_section_t *sect = ELF_SECTION(elf, section);
+  if (sect->kind == LLACE_ELF_BSS) {
+    return LLACE_ERROR_INVLSECT;
+  }
+
+  size_t width;
+  switch (type) {
+  case LLACE_ELF_R_64: width = 8; break;
+  case LLACE_ELF_R_PC32: case LLACE_ELF_R_PLT32: case LLACE_ELF_R_32: case LLACE_ELF_R_32S: width = 4; break;
+  default: return LLACE_ERROR_INVLREL;
+  }
+  if (offset > sect->size || sect->size - offset < width) {
+    return LLACE_ERROR_INVLREL;
+  }
+
+  LLACE_ARRAY_PUSH(sect->relocs, ((llace_elf_reloc_t){ .offset = offset, .symbol = symbol, .type = type, .addend = addend }));
+  return LLACE_ERROR_NONE;
+}
+
+// ================ Layout ================ //
+
+// Names of the sections every object ends with
+#define ELF_TABLES ".note.GNU-stack\0.symtab\0.strtab\0.shstrtab"
+#define ELF_ALIGN(value, align) (((value) + (align) - 1) & ~(size_t)((align) - 1))
+
+// Everything after the header, in file order: section contents, relocations
+// (.rela<name>), .symtab, .strtab, .shstrtab, the section headers. An empty
+// .note.GNU-stack precedes the tables so linkers keep the stack non executable.
+typedef struct elf_layout {
+  size_t *offsets;      // per section, per relocation section, then spare for the section names
+  size_t *order;        // symbol table index of every symbol, locals first
+  size_t locals;        // symbol table entries before the first global, the null one included
+  size_t relas;         // sections with relocations
+  size_t symtab, strtab, strtab_size, shstrtab, shstrtab_size;
+  size_t shoff, shnum, size;
+} elf_layout_t;
+
+static void elf_layout(const llace_elf_t *elf, elf_layout_t *layout) {
+  size_t sections = LLACE_ARRAY_COUNT(elf->sections), symbols = LLACE_ARRAY_COUNT(elf->symbols);
+  *layout = (elf_layout_t){
+    .offsets = malloc((3 * sections + 1) * sizeof(size_t)),
+    .order = malloc((symbols + 1) * sizeof(size_t)),
+    .locals = 1,
+  };
+  if (!layout->offsets || !layout->order) { LLACE_LOG_FATAL("Failed to allocate the layout of '%zu' sections", sections); }
+
+  size_t offset = sizeof(Elf64_Ehdr);
+  for (size_t s = 0; s < sections; ++s) {
+    const llace_elf_section_t *section = ELF_SECTION(elf, s);
+    offset = ELF_ALIGN(offset, section->align);
+    layout->offsets[s] = offset;
+    if (section->kind != LLACE_ELF_BSS) offset += section->size;
+  }
+  for (size_t s = 0; s < sections; ++s) {
+    const llace_elf_section_t *section = ELF_SECTION(elf, s);
+    if (LLACE_ARRAY_IS_EMPTY(section->relocs)) continue;
+    offset = ELF_ALIGN(offset, 8);
+    layout->offsets[sections + layout->relas++] = offset;
+    offset += LLACE_ARRAY_COUNT(section->relocs) * sizeof(Elf64_Rela);
+  }
+
+  size_t next = 1;
+  layout->strtab_size = 1;
+  for (int global = 0; global < 2; ++global) {
+    for (size_t i = 0; i < symbols; ++i) {
+      const llace_elf_symbol_t *symbol = ELF_SYMBOL(elf, i);
+      if (symbol->global != global) continue;
+      layout->order[i] = next++;
+      layout->strtab_size += strlen(symbol->name) + 1;
+    }
+    if (!global) layout->locals = next;
+  }
+
+  layout->shstrtab_size = 1 + sizeof(ELF_TABLES);
+  LLACE_ARRAY_FOREACH(llace_elf_section_t, section, elf->sections) {
+    layout->shstrtab_size += strlen(section->name) + 1 + (LLACE_ARRAY_IS_EMPTY(section->relocs) ? 0 : sizeof(".rela") - 1);
+  }
+
+  layout->symtab = ELF_ALIGN(offset, 8);
+  layout->strtab = layout->symtab + (symbols + 1) * sizeof(Elf64_Sym);
+  layout->shstrtab = layout->strtab + layout->strtab_size;
+  layout->shoff = ELF_ALIGN(layout->shstrtab + layout->shstrtab_size, 8);
+  layout->shnum = 1 + sections + layout->relas + 4;
+  layout->size = layout->shoff + layout->shnum * sizeof(Elf64_Shdr);
+}
+
+static void elf_layout_free(elf_layout_t *layout) {
+  free(layout->offsets);
+  free(layout->order);
+}
+
+size_t llace_elf_size(const llace_elf_t *elf) {
+  elf_layout_t layout;
+  elf_layout(elf, &layout);
+  elf_layout_free(&layout);
+  return layout.size;
+}
+
+// ================ Output ================ //
+
+#define ELF_IOV 64
+#define ELF_STAGE 4096
+
+static const uint8_t elf_zeros[256];
+
+// Gathers borrowed contents and staged headers into one writev per batch
+typedef struct elf_out {
+  int fd;
+  struct iovec iov[ELF_IOV];
+  int count;
+  uint8_t stage[ELF_STAGE];
+  size_t staged;
+  size_t offset; // of the next queued byte in the file
+  llace_error_t err;
+} elf_out_t;
+
+static void elf_flush(elf_out_t *out) {
+  struct iovec *iov = out->iov;
+  int count = out->count;
+  while (count > 0 && out->err == LLACE_ERROR_NONE) {
+    ssize_t written = writev(out->fd, iov, count);
+    if (written <= 0) {
+      if (written == 0 || errno != EINTR) out->err = LLACE_ERROR_IO;
+      continue;
+    }
+    // Partial writes resume inside the first unfinished vector
+    size_t left = (size_t)written;
+    for (; count > 0 && left >= iov->iov_len; ++iov, --count) left -= iov->iov_len;
+    if (count > 0) {
+      iov->iov_base = (uint8_t *)iov->iov_base + left;
+      iov->iov_len -= left;
+    }
+  }
+  out->count = 0;
+  out->staged = 0;
+}
+
+static void elf_queue(elf_out_t *out, const void *data, size_t size) {
+  if (size == 0) return;
+  if (out->count == ELF_IOV) elf_flush(out);
+  out->iov[out->count++] = (struct iovec){ .iov_base = (void *)data, .iov_len = size };
+  out->offset += size;
+}
+
+// Copies small pieces (headers, table entries) so they outlive the caller
+static void elf_stage(elf_out_t *out, const void *data, size_t size) {
+  if (out->staged + size > ELF_STAGE || out->count == ELF_IOV) elf_flush(out);
+  uint8_t *at = out->stage + out->staged;
+  memcpy(at, data, size);
+  out->staged += size;
+  out->offset += size;
+
+  struct iovec *last = out->count > 0 ? &out->iov[out->count - 1] : NULL;
+  if (last && (uint8_t *)last->iov_base + last->iov_len == at) {
+    last->iov_len += size;
+  } else {
+    out->iov[out->count++] = (struct iovec){ .iov_base = at, .iov_len = size };
+  }
+}
+
+static void elf_pad(elf_out_t *out, size_t offset) {
+  while (out->offset < offset) elf_queue(out, elf_zeros, LLACE_MIN(offset - out->offset, sizeof(elf_zeros)));
+}
+
+static void elf_section_header(elf_out_t *out, uint32_t name, uint32_t type, uint64_t flags, size_t offset, size_t size, uint32_t link, uint32_t info,
+                               size_t align, size_t entsize) {
+  Elf64_Shdr header = {
+    .sh_name = name, .sh_type = type, .sh_flags = flags, .sh_offset = offset, .sh_size = size,
+    .sh_link = link, .sh_info = info, .sh_addralign = align, .sh_entsize = entsize,
+  };
+  elf_stage(out, &header, sizeof(header));
+}
+
+llace_error_t llace_elf_write_fd(const llace_elf_t *elf, int fd) {
+  LLACE_PROFILE_SCOPE("elf");
+  LLACE_MEM_SCOPE(LLACE_MEM_CODEGEN);
+  if (!elf || fd < 0) {
+    return LLACE_ERROR_BADARG;
+  }
+
+  elf_layout_t layout;
+  elf_layout(elf, &layout);
+  size_t sections = LLACE_ARRAY_COUNT(elf->sections), symbols = LLACE_ARRAY_COUNT(elf->symbols);
+  size_t symtab_index = 1 + sections + layout.relas + 1;
+  elf_out_t *out = malloc(sizeof(elf_out_t));
+  if (out == NULL) { LLACE_LOG_FATAL("Failed to allocate the ELF output buffer"); }
+  out->fd = fd;
+  out->count = 0;
+  out->staged = 0;
+  out->offset = 0;
+  out->err = LLACE_ERROR_NONE;
+
+  Elf64_Ehdr header = {
+    .e_ident = { ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3, ELFCLASS64, ELFDATA2LSB, EV_CURRENT, ELFOSABI_NONE },
+    .e_type = ET_REL, .e_machine = EM_X86_64, .e_version = EV_CURRENT,
+    .e_shoff = layout.shoff, .e_ehsize = sizeof(Elf64_Ehdr), .e_shentsize = sizeof(Elf64_Shdr),
+    .e_shnum = (Elf64_Half)layout.shnum, .e_shstrndx = (Elf64_Half)(layout.shnum - 1),
+  };
+  elf_stage(out, &header, sizeof(header));
+
+  // Contents, straight from the chunks
+  for (size_t s = 0; s < sections; ++s) {
+    const llace_elf_section_t *section = ELF_SECTION(elf, s);
+    if (section->kind == LLACE_ELF_BSS) continue;
+    elf_pad(out, layout.offsets[s]);
+    LLACE_ARRAY_FOREACH(llace_elf_chunk_t, chunk, section->chunks) elf_queue(out, chunk->data, chunk->size);
+  }
+
+  for (size_t s = 0, r = 0; s < sections; ++s) {
+    const llace_elf_section_t *section = ELF_SECTION(elf, s);
+    if (LLACE_ARRAY_IS_EMPTY(section->relocs)) continue;
+    elf_pad(out, layout.offsets[sections + r++]);
+    LLACE_ARRAY_FOREACH(llace_elf_reloc_t, reloc, section->relocs) {
+      Elf64_Rela rela = { .r_offset = reloc->offset, .r_info = ELF64_R_INFO(layout.order[reloc->symbol], reloc->type), .r_addend = reloc->addend };
+      elf_stage(out, &rela, sizeof(rela));
+    }
+  }
+
+  // Symbols in table order, names in the same order
+  elf_pad(out, layout.symtab);
+  elf_stage(out, &(Elf64_Sym){0}, sizeof(Elf64_Sym));
+  size_t name = 1;
+  for (int global = 0; global < 2; ++global) {
+    for (size_t i = 0; i < symbols; ++i) {
+      const llace_elf_symbol_t *symbol = ELF_SYMBOL(elf, i);
+      if (symbol->global != global) continue;
+      static const uint8_t types[] = { [LLACE_ELF_NOTYPE] = STT_NOTYPE, [LLACE_ELF_OBJECT] = STT_OBJECT, [LLACE_ELF_FUNC] = STT_FUNC };
+      Elf64_Sym sym = {
+        .st_name = (Elf64_Word)name,
+        .st_info = ELF64_ST_INFO(global ? STB_GLOBAL : STB_LOCAL, types[symbol->kind]),
+        .st_shndx = symbol->section == LLACE_ELF_UNDEF ? SHN_UNDEF : (Elf64_Section)(symbol->section + 1),
+        .st_value = symbol->value, .st_size = symbol->size,
+      };
+      elf_stage(out, &sym, sizeof(sym));
+      name += strlen(symbol->name) + 1;
+    }
+  }
+  elf_stage(out, "", 1);
+  for (int global = 0; global < 2; ++global) {
+    for (size_t i = 0; i < symbols; ++i) {
+      const llace_elf_symbol_t *symbol = ELF_SYMBOL(elf, i);
+      if (symbol->global != global) continue;
+      elf_queue(out, symbol->name, strlen(symbol->name));
+      elf_stage(out, "", 1);
+    }
+  }
+
+  // Section names, a relocation section's name ends with its section's name
+  size_t *names = layout.offsets + sections + layout.relas;
+  elf_stage(out, "", 1);
+  size_t shname = 1;
+  for (size_t s = 0; s < sections; ++s) {
+    const llace_elf_section_t *section = ELF_SECTION(elf, s);
+    if (!LLACE_ARRAY_IS_EMPTY(section->relocs)) {
+      elf_stage(out, ".rela", sizeof(".rela") - 1);
+      shname += sizeof(".rela") - 1;
+    }
+    names[s] = shname;
+    elf_queue(out, section->name, strlen(section->name));
+    elf_stage(out, "", 1);
+    shname += strlen(section->name) + 1;
+  }
+  elf_stage(out, ELF_TABLES, sizeof(ELF_TABLES));
+  const size_t stack_name = shname, symtab_name = stack_name + sizeof(".note.GNU-stack");
+  const size_t strtab_name = symtab_name + sizeof(".symtab"), shstrtab_name = strtab_name + sizeof(".strtab");
+
+  elf_pad(out, layout.shoff);
+  elf_stage(out, &(Elf64_Shdr){0}, sizeof(Elf64_Shdr));
+  static const uint32_t types[] = { [LLACE_ELF_TEXT] = SHT_PROGBITS, [LLACE_ELF_DATA] = SHT_PROGBITS, [LLACE_ELF_RODATA] = SHT_PROGBITS, [LLACE_ELF_BSS] = SHT_NOBITS };
+  static const uint64_t flags[] = {
+    [LLACE_ELF_TEXT] = SHF_ALLOC | SHF_EXECINSTR, [LLACE_ELF_DATA] = SHF_ALLOC | SHF_WRITE,
+    [LLACE_ELF_RODATA] = SHF_ALLOC, [LLACE_ELF_BSS] = SHF_ALLOC | SHF_WRITE,
+  };
+  for (size_t s = 0; s < sections; ++s) {
+    const llace_elf_section_t *section = ELF_SECTION(elf, s);
+    elf_section_header(out, (uint32_t)names[s], types[section->kind], flags[section->kind], layout.offsets[s], section->size, 0, 0, section->align, 0);
+  }
+  for (size_t s = 0, r = 0; s < sections; ++s) {
+    const llace_elf_section_t *section = ELF_SECTION(elf, s);
+    if (LLACE_ARRAY_IS_EMPTY(section->relocs)) continue;
+    elf_section_header(out, (uint32_t)(names[s] - (sizeof(".rela") - 1)), SHT_RELA, SHF_INFO_LINK, layout.offsets[sections + r++],
+                       LLACE_ARRAY_COUNT(section->relocs) * sizeof(Elf64_Rela), (uint32_t)symtab_index, (uint32_t)(s + 1), 8, sizeof(Elf64_Rela));
+  }
+  elf_section_header(out, (uint32_t)stack_name, SHT_PROGBITS, 0, layout.shstrtab, 0, 0, 0, 1, 0); // no executable stack
+  elf_section_header(out, (uint32_t)symtab_name, SHT_SYMTAB, 0, layout.symtab, (symbols + 1) * sizeof(Elf64_Sym), (uint32_t)symtab_index + 1,
+                     (uint32_t)layout.locals, 8, sizeof(Elf64_Sym));
+  elf_section_header(out, (uint32_t)strtab_name, SHT_STRTAB, 0, layout.strtab, layout.strtab_size, 0, 0, 1, 0);
+  elf_section_header(out, (uint32_t)shstrtab_name, SHT_STRTAB, 0, layout.shstrtab, layout.shstrtab_size, 0, 0, 1, 0);
+  elf_flush(out);
+
+  llace_error_t err = out->err;
+  if (err == LLACE_ERROR_NONE && out->offset != layout.size) {
+    LLACE_LOG_ERROR("ELF layout mismatch: wrote %zu of %zu bytes", out->offset, layout.size);
+    err = LLACE_ERROR_INVLFMT;
+  }
+  free(out);
+  elf_layout_free(&layout);
+  return err;
+}
+
+llace_error_t llace_elf_write(const llace_elf_t *elf, const char *path) {
+  if (!elf || !path) {
+    return LLACE_ERROR_BADARG;
+  }
+
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    LLACE_LOG_ERROR("Failed to open '%s' for writing", path);
+    return LLACE_ERROR_IO;
+  }
+  llace_error_t err = llace_elf_write_fd(elf, fd);
+  if (close(fd) != 0 && err == LLACE_ERROR_NONE) err = LLACE_ERROR_IO;
+  return err;
+}
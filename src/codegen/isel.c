@@ -0,0 +1,820 @@
+#include <llace/codegen/isel.h>
+#include <llace/ir/opt.h>
+#include <llace/profile.h>
+#include <llace/detail/common.h>
+
+// ================ Trees ================ //
+
+void llace_isel_tree_init(llace_isel_tree_t *tree) {
+  tree->nodes = LLACE_NEW_ARRAY(llace_isel_node_t, 16);
+  tree->kids = LLACE_NEW_ARRAY(size_t, 16);
+}
+
+void llace_isel_tree_free(llace_isel_tree_t *tree) {
+  LLACE_FREE_ARRAY(tree->nodes);
+  LLACE_FREE_ARRAY(tree->kids);
+}
+
+// Result type of an instruction node from its kids, as the parser infers variable types
+static void isel_infer(const llace_ir_context_t *ctx, llace_isel_tree_t *tree, llace_isel_node_t *node) {
+  const llace_ir_instr_t *instr = &node->value->instr;
+  const llace_isel_node_t *lhs = node->count > 0 ? LLACE_ISEL_NODE(tree, LLACE_ISEL_KID(tree, node, 0)) : NULL;
+  const llace_isel_node_t *rhs = node->count > 1 ? LLACE_ISEL_NODE(tree, LLACE_ISEL_KID(tree, node, 1)) : NULL;
+  node->type = LLACE_IR_VOID;
+  node->depth = 0;
+
+  switch (instr->op) {
+  case LLACE_IR_OP_EQ: case LLACE_IR_OP_NE: case LLACE_IR_OP_LT: case LLACE_IR_OP_LE:
+  case LLACE_IR_OP_GT: case LLACE_IR_OP_GE: case LLACE_IR_OP_NZ: case LLACE_IR_OP_Z:
+    node->type = LLACE_IR_INT(1);
+    break;
+  case LLACE_IR_OP_LOAD:
+    node->type = instr->lanes ? llace_ir_type_vec(lhs->type, instr->lanes) : lhs->type;
+    node->depth = lhs->depth > 0 ? lhs->depth - 1 : 0;
+    break;
+  case LLACE_IR_OP_SPLAT: case LLACE_IR_OP_PACK:
+    node->type = llace_ir_type_vec(node->count > 0 ? LLACE_ISEL_NODE(tree, LLACE_ISEL_KID(tree, node, node->count - 1))->type : LLACE_IR_VOID, instr->lanes);
+    break;
+  case LLACE_IR_OP_EXTRACT:
+    node->type = llace_ir_type_vec(lhs->type, 0);
+    break;
+  case LLACE_IR_OP_INDEX:
+    node->type = lhs->type;
+    node->depth = lhs->depth;
+    break;
+  case LLACE_IR_OP_CALL: {
+    const llace_ir_function_t *callee = LLACE_IR_FUNCTION(ctx, instr->func);
+    node->type = callee->ret;
+    node->depth = callee->retattr.depth;
+    break;
+  }
+  default:
+    if (instr->in != 2 || instr->out != 1) break;
+    llace_ir_type_arith(lhs->type, lhs->depth, rhs->type, rhs->depth, &node->type, &node->depth);
+    break;
+  }
+}
+
+llace_error_t llace_isel_tree_build(const llace_ir_context_t *ctx, const llace_ir_function_t *fn, const llace_ir_basicblock_t *block,
+                                    const llace_ir_stmt_t *stmt, llace_isel_tree_t *tree) {
+  tree->nodes.element_count = 0;
+  tree->kids.element_count = 0;
+  size_t len = stmt->end - stmt->begin;
+  if (len >= 3 && LLACE_IR_IS_OP(LLACE_IR_STACK_AT(block, stmt->end - 3), LLACE_IR_OP_PHI) && llace_ir_stmt_def(block, stmt, NULL)) {
+    return LLACE_ERROR_NONE; // resolved by the moves of register allocation
+  }
+
+  // Replay the stack, every value becomes a node taking its operands as kids
+  llace_array_t stack = LLACE_NEW_ARRAY(size_t, 8);
+  for (size_t i = stmt->begin; i < stmt->end; ++i) {
+    const llace_ir_value_t *value = LLACE_IR_STACK_AT(block, i);
+    llace_isel_node_t node = { .value = value, .type = value->type };
+    size_t in = LLACE_IR_VALUE_IN(value);
+    if (in > LLACE_ARRAY_COUNT(stack)) {
+      LLACE_FREE_ARRAY(stack);
+      return LLACE_ERROR_INVLFUNC;
+    }
+
+    switch (value->kind) {
+    case LLACE_IR_VALUE_CONST: node.op = LLACE_ISEL_CONST; break;
+    case LLACE_IR_VALUE_VAR:
+      node.op = LLACE_ISEL_VAR;
+      node.type = LLACE_IR_VAR_AT(fn, value->var)->type;
+      node.depth = LLACE_IR_VAR_AT(fn, value->var)->attr.depth;
+      break;
+    case LLACE_IR_VALUE_GLOBAL:
+      node.op = LLACE_ISEL_GLOBAL;
+      node.type = LLACE_IR_GLOBAL_AT(ctx, value->global)->type;
+      node.depth = LLACE_IR_GLOBAL_AT(ctx, value->global)->attr.depth + 1;
+      break;
+    case LLACE_IR_VALUE_BLOCK: node.op = LLACE_ISEL_BLOCK; node.type = LLACE_IR_VOID; break;
+    case LLACE_IR_VALUE_INSTR: node.op = (uint16_t)value->instr.op; break;
+    }
+
+    node.first = LLACE_ARRAY_COUNT(tree->kids);
+    node.count = in;
+    if (in > 0) LLACE_ARRAY_PUSHA(tree->kids, LLACE_ARRAY_GET(size_t, stack, LLACE_ARRAY_COUNT(stack) - in), in);
+    stack.element_count -= in;
+    if (value->kind == LLACE_IR_VALUE_INSTR) isel_infer(ctx, tree, &node);
+
+    LLACE_ARRAY_PUSH(stack, LLACE_ARRAY_COUNT(tree->nodes));
+    LLACE_ARRAY_PUSHP(tree->nodes, &node);
+  }
+
+  bool single = LLACE_ARRAY_COUNT(stack) == 1;
+  LLACE_FREE_ARRAY(stack);
+  return single ? LLACE_ERROR_NONE : LLACE_ERROR_INVLFUNC;
+}
+
+// ================ Labelling ================ //
+
+// Match the pattern from *pos against the subtree, adding the costs of the nonterminals
+static bool isel_match(const llace_isel_tree_t *tree, size_t index, const llace_isel_rule_t *rule, size_t *pos, uint32_t *cost) {
+  if (*pos >= rule->length) return false;
+  const llace_isel_node_t *node = LLACE_ISEL_NODE(tree, index);
+  uint8_t sym = rule->pattern[(*pos)++];
+
+  if (LLACE_ISEL_IS_NT(sym)) {
+    uint16_t c = node->cost[sym & 0x7F];
+    if (c == LLACE_ISEL_NOCOST) return false;
+    *cost += c;
+    return true;
+  }
+  if (sym != node->op) return false;
+
+  if ((rule->flags & LLACE_ISEL_VARIADIC) && *pos == 1) {
+    for (size_t k = 0; k < node->count; ++k) {
+      size_t sub = 1;
+      if (!isel_match(tree, LLACE_ISEL_KID(tree, node, k), rule, &sub, cost)) return false;
+    }
+    *pos = rule->length;
+    return true;
+  }
+  for (size_t k = 0; k < node->count; ++k) {
+    if (!isel_match(tree, LLACE_ISEL_KID(tree, node, k), rule, pos, cost)) return false;
+  }
+  return true;
+}
+
+static bool isel_chain(const llace_isel_rule_t *rule) {
+  return rule->length == 1 && LLACE_ISEL_IS_NT(rule->pattern[0]);
+}
+
+static void isel_record(llace_isel_node_t *node, const llace_isel_rule_t *rule, size_t r, uint32_t cost, bool *changed) {
+  if (cost >= node->cost[rule->lhs]) return;
+  node->cost[rule->lhs] = (uint16_t)cost;
+  node->rule[rule->lhs] = (uint16_t)r;
+  *changed = true;
+}
+
+bool llace_isel_label(const llace_isel_target_t *target, void *user, llace_isel_tree_t *tree) {
+  if (LLACE_ARRAY_IS_EMPTY(tree->nodes)) return true;
+
+  for (size_t n = 0; n < LLACE_ARRAY_COUNT(tree->nodes); ++n) {
+    llace_isel_node_t *node = LLACE_ISEL_NODE(tree, n);
+    for (size_t nt = 0; nt < LLACE_ISEL_MAX_NT; ++nt) node->cost[nt] = LLACE_ISEL_NOCOST;
+    bool changed = false;
+
+    for (size_t r = 0; r < target->rule_count; ++r) {
+      const llace_isel_rule_t *rule = &target->rules[r];
+      if (isel_chain(rule) || rule->pattern[0] != node->op) continue;
+      size_t pos = 0;
+      uint32_t cost = rule->cost;
+      if (!isel_match(tree, n, rule, &pos, &cost) || pos != rule->length) continue;
+      if (rule->pred && !target->accept(user, tree, n, rule->pred)) continue;
+      isel_record(node, rule, r, cost, &changed);
+    }
+
+    // Close over the chain rules until nothing gets cheaper
+    changed = true;
+    while (changed) {
+      changed = false;
+      for (size_t r = 0; r < target->rule_count; ++r) {
+        const llace_isel_rule_t *rule = &target->rules[r];
+        if (!isel_chain(rule)) continue;
+        uint16_t from = node->cost[rule->pattern[0] & 0x7F];
+        if (from == LLACE_ISEL_NOCOST || (rule->pred && !target->accept(user, tree, n, rule->pred))) continue;
+        isel_record(node, rule, r, (uint32_t)from + rule->cost, &changed);
+      }
+    }
+  }
+
+  return LLACE_ISEL_NODE(tree, LLACE_ISEL_ROOT(tree))->cost[target->start] != LLACE_ISEL_NOCOST;
+}
+
+// ================ Reduction ================ //
+
+// Subtrees matched by the nonterminals of a pattern, in pattern order
+static void isel_leaves(const llace_isel_tree_t *tree, size_t index, const llace_isel_rule_t *rule, size_t *pos, llace_array_t *leaves) {
+  const llace_isel_node_t *node = LLACE_ISEL_NODE(tree, index);
+  uint8_t sym = rule->pattern[(*pos)++];
+  if (LLACE_ISEL_IS_NT(sym)) {
+    llace_isel_leaf_t leaf = { index, sym & 0x7F };
+    LLACE_ARRAY_PUSHP(*leaves, &leaf);
+    return;
+  }
+
+  if ((rule->flags & LLACE_ISEL_VARIADIC) && *pos == 1) {
+    for (size_t k = 0; k < node->count; ++k) {
+      size_t sub = 1;
+      isel_leaves(tree, LLACE_ISEL_KID(tree, node, k), rule, &sub, leaves);
+    }
+    *pos = rule->length;
+    return;
+  }
+  for (size_t k = 0; k < node->count; ++k) isel_leaves(tree, LLACE_ISEL_KID(tree, node, k), rule, pos, leaves);
+}
+
+static llace_error_t isel_reduce(const llace_isel_target_t *target, void *user, const llace_isel_tree_t *tree, size_t index, uint8_t nt, size_t *cost) {
+  const llace_isel_node_t *node = LLACE_ISEL_NODE(tree, index);
+  const llace_isel_rule_t *rule = &target->rules[node->rule[nt]];
+
+  llace_array_t leaves = LLACE_NEW_ARRAY(llace_isel_leaf_t, 4);
+  size_t pos = 0;
+  isel_leaves(tree, index, rule, &pos, &leaves);
+
+  llace_error_t err = LLACE_ERROR_NONE;
+  LLACE_ARRAY_FOREACH(llace_isel_leaf_t, leaf, leaves) {
+    if (err == LLACE_ERROR_NONE) err = isel_reduce(target, user, tree, leaf->node, leaf->nt, cost);
+  }
+  if (err == LLACE_ERROR_NONE) {
+    *cost += rule->cost;
+    err = target->reduce(user, tree, index, rule, LLACE_ARRAY_RAW(leaves), LLACE_ARRAY_COUNT(leaves));
+  }
+
+  LLACE_FREE_ARRAY(leaves);
+  return err;
+}
+
+llace_error_t llace_isel_reduce(const llace_isel_target_t *target, void *user, const llace_isel_tree_t *tree, size_t *cost) {
+  if (LLACE_ARRAY_IS_EMPTY(tree->nodes)) return LLACE_ERROR_NONE;
+  if (LLACE_ISEL_NODE(tree, LLACE_ISEL_ROOT(tree))->cost[target->start] == LLACE_ISEL_NOCOST) return LLACE_ERROR_BADARG;
+  return isel_reduce(target, user, tree, LLACE_ISEL_ROOT(tree), target->start, cost);
+}
+
+// ================ Folding ================ //
+
+// Roots worth carrying into their user: flags for a branch, addresses and memory operands
+static bool isel_foldable(llace_ir_opcode_t op) {
+  switch (op) {
+  case LLACE_IR_OP_EQ: case LLACE_IR_OP_NE: case LLACE_IR_OP_LT: case LLACE_IR_OP_LE:
+  case LLACE_IR_OP_GT: case LLACE_IR_OP_GE: case LLACE_IR_OP_NZ: case LLACE_IR_OP_Z:
+  case LLACE_IR_OP_INDEX: case LLACE_IR_OP_LOAD:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static bool isel_has_op(const llace_ir_basicblock_t *block, size_t begin, size_t end, llace_ir_opcode_t a, llace_ir_opcode_t b) {
+  for (size_t i = begin; i < end; ++i) {
+    const llace_ir_value_t *value = LLACE_IR_STACK_AT(block, i);
+    if (LLACE_IR_IS_OP(value, a) || LLACE_IR_IS_OP(value, b)) return true;
+  }
+  return false;
+}
+
+// Push the values of [begin, end), folded variables replaced by their expressions
+static void isel_splice(const llace_ir_basicblock_t *block, const size_t *fold, const llace_ir_stmt_t *stmts, size_t begin, size_t end, llace_array_t *out) {
+  for (size_t i = begin; i < end; ++i) {
+    if (fold[i] != SIZE_MAX) {
+      const llace_ir_stmt_t *def = &stmts[fold[i]];
+      isel_splice(block, fold, stmts, def->begin, def->end - 2, out);
+    } else {
+      LLACE_ARRAY_PUSHP(*out, LLACE_IR_STACK_AT(block, i));
+    }
+  }
+}
+
+llace_error_t llace_isel_fold(llace_ir_function_t *fn, size_t *folded) {
+  LLACE_PROFILE_SCOPE("isel.fold");
+  LLACE_MEM_SCOPE(LLACE_MEM_CODEGEN);
+  size_t var_count = LLACE_ARRAY_COUNT(fn->vars), count = 0;
+  size_t *uses = calloc(var_count + 1, sizeof(size_t));
+  if (uses == NULL) { LLACE_LOG_FATAL("Failed to allocate use counts for '%zu' variables", var_count); }
+
+  // Uses across the function, the variable of a definition does not count
+  LLACE_ARRAY_FOREACH(llace_ir_basicblock_t, block, fn->blocks) {
+    for (size_t i = 0; i < LLACE_ARRAY_COUNT(block->stack); ++i) {
+      const llace_ir_value_t *value = LLACE_IR_STACK_AT(block, i);
+      bool def = i + 1 < LLACE_ARRAY_COUNT(block->stack) && LLACE_IR_IS_OP(value + 1, LLACE_IR_OP_ASSIGN);
+      if (value->kind == LLACE_IR_VALUE_VAR && !def) ++uses[value->var];
+    }
+  }
+
+  llace_array_t stmts = LLACE_NEW_ARRAY(llace_ir_stmt_t, 16);
+  llace_array_t stack = LLACE_NEW_ARRAY(llace_ir_value_t, 64);
+  llace_error_t err = LLACE_ERROR_NONE;
+  LLACE_ARRAY_FOREACH(llace_ir_basicblock_t, block, fn->blocks) {
+    if ((err = llace_ir_block_stmts(block, &stmts)) != LLACE_ERROR_NONE) break;
+    size_t size = LLACE_ARRAY_COUNT(block->stack), n = LLACE_ARRAY_COUNT(stmts);
+    const llace_ir_stmt_t *list = LLACE_ARRAY_RAW(stmts);
+
+    // fold[i]: statement whose expression replaces the variable read at stack index i
+    size_t *fold = malloc((size + 1) * sizeof(size_t));
+    bool *gone = calloc(n + 1, sizeof(bool));
+    if (fold == NULL || gone == NULL) { LLACE_LOG_FATAL("Failed to allocate fold state for '%zu' values", size); }
+    for (size_t i = 0; i < size; ++i) fold[i] = SIZE_MAX;
+
+    // Back to front, so a definition knows whether its user moves as well
+    size_t block_folds = 0;
+    for (size_t k = n; k > 0; --k) {
+      const llace_ir_stmt_t *def = &list[k - 1];
+      size_t var, len = def->end - def->begin;
+      if (len < 3 || !llace_ir_stmt_def(block, def, &var) || uses[var] != 1) continue;
+      const llace_ir_variable_t *target = LLACE_IR_VAR_AT(fn, var);
+      const llace_ir_value_t *root = LLACE_IR_STACK_AT(block, def->end - 3);
+      if (target->attr.attraw != 0 || root->kind != LLACE_IR_VALUE_INSTR || !isel_foldable(root->instr.op)) continue;
+      if (isel_has_op(block, def->begin, def->end, LLACE_IR_OP_CALL, LLACE_IR_OP_PHI)) continue;
+
+      // The single use, later in this block and outside a phi
+      size_t use = SIZE_MAX, user = k;
+      for (; user < n && use == SIZE_MAX; ++user) {
+        for (size_t i = list[user].begin; i < list[user].end; ++i) {
+          const llace_ir_value_t *value = LLACE_IR_STACK_AT(block, i);
+          if (value->kind == LLACE_IR_VALUE_VAR && value->var == var && !LLACE_IR_IS_OP(value + 1, LLACE_IR_OP_ASSIGN)) { use = i; break; }
+        }
+      }
+      // Nor into a pack, its lanes are held all at once
+      if (use == SIZE_MAX || isel_has_op(block, list[user - 1].begin, list[user - 1].end, LLACE_IR_OP_PHI, LLACE_IR_OP_PACK)) continue;
+
+      // A load must not move past a store or call, nor ride along with a user that moves again
+      if (isel_has_op(block, def->begin, def->end, LLACE_IR_OP_LOAD, LLACE_IR_OP_LOAD)) {
+        if (gone[user - 1] || isel_has_op(block, def->end, list[user - 1].end, LLACE_IR_OP_STORE, LLACE_IR_OP_CALL)) continue;
+      }
+
+      fold[use] = k - 1;
+      gone[k - 1] = true;
+      ++block_folds;
+    }
+
+    if (block_folds > 0) {
+      stack.element_count = 0;
+      for (size_t k = 0; k < n; ++k) {
+        if (!gone[k]) isel_splice(block, fold, list, list[k].begin, list[k].end, &stack);
+      }
+      block->stack.element_count = 0;
+      LLACE_ARRAY_PUSHA(block->stack, LLACE_ARRAY_RAW(stack), LLACE_ARRAY_COUNT(stack));
+      count += block_folds;
+    }
+
+    free(fold);
+    free(gone);
+  }
+
+  if (folded) *folded = count;
+  LLACE_FREE_ARRAY(stmts);
+  LLACE_FREE_ARRAY(stack);
+  free(uses);
+  return err;
+}
+
+// ================ Scalarizing ================ //
+
+#define ISEL_MAX_LANES 64
+
+typedef struct {
+  size_t node;
+  llace_ir_value_t value;
+} isel_extract_t;
+
+typedef struct {
+  const llace_ir_context_t *ctx;
+  llace_ir_function_t *fn;
+  llace_isel_tree_t tree;  // of the statement being rewritten
+  llace_array_t out;       // llace_ir_value_t, the rewritten block
+  llace_array_t extracts;  // isel_extract_t, lanes the extracts of the statement read
+  size_t *first;           // first lane variable per vector variable, SIZE_MAX for scalars
+  size_t var_count;        // variables before scalarizing
+  size_t temps;
+} isel_scalar_t;
+
+typedef struct {
+  size_t begin, end; // stack range of the lane within the statement
+  size_t var;
+} isel_hoist_t;
+
+static bool isel_is_vector(const isel_scalar_t *s, const llace_ir_value_t *value) {
+  switch (value->kind) {
+  case LLACE_IR_VALUE_VAR: return value->var < s->var_count && s->first[value->var] != SIZE_MAX;
+  case LLACE_IR_VALUE_CONST: return LLACE_IR_IS_VEC(value->type);
+  case LLACE_IR_VALUE_INSTR:
+    if (value->instr.op == LLACE_IR_OP_CALL) return false; // lanes shares the callee
+    return value->instr.lanes > 0 || value->instr.op == LLACE_IR_OP_EXTRACT;
+  default: return false;
+  }
+}
+
+static size_t isel_temp(isel_scalar_t *s, llace_ir_type_t type, size_t depth) {
+  char name[32];
+  size_t index;
+  snprintf(name, sizeof(name), "lane.%zu", s->temps++);
+  llace_ir_variable_new(s->fn, name, type, (llace_ir_typeattr_t){ .depth = depth }, &index);
+  return index;
+}
+
+static void isel_assign(isel_scalar_t *s, size_t var) {
+  LLACE_ARRAY_PUSH(s->out, LLACE_IR_VAR(var));
+  LLACE_ARRAY_PUSH(s->out, LLACE_IR_OP(LLACE_IR_OP_ASSIGN, 2, 0));
+}
+
+// Address of lane l from the address of lane 0
+static void isel_lane_address(isel_scalar_t *s, const llace_ir_value_t *addr, size_t l) {
+  LLACE_ARRAY_PUSHP(s->out, addr);
+  if (l > 0) {
+    LLACE_ARRAY_PUSH(s->out, LLACE_IR_CONST_INT(LLACE_IR_INT(32), (int64_t)l));
+    LLACE_ARRAY_PUSH(s->out, LLACE_IR_OP(LLACE_IR_OP_INDEX, 2, 1));
+  }
+}
+
+static llace_error_t isel_scalar_vector(isel_scalar_t *s, size_t n, size_t into, llace_ir_value_t *lanes);
+
+// Push a scalar expression, extracts read the lanes isel_scalar_prepare computed
+static llace_error_t isel_scalar_expr(isel_scalar_t *s, size_t n) {
+  const llace_isel_node_t *node = LLACE_ISEL_NODE(&s->tree, n);
+  if (node->op == LLACE_IR_OP_EXTRACT) {
+    LLACE_ARRAY_FOREACH(isel_extract_t, x, s->extracts) {
+      if (x->node == n) {
+        LLACE_ARRAY_PUSHP(s->out, &x->value);
+        return LLACE_ERROR_NONE;
+      }
+    }
+  }
+  if (isel_is_vector(s, node->value)) return LLACE_ERROR_INVLTYPE; // a vector reaching a call, return or comparison
+
+  for (size_t k = 0; k < node->count; ++k) LLACE_RUNCHECK(isel_scalar_expr(s, LLACE_ISEL_KID(&s->tree, node, k)));
+  LLACE_ARRAY_PUSHP(s->out, node->value);
+  return LLACE_ERROR_NONE;
+}
+
+// Lanes of every extract under the node, computed ahead of the statement
+static llace_error_t isel_scalar_prepare(isel_scalar_t *s, size_t n) {
+  const llace_isel_node_t *node = LLACE_ISEL_NODE(&s->tree, n);
+  if (node->op != LLACE_IR_OP_EXTRACT) {
+    for (size_t k = 0; k < node->count; ++k) LLACE_RUNCHECK(isel_scalar_prepare(s, LLACE_ISEL_KID(&s->tree, node, k)));
+    return LLACE_ERROR_NONE;
+  }
+
+  size_t from = LLACE_ISEL_KID(&s->tree, node, 0);
+  const llace_isel_node_t *lane = LLACE_ISEL_NODE(&s->tree, LLACE_ISEL_KID(&s->tree, node, 1));
+  size_t count = LLACE_ISEL_NODE(&s->tree, from)->type.lanes;
+  if (lane->op != LLACE_ISEL_CONST || lane->value->_int < 0 || (size_t)lane->value->_int >= count) return LLACE_ERROR_INVLTYPE;
+
+  llace_ir_value_t lanes[ISEL_MAX_LANES];
+  LLACE_RUNCHECK(isel_scalar_vector(s, from, SIZE_MAX, lanes));
+  isel_extract_t x = { .node = n, .value = lanes[lane->value->_int] };
+  LLACE_ARRAY_PUSHP(s->extracts, &x);
+  return LLACE_ERROR_NONE;
+}
+
+// A leaf holding the value of a scalar node, anything else is computed into a temporary first
+static llace_error_t isel_scalar_leaf(isel_scalar_t *s, size_t n, llace_ir_value_t *leaf) {
+  const llace_isel_node_t *node = LLACE_ISEL_NODE(&s->tree, n);
+  if (isel_is_vector(s, node->value) && node->op != LLACE_IR_OP_EXTRACT) return LLACE_ERROR_INVLTYPE;
+  if (node->op == LLACE_ISEL_CONST || node->op == LLACE_ISEL_VAR || node->op == LLACE_ISEL_GLOBAL) {
+    *leaf = *node->value;
+    return LLACE_ERROR_NONE;
+  }
+
+  LLACE_RUNCHECK(isel_scalar_prepare(s, n));
+  LLACE_RUNCHECK(isel_scalar_expr(s, n));
+  size_t temp = isel_temp(s, node->type, node->depth);
+  isel_assign(s, temp);
+  *leaf = LLACE_IR_VAR(temp);
+  return LLACE_ERROR_NONE;
+}
+
+// Scalar leaves for every lane of a vector node, written to the lane variables from into unless SIZE_MAX.
+// Lane l only ever reads lane l of its operands, so into may be one of them.
+static llace_error_t isel_scalar_vector(isel_scalar_t *s, size_t n, size_t into, llace_ir_value_t *lanes) {
+  const llace_isel_node_t *node = LLACE_ISEL_NODE(&s->tree, n);
+  size_t count = node->type.lanes;
+  llace_ir_type_t element = llace_ir_type_vec(node->type, 0);
+  if (count == 0 || count > ISEL_MAX_LANES) return LLACE_ERROR_INVLTYPE;
+
+  switch (node->op) {
+  case LLACE_ISEL_VAR:
+    for (size_t l = 0; l < count; ++l) lanes[l] = LLACE_IR_VAR(s->first[node->value->var] + l);
+    break;
+  case LLACE_IR_OP_SPLAT:
+    LLACE_RUNCHECK(isel_scalar_leaf(s, LLACE_ISEL_KID(&s->tree, node, 0), &lanes[0]));
+    for (size_t l = 1; l < count; ++l) lanes[l] = lanes[0];
+    break;
+  case LLACE_IR_OP_PACK:
+    for (size_t l = 0; l < count; ++l) LLACE_RUNCHECK(isel_scalar_leaf(s, LLACE_ISEL_KID(&s->tree, node, l), &lanes[l]));
+    break;
+  case LLACE_IR_OP_LOAD: {
+    llace_ir_value_t addr;
+    LLACE_RUNCHECK(isel_scalar_leaf(s, LLACE_ISEL_KID(&s->tree, node, 0), &addr));
+    for (size_t l = 0; l < count; ++l) {
+      size_t var = into != SIZE_MAX ? into + l : isel_temp(s, element, node->depth);
+      isel_lane_address(s, &addr, l);
+      LLACE_ARRAY_PUSH(s->out, LLACE_IR_OP(LLACE_IR_OP_LOAD, 1, 1));
+      isel_assign(s, var);
+      lanes[l] = LLACE_IR_VAR(var);
+    }
+    return LLACE_ERROR_NONE;
+  }
+  default: {
+    // Lane-wise arithmetic, a scalar operand is the same in every lane
+    if (node->op < LLACE_IR_OP_ADD || node->op > LLACE_IR_OP_SHR) return LLACE_ERROR_INVLTYPE;
+    llace_ir_value_t kids[2][ISEL_MAX_LANES];
+    for (size_t k = 0; k < 2; ++k) {
+      size_t kid = LLACE_ISEL_KID(&s->tree, node, k);
+      size_t lanes_in = LLACE_ISEL_NODE(&s->tree, kid)->type.lanes;
+      if (lanes_in == 0) {
+        LLACE_RUNCHECK(isel_scalar_leaf(s, kid, &kids[k][0]));
+        for (size_t l = 1; l < count; ++l) kids[k][l] = kids[k][0];
+      } else if (lanes_in != count) {
+        return LLACE_ERROR_INVLTYPE;
+      } else {
+        LLACE_RUNCHECK(isel_scalar_vector(s, kid, SIZE_MAX, kids[k]));
+      }
+    }
+
+    llace_ir_value_t op = *node->value;
+    op.instr.lanes = 0;
+    for (size_t l = 0; l < count; ++l) {
+      size_t var = into != SIZE_MAX ? into + l : isel_temp(s, element, 0);
+      LLACE_ARRAY_PUSHP(s->out, &kids[0][l]);
+      LLACE_ARRAY_PUSHP(s->out, &kids[1][l]);
+      LLACE_ARRAY_PUSHP(s->out, &op);
+      isel_assign(s, var);
+      lanes[l] = LLACE_IR_VAR(var);
+    }
+    return LLACE_ERROR_NONE;
+  }
+  }
+
+  // Variables, splats and packs give existing leaves, copied when they have a destination
+  if (into != SIZE_MAX) {
+    for (size_t l = 0; l < count; ++l) {
+      LLACE_ARRAY_PUSHP(s->out, &lanes[l]);
+      isel_assign(s, into + l);
+      lanes[l] = LLACE_IR_VAR(into + l);
+    }
+  }
+  return LLACE_ERROR_NONE;
+}
+
+// A vector phi becomes one phi per lane
+static llace_error_t isel_scalar_phi(isel_scalar_t *s, const llace_ir_basicblock_t *block, const llace_ir_stmt_t *stmt) {
+  size_t def;
+  llace_ir_stmt_def(block, stmt, &def);
+  if (!isel_is_vector(s, &LLACE_IR_VAR(def))) return LLACE_ERROR_INVLTYPE;
+  llace_ir_type_t type = LLACE_IR_VAR_AT(s->fn, def)->type;
+
+  for (size_t l = 0; l < type.lanes; ++l) {
+    for (size_t i = stmt->begin; i < stmt->end - 2; ++i) {
+      llace_ir_value_t value = *LLACE_IR_STACK_AT(block, i);
+      if (value.kind == LLACE_IR_VALUE_VAR) {
+        if (!isel_is_vector(s, &value) || !llace_ir_type_eq(LLACE_IR_VAR_AT(s->fn, value.var)->type, type)) return LLACE_ERROR_INVLTYPE;
+        value = LLACE_IR_VAR(s->first[value.var] + l);
+      } else if (value.kind != LLACE_IR_VALUE_BLOCK && value.kind != LLACE_IR_VALUE_INSTR) {
+        return LLACE_ERROR_INVLTYPE;
+      }
+      LLACE_ARRAY_PUSHP(s->out, &value);
+    }
+    isel_assign(s, s->first[def] + l);
+  }
+  return LLACE_ERROR_NONE;
+}
+
+static llace_error_t isel_scalar_stmt(isel_scalar_t *s, const llace_ir_basicblock_t *block, const llace_ir_stmt_t *stmt, bool *changed) {
+  *changed = false;
+  for (size_t i = stmt->begin; i < stmt->end && !*changed; ++i) *changed = isel_is_vector(s, LLACE_IR_STACK_AT(block, i));
+  if (!*changed) {
+    LLACE_ARRAY_PUSHA(s->out, LLACE_IR_STACK_AT(block, stmt->begin), stmt->end - stmt->begin);
+    return LLACE_ERROR_NONE;
+  }
+
+  s->extracts.element_count = 0;
+  LLACE_RUNCHECK(llace_isel_tree_build(s->ctx, s->fn, block, stmt, &s->tree));
+  if (LLACE_ARRAY_IS_EMPTY(s->tree.nodes)) return isel_scalar_phi(s, block, stmt);
+
+  size_t root = LLACE_ISEL_ROOT(&s->tree);
+  const llace_isel_node_t *node = LLACE_ISEL_NODE(&s->tree, root);
+  llace_ir_value_t lanes[ISEL_MAX_LANES];
+  if (node->op == LLACE_IR_OP_ASSIGN) {
+    size_t from = LLACE_ISEL_KID(&s->tree, node, 0);
+    const llace_isel_node_t *dst = LLACE_ISEL_NODE(&s->tree, LLACE_ISEL_KID(&s->tree, node, 1));
+    if (isel_is_vector(s, dst->value)) {
+      if (LLACE_ISEL_NODE(&s->tree, from)->type.lanes != dst->type.lanes) return LLACE_ERROR_INVLTYPE;
+      return isel_scalar_vector(s, from, s->first[dst->value->var], lanes);
+    }
+  }
+
+  // Every lane is stored once all of them are computed, as the one vector store would
+  if (node->op == LLACE_IR_OP_STORE && node->value->instr.lanes > 0) {
+    size_t from = LLACE_ISEL_KID(&s->tree, node, 0);
+    size_t count = node->value->instr.lanes;
+    llace_ir_value_t addr;
+    if (LLACE_ISEL_NODE(&s->tree, from)->type.lanes != count) return LLACE_ERROR_INVLTYPE;
+    LLACE_RUNCHECK(isel_scalar_vector(s, from, SIZE_MAX, lanes));
+    LLACE_RUNCHECK(isel_scalar_leaf(s, LLACE_ISEL_KID(&s->tree, node, 1), &addr));
+    for (size_t l = 0; l < count; ++l) {
+      LLACE_ARRAY_PUSHP(s->out, &lanes[l]);
+      isel_lane_address(s, &addr, l);
+      LLACE_ARRAY_PUSH(s->out, LLACE_IR_OP(LLACE_IR_OP_STORE, 2, 0));
+    }
+    return LLACE_ERROR_NONE;
+  }
+
+  // Scalar statements reading lanes
+  LLACE_RUNCHECK(isel_scalar_prepare(s, root));
+  return isel_scalar_expr(s, root);
+}
+
+// ================ Keeping vectors ================ //
+
+static bool isel_keep_cost(const llace_target_t *target, const llace_isel_node_t *node, llace_ir_type_t type) {
+  return llace_ir_value_cost(target, node->value, llace_ir_type_vec(type, 0), type.lanes) != LLACE_COST_UNSUPPORTED;
+}
+
+// Whether the target selects the subtree with its vectors whole
+static bool isel_keep_node(const llace_target_t *target, const llace_isel_tree_t *tree, size_t n, bool in_pack) {
+  const llace_isel_node_t *node = LLACE_ISEL_NODE(tree, n), *kid[2] = { NULL, NULL };
+  for (size_t k = 0; k < node->count; ++k) {
+    if (k < 2) kid[k] = LLACE_ISEL_NODE(tree, LLACE_ISEL_KID(tree, node, k));
+    if (!isel_keep_node(target, tree, LLACE_ISEL_KID(tree, node, k), in_pack || node->op == LLACE_IR_OP_PACK)) return false;
+  }
+
+  bool vector = LLACE_IR_IS_VEC(node->type);
+  if (vector && node->depth != 0) return false;
+  switch (node->op) {
+  case LLACE_ISEL_CONST: return !vector;
+  case LLACE_ISEL_VAR: case LLACE_ISEL_GLOBAL: case LLACE_ISEL_BLOCK: return true;
+  case LLACE_IR_OP_CALL: return false; // no vector register survives it
+  case LLACE_IR_OP_ADD: case LLACE_IR_OP_SUB: case LLACE_IR_OP_MUL: case LLACE_IR_OP_DIV:
+  case LLACE_IR_OP_AND: case LLACE_IR_OP_OR: case LLACE_IR_OP_XOR:
+    if (!vector) break;
+    return llace_ir_type_eq(kid[0]->type, node->type) && llace_ir_type_eq(kid[1]->type, node->type) && isel_keep_cost(target, node, node->type);
+  case LLACE_IR_OP_SPLAT: case LLACE_IR_OP_PACK:
+    if (in_pack && node->op == LLACE_IR_OP_PACK) return false;
+    for (size_t k = 0; k < node->count; ++k) {
+      const llace_isel_node_t *lane = LLACE_ISEL_NODE(tree, LLACE_ISEL_KID(tree, node, k));
+      if (LLACE_IR_IS_VEC(lane->type) || lane->depth != 0) return false;
+    }
+    return isel_keep_cost(target, node, node->type);
+  case LLACE_IR_OP_LOAD:
+    if (!vector) break;
+    return isel_keep_cost(target, node, node->type);
+  case LLACE_IR_OP_EXTRACT:
+    return LLACE_IR_IS_VEC(kid[0]->type) && kid[1]->op == LLACE_ISEL_CONST && kid[1]->value->_int >= 0 &&
+           (size_t)kid[1]->value->_int < kid[0]->type.lanes && isel_keep_cost(target, node, kid[0]->type);
+  case LLACE_IR_OP_STORE:
+    if (node->value->instr.lanes == 0) break;
+    return kid[0]->type.lanes == node->value->instr.lanes && !LLACE_IR_IS_VEC(kid[1]->type) && isel_keep_cost(target, node, kid[0]->type);
+  case LLACE_IR_OP_ASSIGN:
+    if (!LLACE_IR_IS_VEC(kid[1]->type)) break;
+    return llace_ir_type_eq(kid[0]->type, kid[1]->type);
+  default: break;
+  }
+
+  // Scalar operations take no vectors
+  if (vector) return false;
+  for (size_t k = 0; k < node->count; ++k) {
+    if (LLACE_IR_IS_VEC(LLACE_ISEL_NODE(tree, LLACE_ISEL_KID(tree, node, k))->type)) return false;
+  }
+  return true;
+}
+
+// Whether every vector of the function is one the target selects
+static bool isel_keeps(isel_scalar_t *s, const llace_target_t *target, llace_array_t *stmts) {
+  for (size_t v = 0; v < s->var_count; ++v) {
+    const llace_ir_variable_t *var = LLACE_IR_VAR_AT(s->fn, v);
+    if (!LLACE_IR_IS_VEC(var->type)) continue;
+    llace_ir_type_t element = llace_ir_type_vec(var->type, 0);
+    if (var->attr.depth != 0 || llace_target_cost(target, LLACE_COST_LOAD, llace_ir_type_bits(element), var->type.lanes,
+                                                  element.kind == LLACE_IR_TYPE_FLOAT) == LLACE_COST_UNSUPPORTED) {
+      return false;
+    }
+  }
+
+  LLACE_ARRAY_FOREACH(llace_ir_basicblock_t, block, s->fn->blocks) {
+    if (llace_ir_block_stmts(block, stmts) != LLACE_ERROR_NONE) return false;
+    LLACE_ARRAY_FOREACH(llace_ir_stmt_t, stmt, *stmts) {
+      bool vector = false;
+      for (size_t i = stmt->begin; i < stmt->end; ++i) {
+        const llace_ir_value_t *value = LLACE_IR_STACK_AT(block, i);
+        if (value->kind == LLACE_IR_VALUE_CONST && LLACE_IR_IS_VEC(value->type)) return false;
+        vector |= isel_is_vector(s, value);
+      }
+      if (!vector) continue;
+      if (llace_isel_tree_build(s->ctx, s->fn, block, stmt, &s->tree) != LLACE_ERROR_NONE) return false;
+      if (LLACE_ARRAY_IS_EMPTY(s->tree.nodes)) continue; // a phi, moved whole by register allocation
+
+      size_t root = LLACE_ISEL_ROOT(&s->tree);
+      if (LLACE_IR_IS_VEC(LLACE_ISEL_NODE(&s->tree, root)->type) || !isel_keep_node(target, &s->tree, root, false)) return false;
+    }
+  }
+  return true;
+}
+
+static size_t isel_subtree_begin(const llace_isel_tree_t *tree, size_t n) {
+  const llace_isel_node_t *node = LLACE_ISEL_NODE(tree, n);
+  return node->count == 0 ? n : isel_subtree_begin(tree, LLACE_ISEL_KID(tree, node, 0));
+}
+
+// Pack lanes other than variables and integer constants are computed into temporaries ahead of the statement
+static llace_error_t isel_keep_stmt(isel_scalar_t *s, const llace_ir_basicblock_t *block, const llace_ir_stmt_t *stmt, llace_array_t *hoists,
+                                    bool *changed) {
+  hoists->element_count = 0;
+  *changed = false;
+  if (!isel_has_op(block, stmt->begin, stmt->end, LLACE_IR_OP_PACK, LLACE_IR_OP_PACK)) {
+    LLACE_ARRAY_PUSHA(s->out, LLACE_IR_STACK_AT(block, stmt->begin), stmt->end - stmt->begin);
+    return LLACE_ERROR_NONE;
+  }
+  LLACE_RUNCHECK(llace_isel_tree_build(s->ctx, s->fn, block, stmt, &s->tree));
+  for (size_t n = 0; n < LLACE_ARRAY_COUNT(s->tree.nodes); ++n) {
+    const llace_isel_node_t *node = LLACE_ISEL_NODE(&s->tree, n);
+    if (node->op != LLACE_IR_OP_PACK) continue;
+    for (size_t k = 0; k < node->count; ++k) {
+      size_t kid = LLACE_ISEL_KID(&s->tree, node, k);
+      const llace_isel_node_t *lane = LLACE_ISEL_NODE(&s->tree, kid);
+      if (lane->op == LLACE_ISEL_VAR || (lane->op == LLACE_ISEL_CONST && lane->type.kind == LLACE_IR_TYPE_INT)) continue;
+
+      isel_hoist_t hoist = { .begin = stmt->begin + isel_subtree_begin(&s->tree, kid), .end = stmt->begin + kid + 1 };
+      LLACE_ARRAY_PUSHA(s->out, LLACE_IR_STACK_AT(block, hoist.begin), hoist.end - hoist.begin);
+      hoist.var = isel_temp(s, lane->type, lane->depth);
+      isel_assign(s, hoist.var);
+      LLACE_ARRAY_PUSHP(*hoists, &hoist);
+    }
+  }
+
+  // Lanes are disjoint and in stack order
+  *changed = !LLACE_ARRAY_IS_EMPTY(*hoists);
+  size_t next = 0;
+  for (size_t i = stmt->begin; i < stmt->end; ++i) {
+    const isel_hoist_t *hoist = next < LLACE_ARRAY_COUNT(*hoists) ? LLACE_ARRAY_GET(isel_hoist_t, *hoists, next) : NULL;
+    if (hoist && hoist->begin == i) {
+      LLACE_ARRAY_PUSH(s->out, LLACE_IR_VAR(hoist->var));
+      i = hoist->end - 1;
+      ++next;
+    } else {
+      LLACE_ARRAY_PUSHP(s->out, LLACE_IR_STACK_AT(block, i));
+    }
+  }
+  return LLACE_ERROR_NONE;
+}
+
+llace_error_t llace_isel_scalarize(const llace_ir_context_t *ctx, llace_ir_function_t *fn, const llace_target_t *target, size_t *scalarized) {
+  LLACE_PROFILE_SCOPE("isel.scalarize");
+  LLACE_MEM_SCOPE(LLACE_MEM_CODEGEN);
+  if (scalarized) *scalarized = 0;
+  isel_scalar_t s = { .ctx = ctx, .fn = fn, .var_count = LLACE_ARRAY_COUNT(fn->vars) };
+  s.first = malloc((s.var_count + 1) * sizeof(size_t));
+  if (s.first == NULL) { LLACE_LOG_FATAL("Failed to allocate lanes for '%zu' variables", s.var_count); }
+
+  // Functions without vectors are left alone
+  bool any = false;
+  for (size_t v = 0; v < s.var_count; ++v) {
+    s.first[v] = LLACE_IR_IS_VEC(LLACE_IR_VAR_AT(fn, v)->type) ? 0 : SIZE_MAX;
+    any |= s.first[v] != SIZE_MAX;
+  }
+  LLACE_ARRAY_FOREACH(llace_ir_basicblock_t, block, fn->blocks) {
+    LLACE_ARRAY_FOREACH(llace_ir_value_t, value, block->stack) any |= isel_is_vector(&s, value);
+  }
+  if (!any) {
+    free(s.first);
+    return LLACE_ERROR_NONE;
+  }
+
+  // Vectors cross calls in no register the ABI knows of
+  bool passed = LLACE_IR_IS_VEC(fn->ret);
+  for (size_t v = 0; v < fn->param_count; ++v) passed |= s.first[v] != SIZE_MAX;
+  if (passed) {
+    free(s.first);
+    return LLACE_ERROR_INVLTYPE;
+  }
+
+  llace_isel_tree_init(&s.tree);
+  s.out = LLACE_NEW_ARRAY(llace_ir_value_t, 64);
+  s.extracts = LLACE_NEW_ARRAY(isel_extract_t, 4);
+  llace_array_t stmts = LLACE_NEW_ARRAY(llace_ir_stmt_t, 16);
+  llace_array_t hoists = LLACE_NEW_ARRAY(isel_hoist_t, 4);
+  bool keep = target != NULL && isel_keeps(&s, target, &stmts);
+
+  // One scalar variable per lane, named after the vector and its lane
+  for (size_t v = 0; v < s.var_count && !keep; ++v) {
+    if (s.first[v] == SIZE_MAX) continue;
+    llace_ir_type_t type = LLACE_IR_VAR_AT(fn, v)->type;
+    for (size_t l = 0; l < type.lanes; ++l) {
+      char name[256];
+      size_t index;
+      snprintf(name, sizeof(name), "%.200s.%zu", LLACE_IR_VAR_AT(fn, v)->name, l);
+      llace_ir_variable_new(fn, name, llace_ir_type_vec(type, 0), (llace_ir_typeattr_t){0}, &index);
+      if (l == 0) s.first[v] = index;
+    }
+  }
+
+  llace_error_t err = LLACE_ERROR_NONE;
+  size_t count = 0;
+  for (size_t b = 0; b < LLACE_ARRAY_COUNT(fn->blocks) && err == LLACE_ERROR_NONE; ++b) {
+    llace_ir_basicblock_t *block = LLACE_IR_BLOCK_AT(fn, b);
+    if ((err = llace_ir_block_stmts(block, &stmts)) != LLACE_ERROR_NONE) break;
+    size_t block_count = 0;
+    s.out.element_count = 0;
+    for (size_t k = 0; k < LLACE_ARRAY_COUNT(stmts) && err == LLACE_ERROR_NONE; ++k) {
+      bool changed;
+      const llace_ir_stmt_t *stmt = LLACE_ARRAY_GET(llace_ir_stmt_t, stmts, k);
+      err = keep ? isel_keep_stmt(&s, block, stmt, &hoists, &changed) : isel_scalar_stmt(&s, block, stmt, &changed);
+      block_count += changed;
+    }
+
+    if (err == LLACE_ERROR_NONE && block_count > 0) {
+      block->stack.element_count = 0;
+      LLACE_ARRAY_PUSHA(block->stack, LLACE_ARRAY_RAW(s.out), LLACE_ARRAY_COUNT(s.out));
+      count += block_count;
+    }
+  }
+
+  if (scalarized) *scalarized = keep ? 0 : count;
+  LLACE_FREE_ARRAY(hoists);
+  LLACE_FREE_ARRAY(stmts);
+  LLACE_FREE_ARRAY(s.extracts);
+  LLACE_FREE_ARRAY(s.out);
+  llace_isel_tree_free(&s.tree);
+  free(s.first);
+  return err;
+}
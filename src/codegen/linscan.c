@@ -0,0 +1,254 @@
+#include <llace/detail/regalloc.h>
+
+// ================ Worklists ================ //
+
+typedef struct {
+  llace_ra_live_t *live;
+  llace_array_t unhandled; // size_t, min heap on the interval start
+  llace_array_t active;    // size_t, holding a register at the scan position
+  llace_array_t inactive;  // size_t, holding a register but in a lifetime hole
+} ra_scan_t;
+
+#define RA_HEAP_KEY(scan, slot) LLACE_RA_START(LLACE_RA_INTERVAL((scan)->live, *LLACE_ARRAY_GET(size_t, (scan)->unhandled, (slot))))
+
+static void ra_heap_swap(ra_scan_t *scan, size_t a, size_t b) {
+  size_t *items = LLACE_ARRAY_RAW(scan->unhandled);
+  size_t tmp = items[a];
+  items[a] = items[b];
+  items[b] = tmp;
+}
+
+static void ra_heap_push(ra_scan_t *scan, size_t index) {
+  LLACE_ARRAY_PUSH(scan->unhandled, index);
+  for (size_t slot = LLACE_ARRAY_COUNT(scan->unhandled) - 1; slot > 0; slot = (slot - 1) / 2) {
+    if (RA_HEAP_KEY(scan, (slot - 1) / 2) <= RA_HEAP_KEY(scan, slot)) break;
+    ra_heap_swap(scan, slot, (slot - 1) / 2);
+  }
+}
+
+static size_t ra_heap_pop(ra_scan_t *scan) {
+  size_t count = LLACE_ARRAY_COUNT(scan->unhandled), top = *LLACE_ARRAY_FRONT(size_t, scan->unhandled);
+  ra_heap_swap(scan, 0, --count);
+  scan->unhandled.element_count = count;
+  for (size_t slot = 0;;) {
+    size_t min = slot, left = 2 * slot + 1, right = left + 1;
+    if (left < count && RA_HEAP_KEY(scan, left) < RA_HEAP_KEY(scan, min)) min = left;
+    if (right < count && RA_HEAP_KEY(scan, right) < RA_HEAP_KEY(scan, min)) min = right;
+    if (min == slot) break;
+    ra_heap_swap(scan, slot, min);
+    slot = min;
+  }
+  return top;
+}
+
+static void ra_list_remove(llace_array_t *list, size_t at) {
+  size_t *items = LLACE_ARRAY_RAW(*list);
+  items[at] = items[--list->element_count];
+}
+
+// ================ Linear Scan ================ //
+
+// Split points have to fall between statements, before the one reading at an even position
+#define RA_EVEN(pos) ((pos) & ~(size_t)1)
+
+static size_t ra_reg_at(const llace_regset_t *regs, llace_regclass_t cls, size_t machine) {
+  for (size_t r = 0; r < regs->count[cls]; ++r) {
+    if (regs->regs[cls][r] == machine) return r;
+  }
+  return SIZE_MAX;
+}
+
+// Register the interval would like: its ABI register, or the one of the interval it is copied from
+static size_t ra_hint(ra_scan_t *scan, size_t index) {
+  const llace_regset_t *regs = scan->live->regs;
+  const llace_ra_interval_t *cur = LLACE_RA_INTERVAL(scan->live, index);
+  if (cur->hint_reg >= 0) return ra_reg_at(regs, cur->cls, (size_t)cur->hint_reg);
+
+  size_t found = SIZE_MAX, start = LLACE_RA_START(cur);
+  for (size_t c = cur->hint; c != SIZE_MAX; c = LLACE_RA_INTERVAL(scan->live, c)->next) {
+    const llace_ra_interval_t *it = LLACE_RA_INTERVAL(scan->live, c);
+    if (LLACE_ARRAY_IS_EMPTY(it->ranges) || LLACE_RA_START(it) > start) break;
+    if (it->cls == cur->cls && it->loc.kind == LLACE_LOC_REG) found = ra_reg_at(regs, cur->cls, it->loc.index);
+  }
+  return found;
+}
+
+// Spill an interval from its start until right before its next use, the rest goes back to the worklist
+static void ra_spill(ra_scan_t *scan, size_t index) {
+  llace_ra_interval_t *it = LLACE_RA_INTERVAL(scan->live, index);
+  size_t start = LLACE_RA_START(it), end = LLACE_RA_END(it);
+  size_t use = llace_ra_next_use(it, start);
+  it->loc = (llace_loc_t){ .kind = LLACE_LOC_SLOT, .cls = it->cls };
+  if (use == SIZE_MAX) return;
+
+  // Starting right at a use: that one reads the slot, registers are tried again after it
+  size_t at = use > start ? RA_EVEN(use) : RA_EVEN(use) + 2;
+  if (at <= start || at >= end) return;
+  ra_heap_push(scan, llace_ra_split(scan->live, index, at));
+}
+
+static bool ra_try_free(ra_scan_t *scan, size_t index) {
+  llace_ra_live_t *live = scan->live;
+  llace_ra_interval_t *cur = LLACE_RA_INTERVAL(live, index);
+  const llace_regset_t *regs = live->regs;
+  size_t count = regs->count[cur->cls], pos = LLACE_RA_START(cur), end = LLACE_RA_END(cur);
+  size_t free_until[64];
+  for (size_t r = 0; r < count; ++r) free_until[r] = SIZE_MAX;
+
+  LLACE_ARRAY_FOREACH(size_t, a, scan->active) {
+    const llace_ra_interval_t *it = LLACE_RA_INTERVAL(live, *a);
+    if (it->cls == cur->cls) free_until[ra_reg_at(regs, it->cls, it->loc.index)] = 0;
+  }
+  LLACE_ARRAY_FOREACH(size_t, i, scan->inactive) {
+    const llace_ra_interval_t *it = LLACE_RA_INTERVAL(live, *i);
+    if (it->cls != cur->cls) continue;
+    size_t r = ra_reg_at(regs, it->cls, it->loc.index), at = llace_ra_intersect(it, cur, pos);
+    free_until[r] = LLACE_MIN(free_until[r], at);
+  }
+
+  size_t hint = ra_hint(scan, index), reg = SIZE_MAX;
+  if (hint != SIZE_MAX && free_until[hint] >= end) reg = hint;
+  for (size_t r = 0; r < count && reg == SIZE_MAX; ++r) {
+    if (free_until[r] >= end) reg = r;
+  }
+  if (reg == SIZE_MAX) {
+    // Nothing is free for the whole lifetime, take the longest and split there
+    for (size_t r = 0; r < count; ++r) {
+      if (free_until[r] > pos && (reg == SIZE_MAX || free_until[r] > free_until[reg])) reg = r;
+    }
+    if (reg == SIZE_MAX || RA_EVEN(free_until[reg]) <= pos) return false;
+    size_t child = llace_ra_split(live, index, RA_EVEN(free_until[reg]));
+    ra_heap_push(scan, child);
+    cur = LLACE_RA_INTERVAL(live, index);
+  }
+
+  cur->loc = (llace_loc_t){ .kind = LLACE_LOC_REG, .cls = cur->cls, .index = regs->regs[cur->cls][reg] };
+  return true;
+}
+
+static void ra_allocate_blocked(ra_scan_t *scan, size_t index) {
+  llace_ra_live_t *live = scan->live;
+  llace_ra_interval_t *cur = LLACE_RA_INTERVAL(live, index);
+  const llace_regset_t *regs = live->regs;
+  llace_regclass_t cls = cur->cls;
+  size_t count = regs->count[cls], pos = LLACE_RA_START(cur), end = LLACE_RA_END(cur);
+  size_t use_pos[64], block_pos[64];
+  for (size_t r = 0; r < count; ++r) use_pos[r] = block_pos[r] = SIZE_MAX;
+
+  LLACE_ARRAY_FOREACH(size_t, a, scan->active) {
+    const llace_ra_interval_t *it = LLACE_RA_INTERVAL(live, *a);
+    if (it->cls != cls) continue;
+    size_t r = ra_reg_at(regs, cls, it->loc.index);
+    if (it->var == SIZE_MAX) use_pos[r] = block_pos[r] = 0;
+    else use_pos[r] = LLACE_MIN(use_pos[r], llace_ra_next_use(it, pos));
+  }
+  LLACE_ARRAY_FOREACH(size_t, i, scan->inactive) {
+    const llace_ra_interval_t *it = LLACE_RA_INTERVAL(live, *i);
+    if (it->cls != cls) continue;
+    size_t r = ra_reg_at(regs, cls, it->loc.index), at = llace_ra_intersect(it, cur, pos);
+    if (at == SIZE_MAX) continue;
+    if (it->var == SIZE_MAX) {
+      block_pos[r] = LLACE_MIN(block_pos[r], at);
+      use_pos[r] = LLACE_MIN(use_pos[r], at);
+    } else {
+      use_pos[r] = LLACE_MIN(use_pos[r], llace_ra_next_use(it, pos));
+    }
+  }
+
+  size_t reg = 0;
+  for (size_t r = 1; r < count; ++r) {
+    if (use_pos[r] > use_pos[reg]) reg = r;
+  }
+
+  // Everyone else needs their register first: current goes to memory instead
+  size_t first_use = llace_ra_next_use(cur, pos);
+  if (count == 0 || first_use == SIZE_MAX || use_pos[reg] <= first_use || RA_EVEN(block_pos[reg]) <= pos) {
+    ra_spill(scan, index);
+    return;
+  }
+
+  cur->loc = (llace_loc_t){ .kind = LLACE_LOC_REG, .cls = cls, .index = regs->regs[cls][reg] };
+  if (block_pos[reg] < end) ra_heap_push(scan, llace_ra_split(live, index, RA_EVEN(block_pos[reg])));
+
+  // Evict the intervals holding the register where they overlap current
+  uint32_t machine = regs->regs[cls][reg];
+  for (size_t a = 0; a < LLACE_ARRAY_COUNT(scan->active);) {
+    size_t other = *LLACE_ARRAY_GET(size_t, scan->active, a);
+    llace_ra_interval_t *it = LLACE_RA_INTERVAL(live, other);
+    if (it->cls != cls || it->loc.index != machine || it->var == SIZE_MAX) { ++a; continue; }
+    ra_list_remove(&scan->active, a);
+    // Split before the statement defining current, the store runs while both are read
+    ra_spill(scan, LLACE_RA_START(it) < RA_EVEN(pos) ? llace_ra_split(live, other, RA_EVEN(pos)) : other);
+  }
+  for (size_t i = 0; i < LLACE_ARRAY_COUNT(scan->inactive);) {
+    size_t other = *LLACE_ARRAY_GET(size_t, scan->inactive, i);
+    llace_ra_interval_t *it = LLACE_RA_INTERVAL(live, other);
+    if (it->cls != cls || it->loc.index != machine || it->var == SIZE_MAX || llace_ra_intersect(it, LLACE_RA_INTERVAL(live, index), pos) == SIZE_MAX) { ++i; continue; }
+    size_t child = llace_ra_split(live, other, pos);
+    if (LLACE_ARRAY_IS_EMPTY(LLACE_RA_INTERVAL(live, child)->ranges)) { ++i; continue; }
+    ra_spill(scan, child);
+    ++i;
+  }
+}
+
+llace_error_t llace_regalloc_linear(const llace_ir_context_t *ctx, const llace_ir_function_t *fn, const llace_regset_t *regs, llace_regalloc_t *ra) {
+  if (!ctx || !fn || !regs || !ra) {
+    return LLACE_ERROR_BADARG;
+  }
+  for (size_t c = 0; c < LLACE_REGCLASS_COUNT; ++c) {
+    if (regs->count[c] > 64) return LLACE_ERROR_BADARG;
+  }
+
+  llace_ra_live_t live;
+  LLACE_RUNCHECK(llace_ra_live_build(ctx, fn, regs, &live));
+
+  ra_scan_t scan = {
+    .live = &live,
+    .unhandled = LLACE_NEW_ARRAY(size_t, live.var_count + 1),
+    .active = LLACE_NEW_ARRAY(size_t, 16),
+    .inactive = LLACE_NEW_ARRAY(size_t, 16),
+  };
+  for (size_t v = 0; v < live.var_count; ++v) {
+    llace_ra_interval_t *it = LLACE_RA_INTERVAL(&live, v);
+    if (LLACE_ARRAY_IS_EMPTY(it->ranges)) continue;
+    if (LLACE_IR_VAR_AT(fn, v)->attr.attr._volatile) {
+      it->loc = (llace_loc_t){ .kind = LLACE_LOC_SLOT, .cls = it->cls }; // every access goes to memory
+      continue;
+    }
+    ra_heap_push(&scan, v);
+  }
+  for (size_t f = live.fixed[0]; f < LLACE_ARRAY_COUNT(live.intervals); ++f) {
+    if (!LLACE_ARRAY_IS_EMPTY(LLACE_RA_INTERVAL(&live, f)->ranges)) LLACE_ARRAY_PUSH(scan.inactive, f);
+  }
+
+  while (!LLACE_ARRAY_IS_EMPTY(scan.unhandled)) {
+    size_t index = ra_heap_pop(&scan);
+    size_t pos = LLACE_RA_START(LLACE_RA_INTERVAL(&live, index));
+
+    for (size_t a = 0; a < LLACE_ARRAY_COUNT(scan.active);) {
+      size_t other = *LLACE_ARRAY_GET(size_t, scan.active, a);
+      llace_ra_interval_t *it = LLACE_RA_INTERVAL(&live, other);
+      if (LLACE_RA_END(it) <= pos) { ra_list_remove(&scan.active, a); continue; }
+      if (!llace_ra_covers(it, pos)) { ra_list_remove(&scan.active, a); LLACE_ARRAY_PUSH(scan.inactive, other); continue; }
+      ++a;
+    }
+    for (size_t i = 0; i < LLACE_ARRAY_COUNT(scan.inactive);) {
+      size_t other = *LLACE_ARRAY_GET(size_t, scan.inactive, i);
+      llace_ra_interval_t *it = LLACE_RA_INTERVAL(&live, other);
+      if (LLACE_RA_END(it) <= pos) { ra_list_remove(&scan.inactive, i); continue; }
+      if (llace_ra_covers(it, pos)) { ra_list_remove(&scan.inactive, i); LLACE_ARRAY_PUSH(scan.active, other); continue; }
+      ++i;
+    }
+
+    if (!ra_try_free(&scan, index)) ra_allocate_blocked(&scan, index);
+    if (LLACE_RA_INTERVAL(&live, index)->loc.kind == LLACE_LOC_REG) LLACE_ARRAY_PUSH(scan.active, index);
+  }
+
+  llace_ra_finish(&live, ra);
+
+  LLACE_FREE_ARRAY(scan.unhandled);
+  LLACE_FREE_ARRAY(scan.active);
+  LLACE_FREE_ARRAY(scan.inactive);
+  llace_ra_live_free(&live);
+  return LLACE_ERROR_NONE;
+}
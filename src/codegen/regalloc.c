@@ -0,0 +1,642 @@
+#include <llace/detail/regalloc.h>
+#include <llace/profile.h>
+
+// ================ Register Classes ================ //
+
+llace_regclass_t llace_regclass_of(llace_ir_type_t type, llace_ir_typeattr_t attr) {
+  if (attr.depth > 0) return LLACE_REGCLASS_GPR;
+  if (LLACE_IR_IS_VEC(type) || type.kind == LLACE_IR_TYPE_FLOAT) return LLACE_REGCLASS_VEC;
+  return LLACE_REGCLASS_GPR;
+}
+
+bool llace_loc_eq(llace_loc_t a, llace_loc_t b) {
+  if (a.kind != b.kind) return false;
+  if (a.kind == LLACE_LOC_NONE || a.kind == LLACE_LOC_CONST) return a.kind != LLACE_LOC_CONST;
+  return a.cls == b.cls && a.index == b.index;
+}
+
+// ================ Live Sets ================ //
+
+// Sparse set of variables: the bits answer membership, the list is walked instead of every variable
+typedef struct ra_set {
+  uint64_t *bits;
+  llace_array_t vars; // size_t, removed and repeated members linger until compacted
+} ra_set_t;
+
+static void ra_set_add(ra_set_t *set, size_t var) {
+  if (LLACE_BITSET_GET(set->bits, var)) return;
+  LLACE_BITSET_SET(set->bits, var);
+  LLACE_ARRAY_PUSH(set->vars, var);
+}
+
+static int ra_var_compare(const void *a, const void *b) {
+  size_t x = *(const size_t *)a, y = *(const size_t *)b;
+  return x < y ? -1 : x > y ? 1 : 0;
+}
+
+// Leaves exactly the members, ascending
+static void ra_set_compact(ra_set_t *set) {
+  size_t *vars = LLACE_ARRAY_RAW(set->vars), count = 0;
+  for (size_t i = 0; i < LLACE_ARRAY_COUNT(set->vars); ++i) {
+    if (!LLACE_BITSET_GET(set->bits, vars[i])) continue;
+    LLACE_BITSET_CLEAR(set->bits, vars[i]);
+    vars[count++] = vars[i];
+  }
+  set->vars.element_count = count;
+  for (size_t i = 0; i < count; ++i) LLACE_BITSET_SET(set->bits, vars[i]);
+  qsort(vars, count, sizeof(size_t), ra_var_compare);
+}
+
+static void ra_set_clear(ra_set_t *set) {
+  LLACE_ARRAY_FOREACH(size_t, var, set->vars) LLACE_BITSET_CLEAR(set->bits, *var);
+  set->vars.element_count = 0;
+}
+
+// Adds the ascending vars to the ascending live-in list of a block
+static void ra_live_merge(llace_array_t *in, const llace_array_t *vars, llace_array_t *scratch) {
+  const size_t *a = LLACE_ARRAY_RAW(*in), *b = LLACE_ARRAY_RAW(*vars);
+  size_t na = LLACE_ARRAY_COUNT(*in), nb = LLACE_ARRAY_COUNT(*vars), i = 0, j = 0;
+  if (nb == 0) return;
+  if (na == 0) {
+    LLACE_ARRAY_PUSHA(*in, b, nb);
+    return;
+  }
+  scratch->element_count = 0;
+  while (i < na && j < nb) {
+    size_t next = a[i] <= b[j] ? a[i] : b[j];
+    i += a[i] == next;
+    j += b[j] == next;
+    LLACE_ARRAY_PUSH(*scratch, next);
+  }
+  LLACE_ARRAY_PUSHA(*scratch, a + i, na - i);
+  LLACE_ARRAY_PUSHA(*scratch, b + j, nb - j);
+  llace_array_t tmp = *in;
+  *in = *scratch;
+  *scratch = tmp;
+}
+
+// Phi inputs a predecessor passes to block
+static void ra_phi_inputs(llace_ra_live_t *live, size_t block, size_t pred, ra_set_t *set) {
+  const llace_ir_basicblock_t *bb = LLACE_IR_BLOCK_AT(live->fn, block);
+  LLACE_ARRAY_FOREACH(llace_ir_value_t, value, bb->stack) {
+    if (!LLACE_IR_IS_OP(value, LLACE_IR_OP_PHI)) continue;
+    const llace_ir_value_t *pairs = value - value->instr.in;
+    for (size_t p = 0; p < value->instr.in; p += 2) {
+      if (pairs[p + 1].block == pred && pairs[p].kind == LLACE_IR_VALUE_VAR) ra_set_add(set, pairs[p].var);
+    }
+  }
+}
+
+// ================ Live Intervals ================ //
+
+// Ranges are collected backwards, the lowest range is the last one until the build reverses them
+static void ra_add_range(llace_ra_interval_t *it, size_t from, size_t to) {
+  while (!LLACE_ARRAY_IS_EMPTY(it->ranges)) {
+    llace_ra_range_t *low = LLACE_ARRAY_BACK(llace_ra_range_t, it->ranges);
+    if (low->from > to || from > low->to) break;
+    from = LLACE_MIN(from, low->from);
+    to = LLACE_MAX(to, low->to);
+    --it->ranges.element_count;
+  }
+  llace_ra_range_t range = { from, to };
+  LLACE_ARRAY_PUSHP(it->ranges, &range);
+}
+
+// Definitions cut the range opened by the uses below them, dead ones still need a register to write
+static void ra_set_from(llace_ra_interval_t *it, size_t from, bool live) {
+  if (!live) {
+    ra_add_range(it, from, from + 1);
+    return;
+  }
+  LLACE_ARRAY_BACK(llace_ra_range_t, it->ranges)->from = from;
+}
+
+static void ra_reverse(llace_array_t *array, size_t size) {
+  char tmp[sizeof(llace_ra_range_t)];
+  size_t count = LLACE_ARRAY_COUNT(*array);
+  char *data = LLACE_ARRAY_RAW(*array);
+  for (size_t i = 0; i < count / 2; ++i) {
+    memcpy(tmp, data + i * size, size);
+    memcpy(data + i * size, data + (count - 1 - i) * size, size);
+    memcpy(data + (count - 1 - i) * size, tmp, size);
+  }
+}
+
+static llace_ra_interval_t ra_interval_new(size_t var, llace_regclass_t cls) {
+  return (llace_ra_interval_t){
+    .var = var,
+    .cls = cls,
+    .ranges = LLACE_NEW_ARRAY(llace_ra_range_t, 2),
+    .uses = LLACE_NEW_ARRAY(size_t, 4),
+    .hint = SIZE_MAX,
+    .hint_reg = -1,
+    .next = SIZE_MAX,
+  };
+}
+
+llace_error_t llace_ra_live_build(const llace_ir_context_t *ctx, const llace_ir_function_t *fn, const llace_regset_t *regs, llace_ra_live_t *live) {
+  if (!ctx || !fn || !regs || !live) {
+    return LLACE_ERROR_BADARG;
+  }
+  if (LLACE_ARRAY_IS_EMPTY(fn->blocks)) {
+    return LLACE_ERROR_INVLFUNC;
+  }
+
+  *live = (llace_ra_live_t){ .fn = fn, .regs = regs, .var_count = LLACE_ARRAY_COUNT(fn->vars) };
+  LLACE_RUNCHECK(llace_ir_cfg_build(fn, &live->cfg));
+  LLACE_RUNCHECK(llace_ir_loops_build(&live->cfg, &live->loops));
+
+  size_t block_count = LLACE_ARRAY_COUNT(fn->blocks);
+  live->order = LLACE_NEW_ARRAY(size_t, block_count);
+  live->from = LLACE_NEW_ARRAY(size_t, block_count);
+  live->to = LLACE_NEW_ARRAY(size_t, block_count);
+  live->live_in = LLACE_NEW_ARRAY(llace_array_t, block_count);
+  live->intervals = LLACE_NEW_ARRAY(llace_ra_interval_t, live->var_count * 2 + 32);
+  live->copies = LLACE_NEW_ARRAY(llace_ra_copy_t, 8);
+
+  // Number the positions in reverse post order
+  llace_array_t stmts = LLACE_NEW_ARRAY(llace_ir_stmt_t, 16);
+  size_t none = SIZE_MAX, pos = 0;
+  for (size_t b = 0; b < block_count; ++b) {
+    LLACE_ARRAY_PUSH(live->from, none);
+    LLACE_ARRAY_PUSH(live->to, none);
+    LLACE_ARRAY_PUSH(live->live_in, LLACE_NEW_ARRAY(size_t, 0));
+  }
+  LLACE_ARRAY_FOREACH(size_t, b, live->cfg.rpo) {
+    llace_ir_block_stmts(LLACE_IR_BLOCK_AT(fn, *b), &stmts);
+    LLACE_ARRAY_PUSH(live->order, *b);
+    *LLACE_ARRAY_GET(size_t, live->from, *b) = pos;
+    pos += 2 * (LLACE_ARRAY_COUNT(stmts) + 1);
+    *LLACE_ARRAY_GET(size_t, live->to, *b) = pos;
+  }
+  live->end = pos;
+  live->block_start = LLACE_BITSET_NEW(pos + 1);
+  LLACE_ARRAY_FOREACH(size_t, b, live->order) LLACE_BITSET_SET(live->block_start, *LLACE_ARRAY_GET(size_t, live->from, *b));
+
+  // One interval per variable, then one fixed interval per allocatable register
+  for (size_t v = 0; v < live->var_count; ++v) {
+    const llace_ir_variable_t *var = LLACE_IR_VAR_AT(fn, v);
+    llace_ra_interval_t it = ra_interval_new(v, llace_regclass_of(var->type, var->attr));
+    LLACE_ARRAY_PUSHP(live->intervals, &it);
+  }
+  for (size_t c = 0; c < LLACE_REGCLASS_COUNT; ++c) {
+    live->fixed[c] = LLACE_ARRAY_COUNT(live->intervals);
+    for (size_t r = 0; r < regs->count[c]; ++r) {
+      llace_ra_interval_t it = ra_interval_new(SIZE_MAX, (llace_regclass_t)c);
+      it.loc = (llace_loc_t){ .kind = LLACE_LOC_REG, .cls = (llace_regclass_t)c, .index = regs->regs[c][r] };
+      LLACE_ARRAY_PUSHP(live->intervals, &it);
+    }
+  }
+
+  // Parameters prefer the registers they arrive in
+  size_t args[LLACE_REGCLASS_COUNT] = {0};
+  for (size_t v = 0; v < fn->param_count && v < live->var_count; ++v) {
+    llace_ra_interval_t *it = LLACE_RA_INTERVAL(live, v);
+    if (args[it->cls] < regs->arg_count[it->cls]) it->hint_reg = regs->args[it->cls][args[it->cls]];
+    ++args[it->cls];
+  }
+
+  // The loop each block heads, SIZE_MAX if none
+  llace_array_t heads = LLACE_NEW_ARRAY(size_t, block_count);
+  for (size_t b = 0; b < block_count; ++b) LLACE_ARRAY_PUSH(heads, none);
+  for (size_t l = 0; l < LLACE_ARRAY_COUNT(live->loops.loops); ++l) *LLACE_ARRAY_GET(size_t, heads, LLACE_IR_LOOP_AT(&live->loops, l)->header) = l;
+
+  ra_set_t set = { LLACE_BITSET_NEW(live->var_count), LLACE_NEW_ARRAY(size_t, 16) };
+  llace_array_t scratch = LLACE_NEW_ARRAY(size_t, 16);
+  for (size_t n = LLACE_ARRAY_COUNT(live->order); n > 0; --n) {
+    size_t b = *LLACE_ARRAY_GET(size_t, live->order, n - 1);
+    const llace_ir_basicblock_t *block = LLACE_IR_BLOCK_AT(fn, b);
+    size_t from = *LLACE_ARRAY_GET(size_t, live->from, b), to = *LLACE_ARRAY_GET(size_t, live->to, b);
+
+    // Live out: what the successors need, including the phi inputs of this edge
+    ra_set_clear(&set);
+    LLACE_ARRAY_FOREACH(size_t, succ, *LLACE_IR_CFG_SUCCS(&live->cfg, b)) {
+      LLACE_ARRAY_FOREACH(size_t, v, *LLACE_ARRAY_GET(llace_array_t, live->live_in, *succ)) ra_set_add(&set, *v);
+      ra_phi_inputs(live, *succ, b, &set);
+    }
+    LLACE_ARRAY_FOREACH(size_t, v, set.vars) ra_add_range(LLACE_RA_INTERVAL(live, *v), from, to);
+
+    llace_ir_block_stmts(block, &stmts);
+    for (size_t k = LLACE_ARRAY_COUNT(stmts); k > 0; --k) {
+      const llace_ir_stmt_t *stmt = LLACE_ARRAY_GET(llace_ir_stmt_t, stmts, k - 1);
+      const llace_ir_value_t *values = LLACE_IR_STACK_AT(block, stmt->begin);
+      size_t len = stmt->end - stmt->begin, p = from + 2 * k, def;
+      bool defines = llace_ir_stmt_def(block, stmt, &def);
+      bool phi = defines && len >= 3 && LLACE_IR_IS_OP(&values[len - 3], LLACE_IR_OP_PHI);
+
+      if (phi) {
+        // Defined on entry, the inputs belong to the predecessors
+        ra_set_from(LLACE_RA_INTERVAL(live, def), from, LLACE_BITSET_GET(set.bits, def));
+        LLACE_BITSET_CLEAR(set.bits, def);
+        const llace_ir_value_t *first = &values[0];
+        if (first->kind == LLACE_IR_VALUE_VAR && first->var != def) {
+          LLACE_RA_INTERVAL(live, def)->hint = first->var;
+          if (LLACE_RA_INTERVAL(live, first->var)->hint == SIZE_MAX) LLACE_RA_INTERVAL(live, first->var)->hint = def;
+        }
+        continue;
+      }
+
+      if (defines) {
+        ra_set_from(LLACE_RA_INTERVAL(live, def), p + 1, LLACE_BITSET_GET(set.bits, def));
+        LLACE_BITSET_CLEAR(set.bits, def);
+        if (len == 3 && values[0].kind == LLACE_IR_VALUE_VAR) {
+          // Plain copy, both sides prefer one register
+          llace_ra_copy_t copy = { .dst = def, .src = values[0].var, .position = p };
+          LLACE_ARRAY_PUSHP(live->copies, &copy);
+          LLACE_RA_INTERVAL(live, def)->hint = copy.src;
+          if (LLACE_RA_INTERVAL(live, copy.src)->hint == SIZE_MAX) LLACE_RA_INTERVAL(live, copy.src)->hint = def;
+        }
+      }
+
+      size_t uses_end = defines ? len - 2 : len;
+      for (size_t i = 0; i < uses_end; ++i) {
+        if (LLACE_IR_IS_OP(&values[i], LLACE_IR_OP_CALL)) {
+          // Calls clobber the caller saved registers right after reading their arguments
+          for (size_t c = 0; c < LLACE_REGCLASS_COUNT; ++c) {
+            for (size_t r = 0; r < regs->count[c]; ++r) {
+              if (regs->caller_saved[c] >> regs->regs[c][r] & 1) ra_add_range(LLACE_RA_INTERVAL(live, live->fixed[c] + r), p + 1, p + 2);
+            }
+          }
+        }
+        if (values[i].kind != LLACE_IR_VALUE_VAR) continue;
+        llace_ra_interval_t *it = LLACE_RA_INTERVAL(live, values[i].var);
+        ra_add_range(it, from, p + 1);
+        if (LLACE_ARRAY_IS_EMPTY(it->uses) || *LLACE_ARRAY_BACK(size_t, it->uses) != p) LLACE_ARRAY_PUSH(it->uses, p);
+        ra_set_add(&set, values[i].var);
+      }
+    }
+
+    // Values live into a loop header stay live for the whole loop
+    ra_set_compact(&set);
+    size_t l = *LLACE_ARRAY_GET(size_t, heads, b);
+    if (l != SIZE_MAX) {
+      const llace_ir_loop_t *loop = LLACE_IR_LOOP_AT(&live->loops, l);
+      size_t loop_end = to;
+      LLACE_ARRAY_FOREACH(size_t, lb, loop->blocks) {
+        loop_end = LLACE_MAX(loop_end, *LLACE_ARRAY_GET(size_t, live->to, *lb));
+        if (*lb != b) ra_live_merge(LLACE_ARRAY_GET(llace_array_t, live->live_in, *lb), &set.vars, &scratch);
+      }
+      LLACE_ARRAY_FOREACH(size_t, v, set.vars) ra_add_range(LLACE_RA_INTERVAL(live, *v), from, loop_end);
+    }
+    ra_live_merge(LLACE_ARRAY_GET(llace_array_t, live->live_in, b), &set.vars, &scratch);
+  }
+
+  LLACE_ARRAY_FOREACH(llace_ra_interval_t, it, live->intervals) {
+    ra_reverse(&it->ranges, sizeof(llace_ra_range_t));
+    ra_reverse(&it->uses, sizeof(size_t));
+  }
+
+  free(set.bits);
+  LLACE_FREE_ARRAY(set.vars);
+  LLACE_FREE_ARRAY(scratch);
+  LLACE_FREE_ARRAY(heads);
+  LLACE_FREE_ARRAY(stmts);
+  return LLACE_ERROR_NONE;
+}
+
+void llace_ra_live_free(llace_ra_live_t *live) {
+  LLACE_ARRAY_FOREACH(llace_ra_interval_t, it, live->intervals) {
+    LLACE_FREE_ARRAY(it->ranges);
+    LLACE_FREE_ARRAY(it->uses);
+  }
+  LLACE_ARRAY_FOREACH(llace_array_t, in, live->live_in) LLACE_FREE_ARRAY(*in);
+  LLACE_FREE_ARRAY(live->intervals);
+  LLACE_FREE_ARRAY(live->live_in);
+  LLACE_FREE_ARRAY(live->copies);
+  LLACE_FREE_ARRAY(live->order);
+  LLACE_FREE_ARRAY(live->from);
+  LLACE_FREE_ARRAY(live->to);
+  free(live->block_start);
+  llace_ir_loops_free(&live->loops);
+  llace_ir_cfg_free(&live->cfg);
+}
+
+bool llace_ra_covers(llace_ra_interval_t *it, size_t position) {
+  // The scan only moves forward, ranges behind the cursor are never asked for again
+  size_t count = LLACE_ARRAY_COUNT(it->ranges);
+  if (it->cursor > 0 && LLACE_ARRAY_GET(llace_ra_range_t, it->ranges, it->cursor - 1)->to > position) it->cursor = 0;
+  while (it->cursor < count && LLACE_ARRAY_GET(llace_ra_range_t, it->ranges, it->cursor)->to <= position) ++it->cursor;
+  if (it->cursor >= count) return false;
+  return LLACE_ARRAY_GET(llace_ra_range_t, it->ranges, it->cursor)->from <= position;
+}
+
+size_t llace_ra_intersect(const llace_ra_interval_t *a, const llace_ra_interval_t *b, size_t position) {
+  const llace_ra_range_t *ra = LLACE_ARRAY_RAW(a->ranges), *rb = LLACE_ARRAY_RAW(b->ranges);
+  size_t i = 0, j = 0, ca = LLACE_ARRAY_COUNT(a->ranges), cb = LLACE_ARRAY_COUNT(b->ranges);
+  while (i < ca && ra[i].to <= position) ++i;
+  while (j < cb && rb[j].to <= position) ++j;
+
+  while (i < ca && j < cb) {
+    size_t lo = LLACE_MAX(LLACE_MAX(ra[i].from, rb[j].from), position);
+    size_t hi = LLACE_MIN(ra[i].to, rb[j].to);
+    if (lo < hi) return lo;
+    if (ra[i].to < rb[j].to) ++i; else ++j;
+  }
+  return SIZE_MAX;
+}
+
+size_t llace_ra_next_use(const llace_ra_interval_t *it, size_t position) {
+  LLACE_ARRAY_FOREACH(size_t, use, it->uses) {
+    if (*use >= position) return *use;
+  }
+  return SIZE_MAX;
+}
+
+size_t llace_ra_split(llace_ra_live_t *live, size_t index, size_t position) {
+  llace_ra_interval_t *it = LLACE_RA_INTERVAL(live, index);
+  llace_ra_interval_t child = ra_interval_new(it->var, it->cls);
+  child.hint = index;
+  child.next = it->next;
+
+  size_t keep = 0;
+  LLACE_ARRAY_FOREACH(llace_ra_range_t, range, it->ranges) {
+    if (range->to <= position) { ++keep; continue; }
+    llace_ra_range_t moved = *range;
+    if (moved.from < position) {
+      moved.from = position;
+      range->to = position;
+      ++keep;
+    }
+    LLACE_ARRAY_PUSHP(child.ranges, &moved);
+  }
+  it->ranges.element_count = keep;
+  it->cursor = LLACE_MIN(it->cursor, keep);
+
+  size_t kept_uses = 0;
+  LLACE_ARRAY_FOREACH(size_t, use, it->uses) {
+    if (*use < position) { ++kept_uses; continue; }
+    LLACE_ARRAY_PUSHP(child.uses, use);
+  }
+  it->uses.element_count = kept_uses;
+
+  size_t child_index = LLACE_ARRAY_COUNT(live->intervals);
+  it->next = child_index;
+  LLACE_ARRAY_PUSHP(live->intervals, &child); // it is stale from here on
+  return child_index;
+}
+
+// ================ Resolution ================ //
+
+typedef struct {
+  size_t var, from, to;
+  llace_regclass_t cls;
+} ra_hull_t;
+
+static int ra_hull_compare(const void *a, const void *b) {
+  const ra_hull_t *ha = a, *hb = b;
+  return ha->from < hb->from ? -1 : ha->from > hb->from ? 1 : 0;
+}
+
+// Spilled variables share slots when their lifetimes do not overlap
+static void ra_color_slots(llace_ra_live_t *live, llace_regalloc_t *ra) {
+  llace_array_t hulls = LLACE_NEW_ARRAY(ra_hull_t, 8);
+  for (size_t v = 0; v < live->var_count; ++v) {
+    const llace_ra_interval_t *first = LLACE_RA_INTERVAL(live, v);
+    if (LLACE_ARRAY_IS_EMPTY(first->ranges)) continue;
+    bool spilled = false;
+    ra_hull_t hull = { .var = v, .from = LLACE_RA_START(first), .cls = first->cls };
+    for (size_t c = v; c != SIZE_MAX; c = LLACE_RA_INTERVAL(live, c)->next) {
+      const llace_ra_interval_t *it = LLACE_RA_INTERVAL(live, c);
+      spilled |= it->loc.kind == LLACE_LOC_SLOT;
+      if (!LLACE_ARRAY_IS_EMPTY(it->ranges)) hull.to = LLACE_RA_END(it);
+    }
+    if (spilled) LLACE_ARRAY_PUSHP(hulls, &hull);
+  }
+  qsort(LLACE_ARRAY_RAW(hulls), LLACE_ARRAY_COUNT(hulls), sizeof(ra_hull_t), ra_hull_compare);
+
+  llace_array_t expiry[LLACE_REGCLASS_COUNT]; // size_t per slot, where its last owner dies
+  for (size_t c = 0; c < LLACE_REGCLASS_COUNT; ++c) expiry[c] = LLACE_NEW_ARRAY(size_t, 4);
+  LLACE_ARRAY_FOREACH(ra_hull_t, hull, hulls) {
+    llace_array_t *slots = &expiry[hull->cls];
+    size_t slot = LLACE_ARRAY_COUNT(*slots);
+    for (size_t s = 0; s < LLACE_ARRAY_COUNT(*slots); ++s) {
+      if (*LLACE_ARRAY_GET(size_t, *slots, s) <= hull->from) { slot = s; break; }
+    }
+    if (slot == LLACE_ARRAY_COUNT(*slots)) LLACE_ARRAY_PUSH(*slots, hull->to);
+    *LLACE_ARRAY_GET(size_t, *slots, slot) = hull->to;
+
+    for (size_t c = hull->var; c != SIZE_MAX; c = LLACE_RA_INTERVAL(live, c)->next) {
+      llace_ra_interval_t *it = LLACE_RA_INTERVAL(live, c);
+      if (it->loc.kind == LLACE_LOC_SLOT) it->loc.index = (uint32_t)slot;
+    }
+    ++ra->stats.spilled;
+  }
+  for (size_t c = 0; c < LLACE_REGCLASS_COUNT; ++c) {
+    ra->slots[c] = LLACE_ARRAY_COUNT(expiry[c]);
+    ra->stats.slots += ra->slots[c];
+    LLACE_FREE_ARRAY(expiry[c]);
+  }
+  LLACE_FREE_ARRAY(hulls);
+}
+
+// Order parallel moves so no source is overwritten before it is read, cycles go through the scratch register
+static void ra_sequentialize(const llace_regset_t *regs, llace_array_t *pending, llace_array_t *out) {
+  while (!LLACE_ARRAY_IS_EMPTY(*pending)) {
+    llace_ra_move_t *moves = LLACE_ARRAY_RAW(*pending);
+    size_t count = LLACE_ARRAY_COUNT(*pending);
+    bool progress = false;
+
+    for (size_t i = 0; i < count; ++i) {
+      bool blocked = false;
+      for (size_t j = 0; j < count && !blocked; ++j) {
+        blocked = j != i && llace_loc_eq(moves[j].from, moves[i].to);
+      }
+      if (blocked) continue;
+      LLACE_ARRAY_PUSHP(*out, &moves[i]);
+      moves[i] = moves[--count];
+      pending->element_count = count;
+      progress = true;
+      break;
+    }
+    if (progress) continue;
+
+    // Every destination is still needed: park one source in the scratch register
+    llace_loc_t parked = moves[0].from;
+    llace_loc_t scratch = { .kind = LLACE_LOC_REG, .cls = parked.cls, .index = regs->scratch[parked.cls] };
+    llace_ra_move_t save = { .var = moves[0].var, .from = parked, .to = scratch };
+    LLACE_ARRAY_PUSHP(*out, &save);
+    for (size_t i = 0; i < count; ++i) {
+      if (llace_loc_eq(moves[i].from, parked)) moves[i].from = scratch;
+    }
+  }
+}
+
+static void ra_emit_group(const llace_regset_t *regs, llace_regalloc_t *ra, llace_array_t *pending, size_t position, size_t pred, size_t succ) {
+  if (LLACE_ARRAY_IS_EMPTY(*pending)) return;
+  llace_ra_moves_t group = { .position = position, .pred = pred, .succ = succ, .first = LLACE_ARRAY_COUNT(ra->moves) };
+  ra_sequentialize(regs, pending, &ra->moves);
+  group.count = LLACE_ARRAY_COUNT(ra->moves) - group.first;
+  LLACE_ARRAY_PUSHP(ra->groups, &group);
+}
+
+typedef struct {
+  size_t position;
+  llace_ra_move_t move;
+} ra_split_move_t;
+
+static int ra_split_compare(const void *a, const void *b) {
+  const ra_split_move_t *ma = a, *mb = b;
+  return ma->position < mb->position ? -1 : ma->position > mb->position ? 1 : 0;
+}
+
+void llace_ra_finish(llace_ra_live_t *live, llace_regalloc_t *ra) {
+  const llace_regset_t *regs = live->regs;
+  *ra = (llace_regalloc_t){
+    .order = LLACE_NEW_ARRAY(size_t, LLACE_ARRAY_COUNT(live->order)),
+    .from = LLACE_NEW_ARRAY(size_t, LLACE_ARRAY_COUNT(live->from)),
+    .segments = LLACE_NEW_ARRAY(llace_array_t, live->var_count + 1),
+    .moves = LLACE_NEW_ARRAY(llace_ra_move_t, 8),
+    .groups = LLACE_NEW_ARRAY(llace_ra_moves_t, 8),
+  };
+  LLACE_ARRAY_PUSHA(ra->order, LLACE_ARRAY_RAW(live->order), LLACE_ARRAY_COUNT(live->order));
+  LLACE_ARRAY_PUSHA(ra->from, LLACE_ARRAY_RAW(live->from), LLACE_ARRAY_COUNT(live->from));
+  ra_color_slots(live, ra);
+
+  // Segments per variable
+  for (size_t v = 0; v < live->var_count; ++v) {
+    llace_array_t segments = LLACE_NEW_ARRAY(llace_ra_segment_t, 2);
+    for (size_t c = v; c != SIZE_MAX; c = LLACE_RA_INTERVAL(live, c)->next) {
+      const llace_ra_interval_t *it = LLACE_RA_INTERVAL(live, c);
+      LLACE_ARRAY_FOREACH(llace_ra_range_t, range, it->ranges) {
+        llace_ra_segment_t segment = { range->from, range->to, it->loc };
+        LLACE_ARRAY_PUSHP(segments, &segment);
+      }
+    }
+    LLACE_ARRAY_PUSHP(ra->segments, &segments);
+  }
+
+  // Splits inside a block move the value where the next part expects it
+  llace_array_t splits = LLACE_NEW_ARRAY(ra_split_move_t, 8);
+  for (size_t v = 0; v < live->var_count; ++v) {
+    for (size_t c = LLACE_RA_INTERVAL(live, v)->next; c != SIZE_MAX; c = LLACE_RA_INTERVAL(live, c)->next) {
+      const llace_ra_interval_t *it = LLACE_RA_INTERVAL(live, c);
+      if (LLACE_ARRAY_IS_EMPTY(it->ranges)) continue;
+      size_t start = LLACE_RA_START(it);
+      if (start == 0 || start % 2 != 0 || LLACE_BITSET_GET(live->block_start, start)) continue;
+      llace_loc_t before = llace_regalloc_loc(ra, v, start - 1);
+      if (before.kind == LLACE_LOC_NONE || llace_loc_eq(before, it->loc)) continue;
+      ra_split_move_t split = { start, { .var = v, .from = before, .to = it->loc } };
+      LLACE_ARRAY_PUSHP(splits, &split);
+    }
+  }
+  qsort(LLACE_ARRAY_RAW(splits), LLACE_ARRAY_COUNT(splits), sizeof(ra_split_move_t), ra_split_compare);
+
+  llace_array_t pending = LLACE_NEW_ARRAY(llace_ra_move_t, 8);
+  for (size_t i = 0; i < LLACE_ARRAY_COUNT(splits);) {
+    size_t position = LLACE_ARRAY_GET(ra_split_move_t, splits, i)->position;
+    pending.element_count = 0;
+    for (; i < LLACE_ARRAY_COUNT(splits) && LLACE_ARRAY_GET(ra_split_move_t, splits, i)->position == position; ++i) {
+      LLACE_ARRAY_PUSHP(pending, &LLACE_ARRAY_GET(ra_split_move_t, splits, i)->move);
+    }
+    ra_emit_group(regs, ra, &pending, position, SIZE_MAX, SIZE_MAX);
+  }
+
+  // Control flow edges: live-in values and phi inputs
+  llace_array_t stmts = LLACE_NEW_ARRAY(llace_ir_stmt_t, 16);
+  LLACE_ARRAY_FOREACH(size_t, b, live->order) {
+    const llace_ir_basicblock_t *block = LLACE_IR_BLOCK_AT(live->fn, *b);
+    size_t from = *LLACE_ARRAY_GET(size_t, live->from, *b);
+    const llace_array_t *in = LLACE_ARRAY_GET(llace_array_t, live->live_in, *b);
+    llace_ir_block_stmts(block, &stmts);
+
+    LLACE_ARRAY_FOREACH(size_t, pred, *LLACE_IR_CFG_PREDS(&live->cfg, *b)) {
+      if (!LLACE_IR_CFG_REACHABLE(&live->cfg, *pred)) continue;
+      size_t out = *LLACE_ARRAY_GET(size_t, live->to, *pred) - 1;
+      pending.element_count = 0;
+
+      for (size_t i = 0; i < LLACE_ARRAY_COUNT(*in); ++i) {
+        size_t v = *LLACE_ARRAY_GET(size_t, *in, i);
+        llace_ra_move_t move = { .var = v, .from = llace_regalloc_loc(ra, v, out), .to = llace_regalloc_loc(ra, v, from) };
+        if (move.from.kind == LLACE_LOC_NONE || move.to.kind == LLACE_LOC_NONE || llace_loc_eq(move.from, move.to)) continue;
+        LLACE_ARRAY_PUSHP(pending, &move);
+      }
+
+      LLACE_ARRAY_FOREACH(llace_ir_stmt_t, stmt, stmts) {
+        size_t def;
+        if (stmt->end - stmt->begin < 3 || !llace_ir_stmt_def(block, stmt, &def)) continue;
+        const llace_ir_value_t *phi = LLACE_IR_STACK_AT(block, stmt->end - 3);
+        if (!LLACE_IR_IS_OP(phi, LLACE_IR_OP_PHI)) continue;
+        const llace_ir_value_t *pairs = LLACE_IR_STACK_AT(block, stmt->begin);
+        for (size_t p = 0; p < phi->instr.in; p += 2) {
+          if (pairs[p + 1].block != *pred) continue;
+          llace_ra_move_t move = { .var = def, .to = llace_regalloc_loc(ra, def, from) };
+          if (pairs[p].kind == LLACE_IR_VALUE_VAR) {
+            move.from = llace_regalloc_loc(ra, pairs[p].var, out);
+          } else {
+            move.from = (llace_loc_t){ .kind = LLACE_LOC_CONST, .cls = move.to.cls };
+            move.constant = pairs[p];
+          }
+          if (move.to.kind == LLACE_LOC_NONE || move.from.kind == LLACE_LOC_NONE) continue;
+          if (llace_loc_eq(move.from, move.to)) { ++ra->stats.coalesced; continue; }
+          LLACE_ARRAY_PUSHP(pending, &move);
+        }
+      }
+      ra_emit_group(regs, ra, &pending, SIZE_MAX, *pred, *b);
+    }
+  }
+
+  // Statistics of the final code: slot traffic, moves left and copies folded away
+  LLACE_ARRAY_FOREACH(llace_ra_move_t, move, ra->moves) {
+    if (move->to.kind == LLACE_LOC_SLOT) ++ra->stats.spill_stores;
+    else if (move->from.kind == LLACE_LOC_SLOT) ++ra->stats.reloads;
+    else if (move->from.kind == LLACE_LOC_REG) ++ra->stats.moves;
+  }
+  for (size_t v = 0; v < live->var_count; ++v) {
+    const llace_ra_interval_t *first = LLACE_RA_INTERVAL(live, v);
+    if (!LLACE_ARRAY_IS_EMPTY(first->ranges) && first->loc.kind == LLACE_LOC_SLOT) ++ra->stats.spill_stores; // defined into its slot
+    for (size_t c = v; c != SIZE_MAX; c = LLACE_RA_INTERVAL(live, c)->next) {
+      const llace_ra_interval_t *it = LLACE_RA_INTERVAL(live, c);
+      if (it->loc.kind == LLACE_LOC_SLOT) ra->stats.reloads += LLACE_ARRAY_COUNT(it->uses); // read from memory
+    }
+  }
+  LLACE_ARRAY_FOREACH(llace_ra_copy_t, copy, live->copies) {
+    llace_loc_t src = llace_regalloc_loc(ra, copy->src, copy->position);
+    llace_loc_t dst = llace_regalloc_loc(ra, copy->dst, copy->position + 1);
+    if (src.kind == LLACE_LOC_REG && llace_loc_eq(src, dst)) ++ra->stats.coalesced;
+  }
+
+  LLACE_FREE_ARRAY(stmts);
+  LLACE_FREE_ARRAY(pending);
+  LLACE_FREE_ARRAY(splits);
+}
+
+// ================ Allocation Results ================ //
+
+llace_error_t llace_regalloc(const llace_ir_context_t *ctx, const llace_config_t *config, const llace_ir_function_t *fn, const llace_regset_t *regs, llace_regalloc_t *ra) {
+  LLACE_PROFILE_SCOPE("regalloc");
+  LLACE_MEM_SCOPE(LLACE_MEM_CODEGEN);
+  if (!config) {
+    return LLACE_ERROR_BADARG;
+  }
+
+  switch (config->regalloc) {
+  case LLACE_REGALLOC_LINEAR: return llace_regalloc_linear(ctx, fn, regs, ra);
+  case LLACE_REGALLOC_COLOR:  return llace_regalloc_color(ctx, fn, regs, ra);
+  default: return LLACE_ERROR_BADARG;
+  }
+}
+
+void llace_regalloc_free(llace_regalloc_t *ra) {
+  LLACE_ARRAY_FOREACH(llace_array_t, segments, ra->segments) LLACE_FREE_ARRAY(*segments);
+  LLACE_FREE_ARRAY(ra->segments);
+  LLACE_FREE_ARRAY(ra->moves);
+  LLACE_FREE_ARRAY(ra->groups);
+  LLACE_FREE_ARRAY(ra->order);
+  LLACE_FREE_ARRAY(ra->from);
+}
+
+llace_loc_t llace_regalloc_loc(const llace_regalloc_t *ra, size_t var, size_t position) {
+  llace_loc_t none = { .kind = LLACE_LOC_NONE };
+  if (var >= LLACE_ARRAY_COUNT(ra->segments)) return none;
+
+  const llace_array_t *segments = LLACE_ARRAY_GET(llace_array_t, ra->segments, var);
+  const llace_ra_segment_t *seg = LLACE_ARRAY_RAW(*segments);
+  size_t lo = 0, hi = LLACE_ARRAY_COUNT(*segments);
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (seg[mid].to <= position) lo = mid + 1;
+    else hi = mid;
+  }
+  if (lo < LLACE_ARRAY_COUNT(*segments) && seg[lo].from <= position) return seg[lo].loc;
+  return none;
+}
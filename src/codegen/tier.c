@@ -0,0 +1,256 @@
+#include <llace/codegen/tier.h>
+#include <llace/detail/common.h>
+#include <string.h>
+
+#define TIER_FUNC(tier, index) LLACE_ARRAY_GET(llace_tier_func_t, (tier)->funcs, (index))
+#define TIER_MAX_PARAMS 6 // integer argument registers of the host convention
+
+typedef uint64_t (*tier_code_t)(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t);
+
+// ================ Signatures ================ //
+
+static bool tier_word(llace_ir_type_t type, size_t depth) {
+  return depth > 0 || ((type.kind == LLACE_IR_TYPE_INT || type.kind == LLACE_IR_TYPE_UNT) && !LLACE_IR_IS_VEC(type));
+}
+
+// Functions added to the context since the last call, with the compiler lock held
+static void tier_sync(llace_tier_t *tier) {
+  while (LLACE_ARRAY_COUNT(tier->funcs) < LLACE_ARRAY_COUNT(tier->ctx->funcmap.funcs)) {
+    const llace_ir_function_t *fn = LLACE_IR_FUNCTION(tier->ctx, LLACE_ARRAY_COUNT(tier->funcs));
+    llace_tier_func_t func = { .state = LLACE_TIER_INTERP, .params = fn->param_count };
+
+    func.eligible = fn->param_count <= TIER_MAX_PARAMS && (fn->ret.kind == LLACE_IR_TYPE_VOID || tier_word(fn->ret, fn->retattr.depth));
+    for (size_t p = 0; p < fn->param_count && func.eligible; ++p) {
+      const llace_ir_variable_t *param = LLACE_IR_VAR_AT(fn, p);
+      func.eligible = tier_word(param->type, param->attr.depth);
+    }
+    if (fn->ret.kind != LLACE_IR_TYPE_VOID) {
+      size_t bits = fn->retattr.depth > 0 ? 64 : llace_ir_type_bits(fn->ret);
+      func.width = (uint8_t)(bits == 0 || bits > 64 ? 64 : bits);
+      func.sign = fn->retattr.depth == 0 && fn->ret.kind == LLACE_IR_TYPE_INT && func.width > 1;
+    }
+    LLACE_ARRAY_PUSHP(tier->funcs, &func);
+  }
+}
+
+// Calls machine code, the returned register only holds the width of the type
+static uint64_t tier_invoke(const llace_tier_func_t *func, void *entry, const uint64_t *args) {
+  uint64_t words[TIER_MAX_PARAMS] = {0};
+  memcpy(words, args, func->params * sizeof(uint64_t));
+  tier_code_t code;
+  memcpy(&code, &entry, sizeof(code));
+  uint64_t word = code(words[0], words[1], words[2], words[3], words[4], words[5]);
+
+  if (func->width == 0) return 0;
+  unsigned shift = 64u - func->width;
+  return func->sign ? (uint64_t)((int64_t)(word << shift) >> shift) : (word << shift) >> shift;
+}
+
+// ================ Compilation ================ //
+
+// Compiles the function, then publishes it and everything compiled along with it
+static void tier_compile(llace_tier_t *tier, size_t function) {
+  pthread_mutex_lock(&tier->compile);
+  void *entry = NULL;
+  if (llace_jit_add(&tier->jit, function, &entry) != LLACE_ERROR_NONE) {
+    LLACE_LOG_ERROR("Tiered execution keeps function '%s' interpreted, it did not compile", LLACE_IR_FUNCTION(tier->ctx, function)->name);
+    __atomic_store_n(&TIER_FUNC(tier, function)->state, LLACE_TIER_PINNED, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&tier->stats.pinned, 1, __ATOMIC_RELAXED);
+  } else {
+    size_t count = LLACE_MIN(LLACE_ARRAY_COUNT(tier->funcs), LLACE_ARRAY_COUNT(tier->jit.funcs));
+    for (size_t f = 0; f < count; ++f) {
+      llace_tier_func_t *func = TIER_FUNC(tier, f);
+      void *code = LLACE_ARRAY_GET(llace_jit_func_t, tier->jit.funcs, f)->entry;
+      if (code == NULL || !func->eligible || __atomic_load_n(&func->entry, __ATOMIC_RELAXED)) continue;
+      __atomic_store_n(&func->entry, code, __ATOMIC_RELEASE);
+      __atomic_store_n(&func->state, LLACE_TIER_COMPILED, __ATOMIC_RELEASE);
+      ++tier->stats.compiled;
+    }
+  }
+  pthread_mutex_unlock(&tier->compile);
+}
+
+static void *tier_worker(void *arg) {
+  llace_tier_t *tier = arg;
+  pthread_mutex_lock(&tier->lock);
+  for (;;) {
+    while (!tier->stop && tier->head == LLACE_ARRAY_COUNT(tier->queue)) {
+      tier->head = tier->queue.element_count = 0;
+      pthread_cond_broadcast(&tier->idle);
+      pthread_cond_wait(&tier->wake, &tier->lock);
+    }
+    if (tier->stop) break;
+
+    size_t function = *LLACE_ARRAY_GET(size_t, tier->queue, tier->head++);
+    tier->busy = true;
+    pthread_mutex_unlock(&tier->lock);
+    tier_compile(tier, function);
+    pthread_mutex_lock(&tier->lock);
+    tier->busy = false;
+  }
+  pthread_mutex_unlock(&tier->lock);
+  return NULL;
+}
+
+// Queues the function once it is hot, in the calling thread
+static void tier_check(llace_tier_t *tier, size_t function) {
+  llace_tier_func_t *func = TIER_FUNC(tier, function);
+  if (__atomic_load_n(&func->state, __ATOMIC_ACQUIRE) != LLACE_TIER_INTERP) return;
+  const llace_interp_counts_t *counts = llace_interp_counts(&tier->interp, function);
+  if (counts == NULL || (counts->calls < tier->config.tier_call_threshold && counts->backedges < tier->config.tier_loop_threshold)) return;
+
+  if (!func->eligible) {
+    __atomic_store_n(&func->state, LLACE_TIER_PINNED, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&tier->stats.pinned, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  __atomic_store_n(&func->state, LLACE_TIER_QUEUED, __ATOMIC_RELEASE);
+  if (!tier->config.tier_background) {
+    tier_compile(tier, function);
+    return;
+  }
+
+  pthread_mutex_lock(&tier->lock);
+  if (!tier->started) {
+    tier->started = pthread_create(&tier->worker, NULL, tier_worker, tier) == 0;
+  }
+  if (!tier->started) {
+    pthread_mutex_unlock(&tier->lock);
+    LLACE_LOG_ERROR("Failed to start the tiered execution worker, compiling in the calling thread");
+    tier_compile(tier, function);
+    return;
+  }
+  LLACE_ARRAY_PUSH(tier->queue, function);
+  pthread_cond_signal(&tier->wake);
+  pthread_mutex_unlock(&tier->lock);
+}
+
+// ================ Hooks ================ //
+
+// Interpreted code calling out, to machine code once the entry is swapped
+static bool tier_enter(void *user, size_t function, const uint64_t *args, size_t count, uint64_t *result) {
+  (void)count;
+  llace_tier_t *tier = user;
+  const llace_tier_func_t *func = TIER_FUNC(tier, function);
+  void *entry = __atomic_load_n(&func->entry, __ATOMIC_ACQUIRE);
+  if (entry) {
+    ++tier->stats.native_calls;
+    *result = tier_invoke(func, entry, args);
+    return true;
+  }
+  tier_check(tier, function);
+  return false;
+}
+
+// Globals live in the JIT, the interpreter only resolves them under the compiler lock
+static void *tier_resolve(void *user, size_t global) {
+  llace_tier_t *tier = user;
+  return llace_jit_global(&tier->jit, global);
+}
+
+// ================ Engine ================ //
+
+llace_error_t llace_tier_init(llace_tier_t *tier, llace_ir_context_t *ctx, const llace_config_t *config) {
+  if (!tier || !ctx) {
+    return LLACE_ERROR_BADARG;
+  }
+
+  *tier = (llace_tier_t){ .ctx = ctx };
+  if (config) {
+    tier->config = *config;
+  } else {
+    llace_config_init(&tier->config);
+  }
+  LLACE_RUNCHECK(llace_jit_init(&tier->jit, ctx, &tier->config));
+  llace_error_t err = llace_interp_init(&tier->interp, ctx);
+  if (err != LLACE_ERROR_NONE) {
+    llace_jit_free(&tier->jit);
+    return err;
+  }
+  tier->interp.resolve = tier_resolve;
+  tier->interp.enter = tier_enter;
+  tier->interp.user = tier;
+
+  tier->funcs = LLACE_NEW_ARRAY(llace_tier_func_t, 16);
+  tier->queue = LLACE_NEW_ARRAY(size_t, 16);
+  pthread_mutex_init(&tier->compile, NULL);
+  pthread_mutex_init(&tier->lock, NULL);
+  pthread_cond_init(&tier->wake, NULL);
+  pthread_cond_init(&tier->idle, NULL);
+  return LLACE_ERROR_NONE;
+}
+
+void llace_tier_free(llace_tier_t *tier) {
+  if (tier->started) {
+    pthread_mutex_lock(&tier->lock);
+    tier->stop = true;
+    pthread_cond_signal(&tier->wake);
+    pthread_mutex_unlock(&tier->lock);
+    pthread_join(tier->worker, NULL);
+  }
+  pthread_mutex_destroy(&tier->compile);
+  pthread_mutex_destroy(&tier->lock);
+  pthread_cond_destroy(&tier->wake);
+  pthread_cond_destroy(&tier->idle);
+  llace_interp_free(&tier->interp);
+  llace_jit_free(&tier->jit);
+  LLACE_FREE_ARRAY(tier->funcs);
+  LLACE_FREE_ARRAY(tier->queue);
+  *tier = (llace_tier_t){0};
+}
+
+llace_error_t llace_tier_call(llace_tier_t *tier, size_t function, const uint64_t *args, size_t count, uint64_t *result) {
+  if (!tier || !tier->ctx || (count > 0 && !args) || !result) {
+    return LLACE_ERROR_BADARG;
+  }
+  if (function >= LLACE_ARRAY_COUNT(tier->funcs)) {
+    pthread_mutex_lock(&tier->compile);
+    tier_sync(tier);
+    pthread_mutex_unlock(&tier->compile);
+    if (function >= LLACE_ARRAY_COUNT(tier->funcs)) return LLACE_ERROR_INVLFUNC;
+  }
+
+  llace_tier_func_t *func = TIER_FUNC(tier, function);
+  if (count != func->params) {
+    return LLACE_ERROR_BADARG;
+  }
+  void *entry = __atomic_load_n(&func->entry, __ATOMIC_ACQUIRE);
+  if (entry) {
+    ++tier->stats.native_calls;
+    *result = tier_invoke(func, entry, args);
+    return LLACE_ERROR_NONE;
+  }
+
+  // Decode ahead, so the interpreter never reads IR the worker may be folding
+  if (!func->prepared) {
+    pthread_mutex_lock(&tier->compile);
+    tier_sync(tier); // the callees reached
+    llace_error_t decoded = llace_interp_prepare(&tier->interp, function);
+    pthread_mutex_unlock(&tier->compile);
+    LLACE_RUNCHECK(decoded);
+    func->prepared = true;
+  }
+  LLACE_RUNCHECK(llace_interp_call(&tier->interp, function, args, count, result));
+  tier_check(tier, function);
+  return LLACE_ERROR_NONE;
+}
+
+void llace_tier_wait(llace_tier_t *tier) {
+  pthread_mutex_lock(&tier->lock);
+  while (tier->started && (tier->head < LLACE_ARRAY_COUNT(tier->queue) || tier->busy)) {
+    pthread_cond_wait(&tier->idle, &tier->lock);
+  }
+  pthread_mutex_unlock(&tier->lock);
+}
+
+llace_tier_state_t llace_tier_state(llace_tier_t *tier, size_t function) {
+  if (function >= LLACE_ARRAY_COUNT(tier->funcs)) return LLACE_TIER_INTERP;
+  return (llace_tier_state_t)__atomic_load_n(&TIER_FUNC(tier, function)->state, __ATOMIC_ACQUIRE);
+}
+
+void *llace_tier_global(llace_tier_t *tier, size_t global) {
+  pthread_mutex_lock(&tier->compile);
+  void *storage = llace_jit_global(&tier->jit, global);
+  pthread_mutex_unlock(&tier->compile);
+  return storage;
+}
@@ -0,0 +1,1354 @@
+#include <llace/codegen/wasm/wasm.h>
+#include <llace/ir/analysis.h>
+#include <llace/profile.h>
+#include <llace/detail/common.h>
+#include <string.h>
+
+// Opcodes, the MVP set and the sign extension ops
+enum {
+  WASM_UNREACHABLE = 0x00, WASM_BLOCK = 0x02, WASM_LOOP = 0x03, WASM_IF = 0x04, WASM_ELSE = 0x05, WASM_END = 0x0B,
+  WASM_BR = 0x0C, WASM_RETURN = 0x0F, WASM_CALL = 0x10, WASM_DROP = 0x1A,
+  WASM_LOCAL_GET = 0x20, WASM_LOCAL_SET = 0x21,
+  WASM_I32_LOAD = 0x28, WASM_I64_LOAD, WASM_F32_LOAD, WASM_F64_LOAD,
+  WASM_I32_LOAD8_S, WASM_I32_LOAD8_U, WASM_I32_LOAD16_S, WASM_I32_LOAD16_U,
+  WASM_I32_STORE = 0x36, WASM_I64_STORE, WASM_F32_STORE, WASM_F64_STORE, WASM_I32_STORE8, WASM_I32_STORE16,
+  WASM_I32_CONST = 0x41, WASM_I64_CONST, WASM_F32_CONST, WASM_F64_CONST,
+  WASM_I32_EQZ = 0x45, WASM_I32_EQ, WASM_I32_NE, WASM_I32_LT_S, WASM_I32_LT_U, WASM_I32_GT_S, WASM_I32_GT_U,
+  WASM_I32_LE_S, WASM_I32_LE_U, WASM_I32_GE_S, WASM_I32_GE_U,
+  WASM_I64_EQZ = 0x50,
+  WASM_F32_EQ = 0x5B, WASM_F32_NE, WASM_F32_LT, WASM_F32_GT, WASM_F32_LE, WASM_F32_GE,
+  WASM_F64_EQ = 0x61,
+  WASM_I32_ADD = 0x6A, WASM_I32_SUB, WASM_I32_MUL, WASM_I32_DIV_S, WASM_I32_DIV_U, WASM_I32_REM_S, WASM_I32_REM_U,
+  WASM_I32_AND, WASM_I32_OR, WASM_I32_XOR, WASM_I32_SHL, WASM_I32_SHR_S, WASM_I32_SHR_U,
+  WASM_F32_ADD = 0x92, WASM_F64_ADD = 0xA0,
+  WASM_I32_WRAP_I64 = 0xA7, WASM_I64_EXTEND_I32_S = 0xAC, WASM_I64_EXTEND_I32_U = 0xAD,
+  WASM_F32_DEMOTE_F64 = 0xB6, WASM_F64_PROMOTE_F32 = 0xBB,
+  WASM_I32_EXTEND8_S = 0xC0, WASM_I32_EXTEND16_S, WASM_I64_EXTEND8_S, WASM_I64_EXTEND16_S, WASM_I64_EXTEND32_S,
+  WASM_SIMD = 0xFD,
+};
+
+// simd128 ops after the prefix
+enum {
+  WASM_V128_LOAD = 0x00, WASM_V128_STORE = 0x0B, WASM_V128_CONST = 0x0C,
+  WASM_V128_AND = 0x4E, WASM_V128_OR = 0x50, WASM_V128_XOR = 0x51,
+};
+
+// Lane forms: i8x16 i16x8 i32x4 i64x2 f32x4 f64x2
+static const uint8_t wasm_splat[] = { 0x0F, 0x10, 0x11, 0x12, 0x13, 0x14 };
+static const uint8_t wasm_extract[][2] = { { 0x15, 0x16 }, { 0x18, 0x19 }, { 0x1B, 0x1B }, { 0x1D, 0x1D }, { 0x1F, 0x1F }, { 0x21, 0x21 } };
+static const uint8_t wasm_replace[] = { 0x17, 0x1A, 0x1C, 0x1E, 0x20, 0x22 };
+// add sub mul div shl shr_s shr_u, 0 where there is none
+static const uint8_t wasm_varith[][7] = {
+  { 0x6E, 0x71, 0x00, 0x00, 0x6B, 0x6C, 0x6D },
+  { 0x8E, 0x91, 0x95, 0x00, 0x8B, 0x8C, 0x8D },
+  { 0xAE, 0xB1, 0xB5, 0x00, 0xAB, 0xAC, 0xAD },
+  { 0xCE, 0xD1, 0xD5, 0x00, 0xCB, 0xCC, 0xCD },
+  { 0xE4, 0xE5, 0xE6, 0xE7, 0x00, 0x00, 0x00 },
+  { 0xF0, 0xF1, 0xF2, 0xF3, 0x00, 0x00, 0x00 },
+};
+
+// The i64 ops sit at a fixed distance from their i32 twins
+#define WASM_WIDE_CMP (0x51 - WASM_I32_EQ)
+#define WASM_WIDE_ARITH (0x7C - WASM_I32_ADD)
+#define WASM_VOID 0x40 // empty block type
+#define WASM_FUNC 0x60
+
+#define WASM_TEMP_ADDR 0 // temps are keyed by value type, addresses are i32s of their own
+
+typedef struct {
+  llace_ir_type_t type;
+  size_t depth;
+} wasm_type_t;
+
+// How a value is held: one or more wasm values of a part type
+typedef struct {
+  uint8_t part;  // value type of each part, v128 or the scalar of one lane
+  uint8_t form;  // lane form in a v128, index of the simd tables
+  size_t width;  // bits of a lane once widened
+  size_t parts;  // on the stack and in locals
+  size_t per;    // lanes per part
+} wasm_shape_t;
+
+typedef struct {
+  uint8_t key; // value type or WASM_TEMP_ADDR
+  uint32_t local;
+} wasm_temp_t;
+
+// The constant emitted last, lane numbers are immediates in wasm
+typedef struct {
+  size_t count;    // operands once it was pushed
+  size_t at, end;  // its code
+  uint64_t value;
+} wasm_imm_t;
+
+typedef enum {
+  WASM_FRAME_IF,
+  WASM_FRAME_BLOCK, // a branch lands after its end, on block
+  WASM_FRAME_LOOP,  // a branch lands on block, its header
+} wasm_frame_kind_t;
+
+typedef struct {
+  wasm_frame_kind_t kind;
+  size_t block;
+} wasm_frame_t;
+
+typedef struct {
+  size_t offset, size; // in signatures
+} wasm_span_t;
+
+typedef struct {
+  const llace_ir_context_t *ctx;
+  const llace_target_t *target;
+  bool simd;
+  llace_codebuf_t *out;
+  llace_array_t funcs; // uint32_t per function, index in the wasm function space
+  llace_array_t sigs;  // uint32_t per function, type index
+  llace_array_t addrs; // uint32_t per global, address in linear memory
+  llace_codebuf_t signatures; // encoded function types
+  llace_array_t spans;         // wasm_span_t per function type
+  llace_codebuf_t code;        // body of the function, its locals are known once it is done
+  size_t vector, scalarized;
+
+  // Per function
+  const llace_ir_function_t *fn;
+  llace_ir_cfg_t cfg;
+  llace_array_t merges;  // size_t per block, forward edges into it
+  llace_array_t headers; // bool per block, target of a back edge
+  llace_array_t first;   // size_t per block and one more, where its children start in kids
+  llace_array_t kids;    // size_t, dominator tree children grouped by parent in reverse post order
+  llace_array_t frames;  // wasm_frame_t, innermost last
+  llace_array_t types;   // wasm_type_t, operand stack of the statement
+  llace_array_t stmts;   // llace_ir_stmt_t scratch
+  llace_array_t copies;  // size_t, phi targets of an edge
+  llace_array_t locals;  // uint32_t per variable, its first local
+  llace_array_t temps;   // wasm_temp_t, scratch locals in the order they are declared
+  uint32_t next;         // local the next temp gets
+  wasm_imm_t imm;
+} wasm_emit_t;
+
+// ================ Encoding ================ //
+
+static inline void wasm_byte(llace_codebuf_t *out, uint8_t byte) {
+  LLACE_CODEBUF_RESERVE(out, 1);
+  out->data[out->size++] = byte;
+}
+
+void llace_wasm_uleb(llace_codebuf_t *out, uint64_t value) {
+  LLACE_CODEBUF_RESERVE(out, 10);
+  do {
+    uint8_t byte = value & 0x7F;
+    value >>= 7;
+    out->data[out->size++] = byte | (value ? 0x80 : 0);
+  } while (value);
+}
+
+void llace_wasm_sleb(llace_codebuf_t *out, int64_t value) {
+  LLACE_CODEBUF_RESERVE(out, 10);
+  for (;;) {
+    uint8_t byte = value & 0x7F;
+    value >>= 7; // arithmetic
+    bool done = (value == 0 && !(byte & 0x40)) || (value == -1 && (byte & 0x40));
+    out->data[out->size++] = byte | (done ? 0 : 0x80);
+    if (done) return;
+  }
+}
+
+void llace_wasm_size_begin(llace_codebuf_t *out, size_t *at) {
+  LLACE_CODEBUF_RESERVE(out, 5);
+  *at = out->size;
+  out->size += 5;
+}
+
+void llace_wasm_size_end(llace_codebuf_t *out, size_t at) {
+  uint32_t size = (uint32_t)(out->size - at - 5);
+  for (size_t i = 0; i < 4; ++i, size >>= 7) out->data[at + i] = (size & 0x7F) | 0x80;
+  out->data[at + 4] = size & 0x7F;
+}
+
+static void wasm_name(llace_codebuf_t *out, const char *name) {
+  size_t length = strlen(name);
+  llace_wasm_uleb(out, length);
+  llace_codebuf_write(out, name, length);
+}
+
+static inline void wasm_op(wasm_emit_t *e, uint8_t op) {
+  wasm_byte(e->out, op);
+}
+
+static void wasm_op_u(wasm_emit_t *e, uint8_t op, uint64_t imm) {
+  wasm_byte(e->out, op);
+  llace_wasm_uleb(e->out, imm);
+}
+
+// Loads and stores take the alignment (log2) and a constant offset
+static void wasm_memop(wasm_emit_t *e, uint8_t op, unsigned align, uint64_t offset) {
+  wasm_byte(e->out, op);
+  llace_wasm_uleb(e->out, align);
+  llace_wasm_uleb(e->out, offset);
+}
+
+static void wasm_simd(wasm_emit_t *e, uint8_t op) {
+  wasm_byte(e->out, WASM_SIMD);
+  llace_wasm_uleb(e->out, op);
+}
+
+static void wasm_simd_lane(wasm_emit_t *e, uint8_t op, size_t lane) {
+  wasm_simd(e, op);
+  wasm_byte(e->out, (uint8_t)lane);
+}
+
+static void wasm_simd_mem(wasm_emit_t *e, uint8_t op, unsigned align, uint64_t offset) {
+  wasm_simd(e, op);
+  llace_wasm_uleb(e->out, align);
+  llace_wasm_uleb(e->out, offset);
+}
+
+static void wasm_v128(wasm_emit_t *e, const uint8_t bytes[16]) {
+  wasm_simd(e, WASM_V128_CONST);
+  llace_codebuf_write(e->out, bytes, 16);
+}
+
+static void wasm_iconst(wasm_emit_t *e, bool wide, int64_t value) {
+  wasm_byte(e->out, wide ? WASM_I64_CONST : WASM_I32_CONST);
+  llace_wasm_sleb(e->out, wide ? value : (int32_t)(uint32_t)value);
+}
+
+// ================ Types ================ //
+
+// Bits an integer carries, pointers are wasm32 addresses
+static size_t wasm_width(wasm_type_t t) {
+  size_t bits = t.depth > 0 ? 32 : llace_ir_type_bits(t.type);
+  return bits == 0 || bits > 64 ? 64 : bits;
+}
+
+static bool wasm_signed(wasm_type_t t) {
+  return t.depth == 0 && t.type.kind == LLACE_IR_TYPE_INT && wasm_width(t) > 1;
+}
+
+static bool wasm_float(wasm_type_t t) {
+  return t.depth == 0 && t.type.kind == LLACE_IR_TYPE_FLOAT;
+}
+
+static bool wasm_scalar(wasm_type_t t) {
+  return t.depth > 0 || (!LLACE_IR_IS_VEC(t.type) && t.type.kind != LLACE_IR_TYPE_VOID);
+}
+
+static bool wasm_vec(wasm_type_t t) {
+  return t.depth == 0 && LLACE_IR_IS_VEC(t.type);
+}
+
+static uint8_t wasm_valtype(wasm_type_t t) {
+  if (wasm_float(t)) return llace_ir_type_bits(t.type) <= 32 ? LLACE_WASM_F32 : LLACE_WASM_F64;
+  return wasm_width(t) <= 32 ? LLACE_WASM_I32 : LLACE_WASM_I64;
+}
+
+static wasm_type_t wasm_lane(wasm_type_t t) {
+  t.type.lanes = 0;
+  return t;
+}
+
+// Lanes are widened to the next machine element
+static wasm_shape_t wasm_shape(const wasm_emit_t *e, wasm_type_t t) {
+  if (!wasm_vec(t)) return (wasm_shape_t){ .part = wasm_valtype(t), .width = wasm_width(t), .parts = 1, .per = 1 };
+  wasm_type_t lane = wasm_lane(t);
+  size_t bits = wasm_width(lane), lanes = t.type.lanes;
+  wasm_shape_t s = { .width = bits <= 8 ? 8 : bits <= 16 ? 16 : bits <= 32 ? 32 : 64 };
+  if (wasm_float(lane)) s.width = wasm_valtype(lane) == LLACE_WASM_F32 ? 32 : 64;
+  s.form = wasm_float(lane) ? (s.width == 32 ? 4 : 5) : (s.width == 8 ? 0 : s.width == 16 ? 1 : s.width == 32 ? 2 : 3);
+  if (!e->simd) {
+    s.part = wasm_valtype(lane);
+    s.parts = lanes;
+    s.per = 1;
+  } else {
+    s.part = LLACE_WASM_V128;
+    s.per = 128 / s.width;
+    s.parts = (lanes + s.per - 1) / s.per;
+  }
+  return s;
+}
+
+// The k-th scratch local of a key, live for one instruction
+static uint32_t wasm_temp(wasm_emit_t *e, uint8_t key, size_t k) {
+  size_t seen = 0;
+  LLACE_ARRAY_FOREACH(wasm_temp_t, temp, e->temps) {
+    if (temp->key == key && seen++ == k) return temp->local;
+  }
+  for (; seen <= k; ++seen) LLACE_ARRAY_PUSH(e->temps, ((wasm_temp_t){ key, e->next++ }));
+  return e->next - 1;
+}
+
+static wasm_type_t wasm_var_type(const llace_ir_function_t *fn, size_t var) {
+  const llace_ir_variable_t *v = LLACE_IR_VAR_AT(fn, var);
+  return (wasm_type_t){ v->type, v->attr.depth };
+}
+
+static llace_error_t wasm_push(wasm_emit_t *e, wasm_type_t t) {
+  if (t.depth == 0 && t.type.kind == LLACE_IR_TYPE_VOID) return LLACE_ERROR_INVLTYPE;
+  LLACE_ARRAY_PUSH(e->types, t);
+  return LLACE_ERROR_NONE;
+}
+
+static llace_error_t wasm_top(wasm_emit_t *e, wasm_type_t *t) {
+  if (LLACE_ARRAY_IS_EMPTY(e->types)) return LLACE_ERROR_INVLFUNC;
+  *t = *LLACE_ARRAY_BACK(wasm_type_t, e->types);
+  return LLACE_ERROR_NONE;
+}
+
+// Converts the value on top to another value type, integers keep their sign
+static llace_error_t wasm_coerce(wasm_emit_t *e, wasm_type_t from, uint8_t to) {
+  uint8_t have = wasm_valtype(from);
+  if (have == to) return LLACE_ERROR_NONE;
+  if (have == LLACE_WASM_I64 && to == LLACE_WASM_I32) wasm_op(e, WASM_I32_WRAP_I64);
+  else if (have == LLACE_WASM_I32 && to == LLACE_WASM_I64) wasm_op(e, wasm_signed(from) ? WASM_I64_EXTEND_I32_S : WASM_I64_EXTEND_I32_U);
+  else if (have == LLACE_WASM_F64 && to == LLACE_WASM_F32) wasm_op(e, WASM_F32_DEMOTE_F64);
+  else if (have == LLACE_WASM_F32 && to == LLACE_WASM_F64) wasm_op(e, WASM_F64_PROMOTE_F32);
+  else return LLACE_ERROR_INVLTYPE;
+  return LLACE_ERROR_NONE;
+}
+
+// Brings both operands of a binary op to the value type of the one it takes its type from
+static llace_error_t wasm_operands(wasm_emit_t *e, wasm_type_t lhs, wasm_type_t rhs, wasm_type_t from) {
+  uint8_t to = wasm_valtype(from);
+  if (wasm_valtype(lhs) == to) return wasm_coerce(e, rhs, to);
+  uint32_t scratch = wasm_temp(e, wasm_valtype(rhs), 0);
+  wasm_op_u(e, WASM_LOCAL_SET, scratch);
+  LLACE_RUNCHECK(wasm_coerce(e, lhs, to));
+  wasm_op_u(e, WASM_LOCAL_GET, scratch);
+  return wasm_coerce(e, rhs, to);
+}
+
+// Narrow integers are brought back to their width after ops that can carry out of it
+static void wasm_norm(wasm_emit_t *e, wasm_type_t t) {
+  size_t width = wasm_width(t);
+  bool wide = wasm_valtype(t) == LLACE_WASM_I64;
+  size_t full = wide ? 64 : 32;
+  if (width >= full) return;
+  if (!wasm_signed(t)) {
+    wasm_iconst(e, wide, (int64_t)((UINT64_C(1) << width) - 1));
+    wasm_op(e, WASM_I32_AND + (wide ? WASM_WIDE_ARITH : 0));
+  } else if (width == 8 || width == 16 || width == 32) {
+    wasm_op(e, wide ? (width == 8 ? WASM_I64_EXTEND8_S : width == 16 ? WASM_I64_EXTEND16_S : WASM_I64_EXTEND32_S)
+                    : (width == 8 ? WASM_I32_EXTEND8_S : WASM_I32_EXTEND16_S));
+  } else {
+    wasm_iconst(e, wide, (int64_t)(full - width));
+    wasm_op(e, WASM_I32_SHL + (wide ? WASM_WIDE_ARITH : 0));
+    wasm_iconst(e, wide, (int64_t)(full - width));
+    wasm_op(e, WASM_I32_SHR_S + (wide ? WASM_WIDE_ARITH : 0));
+  }
+}
+
+// Leaves an i32 that is zero for false on top, what if and br_if test
+static void wasm_truth(wasm_emit_t *e, wasm_type_t t) {
+  switch (wasm_valtype(t)) {
+  case LLACE_WASM_I64: wasm_op(e, WASM_I64_EQZ); wasm_op(e, WASM_I32_EQZ); break;
+  case LLACE_WASM_F32: wasm_op(e, WASM_F32_CONST); llace_codebuf_write(e->out, &(float){ 0.0f }, 4); wasm_op(e, WASM_F32_NE); break;
+  case LLACE_WASM_F64: wasm_op(e, WASM_F64_CONST); llace_codebuf_write(e->out, &(double){ 0.0 }, 8); wasm_op(e, WASM_F64_EQ + 1); break;
+  default: break;
+  }
+}
+
+static void wasm_const(wasm_emit_t *e, const llace_ir_value_t *value) {
+  wasm_type_t t = { value->type, 0 };
+  if (wasm_float(t)) {
+    if (wasm_valtype(t) == LLACE_WASM_F32) {
+      float single = (float)value->_float;
+      wasm_op(e, WASM_F32_CONST);
+      llace_codebuf_write(e->out, &single, sizeof(single));
+    } else {
+      wasm_op(e, WASM_F64_CONST);
+      llace_codebuf_write(e->out, &value->_float, sizeof(value->_float));
+    }
+    return;
+  }
+  unsigned shift = (unsigned)(64 - wasm_width(t));
+  uint64_t word = value->_unt << shift;
+  word = wasm_signed(t) ? (uint64_t)((int64_t)word >> shift) : word >> shift;
+  wasm_iconst(e, wasm_valtype(t) == LLACE_WASM_I64, (int64_t)word);
+}
+
+// Binary op on two values of the value type of t
+static llace_error_t wasm_arith(wasm_emit_t *e, llace_ir_opcode_t opcode, wasm_type_t t) {
+  if (wasm_float(t)) {
+    if (opcode > LLACE_IR_OP_DIV) return LLACE_ERROR_INVLTYPE;
+    wasm_op(e, (wasm_valtype(t) == LLACE_WASM_F32 ? WASM_F32_ADD : WASM_F64_ADD) + (opcode - LLACE_IR_OP_ADD));
+    return LLACE_ERROR_NONE;
+  }
+  bool sign = wasm_signed(t), norm = true;
+  uint8_t op;
+  switch (opcode) {
+  case LLACE_IR_OP_ADD: op = WASM_I32_ADD; break;
+  case LLACE_IR_OP_SUB: op = WASM_I32_SUB; break;
+  case LLACE_IR_OP_MUL: op = WASM_I32_MUL; break;
+  case LLACE_IR_OP_SHL: op = WASM_I32_SHL; break;
+  case LLACE_IR_OP_DIV: op = sign ? WASM_I32_DIV_S : WASM_I32_DIV_U; norm = sign; break;
+  case LLACE_IR_OP_MOD: op = sign ? WASM_I32_REM_S : WASM_I32_REM_U; norm = false; break;
+  case LLACE_IR_OP_SHR: op = sign ? WASM_I32_SHR_S : WASM_I32_SHR_U; norm = false; break;
+  case LLACE_IR_OP_AND: op = WASM_I32_AND; norm = false; break;
+  case LLACE_IR_OP_OR: op = WASM_I32_OR; norm = false; break;
+  default: op = WASM_I32_XOR; norm = false; break;
+  }
+  wasm_op(e, op + (wasm_valtype(t) == LLACE_WASM_I64 ? WASM_WIDE_ARITH : 0));
+  if (norm) wasm_norm(e, t);
+  return LLACE_ERROR_NONE;
+}
+
+// A scalar from the address on top
+static void wasm_load(wasm_emit_t *e, wasm_type_t t, uint64_t offset) {
+  size_t width = wasm_width(t);
+  bool sign = wasm_signed(t);
+  if (wasm_float(t)) {
+    bool single = wasm_valtype(t) == LLACE_WASM_F32;
+    wasm_memop(e, single ? WASM_F32_LOAD : WASM_F64_LOAD, single ? 2 : 3, offset);
+  } else if (width <= 8) {
+    wasm_memop(e, sign ? WASM_I32_LOAD8_S : WASM_I32_LOAD8_U, 0, offset);
+    if (width < 8) wasm_norm(e, t);
+  } else if (width <= 16) {
+    wasm_memop(e, sign ? WASM_I32_LOAD16_S : WASM_I32_LOAD16_U, 1, offset);
+    if (width < 16) wasm_norm(e, t);
+  } else if (width <= 32) {
+    wasm_memop(e, WASM_I32_LOAD, 2, offset);
+    wasm_norm(e, t);
+  } else {
+    wasm_memop(e, WASM_I64_LOAD, 3, offset);
+    wasm_norm(e, t);
+  }
+}
+
+// A scalar on top to the address below it
+static void wasm_store(wasm_emit_t *e, wasm_type_t t, uint64_t offset) {
+  size_t width = wasm_width(t);
+  switch (wasm_valtype(t)) {
+  case LLACE_WASM_F32: wasm_memop(e, WASM_F32_STORE, 2, offset); break;
+  case LLACE_WASM_F64: wasm_memop(e, WASM_F64_STORE, 3, offset); break;
+  case LLACE_WASM_I64: wasm_memop(e, WASM_I64_STORE, 3, offset); break;
+  default: wasm_memop(e, width <= 8 ? WASM_I32_STORE8 : width <= 16 ? WASM_I32_STORE16 : WASM_I32_STORE, width <= 8 ? 0 : width <= 16 ? 1 : 2, offset); break;
+  }
+}
+
+// ================ Vectors ================ //
+
+// The simd128 op of a vector op, 0 if it has none; shifts take one count for every lane
+static uint8_t wasm_vop(llace_ir_opcode_t op, wasm_shape_t s, wasm_type_t lane, bool by) {
+  if (s.part != LLACE_WASM_V128) return 0;
+  bool flt = wasm_float(lane);
+  switch (op) {
+  case LLACE_IR_OP_ADD: case LLACE_IR_OP_SUB: case LLACE_IR_OP_MUL: case LLACE_IR_OP_DIV:
+    return by ? 0 : wasm_varith[s.form][op - LLACE_IR_OP_ADD];
+  case LLACE_IR_OP_SHL: return by ? wasm_varith[s.form][4] : 0;
+  case LLACE_IR_OP_SHR: return by ? wasm_varith[s.form][wasm_signed(lane) ? 5 : 6] : 0;
+  case LLACE_IR_OP_AND: return by || flt ? 0 : WASM_V128_AND;
+  case LLACE_IR_OP_OR: return by || flt ? 0 : WASM_V128_OR;
+  case LLACE_IR_OP_XOR: return by || flt ? 0 : WASM_V128_XOR;
+  default: return 0;
+  }
+}
+
+// simd128 unless the cost table has it dearer than two extracts, the scalar op and a replace per lane
+static bool wasm_vcheap(const wasm_emit_t *e, llace_ir_opcode_t op, wasm_shape_t s, wasm_type_t lane) {
+  llace_cost_t cost = op == LLACE_IR_OP_MUL ? LLACE_COST_MUL : op == LLACE_IR_OP_DIV ? LLACE_COST_DIV
+                    : op == LLACE_IR_OP_SHL || op == LLACE_IR_OP_SHR ? LLACE_COST_SHIFT : LLACE_COST_ALU;
+  bool flt = wasm_float(lane);
+  unsigned vector = llace_target_cost(e->target, cost, s.width, s.per, flt);
+  unsigned scalar = llace_target_cost(e->target, cost, wasm_width(lane), 0, flt);
+  unsigned extract = llace_target_cost(e->target, LLACE_COST_EXTRACT, s.width, s.per, flt);
+  if (vector == LLACE_COST_UNSUPPORTED) return false;
+  if (scalar == LLACE_COST_UNSUPPORTED || extract == LLACE_COST_UNSUPPORTED) return true;
+  return vector <= s.per * (scalar + 3 * extract);
+}
+
+// Widened lanes are brought back to the width of the IR lane
+static void wasm_vnorm(wasm_emit_t *e, wasm_shape_t s, wasm_type_t lane) {
+  size_t width = wasm_width(lane);
+  if (wasm_float(lane) || s.part != LLACE_WASM_V128 || width >= s.width) return;
+  if (wasm_signed(lane)) {
+    wasm_iconst(e, false, (int64_t)(s.width - width));
+    wasm_simd(e, wasm_varith[s.form][4]);
+    wasm_iconst(e, false, (int64_t)(s.width - width));
+    wasm_simd(e, wasm_varith[s.form][5]);
+    return;
+  }
+  uint8_t mask[16] = {0};
+  uint64_t ones = (UINT64_C(1) << width) - 1;
+  for (size_t i = 0; i < 16; ++i) mask[i] = (uint8_t)(ones >> (8 * (i % (s.width / 8))));
+  wasm_v128(e, mask);
+  wasm_simd(e, WASM_V128_AND);
+}
+
+static void wasm_vextract(wasm_emit_t *e, wasm_shape_t s, wasm_type_t lane, size_t j) {
+  wasm_simd_lane(e, wasm_extract[s.form][!wasm_signed(lane)], j);
+}
+
+static llace_error_t wasm_varith_op(wasm_emit_t *e, llace_ir_opcode_t op, wasm_type_t lhs, wasm_type_t rhs) {
+  bool by = !wasm_vec(rhs); // shift by one count
+  if (!wasm_vec(lhs) || (by ? op != LLACE_IR_OP_SHL && op != LLACE_IR_OP_SHR : !llace_ir_type_eq(lhs.type, rhs.type))) return LLACE_ERROR_INVLTYPE;
+  wasm_type_t lane = wasm_lane(lhs);
+  if (wasm_float(lane) && op > LLACE_IR_OP_DIV) return LLACE_ERROR_INVLTYPE;
+  wasm_shape_t s = wasm_shape(e, lhs);
+  uint8_t code = wasm_vop(op, s, lane, by);
+  bool simd = code != 0 && wasm_vcheap(e, op, s, lane);
+  bool norm = op == LLACE_IR_OP_ADD || op == LLACE_IR_OP_SUB || op == LLACE_IR_OP_MUL || op == LLACE_IR_OP_SHL;
+  size_t parts = s.parts, lanes = lhs.type.lanes;
+  simd ? ++e->vector : ++e->scalarized;
+
+  if (simd && parts == 1) {
+    if (by) LLACE_RUNCHECK(wasm_coerce(e, rhs, LLACE_WASM_I32));
+    wasm_simd(e, code);
+    if (norm) wasm_vnorm(e, s, lane);
+    return LLACE_ERROR_NONE;
+  }
+
+  // Split or lane by lane, both operands go to temps
+  uint32_t count = 0;
+  if (by) {
+    uint8_t vt = simd ? LLACE_WASM_I32 : wasm_valtype(lane);
+    LLACE_RUNCHECK(wasm_coerce(e, rhs, vt));
+    count = wasm_temp(e, vt, vt == s.part ? 2 * parts : 0);
+    wasm_op_u(e, WASM_LOCAL_SET, count);
+  } else {
+    for (size_t k = parts; k-- > 0;) wasm_op_u(e, WASM_LOCAL_SET, wasm_temp(e, s.part, parts + k));
+  }
+  for (size_t k = parts; k-- > 0;) wasm_op_u(e, WASM_LOCAL_SET, wasm_temp(e, s.part, k));
+
+  for (size_t k = 0; k < parts; ++k) {
+    uint32_t a = wasm_temp(e, s.part, k), b = by ? count : wasm_temp(e, s.part, parts + k);
+    wasm_op_u(e, WASM_LOCAL_GET, a);
+    if (simd || s.part != LLACE_WASM_V128) {
+      wasm_op_u(e, WASM_LOCAL_GET, b);
+      if (simd) {
+        wasm_simd(e, code);
+        if (norm) wasm_vnorm(e, s, lane);
+      } else {
+        LLACE_RUNCHECK(wasm_arith(e, op, lane));
+      }
+      continue;
+    }
+    for (size_t j = 0, used = LLACE_MIN(s.per, lanes - k * s.per); j < used; ++j) {
+      wasm_op_u(e, WASM_LOCAL_GET, a);
+      wasm_vextract(e, s, lane, j);
+      wasm_op_u(e, WASM_LOCAL_GET, b);
+      if (!by) wasm_vextract(e, s, lane, j);
+      LLACE_RUNCHECK(wasm_arith(e, op, lane));
+      wasm_simd_lane(e, wasm_replace[s.form], j);
+    }
+  }
+  return LLACE_ERROR_NONE;
+}
+
+static unsigned wasm_align(size_t bytes) {
+  return bytes <= 1 ? 0 : bytes == 2 ? 1 : bytes == 4 ? 2 : 3;
+}
+
+// A vector from the address on top, whole parts with v128.load and the rest lane by lane;
+// lanes are as far apart in memory as they are wide in a v128
+static void wasm_vload(wasm_emit_t *e, wasm_type_t t) {
+  wasm_shape_t s = wasm_shape(e, t);
+  wasm_type_t lane = wasm_lane(t);
+  size_t bytes = s.width / 8, lanes = t.type.lanes;
+  uint32_t addr = wasm_temp(e, WASM_TEMP_ADDR, 0);
+  bool simd = false;
+  wasm_op_u(e, WASM_LOCAL_SET, addr);
+
+  for (size_t k = 0; k < s.parts; ++k) {
+    size_t used = LLACE_MIN(s.per, lanes - k * s.per), at = k * s.per * bytes;
+    if (s.part == LLACE_WASM_V128 && used == s.per) {
+      wasm_op_u(e, WASM_LOCAL_GET, addr);
+      wasm_simd_mem(e, WASM_V128_LOAD, wasm_align(bytes), at);
+      wasm_vnorm(e, s, lane);
+      simd = true;
+      continue;
+    }
+    if (s.part == LLACE_WASM_V128) wasm_v128(e, (const uint8_t[16]){0});
+    for (size_t j = 0; j < used; ++j) {
+      wasm_op_u(e, WASM_LOCAL_GET, addr);
+      wasm_load(e, lane, at + j * bytes);
+      if (s.part == LLACE_WASM_V128) wasm_simd_lane(e, wasm_replace[s.form], j);
+    }
+  }
+  simd ? ++e->vector : ++e->scalarized;
+}
+
+// A vector below the address on top to it
+static void wasm_vstore(wasm_emit_t *e, wasm_type_t t) {
+  wasm_shape_t s = wasm_shape(e, t);
+  wasm_type_t lane = wasm_lane(t);
+  size_t bytes = s.width / 8, lanes = t.type.lanes;
+  uint32_t addr = wasm_temp(e, WASM_TEMP_ADDR, 0);
+  bool simd = false;
+  wasm_op_u(e, WASM_LOCAL_SET, addr);
+  for (size_t k = s.parts; k-- > 0;) wasm_op_u(e, WASM_LOCAL_SET, wasm_temp(e, s.part, k));
+
+  for (size_t k = 0; k < s.parts; ++k) {
+    size_t used = LLACE_MIN(s.per, lanes - k * s.per), at = k * s.per * bytes;
+    uint32_t part = wasm_temp(e, s.part, k);
+    if (s.part == LLACE_WASM_V128 && used == s.per) {
+      wasm_op_u(e, WASM_LOCAL_GET, addr);
+      wasm_op_u(e, WASM_LOCAL_GET, part);
+      wasm_simd_mem(e, WASM_V128_STORE, wasm_align(bytes), at);
+      simd = true;
+      continue;
+    }
+    for (size_t j = 0; j < used; ++j) {
+      wasm_op_u(e, WASM_LOCAL_GET, addr);
+      wasm_op_u(e, WASM_LOCAL_GET, part);
+      if (s.part == LLACE_WASM_V128) wasm_vextract(e, s, lane, j);
+      wasm_store(e, lane, at + j * bytes);
+    }
+  }
+  simd ? ++e->vector : ++e->scalarized;
+}
+
+// One scalar on top to every lane
+static void wasm_vsplat(wasm_emit_t *e, wasm_type_t t) {
+  wasm_shape_t s = wasm_shape(e, t);
+  bool simd = s.part == LLACE_WASM_V128;
+  simd ? ++e->vector : ++e->scalarized;
+  if (simd && s.parts == 1) {
+    wasm_simd(e, wasm_splat[s.form]);
+    return;
+  }
+  uint32_t value = wasm_temp(e, wasm_valtype(wasm_lane(t)), 0);
+  wasm_op_u(e, WASM_LOCAL_SET, value);
+  for (size_t k = 0; k < s.parts; ++k) {
+    wasm_op_u(e, WASM_LOCAL_GET, value);
+    if (simd) wasm_simd(e, wasm_splat[s.form]);
+  }
+}
+
+// One scalar per lane on the stack, without simd128 they are the parts already
+static void wasm_vpack(wasm_emit_t *e, wasm_type_t t) {
+  wasm_shape_t s = wasm_shape(e, t);
+  size_t lanes = t.type.lanes;
+  if (s.part != LLACE_WASM_V128) {
+    ++e->scalarized;
+    return;
+  }
+  uint8_t vt = wasm_valtype(wasm_lane(t));
+  for (size_t i = lanes; i-- > 0;) wasm_op_u(e, WASM_LOCAL_SET, wasm_temp(e, vt, i));
+  for (size_t k = 0; k < s.parts; ++k) {
+    for (size_t j = 0, used = LLACE_MIN(s.per, lanes - k * s.per); j < used; ++j) {
+      wasm_op_u(e, WASM_LOCAL_GET, wasm_temp(e, vt, k * s.per + j));
+      if (j == 0) wasm_simd(e, wasm_splat[s.form]);
+      else wasm_simd_lane(e, wasm_replace[s.form], j);
+    }
+  }
+  ++e->vector;
+}
+
+// Lane i of the vector on top, the other parts are dropped
+static void wasm_vlane(wasm_emit_t *e, wasm_type_t t, size_t i) {
+  wasm_shape_t s = wasm_shape(e, t);
+  size_t k = i / s.per;
+  for (size_t d = s.parts - 1; d > k; --d) wasm_op(e, WASM_DROP);
+  if (k > 0) {
+    uint32_t part = wasm_temp(e, s.part, 0);
+    wasm_op_u(e, WASM_LOCAL_SET, part);
+    for (size_t d = 0; d < k; ++d) wasm_op(e, WASM_DROP);
+    wasm_op_u(e, WASM_LOCAL_GET, part);
+  }
+  if (s.part == LLACE_WASM_V128) {
+    wasm_vextract(e, s, wasm_lane(t), i % s.per);
+    ++e->vector;
+  } else {
+    ++e->scalarized;
+  }
+}
+
+static llace_error_t wasm_vinstr(wasm_emit_t *e, const llace_ir_instr_t *instr) {
+  size_t count = LLACE_ARRAY_COUNT(e->types), base = count - instr->in;
+  wasm_type_t lhs = instr->in > 0 ? *LLACE_ARRAY_GET(wasm_type_t, e->types, base) : (wasm_type_t){ LLACE_IR_VOID, 0 };
+  wasm_type_t rhs = instr->in > 1 ? *LLACE_ARRAY_GET(wasm_type_t, e->types, base + 1) : (wasm_type_t){ LLACE_IR_VOID, 0 };
+  wasm_type_t result = lhs;
+  bool imm = e->imm.count == count && e->imm.end == e->out->size; // the operand on top was the constant just emitted
+
+  switch (instr->op) {
+  case LLACE_IR_OP_ADD: case LLACE_IR_OP_SUB: case LLACE_IR_OP_MUL: case LLACE_IR_OP_DIV: case LLACE_IR_OP_MOD:
+  case LLACE_IR_OP_AND: case LLACE_IR_OP_OR: case LLACE_IR_OP_XOR: case LLACE_IR_OP_SHL: case LLACE_IR_OP_SHR:
+    LLACE_RUNCHECK(wasm_varith_op(e, instr->op, lhs, rhs));
+    break;
+  case LLACE_IR_OP_LOAD:
+    // Lanes of an element pointer, or through a pointer to a vector
+    if (lhs.depth != 1 || LLACE_IR_IS_VEC(lhs.type) == (instr->lanes > 0)) return LLACE_ERROR_INVLTYPE;
+    result = (wasm_type_t){ instr->lanes ? llace_ir_type_vec(lhs.type, instr->lanes) : lhs.type, 0 };
+    wasm_vload(e, result);
+    break;
+  case LLACE_IR_OP_STORE: {
+    if (rhs.depth != 1 || LLACE_IR_IS_VEC(rhs.type) == (instr->lanes > 0)) return LLACE_ERROR_INVLTYPE;
+    llace_ir_type_t to = instr->lanes ? llace_ir_type_vec(rhs.type, instr->lanes) : rhs.type;
+    if (!wasm_vec(lhs) || !llace_ir_type_eq(lhs.type, to)) return LLACE_ERROR_INVLTYPE;
+    wasm_vstore(e, lhs);
+    break;
+  }
+  case LLACE_IR_OP_SPLAT: {
+    wasm_type_t value = *LLACE_ARRAY_GET(wasm_type_t, e->types, count - 1);
+    if (instr->lanes == 0 || value.depth > 0 || wasm_vec(value)) return LLACE_ERROR_INVLTYPE;
+    result = (wasm_type_t){ llace_ir_type_vec(value.type, instr->lanes), 0 };
+    wasm_vsplat(e, result);
+    break;
+  }
+  case LLACE_IR_OP_PACK: {
+    wasm_type_t value = *LLACE_ARRAY_GET(wasm_type_t, e->types, count - 1);
+    if (instr->lanes == 0 || instr->in != instr->lanes || value.depth > 0 || wasm_vec(value)) return LLACE_ERROR_INVLTYPE;
+    for (size_t i = base; i < count; ++i) {
+      wasm_type_t t = *LLACE_ARRAY_GET(wasm_type_t, e->types, i);
+      if (t.depth > 0 || wasm_vec(t) || wasm_valtype(t) != wasm_valtype(value)) return LLACE_ERROR_INVLTYPE;
+    }
+    result = (wasm_type_t){ llace_ir_type_vec(value.type, instr->lanes), 0 };
+    wasm_vpack(e, result);
+    break;
+  }
+  case LLACE_IR_OP_EXTRACT:
+    // wasm only reads lanes by immediate, the constant is taken back
+    if (!wasm_vec(lhs) || !imm) return LLACE_ERROR_INVLTYPE;
+    if (e->imm.value >= lhs.type.lanes) return LLACE_ERROR_INVLFUNC;
+    e->out->size = e->imm.at;
+    wasm_vlane(e, lhs, (size_t)e->imm.value);
+    result = wasm_lane(lhs);
+    break;
+  default:
+    return LLACE_ERROR_INVLTYPE; // compares, calls and indexing take scalars
+  }
+
+  e->types.element_count = base;
+  if (instr->out) LLACE_RUNCHECK(wasm_push(e, result));
+  return LLACE_ERROR_NONE;
+}
+
+// ================ Expressions ================ //
+
+static llace_error_t wasm_instr(wasm_emit_t *e, const llace_ir_instr_t *instr) {
+  size_t count = LLACE_ARRAY_COUNT(e->types);
+  if (instr->in > count) return LLACE_ERROR_INVLFUNC;
+  bool vector = instr->op == LLACE_IR_OP_SPLAT || instr->op == LLACE_IR_OP_PACK || instr->op == LLACE_IR_OP_EXTRACT;
+  bool memory = instr->op == LLACE_IR_OP_LOAD || instr->op == LLACE_IR_OP_STORE;
+  for (size_t i = count - instr->in; i < count; ++i) {
+    wasm_type_t t = *LLACE_ARRAY_GET(wasm_type_t, e->types, i);
+    vector |= wasm_vec(t) || (memory && t.depth == 1 && LLACE_IR_IS_VEC(t.type));
+  }
+  if (vector || (memory && instr->lanes)) return wasm_vinstr(e, instr);
+
+  wasm_type_t lhs = instr->in > 0 ? *LLACE_ARRAY_GET(wasm_type_t, e->types, count - instr->in) : (wasm_type_t){ LLACE_IR_VOID, 0 };
+  wasm_type_t rhs = instr->in > 1 ? *LLACE_ARRAY_GET(wasm_type_t, e->types, count - instr->in + 1) : (wasm_type_t){ LLACE_IR_VOID, 0 };
+  e->types.element_count -= instr->in;
+  wasm_type_t from;
+  llace_ir_type_arith(lhs.type, lhs.depth, rhs.type, rhs.depth, &from.type, &from.depth);
+  wasm_type_t result = { LLACE_IR_INT(1), 0 };
+
+  switch (instr->op) {
+  case LLACE_IR_OP_ADD: case LLACE_IR_OP_SUB: case LLACE_IR_OP_MUL: case LLACE_IR_OP_DIV: case LLACE_IR_OP_MOD:
+  case LLACE_IR_OP_AND: case LLACE_IR_OP_OR: case LLACE_IR_OP_XOR: case LLACE_IR_OP_SHL: case LLACE_IR_OP_SHR: {
+    result = from;
+    LLACE_RUNCHECK(wasm_operands(e, lhs, rhs, from));
+    LLACE_RUNCHECK(wasm_arith(e, instr->op, result));
+    break;
+  }
+  case LLACE_IR_OP_EQ: case LLACE_IR_OP_NE: case LLACE_IR_OP_LT: case LLACE_IR_OP_LE: case LLACE_IR_OP_GT: case LLACE_IR_OP_GE: {
+    static const uint8_t fcmp[] = { 0, 1, 2, 4, 3, 5 }; // eq ne lt gt le ge
+    static const uint8_t icmp[][2] = {
+      { WASM_I32_LT_S, WASM_I32_LT_U }, { WASM_I32_LE_S, WASM_I32_LE_U }, { WASM_I32_GT_S, WASM_I32_GT_U }, { WASM_I32_GE_S, WASM_I32_GE_U },
+    };
+    LLACE_RUNCHECK(wasm_operands(e, lhs, rhs, from));
+    uint8_t vt = wasm_valtype(from);
+    if (wasm_float(from)) {
+      wasm_op(e, (vt == LLACE_WASM_F32 ? WASM_F32_EQ : WASM_F64_EQ) + fcmp[instr->op - LLACE_IR_OP_EQ]);
+    } else {
+      uint8_t op = instr->op <= LLACE_IR_OP_NE ? WASM_I32_EQ + (instr->op - LLACE_IR_OP_EQ) : icmp[instr->op - LLACE_IR_OP_LT][!wasm_signed(from)];
+      wasm_op(e, op + (vt == LLACE_WASM_I64 ? WASM_WIDE_CMP : 0));
+    }
+    break;
+  }
+  case LLACE_IR_OP_NZ: case LLACE_IR_OP_Z:
+    if (wasm_float(lhs)) {
+      // Compared with zero, -0.0 is zero
+      wasm_truth(e, lhs);
+      if (instr->op == LLACE_IR_OP_Z) wasm_op(e, WASM_I32_EQZ);
+    } else {
+      wasm_op(e, wasm_valtype(lhs) == LLACE_WASM_I64 ? WASM_I64_EQZ : WASM_I32_EQZ);
+      if (instr->op == LLACE_IR_OP_NZ) wasm_op(e, WASM_I32_EQZ);
+    }
+    break;
+  case LLACE_IR_OP_LOAD:
+    if (lhs.depth == 0) return LLACE_ERROR_INVLFUNC;
+    result = (wasm_type_t){ lhs.type, lhs.depth - 1 };
+    if (!wasm_scalar(result)) return LLACE_ERROR_INVLTYPE;
+    wasm_load(e, result, 0);
+    break;
+  case LLACE_IR_OP_STORE: {
+    if (rhs.depth == 0) return LLACE_ERROR_INVLFUNC;
+    wasm_type_t to = { rhs.type, rhs.depth - 1 };
+    if (!wasm_scalar(to)) return LLACE_ERROR_INVLTYPE;
+    // The IR pushes the value first, wasm wants the address first
+    uint8_t vt = wasm_valtype(to);
+    uint32_t addr = wasm_temp(e, WASM_TEMP_ADDR, 0), value = wasm_temp(e, vt, 0);
+    wasm_op_u(e, WASM_LOCAL_SET, addr);
+    LLACE_RUNCHECK(wasm_coerce(e, lhs, vt));
+    wasm_op_u(e, WASM_LOCAL_SET, value);
+    wasm_op_u(e, WASM_LOCAL_GET, addr);
+    wasm_op_u(e, WASM_LOCAL_GET, value);
+    wasm_store(e, to, 0);
+    break;
+  }
+  case LLACE_IR_OP_INDEX: {
+    if (lhs.depth == 0) return LLACE_ERROR_INVLFUNC;
+    result = lhs;
+    LLACE_RUNCHECK(wasm_coerce(e, rhs, LLACE_WASM_I32));
+    size_t size = lhs.depth > 1 ? 4 : LLACE_MAX(llace_ir_type_bits(lhs.type) / 8, (size_t)1);
+    if (size != 1) {
+      wasm_iconst(e, false, (int64_t)size);
+      wasm_op(e, WASM_I32_MUL);
+    }
+    wasm_op(e, WASM_I32_ADD);
+    break;
+  }
+  case LLACE_IR_OP_CALL: {
+    const llace_ir_function_t *callee = LLACE_IR_FUNCTION(e->ctx, instr->func);
+    result = (wasm_type_t){ callee->ret, callee->retattr.depth };
+    wasm_op_u(e, WASM_CALL, *LLACE_ARRAY_GET(uint32_t, e->funcs, instr->func));
+    break;
+  }
+  default:
+    return LLACE_ERROR_INVLFUNC; // statements are taken apart by wasm_code
+  }
+
+  if (instr->out) LLACE_RUNCHECK(wasm_push(e, result));
+  return LLACE_ERROR_NONE;
+}
+
+// Emits the values [begin, end) of a block
+static llace_error_t wasm_expr(wasm_emit_t *e, const llace_ir_basicblock_t *block, size_t begin, size_t end) {
+  for (size_t i = begin; i < end; ++i) {
+    const llace_ir_value_t *value = LLACE_IR_STACK_AT(block, i);
+    switch (value->kind) {
+    case LLACE_IR_VALUE_CONST: {
+      if (!wasm_scalar((wasm_type_t){ value->type, 0 })) return LLACE_ERROR_INVLTYPE;
+      size_t at = e->out->size;
+      wasm_const(e, value);
+      LLACE_RUNCHECK(wasm_push(e, (wasm_type_t){ value->type, 0 }));
+      e->imm = (wasm_imm_t){ LLACE_ARRAY_COUNT(e->types), at, e->out->size, value->_unt };
+      break;
+    }
+    case LLACE_IR_VALUE_VAR: {
+      wasm_type_t t = wasm_var_type(e->fn, value->var);
+      uint32_t local = *LLACE_ARRAY_GET(uint32_t, e->locals, value->var);
+      for (size_t k = 0, parts = wasm_shape(e, t).parts; k < parts; ++k) wasm_op_u(e, WASM_LOCAL_GET, local + (uint32_t)k);
+      LLACE_RUNCHECK(wasm_push(e, t));
+      break;
+    }
+    case LLACE_IR_VALUE_GLOBAL: {
+      const llace_ir_global_t *glob = LLACE_IR_GLOBAL_AT(e->ctx, value->global);
+      wasm_iconst(e, false, *LLACE_ARRAY_GET(uint32_t, e->addrs, value->global));
+      LLACE_RUNCHECK(wasm_push(e, (wasm_type_t){ glob->type, glob->attr.depth + 1 }));
+      break;
+    }
+    case LLACE_IR_VALUE_BLOCK:
+      return LLACE_ERROR_INVLFUNC;
+    case LLACE_IR_VALUE_INSTR:
+      LLACE_RUNCHECK(wasm_instr(e, &value->instr));
+      break;
+    }
+  }
+  return LLACE_ERROR_NONE;
+}
+
+// Brings the value on top to the type of a variable, vectors only go to their own type
+static llace_error_t wasm_fit(wasm_emit_t *e, size_t var) {
+  wasm_type_t top, t = wasm_var_type(e->fn, var);
+  LLACE_RUNCHECK(wasm_top(e, &top));
+  if (wasm_vec(top) || wasm_vec(t)) return wasm_vec(top) && wasm_vec(t) && llace_ir_type_eq(top.type, t.type) ? LLACE_ERROR_NONE : LLACE_ERROR_INVLTYPE;
+  return wasm_coerce(e, top, wasm_valtype(t));
+}
+
+// Parts are set last first
+static void wasm_local_set(wasm_emit_t *e, size_t var) {
+  uint32_t local = *LLACE_ARRAY_GET(uint32_t, e->locals, var);
+  for (size_t k = wasm_shape(e, wasm_var_type(e->fn, var)).parts; k-- > 0;) wasm_op_u(e, WASM_LOCAL_SET, local + (uint32_t)k);
+}
+
+// Pops the value on top into a variable
+static llace_error_t wasm_set(wasm_emit_t *e, size_t var) {
+  LLACE_RUNCHECK(wasm_fit(e, var));
+  wasm_local_set(e, var);
+  --e->types.element_count;
+  return LLACE_ERROR_NONE;
+}
+
+// ================ Control Flow ================ //
+
+static llace_error_t wasm_tree(wasm_emit_t *e, size_t block);
+
+#define WASM_ORDER(e, block) (*LLACE_ARRAY_GET(size_t, (e)->cfg.order, (block)))
+
+// Phis of the target read the values of the edge, all inputs are pushed before the first store
+static llace_error_t wasm_edge(wasm_emit_t *e, size_t from, size_t to) {
+  const llace_ir_basicblock_t *block = LLACE_IR_BLOCK_AT(e->fn, to);
+  e->types.element_count = 0;
+  e->copies.element_count = 0;
+
+  for (size_t i = 0; i < LLACE_ARRAY_COUNT(block->stack); ++i) {
+    const llace_ir_value_t *value = LLACE_IR_STACK_AT(block, i);
+    if (!LLACE_IR_IS_OP(value, LLACE_IR_OP_PHI)) continue;
+    for (size_t p = i - value->instr.in; p < i; p += 2) {
+      if (LLACE_IR_STACK_AT(block, p + 1)->block != from) continue;
+      size_t var = LLACE_IR_STACK_AT(block, i + 1)->var;
+      LLACE_RUNCHECK(wasm_expr(e, block, p, p + 1));
+      LLACE_RUNCHECK(wasm_fit(e, var));
+      LLACE_ARRAY_PUSH(e->copies, var);
+      break;
+    }
+  }
+  for (size_t c = LLACE_ARRAY_COUNT(e->copies); c-- > 0;) wasm_local_set(e, *LLACE_ARRAY_GET(size_t, e->copies, c));
+  e->types.element_count = 0;
+  return LLACE_ERROR_NONE;
+}
+
+// Branches to the label of the innermost frame of that kind opened for block
+static llace_error_t wasm_br(wasm_emit_t *e, wasm_frame_kind_t kind, size_t block) {
+  size_t count = LLACE_ARRAY_COUNT(e->frames);
+  for (size_t f = count; f-- > 0;) {
+    const wasm_frame_t *frame = LLACE_ARRAY_GET(wasm_frame_t, e->frames, f);
+    if (frame->kind != kind || frame->block != block) continue;
+    wasm_op_u(e, WASM_BR, count - 1 - f);
+    return LLACE_ERROR_NONE;
+  }
+  return LLACE_ERROR_INVLFUNC;
+}
+
+// An edge goes back to its loop, forward to the end of the block opened for a merge, or inlines its target
+static llace_error_t wasm_branch(wasm_emit_t *e, size_t from, const llace_ir_value_t *target) {
+  if (target->kind != LLACE_IR_VALUE_BLOCK) return LLACE_ERROR_INVLFUNC;
+  size_t to = target->block;
+  LLACE_RUNCHECK(wasm_edge(e, from, to));
+  if (WASM_ORDER(e, to) <= WASM_ORDER(e, from)) return wasm_br(e, WASM_FRAME_LOOP, to);
+  if (*LLACE_ARRAY_GET(size_t, e->merges, to) > 1) return wasm_br(e, WASM_FRAME_BLOCK, to);
+  return wasm_tree(e, to);
+}
+
+static void wasm_open(wasm_emit_t *e, uint8_t op, wasm_frame_kind_t kind, size_t block) {
+  wasm_op(e, op);
+  wasm_op(e, WASM_VOID);
+  LLACE_ARRAY_PUSH(e->frames, ((wasm_frame_t){ kind, block }));
+}
+
+static void wasm_close(wasm_emit_t *e) {
+  wasm_op(e, WASM_END);
+  --e->frames.element_count;
+}
+
+// Statements of a block, the terminator ends the code
+static llace_error_t wasm_code(wasm_emit_t *e, size_t index) {
+  const llace_ir_basicblock_t *block = LLACE_IR_BLOCK_AT(e->fn, index);
+  LLACE_RUNCHECK(llace_ir_block_stmts(block, &e->stmts));
+
+  for (size_t s = 0; s < LLACE_ARRAY_COUNT(e->stmts); ++s) {
+    llace_ir_stmt_t stmt = *LLACE_ARRAY_GET(llace_ir_stmt_t, e->stmts, s); // the blocks inlined below reuse stmts
+    const llace_ir_instr_t *instr = LLACE_IR_STMT_INSTR(block, &stmt);
+    e->types.element_count = 0;
+    e->imm = (wasm_imm_t){0};
+
+    switch (instr->op) {
+    case LLACE_IR_OP_ASSIGN: {
+      if (stmt.end - stmt.begin >= 3 && LLACE_IR_IS_OP(LLACE_IR_STACK_AT(block, stmt.end - 3), LLACE_IR_OP_PHI)) {
+        continue; // set on the incoming edges
+      }
+      size_t var;
+      llace_ir_stmt_def(block, &stmt, &var);
+      LLACE_RUNCHECK(wasm_expr(e, block, stmt.begin, stmt.end - 2));
+      LLACE_RUNCHECK(wasm_set(e, var));
+      break;
+    }
+    case LLACE_IR_OP_JMP:
+      return wasm_branch(e, index, LLACE_IR_STACK_AT(block, stmt.end - 2));
+    case LLACE_IR_OP_BRANCH: {
+      wasm_type_t cond;
+      LLACE_RUNCHECK(wasm_expr(e, block, stmt.begin, stmt.end - 3));
+      LLACE_RUNCHECK(wasm_top(e, &cond));
+      wasm_truth(e, cond);
+      wasm_open(e, WASM_IF, WASM_FRAME_IF, index);
+      LLACE_RUNCHECK(wasm_branch(e, index, LLACE_IR_STACK_AT(block, stmt.end - 3)));
+      wasm_op(e, WASM_ELSE);
+      LLACE_RUNCHECK(wasm_branch(e, index, LLACE_IR_STACK_AT(block, stmt.end - 2)));
+      wasm_close(e);
+      return LLACE_ERROR_NONE;
+    }
+    case LLACE_IR_OP_RET:
+      LLACE_RUNCHECK(wasm_expr(e, block, stmt.begin, stmt.end - 1));
+      if (instr->in) {
+        wasm_type_t top;
+        LLACE_RUNCHECK(wasm_top(e, &top));
+        LLACE_RUNCHECK(wasm_coerce(e, top, wasm_valtype((wasm_type_t){ e->fn->ret, e->fn->retattr.depth })));
+      }
+      wasm_op(e, WASM_RETURN);
+      return LLACE_ERROR_NONE;
+    default:
+      LLACE_RUNCHECK(wasm_expr(e, block, stmt.begin, stmt.end));
+      LLACE_ARRAY_FOREACH(wasm_type_t, t, e->types) {
+        for (size_t k = wasm_shape(e, *t).parts; k > 0; --k) wasm_op(e, WASM_DROP);
+      }
+      break;
+    }
+  }
+  return LLACE_ERROR_INVLFUNC; // no terminator
+}
+
+// A block with the blocks it dominates (Ramsey): one wasm block per child that
+// edges merge into, the latest in reverse post order outermost, so each child
+// follows the end of its block and every edge into it is a forward br
+static llace_error_t wasm_tree(wasm_emit_t *e, size_t block) {
+  bool header = *LLACE_ARRAY_GET(bool, e->headers, block);
+  size_t first = *LLACE_ARRAY_GET(size_t, e->first, block), last = *LLACE_ARRAY_GET(size_t, e->first, block + 1);
+  if (header) wasm_open(e, WASM_LOOP, WASM_FRAME_LOOP, block);
+
+  for (size_t k = last; k-- > first;) {
+    size_t child = *LLACE_ARRAY_GET(size_t, e->kids, k);
+    if (*LLACE_ARRAY_GET(size_t, e->merges, child) > 1) wasm_open(e, WASM_BLOCK, WASM_FRAME_BLOCK, child);
+  }
+  LLACE_RUNCHECK(wasm_code(e, block));
+  for (size_t k = first; k < last; ++k) {
+    size_t child = *LLACE_ARRAY_GET(size_t, e->kids, k);
+    if (*LLACE_ARRAY_GET(size_t, e->merges, child) < 2) continue;
+    wasm_close(e);
+    LLACE_RUNCHECK(wasm_tree(e, child));
+  }
+
+  if (header) wasm_close(e);
+  return LLACE_ERROR_NONE;
+}
+
+// Counts the forward edges into each block, marks loop headers and groups the dominator tree
+static llace_error_t wasm_structure(wasm_emit_t *e) {
+  const llace_ir_cfg_t *cfg = &e->cfg;
+  size_t blocks = cfg->block_count, reachable = LLACE_ARRAY_COUNT(cfg->rpo);
+  e->merges.element_count = e->headers.element_count = e->first.element_count = e->kids.element_count = 0;
+  for (size_t b = 0; b <= blocks; ++b) {
+    LLACE_ARRAY_PUSH(e->merges, (size_t)0);
+    LLACE_ARRAY_PUSH(e->headers, false);
+    LLACE_ARRAY_PUSH(e->first, (size_t)0);
+  }
+
+  for (size_t i = 0; i < reachable; ++i) {
+    size_t from = *LLACE_ARRAY_GET(size_t, cfg->rpo, i);
+    const llace_ir_basicblock_t *block = LLACE_IR_BLOCK_AT(e->fn, from);
+    size_t count = LLACE_ARRAY_COUNT(block->stack);
+    if (count == 0) return LLACE_ERROR_INVLFUNC;
+    const llace_ir_value_t *term = LLACE_IR_STACK_AT(block, count - 1);
+    size_t targets = LLACE_IR_IS_OP(term, LLACE_IR_OP_JMP) ? 1 : LLACE_IR_IS_OP(term, LLACE_IR_OP_BRANCH) ? 2 : 0;
+
+    // Both sides of a branch to one block count, the block cannot be inlined twice
+    for (size_t t = 0; t < targets; ++t) {
+      const llace_ir_value_t *target = LLACE_IR_STACK_AT(block, count - 1 - targets + t);
+      if (target->kind != LLACE_IR_VALUE_BLOCK) return LLACE_ERROR_INVLFUNC;
+      if (WASM_ORDER(e, target->block) > i) {
+        ++*LLACE_ARRAY_GET(size_t, e->merges, target->block);
+      } else if (llace_ir_cfg_dominates(cfg, target->block, from)) {
+        *LLACE_ARRAY_GET(bool, e->headers, target->block) = true;
+      } else {
+        LLACE_LOG_ERROR("Function '%s' has irreducible control flow into block '%s'", e->fn->name, LLACE_IR_BLOCK_AT(e->fn, target->block)->name);
+        return LLACE_ERROR_INVLFUNC;
+      }
+    }
+  }
+
+  // Children in reverse post order: count per parent, then place
+  for (size_t i = 1; i < reachable; ++i) {
+    size_t parent = LLACE_IR_CFG_IDOM(cfg, *LLACE_ARRAY_GET(size_t, cfg->rpo, i));
+    ++*LLACE_ARRAY_GET(size_t, e->first, parent + 1);
+  }
+  for (size_t b = 0; b < blocks; ++b) *LLACE_ARRAY_GET(size_t, e->first, b + 1) += *LLACE_ARRAY_GET(size_t, e->first, b);
+  for (size_t i = 1; i < reachable; ++i) LLACE_ARRAY_PUSH(e->kids, (size_t)0);
+  for (size_t i = 1; i < reachable; ++i) {
+    size_t child = *LLACE_ARRAY_GET(size_t, cfg->rpo, i);
+    size_t parent = LLACE_IR_CFG_IDOM(cfg, child);
+    *LLACE_ARRAY_GET(size_t, e->kids, (*LLACE_ARRAY_GET(size_t, e->first, parent))++) = child;
+  }
+  // Placing moved every start to the next parent's, shift them back
+  for (size_t b = blocks; b > 0; --b) *LLACE_ARRAY_GET(size_t, e->first, b) = *LLACE_ARRAY_GET(size_t, e->first, b - 1);
+  *LLACE_ARRAY_GET(size_t, e->first, 0) = 0;
+  return LLACE_ERROR_NONE;
+}
+
+// ================ Functions ================ //
+
+// The code goes to a buffer first, the temps it took are declared before it
+static llace_error_t wasm_body(wasm_emit_t *e) {
+  const llace_ir_function_t *fn = e->fn;
+  size_t vars = LLACE_ARRAY_COUNT(fn->vars);
+  e->locals.element_count = e->temps.element_count = 0;
+  e->next = 0;
+  for (size_t v = 0; v < vars; ++v) {
+    wasm_type_t t = wasm_var_type(fn, v);
+    if (t.depth == 0 && t.type.kind == LLACE_IR_TYPE_VOID) return LLACE_ERROR_INVLTYPE;
+    LLACE_ARRAY_PUSH(e->locals, e->next);
+    e->next += (uint32_t)wasm_shape(e, t).parts;
+  }
+  size_t declared = e->next - fn->param_count;
+
+  llace_codebuf_t *out = e->out;
+  e->out = &e->code;
+  e->code.size = 0;
+  e->frames.element_count = 0;
+  llace_error_t tree = wasm_tree(e, 0);
+  // Every path ends in a return, the end is only reached as far as validation can tell
+  if (fn->ret.kind != LLACE_IR_TYPE_VOID || fn->retattr.depth > 0) wasm_op(e, WASM_UNREACHABLE);
+  wasm_op(e, WASM_END);
+  e->out = out;
+  LLACE_RUNCHECK(tree);
+
+  // Locals after the parameters, consecutive ones of a type share an entry
+  size_t total = declared + LLACE_ARRAY_COUNT(e->temps), runs = 0, at = 0;
+  uint8_t types[LLACE_MAX(total, (size_t)1)];
+  for (size_t v = fn->param_count; v < vars; ++v) {
+    wasm_type_t t = wasm_var_type(fn, v);
+    wasm_shape_t s = wasm_shape(e, t);
+    for (size_t k = 0; k < s.parts; ++k) types[at++] = s.part;
+  }
+  LLACE_ARRAY_FOREACH(wasm_temp_t, temp, e->temps) types[at++] = temp->key == WASM_TEMP_ADDR ? LLACE_WASM_I32 : temp->key;
+  for (size_t i = 0; i < total; ++i) runs += i == 0 || types[i] != types[i - 1];
+
+  llace_wasm_size_begin(out, &at);
+  llace_wasm_uleb(out, runs);
+  for (size_t i = 0, length = 1; i < total; ++i, ++length) {
+    if (i + 1 < total && types[i + 1] == types[i]) continue;
+    llace_wasm_uleb(out, length);
+    wasm_byte(out, types[i]);
+    length = 0;
+  }
+  llace_codebuf_write(out, e->code.data, e->code.size);
+  llace_wasm_size_end(out, at);
+  return LLACE_ERROR_NONE;
+}
+
+static llace_error_t wasm_function(wasm_emit_t *e, size_t function) {
+  e->fn = LLACE_IR_FUNCTION(e->ctx, function);
+  LLACE_RUNCHECK(llace_ir_cfg_build(e->fn, &e->cfg));
+  llace_error_t err = wasm_structure(e);
+  if (err == LLACE_ERROR_NONE) err = wasm_body(e);
+  llace_ir_cfg_free(&e->cfg);
+  if (err != LLACE_ERROR_NONE) {
+    LLACE_LOG_ERROR("Failed to emit function '%s' as WebAssembly: %s", e->fn->name, llace_error_str(err));
+  }
+  return err;
+}
+
+// Function type of a signature, equal ones share their index
+static llace_error_t wasm_signature(wasm_emit_t *e, const llace_ir_function_t *fn, uint32_t *index) {
+  llace_codebuf_t *buf = &e->signatures;
+  size_t start = buf->size;
+  wasm_byte(buf, WASM_FUNC);
+  llace_wasm_uleb(buf, fn->param_count);
+  for (size_t p = 0; p < fn->param_count; ++p) {
+    wasm_type_t t = wasm_var_type(fn, p);
+    if (!wasm_scalar(t)) return LLACE_ERROR_INVLTYPE;
+    wasm_byte(buf, wasm_valtype(t));
+  }
+  wasm_type_t ret = { fn->ret, fn->retattr.depth };
+  if (fn->ret.kind == LLACE_IR_TYPE_VOID && ret.depth == 0) {
+    llace_wasm_uleb(buf, 0);
+  } else {
+    if (!wasm_scalar(ret)) return LLACE_ERROR_INVLTYPE;
+    llace_wasm_uleb(buf, 1);
+    wasm_byte(buf, wasm_valtype(ret));
+  }
+
+  size_t size = buf->size - start;
+  for (size_t s = 0; s < LLACE_ARRAY_COUNT(e->spans); ++s) {
+    const wasm_span_t *span = LLACE_ARRAY_GET(wasm_span_t, e->spans, s);
+    if (span->size != size || memcmp(buf->data + span->offset, buf->data + start, size) != 0) continue;
+    buf->size = start;
+    *index = (uint32_t)s;
+    return LLACE_ERROR_NONE;
+  }
+  LLACE_ARRAY_PUSH(e->spans, ((wasm_span_t){ start, size }));
+  *index = (uint32_t)(LLACE_ARRAY_COUNT(e->spans) - 1);
+  return LLACE_ERROR_NONE;
+}
+
+// ================ Modules ================ //
+
+// Globals one after the other at their natural alignment, their initial values in image
+static size_t wasm_layout(wasm_emit_t *e, uint8_t **image) {
+  size_t count = LLACE_ARRAY_COUNT(e->ctx->globmap.globals), end = LLACE_WASM_DATA_BASE;
+  for (size_t g = 0; g < count; ++g) {
+    const llace_ir_global_t *glob = LLACE_IR_GLOBAL_AT(e->ctx, g);
+    size_t size = glob->attr.depth > 0 ? 4 : LLACE_MAX(llace_ir_type_bits(glob->type) / 8, (size_t)1), align = 1;
+    while (align < size && align < 8) align *= 2;
+    end = (end + align - 1) & ~(align - 1);
+    LLACE_ARRAY_PUSH(e->addrs, (uint32_t)end);
+    end += size;
+  }
+
+  size_t data = end - LLACE_WASM_DATA_BASE;
+  *image = calloc(1, LLACE_MAX(data, (size_t)1));
+  if (*image == NULL) { LLACE_LOG_FATAL("Failed to allocate '%zu' bytes of WebAssembly data", data); }
+  for (size_t g = 0; g < count; ++g) {
+    const llace_ir_global_t *glob = LLACE_IR_GLOBAL_AT(e->ctx, g);
+    wasm_type_t t = { glob->type, glob->attr.depth };
+    if (glob->value.kind != LLACE_IR_VALUE_CONST || t.depth > 0 || !wasm_scalar(t)) continue;
+
+    uint8_t *slot = *image + *LLACE_ARRAY_GET(uint32_t, e->addrs, g) - LLACE_WASM_DATA_BASE;
+    if (wasm_float(t) && wasm_valtype(t) == LLACE_WASM_F32) {
+      float single = (float)glob->value._float;
+      memcpy(slot, &single, sizeof(single));
+    } else if (wasm_float(t)) {
+      memcpy(slot, &glob->value._float, sizeof(glob->value._float));
+    } else {
+      memcpy(slot, &glob->value._unt, LLACE_MAX(llace_ir_type_bits(t.type) / 8, (size_t)1));
+    }
+  }
+  return data;
+}
+
+static llace_error_t wasm_module(wasm_emit_t *e, llace_wasm_stats_t *stats) {
+  const llace_ir_context_t *ctx = e->ctx;
+  llace_codebuf_t *out = e->out;
+  size_t count = LLACE_ARRAY_COUNT(ctx->funcmap.funcs), imports = 0, defined = 0, at;
+
+  // Imports come first in the function index space
+  for (size_t f = 0; f < count; ++f) imports += LLACE_ARRAY_IS_EMPTY(LLACE_IR_FUNCTION(ctx, f)->blocks);
+  for (size_t f = 0; f < count; ++f) {
+    const llace_ir_function_t *fn = LLACE_IR_FUNCTION(ctx, f);
+    uint32_t sig;
+    LLACE_RUNCHECK(wasm_signature(e, fn, &sig));
+    LLACE_ARRAY_PUSH(e->sigs, sig);
+    LLACE_ARRAY_PUSH(e->funcs, (uint32_t)(LLACE_ARRAY_IS_EMPTY(fn->blocks) ? f - defined : imports + defined));
+    defined += !LLACE_ARRAY_IS_EMPTY(fn->blocks);
+  }
+  uint8_t *image;
+  size_t data = wasm_layout(e, &image);
+
+  static const uint8_t header[] = { 0x00, 0x61, 0x73, 0x6D, LLACE_WASM_VERSION, 0, 0, 0 };
+  llace_codebuf_write(out, header, sizeof(header));
+
+  wasm_byte(out, LLACE_WASM_SECTION_TYPE);
+  llace_wasm_size_begin(out, &at);
+  llace_wasm_uleb(out, LLACE_ARRAY_COUNT(e->spans));
+  llace_codebuf_write(out, e->signatures.data, e->signatures.size);
+  llace_wasm_size_end(out, at);
+
+  if (imports > 0) {
+    wasm_byte(out, LLACE_WASM_SECTION_IMPORT);
+    llace_wasm_size_begin(out, &at);
+    llace_wasm_uleb(out, imports);
+    for (size_t f = 0; f < count; ++f) {
+      const llace_ir_function_t *fn = LLACE_IR_FUNCTION(ctx, f);
+      if (!LLACE_ARRAY_IS_EMPTY(fn->blocks)) continue;
+      wasm_name(out, "env");
+      wasm_name(out, fn->name);
+      wasm_byte(out, 0x00); // function
+      llace_wasm_uleb(out, *LLACE_ARRAY_GET(uint32_t, e->sigs, f));
+    }
+    llace_wasm_size_end(out, at);
+  }
+
+  wasm_byte(out, LLACE_WASM_SECTION_FUNCTION);
+  llace_wasm_size_begin(out, &at);
+  llace_wasm_uleb(out, defined);
+  for (size_t f = 0; f < count; ++f) {
+    if (!LLACE_ARRAY_IS_EMPTY(LLACE_IR_FUNCTION(ctx, f)->blocks)) llace_wasm_uleb(out, *LLACE_ARRAY_GET(uint32_t, e->sigs, f));
+  }
+  llace_wasm_size_end(out, at);
+
+  wasm_byte(out, LLACE_WASM_SECTION_MEMORY);
+  llace_wasm_size_begin(out, &at);
+  llace_wasm_uleb(out, 1);
+  wasm_byte(out, 0x00); // minimum only
+  llace_wasm_uleb(out, (LLACE_WASM_DATA_BASE + data + LLACE_WASM_PAGE - 1) / LLACE_WASM_PAGE);
+  llace_wasm_size_end(out, at);
+
+  wasm_byte(out, LLACE_WASM_SECTION_EXPORT);
+  llace_wasm_size_begin(out, &at);
+  llace_wasm_uleb(out, defined + 1);
+  for (size_t f = 0; f < count; ++f) {
+    const llace_ir_function_t *fn = LLACE_IR_FUNCTION(ctx, f);
+    if (LLACE_ARRAY_IS_EMPTY(fn->blocks)) continue;
+    wasm_name(out, fn->name);
+    wasm_byte(out, 0x00); // function
+    llace_wasm_uleb(out, *LLACE_ARRAY_GET(uint32_t, e->funcs, f));
+  }
+  wasm_name(out, "memory");
+  wasm_byte(out, 0x02); // memory
+  llace_wasm_uleb(out, 0);
+  llace_wasm_size_end(out, at);
+
+  llace_error_t err = LLACE_ERROR_NONE;
+  wasm_byte(out, LLACE_WASM_SECTION_CODE);
+  llace_wasm_size_begin(out, &at);
+  llace_wasm_uleb(out, defined);
+  for (size_t f = 0; f < count && err == LLACE_ERROR_NONE; ++f) {
+    if (!LLACE_ARRAY_IS_EMPTY(LLACE_IR_FUNCTION(ctx, f)->blocks)) err = wasm_function(e, f);
+  }
+  llace_wasm_size_end(out, at);
+
+  if (err == LLACE_ERROR_NONE && data > 0) {
+    wasm_byte(out, LLACE_WASM_SECTION_DATA);
+    llace_wasm_size_begin(out, &at);
+    llace_wasm_uleb(out, 1);
+    wasm_byte(out, 0x00); // active, memory 0
+    wasm_iconst(e, false, LLACE_WASM_DATA_BASE);
+    wasm_byte(out, WASM_END);
+    llace_wasm_uleb(out, data);
+    llace_codebuf_write(out, image, data);
+    llace_wasm_size_end(out, at);
+  }
+  free(image);
+
+  if (stats) {
+    *stats = (llace_wasm_stats_t){ .functions = defined, .imports = imports, .data = data, .vector = e->vector, .scalarized = e->scalarized };
+  }
+  return err;
+}
+
+llace_error_t llace_wasm_emit(const llace_ir_context_t *ctx, const llace_target_t *target, llace_codebuf_t *out, llace_wasm_stats_t *stats) {
+  LLACE_PROFILE_SCOPE("wasm");
+  LLACE_MEM_SCOPE(LLACE_MEM_CODEGEN);
+  if (!ctx || !out) {
+    return LLACE_ERROR_BADARG;
+  }
+
+  static const llace_target_t wasm32 = {
+    .arch = LLACE_ARCH_WASM32, .os = LLACE_OS_NONE, .format = LLACE_OBJFMT_WASM, .endian = LLACE_ENDIAN_LITTLE,
+    .features = LLACE_FEATURE_SIMD128,
+  };
+  if (!target) target = &wasm32;
+  size_t funcs = LLACE_ARRAY_COUNT(ctx->funcmap.funcs);
+  wasm_emit_t e = {
+    .ctx = ctx,
+    .target = target,
+    .simd = (target->features & LLACE_FEATURE_SIMD128) != 0,
+    .out = out,
+    .funcs = LLACE_NEW_ARRAY(uint32_t, funcs + 1),
+    .sigs = LLACE_NEW_ARRAY(uint32_t, funcs + 1),
+    .addrs = LLACE_NEW_ARRAY(uint32_t, LLACE_ARRAY_COUNT(ctx->globmap.globals) + 1),
+    .spans = LLACE_NEW_ARRAY(wasm_span_t, 8),
+    .merges = LLACE_NEW_ARRAY(size_t, 16),
+    .headers = LLACE_NEW_ARRAY(bool, 16),
+    .first = LLACE_NEW_ARRAY(size_t, 16),
+    .kids = LLACE_NEW_ARRAY(size_t, 16),
+    .frames = LLACE_NEW_ARRAY(wasm_frame_t, 16),
+    .types = LLACE_NEW_ARRAY(wasm_type_t, 16),
+    .stmts = LLACE_NEW_ARRAY(llace_ir_stmt_t, 16),
+    .copies = LLACE_NEW_ARRAY(size_t, 4),
+    .locals = LLACE_NEW_ARRAY(uint32_t, 16),
+    .temps = LLACE_NEW_ARRAY(wasm_temp_t, 8),
+  };
+  llace_codebuf_init(&e.signatures, 64);
+  llace_codebuf_init(&e.code, 256);
+
+  llace_error_t err = wasm_module(&e, stats);
+
+  llace_codebuf_free(&e.signatures);
+  llace_codebuf_free(&e.code);
+  LLACE_FREE_ARRAY(e.funcs);
+  LLACE_FREE_ARRAY(e.sigs);
+  LLACE_FREE_ARRAY(e.addrs);
+  LLACE_FREE_ARRAY(e.spans);
+  LLACE_FREE_ARRAY(e.merges);
+  LLACE_FREE_ARRAY(e.headers);
+  LLACE_FREE_ARRAY(e.first);
+  LLACE_FREE_ARRAY(e.kids);
+  LLACE_FREE_ARRAY(e.frames);
+  LLACE_FREE_ARRAY(e.types);
+  LLACE_FREE_ARRAY(e.stmts);
+  LLACE_FREE_ARRAY(e.copies);
+  LLACE_FREE_ARRAY(e.locals);
+  LLACE_FREE_ARRAY(e.temps);
+  return err;
+}
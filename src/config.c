@@ -1,4 +1,5 @@
 #include "llace/config.h"
+#include "llace/detail/common.h"
 
 const char *llace_arch_str(llace_arch_t arch) {
   switch (arch) {
@@ -113,6 +114,16 @@ void llace_target_get_host(llace_target_t *target) {
   target->format = LLACE_OBJFMT_BINARY;
   target->endian = LLACE_ENDIAN_LITTLE;
 
+  target->features = LLACE_FEATURE_SSE2;
+#if defined(__x86_64__) && defined(__GNUC__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx")) target->features |= LLACE_FEATURE_AVX;
+  if (__builtin_cpu_supports("avx2")) target->features |= LLACE_FEATURE_AVX2;
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512dq")) {
+    target->features |= LLACE_FEATURE_AVX512;
+  }
+#endif
+
   target->vendor = "pc";
   target->env = "gnu";
   target->version = "1.0.0";
@@ -122,15 +133,84 @@ size_t llace_target_pointer_size(const llace_target_t *target) {
   if (target->arch == LLACE_ARCH_AMD64) {
     return 64; // it may be technically 48?
   }
+  if (target->arch == LLACE_ARCH_WASM32) {
+    return 32;
+  }
+  if (target->arch == LLACE_ARCH_WASM64) {
+    return 64;
+  }
   return 0;
 }
 size_t llace_target_word_size(const llace_target_t *target) {
   if (target->arch == LLACE_ARCH_AMD64) {
     return 64; // it may be technically 48?
   }
+  if (target->arch == LLACE_ARCH_WASM32 || target->arch == LLACE_ARCH_WASM64) {
+    return 64; // i64 is native
+  }
   return 0;
 }
 
+// Widest vector the target can operate on for one element kind
+static size_t llace_target_lane_bits(const llace_target_t *target, bool is_float) {
+  switch (target->arch) {
+  case LLACE_ARCH_AMD64:
+    if (target->features & LLACE_FEATURE_AVX512) return 512;
+    if (target->features & (is_float ? LLACE_FEATURE_AVX : LLACE_FEATURE_AVX2)) return 256;
+    if (target->features & LLACE_FEATURE_SSE2) return 128;
+    return 0;
+  case LLACE_ARCH_WASM32: case LLACE_ARCH_WASM64:
+    return target->features & LLACE_FEATURE_SIMD128 ? 128 : 0;
+  default:
+    return 0;
+  }
+}
+
+size_t llace_target_vector_bits(const llace_target_t *target) {
+  return LLACE_MAX(llace_target_lane_bits(target, false), llace_target_lane_bits(target, true));
+}
+
+unsigned llace_target_cost(const llace_target_t *target, llace_cost_t op, size_t bits, size_t lanes, bool is_float) {
+  if (lanes <= 1) {
+    // Scalars, anything wider than a register is split
+    size_t word = LLACE_MAX(llace_target_word_size(target), (size_t)32);
+    unsigned parts = (unsigned)((bits + word - 1) / word);
+    switch (op) {
+    case LLACE_COST_MUL:   return parts * (is_float ? 4 : 3);
+    case LLACE_COST_DIV:   return parts * (is_float ? 12 : 24);
+    case LLACE_COST_SPLAT: case LLACE_COST_PACK: case LLACE_COST_EXTRACT:
+      return LLACE_COST_UNSUPPORTED;
+    default:               return parts;
+    }
+  }
+
+  // Vectors need power of two lanes of a machine element that fit a register
+  if (bits != 8 && bits != 16 && bits != 32 && bits != 64) return LLACE_COST_UNSUPPORTED;
+  if (is_float && bits != 32 && bits != 64) return LLACE_COST_UNSUPPORTED;
+  if ((lanes & (lanes - 1)) != 0 || bits * lanes > llace_target_lane_bits(target, is_float)) return LLACE_COST_UNSUPPORTED;
+
+  // amd64 selects the VEX forms of xmm and ymm (llace_amd64_select), anything else is scalarized
+  bool amd64 = target->arch == LLACE_ARCH_AMD64;
+  if (amd64 && (!(target->features & LLACE_FEATURE_AVX2) || (bits * lanes != 128 && bits * lanes != 256))) return LLACE_COST_UNSUPPORTED;
+  switch (op) {
+  case LLACE_COST_SHIFT:
+    return amd64 ? LLACE_COST_UNSUPPORTED : 1; // no vector shifts selected on amd64
+  case LLACE_COST_MUL:
+    if (is_float) return 1;
+    if (bits == 8 || (bits == 64 && amd64)) return LLACE_COST_UNSUPPORTED;
+    return bits == 32 ? 2 : 1; // pmulld is two uops
+  case LLACE_COST_DIV:
+    if (!is_float) return LLACE_COST_UNSUPPORTED; // no integer vector division
+    return (unsigned)(bits * lanes / 64);
+  case LLACE_COST_SPLAT:
+    return 2;
+  case LLACE_COST_PACK:
+    return (unsigned)lanes; // one insert per lane
+  default:
+    return 1;
+  }
+}
+
 llace_error_t llace_config_init(llace_config_t *config) {
   if (!config) {
     return LLACE_ERROR_BADARG;
@@ -148,6 +228,16 @@ llace_error_t llace_config_init(llace_config_t *config) {
   config->generate_symbol_table = 0;
   config->filename = "output.o";
 
+  config->inline_threshold = 48;
+  config->inline_leaf_threshold = 24;
+  config->inline_growth = 200;
+
+  config->regalloc = LLACE_REGALLOC_LINEAR;
+
+  config->tier_call_threshold = 100;
+  config->tier_loop_threshold = 10000;
+  config->tier_background = 1;
+
   return LLACE_ERROR_NONE;
 }
 
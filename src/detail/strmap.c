@@ -0,0 +1,71 @@
+#include <llace/detail/strmap.h>
+
+// ================ String Map ================ //
+
+uint64_t llace_strhash(const char *key, size_t len) {
+  // FNV-1a
+  uint64_t hash = UINT64_C(0xcbf29ce484222325);
+  for (size_t i = 0; i < len; ++i) {
+    hash ^= (unsigned char)key[i];
+    hash *= UINT64_C(0x100000001b3);
+  }
+  return hash;
+}
+
+void llace_strmap_init(llace_strmap_t *map, size_t capacity) {
+  LLACE_MEM_SCOPE(LLACE_MEM_SYMBOLS);
+  size_t slots = 16;
+  while (slots < capacity * 2) slots *= 2;
+
+  map->slots = LLACE_NEW_ARRAY(llace_strmap_slot_t, slots);
+  memset(map->slots.data, 0, slots * sizeof(llace_strmap_slot_t));
+  map->slots.element_count = slots;
+  map->count = 0;
+}
+
+void llace_strmap_free(llace_strmap_t *map) {
+  LLACE_FREE_ARRAY(map->slots);
+  map->count = 0;
+}
+
+static llace_strmap_slot_t *llace_strmap_find(const llace_strmap_t *map, const char *key, size_t len, uint64_t hash) {
+  llace_strmap_slot_t *slots = LLACE_ARRAY_RAW(map->slots);
+  size_t mask = LLACE_ARRAY_COUNT(map->slots) - 1;
+
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    llace_strmap_slot_t *slot = &slots[i];
+    if (slot->key == NULL) return slot;
+    if (slot->hash == hash && slot->len == len && memcmp(slot->key, key, len) == 0) return slot;
+  }
+}
+
+bool llace_strmap_get(const llace_strmap_t *map, const char *key, size_t len, size_t *value) {
+  llace_strmap_slot_t *slot = llace_strmap_find(map, key, len, llace_strhash(key, len));
+  if (slot->key == NULL) return false;
+  if (value) *value = slot->value;
+  return true;
+}
+
+void llace_strmap_put(llace_strmap_t *map, const char *key, size_t len, size_t value) {
+  // Grow at 50% load so probe sequences stay short
+  if ((map->count + 1) * 2 > LLACE_ARRAY_COUNT(map->slots)) {
+    llace_strmap_t grown;
+    llace_strmap_init(&grown, LLACE_ARRAY_COUNT(map->slots));
+    LLACE_ARRAY_FOREACH(llace_strmap_slot_t, slot, map->slots) {
+      if (slot->key) *llace_strmap_find(&grown, slot->key, slot->len, slot->hash) = *slot;
+    }
+    grown.count = map->count;
+    llace_strmap_free(map);
+    *map = grown;
+  }
+
+  uint64_t hash = llace_strhash(key, len);
+  llace_strmap_slot_t *slot = llace_strmap_find(map, key, len, hash);
+  if (slot->key == NULL) {
+    slot->key = key;
+    slot->len = len;
+    slot->hash = hash;
+    ++map->count;
+  }
+  slot->value = value;
+}
@@ -5,14 +5,18 @@
 
 // This file serves as the main entry point for the IR system
 // All individual components are implemented in their respective files:
-// - ir/type.c - Type system
-// - ir/value.c - Value system
-// - ir/var.c - Variable system
-// - ir/global.c - Global variable system
-// - ir/func.c - Function system
-// - ir/instr.c - Instruction system
-// - ir/cinstr.c - Child instruction system
-// - ir/module.c - Module system
+// - ir/stack.c - Types, values, symbols, stack decoding and validation
+// - ir/parse.c - Text form parser
+// - ir/print.c - Text form printer
+// - ir/adce.c - Aggressive dead code elimination
+// - ir/callgraph.c - Call graph and its components
+// - ir/inline.c - Function inlining
+// - ir/cfg.c - Control flow graph and dominators
+// - ir/loop.c - Loop nesting forest and preheaders
+// - ir/licm.c - Loop invariant code motion
+// - ir/indvar.c - Induction variable strength reduction
+// - ir/vectorize.c - Loop vectorization
+// - ir/slp.c - Straight-line (superword level) vectorization
 
 // The IR system provides a complete intermediate representation
 // for building and manipulating code structures in memory.
@@ -0,0 +1,231 @@
+#include <llace/ir.h>
+#include <llace/profile.h>
+#include <llace/detail/common.h>
+
+// ================ Aggressive Dead Code Elimination ================ //
+
+// A statement site, statements of all live blocks are numbered in one flat array
+typedef struct {
+  size_t block;
+  size_t begin;
+  size_t end;
+} adce_site_t;
+
+static bool adce_is_pinned(llace_ir_typeattr_t attr) {
+  return attr.attr._const || attr.attr._volatile;
+}
+
+// Statements with an effect beyond the variable they define
+static bool adce_is_root(const llace_ir_context_t *ctx, const llace_ir_function_t *fn, const llace_ir_basicblock_t *block, const adce_site_t *site) {
+  const llace_ir_value_t *stack = LLACE_ARRAY_RAW(block->stack);
+  const llace_ir_value_t *last = &stack[site->end - 1];
+  if (last->instr.op != LLACE_IR_OP_ASSIGN) {
+    return true; // terminators, stores and calls without a result
+  }
+
+  const llace_ir_variable_t *target = LLACE_IR_VAR_AT(fn, stack[site->end - 2].var);
+  if (adce_is_pinned(target->attr)) {
+    return true;
+  }
+
+  for (size_t i = site->begin; i < site->end - 2; ++i) {
+    const llace_ir_value_t *value = &stack[i];
+    switch (value->kind) {
+    case LLACE_IR_VALUE_INSTR:
+      if (value->instr.op == LLACE_IR_OP_CALL || value->instr.op == LLACE_IR_OP_STORE) return true;
+      break;
+    case LLACE_IR_VALUE_VAR:
+      if (LLACE_IR_VAR_AT(fn, value->var)->attr.attr._volatile) return true; // observable read
+      break;
+    case LLACE_IR_VALUE_GLOBAL:
+      if (adce_is_pinned(LLACE_IR_GLOBAL_AT(ctx, value->global)->attr)) return true;
+      break;
+    default:
+      break;
+    }
+  }
+  return false;
+}
+
+// Mark every block reachable from the entry
+static void adce_reach(const llace_ir_function_t *fn, uint64_t *reachable) {
+  size_t count = LLACE_ARRAY_COUNT(fn->blocks);
+  llace_array_t work = LLACE_NEW_ARRAY(size_t, count);
+  llace_array_t succs = LLACE_NEW_ARRAY(size_t, 2);
+
+  LLACE_BITSET_SET(reachable, 0);
+  LLACE_ARRAY_PUSH(work, (size_t)0);
+  while (!LLACE_ARRAY_IS_EMPTY(work)) {
+    size_t b = *LLACE_ARRAY_BACK(size_t, work);
+    --work.element_count;
+
+    llace_ir_block_succs(LLACE_IR_BLOCK_AT(fn, b), &succs);
+    LLACE_ARRAY_FOREACH(size_t, succ, succs) {
+      if (LLACE_BITSET_GET(reachable, *succ)) continue;
+      LLACE_BITSET_SET(reachable, *succ);
+      LLACE_ARRAY_PUSH(work, *succ);
+    }
+  }
+
+  LLACE_FREE_ARRAY(succs);
+  LLACE_FREE_ARRAY(work);
+}
+
+// Drop phi incoming pairs whose block is unreachable, compacting the stack in place
+static void adce_prune_phis(llace_ir_basicblock_t *block, const uint64_t *reachable) {
+  llace_ir_value_t *stack = LLACE_ARRAY_RAW(block->stack);
+  size_t count = LLACE_ARRAY_COUNT(block->stack);
+  size_t w = 0;
+
+  for (size_t r = 0; r < count; ++r) {
+    llace_ir_value_t value = stack[r];
+    if (LLACE_IR_IS_OP(&value, LLACE_IR_OP_PHI)) {
+      size_t first = w - value.instr.in;
+      size_t keep = first;
+      for (size_t p = first; p < w; p += 2) {
+        if (!LLACE_BITSET_GET(reachable, stack[p + 1].block)) continue;
+        stack[keep++] = stack[p];
+        stack[keep++] = stack[p + 1];
+      }
+      value.instr.in = (uint32_t)(keep - first);
+      w = keep;
+    }
+    stack[w++] = value;
+  }
+  block->stack.element_count = w;
+}
+
+// Remove unreachable blocks and renumber block references
+static size_t adce_sweep_blocks(llace_ir_function_t *fn, const uint64_t *reachable) {
+  size_t count = LLACE_ARRAY_COUNT(fn->blocks);
+  llace_ir_basicblock_t *blocks = LLACE_ARRAY_RAW(fn->blocks);
+  size_t *remap = malloc(count * sizeof(size_t));
+  if (remap == NULL) { LLACE_LOG_FATAL("Failed to allocate block remap of '%zu' blocks", count); }
+
+  size_t w = 0;
+  for (size_t b = 0; b < count; ++b) {
+    if (!LLACE_BITSET_GET(reachable, b)) {
+      free(blocks[b].name);
+      LLACE_FREE_ARRAY(blocks[b].stack);
+      continue;
+    }
+    remap[b] = w;
+    blocks[w++] = blocks[b];
+  }
+  fn->blocks.element_count = w;
+
+  for (size_t b = 0; b < w; ++b) {
+    LLACE_ARRAY_FOREACH(llace_ir_value_t, value, blocks[b].stack) {
+      if (value->kind == LLACE_IR_VALUE_BLOCK) value->block = remap[value->block];
+    }
+  }
+
+  free(remap);
+  return count - w;
+}
+
+llace_error_t llace_ir_opt_adce(const llace_ir_context_t *ctx, llace_ir_function_t *fn, llace_ir_adce_stats_t *stats) {
+  LLACE_PROFILE_SCOPE("adce");
+  LLACE_MEM_SCOPE(LLACE_MEM_IR);
+  if (!ctx || !fn) {
+    return LLACE_ERROR_BADARG;
+  }
+  if (stats) *stats = (llace_ir_adce_stats_t){0};
+  if (LLACE_ARRAY_IS_EMPTY(fn->blocks)) {
+    return LLACE_ERROR_NONE;
+  }
+
+  size_t block_count = LLACE_ARRAY_COUNT(fn->blocks);
+  size_t var_count = LLACE_ARRAY_COUNT(fn->vars);
+  uint64_t *reachable = LLACE_BITSET_NEW(block_count);
+  adce_reach(fn, reachable);
+
+  bool unreachable = false;
+  for (size_t b = 0; b < block_count; ++b) {
+    if (!LLACE_BITSET_GET(reachable, b)) { unreachable = true; break; }
+  }
+
+  // Number the statements of every live block, remembering where each variable is defined
+  llace_array_t sites = LLACE_NEW_ARRAY(adce_site_t, 64);
+  llace_array_t stmts = LLACE_NEW_ARRAY(llace_ir_stmt_t, 16);
+  size_t *defsite = malloc((var_count + 1) * sizeof(size_t));
+  if (defsite == NULL) { LLACE_LOG_FATAL("Failed to allocate def sites of '%zu' variables", var_count); }
+  for (size_t v = 0; v < var_count; ++v) defsite[v] = SIZE_MAX;
+
+  llace_error_t err = LLACE_ERROR_NONE;
+  for (size_t b = 0; b < block_count; ++b) {
+    if (!LLACE_BITSET_GET(reachable, b)) continue;
+    llace_ir_basicblock_t *block = LLACE_IR_BLOCK_AT(fn, b);
+    if (unreachable) adce_prune_phis(block, reachable);
+
+    if ((err = llace_ir_block_stmts(block, &stmts)) != LLACE_ERROR_NONE) goto done;
+    LLACE_ARRAY_FOREACH(llace_ir_stmt_t, stmt, stmts) {
+      adce_site_t site = { .block = b, .begin = stmt->begin, .end = stmt->end };
+      size_t var;
+      if (llace_ir_stmt_def(block, stmt, &var)) defsite[var] = LLACE_ARRAY_COUNT(sites);
+      LLACE_ARRAY_PUSHP(sites, &site);
+    }
+  }
+
+  // Mark from the roots along use-def chains
+  size_t site_count = LLACE_ARRAY_COUNT(sites);
+  adce_site_t *all = LLACE_ARRAY_RAW(sites);
+  uint64_t *live = LLACE_BITSET_NEW(site_count);
+  llace_array_t work = LLACE_NEW_ARRAY(size_t, site_count);
+
+  for (size_t s = 0; s < site_count; ++s) {
+    if (!adce_is_root(ctx, fn, LLACE_IR_BLOCK_AT(fn, all[s].block), &all[s])) continue;
+    LLACE_BITSET_SET(live, s);
+    LLACE_ARRAY_PUSH(work, s);
+  }
+
+  while (!LLACE_ARRAY_IS_EMPTY(work)) {
+    const adce_site_t *site = &all[*LLACE_ARRAY_BACK(size_t, work)];
+    --work.element_count;
+
+    const llace_ir_basicblock_t *block = LLACE_IR_BLOCK_AT(fn, site->block);
+    const llace_ir_value_t *stack = LLACE_ARRAY_RAW(block->stack);
+    bool assign = stack[site->end - 1].instr.op == LLACE_IR_OP_ASSIGN;
+    size_t uses_end = assign ? site->end - 2 : site->end;
+
+    for (size_t i = site->begin; i < uses_end; ++i) {
+      if (stack[i].kind != LLACE_IR_VALUE_VAR) continue;
+      size_t def = defsite[stack[i].var];
+      if (def == SIZE_MAX || LLACE_BITSET_GET(live, def)) continue; // parameter or already live
+      LLACE_BITSET_SET(live, def);
+      LLACE_ARRAY_PUSH(work, def);
+    }
+  }
+
+  // Sweep: one compaction per block, sites are ordered by block then position
+  size_t removed = 0;
+  for (size_t s = 0; s < site_count;) {
+    llace_ir_basicblock_t *block = LLACE_IR_BLOCK_AT(fn, all[s].block);
+    llace_ir_value_t *stack = LLACE_ARRAY_RAW(block->stack);
+    size_t w = 0;
+
+    size_t b = all[s].block;
+    for (; s < site_count && all[s].block == b; ++s) {
+      if (!LLACE_BITSET_GET(live, s)) { ++removed; continue; }
+      size_t len = all[s].end - all[s].begin;
+      if (w != all[s].begin) memmove(&stack[w], &stack[all[s].begin], len * sizeof(llace_ir_value_t));
+      w += len;
+    }
+    block->stack.element_count = w;
+  }
+
+  size_t blocks_removed = unreachable ? adce_sweep_blocks(fn, reachable) : 0;
+  if (stats) {
+    stats->stmts_removed = removed;
+    stats->blocks_removed = blocks_removed;
+  }
+
+  free(live);
+  LLACE_FREE_ARRAY(work);
+done:
+  free(defsite);
+  free(reachable);
+  LLACE_FREE_ARRAY(stmts);
+  LLACE_FREE_ARRAY(sites);
+  return err;
+}
@@ -0,0 +1,136 @@
+#include <llace/ir.h>
+#include <llace/detail/common.h>
+
+// ================ Call Graph ================ //
+
+static void callgraph_push_unique(llace_array_t *list, size_t func) {
+  LLACE_ARRAY_FOREACH(size_t, existing, *list) {
+    if (*existing == func) return;
+  }
+  LLACE_ARRAY_PUSH(*list, func);
+}
+
+typedef struct {
+  size_t func;
+  size_t next; // next callee to visit
+} callgraph_frame_t;
+
+llace_error_t llace_ir_callgraph_build(const llace_ir_context_t *ctx, llace_ir_callgraph_t *cg) {
+  LLACE_MEM_SCOPE(LLACE_MEM_IR);
+  if (!ctx || !cg) {
+    return LLACE_ERROR_BADARG;
+  }
+
+  size_t count = LLACE_ARRAY_COUNT(ctx->funcmap.funcs);
+  cg->callees = LLACE_NEW_ARRAY(llace_array_t, count);
+  cg->callers = LLACE_NEW_ARRAY(llace_array_t, count);
+  cg->sccs = LLACE_NEW_ARRAY(llace_array_t, count);
+  cg->scc = LLACE_NEW_ARRAY(size_t, count);
+
+  for (size_t f = 0; f < count; ++f) {
+    llace_array_t empty = LLACE_NEW_ARRAY(size_t, 2);
+    LLACE_ARRAY_PUSHP(cg->callees, &empty);
+    empty = LLACE_NEW_ARRAY(size_t, 2);
+    LLACE_ARRAY_PUSHP(cg->callers, &empty);
+    size_t none = SIZE_MAX;
+    LLACE_ARRAY_PUSH(cg->scc, none);
+  }
+
+  // Edges
+  for (size_t f = 0; f < count; ++f) {
+    LLACE_ARRAY_FOREACH(llace_ir_basicblock_t, block, LLACE_IR_FUNCTION(ctx, f)->blocks) {
+      LLACE_ARRAY_FOREACH(llace_ir_value_t, value, block->stack) {
+        if (!LLACE_IR_IS_OP(value, LLACE_IR_OP_CALL) || value->instr.func >= count) continue;
+        callgraph_push_unique(LLACE_IR_CALLGRAPH_CALLEES(cg, f), value->instr.func);
+        callgraph_push_unique(LLACE_IR_CALLGRAPH_CALLERS(cg, value->instr.func), f);
+      }
+    }
+  }
+  if (count == 0) {
+    return LLACE_ERROR_NONE;
+  }
+
+  // Tarjan with an explicit call stack, components complete callees first
+  size_t *index = malloc(count * sizeof(size_t));
+  size_t *low = malloc(count * sizeof(size_t));
+  if (index == NULL || low == NULL) { LLACE_LOG_FATAL("Failed to allocate call graph of '%zu' functions", count); }
+  for (size_t f = 0; f < count; ++f) index[f] = SIZE_MAX;
+  uint64_t *on_stack = LLACE_BITSET_NEW(count);
+  llace_array_t stack = LLACE_NEW_ARRAY(size_t, count);
+  llace_array_t frames = LLACE_NEW_ARRAY(callgraph_frame_t, 8);
+  size_t next_index = 0;
+
+  for (size_t root = 0; root < count; ++root) {
+    if (index[root] != SIZE_MAX) continue;
+    LLACE_ARRAY_PUSH(frames, ((callgraph_frame_t){ .func = root }));
+    index[root] = low[root] = next_index++;
+    LLACE_ARRAY_PUSH(stack, root);
+    LLACE_BITSET_SET(on_stack, root);
+
+    while (!LLACE_ARRAY_IS_EMPTY(frames)) {
+      callgraph_frame_t *frame = LLACE_ARRAY_BACK(callgraph_frame_t, frames);
+      size_t f = frame->func;
+      const llace_array_t *callees = LLACE_IR_CALLGRAPH_CALLEES(cg, f);
+
+      if (frame->next < LLACE_ARRAY_COUNT(*callees)) {
+        size_t callee = *LLACE_ARRAY_GET(size_t, *callees, frame->next++);
+        if (index[callee] == SIZE_MAX) {
+          index[callee] = low[callee] = next_index++;
+          LLACE_ARRAY_PUSH(stack, callee);
+          LLACE_BITSET_SET(on_stack, callee);
+          LLACE_ARRAY_PUSH(frames, ((callgraph_frame_t){ .func = callee }));
+        } else if (LLACE_BITSET_GET(on_stack, callee)) {
+          low[f] = LLACE_MIN(low[f], index[callee]);
+        }
+        continue;
+      }
+
+      // All callees visited, f may close a component
+      --frames.element_count;
+      if (!LLACE_ARRAY_IS_EMPTY(frames)) {
+        size_t caller = LLACE_ARRAY_BACK(callgraph_frame_t, frames)->func;
+        low[caller] = LLACE_MIN(low[caller], low[f]);
+      }
+      if (low[f] != index[f]) continue;
+
+      size_t component = LLACE_ARRAY_COUNT(cg->sccs);
+      llace_array_t members = LLACE_NEW_ARRAY(size_t, 1);
+      size_t member;
+      do {
+        member = *LLACE_ARRAY_BACK(size_t, stack);
+        --stack.element_count;
+        LLACE_BITSET_CLEAR(on_stack, member);
+        LLACE_ARRAY_PUSH(members, member);
+        *LLACE_ARRAY_GET(size_t, cg->scc, member) = component;
+      } while (member != f);
+      LLACE_ARRAY_PUSHP(cg->sccs, &members);
+    }
+  }
+
+  LLACE_FREE_ARRAY(frames);
+  LLACE_FREE_ARRAY(stack);
+  free(on_stack);
+  free(low);
+  free(index);
+  return LLACE_ERROR_NONE;
+}
+
+void llace_ir_callgraph_free(llace_ir_callgraph_t *cg) {
+  LLACE_ARRAY_FOREACH(llace_array_t, list, cg->callees) LLACE_FREE_ARRAY(*list);
+  LLACE_ARRAY_FOREACH(llace_array_t, list, cg->callers) LLACE_FREE_ARRAY(*list);
+  LLACE_ARRAY_FOREACH(llace_array_t, list, cg->sccs) LLACE_FREE_ARRAY(*list);
+  LLACE_FREE_ARRAY(cg->callees);
+  LLACE_FREE_ARRAY(cg->callers);
+  LLACE_FREE_ARRAY(cg->sccs);
+  LLACE_FREE_ARRAY(cg->scc);
+}
+
+bool llace_ir_callgraph_recursive(const llace_ir_callgraph_t *cg, size_t func) {
+  const llace_array_t *members = LLACE_ARRAY_GET(llace_array_t, cg->sccs, LLACE_IR_CALLGRAPH_SCC(cg, func));
+  if (LLACE_ARRAY_COUNT(*members) > 1) return true;
+
+  LLACE_ARRAY_FOREACH(size_t, callee, *LLACE_IR_CALLGRAPH_CALLEES(cg, func)) {
+    if (*callee == func) return true;
+  }
+  return false;
+}
@@ -0,0 +1,165 @@
+#include <llace/ir.h>
+#include <llace/detail/common.h>
+
+// ================ Control Flow Graph ================ //
+
+static void cfg_push_unique(llace_array_t *list, size_t block) {
+  LLACE_ARRAY_FOREACH(size_t, existing, *list) {
+    if (*existing == block) return;
+  }
+  LLACE_ARRAY_PUSH(*list, block);
+}
+
+// Walk up the dominator tree until both fingers meet
+static size_t cfg_intersect(const size_t *idom, const size_t *order, size_t a, size_t b) {
+  while (a != b) {
+    while (order[a] > order[b]) a = idom[a];
+    while (order[b] > order[a]) b = idom[b];
+  }
+  return a;
+}
+
+llace_error_t llace_ir_cfg_build(const llace_ir_function_t *fn, llace_ir_cfg_t *cfg) {
+  LLACE_MEM_SCOPE(LLACE_MEM_IR);
+  if (!fn || !cfg) {
+    return LLACE_ERROR_BADARG;
+  }
+
+  size_t count = LLACE_ARRAY_COUNT(fn->blocks);
+  cfg->block_count = count;
+  cfg->succs = LLACE_NEW_ARRAY(llace_array_t, count);
+  cfg->preds = LLACE_NEW_ARRAY(llace_array_t, count);
+  cfg->rpo = LLACE_NEW_ARRAY(size_t, count);
+  cfg->order = LLACE_NEW_ARRAY(size_t, count);
+  cfg->idom = LLACE_NEW_ARRAY(size_t, count);
+  cfg->enter = LLACE_NEW_ARRAY(size_t, count);
+  cfg->leave = LLACE_NEW_ARRAY(size_t, count);
+
+  for (size_t b = 0; b < count; ++b) {
+    llace_array_t empty = LLACE_NEW_ARRAY(size_t, 2);
+    LLACE_ARRAY_PUSHP(cfg->succs, &empty);
+    empty = LLACE_NEW_ARRAY(size_t, 2);
+    LLACE_ARRAY_PUSHP(cfg->preds, &empty);
+    size_t none = SIZE_MAX;
+    LLACE_ARRAY_PUSH(cfg->order, none);
+    LLACE_ARRAY_PUSH(cfg->idom, none);
+    LLACE_ARRAY_PUSH(cfg->enter, none);
+    LLACE_ARRAY_PUSH(cfg->leave, none);
+  }
+  if (count == 0) {
+    return LLACE_ERROR_NONE;
+  }
+
+  // Edges
+  llace_array_t targets = LLACE_NEW_ARRAY(size_t, 2);
+  for (size_t b = 0; b < count; ++b) {
+    llace_ir_block_succs(LLACE_IR_BLOCK_AT(fn, b), &targets);
+    LLACE_ARRAY_FOREACH(size_t, succ, targets) {
+      cfg_push_unique(LLACE_IR_CFG_SUCCS(cfg, b), *succ);
+      cfg_push_unique(LLACE_IR_CFG_PREDS(cfg, *succ), b);
+    }
+  }
+  LLACE_FREE_ARRAY(targets);
+
+  // Post order with an explicit stack of (block, next successor)
+  size_t *post = malloc(count * sizeof(size_t));
+  size_t *stack = malloc(count * 2 * sizeof(size_t));
+  uint64_t *visited = LLACE_BITSET_NEW(count);
+  if (!post || !stack) { LLACE_LOG_FATAL("Failed to allocate traversal of '%zu' blocks", count); }
+
+  size_t post_count = 0, depth = 0;
+  LLACE_BITSET_SET(visited, 0);
+  stack[0] = 0; stack[1] = 0; depth = 1;
+  while (depth > 0) {
+    size_t *top = &stack[(depth - 1) * 2];
+    llace_array_t *succs = LLACE_IR_CFG_SUCCS(cfg, top[0]);
+    if (top[1] < LLACE_ARRAY_COUNT(*succs)) {
+      size_t succ = *LLACE_ARRAY_GET(size_t, *succs, top[1]++);
+      if (LLACE_BITSET_GET(visited, succ)) continue;
+      LLACE_BITSET_SET(visited, succ);
+      stack[depth * 2] = succ;
+      stack[depth * 2 + 1] = 0;
+      ++depth;
+    } else {
+      post[post_count++] = top[0];
+      --depth;
+    }
+  }
+
+  size_t *order = LLACE_ARRAY_RAW(cfg->order);
+  size_t *idom = LLACE_ARRAY_RAW(cfg->idom);
+  for (size_t i = 0; i < post_count; ++i) {
+    size_t block = post[post_count - 1 - i];
+    LLACE_ARRAY_PUSH(cfg->rpo, block);
+    order[block] = i;
+  }
+
+  // Dominators, iterate in reverse post order until stable
+  const size_t *rpo = LLACE_ARRAY_RAW(cfg->rpo);
+  idom[0] = 0;
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (size_t i = 1; i < post_count; ++i) {
+      size_t block = rpo[i];
+      size_t dom = SIZE_MAX;
+      LLACE_ARRAY_FOREACH(size_t, pred, *LLACE_IR_CFG_PREDS(cfg, block)) {
+        if (idom[*pred] == SIZE_MAX) continue; // not processed yet or unreachable
+        dom = dom == SIZE_MAX ? *pred : cfg_intersect(idom, order, *pred, dom);
+      }
+      if (idom[block] != dom) {
+        idom[block] = dom;
+        changed = true;
+      }
+    }
+  }
+
+  // Number the dominator tree so dominance is an interval check, children are linked through post
+  size_t *child = stack, *sibling = post;
+  size_t *enter = LLACE_ARRAY_RAW(cfg->enter), *leave = LLACE_ARRAY_RAW(cfg->leave);
+  for (size_t i = 0; i < post_count; ++i) child[rpo[i]] = SIZE_MAX;
+  for (size_t i = post_count; i > 1; --i) {
+    size_t block = rpo[i - 1];
+    sibling[block] = child[idom[block]];
+    child[idom[block]] = block;
+  }
+  size_t number = 0, block = 0;
+  enter[0] = number++;
+  while (block != SIZE_MAX) {
+    if (child[block] != SIZE_MAX) {
+      size_t next = child[block];
+      child[block] = sibling[next]; // consumed
+      enter[next] = number++;
+      block = next;
+      continue;
+    }
+    leave[block] = number;
+    block = block == 0 ? SIZE_MAX : idom[block];
+  }
+
+  free(visited);
+  free(stack);
+  free(post);
+  return LLACE_ERROR_NONE;
+}
+
+void llace_ir_cfg_free(llace_ir_cfg_t *cfg) {
+  LLACE_ARRAY_FOREACH(llace_array_t, list, cfg->succs) LLACE_FREE_ARRAY(*list);
+  LLACE_ARRAY_FOREACH(llace_array_t, list, cfg->preds) LLACE_FREE_ARRAY(*list);
+  LLACE_FREE_ARRAY(cfg->succs);
+  LLACE_FREE_ARRAY(cfg->preds);
+  LLACE_FREE_ARRAY(cfg->rpo);
+  LLACE_FREE_ARRAY(cfg->order);
+  LLACE_FREE_ARRAY(cfg->idom);
+  LLACE_FREE_ARRAY(cfg->enter);
+  LLACE_FREE_ARRAY(cfg->leave);
+  cfg->block_count = 0;
+}
+
+bool llace_ir_cfg_dominates(const llace_ir_cfg_t *cfg, size_t a, size_t b) {
+  const size_t *idom = LLACE_ARRAY_RAW(cfg->idom);
+  if (idom[a] == SIZE_MAX || idom[b] == SIZE_MAX) return false;
+
+  // b lies in the subtree of a
+  const size_t *enter = LLACE_ARRAY_RAW(cfg->enter), *leave = LLACE_ARRAY_RAW(cfg->leave);
+  return enter[a] <= enter[b] && enter[b] < leave[a];
+}
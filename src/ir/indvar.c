@@ -0,0 +1,254 @@
+#include <llace/ir.h>
+#include <llace/ir/analysis.h>
+#include <llace/profile.h>
+#include <llace/detail/common.h>
+
+// ================ Induction Variable Strength Reduction ================ //
+
+// Basic induction variable: %i = phi [init, preheader], [%next, latch]; %next = %i step +
+typedef struct {
+  size_t var;
+  size_t next;
+  llace_ir_value_t init;
+  llace_ir_value_t step;
+} indvar_iv_t;
+
+typedef struct {
+  llace_ir_function_t *fn;
+  llace_ir_cfg_t cfg;
+  llace_ir_loopinfo_t loops;
+  llace_array_t stmts; // statements of the block being reduced
+  llace_array_t defs;  // scratch for definition lookups
+  llace_array_t defblock; // block defining each variable, SIZE_MAX for parameters
+  size_t loop;
+  size_t pre;
+  size_t latch;
+} indvar_t;
+
+static size_t indvar_def_block(const indvar_t *iv, size_t var) {
+  if (var >= LLACE_ARRAY_COUNT(iv->defblock)) return SIZE_MAX;
+  return *LLACE_ARRAY_GET(size_t, iv->defblock, var);
+}
+
+static void indvar_set_def(indvar_t *iv, size_t var, size_t block) {
+  while (LLACE_ARRAY_COUNT(iv->defblock) <= var) LLACE_ARRAY_PUSH(iv->defblock, (size_t)SIZE_MAX);
+  *LLACE_ARRAY_GET(size_t, iv->defblock, var) = block;
+}
+
+// Only the defining block is scanned, statement positions shift as statements are inserted
+static bool indvar_find_def(indvar_t *iv, size_t var, size_t *block, llace_ir_stmt_t *found) {
+  size_t b = indvar_def_block(iv, var);
+  if (b == SIZE_MAX) return false;
+  const llace_ir_basicblock_t *bb = LLACE_IR_BLOCK_AT(iv->fn, b);
+  llace_ir_block_stmts(bb, &iv->defs);
+  LLACE_ARRAY_FOREACH(llace_ir_stmt_t, stmt, iv->defs) {
+    size_t def;
+    if (!llace_ir_stmt_def(bb, stmt, &def) || def != var) continue;
+    *block = b;
+    *found = *stmt;
+    return true;
+  }
+  return false;
+}
+
+// Constants, and variables defined outside the loop
+static bool indvar_is_invariant(indvar_t *iv, const llace_ir_value_t *value) {
+  if (value->kind == LLACE_IR_VALUE_CONST) return value->type.kind != LLACE_IR_TYPE_FLOAT;
+  if (value->kind != LLACE_IR_VALUE_VAR) return false;
+  if (value->var < iv->fn->param_count) return true;
+
+  size_t block = indvar_def_block(iv, value->var);
+  if (block == SIZE_MAX) return false;
+  return !llace_ir_loop_contains(&iv->loops, iv->loop, block);
+}
+
+static bool indvar_is_int(const llace_ir_variable_t *var) {
+  return (var->type.kind == LLACE_IR_TYPE_INT || var->type.kind == LLACE_IR_TYPE_UNT) && var->attr.depth == 0 && var->attr.attraw == 0;
+}
+
+// Two pair phis in the header fed by the preheader and a single add in the latch
+static void indvar_find_ivs(indvar_t *iv, llace_array_t *ivs) {
+  const llace_ir_loop_t *loop = LLACE_IR_LOOP_AT(&iv->loops, iv->loop);
+  const llace_ir_basicblock_t *header = LLACE_IR_BLOCK_AT(iv->fn, loop->header);
+  const llace_ir_value_t *stack = LLACE_ARRAY_RAW(header->stack);
+  ivs->element_count = 0;
+
+  for (size_t i = 4; i + 2 < LLACE_ARRAY_COUNT(header->stack); ++i) {
+    if (!LLACE_IR_IS_OP(&stack[i], LLACE_IR_OP_PHI) || stack[i].instr.in != 4) continue;
+    if (!LLACE_IR_IS_OP(&stack[i + 2], LLACE_IR_OP_ASSIGN)) continue;
+
+    indvar_iv_t found = { .var = stack[i + 1].var };
+    const llace_ir_value_t *pairs = &stack[i - 4];
+    bool has_init = false, has_next = false;
+    for (size_t p = 0; p < 4; p += 2) {
+      if (pairs[p + 1].block == iv->pre) { found.init = pairs[p]; has_init = true; }
+      if (pairs[p + 1].block == iv->latch && pairs[p].kind == LLACE_IR_VALUE_VAR) { found.next = pairs[p].var; has_next = true; }
+    }
+    if (!has_init || !has_next || !indvar_is_int(LLACE_IR_VAR_AT(iv->fn, found.var))) continue;
+
+    size_t block;
+    llace_ir_stmt_t stmt;
+    if (!indvar_find_def(iv, found.next, &block, &stmt) || stmt.end - stmt.begin != 5) continue;
+    if (!llace_ir_loop_contains(&iv->loops, iv->loop, block)) continue;
+
+    const llace_ir_basicblock_t *nb = LLACE_IR_BLOCK_AT(iv->fn, block);
+    const llace_ir_value_t *a = LLACE_IR_STACK_AT(nb, stmt.begin);
+    const llace_ir_value_t *b = LLACE_IR_STACK_AT(nb, stmt.begin + 1);
+    if (!LLACE_IR_IS_OP(LLACE_IR_STACK_AT(nb, stmt.begin + 2), LLACE_IR_OP_ADD)) continue;
+
+    if (a->kind == LLACE_IR_VALUE_VAR && a->var == found.var && indvar_is_invariant(iv, b)) found.step = *b;
+    else if (b->kind == LLACE_IR_VALUE_VAR && b->var == found.var && indvar_is_invariant(iv, a)) found.step = *a;
+    else continue;
+
+    LLACE_ARRAY_PUSHP(*ivs, &found);
+  }
+}
+
+// %t = %i k * becomes %t = phi [init k *, preheader], [%t step k * +, latch]
+static bool indvar_reduce_one(indvar_t *iv, const llace_array_t *ivs) {
+  const llace_ir_loop_t *loop = LLACE_IR_LOOP_AT(&iv->loops, iv->loop);
+  size_t header = loop->header;
+
+  LLACE_ARRAY_FOREACH(size_t, b, loop->blocks) {
+    llace_ir_basicblock_t *block = LLACE_IR_BLOCK_AT(iv->fn, *b);
+    llace_ir_block_stmts(block, &iv->stmts);
+
+    LLACE_ARRAY_FOREACH(llace_ir_stmt_t, stmt, iv->stmts) {
+      size_t target;
+      if (stmt->end - stmt->begin != 5 || !llace_ir_stmt_def(block, stmt, &target)) continue;
+      llace_ir_value_t *s = LLACE_IR_STACK_AT(block, stmt->begin);
+      if (!LLACE_IR_IS_OP(&s[2], LLACE_IR_OP_MUL) || !indvar_is_int(LLACE_IR_VAR_AT(iv->fn, target))) continue;
+
+      const indvar_iv_t *match = NULL;
+      llace_ir_value_t factor;
+      for (size_t c = 0; c < LLACE_ARRAY_COUNT(*ivs) && !match; ++c) {
+        const indvar_iv_t *cand = LLACE_ARRAY_GET(indvar_iv_t, *ivs, c);
+        if (s[0].kind == LLACE_IR_VALUE_VAR && s[0].var == cand->var && indvar_is_invariant(iv, &s[1])) { match = cand; factor = s[1]; }
+        else if (s[1].kind == LLACE_IR_VALUE_VAR && s[1].var == cand->var && indvar_is_invariant(iv, &s[0])) { match = cand; factor = s[0]; }
+      }
+      if (!match) continue;
+
+      // New variables for the reduced recurrence
+      const llace_ir_variable_t *tv = LLACE_IR_VAR_AT(iv->fn, target);
+      llace_ir_type_t type = tv->type;
+      char name[256], base[200];
+      snprintf(base, sizeof(base), "%s", tv->name);
+      size_t init, step, next;
+      snprintf(name, sizeof(name), "%s.sr.init", base);
+      llace_ir_variable_new(iv->fn, name, type, (llace_ir_typeattr_t){0}, &init);
+      snprintf(name, sizeof(name), "%s.sr.step", base);
+      llace_ir_variable_new(iv->fn, name, type, (llace_ir_typeattr_t){0}, &step);
+      snprintf(name, sizeof(name), "%s.sr.next", base);
+      llace_ir_variable_new(iv->fn, name, type, (llace_ir_typeattr_t){0}, &next);
+
+      // Drop the multiply
+      memmove(&s[0], &s[5], (LLACE_ARRAY_COUNT(block->stack) - stmt->end) * sizeof(llace_ir_value_t));
+      block->stack.element_count -= 5;
+
+      // Step the reduced value next to the induction variable update
+      size_t nblock;
+      llace_ir_stmt_t nstmt;
+      indvar_find_def(iv, match->next, &nblock, &nstmt);
+      llace_ir_value_t bump[] = {
+        LLACE_IR_VAR(target), LLACE_IR_VAR(step), LLACE_IR_OP(LLACE_IR_OP_ADD, 2, 1), LLACE_IR_VAR(next), LLACE_IR_OP(LLACE_IR_OP_ASSIGN, 2, 0),
+      };
+      llace_ir_block_insert(LLACE_IR_BLOCK_AT(iv->fn, nblock), nstmt.end, bump, 5);
+      indvar_set_def(iv, next, nblock);
+
+      // The multiply becomes a phi in the header
+      llace_ir_value_t phi[] = {
+        LLACE_IR_VAR(init), LLACE_IR_BLOCK(iv->pre), LLACE_IR_VAR(next), LLACE_IR_BLOCK(iv->latch),
+        LLACE_IR_OP(LLACE_IR_OP_PHI, 4, 1), LLACE_IR_VAR(target), LLACE_IR_OP(LLACE_IR_OP_ASSIGN, 2, 0),
+      };
+      llace_ir_block_insert(LLACE_IR_BLOCK_AT(iv->fn, header), 0, phi, 7);
+      indvar_set_def(iv, target, header);
+
+      // Start and stride are computed once in the preheader, folded when constant
+      llace_ir_value_t setup[10];
+      size_t n = 0;
+      setup[n++] = match->init;
+      setup[n++] = factor;
+      setup[n++] = LLACE_IR_OP(LLACE_IR_OP_MUL, 2, 1);
+      setup[n++] = LLACE_IR_VAR(init);
+      setup[n++] = LLACE_IR_OP(LLACE_IR_OP_ASSIGN, 2, 0);
+      if (match->step.kind == LLACE_IR_VALUE_CONST && factor.kind == LLACE_IR_VALUE_CONST) {
+        setup[n++] = LLACE_IR_CONST_INT(type, match->step._int * factor._int);
+      } else {
+        setup[n++] = match->step;
+        setup[n++] = factor;
+        setup[n++] = LLACE_IR_OP(LLACE_IR_OP_MUL, 2, 1);
+      }
+      setup[n++] = LLACE_IR_VAR(step);
+      setup[n++] = LLACE_IR_OP(LLACE_IR_OP_ASSIGN, 2, 0);
+      llace_ir_basicblock_t *pb = LLACE_IR_BLOCK_AT(iv->fn, iv->pre);
+      llace_ir_block_insert(pb, llace_ir_block_term(pb), setup, n);
+      indvar_set_def(iv, init, iv->pre);
+      indvar_set_def(iv, step, iv->pre);
+      return true;
+    }
+  }
+  return false;
+}
+
+llace_error_t llace_ir_opt_indvars(const llace_ir_context_t *ctx, llace_ir_function_t *fn, llace_ir_indvar_stats_t *stats) {
+  LLACE_PROFILE_SCOPE("indvars");
+  LLACE_MEM_SCOPE(LLACE_MEM_IR);
+  if (!ctx || !fn) {
+    return LLACE_ERROR_BADARG;
+  }
+  if (stats) *stats = (llace_ir_indvar_stats_t){0};
+  if (LLACE_ARRAY_IS_EMPTY(fn->blocks)) {
+    return LLACE_ERROR_NONE;
+  }
+
+  indvar_t iv = {
+    .fn = fn,
+    .stmts = LLACE_NEW_ARRAY(llace_ir_stmt_t, 16),
+    .defs = LLACE_NEW_ARRAY(llace_ir_stmt_t, 16),
+    .defblock = LLACE_NEW_ARRAY(size_t, LLACE_ARRAY_COUNT(fn->vars) + 1),
+  };
+  LLACE_RUNCHECK(llace_ir_cfg_build(fn, &iv.cfg));
+  llace_ir_loops_build(&iv.cfg, &iv.loops);
+  if (llace_ir_loops_make_preheaders(fn, &iv.cfg, &iv.loops)) {
+    llace_ir_loops_free(&iv.loops);
+    llace_ir_cfg_free(&iv.cfg);
+    LLACE_RUNCHECK(llace_ir_cfg_build(fn, &iv.cfg));
+    llace_ir_loops_build(&iv.cfg, &iv.loops);
+  }
+
+  // Where every variable is defined, kept current as statements are added
+  for (size_t b = 0; b < LLACE_ARRAY_COUNT(fn->blocks); ++b) {
+    const llace_ir_basicblock_t *block = LLACE_IR_BLOCK_AT(fn, b);
+    llace_ir_block_stmts(block, &iv.stmts);
+    LLACE_ARRAY_FOREACH(llace_ir_stmt_t, stmt, iv.stmts) {
+      size_t var;
+      if (llace_ir_stmt_def(block, stmt, &var)) indvar_set_def(&iv, var, b);
+    }
+  }
+
+  // Blocks are never added below, so the loop forest stays valid throughout
+  llace_array_t ivs = LLACE_NEW_ARRAY(indvar_iv_t, 4);
+  size_t reduced = 0;
+  for (size_t l = LLACE_ARRAY_COUNT(iv.loops.loops); l > 0; --l) {
+    const llace_ir_loop_t *loop = LLACE_IR_LOOP_AT(&iv.loops, l - 1);
+    if (LLACE_ARRAY_COUNT(loop->latches) != 1) continue;
+
+    iv.loop = l - 1;
+    iv.pre = llace_ir_loop_preheader(&iv.cfg, &iv.loops, iv.loop);
+    iv.latch = *LLACE_ARRAY_FRONT(size_t, loop->latches);
+    if (iv.pre == SIZE_MAX) continue;
+
+    indvar_find_ivs(&iv, &ivs);
+    if (LLACE_ARRAY_IS_EMPTY(ivs)) continue;
+    while (indvar_reduce_one(&iv, &ivs)) ++reduced;
+  }
+  if (stats) stats->reduced = reduced;
+
+  LLACE_FREE_ARRAY(ivs);
+  LLACE_FREE_ARRAY(iv.stmts);
+  LLACE_FREE_ARRAY(iv.defs);
+  LLACE_FREE_ARRAY(iv.defblock);
+  llace_ir_loops_free(&iv.loops);
+  llace_ir_cfg_free(&iv.cfg);
+  return LLACE_ERROR_NONE;
+}
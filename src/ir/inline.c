@@ -0,0 +1,372 @@
+#include <llace/ir.h>
+#include <llace/profile.h>
+#include <llace/detail/common.h>
+
+// ================ Function Inlining ================ //
+
+#define INLINE_MAX_DEPTH 4 // loop depth bonus stops growing past this
+
+typedef struct {
+  llace_ir_context_t *ctx;
+  const llace_config_t *config;
+  llace_ir_callgraph_t cg;
+  size_t *sizes;        // stack values per function, updated as callers grow
+  llace_array_t stmts;  // llace_ir_stmt_t scratch
+  llace_array_t values; // llace_ir_value_t scratch
+  llace_array_t succs;  // size_t scratch
+  size_t serial;        // suffix keeping cloned names unique
+  size_t inlined;
+} inline_t;
+
+typedef struct {
+  size_t block;
+  size_t depth; // loop depth of the block in the caller
+} inline_work_t;
+
+static size_t inline_size(const llace_ir_function_t *fn) {
+  size_t size = 0;
+  LLACE_ARRAY_FOREACH(llace_ir_basicblock_t, block, fn->blocks) size += LLACE_ARRAY_COUNT(block->stack);
+  return size;
+}
+
+static bool inline_is_leaf(const llace_ir_function_t *fn) {
+  LLACE_ARRAY_FOREACH(llace_ir_basicblock_t, block, fn->blocks) {
+    LLACE_ARRAY_FOREACH(llace_ir_value_t, value, block->stack) {
+      if (LLACE_IR_IS_OP(value, LLACE_IR_OP_CALL)) return false;
+    }
+  }
+  return true;
+}
+
+// Returns carrying a value, SIZE_MAX if the callee mixes void and value returns
+static size_t inline_returns(const llace_ir_function_t *fn) {
+  size_t with = 0, without = 0;
+  LLACE_ARRAY_FOREACH(llace_ir_basicblock_t, block, fn->blocks) {
+    LLACE_ARRAY_FOREACH(llace_ir_value_t, value, block->stack) {
+      if (!LLACE_IR_IS_OP(value, LLACE_IR_OP_RET)) continue;
+      if (value->instr.in) ++with; else ++without;
+    }
+  }
+  return with && without ? SIZE_MAX : with;
+}
+
+// Jumping back to the entry would need a phi for the call site
+static bool inline_entry_has_preds(const llace_ir_function_t *fn) {
+  LLACE_ARRAY_FOREACH(llace_ir_basicblock_t, block, fn->blocks) {
+    for (size_t i = llace_ir_block_term(block); i < LLACE_ARRAY_COUNT(block->stack); ++i) {
+      const llace_ir_value_t *value = LLACE_IR_STACK_AT(block, i);
+      if (value->kind == LLACE_IR_VALUE_BLOCK && value->block == 0) return true;
+    }
+  }
+  return false;
+}
+
+// Size/benefit model, constant arguments and call sites inside loops make inlining cheaper
+static bool inline_profitable(inline_t *in, size_t caller, size_t callee, const llace_ir_basicblock_t *block, size_t call, size_t depth, size_t budget) {
+  const llace_ir_function_t *fn = LLACE_IR_FUNCTION(in->ctx, callee);
+  size_t size = in->sizes[callee];
+  if (inline_is_leaf(fn) && size <= in->config->inline_leaf_threshold) return true;
+  if (in->sizes[caller] + size > budget) return false;
+
+  size_t args = LLACE_IR_STACK_AT(block, call)->instr.in;
+  size_t roots[args ? args : 1];
+  llace_ir_operands(block, call, roots, args);
+  size_t bonus = 2 * (args + 1); // argument moves, call and return
+  for (size_t a = 0; a < args; ++a) {
+    if (LLACE_IR_STACK_AT(block, roots[a])->kind == LLACE_IR_VALUE_CONST) bonus += 4;
+  }
+
+  size_t cost = size > bonus ? size - bonus : 0;
+  size_t limit = in->config->inline_threshold;
+  limit += limit * LLACE_MIN(depth, INLINE_MAX_DEPTH) / 2;
+  return cost <= limit;
+}
+
+static bool inline_eligible(inline_t *in, size_t caller, const llace_ir_value_t *call) {
+  size_t callee = call->instr.func;
+  if (callee >= LLACE_ARRAY_COUNT(in->ctx->funcmap.funcs) || callee == caller) return false;
+  if (LLACE_IR_CALLGRAPH_SCC(&in->cg, callee) == LLACE_IR_CALLGRAPH_SCC(&in->cg, caller)) return false;
+  if (llace_ir_callgraph_recursive(&in->cg, callee)) return false;
+
+  const llace_ir_function_t *fn = LLACE_IR_FUNCTION(in->ctx, callee);
+  if (LLACE_ARRAY_IS_EMPTY(fn->blocks) || fn->param_count != call->instr.in) return false;
+  if (inline_entry_has_preds(fn)) return false;
+
+  size_t rets = inline_returns(fn);
+  if (rets == SIZE_MAX) return false;
+  return call->instr.out ? rets > 0 : rets == 0;
+}
+
+// Values before the call in its statement run first, they must not observe the callee
+static bool inline_prefix_pure(const inline_t *in, const llace_ir_function_t *fn, const llace_ir_basicblock_t *block, size_t begin, size_t end) {
+  for (size_t i = begin; i < end; ++i) {
+    const llace_ir_value_t *value = LLACE_IR_STACK_AT(block, i);
+    if (LLACE_IR_IS_OP(value, LLACE_IR_OP_LOAD) || LLACE_IR_IS_OP(value, LLACE_IR_OP_CALL)) return false;
+    if (value->kind == LLACE_IR_VALUE_VAR && LLACE_IR_VAR_AT(fn, value->var)->attr.attr._volatile) return false;
+    if (value->kind == LLACE_IR_VALUE_GLOBAL && LLACE_IR_GLOBAL_AT(in->ctx, value->global)->attr.attr._volatile) return false;
+  }
+  return true;
+}
+
+// Move a call nested in an expression into a statement of its own, returns its result variable
+static size_t inline_outline(inline_t *in, llace_ir_function_t *fn, size_t b, const llace_ir_stmt_t *stmt, size_t call) {
+  llace_ir_basicblock_t *block = LLACE_IR_BLOCK_AT(fn, b);
+  size_t begin = llace_ir_expr_begin(block, call);
+  const llace_ir_function_t *callee = LLACE_IR_FUNCTION(in->ctx, LLACE_IR_STACK_AT(block, call)->instr.func);
+
+  char name[256];
+  snprintf(name, sizeof(name), "%s.ret.%zu", callee->name, in->serial);
+  size_t result;
+  llace_ir_variable_new(fn, name, callee->ret, (llace_ir_typeattr_t){ .depth = callee->retattr.depth }, &result);
+
+  in->values.element_count = 0;
+  LLACE_ARRAY_PUSHA(in->values, LLACE_IR_STACK_AT(block, begin), call + 1 - begin);
+  LLACE_ARRAY_PUSH(in->values, LLACE_IR_VAR(result));
+  LLACE_ARRAY_PUSH(in->values, LLACE_IR_OP(LLACE_IR_OP_ASSIGN, 2, 0));
+
+  // The call's subtree collapses to its result
+  llace_ir_value_t *stack = LLACE_ARRAY_RAW(block->stack);
+  stack[begin] = LLACE_IR_VAR(result);
+  memmove(&stack[begin + 1], &stack[call + 1], (LLACE_ARRAY_COUNT(block->stack) - call - 1) * sizeof(llace_ir_value_t));
+  block->stack.element_count -= call - begin;
+
+  llace_ir_block_insert(block, stmt->begin, LLACE_ARRAY_RAW(in->values), LLACE_ARRAY_COUNT(in->values));
+  return result;
+}
+
+// Splice the callee into the canonical call statement [begin, end) of block b, returns the continuation block
+static size_t inline_call(inline_t *in, llace_ir_function_t *fn, size_t b, size_t begin, size_t end, size_t call) {
+  llace_ir_basicblock_t *block = LLACE_IR_BLOCK_AT(fn, b);
+  const llace_ir_value_t *call_value = LLACE_IR_STACK_AT(block, call);
+  const llace_ir_function_t *callee = LLACE_IR_FUNCTION(in->ctx, call_value->instr.func);
+  bool has_result = call_value->instr.out != 0;
+  size_t result = has_result ? LLACE_IR_STACK_AT(block, call + 1)->var : SIZE_MAX;
+  size_t serial = in->serial++;
+  char name[256];
+
+  // Arguments, single values are substituted and expressions get a variable
+  size_t params = callee->param_count;
+  size_t roots[params ? params : 1];
+  llace_ir_operands(block, call, roots, params);
+  llace_ir_value_t *varmap = malloc((LLACE_ARRAY_COUNT(callee->vars) + 1) * sizeof(llace_ir_value_t));
+  if (varmap == NULL) { LLACE_LOG_FATAL("Failed to allocate variable map of '%s'", callee->name); }
+
+  llace_array_t args = LLACE_NEW_ARRAY(llace_ir_value_t, 8);
+  for (size_t p = 0; p < params; ++p) {
+    const llace_ir_variable_t *param = LLACE_IR_VAR_AT(callee, p);
+    size_t arg_begin = llace_ir_expr_begin(block, roots[p]);
+    const llace_ir_value_t *arg = LLACE_IR_STACK_AT(block, roots[p]);
+    if (arg_begin == roots[p] && arg->kind != LLACE_IR_VALUE_BLOCK && !param->attr.attr._volatile) {
+      varmap[p] = *arg;
+      continue;
+    }
+
+    snprintf(name, sizeof(name), "%s.%s.%zu", callee->name, param->name, serial);
+    size_t var;
+    llace_ir_variable_new(fn, name, param->type, param->attr, &var);
+    LLACE_ARRAY_PUSHA(args, LLACE_IR_STACK_AT(block, arg_begin), roots[p] + 1 - arg_begin);
+    LLACE_ARRAY_PUSH(args, LLACE_IR_VAR(var));
+    LLACE_ARRAY_PUSH(args, LLACE_IR_OP(LLACE_IR_OP_ASSIGN, 2, 0));
+    varmap[p] = LLACE_IR_VAR(var);
+  }
+  for (size_t v = params; v < LLACE_ARRAY_COUNT(callee->vars); ++v) {
+    const llace_ir_variable_t *var = LLACE_IR_VAR_AT(callee, v);
+    snprintf(name, sizeof(name), "%s.%s.%zu", callee->name, var->name, serial);
+    size_t index;
+    llace_ir_variable_new(fn, name, var->type, var->attr, &index);
+    varmap[v] = LLACE_IR_VAR(index);
+  }
+
+  // The statements after the call move to a continuation block
+  snprintf(name, sizeof(name), "%s.cont.%zu", block->name, serial);
+  size_t cont;
+  llace_ir_block_new(fn, name, &cont);
+  size_t base = LLACE_ARRAY_COUNT(fn->blocks);
+  for (size_t k = 0; k < LLACE_ARRAY_COUNT(callee->blocks); ++k) {
+    snprintf(name, sizeof(name), "%s.%s.%zu", callee->name, LLACE_IR_BLOCK_AT(callee, k)->name, serial);
+    llace_ir_block_new(fn, name, NULL);
+  }
+  block = LLACE_IR_BLOCK_AT(fn, b);
+  llace_ir_basicblock_t *cb = LLACE_IR_BLOCK_AT(fn, cont);
+
+  size_t rets = has_result ? inline_returns(callee) : 0;
+  llace_array_t *phi = &in->values; // incoming pairs of the result phi
+  phi->element_count = 0;
+  LLACE_ARRAY_PUSHA(cb->stack, (llace_ir_value_t *)LLACE_ARRAY_RAW(block->stack) + end, LLACE_ARRAY_COUNT(block->stack) - end);
+
+  block->stack.element_count = begin;
+  LLACE_ARRAY_PUSHA(block->stack, LLACE_ARRAY_RAW(args), LLACE_ARRAY_COUNT(args));
+  LLACE_IR_PUSH(block, LLACE_IR_BLOCK(base));
+  LLACE_IR_PUSH(block, LLACE_IR_OP(LLACE_IR_OP_JMP, 1, 0));
+
+  // Successor phis now come from the continuation
+  llace_ir_block_succs(cb, &in->succs);
+  LLACE_ARRAY_FOREACH(size_t, succ, in->succs) {
+    llace_ir_basicblock_t *sb = LLACE_IR_BLOCK_AT(fn, *succ);
+    size_t term = llace_ir_block_term(sb);
+    for (size_t i = 0; i < term; ++i) {
+      llace_ir_value_t *value = LLACE_IR_STACK_AT(sb, i);
+      if (value->kind == LLACE_IR_VALUE_BLOCK && value->block == b) value->block = cont;
+    }
+  }
+
+  // Clone the callee body, returns jump to the continuation
+  for (size_t k = 0; k < LLACE_ARRAY_COUNT(callee->blocks); ++k) {
+    const llace_ir_basicblock_t *from = LLACE_IR_BLOCK_AT(callee, k);
+    llace_ir_basicblock_t *to = LLACE_IR_BLOCK_AT(fn, base + k);
+    LLACE_ARRAY_FOREACH(llace_ir_value_t, value, from->stack) {
+      switch (value->kind) {
+      case LLACE_IR_VALUE_VAR:
+        LLACE_IR_PUSH(to, varmap[value->var]);
+        continue;
+      case LLACE_IR_VALUE_BLOCK:
+        LLACE_IR_PUSH(to, LLACE_IR_BLOCK(base + value->block));
+        continue;
+      default:
+        break;
+      }
+      if (!LLACE_IR_IS_OP(value, LLACE_IR_OP_RET)) {
+        LLACE_IR_PUSH(to, *value);
+        continue;
+      }
+
+      if (has_result) {
+        size_t var = result;
+        if (rets > 1) {
+          snprintf(name, sizeof(name), "%s.ret%zu.%zu", callee->name, LLACE_ARRAY_COUNT(*phi) / 2, serial);
+          llace_ir_variable_new(fn, name, callee->ret, (llace_ir_typeattr_t){ .depth = callee->retattr.depth }, &var);
+          LLACE_ARRAY_PUSH(*phi, LLACE_IR_VAR(var));
+          LLACE_ARRAY_PUSH(*phi, LLACE_IR_BLOCK(base + k));
+        }
+        LLACE_IR_PUSH(to, LLACE_IR_VAR(var));
+        LLACE_IR_PUSH(to, LLACE_IR_OP(LLACE_IR_OP_ASSIGN, 2, 0));
+      }
+      LLACE_IR_PUSH(to, LLACE_IR_BLOCK(cont));
+      LLACE_IR_PUSH(to, LLACE_IR_OP(LLACE_IR_OP_JMP, 1, 0));
+    }
+  }
+
+  // Several returns merge in the continuation
+  if (rets > 1) {
+    size_t pairs = LLACE_ARRAY_COUNT(*phi);
+    LLACE_ARRAY_PUSH(*phi, LLACE_IR_OP(LLACE_IR_OP_PHI, (uint32_t)pairs, 1));
+    LLACE_ARRAY_PUSH(*phi, LLACE_IR_VAR(result));
+    LLACE_ARRAY_PUSH(*phi, LLACE_IR_OP(LLACE_IR_OP_ASSIGN, 2, 0));
+    llace_ir_block_insert(LLACE_IR_BLOCK_AT(fn, cont), 0, LLACE_ARRAY_RAW(*phi), LLACE_ARRAY_COUNT(*phi));
+  }
+
+  LLACE_FREE_ARRAY(args);
+  free(varmap);
+  return cont;
+}
+
+// Inline the profitable call sites of one function, its callees are already final
+static void inline_function(inline_t *in, size_t f) {
+  llace_ir_function_t *fn = LLACE_IR_FUNCTION(in->ctx, f);
+  size_t budget = in->sizes[f] + in->sizes[f] * in->config->inline_growth / 100;
+
+  llace_ir_cfg_t cfg;
+  llace_ir_loopinfo_t loops;
+  llace_ir_cfg_build(fn, &cfg);
+  llace_ir_loops_build(&cfg, &loops);
+  llace_array_t work = LLACE_NEW_ARRAY(inline_work_t, LLACE_ARRAY_COUNT(fn->blocks));
+  for (size_t b = LLACE_ARRAY_COUNT(fn->blocks); b > 0; --b) {
+    size_t loop = *LLACE_ARRAY_GET(size_t, loops.innermost, b - 1);
+    inline_work_t item = { .block = b - 1, .depth = loop == SIZE_MAX ? 0 : LLACE_IR_LOOP_AT(&loops, loop)->depth };
+    LLACE_ARRAY_PUSHP(work, &item);
+  }
+  llace_ir_loops_free(&loops);
+  llace_ir_cfg_free(&cfg);
+
+  // Cloned callee blocks are not revisited, continuation blocks are
+  while (!LLACE_ARRAY_IS_EMPTY(work)) {
+    inline_work_t item = *LLACE_ARRAY_BACK(inline_work_t, work);
+    --work.element_count;
+
+    llace_ir_basicblock_t *block = LLACE_IR_BLOCK_AT(fn, item.block);
+    llace_ir_block_stmts(block, &in->stmts);
+    for (size_t n = 0; n < LLACE_ARRAY_COUNT(in->stmts); ++n) {
+      const llace_ir_stmt_t *stmt = LLACE_ARRAY_GET(llace_ir_stmt_t, in->stmts, n);
+      size_t call = SIZE_MAX;
+      for (size_t i = stmt->begin; i < stmt->end; ++i) {
+        const llace_ir_value_t *value = LLACE_IR_STACK_AT(block, i);
+        if (!LLACE_IR_IS_OP(value, LLACE_IR_OP_CALL) || !inline_eligible(in, f, value)) continue;
+        if (!inline_prefix_pure(in, fn, block, stmt->begin, llace_ir_expr_begin(block, i))) continue;
+        if (!inline_profitable(in, f, value->instr.func, block, i, item.depth, budget)) continue;
+        call = i;
+        break;
+      }
+      if (call == SIZE_MAX) continue;
+
+      llace_ir_stmt_t canon = *stmt;
+      bool standalone = LLACE_IR_STACK_AT(block, call)->instr.out == 0 ||
+                        (call + 3 == stmt->end && llace_ir_expr_begin(block, call) == stmt->begin);
+      if (!standalone) {
+        size_t begin = llace_ir_expr_begin(block, call);
+        inline_outline(in, fn, item.block, stmt, call);
+        canon.end = stmt->begin + (call + 1 - begin) + 2;
+        call = canon.end - 3;
+      }
+
+      size_t cont = inline_call(in, fn, item.block, canon.begin, canon.end, call);
+      in->sizes[f] = inline_size(fn);
+      ++in->inlined;
+
+      inline_work_t next = { .block = cont, .depth = item.depth };
+      LLACE_ARRAY_PUSHP(work, &next);
+      break;
+    }
+  }
+
+  LLACE_FREE_ARRAY(work);
+}
+
+llace_error_t llace_ir_opt_inline(llace_ir_context_t *ctx, const llace_config_t *config, llace_ir_inline_stats_t *stats) {
+  LLACE_PROFILE_SCOPE("inline");
+  LLACE_MEM_SCOPE(LLACE_MEM_IR);
+  if (!ctx || !config) {
+    return LLACE_ERROR_BADARG;
+  }
+  if (stats) *stats = (llace_ir_inline_stats_t){0};
+
+  inline_t in = {
+    .ctx = ctx,
+    .config = config,
+    .stmts = LLACE_NEW_ARRAY(llace_ir_stmt_t, 16),
+    .values = LLACE_NEW_ARRAY(llace_ir_value_t, 16),
+    .succs = LLACE_NEW_ARRAY(size_t, 2),
+  };
+  LLACE_RUNCHECK(llace_ir_callgraph_build(ctx, &in.cg));
+
+  size_t count = LLACE_ARRAY_COUNT(ctx->funcmap.funcs);
+  in.sizes = malloc((count + 1) * sizeof(size_t));
+  if (in.sizes == NULL) { LLACE_LOG_FATAL("Failed to allocate sizes of '%zu' functions", count); }
+  for (size_t f = 0; f < count; ++f) in.sizes[f] = inline_size(LLACE_IR_FUNCTION(ctx, f));
+
+  // Bottom-up, callees are as small as they will get before their callers look at them
+  LLACE_ARRAY_FOREACH(llace_array_t, members, in.cg.sccs) {
+    LLACE_ARRAY_FOREACH(size_t, f, *members) {
+      if (!LLACE_ARRAY_IS_EMPTY(LLACE_IR_FUNCTION(ctx, *f)->blocks)) inline_function(&in, *f);
+    }
+  }
+
+  if (stats) {
+    stats->inlined = in.inlined;
+    // Functions left without callers, they stay in the context for external users
+    llace_ir_callgraph_t after;
+    llace_ir_callgraph_build(ctx, &after);
+    for (size_t f = 0; f < count; ++f) {
+      if (LLACE_ARRAY_IS_EMPTY(*LLACE_IR_CALLGRAPH_CALLERS(&after, f)) && !LLACE_ARRAY_IS_EMPTY(*LLACE_IR_CALLGRAPH_CALLERS(&in.cg, f))) {
+        ++stats->uncalled;
+      }
+    }
+    llace_ir_callgraph_free(&after);
+  }
+
+  free(in.sizes);
+  llace_ir_callgraph_free(&in.cg);
+  LLACE_FREE_ARRAY(in.succs);
+  LLACE_FREE_ARRAY(in.values);
+  LLACE_FREE_ARRAY(in.stmts);
+  return LLACE_ERROR_NONE;
+}
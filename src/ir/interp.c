@@ -0,0 +1,674 @@
+#include <llace/ir/interp.h>
+#include <llace/detail/common.h>
+#include <string.h>
+
+// Handlers of the dispatch loop, the enum indexes its label table
+#define INTERP_OPS(X) \
+  X(CONST) X(VAR) X(STORE_VAR) \
+  X(ADD) X(SUB) X(MUL) X(AND) X(OR) X(XOR) X(SHL) \
+  X(DIV_S) X(DIV_U) X(MOD_S) X(MOD_U) X(SHR_S) X(SHR_U) X(NORM_S) X(NORM_U) \
+  X(EQ) X(NE) X(LT_S) X(LE_S) X(GT_S) X(GE_S) X(LT_U) X(LE_U) X(GT_U) X(GE_U) \
+  X(EQ_F32) X(NE_F32) X(LT_F32) X(LE_F32) X(GT_F32) X(GE_F32) \
+  X(EQ_F64) X(NE_F64) X(LT_F64) X(LE_F64) X(GT_F64) X(GE_F64) \
+  X(NZ) X(Z) \
+  X(ADD_F32) X(SUB_F32) X(MUL_F32) X(DIV_F32) X(ADD_F64) X(SUB_F64) X(MUL_F64) X(DIV_F64) \
+  X(LOAD_S8) X(LOAD_U8) X(LOAD_S16) X(LOAD_U16) X(LOAD_S32) X(LOAD_U32) X(LOAD64) \
+  X(STORE8) X(STORE16) X(STORE32) X(STORE64) \
+  X(INDEX) X(CALL) X(CALL0) X(JMP) X(BACK) X(BRANCH) X(RET) X(RET0)
+
+#define INTERP_ENUM(name) INTERP_##name,
+typedef enum { INTERP_OPS(INTERP_ENUM) } interp_op_t;
+
+// Labels as values where the compiler has them, a switch otherwise
+#if defined(__GNUC__) && !defined(LLACE_INTERP_SWITCH)
+#define INTERP_THREADED 1
+#else
+#define INTERP_THREADED 0
+#endif
+
+typedef struct interp_inst {
+  const void *handler; // label of op once the function is threaded
+  uint32_t op;         // interp_op_t
+  uint32_t a;          // variable, function, jump or false target
+  int64_t imm;         // constant, shift, mask, element size, argument count or true target
+} interp_inst_t;
+
+typedef struct llace_interp_func {
+  llace_array_t code; // interp_inst_t
+  size_t vars, params;
+  size_t depth;  // deepest the operand stack gets
+  bool threaded; // handlers are filled in
+  llace_interp_counts_t counts;
+} interp_func_t;
+
+#define INTERP_FUNC(interp, index) (*LLACE_ARRAY_GET(interp_func_t *, (interp)->funcs, (index)))
+
+// ================ Words ================ //
+
+typedef struct {
+  llace_ir_type_t type;
+  size_t depth;
+} interp_type_t;
+
+// Bits an integer word carries, pointers are full words
+static size_t interp_width(interp_type_t t) {
+  size_t bits = t.depth > 0 ? 64 : llace_ir_type_bits(t.type);
+  return bits == 0 || bits > 64 ? 64 : bits;
+}
+
+static bool interp_signed(interp_type_t t) {
+  return t.depth == 0 && t.type.kind == LLACE_IR_TYPE_INT && interp_width(t) > 1;
+}
+
+static bool interp_float(interp_type_t t) {
+  return t.depth == 0 && t.type.kind == LLACE_IR_TYPE_FLOAT;
+}
+
+static bool interp_single(interp_type_t t) {
+  return llace_ir_type_bits(t.type) <= 32;
+}
+
+static uint64_t interp_extend(uint64_t word, size_t width, bool sign) {
+  unsigned shift = (unsigned)(64 - width);
+  return sign ? (uint64_t)((int64_t)(word << shift) >> shift) : (word << shift) >> shift;
+}
+
+static uint64_t interp_const(const llace_ir_value_t *value) {
+  interp_type_t t = { value->type, 0 };
+  if (!interp_float(t)) return interp_extend(value->_unt, interp_width(t), interp_signed(t));
+  if (interp_single(t)) {
+    float single = (float)value->_float;
+    uint32_t bits;
+    memcpy(&bits, &single, sizeof(bits));
+    return bits;
+  }
+  uint64_t bits;
+  memcpy(&bits, &value->_float, sizeof(bits));
+  return bits;
+}
+
+static inline float interp_f32(uint64_t word) {
+  uint32_t bits = (uint32_t)word;
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+static inline double interp_f64(uint64_t word) {
+  double value;
+  memcpy(&value, &word, sizeof(value));
+  return value;
+}
+
+static inline uint64_t interp_w32(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+static inline uint64_t interp_w64(double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+// ================ Interpreter ================ //
+
+// Functions and globals added to the context since the last call
+static void interp_sync(llace_interp_t *interp) {
+  while (LLACE_ARRAY_COUNT(interp->funcs) < LLACE_ARRAY_COUNT(interp->ctx->funcmap.funcs)) {
+    LLACE_ARRAY_PUSH(interp->funcs, (interp_func_t *)NULL);
+  }
+  while (LLACE_ARRAY_COUNT(interp->globals) < LLACE_ARRAY_COUNT(interp->ctx->globmap.globals)) {
+    LLACE_ARRAY_PUSH(interp->globals, (void *)NULL);
+  }
+}
+
+llace_error_t llace_interp_init(llace_interp_t *interp, const llace_ir_context_t *ctx) {
+  if (!interp || !ctx) {
+    return LLACE_ERROR_BADARG;
+  }
+
+  *interp = (llace_interp_t){ .ctx = ctx };
+  interp->funcs = LLACE_NEW_ARRAY(interp_func_t *, 16);
+  interp->globals = LLACE_NEW_ARRAY(void *, 16);
+  interp->owned = LLACE_NEW_ARRAY(void *, 16);
+  return LLACE_ERROR_NONE;
+}
+
+void llace_interp_free(llace_interp_t *interp) {
+  LLACE_ARRAY_FOREACH(interp_func_t *, func, interp->funcs) {
+    if (*func == NULL) continue;
+    LLACE_FREE_ARRAY((*func)->code);
+    free(*func);
+  }
+  LLACE_ARRAY_FOREACH(void *, storage, interp->owned) free(*storage);
+  LLACE_FREE_ARRAY(interp->funcs);
+  LLACE_FREE_ARRAY(interp->globals);
+  LLACE_FREE_ARRAY(interp->owned);
+  *interp = (llace_interp_t){0};
+}
+
+void *llace_interp_global(llace_interp_t *interp, size_t global) {
+  interp_sync(interp);
+  if (global >= LLACE_ARRAY_COUNT(interp->globals)) return NULL;
+  void **slot = LLACE_ARRAY_GET(void *, interp->globals, global);
+  if (*slot) return *slot;
+  if (interp->resolve) return *slot = interp->resolve(interp->user, global);
+
+  const llace_ir_global_t *glob = LLACE_IR_GLOBAL_AT(interp->ctx, global);
+  size_t size = glob->attr.depth > 0 ? 8 : LLACE_MAX(llace_ir_type_bits(glob->type) / 8, (size_t)1);
+  void *storage = calloc(1, LLACE_MAX(size, sizeof(uint64_t)));
+  if (storage == NULL) { LLACE_LOG_FATAL("Failed to allocate global '%s'", glob->name); }
+  LLACE_ARRAY_PUSH(interp->owned, storage);
+
+  if (glob->value.kind == LLACE_IR_VALUE_CONST && glob->attr.depth == 0) {
+    uint64_t word = interp_const(&glob->value);
+    memcpy(storage, &word, LLACE_MIN(size, sizeof(word)));
+  }
+  return *slot = storage;
+}
+
+// ================ Decoding ================ //
+
+// Jump of a decoded instruction still naming a block
+typedef struct {
+  size_t inst;
+  size_t from, to; // blocks
+  bool taken;      // the true target of a branch (imm), otherwise a
+} interp_edge_t;
+
+typedef struct {
+  llace_interp_t *interp;
+  const llace_ir_function_t *fn;
+  interp_func_t *func;
+  llace_array_t types;  // interp_type_t, operand stack of the statement
+  llace_array_t starts; // size_t, first instruction per block
+  llace_array_t edges;  // interp_edge_t
+  llace_array_t stmts;  // llace_ir_stmt_t scratch
+  llace_array_t copies; // size_t, phi targets of an edge
+} interp_decode_t;
+
+static void interp_emit(interp_decode_t *d, interp_op_t op, size_t a, int64_t imm) {
+  LLACE_ARRAY_PUSH(d->func->code, ((interp_inst_t){ .op = (uint32_t)op, .a = (uint32_t)a, .imm = imm }));
+}
+
+static llace_error_t interp_push(interp_decode_t *d, llace_ir_type_t type, size_t depth) {
+  if (LLACE_IR_IS_VEC(type)) return LLACE_ERROR_INVLTYPE;
+  LLACE_ARRAY_PUSH(d->types, ((interp_type_t){ type, depth }));
+  d->func->depth = LLACE_MAX(d->func->depth, LLACE_ARRAY_COUNT(d->types));
+  return LLACE_ERROR_NONE;
+}
+
+// Narrow integers are brought back to their width after ops that can carry out of it
+static void interp_norm(interp_decode_t *d, interp_type_t t) {
+  size_t width = interp_width(t);
+  if (width < 64) interp_emit(d, interp_signed(t) ? INTERP_NORM_S : INTERP_NORM_U, 0, (int64_t)(64 - width));
+}
+
+static llace_error_t interp_instr(interp_decode_t *d, const llace_ir_instr_t *instr) {
+  size_t count = LLACE_ARRAY_COUNT(d->types);
+  if (instr->in > count) return LLACE_ERROR_INVLFUNC;
+  interp_type_t lhs = instr->in > 0 ? *LLACE_ARRAY_GET(interp_type_t, d->types, count - instr->in) : (interp_type_t){ LLACE_IR_VOID, 0 };
+  interp_type_t rhs = instr->in > 1 ? *LLACE_ARRAY_GET(interp_type_t, d->types, count - instr->in + 1) : (interp_type_t){ LLACE_IR_VOID, 0 };
+  d->types.element_count -= instr->in;
+  interp_type_t from;
+  llace_ir_type_arith(lhs.type, lhs.depth, rhs.type, rhs.depth, &from.type, &from.depth);
+  interp_type_t result = { LLACE_IR_INT(1), 0 };
+
+  switch (instr->op) {
+  case LLACE_IR_OP_ADD: case LLACE_IR_OP_SUB: case LLACE_IR_OP_MUL: case LLACE_IR_OP_DIV: case LLACE_IR_OP_MOD:
+  case LLACE_IR_OP_AND: case LLACE_IR_OP_OR: case LLACE_IR_OP_XOR: case LLACE_IR_OP_SHL: case LLACE_IR_OP_SHR: {
+    result = from;
+    if (interp_float(result)) {
+      if (instr->op > LLACE_IR_OP_DIV) return LLACE_ERROR_INVLTYPE;
+      interp_emit(d, (interp_single(result) ? INTERP_ADD_F32 : INTERP_ADD_F64) + (instr->op - LLACE_IR_OP_ADD), 0, 0);
+      break;
+    }
+    bool sign = interp_signed(result), norm = true;
+    switch (instr->op) {
+    case LLACE_IR_OP_ADD: interp_emit(d, INTERP_ADD, 0, 0); break;
+    case LLACE_IR_OP_SUB: interp_emit(d, INTERP_SUB, 0, 0); break;
+    case LLACE_IR_OP_MUL: interp_emit(d, INTERP_MUL, 0, 0); break;
+    case LLACE_IR_OP_SHL: interp_emit(d, INTERP_SHL, 0, 0); break;
+    case LLACE_IR_OP_DIV: interp_emit(d, sign ? INTERP_DIV_S : INTERP_DIV_U, 0, 0); norm = sign; break;
+    case LLACE_IR_OP_MOD: interp_emit(d, sign ? INTERP_MOD_S : INTERP_MOD_U, 0, 0); norm = false; break;
+    case LLACE_IR_OP_SHR: interp_emit(d, sign ? INTERP_SHR_S : INTERP_SHR_U, 0, 0); norm = false; break;
+    case LLACE_IR_OP_AND: interp_emit(d, INTERP_AND, 0, 0); norm = false; break;
+    case LLACE_IR_OP_OR: interp_emit(d, INTERP_OR, 0, 0); norm = false; break;
+    default: interp_emit(d, INTERP_XOR, 0, 0); norm = false; break;
+    }
+    if (norm) interp_norm(d, result);
+    break;
+  }
+  case LLACE_IR_OP_EQ: case LLACE_IR_OP_NE: case LLACE_IR_OP_LT: case LLACE_IR_OP_LE: case LLACE_IR_OP_GT: case LLACE_IR_OP_GE:
+    if (interp_float(from)) {
+      interp_emit(d, (interp_single(from) ? INTERP_EQ_F32 : INTERP_EQ_F64) + (instr->op - LLACE_IR_OP_EQ), 0, 0);
+    } else if (instr->op <= LLACE_IR_OP_NE) {
+      interp_emit(d, INTERP_EQ + (instr->op - LLACE_IR_OP_EQ), 0, 0);
+    } else {
+      interp_emit(d, (interp_signed(from) ? INTERP_LT_S : INTERP_LT_U) + (instr->op - LLACE_IR_OP_LT), 0, 0);
+    }
+    break;
+  case LLACE_IR_OP_NZ: case LLACE_IR_OP_Z: {
+    // Floats test everything but the sign, -0.0 is zero
+    int64_t mask = !interp_float(lhs) ? -1 : interp_single(lhs) ? INT32_MAX : INT64_MAX;
+    interp_emit(d, instr->op == LLACE_IR_OP_NZ ? INTERP_NZ : INTERP_Z, 0, mask);
+    break;
+  }
+  case LLACE_IR_OP_LOAD: {
+    if (instr->lanes) return LLACE_ERROR_INVLTYPE;
+    if (lhs.depth == 0) return LLACE_ERROR_INVLFUNC;
+    result = (interp_type_t){ lhs.type, lhs.depth - 1 };
+    size_t width = interp_width(result);
+    bool sign = interp_signed(result);
+    if (interp_float(result)) {
+      interp_emit(d, interp_single(result) ? INTERP_LOAD_U32 : INTERP_LOAD64, 0, 0);
+    } else if (width <= 8) {
+      interp_emit(d, sign ? INTERP_LOAD_S8 : INTERP_LOAD_U8, 0, 0);
+      if (width < 8) interp_norm(d, result);
+    } else if (width <= 16) {
+      interp_emit(d, sign ? INTERP_LOAD_S16 : INTERP_LOAD_U16, 0, 0);
+      if (width < 16) interp_norm(d, result);
+    } else if (width <= 32) {
+      interp_emit(d, sign ? INTERP_LOAD_S32 : INTERP_LOAD_U32, 0, 0);
+      if (width < 32) interp_norm(d, result);
+    } else {
+      interp_emit(d, INTERP_LOAD64, 0, 0);
+      interp_norm(d, result);
+    }
+    break;
+  }
+  case LLACE_IR_OP_STORE: {
+    if (instr->lanes) return LLACE_ERROR_INVLTYPE;
+    if (rhs.depth == 0) return LLACE_ERROR_INVLFUNC;
+    size_t bits = rhs.depth > 1 ? 64 : llace_ir_type_bits(rhs.type);
+    interp_emit(d, bits <= 8 ? INTERP_STORE8 : bits <= 16 ? INTERP_STORE16 : bits <= 32 ? INTERP_STORE32 : INTERP_STORE64, 0, 0);
+    break;
+  }
+  case LLACE_IR_OP_INDEX:
+    result = lhs;
+    interp_emit(d, INTERP_INDEX, 0, lhs.depth > 1 ? 8 : (int64_t)LLACE_MAX(llace_ir_type_bits(lhs.type) / 8, (size_t)1));
+    break;
+  case LLACE_IR_OP_CALL: {
+    const llace_ir_function_t *callee = LLACE_IR_FUNCTION(d->interp->ctx, instr->func);
+    result = (interp_type_t){ callee->ret, callee->retattr.depth };
+    interp_emit(d, instr->out ? INTERP_CALL : INTERP_CALL0, instr->func, instr->in);
+    break;
+  }
+  case LLACE_IR_OP_SPLAT: case LLACE_IR_OP_PACK: case LLACE_IR_OP_EXTRACT:
+    return LLACE_ERROR_INVLTYPE;
+  default:
+    return LLACE_ERROR_INVLFUNC; // statements are taken apart by interp_block
+  }
+
+  if (instr->out) LLACE_RUNCHECK(interp_push(d, result.type, result.depth));
+  return LLACE_ERROR_NONE;
+}
+
+// Decodes the values [begin, end) of a block
+static llace_error_t interp_expr(interp_decode_t *d, const llace_ir_basicblock_t *block, size_t begin, size_t end) {
+  for (size_t i = begin; i < end; ++i) {
+    const llace_ir_value_t *value = LLACE_IR_STACK_AT(block, i);
+    switch (value->kind) {
+    case LLACE_IR_VALUE_CONST:
+      interp_emit(d, INTERP_CONST, 0, (int64_t)interp_const(value));
+      LLACE_RUNCHECK(interp_push(d, value->type, 0));
+      break;
+    case LLACE_IR_VALUE_VAR: {
+      const llace_ir_variable_t *var = LLACE_IR_VAR_AT(d->fn, value->var);
+      interp_emit(d, INTERP_VAR, value->var, 0);
+      LLACE_RUNCHECK(interp_push(d, var->type, var->attr.depth));
+      break;
+    }
+    case LLACE_IR_VALUE_GLOBAL: {
+      const llace_ir_global_t *glob = LLACE_IR_GLOBAL_AT(d->interp->ctx, value->global);
+      void *storage = llace_interp_global(d->interp, value->global);
+      if (storage == NULL) return LLACE_ERROR_UNRESSYM;
+      interp_emit(d, INTERP_CONST, 0, (int64_t)(intptr_t)storage);
+      LLACE_RUNCHECK(interp_push(d, glob->type, glob->attr.depth + 1));
+      break;
+    }
+    case LLACE_IR_VALUE_BLOCK:
+      return LLACE_ERROR_INVLFUNC;
+    case LLACE_IR_VALUE_INSTR:
+      LLACE_RUNCHECK(interp_instr(d, &value->instr));
+      break;
+    }
+  }
+  return LLACE_ERROR_NONE;
+}
+
+static llace_error_t interp_jump(interp_decode_t *d, const llace_ir_value_t *target, size_t from, bool taken) {
+  if (target->kind != LLACE_IR_VALUE_BLOCK) return LLACE_ERROR_INVLFUNC;
+  interp_edge_t edge = { .inst = LLACE_ARRAY_COUNT(d->func->code), .from = from, .to = target->block, .taken = taken };
+  LLACE_ARRAY_PUSHP(d->edges, &edge);
+  return LLACE_ERROR_NONE;
+}
+
+static llace_error_t interp_block(interp_decode_t *d, size_t index) {
+  const llace_ir_basicblock_t *block = LLACE_IR_BLOCK_AT(d->fn, index);
+  *LLACE_ARRAY_GET(size_t, d->starts, index) = LLACE_ARRAY_COUNT(d->func->code);
+  LLACE_RUNCHECK(llace_ir_block_stmts(block, &d->stmts));
+
+  LLACE_ARRAY_FOREACH(llace_ir_stmt_t, stmt, d->stmts) {
+    const llace_ir_instr_t *instr = LLACE_IR_STMT_INSTR(block, stmt);
+    d->types.element_count = 0;
+
+    switch (instr->op) {
+    case LLACE_IR_OP_ASSIGN: {
+      if (stmt->end - stmt->begin >= 3 && LLACE_IR_IS_OP(LLACE_IR_STACK_AT(block, stmt->end - 3), LLACE_IR_OP_PHI)) {
+        continue; // copied on the incoming edges
+      }
+      size_t var;
+      llace_ir_stmt_def(block, stmt, &var);
+      LLACE_RUNCHECK(interp_expr(d, block, stmt->begin, stmt->end - 2));
+      interp_emit(d, INTERP_STORE_VAR, var, 0);
+      break;
+    }
+    case LLACE_IR_OP_JMP:
+      LLACE_RUNCHECK(interp_jump(d, LLACE_IR_STACK_AT(block, stmt->end - 2), index, false));
+      interp_emit(d, INTERP_JMP, 0, 0);
+      break;
+    case LLACE_IR_OP_BRANCH:
+      LLACE_RUNCHECK(interp_expr(d, block, stmt->begin, stmt->end - 3));
+      LLACE_RUNCHECK(interp_jump(d, LLACE_IR_STACK_AT(block, stmt->end - 3), index, true));
+      LLACE_RUNCHECK(interp_jump(d, LLACE_IR_STACK_AT(block, stmt->end - 2), index, false));
+      interp_emit(d, INTERP_BRANCH, 0, 0);
+      break;
+    case LLACE_IR_OP_RET:
+      LLACE_RUNCHECK(interp_expr(d, block, stmt->begin, stmt->end - 1));
+      interp_emit(d, instr->in ? INTERP_RET : INTERP_RET0, 0, 0);
+      break;
+    default:
+      LLACE_RUNCHECK(interp_expr(d, block, stmt->begin, stmt->end));
+      break;
+    }
+  }
+  return LLACE_ERROR_NONE;
+}
+
+// Where an edge lands: the block itself, or a stub assigning its phis first.
+// All inputs are pushed before the first store, phis read their inputs in parallel.
+// Edges back to an earlier block go through a counting jump.
+static llace_error_t interp_edge(interp_decode_t *d, size_t inst, size_t from, size_t to, size_t *target) {
+  const llace_ir_basicblock_t *block = LLACE_IR_BLOCK_AT(d->fn, to);
+  size_t stub = LLACE_ARRAY_COUNT(d->func->code);
+  d->types.element_count = 0;
+  d->copies.element_count = 0;
+
+  for (size_t i = 0; i < LLACE_ARRAY_COUNT(block->stack); ++i) {
+    const llace_ir_value_t *value = LLACE_IR_STACK_AT(block, i);
+    if (!LLACE_IR_IS_OP(value, LLACE_IR_OP_PHI)) continue;
+    for (size_t p = i - value->instr.in; p < i; p += 2) {
+      if (LLACE_IR_STACK_AT(block, p + 1)->block != from) continue;
+      LLACE_RUNCHECK(interp_expr(d, block, p, p + 1));
+      LLACE_ARRAY_PUSH(d->copies, LLACE_IR_STACK_AT(block, i + 1)->var);
+      break;
+    }
+  }
+
+  size_t start = *LLACE_ARRAY_GET(size_t, d->starts, to);
+  bool back = start <= inst;
+  if (LLACE_ARRAY_IS_EMPTY(d->copies) && !back) {
+    *target = start;
+    return LLACE_ERROR_NONE;
+  }
+  for (size_t c = LLACE_ARRAY_COUNT(d->copies); c-- > 0;) interp_emit(d, INTERP_STORE_VAR, *LLACE_ARRAY_GET(size_t, d->copies, c), 0);
+  interp_emit(d, back ? INTERP_BACK : INTERP_JMP, start, 0);
+  *target = stub;
+  return LLACE_ERROR_NONE;
+}
+
+static llace_error_t interp_decode(llace_interp_t *interp, size_t function, interp_func_t **out) {
+  if (INTERP_FUNC(interp, function)) {
+    *out = INTERP_FUNC(interp, function);
+    return LLACE_ERROR_NONE;
+  }
+  const llace_ir_function_t *fn = LLACE_IR_FUNCTION(interp->ctx, function);
+  if (LLACE_ARRAY_IS_EMPTY(fn->blocks)) {
+    return LLACE_ERROR_UNRESSYM; // declaration only
+  }
+  if (LLACE_IR_IS_VEC(fn->ret)) {
+    return LLACE_ERROR_INVLTYPE;
+  }
+
+  interp_func_t *func = malloc(sizeof(interp_func_t));
+  if (func == NULL) { LLACE_LOG_FATAL("Failed to allocate the decoded function '%s'", fn->name); }
+  *func = (interp_func_t){ .code = LLACE_NEW_ARRAY(interp_inst_t, 64), .vars = LLACE_ARRAY_COUNT(fn->vars), .params = fn->param_count };
+
+  size_t block_count = LLACE_ARRAY_COUNT(fn->blocks);
+  interp_decode_t d = {
+    .interp = interp,
+    .fn = fn,
+    .func = func,
+    .types = LLACE_NEW_ARRAY(interp_type_t, 16),
+    .starts = LLACE_NEW_ARRAY(size_t, block_count),
+    .edges = LLACE_NEW_ARRAY(interp_edge_t, block_count * 2),
+    .stmts = LLACE_NEW_ARRAY(llace_ir_stmt_t, 16),
+    .copies = LLACE_NEW_ARRAY(size_t, 4),
+  };
+  for (size_t b = 0; b < block_count; ++b) LLACE_ARRAY_PUSH(d.starts, (size_t)0);
+
+  llace_error_t err = LLACE_ERROR_NONE;
+  for (size_t b = 0; b < block_count && err == LLACE_ERROR_NONE; ++b) err = interp_block(&d, b);
+  for (size_t e = 0; e < LLACE_ARRAY_COUNT(d.edges) && err == LLACE_ERROR_NONE; ++e) {
+    interp_edge_t edge = *LLACE_ARRAY_GET(interp_edge_t, d.edges, e);
+    size_t target = 0;
+    err = interp_edge(&d, edge.inst, edge.from, edge.to, &target);
+    interp_inst_t *inst = LLACE_ARRAY_GET(interp_inst_t, func->code, edge.inst);
+    if (edge.taken) inst->imm = (int64_t)target;
+    else inst->a = (uint32_t)target;
+  }
+
+  LLACE_FREE_ARRAY(d.types);
+  LLACE_FREE_ARRAY(d.starts);
+  LLACE_FREE_ARRAY(d.edges);
+  LLACE_FREE_ARRAY(d.stmts);
+  LLACE_FREE_ARRAY(d.copies);
+  if (err != LLACE_ERROR_NONE) {
+    LLACE_LOG_ERROR("Failed to decode function '%s' for the interpreter: %s", fn->name, llace_error_str(err));
+    LLACE_FREE_ARRAY(func->code);
+    free(func);
+    return err;
+  }
+
+  INTERP_FUNC(interp, function) = func;
+  ++interp->stats.decoded;
+  interp->stats.instructions += LLACE_ARRAY_COUNT(func->code);
+  *out = func;
+  return LLACE_ERROR_NONE;
+}
+
+// ================ Execution ================ //
+
+#if INTERP_THREADED
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic" // labels as values
+#define OP(name) L_##name:
+#define DISPATCH goto *ip->handler
+#define INTERP_LABEL(name) [INTERP_##name] = &&L_##name,
+#else
+#define OP(name) case INTERP_##name:
+#define DISPATCH continue
+#endif
+#define NEXT { ++ip; DISPATCH; }
+#define PUSH(value) do { *sp++ = tos; tos = (value); } while (0)
+#define POP() (tos = *--sp)
+#define BINARY(name, expr) OP(name) { uint64_t b = tos, a = *--sp; (void)a; (void)b; tos = (expr); NEXT; }
+#define LOAD(name, type) OP(name) { type value; memcpy(&value, (const void *)(uintptr_t)tos, sizeof(value)); tos = (uint64_t)(int64_t)value; NEXT; }
+#define STORE(name, type) OP(name) { type value = (type)sp[-1]; memcpy((void *)(uintptr_t)tos, &value, sizeof(value)); sp -= 2; tos = *sp; NEXT; }
+
+static llace_error_t interp_exec(llace_interp_t *interp, interp_func_t *func, const uint64_t *args, uint64_t *result) {
+#if INTERP_THREADED
+  static const void *const labels[] = { INTERP_OPS(INTERP_LABEL) };
+  if (!func->threaded) {
+    LLACE_ARRAY_FOREACH(interp_inst_t, inst, func->code) inst->handler = labels[inst->op];
+    func->threaded = true;
+  }
+#endif
+
+  // stack[0] is never read back, the top of the stack is tos
+  uint64_t vars[func->vars ? func->vars : 1], stack[func->depth + 1];
+  memcpy(vars, args, func->params * sizeof(uint64_t));
+  const interp_inst_t *code = LLACE_ARRAY_RAW(func->code), *ip = code;
+  uint64_t *sp = stack, tos = 0;
+  ++interp->stats.calls;
+  ++func->counts.calls;
+
+#if INTERP_THREADED
+  DISPATCH;
+#else
+  for (;;) switch ((interp_op_t)ip->op) {
+#endif
+  OP(CONST) { PUSH((uint64_t)ip->imm); NEXT; }
+  OP(VAR) { PUSH(vars[ip->a]); NEXT; }
+  OP(STORE_VAR) { vars[ip->a] = tos; POP(); NEXT; }
+
+  BINARY(ADD, a + b)
+  BINARY(SUB, a - b)
+  BINARY(MUL, a * b)
+  BINARY(AND, a & b)
+  BINARY(OR, a | b)
+  BINARY(XOR, a ^ b)
+  BINARY(SHL, a << (b & 63))
+  BINARY(SHR_S, (uint64_t)((int64_t)a >> (b & 63)))
+  BINARY(SHR_U, a >> (b & 63))
+  OP(DIV_S) OP(MOD_S) {
+    int64_t b = (int64_t)tos, a = (int64_t)*--sp;
+    if (b == 0) return LLACE_ERROR_BADARG;
+    bool div = ip->op == INTERP_DIV_S;
+    // INT64_MIN / -1 overflows the hardware, the result wraps
+    tos = b == -1 ? (div ? 0 - (uint64_t)a : 0) : (uint64_t)(div ? a / b : a % b);
+    NEXT;
+  }
+  OP(DIV_U) { uint64_t b = tos, a = *--sp; if (b == 0) return LLACE_ERROR_BADARG; tos = a / b; NEXT; }
+  OP(MOD_U) { uint64_t b = tos, a = *--sp; if (b == 0) return LLACE_ERROR_BADARG; tos = a % b; NEXT; }
+  OP(NORM_S) { tos = (uint64_t)((int64_t)(tos << ip->imm) >> ip->imm); NEXT; }
+  OP(NORM_U) { tos = (tos << ip->imm) >> ip->imm; NEXT; }
+
+  BINARY(EQ, a == b)
+  BINARY(NE, a != b)
+  BINARY(LT_S, (int64_t)a < (int64_t)b)
+  BINARY(LE_S, (int64_t)a <= (int64_t)b)
+  BINARY(GT_S, (int64_t)a > (int64_t)b)
+  BINARY(GE_S, (int64_t)a >= (int64_t)b)
+  BINARY(LT_U, a < b)
+  BINARY(LE_U, a <= b)
+  BINARY(GT_U, a > b)
+  BINARY(GE_U, a >= b)
+  BINARY(EQ_F32, interp_f32(a) == interp_f32(b))
+  BINARY(NE_F32, interp_f32(a) != interp_f32(b))
+  BINARY(LT_F32, interp_f32(a) < interp_f32(b))
+  BINARY(LE_F32, interp_f32(a) <= interp_f32(b))
+  BINARY(GT_F32, interp_f32(a) > interp_f32(b))
+  BINARY(GE_F32, interp_f32(a) >= interp_f32(b))
+  BINARY(EQ_F64, interp_f64(a) == interp_f64(b))
+  BINARY(NE_F64, interp_f64(a) != interp_f64(b))
+  BINARY(LT_F64, interp_f64(a) < interp_f64(b))
+  BINARY(LE_F64, interp_f64(a) <= interp_f64(b))
+  BINARY(GT_F64, interp_f64(a) > interp_f64(b))
+  BINARY(GE_F64, interp_f64(a) >= interp_f64(b))
+  OP(NZ) { tos = (tos & (uint64_t)ip->imm) != 0; NEXT; }
+  OP(Z) { tos = (tos & (uint64_t)ip->imm) == 0; NEXT; }
+
+  BINARY(ADD_F32, interp_w32(interp_f32(a) + interp_f32(b)))
+  BINARY(SUB_F32, interp_w32(interp_f32(a) - interp_f32(b)))
+  BINARY(MUL_F32, interp_w32(interp_f32(a) * interp_f32(b)))
+  BINARY(DIV_F32, interp_w32(interp_f32(a) / interp_f32(b)))
+  BINARY(ADD_F64, interp_w64(interp_f64(a) + interp_f64(b)))
+  BINARY(SUB_F64, interp_w64(interp_f64(a) - interp_f64(b)))
+  BINARY(MUL_F64, interp_w64(interp_f64(a) * interp_f64(b)))
+  BINARY(DIV_F64, interp_w64(interp_f64(a) / interp_f64(b)))
+
+  LOAD(LOAD_S8, int8_t)
+  LOAD(LOAD_U8, uint8_t)
+  LOAD(LOAD_S16, int16_t)
+  LOAD(LOAD_U16, uint16_t)
+  LOAD(LOAD_S32, int32_t)
+  LOAD(LOAD_U32, uint32_t)
+  LOAD(LOAD64, uint64_t)
+  STORE(STORE8, uint8_t)
+  STORE(STORE16, uint16_t)
+  STORE(STORE32, uint32_t)
+  STORE(STORE64, uint64_t)
+  BINARY(INDEX, a + b * (uint64_t)ip->imm)
+
+  OP(CALL) OP(CALL0) {
+    // The arguments are the top imm words, tos goes below the frame to line them up
+    *sp = tos;
+    sp -= ip->imm;
+    uint64_t value;
+    if (!interp->enter || !interp->enter(interp->user, ip->a, sp + 1, (size_t)ip->imm, &value)) {
+      interp_func_t *callee;
+      LLACE_RUNCHECK(interp_decode(interp, ip->a, &callee));
+      LLACE_RUNCHECK(interp_exec(interp, callee, sp + 1, &value));
+    }
+    tos = *sp;
+    if (ip->op == INTERP_CALL) PUSH(value);
+    NEXT;
+  }
+  OP(JMP) { ip = code + ip->a; DISPATCH; }
+  OP(BACK) { ++func->counts.backedges; ip = code + ip->a; DISPATCH; }
+  OP(BRANCH) { ip = code + (tos ? (size_t)ip->imm : ip->a); POP(); DISPATCH; }
+  OP(RET) { *result = tos; return LLACE_ERROR_NONE; }
+  OP(RET0) { *result = 0; return LLACE_ERROR_NONE; }
+#if !INTERP_THREADED
+  }
+#endif
+}
+
+#if INTERP_THREADED
+#pragma GCC diagnostic pop
+#endif
+
+llace_error_t llace_interp_call(llace_interp_t *interp, size_t function, const uint64_t *args, size_t count, uint64_t *result) {
+  if (!interp || !interp->ctx || (count > 0 && !args) || !result) {
+    return LLACE_ERROR_BADARG;
+  }
+  interp_sync(interp);
+  if (function >= LLACE_ARRAY_COUNT(interp->funcs)) {
+    return LLACE_ERROR_INVLFUNC;
+  }
+  if (count != LLACE_IR_FUNCTION(interp->ctx, function)->param_count) {
+    return LLACE_ERROR_BADARG;
+  }
+
+  interp_func_t *func;
+  LLACE_RUNCHECK(interp_decode(interp, function, &func));
+  return interp_exec(interp, func, args, result);
+}
+
+llace_error_t llace_interp_prepare(llace_interp_t *interp, size_t function) {
+  if (!interp || !interp->ctx) {
+    return LLACE_ERROR_BADARG;
+  }
+  interp_sync(interp);
+  if (function >= LLACE_ARRAY_COUNT(interp->funcs)) {
+    return LLACE_ERROR_INVLFUNC;
+  }
+
+  llace_array_t work = LLACE_NEW_ARRAY(size_t, 8);
+  LLACE_ARRAY_PUSH(work, function);
+  llace_error_t err = LLACE_ERROR_NONE;
+  while (!LLACE_ARRAY_IS_EMPTY(work) && err == LLACE_ERROR_NONE) {
+    size_t next = *LLACE_ARRAY_BACK(size_t, work);
+    --work.element_count;
+    if (INTERP_FUNC(interp, next)) continue;
+
+    interp_func_t *func;
+    err = interp_decode(interp, next, &func);
+    if (err != LLACE_ERROR_NONE) break;
+    LLACE_ARRAY_FOREACH(interp_inst_t, inst, func->code) {
+      if ((inst->op == INTERP_CALL || inst->op == INTERP_CALL0) && !INTERP_FUNC(interp, inst->a)) LLACE_ARRAY_PUSH(work, (size_t)inst->a);
+    }
+  }
+  LLACE_FREE_ARRAY(work);
+  return err;
+}
+
+const llace_interp_counts_t *llace_interp_counts(const llace_interp_t *interp, size_t function) {
+  if (!interp || function >= LLACE_ARRAY_COUNT(interp->funcs)) return NULL;
+  const interp_func_t *func = *LLACE_ARRAY_GET(interp_func_t *, interp->funcs, function);
+  return func ? &func->counts : NULL;
+}
@@ -0,0 +1,203 @@
+#include <llace/ir.h>
+#include <llace/ir/analysis.h>
+#include <llace/profile.h>
+#include <llace/detail/common.h>
+
+// ================ Loop Invariant Code Motion ================ //
+
+typedef struct {
+  const llace_ir_context_t *ctx;
+  llace_ir_function_t *fn;
+  llace_ir_cfg_t cfg;
+  llace_ir_loopinfo_t loops;
+  size_t *defblock; // block defining each variable, SIZE_MAX for parameters
+} licm_t;
+
+// Loops writing memory keep their loads in place
+static bool licm_loop_writes(const licm_t *licm, const llace_ir_loop_t *loop) {
+  LLACE_ARRAY_FOREACH(size_t, b, loop->blocks) {
+    LLACE_ARRAY_FOREACH(llace_ir_value_t, value, LLACE_IR_BLOCK_AT(licm->fn, *b)->stack) {
+      if (LLACE_IR_IS_OP(value, LLACE_IR_OP_STORE) || LLACE_IR_IS_OP(value, LLACE_IR_OP_CALL)) return true;
+    }
+  }
+  return false;
+}
+
+static bool licm_is_invariant(const licm_t *licm, size_t l, size_t block_index, const llace_ir_stmt_t *stmt, bool writes) {
+  const llace_ir_basicblock_t *block = LLACE_IR_BLOCK_AT(licm->fn, block_index);
+  const llace_ir_value_t *stack = LLACE_ARRAY_RAW(block->stack);
+
+  const llace_ir_variable_t *target = LLACE_IR_VAR_AT(licm->fn, stack[stmt->end - 2].var);
+  if (target->attr.attr._const || target->attr.attr._volatile) return false;
+
+  for (size_t i = stmt->begin; i < stmt->end - 2; ++i) {
+    const llace_ir_value_t *value = &stack[i];
+    switch (value->kind) {
+    case LLACE_IR_VALUE_VAR: {
+      if (LLACE_IR_VAR_AT(licm->fn, value->var)->attr.attr._volatile) return false;
+      size_t def = licm->defblock[value->var];
+      if (def != SIZE_MAX && llace_ir_loop_contains(&licm->loops, l, def)) return false;
+      break;
+    }
+    case LLACE_IR_VALUE_GLOBAL:
+      if (LLACE_IR_GLOBAL_AT(licm->ctx, value->global)->attr.attr._volatile) return false;
+      break;
+    case LLACE_IR_VALUE_INSTR:
+      switch (value->instr.op) {
+      case LLACE_IR_OP_PHI: case LLACE_IR_OP_CALL: case LLACE_IR_OP_STORE:
+        return false;
+      case LLACE_IR_OP_LOAD:
+        // Only loads that run on every entry to the loop, and nothing may change memory
+        if (writes || block_index != LLACE_IR_LOOP_AT(&licm->loops, l)->header) return false;
+        break;
+      case LLACE_IR_OP_DIV: case LLACE_IR_OP_MOD: {
+        // Hoisting must not introduce a trap the loop would have skipped: a division
+        // by zero, or a signed one by -1 (the most negative dividend overflows)
+        size_t roots[2];
+        llace_ir_operands(block, i, roots, 2);
+        const llace_ir_value_t *divisor = &stack[roots[1]];
+        if (divisor->kind != LLACE_IR_VALUE_CONST) return false;
+        size_t bits = llace_ir_type_bits(divisor->type);
+        uint64_t mask = bits == 0 || bits >= 64 ? UINT64_MAX : ((uint64_t)1 << bits) - 1;
+        if ((divisor->_unt & mask) == 0) return false;
+        if (divisor->type.kind == LLACE_IR_TYPE_INT && (divisor->_unt & mask) == mask) return false;
+        break;
+      }
+      default:
+        break;
+      }
+      break;
+    default:
+      break;
+    }
+  }
+  return true;
+}
+
+// A block with its reverse post order number, the key travels with it through qsort
+typedef struct licm_block {
+  size_t order;
+  size_t block;
+} licm_block_t;
+
+static int licm_compare(const void *a, const void *b) {
+  size_t oa = ((const licm_block_t *)a)->order, ob = ((const licm_block_t *)b)->order;
+  return oa < ob ? -1 : oa > ob ? 1 : 0;
+}
+
+// Hoist the invariant statements of one loop into its preheader
+static size_t licm_loop(licm_t *licm, size_t l, llace_array_t *stmts, llace_array_t *hoisted) {
+  size_t pre = llace_ir_loop_preheader(&licm->cfg, &licm->loops, l);
+  if (pre == SIZE_MAX) return 0;
+
+  const llace_ir_loop_t *loop = LLACE_IR_LOOP_AT(&licm->loops, l);
+  bool writes = licm_loop_writes(licm, loop);
+
+  // Reverse post order, definitions are visited before their uses
+  size_t count = LLACE_ARRAY_COUNT(loop->blocks);
+  licm_block_t *blocks = malloc(count * sizeof(licm_block_t));
+  if (blocks == NULL) { LLACE_LOG_FATAL("Failed to allocate '%zu' loop blocks", count); }
+  for (size_t n = 0; n < count; ++n) {
+    size_t block = *LLACE_ARRAY_GET(size_t, loop->blocks, n);
+    blocks[n] = (licm_block_t){ *LLACE_ARRAY_GET(size_t, licm->cfg.order, block), block };
+  }
+  qsort(blocks, count, sizeof(licm_block_t), licm_compare);
+
+  size_t moved = 0;
+  hoisted->element_count = 0;
+  for (size_t n = 0; n < count; ++n) {
+    llace_ir_basicblock_t *block = LLACE_IR_BLOCK_AT(licm->fn, blocks[n].block);
+    llace_ir_block_stmts(block, stmts);
+
+    // Hoisted statements are appended to the preheader list, the rest is compacted in place
+    llace_ir_value_t *stack = LLACE_ARRAY_RAW(block->stack);
+    size_t w = 0;
+    LLACE_ARRAY_FOREACH(llace_ir_stmt_t, stmt, *stmts) {
+      size_t len = stmt->end - stmt->begin;
+      size_t var;
+      if (llace_ir_stmt_def(block, stmt, &var) && licm_is_invariant(licm, l, blocks[n].block, stmt, writes)) {
+        LLACE_ARRAY_PUSHA(*hoisted, &stack[stmt->begin], len);
+        licm->defblock[var] = pre;
+        ++moved;
+        continue;
+      }
+      if (w != stmt->begin) memmove(&stack[w], &stack[stmt->begin], len * sizeof(llace_ir_value_t));
+      w += len;
+    }
+    block->stack.element_count = w;
+  }
+
+  if (moved > 0) {
+    llace_ir_basicblock_t *pb = LLACE_IR_BLOCK_AT(licm->fn, pre);
+    llace_ir_block_insert(pb, llace_ir_block_term(pb), LLACE_ARRAY_RAW(*hoisted), LLACE_ARRAY_COUNT(*hoisted));
+  }
+
+  free(blocks);
+  return moved;
+}
+
+llace_error_t llace_ir_opt_licm(const llace_ir_context_t *ctx, llace_ir_function_t *fn, llace_ir_licm_stats_t *stats) {
+  LLACE_PROFILE_SCOPE("licm");
+  LLACE_MEM_SCOPE(LLACE_MEM_IR);
+  if (!ctx || !fn) {
+    return LLACE_ERROR_BADARG;
+  }
+  if (stats) *stats = (llace_ir_licm_stats_t){0};
+  if (LLACE_ARRAY_IS_EMPTY(fn->blocks)) {
+    return LLACE_ERROR_NONE;
+  }
+
+  licm_t licm = { .ctx = ctx, .fn = fn };
+  LLACE_RUNCHECK(llace_ir_cfg_build(fn, &licm.cfg));
+  llace_ir_loops_build(&licm.cfg, &licm.loops);
+  if (LLACE_ARRAY_IS_EMPTY(licm.loops.loops)) {
+    llace_ir_loops_free(&licm.loops);
+    llace_ir_cfg_free(&licm.cfg);
+    return LLACE_ERROR_NONE;
+  }
+
+  size_t blocks_before = LLACE_ARRAY_COUNT(fn->blocks);
+  if (llace_ir_loops_make_preheaders(fn, &licm.cfg, &licm.loops)) {
+    llace_ir_loops_free(&licm.loops);
+    llace_ir_cfg_free(&licm.cfg);
+    LLACE_RUNCHECK(llace_ir_cfg_build(fn, &licm.cfg));
+    llace_ir_loops_build(&licm.cfg, &licm.loops);
+  }
+
+  // Where every variable is defined
+  size_t var_count = LLACE_ARRAY_COUNT(fn->vars);
+  licm.defblock = malloc((var_count + 1) * sizeof(size_t));
+  if (licm.defblock == NULL) { LLACE_LOG_FATAL("Failed to allocate def blocks of '%zu' variables", var_count); }
+  for (size_t v = 0; v < var_count; ++v) licm.defblock[v] = SIZE_MAX;
+
+  llace_array_t stmts = LLACE_NEW_ARRAY(llace_ir_stmt_t, 16);
+  llace_error_t err = LLACE_ERROR_NONE;
+  for (size_t b = 0; b < LLACE_ARRAY_COUNT(fn->blocks); ++b) {
+    const llace_ir_basicblock_t *block = LLACE_IR_BLOCK_AT(fn, b);
+    if ((err = llace_ir_block_stmts(block, &stmts)) != LLACE_ERROR_NONE) goto done;
+    LLACE_ARRAY_FOREACH(llace_ir_stmt_t, stmt, stmts) {
+      size_t var;
+      if (llace_ir_stmt_def(block, stmt, &var)) licm.defblock[var] = b;
+    }
+  }
+
+  // Innermost loops first so their invariants can keep moving outwards
+  llace_array_t hoisted = LLACE_NEW_ARRAY(llace_ir_value_t, 32);
+  size_t moved = 0;
+  for (size_t l = LLACE_ARRAY_COUNT(licm.loops.loops); l > 0; --l) {
+    moved += licm_loop(&licm, l - 1, &stmts, &hoisted);
+  }
+  LLACE_FREE_ARRAY(hoisted);
+
+  if (stats) {
+    stats->hoisted = moved;
+    stats->preheaders = LLACE_ARRAY_COUNT(fn->blocks) - blocks_before;
+  }
+
+done:
+  LLACE_FREE_ARRAY(stmts);
+  free(licm.defblock);
+  llace_ir_loops_free(&licm.loops);
+  llace_ir_cfg_free(&licm.cfg);
+  return err;
+}
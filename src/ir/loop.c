@@ -0,0 +1,232 @@
+#include <llace/ir.h>
+#include <llace/ir/analysis.h>
+#include <llace/detail/common.h>
+
+// ================ Loops ================ //
+
+// Sort key of a loop, self-contained so concurrent builds share no state
+typedef struct loop_key {
+  size_t size;  // blocks
+  size_t order; // reverse post order of the header
+  llace_ir_loop_t loop;
+} loop_key_t;
+
+static int loop_compare(const void *a, const void *b) {
+  const loop_key_t *ka = a, *kb = b;
+  if (ka->size != kb->size) return ka->size > kb->size ? -1 : 1; // larger (enclosing) loops first
+  return ka->order < kb->order ? -1 : ka->order > kb->order ? 1 : 0;
+}
+
+llace_error_t llace_ir_loops_build(const llace_ir_cfg_t *cfg, llace_ir_loopinfo_t *info) {
+  LLACE_MEM_SCOPE(LLACE_MEM_IR);
+  if (!cfg || !info) {
+    return LLACE_ERROR_BADARG;
+  }
+
+  size_t count = cfg->block_count;
+  info->loops = LLACE_NEW_ARRAY(llace_ir_loop_t, 4);
+  info->innermost = LLACE_NEW_ARRAY(size_t, count);
+  for (size_t b = 0; b < count; ++b) {
+    size_t none = SIZE_MAX;
+    LLACE_ARRAY_PUSH(info->innermost, none);
+  }
+
+  uint64_t *body = LLACE_BITSET_NEW(count);
+  llace_array_t work = LLACE_NEW_ARRAY(size_t, 8);
+
+  // One natural loop per header, the union of the loops of all its back edges
+  LLACE_ARRAY_FOREACH(size_t, header, cfg->rpo) {
+    llace_ir_loop_t loop = { .header = *header, .parent = SIZE_MAX, .depth = 1 };
+    bool found = false;
+
+    LLACE_ARRAY_FOREACH(size_t, pred, *LLACE_IR_CFG_PREDS(cfg, *header)) {
+      if (!LLACE_IR_CFG_REACHABLE(cfg, *pred) || !llace_ir_cfg_dominates(cfg, *header, *pred)) continue;
+      if (!found) {
+        found = true;
+        loop.blocks = LLACE_NEW_ARRAY(size_t, 8);
+        loop.latches = LLACE_NEW_ARRAY(size_t, 1);
+        memset(body, 0, LLACE_BITSET_WORDS(count) * sizeof(uint64_t));
+        LLACE_BITSET_SET(body, *header);
+        LLACE_ARRAY_PUSH(loop.blocks, *header);
+      }
+      LLACE_ARRAY_PUSH(loop.latches, *pred);
+      if (LLACE_BITSET_GET(body, *pred)) continue;
+
+      // Everything reaching the latch without passing the header
+      LLACE_BITSET_SET(body, *pred);
+      LLACE_ARRAY_PUSH(loop.blocks, *pred);
+      LLACE_ARRAY_PUSH(work, *pred);
+      while (!LLACE_ARRAY_IS_EMPTY(work)) {
+        size_t block = *LLACE_ARRAY_BACK(size_t, work);
+        --work.element_count;
+        LLACE_ARRAY_FOREACH(size_t, up, *LLACE_IR_CFG_PREDS(cfg, block)) {
+          if (!LLACE_IR_CFG_REACHABLE(cfg, *up) || LLACE_BITSET_GET(body, *up)) continue;
+          LLACE_BITSET_SET(body, *up);
+          LLACE_ARRAY_PUSH(loop.blocks, *up);
+          LLACE_ARRAY_PUSH(work, *up);
+        }
+      }
+    }
+
+    if (found) LLACE_ARRAY_PUSHP(info->loops, &loop);
+  }
+
+  // Nesting forest: a loop's parent is the smallest earlier loop containing its header
+  size_t loop_count = LLACE_ARRAY_COUNT(info->loops);
+  loop_key_t *keys = malloc((loop_count ? loop_count : 1) * sizeof(loop_key_t));
+  if (keys == NULL) { LLACE_LOG_FATAL("Failed to allocate '%zu' loop keys", loop_count); }
+  for (size_t l = 0; l < loop_count; ++l) {
+    llace_ir_loop_t *loop = LLACE_IR_LOOP_AT(info, l);
+    keys[l] = (loop_key_t){ LLACE_ARRAY_COUNT(loop->blocks), *LLACE_ARRAY_GET(size_t, cfg->order, loop->header), *loop };
+  }
+  qsort(keys, loop_count, sizeof(loop_key_t), loop_compare);
+  for (size_t l = 0; l < loop_count; ++l) *LLACE_IR_LOOP_AT(info, l) = keys[l].loop;
+  free(keys);
+
+  size_t *innermost = LLACE_ARRAY_RAW(info->innermost);
+  for (size_t l = 0; l < loop_count; ++l) {
+    llace_ir_loop_t *loop = LLACE_IR_LOOP_AT(info, l);
+    size_t parent = innermost[loop->header];
+    if (parent != SIZE_MAX) {
+      loop->parent = parent;
+      loop->depth = LLACE_IR_LOOP_AT(info, parent)->depth + 1;
+    }
+    LLACE_ARRAY_FOREACH(size_t, block, loop->blocks) innermost[*block] = l;
+  }
+
+  LLACE_FREE_ARRAY(work);
+  free(body);
+  return LLACE_ERROR_NONE;
+}
+
+void llace_ir_loops_free(llace_ir_loopinfo_t *info) {
+  LLACE_ARRAY_FOREACH(llace_ir_loop_t, loop, info->loops) {
+    LLACE_FREE_ARRAY(loop->blocks);
+    LLACE_FREE_ARRAY(loop->latches);
+  }
+  LLACE_FREE_ARRAY(info->loops);
+  LLACE_FREE_ARRAY(info->innermost);
+}
+
+bool llace_ir_loop_contains(const llace_ir_loopinfo_t *info, size_t loop, size_t block) {
+  if (block >= LLACE_ARRAY_COUNT(info->innermost)) return false;
+
+  for (size_t l = *LLACE_ARRAY_GET(size_t, info->innermost, block); l != SIZE_MAX; l = LLACE_IR_LOOP_AT(info, l)->parent) {
+    if (l == loop) return true;
+  }
+  return false;
+}
+
+size_t llace_ir_loop_preheader(const llace_ir_cfg_t *cfg, const llace_ir_loopinfo_t *info, size_t loop) {
+  size_t header = LLACE_IR_LOOP_AT(info, loop)->header;
+  size_t found = SIZE_MAX;
+
+  LLACE_ARRAY_FOREACH(size_t, pred, *LLACE_IR_CFG_PREDS(cfg, header)) {
+    if (llace_ir_loop_contains(info, loop, *pred)) continue;
+    if (found != SIZE_MAX) return SIZE_MAX; // several ways in
+    found = *pred;
+  }
+
+  if (found != SIZE_MAX && LLACE_ARRAY_COUNT(*LLACE_IR_CFG_SUCCS(cfg, found)) != 1) return SIZE_MAX;
+  return found;
+}
+
+// Route the header phis' outside inputs through the preheader
+static void loop_split_phis(llace_ir_function_t *fn, size_t header, size_t pre, const uint64_t *outside) {
+  llace_ir_basicblock_t *hb = LLACE_IR_BLOCK_AT(fn, header);
+  llace_array_t stack = LLACE_NEW_ARRAY(llace_ir_value_t, LLACE_ARRAY_COUNT(hb->stack) + 4);
+  llace_array_t moved = LLACE_NEW_ARRAY(llace_ir_value_t, 8);
+
+  for (size_t i = 0; i < LLACE_ARRAY_COUNT(hb->stack); ++i) {
+    llace_ir_value_t value = *LLACE_IR_STACK_AT(hb, i);
+    if (!LLACE_IR_IS_OP(&value, LLACE_IR_OP_PHI)) {
+      LLACE_ARRAY_PUSHP(stack, &value);
+      continue;
+    }
+
+    // The incoming pairs were already copied, take them back out
+    size_t first = LLACE_ARRAY_COUNT(stack) - value.instr.in;
+    llace_ir_value_t *pairs = LLACE_ARRAY_GET(llace_ir_value_t, stack, first);
+    moved.element_count = 0;
+    size_t keep = 0;
+    for (size_t p = 0; p < value.instr.in; p += 2) {
+      if (LLACE_BITSET_GET(outside, pairs[p + 1].block)) {
+        LLACE_ARRAY_PUSHA(moved, &pairs[p], 2);
+      } else {
+        pairs[keep++] = pairs[p];
+        pairs[keep++] = pairs[p + 1];
+      }
+    }
+    stack.element_count = first + keep;
+
+    size_t pairs_moved = LLACE_ARRAY_COUNT(moved) / 2;
+    if (pairs_moved == 1) {
+      llace_ir_value_t incoming = *LLACE_ARRAY_GET(llace_ir_value_t, moved, 0);
+      LLACE_ARRAY_PUSHP(stack, &incoming);
+    } else if (pairs_moved > 1) {
+      // Merge the outside inputs with a phi of their own in the preheader
+      const llace_ir_variable_t *result = LLACE_IR_VAR_AT(fn, LLACE_IR_STACK_AT(hb, i + 1)->var);
+      char name[256];
+      snprintf(name, sizeof(name), "%s.pre", result->name);
+      size_t merged;
+      llace_ir_variable_new(fn, name, result->type, (llace_ir_typeattr_t){ .depth = result->attr.depth }, &merged);
+
+      LLACE_ARRAY_PUSH(moved, LLACE_IR_OP(LLACE_IR_OP_PHI, (uint32_t)(pairs_moved * 2), 1));
+      LLACE_ARRAY_PUSH(moved, LLACE_IR_VAR(merged));
+      LLACE_ARRAY_PUSH(moved, LLACE_IR_OP(LLACE_IR_OP_ASSIGN, 2, 0));
+      llace_ir_basicblock_t *pb = LLACE_IR_BLOCK_AT(fn, pre);
+      llace_ir_block_insert(pb, llace_ir_block_term(pb), LLACE_ARRAY_RAW(moved), LLACE_ARRAY_COUNT(moved));
+
+      LLACE_ARRAY_PUSH(stack, LLACE_IR_VAR(merged));
+    }
+    if (pairs_moved > 0) {
+      LLACE_ARRAY_PUSH(stack, LLACE_IR_BLOCK(pre));
+      keep += 2;
+    }
+
+    value.instr.in = (uint32_t)keep;
+    LLACE_ARRAY_PUSHP(stack, &value);
+  }
+
+  LLACE_FREE_ARRAY(hb->stack);
+  hb->stack = stack;
+  LLACE_FREE_ARRAY(moved);
+}
+
+bool llace_ir_loops_make_preheaders(llace_ir_function_t *fn, const llace_ir_cfg_t *cfg, const llace_ir_loopinfo_t *info) {
+  bool added = false;
+  size_t limit = cfg->block_count + LLACE_ARRAY_COUNT(info->loops); // room for the new preheaders
+  uint64_t *outside = LLACE_BITSET_NEW(limit);
+
+  for (size_t l = 0; l < LLACE_ARRAY_COUNT(info->loops); ++l) {
+    size_t header = LLACE_IR_LOOP_AT(info, l)->header;
+    if (header == 0) continue; // the entry has no way in to split
+    if (llace_ir_loop_preheader(cfg, info, l) != SIZE_MAX) continue;
+
+    char name[256];
+    snprintf(name, sizeof(name), "%s.pre", LLACE_IR_BLOCK_AT(fn, header)->name);
+    size_t pre;
+    llace_ir_block_new(fn, name, &pre);
+    LLACE_IR_PUSH(LLACE_IR_BLOCK_AT(fn, pre), LLACE_IR_BLOCK(header));
+    LLACE_IR_PUSH(LLACE_IR_BLOCK_AT(fn, pre), LLACE_IR_OP(LLACE_IR_OP_JMP, 1, 0));
+
+    // Outside predecessors jump to the preheader instead
+    memset(outside, 0, LLACE_BITSET_WORDS(limit) * sizeof(uint64_t));
+    LLACE_ARRAY_FOREACH(size_t, pred, *LLACE_IR_CFG_PREDS(cfg, header)) {
+      if (llace_ir_loop_contains(info, l, *pred)) continue;
+      LLACE_BITSET_SET(outside, *pred);
+
+      llace_ir_basicblock_t *pb = LLACE_IR_BLOCK_AT(fn, *pred);
+      for (size_t i = llace_ir_block_term(pb); i < LLACE_ARRAY_COUNT(pb->stack); ++i) {
+        llace_ir_value_t *value = LLACE_IR_STACK_AT(pb, i);
+        if (value->kind == LLACE_IR_VALUE_BLOCK && value->block == header) value->block = pre;
+      }
+    }
+
+    loop_split_phis(fn, header, pre, outside);
+    added = true;
+  }
+
+  free(outside);
+  return added;
+}
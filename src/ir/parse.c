@@ -0,0 +1,739 @@
+#include <llace/ir.h>
+#include <llace/profile.h>
+#include <llace/detail/common.h>
+#include <llace/detail/strmap.h>
+#include <ctype.h>
+
+// ================ Lexer ================ //
+
+typedef enum {
+  TOK_EOF,
+  TOK_WORD,   // keywords, types, operators and callee names
+  TOK_VAR,    // %name
+  TOK_BLOCK,  // @name
+  TOK_GLOBAL, // $name
+  TOK_FUNC,   // #name
+  TOK_NUMBER,
+  TOK_PUNCT,  // ( ) { } , :
+} tok_kind_t;
+
+typedef struct {
+  tok_kind_t kind;
+  const char *str; // token text (sigil stripped)
+  size_t len;
+  size_t line;
+} tok_t;
+
+typedef struct {
+  const char *src;
+  size_t len;
+  size_t pos;
+  size_t line;
+  tok_t tok; // current token
+} lexer_t;
+
+static bool is_name_char(char c) {
+  return isalnum((unsigned char)c) || c == '_' || c == '.';
+}
+
+static bool is_op_char(char c) {
+  return strchr("+-*/%<>=!&|^", c) != NULL;
+}
+
+static void lex_next(lexer_t *lex) {
+  const char *src = lex->src;
+
+  // Whitespace and comments
+  for (;;) {
+    while (lex->pos < lex->len && isspace((unsigned char)src[lex->pos])) {
+      if (src[lex->pos] == '\n') ++lex->line;
+      ++lex->pos;
+    }
+    if (lex->pos + 1 < lex->len && src[lex->pos] == '/' && src[lex->pos + 1] == '/') {
+      while (lex->pos < lex->len && src[lex->pos] != '\n') ++lex->pos;
+    } else if (lex->pos + 1 < lex->len && src[lex->pos] == '/' && src[lex->pos + 1] == '*') {
+      lex->pos += 2;
+      while (lex->pos + 1 < lex->len && !(src[lex->pos] == '*' && src[lex->pos + 1] == '/')) {
+        if (src[lex->pos] == '\n') ++lex->line;
+        ++lex->pos;
+      }
+      lex->pos += 2;
+    } else {
+      break;
+    }
+  }
+
+  tok_t *tok = &lex->tok;
+  tok->line = lex->line;
+  if (lex->pos >= lex->len) {
+    tok->kind = TOK_EOF;
+    tok->str = src + lex->len;
+    tok->len = 0;
+    return;
+  }
+
+  size_t start = lex->pos;
+  char c = src[start];
+  char next = start + 1 < lex->len ? src[start + 1] : '\0';
+
+  if ((c == '%' || c == '@' || c == '$' || c == '#') && is_name_char(next)) {
+    tok->kind = c == '%' ? TOK_VAR : c == '@' ? TOK_BLOCK : c == '$' ? TOK_GLOBAL : TOK_FUNC;
+    ++lex->pos;
+    while (lex->pos < lex->len && is_name_char(src[lex->pos])) ++lex->pos;
+    tok->str = src + start + 1;
+    tok->len = lex->pos - start - 1;
+    return;
+  }
+
+  if (isdigit((unsigned char)c) || (c == '-' && isdigit((unsigned char)next))) {
+    tok->kind = TOK_NUMBER;
+    ++lex->pos;
+    while (lex->pos < lex->len && (isalnum((unsigned char)src[lex->pos]) || src[lex->pos] == '.')) ++lex->pos;
+  } else if (isalpha((unsigned char)c) || c == '_') {
+    tok->kind = TOK_WORD;
+    while (lex->pos < lex->len && is_name_char(src[lex->pos])) ++lex->pos;
+    // Vector types and lane counts: vec8<i32>, load<8>
+    if (lex->pos + 1 < lex->len && src[lex->pos] == '<' && is_name_char(src[lex->pos + 1])) {
+      ++lex->pos;
+      while (lex->pos < lex->len && is_name_char(src[lex->pos])) ++lex->pos;
+      if (lex->pos < lex->len && src[lex->pos] == '>') ++lex->pos;
+    }
+    while (lex->pos < lex->len && src[lex->pos] == '*') ++lex->pos; // pointer types
+  } else if (strchr("(){},:", c)) {
+    tok->kind = TOK_PUNCT;
+    ++lex->pos;
+  } else if (is_op_char(c)) {
+    static const char *two[] = { "<<", ">>", "<=", ">=", "==", "!=", "!!" };
+    tok->kind = TOK_WORD;
+    lex->pos += 1;
+    for (size_t i = 0; i < sizeof(two) / sizeof(two[0]); ++i) {
+      if (c == two[i][0] && next == two[i][1]) { lex->pos += 1; break; }
+    }
+  } else {
+    tok->kind = TOK_PUNCT; // unknown character, reported by the parser
+    ++lex->pos;
+  }
+
+  // Arity suffix: phi/3/1, ret/1
+  if (tok->kind == TOK_WORD) {
+    while (lex->pos + 1 < lex->len && src[lex->pos] == '/' && isdigit((unsigned char)src[lex->pos + 1])) {
+      ++lex->pos;
+      while (lex->pos < lex->len && isdigit((unsigned char)src[lex->pos])) ++lex->pos;
+    }
+  }
+
+  tok->str = src + start;
+  tok->len = lex->pos - start;
+}
+
+static bool tok_is(const tok_t *tok, tok_kind_t kind, const char *str) {
+  return tok->kind == kind && tok->len == strlen(str) && memcmp(tok->str, str, tok->len) == 0;
+}
+
+// ================ Parser ================ //
+
+typedef struct {
+  lexer_t lex;
+  llace_ir_context_t *ctx;
+  size_t func; // function being parsed
+  llace_strmap_t vars;
+  llace_strmap_t blocks;
+  llace_array_t defined; // bool per block, label seen
+  char name[256];
+} parser_t;
+
+#define FN(p) LLACE_IR_FUNCTION((p)->ctx, (p)->func)
+
+static llace_error_t parse_error(const parser_t *p, const char *what) {
+  LLACE_LOG_ERROR("IR parse error at line %zu near '%.*s': %s", p->lex.tok.line, (int)p->lex.tok.len, p->lex.tok.str, what);
+  return LLACE_ERROR_INVLFMT;
+}
+
+// Copy the current token text so it can be used as a C string
+static const char *tok_name(parser_t *p) {
+  size_t len = LLACE_MIN(p->lex.tok.len, sizeof(p->name) - 1);
+  memcpy(p->name, p->lex.tok.str, len);
+  p->name[len] = '\0';
+  return p->name;
+}
+
+// Parse a type name without pointer suffix (i32, u8, f23.8, void, vec8<i32>)
+static bool parse_type_name(const char *buf, llace_ir_type_t *type) {
+  if (strcmp(buf, "void") == 0) { *type = LLACE_IR_VOID; return true; }
+
+  char *end = NULL;
+  if (strncmp(buf, "vec", 3) == 0 && isdigit((unsigned char)buf[3])) {
+    unsigned long lanes = strtoul(buf + 3, &end, 10);
+    size_t len = strlen(end);
+    if (lanes < 2 || len < 3 || end[0] != '<' || end[len - 1] != '>') return false;
+
+    char element[64];
+    memcpy(element, end + 1, len - 2);
+    element[len - 2] = '\0';
+    if (!parse_type_name(element, type) || LLACE_IR_IS_VEC(*type) || type->kind == LLACE_IR_TYPE_VOID) return false;
+    type->lanes = lanes;
+    return true;
+  }
+  if (buf[0] == 'i' || buf[0] == 'u') {
+    if (!isdigit((unsigned char)buf[1])) return false;
+    unsigned long bits = strtoul(buf + 1, &end, 10);
+    if (*end != '\0' || bits == 0) return false;
+    *type = buf[0] == 'i' ? LLACE_IR_INT(bits) : LLACE_IR_UNT(bits);
+    return true;
+  }
+  if (buf[0] == 'f') {
+    if (!isdigit((unsigned char)buf[1])) return false;
+    unsigned long mantissa = strtoul(buf + 1, &end, 10);
+    if (*end != '.') return false;
+    unsigned long exponent = strtoul(end + 1, &end, 10);
+    if (*end != '\0') return false;
+    *type = LLACE_IR_FLOAT(mantissa, exponent);
+    return true;
+  }
+  return false;
+}
+
+// Parse a type word (i32, u8, f23.8, void, i32*, vec8<i32>) without consuming it
+static bool parse_type_word(const tok_t *tok, llace_ir_type_t *type, size_t *depth) {
+  if (tok->kind != TOK_WORD || tok->len == 0) return false;
+
+  size_t len = tok->len;
+  *depth = 0;
+  while (len > 0 && tok->str[len - 1] == '*') { --len; ++*depth; }
+
+  char buf[64];
+  if (len == 0 || len >= sizeof(buf)) return false;
+  memcpy(buf, tok->str, len);
+  buf[len] = '\0';
+  return parse_type_name(buf, type);
+}
+
+// [const] [volatile] type
+static llace_error_t parse_typespec(parser_t *p, llace_ir_type_t *type, llace_ir_typeattr_t *attr) {
+  *attr = (llace_ir_typeattr_t){0};
+  for (;;) {
+    if (tok_is(&p->lex.tok, TOK_WORD, "const")) { attr->attr._const = 1; lex_next(&p->lex); continue; }
+    if (tok_is(&p->lex.tok, TOK_WORD, "volatile")) { attr->attr._volatile = 1; lex_next(&p->lex); continue; }
+    break;
+  }
+  if (!parse_type_word(&p->lex.tok, type, &attr->depth)) {
+    return parse_error(p, "expected a type");
+  }
+  lex_next(&p->lex);
+  return LLACE_ERROR_NONE;
+}
+
+static llace_error_t parse_constant(parser_t *p, llace_ir_type_t type, llace_ir_value_t *value) {
+  if (!tok_is(&p->lex.tok, TOK_PUNCT, "(")) return parse_error(p, "expected '(' after constant type");
+  lex_next(&p->lex);
+  if (p->lex.tok.kind != TOK_NUMBER) return parse_error(p, "expected a number");
+
+  char buf[64];
+  size_t len = LLACE_MIN(p->lex.tok.len, sizeof(buf) - 1);
+  memcpy(buf, p->lex.tok.str, len);
+  buf[len] = '\0';
+
+  if (type.kind == LLACE_IR_TYPE_FLOAT) {
+    *value = LLACE_IR_CONST_FLOAT(type, strtod(buf, NULL));
+  } else if (type.kind == LLACE_IR_TYPE_UNT) {
+    *value = (llace_ir_value_t){ .kind = LLACE_IR_VALUE_CONST, .type = type, ._unt = strtoull(buf, NULL, 0) };
+  } else {
+    *value = LLACE_IR_CONST_INT(type, strtoll(buf, NULL, 0));
+  }
+
+  lex_next(&p->lex);
+  if (!tok_is(&p->lex.tok, TOK_PUNCT, ")")) return parse_error(p, "expected ')' after constant");
+  lex_next(&p->lex);
+  return LLACE_ERROR_NONE;
+}
+
+// Variable index by name, created on first mention
+static size_t parser_var(parser_t *p, const char *str, size_t len) {
+  size_t index;
+  if (llace_strmap_get(&p->vars, str, len, &index)) return index;
+
+  char name[256];
+  len = LLACE_MIN(len, sizeof(name) - 1);
+  memcpy(name, str, len);
+  name[len] = '\0';
+
+  llace_ir_variable_new(FN(p), name, LLACE_IR_VOID, (llace_ir_typeattr_t){0}, &index);
+  const llace_ir_variable_t *var = LLACE_IR_VAR_AT(FN(p), index);
+  llace_strmap_put(&p->vars, var->name, len, index);
+  return index;
+}
+
+// Block index by name, created on first mention
+static size_t parser_block(parser_t *p, const char *str, size_t len) {
+  size_t index;
+  if (llace_strmap_get(&p->blocks, str, len, &index)) return index;
+
+  char name[256];
+  len = LLACE_MIN(len, sizeof(name) - 1);
+  memcpy(name, str, len);
+  name[len] = '\0';
+
+  llace_ir_block_new(FN(p), name, &index);
+  const llace_ir_basicblock_t *block = LLACE_IR_BLOCK_AT(FN(p), index);
+  llace_strmap_put(&p->blocks, block->name, len, index);
+  bool seen = false;
+  LLACE_ARRAY_PUSH(p->defined, seen);
+  return index;
+}
+
+typedef struct {
+  const char *word;
+  llace_ir_opcode_t op;
+  uint32_t in;
+  uint32_t out;
+} opdesc_t;
+
+static const opdesc_t opdescs[] = {
+  { "=", LLACE_IR_OP_ASSIGN, 2, 0 },
+  { "+", LLACE_IR_OP_ADD, 2, 1 }, { "-", LLACE_IR_OP_SUB, 2, 1 }, { "*", LLACE_IR_OP_MUL, 2, 1 },
+  { "/", LLACE_IR_OP_DIV, 2, 1 }, { "%", LLACE_IR_OP_MOD, 2, 1 },
+  { "and", LLACE_IR_OP_AND, 2, 1 }, { "or", LLACE_IR_OP_OR, 2, 1 }, { "xor", LLACE_IR_OP_XOR, 2, 1 },
+  { "&", LLACE_IR_OP_AND, 2, 1 }, { "|", LLACE_IR_OP_OR, 2, 1 }, { "^", LLACE_IR_OP_XOR, 2, 1 },
+  { "<<", LLACE_IR_OP_SHL, 2, 1 }, { ">>", LLACE_IR_OP_SHR, 2, 1 },
+  { "==", LLACE_IR_OP_EQ, 2, 1 }, { "!=", LLACE_IR_OP_NE, 2, 1 },
+  { "<", LLACE_IR_OP_LT, 2, 1 }, { "<=", LLACE_IR_OP_LE, 2, 1 },
+  { ">", LLACE_IR_OP_GT, 2, 1 }, { ">=", LLACE_IR_OP_GE, 2, 1 },
+  { "!", LLACE_IR_OP_NZ, 1, 1 }, { "!!", LLACE_IR_OP_Z, 1, 1 },
+  { "load", LLACE_IR_OP_LOAD, 1, 1 }, { "store", LLACE_IR_OP_STORE, 2, 0 }, { "index", LLACE_IR_OP_INDEX, 2, 1 },
+  { "splat", LLACE_IR_OP_SPLAT, 1, 1 }, { "pack", LLACE_IR_OP_PACK, 0, 1 }, { "extract", LLACE_IR_OP_EXTRACT, 2, 1 },
+  { "phi", LLACE_IR_OP_PHI, 0, 1 },
+  { "jmp", LLACE_IR_OP_JMP, 1, 0 }, { "branch", LLACE_IR_OP_BRANCH, 3, 0 }, { "ret", LLACE_IR_OP_RET, 0, 0 },
+};
+
+// Split "word/in/out" into the word and its optional arity
+static size_t split_arity(const tok_t *tok, long *in, long *out) {
+  *in = -1;
+  *out = -1;
+  const char *slash = memchr(tok->str, '/', tok->len);
+  if (slash == NULL || slash == tok->str) return tok->len; // '/' alone is division
+
+  size_t wlen = (size_t)(slash - tok->str);
+  char *end;
+  *in = strtol(slash + 1, &end, 10);
+  if (end < tok->str + tok->len && *end == '/') *out = strtol(end + 1, &end, 10);
+  return wlen;
+}
+
+static llace_error_t parse_word(parser_t *p, llace_ir_basicblock_t **block, size_t block_index) {
+  const tok_t *tok = &p->lex.tok;
+
+  // Constant: type(value)
+  llace_ir_type_t type;
+  size_t depth;
+  if (parse_type_word(tok, &type, &depth)) {
+    if (LLACE_IR_IS_VEC(type)) return parse_error(p, "vector constants are built with splat");
+    llace_ir_value_t value;
+    lex_next(&p->lex);
+    LLACE_RUNCHECK(parse_constant(p, type, &value));
+    *block = LLACE_IR_BLOCK_AT(FN(p), block_index);
+    LLACE_IR_PUSH(*block, value);
+    return LLACE_ERROR_NONE;
+  }
+
+  long in, out;
+  size_t wlen = split_arity(tok, &in, &out);
+
+  // Lane count: load<8>
+  size_t lanes = 0;
+  const char *angle = memchr(tok->str, '<', wlen);
+  if (angle != NULL && angle != tok->str) {
+    char *end;
+    lanes = strtoul(angle + 1, &end, 10);
+    if (*end != '>' || lanes < 2) return parse_error(p, "expected a lane count (load<n>)");
+    wlen = (size_t)(angle - tok->str);
+  }
+
+  for (size_t i = 0; i < sizeof(opdescs) / sizeof(opdescs[0]); ++i) {
+    const opdesc_t *desc = &opdescs[i];
+    if (strlen(desc->word) != wlen || memcmp(desc->word, tok->str, wlen) != 0) continue;
+
+    uint32_t vin = desc->in, vout = desc->out;
+    if (desc->op == LLACE_IR_OP_PHI) {
+      if (in <= 0) return parse_error(p, "phi needs its incoming count (phi/n/1)");
+      vin = (uint32_t)in * 2;
+    } else if (in >= 0) {
+      vin = (uint32_t)in;
+    }
+    if (out >= 0) vout = (uint32_t)out;
+
+    bool laned = desc->op == LLACE_IR_OP_LOAD || desc->op == LLACE_IR_OP_STORE || desc->op == LLACE_IR_OP_SPLAT || desc->op == LLACE_IR_OP_PACK;
+    if (lanes && !laned) return parse_error(p, "only load, store, splat and pack take a lane count");
+    if (desc->op == LLACE_IR_OP_SPLAT && !lanes) return parse_error(p, "splat needs its lane count (splat<n>)");
+    if (desc->op == LLACE_IR_OP_PACK) {
+      if (!lanes) return parse_error(p, "pack needs its lane count (pack<n>)");
+      vin = (uint32_t)lanes;
+    }
+
+    LLACE_IR_PUSH(*block, LLACE_IR_VOP(desc->op, vin, vout, lanes));
+    lex_next(&p->lex);
+    return LLACE_ERROR_NONE;
+  }
+
+  // Anything else is a call by name
+  if (lanes) return parse_error(p, "unknown vector operation");
+  char name[256];
+  size_t len = LLACE_MIN(wlen, sizeof(name) - 1);
+  memcpy(name, tok->str, len);
+  name[len] = '\0';
+
+  size_t callee;
+  if (!llace_ir_function_find(p->ctx, name, &callee)) {
+    LLACE_RUNCHECK(llace_ir_function_new(p->ctx, name, &callee)); // declared, defined later
+  }
+  *block = LLACE_IR_BLOCK_AT(FN(p), block_index);
+
+  // Arity is taken from the callee signature once every function is known
+  bool resolve = in < 0;
+  llace_ir_value_t call = LLACE_IR_CALL(callee, resolve ? UINT32_MAX : (uint32_t)in, out < 0 ? UINT32_MAX : (uint32_t)out);
+  LLACE_IR_PUSH(*block, call);
+  lex_next(&p->lex);
+  return LLACE_ERROR_NONE;
+}
+
+static llace_error_t parse_block_body(parser_t *p, size_t block_index) {
+  llace_ir_basicblock_t *block = LLACE_IR_BLOCK_AT(FN(p), block_index);
+
+  while (!tok_is(&p->lex.tok, TOK_PUNCT, "}")) {
+    const tok_t *tok = &p->lex.tok;
+    switch (tok->kind) {
+    case TOK_VAR: {
+      size_t var = parser_var(p, tok->str, tok->len);
+      lex_next(&p->lex);
+
+      // Optional annotation: %name:type[:const][:volatile]
+      if (tok_is(&p->lex.tok, TOK_PUNCT, ":")) {
+        lex_next(&p->lex);
+        llace_ir_variable_t *v = LLACE_IR_VAR_AT(FN(p), var);
+        if (!parse_type_word(&p->lex.tok, &v->type, &v->attr.depth)) return parse_error(p, "expected a type annotation");
+        lex_next(&p->lex);
+        while (tok_is(&p->lex.tok, TOK_PUNCT, ":")) {
+          lex_next(&p->lex);
+          if (tok_is(&p->lex.tok, TOK_WORD, "const")) v->attr.attr._const = 1;
+          else if (tok_is(&p->lex.tok, TOK_WORD, "volatile")) v->attr.attr._volatile = 1;
+          else return parse_error(p, "expected const or volatile");
+          lex_next(&p->lex);
+        }
+      }
+      LLACE_IR_PUSH(block, LLACE_IR_VAR(var));
+      break;
+    }
+    case TOK_BLOCK: {
+      size_t target = parser_block(p, tok->str, tok->len);
+      block = LLACE_IR_BLOCK_AT(FN(p), block_index);
+      LLACE_IR_PUSH(block, LLACE_IR_BLOCK(target));
+      lex_next(&p->lex);
+      break;
+    }
+    case TOK_GLOBAL: {
+      size_t glob;
+      if (!llace_ir_global_find(p->ctx, tok_name(p), &glob)) return parse_error(p, "unknown global");
+      LLACE_IR_PUSH(block, LLACE_IR_GLOBAL(glob));
+      lex_next(&p->lex);
+      break;
+    }
+    case TOK_WORD:
+      LLACE_RUNCHECK(parse_word(p, &block, block_index));
+      break;
+    default:
+      return parse_error(p, "unexpected token in block");
+    }
+  }
+
+  lex_next(&p->lex); // }
+  return LLACE_ERROR_NONE;
+}
+
+// ================ Type Inference ================ //
+
+// Infer the type of the expression rooted at index, false if it depends on an unknown type
+static bool infer_expr(const llace_ir_context_t *ctx, const llace_ir_function_t *fn, const llace_ir_basicblock_t *block,
+                       size_t index, llace_ir_type_t *type, size_t *depth) {
+  const llace_ir_value_t *value = LLACE_IR_STACK_AT(block, index);
+
+  switch (value->kind) {
+  case LLACE_IR_VALUE_CONST:
+    *type = value->type;
+    *depth = 0;
+    return true;
+  case LLACE_IR_VALUE_VAR: {
+    const llace_ir_variable_t *var = LLACE_IR_VAR_AT(fn, value->var);
+    *type = var->type;
+    *depth = var->attr.depth;
+    return var->type.kind != LLACE_IR_TYPE_VOID;
+  }
+  case LLACE_IR_VALUE_GLOBAL: {
+    const llace_ir_global_t *glob = LLACE_IR_GLOBAL_AT(ctx, value->global);
+    *type = glob->type;
+    *depth = glob->attr.depth + 1;
+    return true;
+  }
+  case LLACE_IR_VALUE_BLOCK:
+    return false;
+  case LLACE_IR_VALUE_INSTR:
+    break;
+  }
+
+  size_t roots[2];
+  const llace_ir_instr_t *instr = &value->instr;
+  switch (instr->op) {
+  case LLACE_IR_OP_EQ: case LLACE_IR_OP_NE: case LLACE_IR_OP_LT: case LLACE_IR_OP_LE:
+  case LLACE_IR_OP_GT: case LLACE_IR_OP_GE: case LLACE_IR_OP_NZ: case LLACE_IR_OP_Z:
+    *type = LLACE_IR_INT(1);
+    *depth = 0;
+    return true;
+  case LLACE_IR_OP_LOAD:
+    llace_ir_operands(block, index, roots, 1);
+    if (!infer_expr(ctx, fn, block, roots[0], type, depth) || *depth == 0) return false;
+    --*depth;
+    if (instr->lanes) *type = llace_ir_type_vec(*type, instr->lanes);
+    return true;
+  case LLACE_IR_OP_SPLAT:
+    llace_ir_operands(block, index, roots, 1);
+    if (!infer_expr(ctx, fn, block, roots[0], type, depth)) return false;
+    *type = llace_ir_type_vec(*type, instr->lanes);
+    return true;
+  case LLACE_IR_OP_PACK:
+    // Every lane has the element type, the last one is closest
+    if (!infer_expr(ctx, fn, block, index - 1, type, depth)) return false;
+    *type = llace_ir_type_vec(*type, instr->lanes);
+    return true;
+  case LLACE_IR_OP_EXTRACT:
+    llace_ir_operands(block, index, roots, 2);
+    if (!infer_expr(ctx, fn, block, roots[0], type, depth)) return false;
+    *type = llace_ir_type_vec(*type, 0);
+    return true;
+  case LLACE_IR_OP_INDEX:
+    llace_ir_operands(block, index, roots, 2);
+    return infer_expr(ctx, fn, block, roots[0], type, depth);
+  case LLACE_IR_OP_PHI:
+    for (size_t n = 0; n < instr->in; n += 2) {
+      if (infer_expr(ctx, fn, block, index - instr->in + n, type, depth)) return true;
+    }
+    return false;
+  case LLACE_IR_OP_CALL: {
+    const llace_ir_function_t *callee = LLACE_IR_FUNCTION(ctx, instr->func);
+    *type = callee->ret;
+    *depth = callee->retattr.depth;
+    return true;
+  }
+  default: {
+    if (instr->in != 2 || instr->out != 1) return false;
+    // An operand of unknown type leaves the other one
+    llace_ir_type_t lt, rt;
+    size_t ld, rd;
+    llace_ir_operands(block, index, roots, 2);
+    bool lok = infer_expr(ctx, fn, block, roots[0], &lt, &ld);
+    bool rok = infer_expr(ctx, fn, block, roots[1], &rt, &rd);
+    if (lok && rok) { llace_ir_type_arith(lt, ld, rt, rd, type, depth); return true; }
+    if (lok) { *type = lt; *depth = ld; return true; }
+    if (rok) { *type = rt; *depth = rd; return true; }
+    return false;
+  }
+  }
+}
+
+static llace_error_t infer_function(parser_t *p) {
+  llace_ir_function_t *fn = FN(p);
+  llace_array_t stmts = LLACE_NEW_ARRAY(llace_ir_stmt_t, 16);
+  llace_error_t err = LLACE_ERROR_NONE;
+
+  // Repeat until no variable changes, phis may refer to later definitions
+  bool progress = true, unknown = true;
+  while (progress && unknown) {
+    progress = false;
+    unknown = false;
+    for (size_t b = 0; b < LLACE_ARRAY_COUNT(fn->blocks); ++b) {
+      const llace_ir_basicblock_t *block = LLACE_IR_BLOCK_AT(fn, b);
+      if ((err = llace_ir_block_stmts(block, &stmts)) != LLACE_ERROR_NONE) {
+        LLACE_LOG_ERROR("IR parse error: values left on the stack of block '%s'", block->name);
+        goto done;
+      }
+
+      LLACE_ARRAY_FOREACH(llace_ir_stmt_t, stmt, stmts) {
+        size_t target;
+        if (!llace_ir_stmt_def(block, stmt, &target)) continue;
+        llace_ir_variable_t *var = LLACE_IR_VAR_AT(fn, target);
+        if (var->type.kind != LLACE_IR_TYPE_VOID) continue;
+
+        if (infer_expr(p->ctx, fn, block, stmt->end - 3, &var->type, &var->attr.depth)) {
+          progress = true;
+        } else {
+          var->type = LLACE_IR_VOID;
+          unknown = true;
+        }
+      }
+    }
+  }
+
+  LLACE_ARRAY_FOREACH(llace_ir_variable_t, var, fn->vars) {
+    if (var->type.kind == LLACE_IR_TYPE_VOID) {
+      LLACE_LOG_ERROR("IR parse error: cannot infer the type of '%%%s' in '%s'", var->name, fn->name);
+      err = LLACE_ERROR_INVLTYPE;
+      break;
+    }
+  }
+
+done:
+  LLACE_FREE_ARRAY(stmts);
+  return err;
+}
+
+// ================ Declarations ================ //
+
+// $name [const] [volatile] type[(value)]
+static llace_error_t parse_global(parser_t *p) {
+  char name[256];
+  snprintf(name, sizeof(name), "%s", tok_name(p));
+  lex_next(&p->lex);
+
+  llace_ir_type_t type;
+  llace_ir_typeattr_t attr;
+  LLACE_RUNCHECK(parse_typespec(p, &type, &attr));
+
+  size_t index;
+  if (llace_ir_global_new(p->ctx, name, type, attr, &index) != LLACE_ERROR_NONE) {
+    return parse_error(p, "duplicate global");
+  }
+  if (tok_is(&p->lex.tok, TOK_PUNCT, "(")) {
+    llace_ir_value_t value;
+    LLACE_RUNCHECK(parse_constant(p, type, &value));
+    LLACE_IR_GLOBAL_AT(p->ctx, index)->value = value;
+  }
+  return LLACE_ERROR_NONE;
+}
+
+// #name(type %param, ...) [type] { @label: { ... } ... }
+static llace_error_t parse_function(parser_t *p) {
+  const char *name = tok_name(p);
+  if (llace_ir_function_find(p->ctx, name, &p->func)) {
+    if (!LLACE_ARRAY_IS_EMPTY(FN(p)->blocks) || FN(p)->param_count > 0) return parse_error(p, "function redefined");
+  } else {
+    LLACE_RUNCHECK(llace_ir_function_new(p->ctx, name, &p->func));
+  }
+  lex_next(&p->lex);
+
+  llace_strmap_init(&p->vars, 64);
+  llace_strmap_init(&p->blocks, 16);
+  p->defined.element_count = 0;
+
+  llace_error_t err = LLACE_ERROR_NONE;
+#define EXPECT(cond, what) if (!(cond)) { err = parse_error(p, what); goto done; }
+
+  // Parameters
+  EXPECT(tok_is(&p->lex.tok, TOK_PUNCT, "("), "expected '(' after function name");
+  lex_next(&p->lex);
+  while (!tok_is(&p->lex.tok, TOK_PUNCT, ")")) {
+    llace_ir_type_t type;
+    llace_ir_typeattr_t attr;
+    if ((err = parse_typespec(p, &type, &attr)) != LLACE_ERROR_NONE) goto done;
+    EXPECT(p->lex.tok.kind == TOK_VAR, "expected parameter name");
+    size_t var = parser_var(p, p->lex.tok.str, p->lex.tok.len);
+    EXPECT(var == FN(p)->param_count, "duplicate parameter");
+    LLACE_IR_VAR_AT(FN(p), var)->type = type;
+    LLACE_IR_VAR_AT(FN(p), var)->attr = attr;
+    ++FN(p)->param_count;
+    lex_next(&p->lex);
+    if (tok_is(&p->lex.tok, TOK_PUNCT, ",")) lex_next(&p->lex);
+  }
+  lex_next(&p->lex);
+
+  // Return type
+  if (!tok_is(&p->lex.tok, TOK_PUNCT, "{")) {
+    if ((err = parse_typespec(p, &FN(p)->ret, &FN(p)->retattr)) != LLACE_ERROR_NONE) goto done;
+  }
+  EXPECT(tok_is(&p->lex.tok, TOK_PUNCT, "{"), "expected '{' to open function body");
+  lex_next(&p->lex);
+
+  // Basic blocks
+  while (!tok_is(&p->lex.tok, TOK_PUNCT, "}")) {
+    EXPECT(p->lex.tok.kind == TOK_BLOCK, "expected a block label");
+    size_t block = parser_block(p, p->lex.tok.str, p->lex.tok.len);
+    bool *seen = LLACE_ARRAY_GET(bool, p->defined, block);
+    EXPECT(!*seen, "block redefined");
+    *seen = true;
+    lex_next(&p->lex);
+    EXPECT(tok_is(&p->lex.tok, TOK_PUNCT, ":"), "expected ':' after block label");
+    lex_next(&p->lex);
+    EXPECT(tok_is(&p->lex.tok, TOK_PUNCT, "{"), "expected '{' to open block");
+    lex_next(&p->lex);
+    if ((err = parse_block_body(p, block)) != LLACE_ERROR_NONE) goto done;
+  }
+  lex_next(&p->lex);
+
+  LLACE_ARRAY_FOREACH(bool, seen, p->defined) {
+    if (!*seen) {
+      LLACE_LOG_ERROR("IR parse error: block '@%s' is never defined in '%s'", LLACE_IR_BLOCK_AT(FN(p), _llace_i)->name, FN(p)->name);
+      err = LLACE_ERROR_SECT404;
+      goto done;
+    }
+  }
+
+#undef EXPECT
+done:
+  llace_strmap_free(&p->vars);
+  llace_strmap_free(&p->blocks);
+  return err;
+}
+
+// Calls written without an explicit arity take it from the callee signature
+static llace_error_t resolve_calls(llace_ir_context_t *ctx) {
+  LLACE_ARRAY_FOREACH(llace_ir_function_t, fn, ctx->funcmap.funcs) {
+    LLACE_ARRAY_FOREACH(llace_ir_basicblock_t, block, fn->blocks) {
+      llace_ir_value_t *stack = LLACE_ARRAY_RAW(block->stack);
+      for (size_t i = 0; i < LLACE_ARRAY_COUNT(block->stack); ++i) {
+        if (!LLACE_IR_IS_OP(&stack[i], LLACE_IR_OP_CALL)) continue;
+        const llace_ir_function_t *callee = LLACE_IR_FUNCTION(ctx, stack[i].instr.func);
+        if (stack[i].instr.in == UINT32_MAX) stack[i].instr.in = (uint32_t)callee->param_count;
+        if (stack[i].instr.out == UINT32_MAX) stack[i].instr.out = callee->ret.kind == LLACE_IR_TYPE_VOID ? 0 : 1;
+      }
+    }
+  }
+  return LLACE_ERROR_NONE;
+}
+
+llace_error_t llace_ir_parse(llace_ir_context_t *ctx, const char *src, size_t len) {
+  LLACE_PROFILE_SCOPE("parse");
+  LLACE_MEM_SCOPE(LLACE_MEM_IR);
+  if (!ctx || !src) {
+    return LLACE_ERROR_BADARG;
+  }
+
+  parser_t p = {
+    .lex = { .src = src, .len = len, .pos = 0, .line = 1 },
+    .ctx = ctx,
+    .defined = LLACE_NEW_ARRAY(bool, 16),
+  };
+  lex_next(&p.lex);
+
+  llace_array_t parsed = LLACE_NEW_ARRAY(size_t, 8);
+  llace_error_t err = LLACE_ERROR_NONE;
+
+  while (p.lex.tok.kind != TOK_EOF && err == LLACE_ERROR_NONE) {
+    if (p.lex.tok.kind == TOK_GLOBAL) {
+      err = parse_global(&p);
+    } else if (p.lex.tok.kind == TOK_FUNC) {
+      err = parse_function(&p);
+      if (err == LLACE_ERROR_NONE) LLACE_ARRAY_PUSH(parsed, p.func);
+    } else {
+      err = parse_error(&p, "expected a global or a function");
+    }
+  }
+
+  if (err == LLACE_ERROR_NONE) err = resolve_calls(ctx);
+
+  // Types are inferred once calls know their callee signatures
+  LLACE_ARRAY_FOREACH(size_t, func, parsed) {
+    if (err != LLACE_ERROR_NONE) break;
+    p.func = *func;
+    err = infer_function(&p);
+  }
+
+  LLACE_FREE_ARRAY(parsed);
+  LLACE_FREE_ARRAY(p.defined);
+  return err;
+}
@@ -0,0 +1,134 @@
+#include <llace/ir.h>
+#include <llace/detail/common.h>
+#include <inttypes.h>
+
+// ================ Text Form ================ //
+
+static void print_type(llace_ir_type_t type, size_t depth, FILE *out) {
+  if (LLACE_IR_IS_VEC(type)) fprintf(out, "vec%zu<", type.lanes);
+  switch (type.kind) {
+  case LLACE_IR_TYPE_VOID:  fprintf(out, "void"); break;
+  case LLACE_IR_TYPE_INT:   fprintf(out, "i%zu", type._int); break;
+  case LLACE_IR_TYPE_UNT:   fprintf(out, "u%zu", type._unt); break;
+  case LLACE_IR_TYPE_FLOAT: fprintf(out, "f%zu.%zu", type._float.mantissa, type._float.exponent); break;
+  }
+  if (LLACE_IR_IS_VEC(type)) fputc('>', out);
+  for (size_t i = 0; i < depth; ++i) fputc('*', out);
+}
+
+static void print_attrs(llace_ir_typeattr_t attr, FILE *out) {
+  if (attr.attr._const) fprintf(out, "const ");
+  if (attr.attr._volatile) fprintf(out, "volatile ");
+}
+
+static void print_const(const llace_ir_value_t *value, FILE *out) {
+  print_type(value->type, 0, out);
+  switch (value->type.kind) {
+  case LLACE_IR_TYPE_FLOAT: fprintf(out, "(%g)", value->_float); break;
+  case LLACE_IR_TYPE_UNT:   fprintf(out, "(%" PRIu64 ")", value->_unt); break;
+  default:                  fprintf(out, "(%" PRId64 ")", value->_int); break;
+  }
+}
+
+static void print_value(const llace_ir_context_t *ctx, const llace_ir_function_t *fn, const llace_ir_value_t *value, bool def, FILE *out) {
+  switch (value->kind) {
+  case LLACE_IR_VALUE_CONST:
+    print_const(value, out);
+    break;
+  case LLACE_IR_VALUE_VAR: {
+    const llace_ir_variable_t *var = LLACE_IR_VAR_AT(fn, value->var);
+    fprintf(out, "%%%s", var->name);
+    if (def) {
+      fputc(':', out);
+      print_type(var->type, var->attr.depth, out);
+      if (var->attr.attr._const) fprintf(out, ":const");
+      if (var->attr.attr._volatile) fprintf(out, ":volatile");
+    }
+    break;
+  }
+  case LLACE_IR_VALUE_GLOBAL:
+    fprintf(out, "$%s", LLACE_IR_GLOBAL_AT(ctx, value->global)->name);
+    break;
+  case LLACE_IR_VALUE_BLOCK:
+    fprintf(out, "@%s", LLACE_IR_BLOCK_AT(fn, value->block)->name);
+    break;
+  case LLACE_IR_VALUE_INSTR: {
+    const llace_ir_instr_t *instr = &value->instr;
+    switch (instr->op) {
+    case LLACE_IR_OP_CALL:
+      fprintf(out, "%s/%u/%u", LLACE_IR_FUNCTION(ctx, instr->func)->name, instr->in, instr->out);
+      break;
+    case LLACE_IR_OP_PHI:
+      fprintf(out, "phi/%u/1", instr->in / 2);
+      break;
+    case LLACE_IR_OP_RET:
+      fprintf(out, "ret/%u", instr->in);
+      break;
+    case LLACE_IR_OP_LOAD: case LLACE_IR_OP_STORE: case LLACE_IR_OP_SPLAT: case LLACE_IR_OP_PACK:
+      fprintf(out, instr->lanes ? "%s<%zu>" : "%s", llace_ir_opcode_str(instr->op), instr->lanes);
+      break;
+    default:
+      fprintf(out, "%s", llace_ir_opcode_str(instr->op));
+      break;
+    }
+    break;
+  }
+  }
+}
+
+void llace_ir_print_function(const llace_ir_context_t *ctx, const llace_ir_function_t *fn, FILE *out) {
+  fprintf(out, "#%s(", fn->name);
+  for (size_t p = 0; p < fn->param_count; ++p) {
+    const llace_ir_variable_t *var = LLACE_IR_VAR_AT(fn, p);
+    if (p) fprintf(out, ", ");
+    print_attrs(var->attr, out);
+    print_type(var->type, var->attr.depth, out);
+    fprintf(out, " %%%s", var->name);
+  }
+  fprintf(out, ") ");
+  print_attrs(fn->retattr, out);
+  print_type(fn->ret, fn->retattr.depth, out);
+  fprintf(out, " {\n");
+
+  LLACE_ARRAY_FOREACH(llace_ir_basicblock_t, block, fn->blocks) {
+    fprintf(out, "  @%s: {\n    ", block->name);
+    size_t count = LLACE_ARRAY_COUNT(block->stack);
+    for (size_t i = 0; i < count; ++i) {
+      const llace_ir_value_t *value = LLACE_IR_STACK_AT(block, i);
+      const llace_ir_value_t *next = i + 1 < count ? LLACE_IR_STACK_AT(block, i + 1) : NULL;
+      bool def = next && LLACE_IR_IS_OP(next, LLACE_IR_OP_ASSIGN);
+
+      print_value(ctx, fn, value, def, out);
+      if (LLACE_IR_VALUE_OUT(value) == 0) {
+        fprintf(out, i + 1 < count ? "\n    " : "\n");
+      } else {
+        fputc(' ', out);
+      }
+    }
+    fprintf(out, "  }\n");
+  }
+  fprintf(out, "}\n");
+}
+
+void llace_ir_print(const llace_ir_context_t *ctx, FILE *out) {
+  LLACE_ARRAY_FOREACH(llace_ir_global_t, glob, ctx->globmap.globals) {
+    fprintf(out, "$%s ", glob->name);
+    print_attrs(glob->attr, out);
+    print_type(glob->type, glob->attr.depth, out);
+    if (glob->attr.depth == 0) {
+      fputc('(', out);
+      switch (glob->type.kind) {
+      case LLACE_IR_TYPE_FLOAT: fprintf(out, "%g", glob->value._float); break;
+      case LLACE_IR_TYPE_UNT:   fprintf(out, "%" PRIu64, glob->value._unt); break;
+      default:                  fprintf(out, "%" PRId64, glob->value._int); break;
+      }
+      fputc(')', out);
+    }
+    fputc('\n', out);
+  }
+
+  LLACE_ARRAY_FOREACH(llace_ir_function_t, fn, ctx->funcmap.funcs) {
+    if (LLACE_ARRAY_IS_EMPTY(fn->blocks)) continue; // declarations are recreated on use
+    llace_ir_print_function(ctx, fn, out);
+  }
+}
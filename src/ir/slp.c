@@ -0,0 +1,537 @@
+#include <llace/ir.h>
+#include <llace/profile.h>
+#include <llace/detail/common.h>
+
+// ================ Superword Level Parallelism ================ //
+
+// Statement that may start a pack: a store to base[offset], or an assignment whose first load is base[offset]
+typedef struct {
+  size_t stmt;
+  bool store;
+  llace_ir_value_t base;
+  int64_t offset;
+} slp_seed_t;
+
+typedef enum {
+  SLP_SPLAT, // the same scalar in every lane
+  SLP_LOAD,  // base[offset + lane]
+  SLP_OP,    // the same operation in every lane
+  SLP_PACK,  // unrelated scalars gathered into a vector
+} slp_kind_t;
+
+typedef struct {
+  slp_kind_t kind;
+  size_t roots;       // offset of the per lane expression roots in slp_t.roots
+  size_t children[2]; // operand nodes of SLP_OP
+} slp_node_t;
+
+typedef struct {
+  const llace_ir_context_t *ctx;
+  const llace_target_t *target;
+  llace_ir_function_t *fn;
+  llace_ir_basicblock_t *block;
+  llace_array_t stmts;   // llace_ir_stmt_t of the block
+  llace_array_t seeds;   // slp_seed_t
+  llace_array_t nodes;   // slp_node_t of the tree being built
+  llace_array_t roots;   // size_t, lane roots of every node
+  llace_array_t out;     // llace_ir_value_t, the packed replacement
+  llace_ir_type_t element;
+  size_t lanes;
+} slp_t;
+
+#define SLP_STMT(slp, index) LLACE_ARRAY_GET(llace_ir_stmt_t, (slp)->stmts, (index))
+#define SLP_SEED(slp, index) LLACE_ARRAY_GET(slp_seed_t, (slp)->seeds, (index))
+#define SLP_NODE(slp, index) LLACE_ARRAY_GET(slp_node_t, (slp)->nodes, (index))
+#define SLP_ROOTS(slp, node) LLACE_ARRAY_GET(size_t, (slp)->roots, SLP_NODE(slp, node)->roots)
+
+// Values that can be evaluated later without changing the result, given the memory checks
+static bool slp_is_pure(const slp_t *slp, size_t begin, size_t end) {
+  for (size_t i = begin; i < end; ++i) {
+    const llace_ir_value_t *value = LLACE_IR_STACK_AT(slp->block, i);
+    switch (value->kind) {
+    case LLACE_IR_VALUE_CONST:
+      break;
+    case LLACE_IR_VALUE_VAR: {
+      const llace_ir_variable_t *var = LLACE_IR_VAR_AT(slp->fn, value->var);
+      if (var->attr.attr._volatile || LLACE_IR_IS_VEC(var->type)) return false;
+      break;
+    }
+    case LLACE_IR_VALUE_GLOBAL:
+      if (LLACE_IR_GLOBAL_AT(slp->ctx, value->global)->attr.attr._volatile) return false;
+      break;
+    case LLACE_IR_VALUE_INSTR:
+      if (value->instr.op == LLACE_IR_OP_LOAD && value->instr.lanes) return false;
+      if (value->instr.op < LLACE_IR_OP_ADD || value->instr.op > LLACE_IR_OP_INDEX || value->instr.op == LLACE_IR_OP_STORE) return false;
+      break;
+    default:
+      return false;
+    }
+  }
+  return true;
+}
+
+// base offset index, with base a pointer variable or a global and offset a constant
+static bool slp_address(const slp_t *slp, size_t root, llace_ir_value_t *base, int64_t *offset) {
+  const llace_ir_value_t *index = LLACE_IR_STACK_AT(slp->block, root);
+  if (!LLACE_IR_IS_OP(index, LLACE_IR_OP_INDEX) || root < 2) return false;
+
+  const llace_ir_value_t *b = LLACE_IR_STACK_AT(slp->block, root - 2);
+  const llace_ir_value_t *k = LLACE_IR_STACK_AT(slp->block, root - 1);
+  if (k->kind != LLACE_IR_VALUE_CONST || (k->type.kind != LLACE_IR_TYPE_INT && k->type.kind != LLACE_IR_TYPE_UNT)) return false;
+  if (b->kind == LLACE_IR_VALUE_VAR) {
+    const llace_ir_variable_t *var = LLACE_IR_VAR_AT(slp->fn, b->var);
+    if (var->attr.depth != 1 || var->attr.attraw) return false;
+  } else if (b->kind == LLACE_IR_VALUE_GLOBAL) {
+    const llace_ir_global_t *glob = LLACE_IR_GLOBAL_AT(slp->ctx, b->global);
+    if (glob->attr.depth != 0 || glob->attr.attraw) return false;
+  } else {
+    return false;
+  }
+
+  *base = *b;
+  *offset = k->_int;
+  return true;
+}
+
+// Element type behind an address base
+static llace_ir_type_t slp_pointee(const slp_t *slp, const llace_ir_value_t *base) {
+  return base->kind == LLACE_IR_VALUE_VAR ? LLACE_IR_VAR_AT(slp->fn, base->var)->type : LLACE_IR_GLOBAL_AT(slp->ctx, base->global)->type;
+}
+
+// Scalar type of the expression rooted at index, false for pointers and anything unknown
+static bool slp_type(const slp_t *slp, size_t index, llace_ir_type_t *type) {
+  const llace_ir_value_t *value = LLACE_IR_STACK_AT(slp->block, index);
+  switch (value->kind) {
+  case LLACE_IR_VALUE_CONST:
+    *type = value->type;
+    return true;
+  case LLACE_IR_VALUE_VAR: {
+    const llace_ir_variable_t *var = LLACE_IR_VAR_AT(slp->fn, value->var);
+    *type = var->type;
+    return var->attr.depth == 0;
+  }
+  case LLACE_IR_VALUE_INSTR:
+    break;
+  default:
+    return false;
+  }
+
+  size_t roots[2];
+  switch (value->instr.op) {
+  case LLACE_IR_OP_LOAD: {
+    llace_ir_value_t base;
+    int64_t offset;
+    if (!slp_address(slp, index - 1, &base, &offset)) return false;
+    *type = slp_pointee(slp, &base);
+    return true;
+  }
+  case LLACE_IR_OP_EQ: case LLACE_IR_OP_NE: case LLACE_IR_OP_LT: case LLACE_IR_OP_LE:
+  case LLACE_IR_OP_GT: case LLACE_IR_OP_GE: case LLACE_IR_OP_NZ: case LLACE_IR_OP_Z:
+    *type = LLACE_IR_INT(1);
+    return true;
+  default:
+    if (value->instr.op < LLACE_IR_OP_ADD || value->instr.op > LLACE_IR_OP_SHR) return false;
+    llace_ir_operands(slp->block, index, roots, 2);
+    return slp_type(slp, roots[0], type);
+  }
+}
+
+// Sum of the scalar costs of the values in [begin, end)
+static unsigned slp_scalar_cost(const slp_t *slp, size_t begin, size_t end) {
+  unsigned total = 0;
+  for (size_t i = begin; i < end; ++i) {
+    unsigned cost = llace_ir_value_cost(slp->target, LLACE_IR_STACK_AT(slp->block, i), slp->element, 0);
+    if (cost == LLACE_COST_UNSUPPORTED) return LLACE_COST_UNSUPPORTED;
+    total += cost;
+  }
+  return total;
+}
+
+static int slp_seed_compare(const void *a, const void *b) {
+  const slp_seed_t *sa = a, *sb = b;
+  if (sa->store != sb->store) return sa->store ? -1 : 1;
+  if (sa->base.kind != sb->base.kind) return sa->base.kind < sb->base.kind ? -1 : 1;
+  size_t ia = sa->base.kind == LLACE_IR_VALUE_VAR ? sa->base.var : sa->base.global;
+  size_t ib = sb->base.kind == LLACE_IR_VALUE_VAR ? sb->base.var : sb->base.global;
+  if (ia != ib) return ia < ib ? -1 : 1;
+  if (sa->offset != sb->offset) return sa->offset < sb->offset ? -1 : 1;
+  return sa->stmt < sb->stmt ? -1 : sa->stmt > sb->stmt ? 1 : 0;
+}
+
+static void slp_find_seeds(slp_t *slp) {
+  slp->seeds.element_count = 0;
+  for (size_t s = 0; s < LLACE_ARRAY_COUNT(slp->stmts); ++s) {
+    const llace_ir_stmt_t *stmt = SLP_STMT(slp, s);
+    const llace_ir_value_t *last = LLACE_IR_STACK_AT(slp->block, stmt->end - 1);
+    slp_seed_t seed = { .stmt = s };
+
+    if (LLACE_IR_IS_OP(last, LLACE_IR_OP_STORE) && !last->instr.lanes) {
+      size_t roots[2];
+      llace_ir_operands(slp->block, stmt->end - 1, roots, 2);
+      if (!slp_is_pure(slp, stmt->begin, stmt->end - 1) || !slp_address(slp, roots[1], &seed.base, &seed.offset)) continue;
+      seed.store = true;
+    } else {
+      size_t def;
+      if (!llace_ir_stmt_def(slp->block, stmt, &def) || !slp_is_pure(slp, stmt->begin, stmt->end - 2)) continue;
+      const llace_ir_variable_t *var = LLACE_IR_VAR_AT(slp->fn, def);
+      if (var->attr.attraw || var->attr.depth || LLACE_IR_IS_VEC(var->type)) continue;
+
+      bool found = false;
+      for (size_t i = stmt->begin; i < stmt->end - 2 && !found; ++i) {
+        if (LLACE_IR_IS_OP(LLACE_IR_STACK_AT(slp->block, i), LLACE_IR_OP_LOAD)) found = slp_address(slp, i - 1, &seed.base, &seed.offset);
+      }
+      if (!found) continue;
+    }
+    LLACE_ARRAY_PUSHP(slp->seeds, &seed);
+  }
+  qsort(LLACE_ARRAY_RAW(slp->seeds), LLACE_ARRAY_COUNT(slp->seeds), sizeof(slp_seed_t), slp_seed_compare);
+}
+
+// Root of the value a seed statement produces
+static size_t slp_seed_root(const slp_t *slp, const slp_seed_t *seed) {
+  const llace_ir_stmt_t *stmt = SLP_STMT(slp, seed->stmt);
+  if (!seed->store) return stmt->end - 3;
+  size_t roots[2];
+  llace_ir_operands(slp->block, stmt->end - 1, roots, 2);
+  return roots[0];
+}
+
+// Node over the given lane roots, SIZE_MAX if the lanes do not have the element type
+static size_t slp_build(slp_t *slp, const size_t *roots) {
+  size_t lanes = slp->lanes;
+  const llace_ir_value_t *first = LLACE_IR_STACK_AT(slp->block, roots[0]);
+  slp_node_t node = { .kind = SLP_PACK, .roots = LLACE_ARRAY_COUNT(slp->roots) };
+  LLACE_ARRAY_PUSHA(slp->roots, roots, lanes);
+
+  bool same = first->kind == LLACE_IR_VALUE_VAR || first->kind == LLACE_IR_VALUE_CONST;
+  bool op = first->kind == LLACE_IR_VALUE_INSTR && first->instr.op >= LLACE_IR_OP_ADD && first->instr.op <= LLACE_IR_OP_SHR;
+  bool load = LLACE_IR_IS_OP(first, LLACE_IR_OP_LOAD);
+  llace_ir_value_t base;
+  int64_t offset = 0;
+  if (load) load = slp_address(slp, roots[0] - 1, &base, &offset);
+
+  for (size_t l = 1; l < lanes; ++l) {
+    const llace_ir_value_t *value = LLACE_IR_STACK_AT(slp->block, roots[l]);
+    same = same && llace_ir_value_same(value, first);
+    op = op && LLACE_IR_IS_OP(value, first->instr.op);
+    if (load) {
+      llace_ir_value_t lb;
+      int64_t lo;
+      load = LLACE_IR_IS_OP(value, LLACE_IR_OP_LOAD) && slp_address(slp, roots[l] - 1, &lb, &lo) &&
+             llace_ir_value_same(&lb, &base) && lo == offset + (int64_t)l;
+    }
+  }
+
+  llace_ir_type_t type;
+  if (same) {
+    node.kind = SLP_SPLAT;
+  } else if (load) {
+    node.kind = SLP_LOAD;
+  } else if (op) {
+    // Operands of every lane, then one child node per operand
+    node.kind = SLP_OP;
+    size_t *lhs = malloc(2 * lanes * sizeof(size_t));
+    if (lhs == NULL) { LLACE_LOG_FATAL("Failed to allocate the operands of '%zu' lanes", lanes); }
+    size_t *rhs = lhs + lanes;
+    for (size_t l = 0; l < lanes; ++l) {
+      size_t ops[2];
+      llace_ir_operands(slp->block, roots[l], ops, 2);
+      lhs[l] = ops[0];
+      rhs[l] = ops[1];
+    }
+    node.children[0] = slp_build(slp, lhs);
+    node.children[1] = node.children[0] == SIZE_MAX ? SIZE_MAX : slp_build(slp, rhs);
+    free(lhs);
+    if (node.children[1] == SIZE_MAX) return SIZE_MAX;
+  }
+
+  for (size_t l = 0; l < lanes; ++l) {
+    if (!slp_type(slp, roots[l], &type) || !llace_ir_type_eq(type, slp->element)) return SIZE_MAX;
+  }
+  LLACE_ARRAY_PUSHP(slp->nodes, &node);
+  return LLACE_ARRAY_COUNT(slp->nodes) - 1;
+}
+
+// Vector cost of a node and everything below it
+static unsigned slp_node_cost(const slp_t *slp, size_t n) {
+  const slp_node_t *node = SLP_NODE(slp, n);
+  const size_t *roots = SLP_ROOTS(slp, n);
+  const llace_ir_value_t *first = LLACE_IR_STACK_AT(slp->block, roots[0]);
+  llace_ir_value_t splat = LLACE_IR_VOP(LLACE_IR_OP_SPLAT, 1, 1, slp->lanes);
+  llace_ir_value_t pack = LLACE_IR_VOP(LLACE_IR_OP_PACK, (uint32_t)slp->lanes, 1, slp->lanes);
+
+  switch (node->kind) {
+  case SLP_SPLAT:
+    return llace_ir_value_cost(slp->target, &splat, slp->element, slp->lanes);
+  case SLP_LOAD:
+    return llace_ir_value_cost(slp->target, first, slp->element, slp->lanes);
+  case SLP_OP: {
+    unsigned cost = llace_ir_value_cost(slp->target, first, slp->element, slp->lanes);
+    unsigned lhs = slp_node_cost(slp, node->children[0]), rhs = slp_node_cost(slp, node->children[1]);
+    if (cost == LLACE_COST_UNSUPPORTED || lhs == LLACE_COST_UNSUPPORTED || rhs == LLACE_COST_UNSUPPORTED) return LLACE_COST_UNSUPPORTED;
+    return cost + lhs + rhs;
+  }
+  case SLP_PACK: {
+    // Every lane is computed as a scalar, then inserted
+    unsigned cost = llace_ir_value_cost(slp->target, &pack, slp->element, slp->lanes);
+    for (size_t l = 0; l < slp->lanes && cost != LLACE_COST_UNSUPPORTED; ++l) {
+      unsigned lane = slp_scalar_cost(slp, llace_ir_expr_begin(slp->block, roots[l]), roots[l] + 1);
+      cost = lane == LLACE_COST_UNSUPPORTED ? LLACE_COST_UNSUPPORTED : cost + lane;
+    }
+    return cost;
+  }
+  }
+  return LLACE_COST_UNSUPPORTED;
+}
+
+static void slp_emit_range(slp_t *slp, size_t begin, size_t end) {
+  LLACE_ARRAY_PUSHA(slp->out, LLACE_IR_STACK_AT(slp->block, begin), end - begin);
+}
+
+static void slp_emit(slp_t *slp, size_t n) {
+  const slp_node_t *node = SLP_NODE(slp, n);
+  const size_t *roots = SLP_ROOTS(slp, n);
+  const llace_ir_value_t *first = LLACE_IR_STACK_AT(slp->block, roots[0]);
+
+  switch (node->kind) {
+  case SLP_SPLAT:
+    LLACE_ARRAY_PUSHP(slp->out, first);
+    LLACE_ARRAY_PUSH(slp->out, LLACE_IR_VOP(LLACE_IR_OP_SPLAT, 1, 1, slp->lanes));
+    break;
+  case SLP_LOAD:
+    slp_emit_range(slp, roots[0] - 3, roots[0]); // base offset index
+    LLACE_ARRAY_PUSH(slp->out, LLACE_IR_VOP(LLACE_IR_OP_LOAD, 1, 1, slp->lanes));
+    break;
+  case SLP_OP:
+    slp_emit(slp, node->children[0]);
+    slp_emit(slp, node->children[1]);
+    LLACE_ARRAY_PUSHP(slp->out, first);
+    break;
+  case SLP_PACK:
+    for (size_t l = 0; l < slp->lanes; ++l) slp_emit_range(slp, llace_ir_expr_begin(slp->block, roots[l]), roots[l] + 1);
+    LLACE_ARRAY_PUSH(slp->out, LLACE_IR_VOP(LLACE_IR_OP_PACK, (uint32_t)slp->lanes, 1, slp->lanes));
+    break;
+  }
+}
+
+// Moving the group to its last statement must keep every value and memory access the same
+static bool slp_legal(const slp_t *slp, const slp_seed_t *group, size_t first, size_t last) {
+  size_t var_count = LLACE_ARRAY_COUNT(slp->fn->vars);
+  uint64_t *used = LLACE_BITSET_NEW(var_count);    // read by the group so far
+  uint64_t *defined = LLACE_BITSET_NEW(var_count); // assigned by the group
+  bool store = group[0].store, legal = true;
+
+  for (size_t l = 0; l < slp->lanes; ++l) {
+    size_t def;
+    if (!llace_ir_stmt_def(slp->block, SLP_STMT(slp, group[l].stmt), &def)) continue;
+    if (LLACE_BITSET_GET(defined, def)) legal = false;
+    LLACE_BITSET_SET(defined, def);
+  }
+
+  for (size_t s = first; s <= last && legal; ++s) {
+    const llace_ir_stmt_t *stmt = SLP_STMT(slp, s);
+    size_t lane = SIZE_MAX, def = SIZE_MAX;
+    for (size_t l = 0; l < slp->lanes; ++l) {
+      if (group[l].stmt == s) lane = l;
+    }
+    bool defines = llace_ir_stmt_def(slp->block, stmt, &def);
+    size_t uses_end = defines ? stmt->end - 2 : stmt->end;
+
+    for (size_t i = stmt->begin; i < uses_end && legal; ++i) {
+      const llace_ir_value_t *value = LLACE_IR_STACK_AT(slp->block, i);
+      if (value->kind == LLACE_IR_VALUE_VAR) {
+        // Group results only exist after the last statement
+        if (LLACE_BITSET_GET(defined, value->var)) legal = false;
+        if (lane != SIZE_MAX) LLACE_BITSET_SET(used, value->var);
+        continue;
+      }
+      if (value->kind != LLACE_IR_VALUE_INSTR) continue;
+
+      if (lane == SIZE_MAX) {
+        // Memory the group moves past
+        llace_ir_opcode_t op = value->instr.op;
+        if (op == LLACE_IR_OP_STORE || op == LLACE_IR_OP_CALL) legal = false;
+        if (store && op == LLACE_IR_OP_LOAD) legal = false;
+      } else if (store && LLACE_IR_IS_OP(value, LLACE_IR_OP_LOAD)) {
+        // Earlier lanes store before this load in the scalar order
+        llace_ir_value_t base;
+        int64_t offset;
+        int64_t begin = group[0].offset, end = group[0].offset + (int64_t)lane;
+        if (!slp_address(slp, i - 1, &base, &offset)) {
+          legal = false;
+        } else if (llace_ir_value_same(&base, &group[0].base)) {
+          if (offset >= begin && offset < end) legal = false;
+        } else if (base.kind != LLACE_IR_VALUE_GLOBAL || group[0].base.kind != LLACE_IR_VALUE_GLOBAL) {
+          legal = false; // two pointers may overlap
+        }
+      }
+    }
+
+    // The group reads its operands late, nothing in between may reassign them
+    if (lane == SIZE_MAX && defines && LLACE_BITSET_GET(used, def)) legal = false;
+  }
+
+  free(defined);
+  free(used);
+  return legal;
+}
+
+// Replace lanes seeds starting at group with one vector statement if it is legal and cheaper
+static bool slp_try(slp_t *slp, const slp_seed_t *group, size_t lanes) {
+  slp->lanes = lanes;
+  if (group[0].store) {
+    slp->element = slp_pointee(slp, &group[0].base);
+  } else {
+    size_t def;
+    llace_ir_stmt_def(slp->block, SLP_STMT(slp, group[0].stmt), &def);
+    slp->element = LLACE_IR_VAR_AT(slp->fn, def)->type;
+  }
+  if (slp->element.kind == LLACE_IR_TYPE_VOID || LLACE_IR_IS_VEC(slp->element)) return false;
+  if (llace_target_cost(slp->target, LLACE_COST_ALU, llace_ir_type_bits(slp->element), lanes, slp->element.kind == LLACE_IR_TYPE_FLOAT) == LLACE_COST_UNSUPPORTED) {
+    return false;
+  }
+
+  size_t first = SIZE_MAX, last = 0;
+  for (size_t l = 0; l < lanes; ++l) {
+    first = LLACE_MIN(first, group[l].stmt);
+    last = LLACE_MAX(last, group[l].stmt);
+  }
+  if (!slp_legal(slp, group, first, last)) return false;
+
+  size_t *roots = malloc(lanes * sizeof(size_t));
+  if (roots == NULL) { LLACE_LOG_FATAL("Failed to allocate '%zu' lane roots", lanes); }
+  for (size_t l = 0; l < lanes; ++l) roots[l] = slp_seed_root(slp, &group[l]);
+  slp->nodes.element_count = 0;
+  slp->roots.element_count = 0;
+  size_t tree = slp_build(slp, roots);
+  free(roots);
+  if (tree == SIZE_MAX) return false;
+
+  // Packing and unpacking are part of the vector price
+  unsigned scalar = 0, vector = slp_node_cost(slp, tree);
+  for (size_t l = 0; l < lanes && scalar != LLACE_COST_UNSUPPORTED; ++l) {
+    const llace_ir_stmt_t *stmt = SLP_STMT(slp, group[l].stmt);
+    unsigned cost = slp_scalar_cost(slp, stmt->begin, stmt->end);
+    scalar = cost == LLACE_COST_UNSUPPORTED ? LLACE_COST_UNSUPPORTED : scalar + cost;
+  }
+  llace_ir_value_t root = group[0].store ? LLACE_IR_VOP(LLACE_IR_OP_STORE, 2, 0, lanes) : LLACE_IR_OP(LLACE_IR_OP_EXTRACT, 2, 1);
+  unsigned tail = llace_ir_value_cost(slp->target, &root, slp->element, lanes);
+  if (vector == LLACE_COST_UNSUPPORTED || tail == LLACE_COST_UNSUPPORTED) return false;
+  vector += group[0].store ? tail : tail * (unsigned)lanes;
+  if (scalar == LLACE_COST_UNSUPPORTED || vector >= scalar) return false;
+
+  slp->out.element_count = 0;
+  slp_emit(slp, tree);
+  if (group[0].store) {
+    size_t ops[2];
+    const llace_ir_stmt_t *stmt = SLP_STMT(slp, group[0].stmt);
+    llace_ir_operands(slp->block, stmt->end - 1, ops, 2);
+    slp_emit_range(slp, llace_ir_expr_begin(slp->block, ops[1]), ops[1] + 1);
+    LLACE_ARRAY_PUSHP(slp->out, &root);
+  } else {
+    // One vector variable, then every lane back into its scalar
+    size_t defs[64], vec;
+    char name[256];
+    for (size_t l = 0; l < lanes; ++l) llace_ir_stmt_def(slp->block, SLP_STMT(slp, group[l].stmt), &defs[l]);
+    snprintf(name, sizeof(name), "%.200s.slp", LLACE_IR_VAR_AT(slp->fn, defs[0])->name);
+    llace_ir_variable_new(slp->fn, name, llace_ir_type_vec(slp->element, lanes), (llace_ir_typeattr_t){0}, &vec);
+    LLACE_ARRAY_PUSH(slp->out, LLACE_IR_VAR(vec));
+    LLACE_ARRAY_PUSH(slp->out, LLACE_IR_OP(LLACE_IR_OP_ASSIGN, 2, 0));
+    for (size_t l = 0; l < lanes; ++l) {
+      LLACE_ARRAY_PUSH(slp->out, LLACE_IR_VAR(vec));
+      LLACE_ARRAY_PUSH(slp->out, LLACE_IR_CONST_INT(LLACE_IR_INT(32), (int64_t)l));
+      LLACE_ARRAY_PUSHP(slp->out, &root);
+      LLACE_ARRAY_PUSH(slp->out, LLACE_IR_VAR(defs[l]));
+      LLACE_ARRAY_PUSH(slp->out, LLACE_IR_OP(LLACE_IR_OP_ASSIGN, 2, 0));
+    }
+  }
+
+  // The group statements go away, the vector statement takes the place of the last one
+  llace_array_t stack = LLACE_NEW_ARRAY(llace_ir_value_t, LLACE_ARRAY_COUNT(slp->block->stack) + LLACE_ARRAY_COUNT(slp->out));
+  for (size_t s = 0; s < LLACE_ARRAY_COUNT(slp->stmts); ++s) {
+    const llace_ir_stmt_t *stmt = SLP_STMT(slp, s);
+    bool member = false;
+    for (size_t l = 0; l < lanes; ++l) member |= group[l].stmt == s;
+
+    if (s == last) {
+      LLACE_ARRAY_PUSHA(stack, LLACE_ARRAY_RAW(slp->out), LLACE_ARRAY_COUNT(slp->out));
+    } else if (!member) {
+      LLACE_ARRAY_PUSHA(stack, LLACE_IR_STACK_AT(slp->block, stmt->begin), stmt->end - stmt->begin);
+    }
+  }
+  LLACE_FREE_ARRAY(slp->block->stack);
+  slp->block->stack = stack;
+  return true;
+}
+
+// Pack one group of the block, false once nothing is left to pack
+static bool slp_block(slp_t *slp, llace_ir_slp_stats_t *stats) {
+  if (llace_ir_block_stmts(slp->block, &slp->stmts) != LLACE_ERROR_NONE) return false;
+  slp_find_seeds(slp);
+
+  size_t count = LLACE_ARRAY_COUNT(slp->seeds);
+  size_t widest = llace_target_vector_bits(slp->target);
+  for (size_t r = 0; r < count;) {
+    // Run of seeds on the same base at consecutive offsets
+    size_t end = r + 1;
+    while (end < count) {
+      const slp_seed_t *prev = SLP_SEED(slp, end - 1), *next = SLP_SEED(slp, end);
+      if (prev->store != next->store || !llace_ir_value_same(&prev->base, &next->base) || next->offset != prev->offset + 1) break;
+      ++end;
+    }
+
+    for (size_t at = r; at + 2 <= end; ++at) {
+      const slp_seed_t *group = SLP_SEED(slp, at);
+      size_t bits = llace_ir_type_bits(slp_pointee(slp, &group->base));
+      size_t lanes = 2;
+      while (lanes * 2 <= end - at && lanes * 2 * bits <= widest && lanes * 2 <= 64) lanes *= 2;
+
+      for (; lanes >= 2; lanes /= 2) {
+        if (!slp_try(slp, group, lanes)) continue;
+        if (stats) {
+          ++stats->packed;
+          stats->scalars += lanes;
+        }
+        return true;
+      }
+    }
+    r = end;
+  }
+  return false;
+}
+
+llace_error_t llace_ir_opt_slp(const llace_ir_context_t *ctx, const llace_config_t *config, llace_ir_function_t *fn, llace_ir_slp_stats_t *stats) {
+  LLACE_PROFILE_SCOPE("slp");
+  LLACE_MEM_SCOPE(LLACE_MEM_IR);
+  if (!ctx || !config || !fn) {
+    return LLACE_ERROR_BADARG;
+  }
+  if (stats) *stats = (llace_ir_slp_stats_t){0};
+  if (llace_target_vector_bits(&config->target) == 0) {
+    return LLACE_ERROR_NONE;
+  }
+
+  slp_t slp = {
+    .ctx = ctx,
+    .target = &config->target,
+    .fn = fn,
+    .stmts = LLACE_NEW_ARRAY(llace_ir_stmt_t, 16),
+    .seeds = LLACE_NEW_ARRAY(slp_seed_t, 16),
+    .nodes = LLACE_NEW_ARRAY(slp_node_t, 16),
+    .roots = LLACE_NEW_ARRAY(size_t, 64),
+    .out = LLACE_NEW_ARRAY(llace_ir_value_t, 64),
+  };
+
+  // Each packed group rewrites the block, its statements are decoded again
+  for (size_t b = 0; b < LLACE_ARRAY_COUNT(fn->blocks); ++b) {
+    slp.block = LLACE_IR_BLOCK_AT(fn, b);
+    while (slp_block(&slp, stats));
+  }
+
+  LLACE_FREE_ARRAY(slp.out);
+  LLACE_FREE_ARRAY(slp.roots);
+  LLACE_FREE_ARRAY(slp.nodes);
+  LLACE_FREE_ARRAY(slp.seeds);
+  LLACE_FREE_ARRAY(slp.stmts);
+  return LLACE_ERROR_NONE;
+}
@@ -0,0 +1,435 @@
+#include <llace/ir.h>
+#include <llace/detail/common.h>
+
+// ================ Types ================ //
+
+bool llace_ir_type_eq(llace_ir_type_t a, llace_ir_type_t b) {
+  if (a.kind != b.kind || a.lanes != b.lanes) return false;
+  switch (a.kind) {
+  case LLACE_IR_TYPE_VOID:  return true;
+  case LLACE_IR_TYPE_INT:   return a._int == b._int;
+  case LLACE_IR_TYPE_UNT:   return a._unt == b._unt;
+  case LLACE_IR_TYPE_FLOAT: return a._float.mantissa == b._float.mantissa && a._float.exponent == b._float.exponent;
+  default: return false;
+  }
+}
+
+size_t llace_ir_type_bits(llace_ir_type_t type) {
+  size_t lanes = LLACE_MAX(type.lanes, (size_t)1);
+  switch (type.kind) {
+  case LLACE_IR_TYPE_VOID:  return 0;
+  case LLACE_IR_TYPE_INT:   return type._int * lanes;
+  case LLACE_IR_TYPE_UNT:   return type._unt * lanes;
+  case LLACE_IR_TYPE_FLOAT: return (type._float.mantissa + type._float.exponent + 1) * lanes; // sign bit
+  default: return 0;
+  }
+}
+
+llace_ir_type_t llace_ir_type_vec(llace_ir_type_t element, size_t lanes) {
+  element.lanes = lanes;
+  return element;
+}
+
+void llace_ir_type_arith(llace_ir_type_t lhs, size_t lhs_depth, llace_ir_type_t rhs, size_t rhs_depth, llace_ir_type_t *type, size_t *depth) {
+  bool left = lhs_depth > 0 || rhs_depth == 0;
+  *type = left ? lhs : rhs;
+  *depth = left ? lhs_depth : rhs_depth;
+}
+
+// ================ Instructions ================ //
+
+const char *llace_ir_opcode_str(llace_ir_opcode_t op) {
+  switch (op) {
+  case LLACE_IR_OP_ASSIGN: return "=";
+  case LLACE_IR_OP_ADD:    return "+";
+  case LLACE_IR_OP_SUB:    return "-";
+  case LLACE_IR_OP_MUL:    return "*";
+  case LLACE_IR_OP_DIV:    return "/";
+  case LLACE_IR_OP_MOD:    return "%";
+  case LLACE_IR_OP_AND:    return "and";
+  case LLACE_IR_OP_OR:     return "or";
+  case LLACE_IR_OP_XOR:    return "xor";
+  case LLACE_IR_OP_SHL:    return "<<";
+  case LLACE_IR_OP_SHR:    return ">>";
+  case LLACE_IR_OP_EQ:     return "==";
+  case LLACE_IR_OP_NE:     return "!=";
+  case LLACE_IR_OP_LT:     return "<";
+  case LLACE_IR_OP_LE:     return "<=";
+  case LLACE_IR_OP_GT:     return ">";
+  case LLACE_IR_OP_GE:     return ">=";
+  case LLACE_IR_OP_NZ:     return "!";
+  case LLACE_IR_OP_Z:      return "!!";
+  case LLACE_IR_OP_LOAD:   return "load";
+  case LLACE_IR_OP_STORE:  return "store";
+  case LLACE_IR_OP_INDEX:  return "index";
+  case LLACE_IR_OP_SPLAT:  return "splat";
+  case LLACE_IR_OP_PACK:   return "pack";
+  case LLACE_IR_OP_EXTRACT: return "extract";
+  case LLACE_IR_OP_PHI:    return "phi";
+  case LLACE_IR_OP_CALL:   return "call";
+  case LLACE_IR_OP_JMP:    return "jmp";
+  case LLACE_IR_OP_BRANCH: return "branch";
+  case LLACE_IR_OP_RET:    return "ret";
+  default: return "INVALID";
+  }
+}
+
+bool llace_ir_op_is_terminator(llace_ir_opcode_t op) {
+  return op == LLACE_IR_OP_JMP || op == LLACE_IR_OP_BRANCH || op == LLACE_IR_OP_RET;
+}
+
+// ================ Values ================ //
+
+bool llace_ir_value_same(const llace_ir_value_t *a, const llace_ir_value_t *b) {
+  if (a->kind != b->kind) return false;
+  switch (a->kind) {
+  case LLACE_IR_VALUE_VAR:    return a->var == b->var;
+  case LLACE_IR_VALUE_GLOBAL: return a->global == b->global;
+  case LLACE_IR_VALUE_CONST:  return llace_ir_type_eq(a->type, b->type) && a->_unt == b->_unt;
+  default:                    return false;
+  }
+}
+
+// ================ Construction ================ //
+
+llace_error_t llace_ir_context_init(llace_ir_context_t *ctx) {
+  LLACE_MEM_SCOPE(LLACE_MEM_IR);
+  if (!ctx) {
+    return LLACE_ERROR_BADARG;
+  }
+
+  ctx->globmap.globals = LLACE_NEW_ARRAY(llace_ir_global_t, 0);
+  ctx->funcmap.funcs = LLACE_NEW_ARRAY(llace_ir_function_t, 0);
+
+  return LLACE_ERROR_NONE;
+}
+
+void llace_ir_function_free(llace_ir_function_t *fn) {
+  LLACE_ARRAY_FOREACH(llace_ir_basicblock_t, block, fn->blocks) {
+    free(block->name);
+    LLACE_FREE_ARRAY(block->stack);
+  }
+  LLACE_ARRAY_FOREACH(llace_ir_variable_t, var, fn->vars) {
+    free(var->name);
+  }
+  LLACE_FREE_ARRAY(fn->blocks);
+  LLACE_FREE_ARRAY(fn->vars);
+  free(fn->name);
+  fn->name = NULL;
+}
+
+void llace_ir_context_free(llace_ir_context_t *ctx) {
+  if (!ctx) return;
+
+  LLACE_ARRAY_FOREACH(llace_ir_function_t, fn, ctx->funcmap.funcs) {
+    llace_ir_function_free(fn);
+  }
+  LLACE_ARRAY_FOREACH(llace_ir_global_t, glob, ctx->globmap.globals) {
+    free(glob->name);
+  }
+  LLACE_FREE_ARRAY(ctx->funcmap.funcs);
+  LLACE_FREE_ARRAY(ctx->globmap.globals);
+}
+
+llace_error_t llace_ir_function_new(llace_ir_context_t *ctx, const char *name, size_t *index) {
+  LLACE_MEM_SCOPE(LLACE_MEM_IR);
+  if (!ctx || !name) {
+    return LLACE_ERROR_BADARG;
+  }
+
+  size_t existing;
+  if (llace_ir_function_find(ctx, name, &existing)) {
+    return LLACE_ERROR_SYMDUP;
+  }
+
+  llace_ir_function_t fn = {
+    .name = llace_strdup(name),
+    .param_count = 0,
+    .ret = LLACE_IR_VOID,
+    .abi = LLACE_ABI_CDECL,
+    .blocks = LLACE_NEW_ARRAY(llace_ir_basicblock_t, 0),
+    .vars = LLACE_NEW_ARRAY(llace_ir_variable_t, 0),
+  };
+  LLACE_ARRAY_PUSHP(ctx->funcmap.funcs, &fn);
+
+  if (index) *index = LLACE_ARRAY_COUNT(ctx->funcmap.funcs) - 1;
+  return LLACE_ERROR_NONE;
+}
+
+bool llace_ir_function_find(const llace_ir_context_t *ctx, const char *name, size_t *index) {
+  for (size_t i = 0; i < LLACE_ARRAY_COUNT(ctx->funcmap.funcs); ++i) {
+    if (strcmp(LLACE_IR_FUNCTION(ctx, i)->name, name) == 0) {
+      if (index) *index = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+llace_error_t llace_ir_global_new(llace_ir_context_t *ctx, const char *name, llace_ir_type_t type, llace_ir_typeattr_t attr, size_t *index) {
+  LLACE_MEM_SCOPE(LLACE_MEM_IR);
+  if (!ctx || !name) {
+    return LLACE_ERROR_BADARG;
+  }
+
+  size_t existing;
+  if (llace_ir_global_find(ctx, name, &existing)) {
+    return LLACE_ERROR_SYMDUP;
+  }
+
+  llace_ir_global_t glob = {
+    .name = llace_strdup(name),
+    .value = LLACE_IR_CONST_INT(type, 0),
+    .type = type,
+    .attr = attr,
+  };
+  LLACE_ARRAY_PUSHP(ctx->globmap.globals, &glob);
+
+  if (index) *index = LLACE_ARRAY_COUNT(ctx->globmap.globals) - 1;
+  return LLACE_ERROR_NONE;
+}
+
+bool llace_ir_global_find(const llace_ir_context_t *ctx, const char *name, size_t *index) {
+  for (size_t i = 0; i < LLACE_ARRAY_COUNT(ctx->globmap.globals); ++i) {
+    if (strcmp(LLACE_IR_GLOBAL_AT(ctx, i)->name, name) == 0) {
+      if (index) *index = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+llace_error_t llace_ir_block_new(llace_ir_function_t *fn, const char *name, size_t *index) {
+  LLACE_MEM_SCOPE(LLACE_MEM_IR);
+  if (!fn) {
+    return LLACE_ERROR_BADARG;
+  }
+
+  llace_ir_basicblock_t block = {
+    .name = llace_strdup(name),
+    .stack = LLACE_NEW_ARRAY(llace_ir_value_t, 0),
+  };
+  LLACE_ARRAY_PUSHP(fn->blocks, &block);
+
+  if (index) *index = LLACE_ARRAY_COUNT(fn->blocks) - 1;
+  return LLACE_ERROR_NONE;
+}
+
+llace_error_t llace_ir_variable_new(llace_ir_function_t *fn, const char *name, llace_ir_type_t type, llace_ir_typeattr_t attr, size_t *index) {
+  LLACE_MEM_SCOPE(LLACE_MEM_IR);
+  if (!fn) {
+    return LLACE_ERROR_BADARG;
+  }
+
+  llace_ir_variable_t var = {
+    .name = llace_strdup(name),
+    .type = type,
+    .attr = attr,
+  };
+  LLACE_ARRAY_PUSHP(fn->vars, &var);
+
+  if (index) *index = LLACE_ARRAY_COUNT(fn->vars) - 1;
+  return LLACE_ERROR_NONE;
+}
+
+void llace_ir_block_insert(llace_ir_basicblock_t *block, size_t index, const llace_ir_value_t *values, size_t count) {
+  size_t size = LLACE_ARRAY_COUNT(block->stack);
+  if (index > size) { LLACE_LOG_FATAL("Insert at %zu past the end of block '%s' (%zu)", index, block->name, size); }
+  if (count == 0) return;
+
+  if (LLACE_ARRAY_CAPACITY(block->stack) < size + count) {
+    size_t doubled = LLACE_ARRAY_CAPACITY(block->stack) * 2;
+    llace_mem_reserve(&block->stack, LLACE_MAX(size + count, doubled));
+  }
+
+  llace_ir_value_t *stack = LLACE_ARRAY_RAW(block->stack);
+  memmove(&stack[index + count], &stack[index], (size - index) * sizeof(llace_ir_value_t));
+  memcpy(&stack[index], values, count * sizeof(llace_ir_value_t));
+  block->stack.element_count = size + count;
+}
+
+// ================ Decoding ================ //
+
+size_t llace_ir_expr_begin(const llace_ir_basicblock_t *block, size_t index) {
+  const llace_ir_value_t *stack = LLACE_ARRAY_RAW(block->stack);
+
+  // Walk back until every value the root consumes has been produced
+  size_t need = LLACE_IR_VALUE_IN(&stack[index]);
+  size_t i = index;
+  while (need > 0) {
+    if (i == 0) { LLACE_LOG_FATAL("Malformed stack in block '%s'", block->name); }
+    --i;
+    need = need - LLACE_IR_VALUE_OUT(&stack[i]) + LLACE_IR_VALUE_IN(&stack[i]);
+  }
+  return i;
+}
+
+size_t llace_ir_operands(const llace_ir_basicblock_t *block, size_t index, size_t *roots, size_t max) {
+  const llace_ir_value_t *stack = LLACE_ARRAY_RAW(block->stack);
+  size_t count = LLACE_IR_VALUE_IN(&stack[index]);
+  if (count > max) {
+    LLACE_LOG_FATAL("Instruction consumes %zu values, only room for %zu", count, max);
+  }
+
+  // Operands are laid out first to last, walk them back to front
+  size_t root = index;
+  for (size_t n = count; n > 0; --n) {
+    roots[n - 1] = root - 1;
+    root = llace_ir_expr_begin(block, root - 1);
+  }
+  return count;
+}
+
+llace_error_t llace_ir_block_stmts(const llace_ir_basicblock_t *block, llace_array_t *stmts) {
+  stmts->element_count = 0;
+
+  size_t begin = 0;
+  for (size_t i = 0; i < LLACE_ARRAY_COUNT(block->stack); ++i) {
+    const llace_ir_value_t *value = LLACE_IR_STACK_AT(block, i);
+    if (LLACE_IR_VALUE_OUT(value) == 0) {
+      llace_ir_stmt_t stmt = { .begin = begin, .end = i + 1 };
+      LLACE_ARRAY_PUSHP(*stmts, &stmt);
+      begin = i + 1;
+    }
+  }
+
+  if (begin != LLACE_ARRAY_COUNT(block->stack)) {
+    return LLACE_ERROR_INVLFUNC; // values left on the stack
+  }
+  return LLACE_ERROR_NONE;
+}
+
+bool llace_ir_stmt_def(const llace_ir_basicblock_t *block, const llace_ir_stmt_t *stmt, size_t *var) {
+  if (LLACE_IR_STMT_INSTR(block, stmt)->op != LLACE_IR_OP_ASSIGN) {
+    return false;
+  }
+
+  const llace_ir_value_t *target = LLACE_IR_STACK_AT(block, stmt->end - 2);
+  if (var) *var = target->var;
+  return true;
+}
+
+size_t llace_ir_block_term(const llace_ir_basicblock_t *block) {
+  size_t count = LLACE_ARRAY_COUNT(block->stack);
+  if (count == 0) return 0;
+
+  const llace_ir_value_t *term = LLACE_IR_STACK_AT(block, count - 1);
+  if (term->kind != LLACE_IR_VALUE_INSTR || !llace_ir_op_is_terminator(term->instr.op)) {
+    return count;
+  }
+  return llace_ir_expr_begin(block, count - 1);
+}
+
+llace_error_t llace_ir_block_succs(const llace_ir_basicblock_t *block, llace_array_t *succs) {
+  succs->element_count = 0;
+
+  size_t count = LLACE_ARRAY_COUNT(block->stack);
+  if (count == 0) {
+    return LLACE_ERROR_NONE;
+  }
+
+  const llace_ir_value_t *term = LLACE_IR_STACK_AT(block, count - 1);
+  if (term->kind != LLACE_IR_VALUE_INSTR || !llace_ir_op_is_terminator(term->instr.op)) {
+    return LLACE_ERROR_NONE;
+  }
+
+  for (size_t i = llace_ir_expr_begin(block, count - 1); i < count - 1; ++i) {
+    const llace_ir_value_t *value = LLACE_IR_STACK_AT(block, i);
+    if (value->kind == LLACE_IR_VALUE_BLOCK) {
+      LLACE_ARRAY_PUSH(*succs, value->block);
+    }
+  }
+  return LLACE_ERROR_NONE;
+}
+
+// ================ Validation ================ //
+
+static bool llace_ir_instr_valid(const llace_ir_context_t *ctx, const llace_ir_function_t *fn, const llace_ir_instr_t *instr) {
+  switch (instr->op) {
+  case LLACE_IR_OP_ASSIGN: case LLACE_IR_OP_STORE:
+    return instr->in == 2 && instr->out == 0;
+  case LLACE_IR_OP_NZ: case LLACE_IR_OP_Z: case LLACE_IR_OP_LOAD:
+    return instr->in == 1 && instr->out == 1;
+  case LLACE_IR_OP_SPLAT:
+    return instr->in == 1 && instr->out == 1 && instr->lanes > 1;
+  case LLACE_IR_OP_PACK:
+    return instr->in == instr->lanes && instr->out == 1 && instr->lanes > 1;
+  case LLACE_IR_OP_PHI:
+    return instr->in > 0 && instr->in % 2 == 0 && instr->out == 1;
+  case LLACE_IR_OP_CALL:
+    return instr->func < LLACE_ARRAY_COUNT(ctx->funcmap.funcs) && instr->out <= 1;
+  case LLACE_IR_OP_JMP:
+    return instr->in == 1 && instr->out == 0;
+  case LLACE_IR_OP_BRANCH:
+    return instr->in == 3 && instr->out == 0;
+  case LLACE_IR_OP_RET:
+    return instr->in == (fn->ret.kind == LLACE_IR_TYPE_VOID ? 0u : 1u) && instr->out == 0;
+  default:
+    return instr->op < LLACE_IR_OP_COUNT && instr->in == 2 && instr->out == 1;
+  }
+}
+
+llace_error_t llace_ir_function_verify(const llace_ir_context_t *ctx, const llace_ir_function_t *fn) {
+  if (!ctx || !fn) {
+    return LLACE_ERROR_BADARG;
+  }
+  if (LLACE_ARRAY_IS_EMPTY(fn->blocks)) {
+    return LLACE_ERROR_NONE; // declaration only
+  }
+
+  size_t var_count = LLACE_ARRAY_COUNT(fn->vars);
+  size_t block_count = LLACE_ARRAY_COUNT(fn->blocks);
+  uint64_t *defined = LLACE_BITSET_NEW(var_count);
+  for (size_t p = 0; p < fn->param_count; ++p) LLACE_BITSET_SET(defined, p);
+
+  llace_error_t err = LLACE_ERROR_NONE;
+  for (size_t b = 0; b < block_count && err == LLACE_ERROR_NONE; ++b) {
+    const llace_ir_basicblock_t *block = LLACE_IR_BLOCK_AT(fn, b);
+    size_t count = LLACE_ARRAY_COUNT(block->stack);
+    size_t depth = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+      const llace_ir_value_t *value = LLACE_IR_STACK_AT(block, i);
+      if (value->kind == LLACE_IR_VALUE_VAR && value->var >= var_count) { err = LLACE_ERROR_INVLSYM; break; }
+      if (value->kind == LLACE_IR_VALUE_BLOCK && value->block >= block_count) { err = LLACE_ERROR_INVLSYM; break; }
+      if (value->kind == LLACE_IR_VALUE_GLOBAL && value->global >= LLACE_ARRAY_COUNT(ctx->globmap.globals)) { err = LLACE_ERROR_INVLSYM; break; }
+      if (value->kind != LLACE_IR_VALUE_INSTR) { ++depth; continue; }
+
+      const llace_ir_instr_t *instr = &value->instr;
+      if (!llace_ir_instr_valid(ctx, fn, instr) || depth < instr->in) { err = LLACE_ERROR_INVLFUNC; break; }
+      depth = depth - instr->in + instr->out;
+
+      if (instr->op == LLACE_IR_OP_ASSIGN) {
+        const llace_ir_value_t *target = LLACE_IR_STACK_AT(block, i - 1);
+        if (target->kind != LLACE_IR_VALUE_VAR) { err = LLACE_ERROR_INVLFUNC; break; }
+        if (LLACE_BITSET_GET(defined, target->var)) { err = LLACE_ERROR_SYMDUP; break; } // not SSA
+        LLACE_BITSET_SET(defined, target->var);
+      } else if (instr->op == LLACE_IR_OP_PHI) {
+        // phi operands are single values paired with their incoming block
+        for (size_t n = 0; n < instr->in; n += 2) {
+          const llace_ir_value_t *incoming = LLACE_IR_STACK_AT(block, i - instr->in + n);
+          const llace_ir_value_t *from = LLACE_IR_STACK_AT(block, i - instr->in + n + 1);
+          if (incoming->kind == LLACE_IR_VALUE_INSTR || from->kind != LLACE_IR_VALUE_BLOCK) { err = LLACE_ERROR_INVLFUNC; break; }
+        }
+        if (err != LLACE_ERROR_NONE) break;
+      } else if (llace_ir_op_is_terminator(instr->op) && i + 1 != count) {
+        err = LLACE_ERROR_INVLFUNC; // terminator in the middle of a block
+        break;
+      }
+    }
+
+    if (err == LLACE_ERROR_NONE && depth != 0) err = LLACE_ERROR_INVLFUNC;
+    if (err == LLACE_ERROR_NONE) {
+      const llace_ir_value_t *term = count ? LLACE_IR_STACK_AT(block, count - 1) : NULL;
+      if (!term || term->kind != LLACE_IR_VALUE_INSTR || !llace_ir_op_is_terminator(term->instr.op)) {
+        err = LLACE_ERROR_INVLFUNC; // block falls off its end
+      }
+    }
+    if (err != LLACE_ERROR_NONE) {
+      LLACE_LOG_ERROR("Invalid block '%s' in function '%s': %s", block->name, fn->name, llace_error_str(err));
+    }
+  }
+
+  free(defined);
+  return err;
+}
@@ -0,0 +1,528 @@
+#include <llace/ir.h>
+#include <llace/ir/analysis.h>
+#include <llace/profile.h>
+#include <llace/detail/common.h>
+
+// ================ Loop Vectorization ================ //
+
+// Counted loop in the shape the vectorizer rewrites:
+//   @pre:    ... @head jmp
+//   @head:   init @pre %next @body phi/2/1 %i = %i bound < %c = %c @body @exit branch
+//   @body:   statements over base %i index load / base %i index store, %i 1 + %next = @head jmp
+typedef struct {
+  size_t pre, header, body;
+  size_t iv, next;
+  llace_ir_value_t init, bound;
+  llace_ir_type_t element; // type of every vectorized value
+  size_t inc;              // statement index of the increment in the body
+  llace_array_t bases;     // llace_ir_value_t, pointers accessed through %i
+  llace_array_t stored;    // bool per base
+  uint64_t *inbody;        // variables defined in the body
+  uint64_t *seen;          // body variables defined so far while scanning
+  unsigned scalar_cost;    // per iteration, loop control excluded
+} vec_loop_t;
+
+typedef struct {
+  const llace_ir_context_t *ctx;
+  const llace_target_t *target;
+  llace_ir_function_t *fn;
+  llace_array_t stmts;
+  llace_array_t values;
+} vec_t;
+
+static bool vec_is_element(llace_ir_type_t type) {
+  return type.kind != LLACE_IR_TYPE_VOID && !LLACE_IR_IS_VEC(type);
+}
+
+unsigned llace_ir_value_cost(const llace_target_t *target, const llace_ir_value_t *value, llace_ir_type_t element, size_t lanes) {
+  if (value->kind != LLACE_IR_VALUE_INSTR) return 0;
+
+  llace_cost_t op;
+  switch (value->instr.op) {
+  case LLACE_IR_OP_ASSIGN: case LLACE_IR_OP_INDEX:  return 0;
+  case LLACE_IR_OP_MUL:                              op = LLACE_COST_MUL; break;
+  case LLACE_IR_OP_DIV: case LLACE_IR_OP_MOD:        op = LLACE_COST_DIV; break;
+  case LLACE_IR_OP_SHL: case LLACE_IR_OP_SHR:        op = LLACE_COST_SHIFT; break;
+  case LLACE_IR_OP_LOAD:                             op = LLACE_COST_LOAD; break;
+  case LLACE_IR_OP_STORE:                            op = LLACE_COST_STORE; break;
+  case LLACE_IR_OP_SPLAT:                            op = LLACE_COST_SPLAT; break;
+  case LLACE_IR_OP_PACK:                             op = LLACE_COST_PACK; break;
+  case LLACE_IR_OP_EXTRACT:                          op = LLACE_COST_EXTRACT; break;
+  default:                                           op = LLACE_COST_ALU; break;
+  }
+  return llace_target_cost(target, op, llace_ir_type_bits(element), lanes, element.kind == LLACE_IR_TYPE_FLOAT);
+}
+
+// Sum of the costs of the body statements at the given lane count
+static unsigned vec_body_cost(const vec_t *v, const vec_loop_t *m, size_t lanes) {
+  const llace_ir_basicblock_t *body = LLACE_IR_BLOCK_AT(v->fn, m->body);
+  unsigned total = 0;
+
+  for (size_t s = 0; s + 1 < LLACE_ARRAY_COUNT(v->stmts); ++s) {
+    if (s == m->inc) continue;
+    const llace_ir_stmt_t *stmt = LLACE_ARRAY_GET(llace_ir_stmt_t, v->stmts, s);
+    for (size_t i = stmt->begin; i < stmt->end; ++i) {
+      unsigned cost = llace_ir_value_cost(v->target, LLACE_IR_STACK_AT(body, i), m->element, lanes);
+      if (cost == LLACE_COST_UNSUPPORTED) return LLACE_COST_UNSUPPORTED;
+      total += cost;
+    }
+  }
+  return total;
+}
+
+// Pointer accessed with the induction variable as its index
+static bool vec_add_base(const vec_t *v, vec_loop_t *m, const llace_ir_value_t *base, bool store) {
+  llace_ir_type_t element;
+  switch (base->kind) {
+  case LLACE_IR_VALUE_VAR: {
+    const llace_ir_variable_t *var = LLACE_IR_VAR_AT(v->fn, base->var);
+    if (var->attr.depth != 1 || var->attr.attraw || LLACE_BITSET_GET(m->inbody, base->var) || base->var == m->iv) return false;
+    element = var->type;
+    break;
+  }
+  case LLACE_IR_VALUE_GLOBAL: {
+    const llace_ir_global_t *glob = LLACE_IR_GLOBAL_AT(v->ctx, base->global);
+    if (glob->attr.depth != 0 || glob->attr.attraw) return false;
+    element = glob->type;
+    break;
+  }
+  default:
+    return false;
+  }
+
+  if (!vec_is_element(element)) return false;
+  if (m->element.kind == LLACE_IR_TYPE_VOID) m->element = element;
+  if (!llace_ir_type_eq(element, m->element)) return false;
+
+  for (size_t b = 0; b < LLACE_ARRAY_COUNT(m->bases); ++b) {
+    if (!llace_ir_value_same(LLACE_ARRAY_GET(llace_ir_value_t, m->bases, b), base)) continue;
+    if (store) *LLACE_ARRAY_GET(bool, m->stored, b) = true;
+    return true;
+  }
+  LLACE_ARRAY_PUSHP(m->bases, base);
+  LLACE_ARRAY_PUSH(m->stored, store);
+  return true;
+}
+
+// Lane-wise statement over vectorizable values
+static bool vec_check_stmt(const vec_t *v, vec_loop_t *m, const llace_ir_basicblock_t *body, const llace_ir_stmt_t *stmt) {
+  for (size_t i = stmt->begin; i < stmt->end; ++i) {
+    const llace_ir_value_t *value = LLACE_IR_STACK_AT(body, i);
+
+    // base %i index load / base %i index store
+    if (i + 3 < stmt->end) {
+      const llace_ir_value_t *idx = LLACE_IR_STACK_AT(body, i + 1);
+      const llace_ir_value_t *op = LLACE_IR_STACK_AT(body, i + 2);
+      if (idx->kind == LLACE_IR_VALUE_VAR && idx->var == m->iv && LLACE_IR_IS_OP(op, LLACE_IR_OP_INDEX)) {
+        const llace_ir_value_t *access = LLACE_IR_STACK_AT(body, i + 3);
+        bool store = LLACE_IR_IS_OP(access, LLACE_IR_OP_STORE) && i + 4 == stmt->end;
+        if (!store && !LLACE_IR_IS_OP(access, LLACE_IR_OP_LOAD)) return false;
+        if (access->instr.lanes || !vec_add_base(v, m, value, store)) return false;
+        i += 3;
+        continue;
+      }
+    }
+
+    switch (value->kind) {
+    case LLACE_IR_VALUE_CONST:
+      if (m->element.kind != LLACE_IR_TYPE_VOID && !llace_ir_type_eq(value->type, m->element)) return false;
+      break;
+    case LLACE_IR_VALUE_VAR: {
+      const llace_ir_variable_t *var = LLACE_IR_VAR_AT(v->fn, value->var);
+      if (value->var == m->iv || value->var == m->next || var->attr.attraw || var->attr.depth) return false;
+      // A body variable read before its definition carries a value across iterations
+      bool target = i + 2 == stmt->end;
+      if (!target && LLACE_BITSET_GET(m->inbody, value->var) && !LLACE_BITSET_GET(m->seen, value->var)) return false;
+      if (m->element.kind != LLACE_IR_TYPE_VOID && !llace_ir_type_eq(var->type, m->element)) return false;
+      break;
+    }
+    case LLACE_IR_VALUE_INSTR:
+      switch (value->instr.op) {
+      case LLACE_IR_OP_ADD: case LLACE_IR_OP_SUB: case LLACE_IR_OP_MUL: case LLACE_IR_OP_DIV: case LLACE_IR_OP_MOD:
+      case LLACE_IR_OP_AND: case LLACE_IR_OP_OR: case LLACE_IR_OP_XOR: case LLACE_IR_OP_SHL: case LLACE_IR_OP_SHR:
+        break;
+      case LLACE_IR_OP_ASSIGN:
+        if (i + 1 != stmt->end) return false;
+        break;
+      default:
+        return false;
+      }
+      break;
+    default:
+      return false;
+    }
+  }
+  return true;
+}
+
+// Recognize the counted loop shape, fills m on success
+static bool vec_match(vec_t *v, const llace_ir_cfg_t *cfg, const llace_ir_loopinfo_t *loops, size_t l, vec_loop_t *m) {
+  const llace_ir_loop_t *loop = LLACE_IR_LOOP_AT(loops, l);
+  if (LLACE_ARRAY_COUNT(loop->blocks) != 2 || LLACE_ARRAY_COUNT(loop->latches) != 1) return false;
+
+  m->header = loop->header;
+  m->body = *LLACE_ARRAY_FRONT(size_t, loop->latches);
+  m->pre = llace_ir_loop_preheader(cfg, loops, l);
+  if (m->body == m->header || m->pre == SIZE_MAX) return false;
+
+  // Header: the induction phi, the exit test and the branch
+  const llace_ir_basicblock_t *header = LLACE_IR_BLOCK_AT(v->fn, m->header);
+  if (llace_ir_block_stmts(header, &v->stmts) != LLACE_ERROR_NONE || LLACE_ARRAY_COUNT(v->stmts) != 3) return false;
+  const llace_ir_stmt_t *phi = LLACE_ARRAY_GET(llace_ir_stmt_t, v->stmts, 0);
+  const llace_ir_stmt_t *test = LLACE_ARRAY_GET(llace_ir_stmt_t, v->stmts, 1);
+  const llace_ir_stmt_t *branch = LLACE_ARRAY_GET(llace_ir_stmt_t, v->stmts, 2);
+  if (phi->end - phi->begin != 7 || test->end - test->begin != 5 || branch->end - branch->begin != 4) return false;
+
+  const llace_ir_value_t *h = LLACE_ARRAY_RAW(header->stack);
+  if (!LLACE_IR_IS_OP(&h[4], LLACE_IR_OP_PHI) || h[5].kind != LLACE_IR_VALUE_VAR) return false;
+  m->iv = h[5].var;
+  bool has_init = false, has_next = false;
+  for (size_t p = 0; p < 4; p += 2) {
+    if (h[p + 1].kind != LLACE_IR_VALUE_BLOCK) return false;
+    if (h[p + 1].block == m->pre) { m->init = h[p]; has_init = true; }
+    else if (h[p + 1].block == m->body && h[p].kind == LLACE_IR_VALUE_VAR) { m->next = h[p].var; has_next = true; }
+  }
+  if (!has_init || !has_next) return false;
+
+  const llace_ir_variable_t *iv = LLACE_IR_VAR_AT(v->fn, m->iv);
+  if (iv->type.kind != LLACE_IR_TYPE_INT || LLACE_IR_IS_VEC(iv->type) || iv->attr.depth || iv->attr.attraw) return false;
+
+  const llace_ir_value_t *t = &h[test->begin];
+  if (t[0].kind != LLACE_IR_VALUE_VAR || t[0].var != m->iv || !LLACE_IR_IS_OP(&t[2], LLACE_IR_OP_LT)) return false;
+  if (t[1].kind != LLACE_IR_VALUE_VAR && t[1].kind != LLACE_IR_VALUE_CONST) return false;
+  m->bound = t[1];
+  const llace_ir_value_t *br = &h[branch->begin];
+  if (t[3].kind != LLACE_IR_VALUE_VAR || br[0].kind != LLACE_IR_VALUE_VAR || br[0].var != t[3].var || br[1].block != m->body) return false;
+
+  // Body: variables it defines stay inside the loop
+  const llace_ir_basicblock_t *body = LLACE_IR_BLOCK_AT(v->fn, m->body);
+  if (llace_ir_block_stmts(body, &v->stmts) != LLACE_ERROR_NONE) return false;
+  size_t count = LLACE_ARRAY_COUNT(v->stmts);
+  const llace_ir_stmt_t *latch = LLACE_ARRAY_BACK(llace_ir_stmt_t, v->stmts);
+  if (latch->end - latch->begin != 2 || !LLACE_IR_IS_OP(LLACE_IR_STACK_AT(body, latch->begin + 1), LLACE_IR_OP_JMP)) return false;
+
+  size_t words = LLACE_BITSET_WORDS(LLACE_ARRAY_COUNT(v->fn->vars)) * sizeof(uint64_t);
+  memset(m->inbody, 0, words);
+  memset(m->seen, 0, words);
+  m->inc = SIZE_MAX;
+  for (size_t s = 0; s + 1 < count; ++s) {
+    const llace_ir_stmt_t *stmt = LLACE_ARRAY_GET(llace_ir_stmt_t, v->stmts, s);
+    size_t def;
+    if (llace_ir_stmt_def(body, stmt, &def)) {
+      if (LLACE_BITSET_GET(m->inbody, def)) return false; // assigned twice
+      LLACE_BITSET_SET(m->inbody, def);
+      if (def == m->next) m->inc = s;
+    } else if (!LLACE_IR_IS_OP(LLACE_IR_STACK_AT(body, stmt->end - 1), LLACE_IR_OP_STORE)) {
+      return false;
+    }
+  }
+  if (m->inc == SIZE_MAX) return false;
+
+  // %i 1 + %next =
+  const llace_ir_stmt_t *inc = LLACE_ARRAY_GET(llace_ir_stmt_t, v->stmts, m->inc);
+  const llace_ir_value_t *n = LLACE_IR_STACK_AT(body, inc->begin);
+  if (inc->end - inc->begin != 5 || !LLACE_IR_IS_OP(&n[2], LLACE_IR_OP_ADD)) return false;
+  const llace_ir_value_t *one = n[0].kind == LLACE_IR_VALUE_VAR && n[0].var == m->iv ? &n[1] : &n[0];
+  const llace_ir_value_t *ivref = one == &n[1] ? &n[0] : &n[1];
+  if (ivref->kind != LLACE_IR_VALUE_VAR || ivref->var != m->iv || one->kind != LLACE_IR_VALUE_CONST || one->_int != 1) return false;
+  if (m->bound.kind == LLACE_IR_VALUE_VAR && LLACE_BITSET_GET(m->inbody, m->bound.var)) return false;
+
+  for (size_t b = 0; b < LLACE_ARRAY_COUNT(v->fn->blocks); ++b) {
+    if (b == m->body) continue;
+    LLACE_ARRAY_FOREACH(llace_ir_value_t, value, LLACE_IR_BLOCK_AT(v->fn, b)->stack) {
+      if (value->kind != LLACE_IR_VALUE_VAR || !LLACE_BITSET_GET(m->inbody, value->var)) continue;
+      if (value->var == m->next && b == m->header) continue;
+      return false;
+    }
+  }
+
+  m->element = LLACE_IR_VOID;
+  m->bases.element_count = 0;
+  m->stored.element_count = 0;
+  // Twice, the second pass checks the values seen before the element type was known
+  for (size_t pass = 0; pass < 2; ++pass) {
+    memset(m->seen, 0, words);
+    for (size_t s = 0; s + 1 < count; ++s) {
+      if (s == m->inc) continue;
+      const llace_ir_stmt_t *stmt = LLACE_ARRAY_GET(llace_ir_stmt_t, v->stmts, s);
+      if (!vec_check_stmt(v, m, body, stmt)) return false;
+      size_t def;
+      if (llace_ir_stmt_def(body, stmt, &def)) LLACE_BITSET_SET(m->seen, def);
+    }
+    if (LLACE_ARRAY_IS_EMPTY(m->bases)) return false;
+  }
+
+  m->scalar_cost = vec_body_cost(v, m, 1);
+  return m->scalar_cost != LLACE_COST_UNSUPPORTED;
+}
+
+// Widest lane count the target runs cheaper than the scalar loop, 0 if none
+static size_t vec_choose_lanes(const vec_t *v, const vec_loop_t *m) {
+  size_t bits = llace_ir_type_bits(m->element);
+  const unsigned control = 3; // increment, compare and branch
+  for (size_t lanes = llace_target_vector_bits(v->target) / bits; lanes >= 2; lanes /= 2) {
+    unsigned cost = vec_body_cost(v, m, lanes);
+    if (cost == LLACE_COST_UNSUPPORTED) continue;
+    if (cost + control < (m->scalar_cost + control) * lanes) return lanes;
+  }
+  return 0;
+}
+
+static size_t vec_new_var(llace_ir_function_t *fn, const char *base, const char *suffix, llace_ir_type_t type, size_t depth) {
+  char name[256];
+  snprintf(name, sizeof(name), "%.200s.%s", base, suffix);
+  size_t index;
+  llace_ir_variable_new(fn, name, type, (llace_ir_typeattr_t){ .depth = depth }, &index);
+  return index;
+}
+
+// Rewrite the loop into a vector loop followed by the original one for the remainder
+static void vec_transform(vec_t *v, vec_loop_t *m, size_t lanes) {
+  llace_ir_function_t *fn = v->fn;
+  llace_ir_type_t ivtype = LLACE_IR_VAR_AT(fn, m->iv)->type;
+  llace_ir_type_t vtype = llace_ir_type_vec(m->element, lanes);
+  char ivname[200];
+  snprintf(ivname, sizeof(ivname), "%s", LLACE_IR_VAR_AT(fn, m->iv)->name);
+
+  size_t vi = vec_new_var(fn, ivname, "vec", ivtype, 0);
+  size_t vnext = vec_new_var(fn, ivname, "vec.next", ivtype, 0);
+  size_t vend = vec_new_var(fn, ivname, "vec.end", ivtype, 0);
+  size_t vtest = vec_new_var(fn, ivname, "vec.test", LLACE_IR_INT(1), 0);
+  size_t resume = vec_new_var(fn, ivname, "resume", ivtype, 0);
+
+  char name[256];
+  size_t vh, vb, mid;
+  snprintf(name, sizeof(name), "%s.vec", LLACE_IR_BLOCK_AT(fn, m->header)->name);
+  llace_ir_block_new(fn, name, &vh);
+  snprintf(name, sizeof(name), "%s.vec", LLACE_IR_BLOCK_AT(fn, m->body)->name);
+  llace_ir_block_new(fn, name, &vb);
+  snprintf(name, sizeof(name), "%s.resume", LLACE_IR_BLOCK_AT(fn, m->header)->name);
+  llace_ir_block_new(fn, name, &mid);
+
+  // Vector twins of the body variables, invariants get broadcast once in the preheader
+  size_t var_count = LLACE_ARRAY_COUNT(fn->vars);
+  size_t *twin = malloc(var_count * sizeof(size_t));
+  if (twin == NULL) { LLACE_LOG_FATAL("Failed to allocate '%zu' vector variables", var_count); }
+  for (size_t x = 0; x < var_count; ++x) twin[x] = SIZE_MAX;
+  llace_array_t splats = LLACE_NEW_ARRAY(llace_ir_value_t, 4); // scalar, then its splat variable
+  llace_array_t setup = LLACE_NEW_ARRAY(llace_ir_value_t, 32);
+
+  llace_ir_block_stmts(LLACE_IR_BLOCK_AT(fn, m->body), &v->stmts);
+  llace_array_t *out = &v->values;
+  out->element_count = 0;
+  for (size_t s = 0; s + 1 < LLACE_ARRAY_COUNT(v->stmts); ++s) {
+    if (s == m->inc) continue;
+    const llace_ir_stmt_t *stmt = LLACE_ARRAY_GET(llace_ir_stmt_t, v->stmts, s);
+    const llace_ir_basicblock_t *body = LLACE_IR_BLOCK_AT(fn, m->body);
+
+    for (size_t i = stmt->begin; i < stmt->end; ++i) {
+      llace_ir_value_t value = *LLACE_IR_STACK_AT(body, i);
+      const llace_ir_value_t *idx = i + 1 < stmt->end ? LLACE_IR_STACK_AT(body, i + 1) : NULL;
+      if (idx && idx->kind == LLACE_IR_VALUE_VAR && idx->var == m->iv) {
+        const llace_ir_value_t *access = LLACE_IR_STACK_AT(body, i + 3);
+        LLACE_ARRAY_PUSHP(*out, &value);
+        LLACE_ARRAY_PUSH(*out, LLACE_IR_VAR(vi));
+        LLACE_ARRAY_PUSH(*out, LLACE_IR_OP(LLACE_IR_OP_INDEX, 2, 1));
+        LLACE_ARRAY_PUSH(*out, LLACE_IR_VOP(access->instr.op, access->instr.in, access->instr.out, lanes));
+        i += 3;
+        continue;
+      }
+
+      if (value.kind == LLACE_IR_VALUE_VAR && LLACE_BITSET_GET(m->inbody, value.var)) {
+        if (twin[value.var] == SIZE_MAX) {
+          twin[value.var] = vec_new_var(fn, LLACE_IR_VAR_AT(fn, value.var)->name, "vec", vtype, 0);
+        }
+        value = LLACE_IR_VAR(twin[value.var]);
+      } else if (value.kind == LLACE_IR_VALUE_VAR || value.kind == LLACE_IR_VALUE_CONST) {
+        size_t found = SIZE_MAX;
+        for (size_t k = 0; k < LLACE_ARRAY_COUNT(splats); k += 2) {
+          if (llace_ir_value_same(LLACE_ARRAY_GET(llace_ir_value_t, splats, k), &value)) found = LLACE_ARRAY_GET(llace_ir_value_t, splats, k + 1)->var;
+        }
+        if (found == SIZE_MAX) {
+          char suffix[32];
+          snprintf(suffix, sizeof(suffix), "splat%zu", LLACE_ARRAY_COUNT(splats) / 2);
+          found = vec_new_var(fn, value.kind == LLACE_IR_VALUE_VAR ? LLACE_IR_VAR_AT(fn, value.var)->name : ivname, suffix, vtype, 0);
+          LLACE_ARRAY_PUSHP(splats, &value);
+          LLACE_ARRAY_PUSH(splats, LLACE_IR_VAR(found));
+          LLACE_ARRAY_PUSHP(setup, &value);
+          LLACE_ARRAY_PUSH(setup, LLACE_IR_VOP(LLACE_IR_OP_SPLAT, 1, 1, lanes));
+          LLACE_ARRAY_PUSH(setup, LLACE_IR_VAR(found));
+          LLACE_ARRAY_PUSH(setup, LLACE_IR_OP(LLACE_IR_OP_ASSIGN, 2, 0));
+        }
+        value = LLACE_IR_VAR(found);
+      }
+      LLACE_ARRAY_PUSHP(*out, &value);
+    }
+  }
+
+  // Vector body, stepping by the lane count
+  llace_ir_basicblock_t *block = LLACE_IR_BLOCK_AT(fn, vb);
+  LLACE_ARRAY_PUSHA(block->stack, LLACE_ARRAY_RAW(*out), LLACE_ARRAY_COUNT(*out));
+  LLACE_IR_PUSH(block, LLACE_IR_VAR(vi));
+  LLACE_IR_PUSH(block, LLACE_IR_CONST_INT(ivtype, (int64_t)lanes));
+  LLACE_IR_PUSH(block, LLACE_IR_OP(LLACE_IR_OP_ADD, 2, 1));
+  LLACE_IR_PUSH(block, LLACE_IR_VAR(vnext));
+  LLACE_IR_PUSH(block, LLACE_IR_OP(LLACE_IR_OP_ASSIGN, 2, 0));
+  LLACE_IR_PUSH(block, LLACE_IR_BLOCK(vh));
+  LLACE_IR_PUSH(block, LLACE_IR_OP(LLACE_IR_OP_JMP, 1, 0));
+
+  // Vector header, runs while a whole vector of iterations is left
+  block = LLACE_IR_BLOCK_AT(fn, vh);
+  llace_ir_value_t vheader[] = {
+    m->init, LLACE_IR_BLOCK(m->pre), LLACE_IR_VAR(vnext), LLACE_IR_BLOCK(vb), LLACE_IR_OP(LLACE_IR_OP_PHI, 4, 1), LLACE_IR_VAR(vi), LLACE_IR_OP(LLACE_IR_OP_ASSIGN, 2, 0),
+    LLACE_IR_VAR(vi), LLACE_IR_VAR(vend), LLACE_IR_OP(LLACE_IR_OP_LT, 2, 1), LLACE_IR_VAR(vtest), LLACE_IR_OP(LLACE_IR_OP_ASSIGN, 2, 0),
+    LLACE_IR_VAR(vtest), LLACE_IR_BLOCK(vb), LLACE_IR_BLOCK(mid), LLACE_IR_OP(LLACE_IR_OP_BRANCH, 3, 0),
+  };
+  LLACE_ARRAY_PUSHA(block->stack, vheader, sizeof(vheader) / sizeof(vheader[0]));
+
+  // Overlapping pointers fall back to the scalar loop: a[bound] <= b[init] or b[bound] <= a[init]
+  size_t checks = 0;
+  for (size_t a = 0; a < LLACE_ARRAY_COUNT(m->bases); ++a) {
+    for (size_t b = a + 1; b < LLACE_ARRAY_COUNT(m->bases); ++b) {
+      const llace_ir_value_t *pa = LLACE_ARRAY_GET(llace_ir_value_t, m->bases, a);
+      const llace_ir_value_t *pb = LLACE_ARRAY_GET(llace_ir_value_t, m->bases, b);
+      if (!*LLACE_ARRAY_GET(bool, m->stored, a) && !*LLACE_ARRAY_GET(bool, m->stored, b)) continue;
+      if (pa->kind == LLACE_IR_VALUE_GLOBAL && pb->kind == LLACE_IR_VALUE_GLOBAL) continue; // distinct objects
+
+      llace_ir_value_t check[] = {
+        *pa, m->bound, LLACE_IR_OP(LLACE_IR_OP_INDEX, 2, 1), *pb, m->init, LLACE_IR_OP(LLACE_IR_OP_INDEX, 2, 1), LLACE_IR_OP(LLACE_IR_OP_LE, 2, 1),
+        *pb, m->bound, LLACE_IR_OP(LLACE_IR_OP_INDEX, 2, 1), *pa, m->init, LLACE_IR_OP(LLACE_IR_OP_INDEX, 2, 1), LLACE_IR_OP(LLACE_IR_OP_LE, 2, 1),
+        LLACE_IR_OP(LLACE_IR_OP_OR, 2, 1),
+      };
+      LLACE_ARRAY_PUSHA(setup, check, sizeof(check) / sizeof(check[0]));
+      if (checks++ > 0) LLACE_ARRAY_PUSH(setup, LLACE_IR_OP(LLACE_IR_OP_AND, 2, 1));
+    }
+  }
+  size_t disjoint = SIZE_MAX;
+  if (checks > 0) {
+    disjoint = vec_new_var(fn, ivname, "vec.disjoint", LLACE_IR_INT(1), 0);
+    LLACE_ARRAY_PUSH(setup, LLACE_IR_VAR(disjoint));
+    LLACE_ARRAY_PUSH(setup, LLACE_IR_OP(LLACE_IR_OP_ASSIGN, 2, 0));
+  }
+
+  // Last start of a whole vector: init + ((bound - init) & -lanes)
+  llace_ir_value_t end[] = {
+    m->init, m->bound, m->init, LLACE_IR_OP(LLACE_IR_OP_SUB, 2, 1), LLACE_IR_CONST_INT(ivtype, -(int64_t)lanes), LLACE_IR_OP(LLACE_IR_OP_AND, 2, 1),
+    LLACE_IR_OP(LLACE_IR_OP_ADD, 2, 1), LLACE_IR_VAR(vend), LLACE_IR_OP(LLACE_IR_OP_ASSIGN, 2, 0),
+  };
+  LLACE_ARRAY_PUSHA(setup, end, sizeof(end) / sizeof(end[0]));
+  if (checks > 0) {
+    LLACE_ARRAY_PUSH(setup, LLACE_IR_VAR(disjoint));
+    LLACE_ARRAY_PUSH(setup, LLACE_IR_BLOCK(vh));
+    LLACE_ARRAY_PUSH(setup, LLACE_IR_BLOCK(mid));
+    LLACE_ARRAY_PUSH(setup, LLACE_IR_OP(LLACE_IR_OP_BRANCH, 3, 0));
+  } else {
+    LLACE_ARRAY_PUSH(setup, LLACE_IR_BLOCK(vh));
+    LLACE_ARRAY_PUSH(setup, LLACE_IR_OP(LLACE_IR_OP_JMP, 1, 0));
+  }
+  block = LLACE_IR_BLOCK_AT(fn, m->pre);
+  block->stack.element_count = llace_ir_block_term(block);
+  LLACE_ARRAY_PUSHA(block->stack, LLACE_ARRAY_RAW(setup), LLACE_ARRAY_COUNT(setup));
+
+  // The scalar loop resumes where the vector loop stopped
+  block = LLACE_IR_BLOCK_AT(fn, mid);
+  if (checks > 0) {
+    LLACE_IR_PUSH(block, m->init);
+    LLACE_IR_PUSH(block, LLACE_IR_BLOCK(m->pre));
+  }
+  LLACE_IR_PUSH(block, LLACE_IR_VAR(vi));
+  LLACE_IR_PUSH(block, LLACE_IR_BLOCK(vh));
+  LLACE_IR_PUSH(block, LLACE_IR_OP(LLACE_IR_OP_PHI, checks > 0 ? 4 : 2, 1));
+  LLACE_IR_PUSH(block, LLACE_IR_VAR(resume));
+  LLACE_IR_PUSH(block, LLACE_IR_OP(LLACE_IR_OP_ASSIGN, 2, 0));
+  LLACE_IR_PUSH(block, LLACE_IR_BLOCK(m->header));
+  LLACE_IR_PUSH(block, LLACE_IR_OP(LLACE_IR_OP_JMP, 1, 0));
+
+  block = LLACE_IR_BLOCK_AT(fn, m->header);
+  for (size_t p = 0; p < 4; p += 2) {
+    llace_ir_value_t *from = LLACE_IR_STACK_AT(block, p + 1);
+    if (from->block != m->pre) continue;
+    *LLACE_IR_STACK_AT(block, p) = LLACE_IR_VAR(resume);
+    from->block = mid;
+  }
+
+  LLACE_FREE_ARRAY(setup);
+  LLACE_FREE_ARRAY(splats);
+  free(twin);
+}
+
+llace_error_t llace_ir_opt_vectorize(const llace_ir_context_t *ctx, const llace_config_t *config, llace_ir_function_t *fn, llace_ir_vectorize_stats_t *stats) {
+  LLACE_PROFILE_SCOPE("vectorize");
+  LLACE_MEM_SCOPE(LLACE_MEM_IR);
+  if (!ctx || !config || !fn) {
+    return LLACE_ERROR_BADARG;
+  }
+  if (stats) *stats = (llace_ir_vectorize_stats_t){0};
+  if (LLACE_ARRAY_IS_EMPTY(fn->blocks) || llace_target_vector_bits(&config->target) == 0) {
+    return LLACE_ERROR_NONE;
+  }
+
+  vec_t v = {
+    .ctx = ctx,
+    .target = &config->target,
+    .fn = fn,
+    .stmts = LLACE_NEW_ARRAY(llace_ir_stmt_t, 16),
+    .values = LLACE_NEW_ARRAY(llace_ir_value_t, 64),
+  };
+  vec_loop_t m = {
+    .bases = LLACE_NEW_ARRAY(llace_ir_value_t, 4),
+    .stored = LLACE_NEW_ARRAY(bool, 4),
+  };
+
+  llace_ir_cfg_t cfg;
+  llace_ir_loopinfo_t loops;
+  LLACE_RUNCHECK(llace_ir_cfg_build(fn, &cfg));
+  llace_ir_loops_build(&cfg, &loops);
+  if (llace_ir_loops_make_preheaders(fn, &cfg, &loops)) {
+    llace_ir_loops_free(&loops);
+    llace_ir_cfg_free(&cfg);
+    LLACE_RUNCHECK(llace_ir_cfg_build(fn, &cfg));
+    llace_ir_loops_build(&cfg, &loops);
+  }
+
+  // Every rewrite adds blocks, the analysis is rebuilt before looking for the next loop.
+  // Headers already handled are skipped, the scalar remainder keeps the original shape.
+  llace_array_t done = LLACE_NEW_ARRAY(size_t, 4);
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    m.inbody = LLACE_BITSET_NEW(LLACE_ARRAY_COUNT(fn->vars));
+    m.seen = LLACE_BITSET_NEW(LLACE_ARRAY_COUNT(fn->vars));
+    for (size_t l = 0; l < LLACE_ARRAY_COUNT(loops.loops) && !changed; ++l) {
+      size_t header = LLACE_IR_LOOP_AT(&loops, l)->header;
+      bool handled = false;
+      LLACE_ARRAY_FOREACH(size_t, h, done) handled |= *h == header;
+      if (handled || !vec_match(&v, &cfg, &loops, l, &m)) continue;
+      LLACE_ARRAY_PUSH(done, header);
+      size_t lanes = vec_choose_lanes(&v, &m);
+      if (lanes == 0) continue;
+
+      size_t first = LLACE_ARRAY_COUNT(fn->blocks);
+      vec_transform(&v, &m, lanes);
+      LLACE_ARRAY_PUSH(done, first); // the vector header
+      if (stats) {
+        ++stats->vectorized;
+        stats->lanes = LLACE_MAX(stats->lanes, lanes);
+      }
+      changed = true;
+    }
+    free(m.seen);
+    free(m.inbody);
+
+    if (changed) {
+      llace_ir_loops_free(&loops);
+      llace_ir_cfg_free(&cfg);
+      LLACE_RUNCHECK(llace_ir_cfg_build(fn, &cfg));
+      llace_ir_loops_build(&cfg, &loops);
+    }
+  }
+
+  LLACE_FREE_ARRAY(done);
+  llace_ir_loops_free(&loops);
+  llace_ir_cfg_free(&cfg);
+  LLACE_FREE_ARRAY(m.stored);
+  LLACE_FREE_ARRAY(m.bases);
+  LLACE_FREE_ARRAY(v.values);
+  LLACE_FREE_ARRAY(v.stmts);
+  return LLACE_ERROR_NONE;
+}
@@ -1,4 +1,14 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime, localtime_r, strnlen
 #include "llace/log.h"
+#include <ctype.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_SLOTS 1024 // power of two
+#define LOG_DATA 200   // bytes of arguments per message
 
 static const char *level_strings[] = {
   "TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL"
@@ -8,22 +18,1035 @@ static const char *level_colors[] = {
   "\x1b[94m", "\x1b[36m", "\x1b[32m", "\x1b[33m", "\x1b[31m", "\x1b[35m"
 };
 
-void llace_log(int level, const char *file, int line, const char *function, const char *fmt, ...) {
+// One message, its arguments as captured or, when they did not fit, formatted
+typedef struct {
+  size_t seq; // Vyukov: the position it may be written at, one past once published
+  int level, line;
+  bool formatted;
+  const char *file, *function, *fmt;
+  time_t when; // seconds are all the prefix shows, time() is the cheapest clock
+  char *text; // formatted and longer than data, freed once written
+  unsigned char data[LOG_DATA];
+} log_slot_t;
+
+static struct {
+  log_slot_t slots[LOG_SLOTS];
+  bool active;
+  size_t head; // producers claim here
+  size_t tail; // the consumer reads here, under drain
+  pthread_mutex_t drain;
+  pthread_mutex_t lock; // wakes the worker
+  pthread_cond_t wake;
+  pthread_t worker;
+  bool threaded, stop, sleeping, registered;
+} log_ring = { .drain = PTHREAD_MUTEX_INITIALIZER, .lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER };
+
+static FILE *log_out;
+
+static inline FILE *log_file(void) {
+  return log_out ? log_out : stdout;
+}
+
+void llace_log_output(FILE *out) {
+  log_out = out;
+}
+
+static void log_prefix(FILE *out, int level, time_t when, const char *file, int line, const char *function) {
   char timebuf[16];
-  time_t t = time(NULL);
-  timebuf[strftime(timebuf, sizeof(timebuf), "%H:%M:%S", localtime(&t))] = '\0';
+  struct tm tm;
+  timebuf[strftime(timebuf, sizeof(timebuf), "%H:%M:%S", localtime_r(&when, &tm))] = '\0';
 
   fprintf(
-    stdout, "%s %s%-5s\x1b[0m \x1b[90m%s:%d: (%s)\x1b[0m ",
+    out, "%s %s%-5s\x1b[0m \x1b[90m%s:%d: (%s)\x1b[0m ",
     timebuf, level_colors[level], level_strings[level],
     file, line, function
   );
+}
+
+// ================ Arguments ================ //
+
+// A conversion after its '%'; lengths: H is hh, L is ll, D is a long double
+typedef struct {
+  char flags[6];
+  int width, precision; // -1 when absent
+  bool star_width, star_precision;
+  char length, conv;
+} log_spec_t;
+
+static const char *log_spec(const char *p, log_spec_t *spec) {
+  *spec = (log_spec_t){ .width = -1, .precision = -1 };
+  for (size_t f = 0; *p && strchr("-+ #0", *p); ++p) {
+    if (f + 1 < sizeof(spec->flags)) spec->flags[f++] = *p;
+  }
+  if (*p == '*') {
+    spec->star_width = true;
+    ++p;
+  } else if (isdigit((unsigned char)*p)) {
+    for (spec->width = 0; isdigit((unsigned char)*p); ++p) spec->width = spec->width * 10 + (*p - '0');
+  }
+  if (*p == '.') {
+    ++p;
+    if (*p == '*') {
+      spec->star_precision = true;
+      ++p;
+    } else {
+      for (spec->precision = 0; isdigit((unsigned char)*p); ++p) spec->precision = spec->precision * 10 + (*p - '0');
+    }
+  }
+  switch (*p) {
+  case 'h': spec->length = p[1] == 'h' ? 'H' : 'h'; p += p[1] == 'h' ? 2 : 1; break;
+  case 'l': spec->length = p[1] == 'l' ? 'L' : 'l'; p += p[1] == 'l' ? 2 : 1; break;
+  case 'L': spec->length = 'D'; ++p; break;
+  case 'z': case 'j': case 't': spec->length = *p++; break;
+  default: break;
+  }
+  spec->conv = *p;
+  return *p ? p + 1 : p;
+}
+
+static bool log_put(unsigned char *data, size_t *size, const void *bytes, size_t count) {
+  if (*size + count > LOG_DATA) return false;
+  memcpy(data + *size, bytes, count);
+  *size += count;
+  return true;
+}
+
+static bool log_put64(unsigned char *data, size_t *size, uint64_t value) {
+  return log_put(data, size, &value, sizeof(value));
+}
+
+// How each argument is read and stored, parsed once per format
+enum {
+  LOG_ARG_INT, LOG_ARG_SCHAR, LOG_ARG_SHORT, LOG_ARG_LONG, LOG_ARG_LLONG, LOG_ARG_SIZE, LOG_ARG_INTMAX, LOG_ARG_PTRDIFF,
+  LOG_ARG_UNSIGNED, LOG_ARG_UCHAR, LOG_ARG_USHORT, LOG_ARG_ULONG, LOG_ARG_ULLONG, LOG_ARG_UINTMAX,
+  LOG_ARG_DOUBLE, LOG_ARG_LDOUBLE, LOG_ARG_POINTER, LOG_ARG_PRECISION, LOG_ARG_STRING, LOG_ARG_SKIP
+};
+
+#define LOG_ARGS 32     // most arguments a captured format takes
+#define LOG_LAYOUTS 1024 // power of two
+
+typedef struct {
+  const char *fmt; // NULL while free, published once the rest is
+  bool capturable; // false for an unknown conversion or too many arguments, formatted at once
+  unsigned char count;
+  unsigned char args[LOG_ARGS];
+  int precision[LOG_ARGS]; // of a string, -1 when absent, -2 taken from the star before it
+} log_layout_t;
+
+static struct {
+  pthread_mutex_t lock; // new layouts
+  log_layout_t layouts[LOG_LAYOUTS];
+} log_layouts = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static bool log_layout_push(log_layout_t *layout, unsigned char arg, int precision) {
+  if (layout->count == LOG_ARGS) return false;
+  layout->precision[layout->count] = precision;
+  layout->args[layout->count++] = arg;
+  return true;
+}
+
+static void log_layout_parse(log_layout_t *layout, const char *fmt) {
+  layout->count = 0;
+  layout->capturable = false;
+  for (const char *p = fmt; *p;) {
+    if (*p++ != '%') continue;
+    if (*p == '%') {
+      ++p;
+      continue;
+    }
+    log_spec_t spec;
+    p = log_spec(p, &spec);
+    if (spec.star_width && !log_layout_push(layout, LOG_ARG_INT, -1)) return;
+    if (spec.star_precision && !log_layout_push(layout, LOG_ARG_PRECISION, -1)) return;
+
+    unsigned char arg;
+    switch (spec.conv) {
+    case 'd': case 'i':
+      switch (spec.length) {
+      case 'H': arg = LOG_ARG_SCHAR; break;
+      case 'h': arg = LOG_ARG_SHORT; break;
+      case 'l': arg = LOG_ARG_LONG; break;
+      case 'L': arg = LOG_ARG_LLONG; break;
+      case 'z': arg = LOG_ARG_SIZE; break;
+      case 'j': arg = LOG_ARG_INTMAX; break;
+      case 't': arg = LOG_ARG_PTRDIFF; break;
+      default:  arg = LOG_ARG_INT; break;
+      }
+      break;
+    case 'u': case 'o': case 'x': case 'X':
+      switch (spec.length) {
+      case 'H': arg = LOG_ARG_UCHAR; break;
+      case 'h': arg = LOG_ARG_USHORT; break;
+      case 'l': arg = LOG_ARG_ULONG; break;
+      case 'L': arg = LOG_ARG_ULLONG; break;
+      case 'z': arg = LOG_ARG_SIZE; break;
+      case 'j': arg = LOG_ARG_UINTMAX; break;
+      case 't': arg = LOG_ARG_PTRDIFF; break;
+      default:  arg = LOG_ARG_UNSIGNED; break;
+      }
+      break;
+    case 'c':
+      if (spec.length) return; // wide
+      arg = LOG_ARG_INT;
+      break;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+      arg = spec.length == 'D' ? LOG_ARG_LDOUBLE : LOG_ARG_DOUBLE;
+      break;
+    case 'p':
+      arg = LOG_ARG_POINTER;
+      break;
+    case 's':
+      if (spec.length) return; // wide
+      arg = LOG_ARG_STRING;
+      break;
+    case 'n':
+      arg = LOG_ARG_SKIP;
+      break;
+    default:
+      return;
+    }
+    if (!log_layout_push(layout, arg, spec.star_precision ? -2 : spec.precision)) return;
+  }
+  layout->capturable = true;
+}
+
+// The format's layout, cached by its address as formats are literals; parsed into local once the cache is full
+static const log_layout_t *log_layout(const char *fmt, log_layout_t *local) {
+  size_t mask = LOG_LAYOUTS - 1, hash = ((uintptr_t)fmt >> 3) * 31;
+  for (size_t i = 0, h = hash & mask; i < LOG_LAYOUTS; ++i, h = (h + 1) & mask) {
+    const char *at = __atomic_load_n(&log_layouts.layouts[h].fmt, __ATOMIC_ACQUIRE);
+    if (at == fmt) return &log_layouts.layouts[h];
+    if (!at) break;
+  }
+
+  const log_layout_t *found = NULL;
+  pthread_mutex_lock(&log_layouts.lock);
+  for (size_t i = 0, h = hash & mask; i < LOG_LAYOUTS; ++i, h = (h + 1) & mask) {
+    log_layout_t *layout = &log_layouts.layouts[h];
+    if (layout->fmt == fmt) {
+      found = layout;
+      break;
+    }
+    if (!layout->fmt) {
+      log_layout_parse(layout, fmt);
+      __atomic_store_n(&layout->fmt, fmt, __ATOMIC_RELEASE);
+      found = layout;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&log_layouts.lock);
+  if (found) return found;
+  log_layout_parse(local, fmt);
+  return local;
+}
+
+// Every argument by what its conversion reads: integers widened to 64 bits, strings copied;
+// false when one does not fit or the conversion is not known
+static bool log_capture(unsigned char *data, const char *fmt, va_list args) {
+  log_layout_t local;
+  const log_layout_t *layout = log_layout(fmt, &local);
+  if (!layout->capturable) return false;
+
+  size_t size = 0;
+  int precision = -1; // the last star one
+  for (size_t i = 0; i < layout->count; ++i) {
+    uint64_t word;
+    switch (layout->args[i]) {
+    case LOG_ARG_INT:      word = (uint64_t)(int64_t)va_arg(args, int); break;
+    case LOG_ARG_SCHAR:    word = (uint64_t)(int64_t)(signed char)va_arg(args, int); break;
+    case LOG_ARG_SHORT:    word = (uint64_t)(int64_t)(short)va_arg(args, int); break;
+    case LOG_ARG_LONG:     word = (uint64_t)(int64_t)va_arg(args, long); break;
+    case LOG_ARG_LLONG:    word = (uint64_t)(int64_t)va_arg(args, long long); break;
+    case LOG_ARG_SIZE:     word = (uint64_t)va_arg(args, size_t); break;
+    case LOG_ARG_INTMAX:   word = (uint64_t)va_arg(args, intmax_t); break;
+    case LOG_ARG_PTRDIFF:  word = (uint64_t)va_arg(args, ptrdiff_t); break;
+    case LOG_ARG_UNSIGNED: word = va_arg(args, unsigned); break;
+    case LOG_ARG_UCHAR:    word = (unsigned char)va_arg(args, unsigned); break;
+    case LOG_ARG_USHORT:   word = (unsigned short)va_arg(args, unsigned); break;
+    case LOG_ARG_ULONG:    word = va_arg(args, unsigned long); break;
+    case LOG_ARG_ULLONG:   word = va_arg(args, unsigned long long); break;
+    case LOG_ARG_UINTMAX:  word = va_arg(args, uintmax_t); break;
+    case LOG_ARG_DOUBLE:
+    case LOG_ARG_LDOUBLE: {
+      double real = layout->args[i] == LOG_ARG_LDOUBLE ? (double)va_arg(args, long double) : va_arg(args, double);
+      memcpy(&word, &real, sizeof(word));
+      break;
+    }
+    case LOG_ARG_POINTER: {
+      uintptr_t pointer = (uintptr_t)va_arg(args, void *);
+      word = pointer;
+      break;
+    }
+    case LOG_ARG_PRECISION:
+      precision = va_arg(args, int);
+      word = (uint64_t)(int64_t)precision;
+      break;
+    case LOG_ARG_STRING: {
+      const char *str = va_arg(args, const char *);
+      if (!str) str = "(null)";
+      int limit = layout->precision[i] == -2 ? precision : layout->precision[i];
+      size_t length = limit >= 0 ? strnlen(str, (size_t)limit) : strlen(str);
+      uint16_t stored = (uint16_t)length;
+      if (length > UINT16_MAX || !log_put(data, &size, &stored, sizeof(stored)) || !log_put(data, &size, str, length)) return false;
+      continue;
+    }
+    default: // LOG_ARG_SKIP, %n writes nothing back
+      (void)va_arg(args, void *);
+      continue;
+    }
+    if (!log_put64(data, &size, word)) return false;
+  }
+  return true;
+}
+
+// The message as text into buf, or onto the heap when longer: NULL when buf holds it, cut short only without memory
+static char *log_format(char *buf, size_t size, size_t *length, const char *fmt, va_list args) {
+  va_list copy;
+  va_copy(copy, args);
+  int written = vsnprintf(buf, size, fmt, copy);
+  va_end(copy);
+  *length = written < 0 ? 0 : (size_t)written;
+  if (*length < size) return NULL;
+
+  char *text = malloc(*length + 1);
+  if (text) {
+    vsnprintf(text, *length + 1, fmt, args);
+  } else {
+    *length = size - 1;
+  }
+  return text;
+}
+
+static uint64_t log_get64(const unsigned char *data, size_t *at) {
+  uint64_t value;
+  memcpy(&value, data + *at, sizeof(value));
+  *at += sizeof(value);
+  return value;
+}
+
+// Formats the message again, one conversion at a time from what was captured
+static void log_replay(FILE *out, const char *fmt, const unsigned char *data) {
+  size_t at = 0;
+  const char *p = fmt, *run = fmt;
+  while (*p) {
+    if (*p != '%') {
+      ++p;
+      continue;
+    }
+    fwrite(run, 1, (size_t)(p - run), out);
+    if (*++p == '%') {
+      fputc('%', out);
+      run = ++p;
+      continue;
+    }
+    log_spec_t spec;
+    p = log_spec(p, &spec);
+    run = p;
+    int width = spec.width, precision = spec.precision;
+    bool left = false;
+    if (spec.star_width) {
+      width = (int)(int64_t)log_get64(data, &at);
+      left = width < 0;
+      if (left) width = -width;
+    }
+    if (spec.star_precision) precision = (int)(int64_t)log_get64(data, &at);
+
+    char conv[40];
+    int n = snprintf(conv, sizeof(conv), "%%%s%s", spec.flags, left ? "-" : "");
+    if (width >= 0) n += snprintf(conv + n, sizeof(conv) - (size_t)n, "%d", width);
+    switch (spec.conv) {
+    case 's': {
+      uint16_t length;
+      memcpy(&length, data + at, sizeof(length));
+      snprintf(conv + n, sizeof(conv) - (size_t)n, ".*s");
+      fprintf(out, conv, (int)length, (const char *)data + at + sizeof(length));
+      at += sizeof(length) + length;
+      continue;
+    }
+    case 'n':
+      continue;
+    default:
+      break;
+    }
+    if (precision >= 0) n += snprintf(conv + n, sizeof(conv) - (size_t)n, ".%d", precision);
+    uint64_t word = log_get64(data, &at);
+    switch (spec.conv) {
+    case 'd': case 'i':
+      snprintf(conv + n, sizeof(conv) - (size_t)n, "ll%c", spec.conv);
+      fprintf(out, conv, (long long)(int64_t)word);
+      break;
+    case 'u': case 'o': case 'x': case 'X':
+      snprintf(conv + n, sizeof(conv) - (size_t)n, "ll%c", spec.conv);
+      fprintf(out, conv, (unsigned long long)word);
+      break;
+    case 'c':
+      snprintf(conv + n, sizeof(conv) - (size_t)n, "c");
+      fprintf(out, conv, (int)word);
+      break;
+    case 'p': {
+      uintptr_t pointer = (uintptr_t)word;
+      snprintf(conv + n, sizeof(conv) - (size_t)n, "p");
+      fprintf(out, conv, (void *)pointer);
+      break;
+    }
+    default: {
+      double real;
+      memcpy(&real, &word, sizeof(real));
+      snprintf(conv + n, sizeof(conv) - (size_t)n, "%c", spec.conv);
+      fprintf(out, conv, real);
+      break;
+    }
+    }
+  }
+  fwrite(run, 1, (size_t)(p - run), out);
+}
+
+// ================ Ring ================ //
+
+void llace_log_drain(void) {
+  pthread_mutex_lock(&log_ring.drain);
+  FILE *out = log_file();
+  bool wrote = false;
+  for (;;) {
+    log_slot_t *slot = &log_ring.slots[log_ring.tail & (LOG_SLOTS - 1)];
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != log_ring.tail + 1) break;
+
+    log_prefix(out, slot->level, slot->when, slot->file, slot->line, slot->function);
+    if (slot->text) {
+      fputs(slot->text, out);
+      free(slot->text);
+      slot->text = NULL;
+    } else if (slot->formatted) {
+      fputs((const char *)slot->data, out);
+    } else {
+      log_replay(out, slot->fmt, slot->data);
+    }
+    fputc('\n', out);
+    __atomic_store_n(&slot->seq, log_ring.tail + LOG_SLOTS, __ATOMIC_RELEASE);
+    ++log_ring.tail;
+    wrote = true;
+  }
+  if (wrote) fflush(out);
+  pthread_mutex_unlock(&log_ring.drain);
+}
+
+// Claims a slot, a full ring is drained by the producer that found it full
+static log_slot_t *log_claim(void) {
+  size_t pos = __atomic_load_n(&log_ring.head, __ATOMIC_RELAXED);
+  for (;;) {
+    log_slot_t *slot = &log_ring.slots[pos & (LOG_SLOTS - 1)];
+    intptr_t diff = (intptr_t)__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - (intptr_t)pos;
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&log_ring.head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) return slot;
+    } else {
+      if (diff < 0) llace_log_drain();
+      pos = __atomic_load_n(&log_ring.head, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+static void *log_worker(void *arg) {
+  (void)arg;
+  pthread_mutex_lock(&log_ring.lock);
+  while (!log_ring.stop) {
+    pthread_mutex_unlock(&log_ring.lock);
+    llace_log_drain();
+    pthread_mutex_lock(&log_ring.lock);
+
+    __atomic_store_n(&log_ring.sleeping, true, __ATOMIC_SEQ_CST);
+    const log_slot_t *next = &log_ring.slots[log_ring.tail & (LOG_SLOTS - 1)];
+    if (!log_ring.stop && __atomic_load_n(&next->seq, __ATOMIC_SEQ_CST) != log_ring.tail + 1) {
+      // Producers only wake a sleeping worker, the timeout covers a wake between the check and the wait
+      struct timespec until;
+      clock_gettime(CLOCK_REALTIME, &until);
+      until.tv_nsec += 20 * 1000000;
+      if (until.tv_nsec >= 1000000000) {
+        until.tv_nsec -= 1000000000;
+        ++until.tv_sec;
+      }
+      pthread_cond_timedwait(&log_ring.wake, &log_ring.lock, &until);
+    }
+    __atomic_store_n(&log_ring.sleeping, false, __ATOMIC_SEQ_CST);
+  }
+  pthread_mutex_unlock(&log_ring.lock);
+  return NULL;
+}
+
+static void log_exit(void) {
+  llace_log_stop();
+  llace_log_trace_stop();
+}
+
+bool llace_log_start(bool thread) {
+  if (log_ring.active) return true;
+  for (size_t i = 0; i < LOG_SLOTS; ++i) log_ring.slots[(log_ring.head + i) & (LOG_SLOTS - 1)].seq = log_ring.head + i;
+  log_ring.tail = log_ring.head;
+  log_ring.stop = false;
+  log_ring.threaded = thread && pthread_create(&log_ring.worker, NULL, log_worker, NULL) == 0;
+  if (thread && !log_ring.threaded) return false;
+  if (!log_ring.registered) log_ring.registered = atexit(log_exit) == 0;
+  __atomic_store_n(&log_ring.active, true, __ATOMIC_RELEASE);
+  return true;
+}
+
+void llace_log_stop(void) {
+  if (!log_ring.active) return;
+  if (log_ring.threaded) {
+    pthread_mutex_lock(&log_ring.lock);
+    log_ring.stop = true;
+    pthread_cond_signal(&log_ring.wake);
+    pthread_mutex_unlock(&log_ring.lock);
+    pthread_join(log_ring.worker, NULL);
+    log_ring.threaded = false;
+  }
+  llace_log_drain();
+  __atomic_store_n(&log_ring.active, false, __ATOMIC_RELEASE);
+}
+
+// ================ Sites ================ //
+
+#define LOG_RULES 32
+
+static struct {
+  pthread_mutex_t lock;
+  llace_log_site_t *sites;
+  int level;
+  size_t rule_count;
+  struct { const char *file; int line; bool enable; } rules[LOG_RULES];
+} log_sites = { .lock = PTHREAD_MUTEX_INITIALIZER, .level = LLACE_LOG_MIN_LEVEL };
+
+// A file names a site by its path or any trailing part of it after a '/'
+static bool log_matches(const char *path, const char *file) {
+  size_t plen = strlen(path), flen = strlen(file);
+  if (flen > plen || strcmp(path + plen - flen, file) != 0) return false;
+  return flen == plen || path[plen - flen - 1] == '/';
+}
+
+// Under the lock
+static void log_settle(llace_log_site_t *site) {
+  bool on = site->level >= log_sites.level;
+  for (size_t i = 0; i < log_sites.rule_count; ++i) {
+    if ((log_sites.rules[i].line == 0 || log_sites.rules[i].line == site->line) && log_matches(site->file, log_sites.rules[i].file)) {
+      on = log_sites.rules[i].enable;
+    }
+  }
+  __atomic_store_n(&site->state, on ? LLACE_LOG_SITE_ON : LLACE_LOG_SITE_OFF, __ATOMIC_RELAXED);
+}
 
+bool llace_log_site_enabled(llace_log_site_t *site) {
+  int state = __atomic_load_n(&site->state, __ATOMIC_RELAXED);
+  if (state != LLACE_LOG_SITE_NEW) return state == LLACE_LOG_SITE_ON;
+
+  pthread_mutex_lock(&log_sites.lock);
+  if (site->state == LLACE_LOG_SITE_NEW) {
+    site->next = log_sites.sites;
+    log_sites.sites = site;
+    log_settle(site);
+  }
+  state = site->state;
+  pthread_mutex_unlock(&log_sites.lock);
+  return state == LLACE_LOG_SITE_ON;
+}
+
+void llace_log_level(int level) {
+  pthread_mutex_lock(&log_sites.lock);
+  log_sites.level = level;
+  log_sites.rule_count = 0;
+  for (llace_log_site_t *site = log_sites.sites; site; site = site->next) log_settle(site);
+  pthread_mutex_unlock(&log_sites.lock);
+}
+
+void llace_log_enable(const char *file, int line, bool enable) {
+  pthread_mutex_lock(&log_sites.lock);
+  if (log_sites.rule_count == LOG_RULES) { // the oldest rule goes
+    memmove(log_sites.rules, log_sites.rules + 1, sizeof(log_sites.rules[0]) * (LOG_RULES - 1));
+    --log_sites.rule_count;
+  }
+  log_sites.rules[log_sites.rule_count].file = file;
+  log_sites.rules[log_sites.rule_count].line = line;
+  log_sites.rules[log_sites.rule_count++].enable = enable;
+  for (llace_log_site_t *site = log_sites.sites; site; site = site->next) log_settle(site);
+  pthread_mutex_unlock(&log_sites.lock);
+}
+
+// ================ Trace ================ //
+
+#define LOG_TRACE_BUFFER (64 * 1024) // per thread
+#define LOG_TRACE_MESSAGE 512        // most a message takes, packed
+#define LOG_TRACE_SITES 4096         // power of two
+static const char log_trace_magic[8] = { 'L', 'L', 'T', 'R', 'A', 'C', 'E', '1' };
+
+// A file is the magic, then records:
+//   'S' id level line file function fmt      a site, before any message of it
+//   'C' size base message...                 one thread's buffer, base its first second,
+//                                            or a single formatted message too long for it
+// message: id, seconds past base, size << 1 | formatted, the arguments packed or the text.
+// Numbers are LEB128, zigzagged when signed, strings a length and their bytes.
+typedef struct log_tbuf {
+  struct log_tbuf *next;
+  size_t size;
+  int64_t base;
+  unsigned char data[LOG_TRACE_BUFFER];
+} log_tbuf_t;
+
+typedef struct {
+  uint32_t id; // 0 while free
+  int level, line;
+  const char *file, *fmt;
+} log_trace_site_t;
+
+static struct {
+  bool active, keyed;
+  FILE *out;
+  pthread_mutex_t lock; // the file, the buffer list and new sites
+  pthread_key_t key;
+  log_tbuf_t *buffers;
+  uint32_t next_id;
+  log_trace_site_t sites[LOG_TRACE_SITES];
+} log_trace = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static _Thread_local log_tbuf_t *log_tbuf;
+
+static size_t log_uleb(unsigned char *out, uint64_t value) {
+  size_t size = 0;
+  do {
+    unsigned char byte = value & 0x7F;
+    value >>= 7;
+    out[size++] = byte | (value ? 0x80 : 0);
+  } while (value);
+  return size;
+}
+
+static uint64_t log_zigzag(int64_t value) {
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t log_unzigzag(uint64_t value) {
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static bool log_get_uleb(const unsigned char *in, size_t size, size_t *at, uint64_t *value) {
+  *value = 0;
+  for (unsigned shift = 0; *at < size && shift < 64; shift += 7) {
+    unsigned char byte = in[(*at)++];
+    *value |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+// Captured arguments to LEB128: star values and signed integers zigzagged, reals stay 8 bytes
+static size_t log_pack(const char *fmt, const unsigned char *data, unsigned char *out) {
+  size_t at = 0, size = 0;
+  for (const char *p = fmt; *p;) {
+    if (*p++ != '%') continue;
+    if (*p == '%') {
+      ++p;
+      continue;
+    }
+    log_spec_t spec;
+    p = log_spec(p, &spec);
+    if (spec.star_width) size += log_uleb(out + size, log_zigzag((int64_t)log_get64(data, &at)));
+    if (spec.star_precision) size += log_uleb(out + size, log_zigzag((int64_t)log_get64(data, &at)));
+    switch (spec.conv) {
+    case 'n':
+      break;
+    case 's': {
+      uint16_t length;
+      memcpy(&length, data + at, sizeof(length));
+      size += log_uleb(out + size, length);
+      memcpy(out + size, data + at + sizeof(length), length);
+      size += length;
+      at += sizeof(length) + length;
+      break;
+    }
+    case 'd': case 'i':
+      size += log_uleb(out + size, log_zigzag((int64_t)log_get64(data, &at)));
+      break;
+    case 'u': case 'o': case 'x': case 'X': case 'c': case 'p':
+      size += log_uleb(out + size, log_get64(data, &at));
+      break;
+    default:
+      memcpy(out + size, data + at, sizeof(uint64_t));
+      size += sizeof(uint64_t);
+      at += sizeof(uint64_t);
+      break;
+    }
+  }
+  return size;
+}
+
+// The reverse, false when the input is short or would not fit
+static bool log_unpack(const char *fmt, const unsigned char *in, size_t size, unsigned char *data) {
+  size_t at = 0, put = 0;
+  uint64_t word;
+  for (const char *p = fmt; *p;) {
+    if (*p++ != '%') continue;
+    if (*p == '%') {
+      ++p;
+      continue;
+    }
+    log_spec_t spec;
+    p = log_spec(p, &spec);
+    if (spec.star_width && (!log_get_uleb(in, size, &at, &word) || !log_put64(data, &put, (uint64_t)log_unzigzag(word)))) return false;
+    if (spec.star_precision && (!log_get_uleb(in, size, &at, &word) || !log_put64(data, &put, (uint64_t)log_unzigzag(word)))) return false;
+    switch (spec.conv) {
+    case 'n':
+      break;
+    case 's': {
+      if (!log_get_uleb(in, size, &at, &word) || word > size - at || word > UINT16_MAX) return false;
+      uint16_t length = (uint16_t)word;
+      if (!log_put(data, &put, &length, sizeof(length)) || !log_put(data, &put, in + at, length)) return false;
+      at += length;
+      break;
+    }
+    case 'd': case 'i':
+      if (!log_get_uleb(in, size, &at, &word) || !log_put64(data, &put, (uint64_t)log_unzigzag(word))) return false;
+      break;
+    case 'u': case 'o': case 'x': case 'X': case 'c': case 'p':
+      if (!log_get_uleb(in, size, &at, &word) || !log_put64(data, &put, word)) return false;
+      break;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+      if (size - at < sizeof(uint64_t) || !log_put(data, &put, in + at, sizeof(uint64_t))) return false;
+      at += sizeof(uint64_t);
+      break;
+    default:
+      return false;
+    }
+  }
+  return at == size;
+}
+
+static void log_write_uleb(FILE *out, uint64_t value) {
+  unsigned char bytes[10];
+  fwrite(bytes, 1, log_uleb(bytes, value), out);
+}
+
+static void log_write_str(FILE *out, const char *str) {
+  size_t length = strlen(str);
+  log_write_uleb(out, length);
+  fwrite(str, 1, length, out);
+}
+
+// Under the lock
+static void log_trace_flush(log_tbuf_t *buf) {
+  if (buf->size == 0) return;
+  fputc('C', log_trace.out);
+  log_write_uleb(log_trace.out, buf->size);
+  log_write_uleb(log_trace.out, log_zigzag(buf->base));
+  fwrite(buf->data, 1, buf->size, log_trace.out);
+  buf->size = 0;
+}
+
+// A thread's buffer goes out with it
+static void log_trace_release(void *arg) {
+  log_tbuf_t *buf = arg;
+  pthread_mutex_lock(&log_trace.lock);
+  if (log_trace.active) log_trace_flush(buf);
+  for (log_tbuf_t **link = &log_trace.buffers; *link; link = &(*link)->next) {
+    if (*link == buf) {
+      *link = buf->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&log_trace.lock);
+  log_tbuf = NULL;
+  free(buf);
+}
+
+// The site's id, registered and written out the first time; 0 once the table is full
+static uint32_t log_trace_site(int level, const char *file, int line, const char *function, const char *fmt) {
+  size_t mask = LOG_TRACE_SITES - 1;
+  size_t hash = ((uintptr_t)fmt >> 3) * 31 + ((uintptr_t)file >> 3) * 17 + (size_t)line;
+  for (size_t i = 0, h = hash & mask; i < LOG_TRACE_SITES; ++i, h = (h + 1) & mask) {
+    log_trace_site_t *site = &log_trace.sites[h];
+    uint32_t id = __atomic_load_n(&site->id, __ATOMIC_ACQUIRE);
+    if (id == 0) break;
+    if (site->fmt == fmt && site->file == file && site->line == line && site->level == level) return id;
+  }
+
+  uint32_t id = 0;
+  pthread_mutex_lock(&log_trace.lock);
+  for (size_t i = 0, h = hash & mask; i < LOG_TRACE_SITES; ++i, h = (h + 1) & mask) {
+    log_trace_site_t *site = &log_trace.sites[h];
+    if (site->id == 0) {
+      site->level = level;
+      site->line = line;
+      site->file = file;
+      site->fmt = fmt;
+      id = ++log_trace.next_id;
+      fputc('S', log_trace.out);
+      log_write_uleb(log_trace.out, id);
+      log_write_uleb(log_trace.out, (uint64_t)level);
+      log_write_uleb(log_trace.out, (uint64_t)line);
+      log_write_str(log_trace.out, file);
+      log_write_str(log_trace.out, function);
+      log_write_str(log_trace.out, fmt);
+      __atomic_store_n(&site->id, id, __ATOMIC_RELEASE);
+      break;
+    }
+    if (site->fmt == fmt && site->file == file && site->line == line && site->level == level) {
+      id = site->id;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&log_trace.lock);
+  return id;
+}
+
+static log_tbuf_t *log_trace_buffer(void) {
+  if (log_tbuf) return log_tbuf;
+  log_tbuf_t *buf = malloc(sizeof(log_tbuf_t));
+  if (!buf) return NULL;
+  buf->size = 0;
+  pthread_mutex_lock(&log_trace.lock);
+  buf->next = log_trace.buffers;
+  log_trace.buffers = buf;
+  pthread_mutex_unlock(&log_trace.lock);
+  pthread_setspecific(log_trace.key, buf);
+  return log_tbuf = buf;
+}
+
+// False when the message could not be traced and should be written as text
+static bool log_trace_message(int level, const char *file, int line, const char *function, const char *fmt, va_list args) {
+  log_tbuf_t *buf = log_trace_buffer();
+  uint32_t id = buf ? log_trace_site(level, file, line, function, fmt) : 0;
+  if (id == 0) return false;
+
+  time_t when = time(NULL);
+  if (buf->size + LOG_TRACE_MESSAGE > LOG_TRACE_BUFFER) {
+    pthread_mutex_lock(&log_trace.lock);
+    log_trace_flush(buf);
+    pthread_mutex_unlock(&log_trace.lock);
+  }
+  if (buf->size == 0) buf->base = when;
+
+  unsigned char data[LOG_DATA], packed[LOG_TRACE_MESSAGE];
+  char *text = NULL;
+  size_t size;
+  bool formatted = false;
+  va_list copy;
+  va_copy(copy, args);
+  if (log_capture(data, fmt, copy)) {
+    size = log_pack(fmt, data, packed);
+  } else {
+    text = log_format((char *)packed, LOG_DATA, &size, fmt, args);
+    formatted = true;
+  }
+  va_end(copy);
+
+  if (text) {
+    // Longer than a message may take: a chunk of its own, after what the thread traced before
+    unsigned char header[30];
+    size_t length = log_uleb(header, id);
+    length += log_uleb(header + length, log_zigzag(0));
+    length += log_uleb(header + length, size << 1 | formatted);
+    pthread_mutex_lock(&log_trace.lock);
+    log_trace_flush(buf);
+    fputc('C', log_trace.out);
+    log_write_uleb(log_trace.out, length + size);
+    log_write_uleb(log_trace.out, log_zigzag(when));
+    fwrite(header, 1, length, log_trace.out);
+    fwrite(text, 1, size, log_trace.out);
+    pthread_mutex_unlock(&log_trace.lock);
+    free(text);
+    return true;
+  }
+
+  unsigned char *out = buf->data + buf->size;
+  out += log_uleb(out, id);
+  out += log_uleb(out, log_zigzag(when - buf->base));
+  out += log_uleb(out, size << 1 | formatted);
+  memcpy(out, packed, size);
+  buf->size = (size_t)(out + size - buf->data);
+  return true;
+}
+
+bool llace_log_trace_start(FILE *out) {
+  if (log_trace.active || !out) return false;
+  if (!log_trace.keyed) log_trace.keyed = pthread_key_create(&log_trace.key, log_trace_release) == 0;
+  if (!log_trace.keyed) return false;
+  memset(log_trace.sites, 0, sizeof(log_trace.sites));
+  log_trace.next_id = 0;
+  log_trace.out = out;
+  if (fwrite(log_trace_magic, 1, sizeof(log_trace_magic), out) != sizeof(log_trace_magic)) return false;
+  if (!log_ring.registered) log_ring.registered = atexit(log_exit) == 0;
+  __atomic_store_n(&log_trace.active, true, __ATOMIC_RELEASE);
+  return true;
+}
+
+void llace_log_trace_stop(void) {
+  if (!log_trace.active) return;
+  pthread_mutex_lock(&log_trace.lock);
+  for (log_tbuf_t *buf = log_trace.buffers; buf; buf = buf->next) log_trace_flush(buf);
+  fflush(log_trace.out);
+  __atomic_store_n(&log_trace.active, false, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&log_trace.lock);
+}
+
+// ================ Decoding ================ //
+
+static bool log_read_uleb(FILE *in, uint64_t *value) {
+  *value = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    int byte = fgetc(in);
+    if (byte == EOF) return false;
+    *value |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+static char *log_read_str(FILE *in) {
+  uint64_t length;
+  if (!log_read_uleb(in, &length) || length > UINT16_MAX) return NULL;
+  char *str = malloc(length + 1);
+  if (str && fread(str, 1, length, in) != length) {
+    free(str);
+    return NULL;
+  }
+  if (str) str[length] = '\0';
+  return str;
+}
+
+typedef struct {
+  int level, line;
+  char *file, *function, *fmt;
+} log_decoded_site_t;
+
+// One chunk's messages, as llace_log would have written them
+static bool log_decode_chunk(FILE *out, const unsigned char *chunk, size_t size, int64_t base, const log_decoded_site_t *sites, size_t count) {
+  unsigned char data[LOG_DATA];
+  size_t at = 0;
+  while (at < size) {
+    uint64_t id, seconds, packed;
+    if (!log_get_uleb(chunk, size, &at, &id) || !log_get_uleb(chunk, size, &at, &seconds) ||
+        !log_get_uleb(chunk, size, &at, &packed) || id == 0 || id > count || (packed >> 1) > size - at) {
+      return false;
+    }
+    const log_decoded_site_t *site = &sites[id - 1];
+    size_t length = (size_t)(packed >> 1);
+    log_prefix(out, site->level, (time_t)(base + log_unzigzag(seconds)), site->file, site->line, site->function);
+    if (packed & 1) {
+      fwrite(chunk + at, 1, length, out);
+    } else {
+      if (!log_unpack(site->fmt, chunk + at, length, data)) return false;
+      log_replay(out, site->fmt, data);
+    }
+    fputc('\n', out);
+    at += length;
+  }
+  return true;
+}
+
+bool llace_log_decode(FILE *in, FILE *out) {
+  char magic[sizeof(log_trace_magic)];
+  if (fread(magic, 1, sizeof(magic), in) != sizeof(magic) || memcmp(magic, log_trace_magic, sizeof(magic)) != 0) return false;
+
+  log_decoded_site_t *sites = NULL;
+  size_t count = 0, capacity = 0;
+  unsigned char *chunk = NULL;
+  size_t chunk_size = 0;
+  bool ok = true;
+  for (int tag; ok && (tag = fgetc(in)) != EOF;) {
+    uint64_t id, level, line, size, base;
+    if (tag == 'S') {
+      ok = log_read_uleb(in, &id) && log_read_uleb(in, &level) && log_read_uleb(in, &line) && id == count + 1 && level <= LLACE_LOG_FATAL;
+      if (ok && count == capacity) {
+        capacity = capacity ? capacity * 2 : 64;
+        log_decoded_site_t *grown = realloc(sites, capacity * sizeof(*sites));
+        ok = grown != NULL;
+        if (grown) sites = grown;
+      }
+      if (!ok) break;
+      log_decoded_site_t *site = &sites[count++];
+      site->level = (int)level;
+      site->line = (int)line;
+      site->file = log_read_str(in);
+      site->function = log_read_str(in);
+      site->fmt = log_read_str(in);
+      ok = site->file && site->function && site->fmt;
+    } else if (tag == 'C') {
+      ok = log_read_uleb(in, &size) && log_read_uleb(in, &base);
+      if (ok && size > chunk_size) {
+        // A buffer's worth, or a single long formatted message
+        size_t want = size > LOG_TRACE_BUFFER ? (size_t)size : LOG_TRACE_BUFFER;
+        unsigned char *grown = realloc(chunk, want);
+        ok = grown != NULL;
+        if (grown) chunk = grown, chunk_size = want;
+      }
+      if (!ok) break;
+      ok = fread(chunk, 1, size, in) == size && log_decode_chunk(out, chunk, size, log_unzigzag(base), sites, count);
+    } else {
+      ok = false;
+    }
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    free(sites[i].file);
+    free(sites[i].function);
+    free(sites[i].fmt);
+  }
+  free(sites);
+  free(chunk);
+  fflush(out);
+  return ok;
+}
+
+// ================ Logging ================ //
+
+void llace_log(int level, const char *file, int line, const char *function, const char *fmt, ...) {
   va_list args;
   va_start(args, fmt);
-  vfprintf(stdout, fmt, args);
+
+  if (__atomic_load_n(&log_trace.active, __ATOMIC_ACQUIRE) && log_trace_message(level, file, line, function, fmt, args)) {
+    if (level != LLACE_LOG_FATAL) {
+      va_end(args);
+      return;
+    }
+    pthread_mutex_lock(&log_trace.lock); // the fatal message is in the trace as well
+    log_trace_flush(log_tbuf);
+    fflush(log_trace.out);
+    pthread_mutex_unlock(&log_trace.lock);
+    va_end(args);
+    va_start(args, fmt);
+  }
+
+  if (__atomic_load_n(&log_ring.active, __ATOMIC_ACQUIRE) && level != LLACE_LOG_FATAL) {
+    log_slot_t *slot = log_claim();
+    slot->level = level;
+    slot->line = line;
+    slot->file = file;
+    slot->function = function;
+    slot->fmt = fmt;
+    slot->formatted = false;
+    slot->text = NULL;
+    slot->when = time(NULL);
+    va_list copy;
+    va_copy(copy, args);
+    if (!log_capture(slot->data, fmt, copy)) {
+      size_t length;
+      slot->text = log_format((char *)slot->data, LOG_DATA, &length, fmt, args);
+      slot->formatted = true;
+    }
+    va_end(copy);
+    va_end(args);
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+    if (__atomic_load_n(&log_ring.sleeping, __ATOMIC_RELAXED) && __atomic_exchange_n(&log_ring.sleeping, false, __ATOMIC_SEQ_CST)) {
+      pthread_mutex_lock(&log_ring.lock);
+      pthread_cond_signal(&log_ring.wake);
+      pthread_mutex_unlock(&log_ring.lock);
+    }
+    return;
+  }
+
+  // Everything captured goes out before a fatal message
+  if (__atomic_load_n(&log_ring.active, __ATOMIC_ACQUIRE)) llace_log_drain();
+  FILE *out = log_file();
+  log_prefix(out, level, time(NULL), file, line, function);
+  vfprintf(out, fmt, args);
   va_end(args);
 
-  fprintf(stdout, "\n");
-  fflush(stdout);
-}
\ No newline at end of file
+  fprintf(out, "\n");
+  fflush(out);
+}
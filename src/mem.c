@@ -3,6 +3,100 @@
 #include <llace/mem.h>
 #include <llace/log.h>
 
+// ================ Accounting ================ //
+
+static struct {
+  size_t live, peak, allocs; // atomic
+} mem_tags[LLACE_MEM_TAG_COUNT], mem_total;
+
+static _Thread_local llace_mem_tag_t mem_tag;
+
+static const char *mem_tag_names[LLACE_MEM_TAG_COUNT] = {
+  "general", "ir", "types", "symbols", "codegen", "debug-info"
+};
+
+const char *llace_mem_tag_name(llace_mem_tag_t tag) {
+  return tag < LLACE_MEM_TAG_COUNT ? mem_tag_names[tag] : "unknown";
+}
+
+llace_mem_tag_t llace_mem_tag(llace_mem_tag_t tag) {
+  llace_mem_tag_t previous = mem_tag;
+  mem_tag = tag;
+  return previous;
+}
+
+void llace_mem_track(llace_mem_tag_t tag, size_t freed, size_t allocated) {
+  if (tag >= LLACE_MEM_TAG_COUNT) tag = LLACE_MEM_GENERAL;
+  if (allocated) __atomic_fetch_add(&mem_tags[tag].allocs, 1, __ATOMIC_RELAXED);
+  if (allocated) __atomic_fetch_add(&mem_total.allocs, 1, __ATOMIC_RELAXED);
+  if (allocated < freed) {
+    __atomic_fetch_sub(&mem_tags[tag].live, freed - allocated, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&mem_total.live, freed - allocated, __ATOMIC_RELAXED);
+    return;
+  }
+
+  size_t live = __atomic_add_fetch(&mem_tags[tag].live, allocated - freed, __ATOMIC_RELAXED);
+  size_t peak = __atomic_load_n(&mem_tags[tag].peak, __ATOMIC_RELAXED);
+  while (live > peak && !__atomic_compare_exchange_n(&mem_tags[tag].peak, &peak, live, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+
+  // The total peaks on its own, the tags need not peak at the same time
+  live = __atomic_add_fetch(&mem_total.live, allocated - freed, __ATOMIC_RELAXED);
+  peak = __atomic_load_n(&mem_total.peak, __ATOMIC_RELAXED);
+  while (live > peak && !__atomic_compare_exchange_n(&mem_total.peak, &peak, live, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+void llace_mem_stats(llace_mem_tag_t tag, llace_mem_stats_t *stats) {
+  if (tag >= LLACE_MEM_TAG_COUNT) {
+    *stats = (llace_mem_stats_t){0};
+    return;
+  }
+  stats->live = __atomic_load_n(&mem_tags[tag].live, __ATOMIC_RELAXED);
+  stats->peak = __atomic_load_n(&mem_tags[tag].peak, __ATOMIC_RELAXED);
+  stats->allocs = __atomic_load_n(&mem_tags[tag].allocs, __ATOMIC_RELAXED);
+}
+
+void llace_mem_total(llace_mem_stats_t *stats) {
+  stats->live = __atomic_load_n(&mem_total.live, __ATOMIC_RELAXED);
+  stats->peak = __atomic_load_n(&mem_total.peak, __ATOMIC_RELAXED);
+  stats->allocs = __atomic_load_n(&mem_total.allocs, __ATOMIC_RELAXED);
+}
+
+void llace_mem_stats_reset(void) {
+  for (size_t tag = 0; tag < LLACE_MEM_TAG_COUNT; ++tag) {
+    __atomic_store_n(&mem_tags[tag].peak, __atomic_load_n(&mem_tags[tag].live, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&mem_total.peak, __atomic_load_n(&mem_total.live, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+}
+
+// Rows to out or to the log when out is NULL
+static void mem_table(FILE *out) {
+  char row[128];
+  snprintf(row, sizeof(row), "%-12s %14s %14s %10s", "memory", "live bytes", "peak bytes", "allocs");
+  if (out) {
+    fprintf(out, "%s\n", row);
+  } else {
+    LLACE_LOG_INFO("%s", row);
+  }
+  for (size_t tag = 0; tag < LLACE_MEM_TAG_COUNT; ++tag) {
+    llace_mem_stats_t stats;
+    llace_mem_stats((llace_mem_tag_t)tag, &stats);
+    snprintf(row, sizeof(row), "%-12s %14zu %14zu %10zu", mem_tag_names[tag], stats.live, stats.peak, stats.allocs);
+    if (out) {
+      fprintf(out, "%s\n", row);
+    } else {
+      LLACE_LOG_INFO("%s", row);
+    }
+  }
+}
+
+void llace_mem_summary(FILE *out) {
+  if (out) mem_table(out);
+}
+
+void llace_mem_report(const llace_config_t *config) {
+  if (config && config->verbose) mem_table(NULL);
+}
+
 // ================ Item Allocation ================ //
 
 // llace_item_t llace_mem_new(size_t size);
@@ -24,10 +118,12 @@ llace_array_t llace_mem_newarray(size_t element_size, size_t element_capacity) {
   arr.element_size = element_size;
   arr.element_capacity = element_capacity;
   arr.element_count = 0;
+  arr.tag = (uint8_t)mem_tag;
 
   if (total_size != 0 && arr.data == NULL) {
     LLACE_LOG_FATAL("Failed to allocate requested size '%zu: size * %zu: capacity = %zu'", element_size, element_capacity, total_size);
   }
+  llace_mem_track(arr.tag, 0, total_size);
 
   return arr;
 }
@@ -35,6 +131,7 @@ llace_array_t llace_mem_newarray(size_t element_size, size_t element_capacity) {
 void llace_mem_freearray(llace_array_t *arr) {
   if (arr->data) {
     free(arr->data);
+    llace_mem_track(arr->tag, arr->element_size * arr->element_capacity, 0);
     arr->element_capacity = 0;
     arr->element_count = 0;
     arr->data = NULL;
@@ -59,6 +156,9 @@ void llace_mem_reserve(llace_array_t *arr, size_t element_capacity) {
     LLACE_LOG_FATAL("Failed to allocate requested size '%zu: size * %zu: capacity = %zu'", arr->element_size, element_capacity, total_size);
   }
   
+  // An array that never held anything takes the current tag
+  if (arr->element_capacity == 0) arr->tag = (uint8_t)mem_tag;
+  llace_mem_track(arr->tag, arr->element_size * arr->element_capacity, total_size);
   arr->data = new_data;
   arr->element_capacity = element_capacity;
 }
@@ -0,0 +1,367 @@
+#define _DEFAULT_SOURCE // syscall
+#include <llace/profile.h>
+#include <llace/mem.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+  #include <linux/perf_event.h>
+  #include <sys/syscall.h>
+#endif
+
+#define PROFILE_NONE SIZE_MAX
+#define PROFILE_COUNTERS 5
+
+static const char *profile_counter_names[PROFILE_COUNTERS] = {
+  "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"
+};
+
+typedef struct {
+  const char *name;
+  uint64_t start, duration;
+  unsigned mask; // counters read at both ends
+  uint64_t counts[PROFILE_COUNTERS];
+} profile_event_t;
+
+// A path of the call tree, the root (index 0) has no name
+typedef struct {
+  const char *name;
+  size_t parent, child, sibling;
+  size_t calls;
+  uint64_t total, children;
+  unsigned mask;                     // counters summed into counts
+  uint64_t counts[PROFILE_COUNTERS]; // inclusive
+  bool opened;                       // open holds the counters at the last open
+  uint64_t open[PROFILE_COUNTERS];
+} profile_node_t;
+
+typedef struct profile_thread {
+  struct profile_thread *next;
+  size_t id;
+  size_t current;       // innermost open zone, the root when none
+  llace_array_t nodes;  // profile_node_t
+  llace_array_t events; // profile_event_t
+  int leader;           // counter group, -1 without
+  int fds[PROFILE_COUNTERS];
+  size_t slots[PROFILE_COUNTERS], members;
+  unsigned mask;        // counters in the group
+} profile_thread_t;
+
+bool llace_profile_active;
+
+static struct {
+  pthread_mutex_t lock; // the thread list
+  profile_thread_t *threads;
+  size_t generation, next_id;
+  uint64_t origin;
+  bool counters;
+} profile = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+// A thread's state belongs to the generation it was made in, an older one was freed by start
+static _Thread_local profile_thread_t *profile_self;
+static _Thread_local size_t profile_generation;
+
+static uint64_t profile_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+#define PROFILE_NODE(nodes, index) LLACE_ARRAY_GET(profile_node_t, nodes, index)
+
+static size_t profile_node(llace_array_t *nodes, size_t parent, const char *name) {
+  size_t last = PROFILE_NONE;
+  for (size_t i = PROFILE_NODE(*nodes, parent)->child; i != PROFILE_NONE; i = PROFILE_NODE(*nodes, i)->sibling) {
+    if (PROFILE_NODE(*nodes, i)->name == name || strcmp(PROFILE_NODE(*nodes, i)->name, name) == 0) return i;
+    last = i;
+  }
+
+  size_t index = LLACE_ARRAY_COUNT(*nodes);
+  LLACE_ARRAY_PUSH(*nodes, ((profile_node_t){ .name = name, .parent = parent, .child = PROFILE_NONE, .sibling = PROFILE_NONE }));
+  if (last == PROFILE_NONE) {
+    PROFILE_NODE(*nodes, parent)->child = index;
+  } else {
+    PROFILE_NODE(*nodes, last)->sibling = index;
+  }
+  return index;
+}
+
+static llace_array_t profile_tree(void) {
+  llace_array_t nodes = LLACE_NEW_ARRAY(profile_node_t, 16);
+  LLACE_ARRAY_PUSH(nodes, ((profile_node_t){ .parent = PROFILE_NONE, .child = PROFILE_NONE, .sibling = PROFILE_NONE }));
+  return nodes;
+}
+
+// ================ Counters ================ //
+
+// A group per thread counting the thread in user space, led by the first counter that opens.
+// Whatever the kernel, hardware or permissions refuse is left out; with nothing left there is no group.
+static void profile_counters_open(profile_thread_t *thread) {
+  thread->leader = -1;
+  thread->members = 0;
+  thread->mask = 0;
+  for (size_t c = 0; c < PROFILE_COUNTERS; ++c) thread->fds[c] = -1;
+#ifdef __linux__
+  static const struct { uint32_t type; uint64_t config; } events[PROFILE_COUNTERS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+  };
+  for (size_t c = 0; c < PROFILE_COUNTERS; ++c) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[c].type;
+    attr.config = events[c].config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, thread->leader, PERF_FLAG_FD_CLOEXEC);
+    if (fd < 0) continue;
+    if (thread->leader < 0) thread->leader = fd;
+    thread->fds[c] = fd;
+    thread->slots[c] = thread->members++;
+    thread->mask |= 1u << c;
+  }
+#endif
+}
+
+static void profile_counters_close(profile_thread_t *thread) {
+  for (size_t c = 0; c < PROFILE_COUNTERS; ++c) {
+    if (thread->fds[c] >= 0) close(thread->fds[c]);
+    thread->fds[c] = -1;
+  }
+  thread->leader = -1;
+  thread->mask = 0;
+}
+
+static bool profile_counters_read(const profile_thread_t *thread, uint64_t *counts) {
+  if (thread->leader < 0) return false;
+  uint64_t values[1 + PROFILE_COUNTERS];
+  ssize_t size = read(thread->leader, values, sizeof(values));
+  if (size < (ssize_t)((1 + thread->members) * sizeof(uint64_t)) || values[0] != thread->members) return false;
+  for (size_t c = 0; c < PROFILE_COUNTERS; ++c) counts[c] = thread->mask & (1u << c) ? values[1 + thread->slots[c]] : 0;
+  return true;
+}
+
+bool llace_profile_counters(bool enable) {
+  bool available = false;
+  if (enable) {
+    profile_thread_t probe;
+    profile_counters_open(&probe);
+    available = probe.leader >= 0;
+    profile_counters_close(&probe);
+  }
+  __atomic_store_n(&profile.counters, available, __ATOMIC_RELEASE);
+  return available;
+}
+
+static profile_thread_t *profile_thread(void) {
+  size_t generation = __atomic_load_n(&profile.generation, __ATOMIC_ACQUIRE);
+  if (profile_self && profile_generation == generation) return profile_self;
+
+  profile_thread_t *thread = malloc(sizeof(profile_thread_t));
+  if (thread == NULL) { LLACE_LOG_FATAL("Failed to allocate the profile of a thread"); }
+  thread->current = 0;
+  thread->nodes = profile_tree();
+  thread->events = LLACE_NEW_ARRAY(profile_event_t, 256);
+  profile_counters_open(thread);
+  if (!__atomic_load_n(&profile.counters, __ATOMIC_ACQUIRE)) profile_counters_close(thread);
+  pthread_mutex_lock(&profile.lock);
+  thread->id = profile.next_id++;
+  thread->next = profile.threads;
+  profile.threads = thread;
+  pthread_mutex_unlock(&profile.lock);
+  profile_self = thread;
+  profile_generation = generation;
+  return thread;
+}
+
+// ================ Zones ================ //
+
+llace_profile_zone_t llace_profile_open(const char *name) {
+  profile_thread_t *thread = profile_thread();
+  thread->current = profile_node(&thread->nodes, thread->current, name);
+  profile_node_t *node = PROFILE_NODE(thread->nodes, thread->current);
+  node->opened = profile_counters_read(thread, node->open);
+  return (llace_profile_zone_t){ .start = profile_now() };
+}
+
+void llace_profile_close(llace_profile_zone_t *zone) {
+  uint64_t duration = profile_now() - zone->start;
+  profile_thread_t *thread = profile_self;
+  if (!thread || profile_generation != __atomic_load_n(&profile.generation, __ATOMIC_ACQUIRE) || thread->current == 0) return;
+
+  profile_node_t *node = PROFILE_NODE(thread->nodes, thread->current);
+  profile_event_t event = { .name = node->name, .start = zone->start, .duration = duration };
+  if (node->opened && profile_counters_read(thread, event.counts)) {
+    event.mask = thread->mask;
+    for (size_t c = 0; c < PROFILE_COUNTERS; ++c) {
+      event.counts[c] -= node->open[c];
+      node->counts[c] += event.counts[c];
+    }
+    node->mask |= event.mask;
+  }
+  ++node->calls;
+  node->total += duration;
+  PROFILE_NODE(thread->nodes, node->parent)->children += duration;
+  LLACE_ARRAY_PUSHP(thread->events, &event);
+  thread->current = node->parent;
+}
+
+// ================ Profile ================ //
+
+void llace_profile_start(void) {
+  pthread_mutex_lock(&profile.lock);
+  for (profile_thread_t *thread = profile.threads, *next; thread; thread = next) {
+    next = thread->next;
+    LLACE_FREE_ARRAY(thread->nodes);
+    LLACE_FREE_ARRAY(thread->events);
+    profile_counters_close(thread);
+    free(thread);
+  }
+  profile.threads = NULL;
+  profile.next_id = 0;
+  profile.origin = profile_now();
+  __atomic_store_n(&profile.generation, profile.generation + 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&profile.lock);
+  __atomic_store_n(&llace_profile_active, true, __ATOMIC_RELEASE);
+}
+
+void llace_profile_stop(void) {
+  __atomic_store_n(&llace_profile_active, false, __ATOMIC_RELEASE);
+}
+
+static void profile_json_str(FILE *out, const char *str) {
+  fputc('"', out);
+  for (const char *p = str; *p; ++p) {
+    if (*p == '"' || *p == '\\') {
+      fprintf(out, "\\%c", *p);
+    } else if ((unsigned char)*p < 0x20) {
+      fprintf(out, "\\u%04x", (unsigned char)*p);
+    } else {
+      fputc(*p, out);
+    }
+  }
+  fputc('"', out);
+}
+
+llace_error_t llace_profile_write(FILE *out) {
+  if (!out) {
+    return LLACE_ERROR_BADARG;
+  }
+
+  pthread_mutex_lock(&profile.lock);
+  fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  bool first = true;
+  for (const profile_thread_t *thread = profile.threads; thread; thread = thread->next) {
+    fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"llace %zu\"}}", first ? "" : ",\n",
+            thread->id, thread->id);
+    first = false;
+    LLACE_ARRAY_FOREACH(profile_event_t, event, thread->events) {
+      fprintf(out, ",\n{\"name\":");
+      profile_json_str(out, event->name);
+      fprintf(out, ",\"cat\":\"llace\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f", thread->id,
+              (double)(event->start - profile.origin) / 1e3, (double)event->duration / 1e3);
+      const char *separator = ",\"args\":{";
+      for (size_t c = 0; c < PROFILE_COUNTERS; ++c) {
+        if (!(event->mask & (1u << c))) continue;
+        fprintf(out, "%s\"%s\":%llu", separator, profile_counter_names[c], (unsigned long long)event->counts[c]);
+        separator = ",";
+      }
+      fprintf(out, "%s}", event->mask ? "}" : "");
+    }
+  }
+  fprintf(out, "\n]}\n");
+  pthread_mutex_unlock(&profile.lock);
+
+  return ferror(out) ? LLACE_ERROR_IO : LLACE_ERROR_NONE;
+}
+
+// Adds a thread's subtree at from into the merged one at to
+static void profile_merge(const llace_array_t *nodes, size_t from, llace_array_t *merged, size_t to) {
+  for (size_t i = PROFILE_NODE(*nodes, from)->child; i != PROFILE_NONE; i = PROFILE_NODE(*nodes, i)->sibling) {
+    const profile_node_t *node = PROFILE_NODE(*nodes, i);
+    size_t into = profile_node(merged, to, node->name);
+    profile_node_t *target = PROFILE_NODE(*merged, into);
+    target->calls += node->calls;
+    target->total += node->total;
+    target->children += node->children;
+    target->mask |= node->mask;
+    for (size_t c = 0; c < PROFILE_COUNTERS; ++c) target->counts[c] += node->counts[c];
+    PROFILE_NODE(*merged, to)->total += to == 0 ? node->total : 0;
+    profile_merge(nodes, i, merged, into);
+  }
+}
+
+// Rows of the tree depth first, to out or to the log when out is NULL
+// The counter columns of mask, inclusive, '-' for what the zone has no count of
+static int profile_columns(char *row, size_t size, unsigned mask, const profile_node_t *node) {
+  int n = 0;
+  for (size_t c = 0; c < PROFILE_COUNTERS; ++c) {
+    if (!(mask & (1u << c))) continue;
+    if (node && node->mask & (1u << c)) {
+      n += snprintf(row + n, size - (size_t)n, " %14llu", (unsigned long long)node->counts[c]);
+    } else {
+      n += snprintf(row + n, size - (size_t)n, " %14s", node ? "-" : profile_counter_names[c]);
+    }
+  }
+  if ((mask & 3u) == 3u) {
+    if (!node) {
+      n += snprintf(row + n, size - (size_t)n, " %6s", "ipc");
+    } else if ((node->mask & 3u) == 3u && node->counts[0]) {
+      n += snprintf(row + n, size - (size_t)n, " %6.2f", (double)node->counts[1] / (double)node->counts[0]);
+    } else {
+      n += snprintf(row + n, size - (size_t)n, " %6s", "-");
+    }
+  }
+  return n;
+}
+
+static void profile_rows(FILE *out, const llace_array_t *merged, size_t index, int depth, uint64_t whole, unsigned mask) {
+  for (size_t i = PROFILE_NODE(*merged, index)->child; i != PROFILE_NONE; i = PROFILE_NODE(*merged, i)->sibling) {
+    const profile_node_t *node = PROFILE_NODE(*merged, i);
+    uint64_t self = node->total - node->children;
+    char row[256];
+    int n = snprintf(row, sizeof(row), "%*s%-*s %8zu %12.3f %12.3f %6.1f%%", depth * 2, "", 32 - depth * 2, node->name, node->calls,
+                     (double)node->total / 1e6, (double)self / 1e6, whole ? 100.0 * (double)node->total / (double)whole : 0.0);
+    profile_columns(row + n, sizeof(row) - (size_t)n, mask, node);
+    if (out) {
+      fprintf(out, "%s\n", row);
+    } else {
+      LLACE_LOG_INFO("%s", row);
+    }
+    profile_rows(out, merged, i, depth + 1, whole, mask);
+  }
+}
+
+static void profile_table(FILE *out) {
+  llace_array_t merged = profile_tree();
+  pthread_mutex_lock(&profile.lock);
+  for (const profile_thread_t *thread = profile.threads; thread; thread = thread->next) profile_merge(&thread->nodes, 0, &merged, 0);
+  pthread_mutex_unlock(&profile.lock);
+
+  unsigned mask = 0;
+  LLACE_ARRAY_FOREACH(profile_node_t, node, merged) mask |= node->mask;
+  char header[256];
+  int n = snprintf(header, sizeof(header), "%-32s %8s %12s %12s %7s", "zone", "calls", "total ms", "self ms", "of all");
+  profile_columns(header + n, sizeof(header) - (size_t)n, mask, NULL);
+  if (out) {
+    fprintf(out, "%s\n", header);
+  } else {
+    LLACE_LOG_INFO("%s", header);
+  }
+  profile_rows(out, &merged, 0, 0, PROFILE_NODE(merged, 0)->total, mask);
+  LLACE_FREE_ARRAY(merged);
+}
+
+void llace_profile_summary(FILE *out) {
+  if (out) profile_table(out);
+}
+
+void llace_profile_report(const llace_config_t *config) {
+  if (config && config->verbose) profile_table(NULL);
+}
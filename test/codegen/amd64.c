@@ -0,0 +1,104 @@
+#include "test.h"
+#include <llace/codegen/amd64/amd64.h>
+#include <string.h>
+#include <time.h>
+
+#define INST(mn, ...) { .mnemonic = LLACE_AMD64_##mn, .count = sizeof((llace_amd64_operand_t[]){ __VA_ARGS__ }) / sizeof(llace_amd64_operand_t), .ops = { __VA_ARGS__ } }
+#define INST0(mn) { .mnemonic = LLACE_AMD64_##mn }
+#define INSTCC(mn, cc, ...) { .mnemonic = LLACE_AMD64_##mn, .cond = LLACE_AMD64_CC_##cc, .count = 1, .ops = { __VA_ARGS__ } }
+
+#define GPR(r, bytes) LLACE_AMD64_GPR(LLACE_AMD64_##r, bytes)
+
+typedef struct {
+  llace_amd64_inst_t inst;
+  uint8_t size;
+  uint8_t bytes[LLACE_AMD64_MAX_INST];
+} amd64_case_t;
+
+// Checked against a disassembler. The operands are compound literals, each case builds its own table
+#define AMD64_CASES { \
+  { INST(ADD, GPR(RAX, 8), GPR(RBX, 8)), 3, { 0x48, 0x01, 0xD8 } }, \
+  { INST(ADD, GPR(RSP, 8), LLACE_AMD64_IMM(8)), 4, { 0x48, 0x83, 0xC4, 0x08 } }, \
+  { INST(SUB, GPR(RAX, 4), LLACE_AMD64_IMM(1000)), 6, { 0x81, 0xE8, 0xE8, 0x03, 0x00, 0x00 } }, \
+  { INST(MOV, GPR(RAX, 4), LLACE_AMD64_IMM(1)), 5, { 0xB8, 0x01, 0x00, 0x00, 0x00 } }, \
+  { INST(MOV, GPR(R12, 8), LLACE_AMD64_BASE(8, LLACE_AMD64_RSP, 8)), 5, { 0x4C, 0x8B, 0x64, 0x24, 0x08 } }, \
+  { INST(MOV, LLACE_AMD64_MEM(4, LLACE_AMD64_RBP, LLACE_AMD64_RCX, 4, 0), GPR(RDX, 4)), 4, { 0x89, 0x54, 0x8D, 0x00 } }, \
+  { INST(MOV, GPR(RSI, 1), GPR(RAX, 1)), 3, { 0x40, 0x88, 0xC6 } }, \
+  { INST(MOV, GPR(R9, 2), LLACE_AMD64_IMM(-2)), 6, { 0x66, 0x41, 0xC7, 0xC1, 0xFE, 0xFF } }, \
+  { INST(LEA, GPR(RAX, 8), LLACE_AMD64_RIPREL(0, 0x10)), 7, { 0x48, 0x8D, 0x05, 0x10, 0x00, 0x00, 0x00 } }, \
+  { INST(IMUL, GPR(RCX, 4), GPR(R13, 4), LLACE_AMD64_IMM(12)), 4, { 0x41, 0x6B, 0xCD, 0x0C } }, \
+  { INST(SHL, GPR(RDX, 8), LLACE_AMD64_GPR(LLACE_AMD64_RCX, 1)), 3, { 0x48, 0xD3, 0xE2 } }, \
+  { INSTCC(SETCC, E, GPR(RAX, 1)), 3, { 0x0F, 0x94, 0xC0 } }, \
+  { INST(PUSH, GPR(R12, 8)), 2, { 0x41, 0x54 } }, \
+  { INST0(RET), 1, { 0xC3 } }, \
+  { INST(MOVQ, LLACE_AMD64_VEC(1, 16), GPR(RAX, 8)), 5, { 0x66, 0x48, 0x0F, 0x6E, 0xC8 } }, \
+  { INST(ADDSD, LLACE_AMD64_VEC(0, 16), LLACE_AMD64_BASE(8, LLACE_AMD64_RDI, 0)), 4, { 0xF2, 0x0F, 0x58, 0x07 } }, \
+  { INST(VADDPS, LLACE_AMD64_VEC(0, 32), LLACE_AMD64_VEC(1, 32), LLACE_AMD64_VEC(2, 32)), 4, { 0xC5, 0xF4, 0x58, 0xC2 } }, \
+  { INST(VADDPS, LLACE_AMD64_VEC(8, 32), LLACE_AMD64_VEC(9, 32), LLACE_AMD64_BASE(32, LLACE_AMD64_R12, 0)), 6, { 0xC4, 0x41, 0x34, 0x58, 0x04, 0x24 } }, \
+  { INST(VADDPS, LLACE_AMD64_VEC(0, 64), LLACE_AMD64_VEC(1, 64), LLACE_AMD64_BASE(64, LLACE_AMD64_RAX, 64)), 7, { 0x62, 0xF1, 0x74, 0x48, 0x58, 0x40, 0x01 } }, \
+  { INST(VPADDQ, LLACE_AMD64_VEC(16, 16), LLACE_AMD64_VEC(17, 16), LLACE_AMD64_VEC(18, 16)), 6, { 0x62, 0xA1, 0xF5, 0x00, 0xD4, 0xC2 } }, \
+  { INST(VPSUBW, LLACE_AMD64_VEC(2, 32), LLACE_AMD64_VEC(3, 32), LLACE_AMD64_BASE(32, LLACE_AMD64_RDI, 0)), 4, { 0xC5, 0xE5, 0xF9, 0x17 } }, \
+  { INST(VPMULLW, LLACE_AMD64_VEC(1, 16), LLACE_AMD64_VEC(2, 16), LLACE_AMD64_VEC(3, 16)), 4, { 0xC5, 0xE9, 0xD5, 0xCB } }, \
+  { INST(VPBROADCASTB, LLACE_AMD64_VEC(0, 32), LLACE_AMD64_VEC(1, 16)), 5, { 0xC4, 0xE2, 0x7D, 0x78, 0xC1 } }, \
+  { INST(VPBROADCASTW, LLACE_AMD64_VEC(9, 16), LLACE_AMD64_BASE(2, LLACE_AMD64_RAX, 0)), 5, { 0xC4, 0x62, 0x79, 0x79, 0x08 } }, \
+}
+
+TEST(codegen_amd64_known, "Known encodings, a branch reports its offset for patching, unencodable operands are rejected") {
+  const amd64_case_t amd64_cases[] = AMD64_CASES;
+  const size_t case_count = sizeof(amd64_cases) / sizeof(amd64_cases[0]);
+  llace_codebuf_t buf;
+  llace_codebuf_init(&buf, 16);
+  bool passed = true;
+
+  for (size_t i = 0; i < case_count; ++i) {
+    buf.size = 0;
+    if (llace_amd64_encode(&buf, &amd64_cases[i].inst, NULL) != LLACE_ERROR_NONE || buf.size != amd64_cases[i].size ||
+        memcmp(buf.data, amd64_cases[i].bytes, buf.size) != 0) {
+      LLACE_LOG_ERROR("AMD64 encoding test failed: case %zu encoded %zu bytes", i, buf.size);
+      passed = false;
+    }
+  }
+
+  llace_amd64_inst_t jcc = INSTCC(JCC, NE, LLACE_AMD64_REL(-6));
+  llace_amd64_inst_t bad = INST(ADD, GPR(RAX, 8), GPR(RBX, 4));
+  llace_amd64_fixup_t fixup;
+  buf.size = 0;
+  llace_amd64_encode(&buf, &amd64_cases[0].inst, NULL);
+  llace_error_t err = llace_amd64_encode(&buf, &jcc, &fixup);
+  size_t size = buf.size;
+
+  if (passed && err == LLACE_ERROR_NONE && fixup.offset == 5 && fixup.end == 9 && buf.data[3] == 0x0F && buf.data[4] == 0x85 &&
+      llace_amd64_encode(&buf, &bad, NULL) == LLACE_ERROR_BADARG && buf.size == size) {
+    *test_passed = true;
+  } else {
+    LLACE_LOG_ERROR("AMD64 encoding test failed: fixup=%zu/%zu", fixup.offset, fixup.end);
+  }
+
+  llace_codebuf_free(&buf);
+}
+
+TEST(codegen_amd64_reserved, "Encoding into a preallocated buffer never grows it") {
+  const amd64_case_t amd64_cases[] = AMD64_CASES;
+  const size_t case_count = sizeof(amd64_cases) / sizeof(amd64_cases[0]);
+  const size_t rounds = 20000, count = rounds * case_count;
+  llace_codebuf_t buf;
+  llace_codebuf_init(&buf, count * LLACE_AMD64_MAX_INST);
+  uint8_t *data = buf.data;
+  size_t capacity = buf.capacity;
+  llace_error_t err = LLACE_ERROR_NONE;
+
+  clock_t start = clock();
+  for (size_t r = 0; r < rounds; ++r) {
+    for (size_t i = 0; i < case_count; ++i) err |= llace_amd64_encode(&buf, &amd64_cases[i].inst, NULL);
+  }
+  double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+  if (err == LLACE_ERROR_NONE && buf.data == data && buf.capacity == capacity) {
+    *test_passed = true;
+    LLACE_LOG_INFO("AMD64 encoder: %zu instructions, %zu bytes, %.1f M instructions/s", count, buf.size, seconds > 0 ? count / seconds / 1e6 : 0.0);
+  } else {
+    LLACE_LOG_ERROR("AMD64 throughput test failed: buffer grew to %zu bytes", buf.capacity);
+  }
+
+  llace_codebuf_free(&buf);
+}
@@ -0,0 +1,143 @@
+#define _POSIX_C_SOURCE 200809L // fileno
+#include "test.h"
+#include <llace/codegen/elf.h>
+#include <llace/codegen/amd64/amd64.h>
+#include <elf.h>
+#include <stdio.h>
+#include <string.h>
+
+// Reads the whole file back, NULL if it could not
+static uint8_t *elf_read(FILE *file, size_t *size) {
+  fflush(file);
+  fseek(file, 0, SEEK_END);
+  *size = (size_t)ftell(file);
+  rewind(file);
+  uint8_t *data = malloc(*size);
+  if (data && fread(data, 1, *size, file) != *size) { free(data); return NULL; }
+  return data;
+}
+
+static const Elf64_Shdr *elf_find(const uint8_t *data, const char *name) {
+  const Elf64_Ehdr *header = (const Elf64_Ehdr *)data;
+  const Elf64_Shdr *sections = (const Elf64_Shdr *)(data + header->e_shoff);
+  const char *names = (const char *)data + sections[header->e_shstrndx].sh_offset;
+  for (size_t i = 0; i < header->e_shnum; ++i) {
+    if (strcmp(names + sections[i].sh_name, name) == 0) return &sections[i];
+  }
+  return NULL;
+}
+
+TEST(codegen_elf_object, "A function calling out and addressing its data, read back as a linker would") {
+  llace_elf_t elf;
+  llace_elf_init(&elf);
+  llace_codebuf_t code;
+  llace_codebuf_init(&code, 64);
+  llace_amd64_fixup_t call, lea;
+  const llace_amd64_inst_t insts[] = {
+    { .mnemonic = LLACE_AMD64_CALL, .count = 1, .ops = { LLACE_AMD64_REL(0) } },
+    { .mnemonic = LLACE_AMD64_LEA, .count = 2, .ops = { LLACE_AMD64_GPR(LLACE_AMD64_RAX, 8), LLACE_AMD64_RIPREL(0, 0) } },
+    { .mnemonic = LLACE_AMD64_RET },
+  };
+  llace_amd64_encode(&code, &insts[0], &call);
+  llace_amd64_encode(&code, &insts[1], &lea);
+  llace_amd64_encode(&code, &insts[2], NULL);
+  static const char greeting[] = "hello";
+
+  size_t text, data, bss, ext, local, fn, offset;
+  llace_error_t err = llace_elf_section(&elf, ".text", LLACE_ELF_TEXT, 16, &text);
+  err |= llace_elf_section(&elf, ".data", LLACE_ELF_DATA, 8, &data);
+  err |= llace_elf_section(&elf, ".bss", LLACE_ELF_BSS, 64, &bss);
+  err |= llace_elf_append(&elf, text, code.data, code.size, NULL);
+  err |= llace_elf_append(&elf, data, greeting, sizeof(greeting), &offset);
+  err |= llace_elf_append(&elf, bss, NULL, 4096, NULL);
+  err |= llace_elf_symbol(&elf, "ext", LLACE_ELF_UNDEF, 0, 0, LLACE_ELF_NOTYPE, true, &ext);
+  err |= llace_elf_symbol(&elf, "fn", text, 0, code.size, LLACE_ELF_FUNC, true, &fn);
+  err |= llace_elf_symbol(&elf, "greeting", data, offset, sizeof(greeting), LLACE_ELF_OBJECT, false, &local);
+  err |= llace_elf_reloc(&elf, text, call.offset, ext, LLACE_ELF_R_PLT32, -4);
+  err |= llace_elf_reloc(&elf, text, lea.offset, local, LLACE_ELF_R_PC32, -4);
+
+  FILE *file = tmpfile();
+  size_t size = 0;
+  uint8_t *bytes = NULL;
+  if (err == LLACE_ERROR_NONE && file && llace_elf_write_fd(&elf, fileno(file)) == LLACE_ERROR_NONE) bytes = elf_read(file, &size);
+
+  bool passed = bytes && size == llace_elf_size(&elf) && memcmp(bytes, ELFMAG, SELFMAG) == 0;
+  const Elf64_Ehdr *header = (const Elf64_Ehdr *)bytes;
+  const Elf64_Shdr *stext = passed ? elf_find(bytes, ".text") : NULL, *srela = passed ? elf_find(bytes, ".rela.text") : NULL;
+  const Elf64_Shdr *ssym = passed ? elf_find(bytes, ".symtab") : NULL, *sbss = passed ? elf_find(bytes, ".bss") : NULL;
+  passed = passed && header->e_type == ET_REL && header->e_machine == EM_X86_64 && header->e_shnum == 9 && stext && srela && ssym && sbss;
+  passed = passed && stext->sh_size == code.size && memcmp(bytes + stext->sh_offset, code.data, code.size) == 0 && stext->sh_offset % 16 == 0;
+  passed = passed && sbss->sh_type == SHT_NOBITS && sbss->sh_size == 4096 && srela->sh_size == 2 * sizeof(Elf64_Rela);
+  if (passed) {
+    // The local comes first, relocations follow the symbols to their new indices
+    const Elf64_Sym *syms = (const Elf64_Sym *)(bytes + ssym->sh_offset);
+    const char *names = (const char *)bytes + ((const Elf64_Shdr *)(bytes + header->e_shoff))[ssym->sh_link].sh_offset;
+    const Elf64_Rela *relas = (const Elf64_Rela *)(bytes + srela->sh_offset);
+    passed = ssym->sh_info == 2 && strcmp(names + syms[1].st_name, "greeting") == 0 && ELF64_ST_BIND(syms[1].st_info) == STB_LOCAL &&
+             strcmp(names + syms[2].st_name, "ext") == 0 && syms[2].st_shndx == SHN_UNDEF &&
+             strcmp(names + syms[3].st_name, "fn") == 0 && ELF64_ST_TYPE(syms[3].st_info) == STT_FUNC &&
+             ELF64_R_SYM(relas[0].r_info) == 2 && ELF64_R_TYPE(relas[0].r_info) == R_X86_64_PLT32 && relas[0].r_offset == call.offset &&
+             ELF64_R_SYM(relas[1].r_info) == 1 && ELF64_R_TYPE(relas[1].r_info) == R_X86_64_PC32 && relas[1].r_addend == -4;
+  }
+
+  if (passed) {
+    *test_passed = true;
+  } else {
+    LLACE_LOG_ERROR("ELF object test failed: err=%d size=%zu/%zu", err, size, llace_elf_size(&elf));
+  }
+  free(bytes);
+  if (file) fclose(file);
+  llace_codebuf_free(&code);
+  llace_elf_free(&elf);
+}
+
+TEST(codegen_elf_stream, "Many chunks and a large one stream through in order, mistakes are rejected") {
+  llace_elf_t elf;
+  llace_elf_init(&elf);
+  const size_t large = 16 << 20, small = 5000;
+  uint8_t *blob = malloc(large);
+  uint32_t *words = malloc(small * 2 * sizeof(uint32_t));
+  for (size_t i = 0; i < large; ++i) blob[i] = (uint8_t)(i * 31);
+  for (size_t i = 0; i < small * 2; ++i) words[i] = (uint32_t)i;
+
+  size_t data, rodata, sym;
+  llace_error_t err = llace_elf_section(&elf, ".data", LLACE_ELF_DATA, 4, &data);
+  err |= llace_elf_section(&elf, ".rodata", LLACE_ELF_RODATA, 4096, &rodata);
+  for (size_t i = 0; i < small; ++i) err |= llace_elf_append(&elf, data, &words[2 * i], sizeof(uint32_t), NULL); // never contiguous
+  err |= llace_elf_append(&elf, rodata, blob, large, NULL);
+  err |= llace_elf_symbol(&elf, "blob", rodata, 0, large, LLACE_ELF_OBJECT, true, &sym);
+
+  bool rejected = llace_elf_section(&elf, ".bad", LLACE_ELF_DATA, 3, NULL) == LLACE_ERROR_BADALLIGN &&
+                  llace_elf_section(&elf, ".data", LLACE_ELF_DATA, 4, NULL) == LLACE_ERROR_INVLSECT &&
+                  llace_elf_symbol(&elf, "blob", data, 0, 0, LLACE_ELF_OBJECT, true, NULL) == LLACE_ERROR_SYMDUP &&
+                  llace_elf_symbol(&elf, "gone", LLACE_ELF_UNDEF, 0, 0, LLACE_ELF_NOTYPE, false, NULL) == LLACE_ERROR_INVLSYM &&
+                  llace_elf_reloc(&elf, data, small * 4 - 2, sym, LLACE_ELF_R_32, 0) == LLACE_ERROR_INVLREL &&
+                  llace_elf_reloc(&elf, data, 0, 7, LLACE_ELF_R_32, 0) == LLACE_ERROR_SYM404 &&
+                  llace_elf_append(&elf, data, NULL, 4, NULL) == LLACE_ERROR_INVLSECT;
+
+  FILE *file = tmpfile();
+  size_t size = 0;
+  uint8_t *bytes = NULL;
+  if (err == LLACE_ERROR_NONE && file && llace_elf_write_fd(&elf, fileno(file)) == LLACE_ERROR_NONE) bytes = elf_read(file, &size);
+
+  bool passed = bytes && size == llace_elf_size(&elf);
+  const Elf64_Shdr *sdata = passed ? elf_find(bytes, ".data") : NULL, *srodata = passed ? elf_find(bytes, ".rodata") : NULL;
+  passed = passed && sdata && srodata && sdata->sh_size == small * 4 && srodata->sh_size == large && srodata->sh_offset % 4096 == 0 &&
+           memcmp(bytes + srodata->sh_offset, blob, large) == 0;
+  for (size_t i = 0; passed && i < small; ++i) {
+    uint32_t word;
+    memcpy(&word, bytes + sdata->sh_offset + 4 * i, sizeof(word));
+    passed = word == 2 * i;
+  }
+
+  if (passed && rejected) {
+    *test_passed = true;
+  } else {
+    LLACE_LOG_ERROR("ELF streaming test failed: err=%d rejected=%d size=%zu", err, rejected, size);
+  }
+  free(bytes);
+  if (file) fclose(file);
+  free(blob);
+  free(words);
+  llace_elf_free(&elf);
+}
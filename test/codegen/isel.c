@@ -0,0 +1,133 @@
+#include "test.h"
+#include <llace/ir.h>
+#include <llace/codegen/isel.h>
+#include <llace/codegen/amd64/amd64.h>
+#include <string.h>
+
+// The compare meets its branch, the index and load fold into the add
+static const char *isel_loop =
+  "#sum(i32* %a, i32 %n) i32 {\n"
+  "  @entry: { i32(0) %i0 = i32(0) %s0 = @head jmp }\n"
+  "  @head: {\n"
+  "    %i0 @entry %i1 @body phi/2/1 %i =\n"
+  "    %s0 @entry %s1 @body phi/2/1 %s =\n"
+  "    %i %n < %c = %c @body @exit branch\n"
+  "  }\n"
+  "  @body: {\n"
+  "    %a %i index load %x =\n"
+  "    %s %x + %s1 =\n"
+  "    %i i32(1) + %i1 =\n"
+  "    @head jmp\n"
+  "  }\n"
+  "  @exit: { %s ret/1 }\n"
+  "}\n";
+
+// Division, shifts, calls, globals, floats and stores, all at once
+static const char *isel_mixed =
+  "$g i64\n"
+  "$f f52.11\n"
+  "#sq(i64 %x) i64 { @entry: { %x %x * ret/1 } }\n"
+  "#mixed(i64 %a, i64 %b) i64 {\n"
+  "  @entry: {\n"
+  "    %a i64(7) / %q = %a i64(7) % %r = %q %r * %b i64(3) << + %t =\n"
+  "    %t sq %s = %s $g store $g load i64(5) + $g store\n"
+  "    $f load f52.11(2.0) * %y = %y $f store\n"
+  "    %y f52.11(2.5) > @big @small branch\n"
+  "  }\n"
+  "  @big: { %s %t + %a sq + ret/1 }\n"
+  "  @small: { %t %b - ret/1 }\n"
+  "}\n";
+
+static const uint8_t isel_tiny_gprs[] = { LLACE_AMD64_RBX, LLACE_AMD64_R12 };
+static const uint8_t isel_tiny_vecs[] = { 0, 1 };
+
+// Stack values of the function, every one worth an instruction at most
+static size_t isel_values(const llace_ir_function_t *fn) {
+  size_t values = 0;
+  LLACE_ARRAY_FOREACH(llace_ir_basicblock_t, block, fn->blocks) values += LLACE_ARRAY_COUNT(block->stack);
+  return values;
+}
+
+TEST(codegen_isel_fold, "Folded compares branch on the flags and loads become memory operands") {
+  llace_ir_context_t ctx;
+  llace_ir_context_init(&ctx);
+  llace_regalloc_t ra = {0};
+  llace_amd64_code_t code = {0};
+  size_t index, folded = 0;
+
+  if (llace_ir_parse(&ctx, isel_loop, strlen(isel_loop)) != LLACE_ERROR_NONE || !llace_ir_function_find(&ctx, "sum", &index)) {
+    LLACE_LOG_ERROR("Instruction selection loop test failed: example did not parse");
+  } else {
+    llace_ir_function_t *fn = LLACE_IR_FUNCTION(&ctx, index);
+    llace_error_t err = llace_isel_fold(fn, &folded);
+    if (err == LLACE_ERROR_NONE) err = llace_regalloc_linear(&ctx, fn, llace_amd64_regset(), &ra);
+    if (err == LLACE_ERROR_NONE) err = llace_amd64_select(&ctx, fn, &ra, &code);
+
+    size_t branches = 0, setccs = 0, sibs = 0;
+    for (size_t i = 0; err == LLACE_ERROR_NONE && i < LLACE_ARRAY_COUNT(code.insts); ++i) {
+      const llace_amd64_inst_t *inst = &LLACE_ARRAY_GET(llace_amd64_minst_t, code.insts, i)->inst;
+      const llace_amd64_inst_t *prev = i > 0 ? &LLACE_ARRAY_GET(llace_amd64_minst_t, code.insts, i - 1)->inst : NULL;
+      if (inst->mnemonic == LLACE_AMD64_JCC && prev && prev->mnemonic == LLACE_AMD64_CMP) ++branches;
+      if (inst->mnemonic == LLACE_AMD64_SETCC) ++setccs;
+      if (inst->mnemonic == LLACE_AMD64_ADD && inst->ops[1].kind == LLACE_AMD64_OPND_MEM && inst->ops[1].index != LLACE_AMD64_NOREG &&
+          inst->ops[1].scale == 4) {
+        ++sibs;
+      }
+    }
+
+    if (err == LLACE_ERROR_NONE && folded == 2 && branches == 1 && setccs == 0 && sibs == 1) {
+      *test_passed = true;
+    } else {
+      LLACE_LOG_ERROR("Instruction selection loop test failed: err=%d folded=%zu branches=%zu setcc=%zu sib=%zu", err, folded, branches, setccs, sibs);
+    }
+    llace_amd64_code_free(&code);
+    llace_regalloc_free(&ra);
+  }
+
+  llace_ir_context_free(&ctx);
+}
+
+TEST(codegen_isel_encode, "Every selected instruction encodes, with all registers and with two per class") {
+  llace_ir_context_t ctx;
+  llace_ir_context_init(&ctx);
+  llace_regset_t tiny = *llace_amd64_regset();
+  tiny.regs[LLACE_REGCLASS_GPR] = isel_tiny_gprs;
+  tiny.count[LLACE_REGCLASS_GPR] = 2;
+  tiny.regs[LLACE_REGCLASS_VEC] = isel_tiny_vecs;
+  tiny.count[LLACE_REGCLASS_VEC] = 2;
+  const llace_regset_t *regsets[] = { llace_amd64_regset(), &tiny };
+  size_t index;
+
+  if (llace_ir_parse(&ctx, isel_mixed, strlen(isel_mixed)) != LLACE_ERROR_NONE || !llace_ir_function_find(&ctx, "mixed", &index)) {
+    LLACE_LOG_ERROR("Instruction selection encoding test failed: example did not parse");
+  } else {
+    llace_ir_function_t *fn = LLACE_IR_FUNCTION(&ctx, index);
+    llace_codebuf_t buf;
+    llace_codebuf_init(&buf, 1024);
+    llace_error_t err = llace_isel_fold(fn, NULL);
+    size_t values = isel_values(fn), cost = 0, spilled = 0, bad = 0;
+
+    for (size_t r = 0; err == LLACE_ERROR_NONE && r < 2; ++r) {
+      llace_regalloc_t ra = {0};
+      llace_amd64_code_t code = {0};
+      err = llace_regalloc_linear(&ctx, fn, regsets[r], &ra);
+      if (err == LLACE_ERROR_NONE) err = llace_amd64_select(&ctx, fn, &ra, &code);
+      LLACE_ARRAY_FOREACH(llace_amd64_minst_t, minst, code.insts) {
+        if (llace_amd64_encode(&buf, &minst->inst, NULL) != LLACE_ERROR_NONE) ++bad;
+      }
+      if (code.cost > cost) cost = code.cost;
+      spilled += ra.stats.spilled;
+      llace_amd64_code_free(&code);
+      llace_regalloc_free(&ra);
+    }
+
+    if (err == LLACE_ERROR_NONE && bad == 0 && spilled > 0 && cost < values) {
+      *test_passed = true;
+    } else {
+      LLACE_LOG_ERROR("Instruction selection encoding test failed: err=%d unencodable=%zu spilled=%zu cost=%zu/%zu", err, bad, spilled, cost, values);
+    }
+    llace_codebuf_free(&buf);
+  }
+
+  llace_ir_context_free(&ctx);
+}
@@ -0,0 +1,216 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+#include "test.h"
+#include <llace/ir.h>
+#include <llace/codegen/jit.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Recursion, mutual recursion, globals with initial values, floats
+static const char *jit_module =
+  "$count i64(100)\n"
+  "$scale f52.11(1.5)\n"
+  "#fib(i64 %n) i64 {\n"
+  "  @entry: { %n i64(2) < @base @rec branch }\n"
+  "  @base: { %n ret/1 }\n"
+  "  @rec: { %n i64(1) - fib %n i64(2) - fib + ret/1 }\n"
+  "}\n"
+  "#even(i64 %n) i64 {\n"
+  "  @entry: { %n i64(0) == @yes @no branch }\n"
+  "  @yes: { i64(1) ret/1 }\n"
+  "  @no: { %n i64(1) - odd ret/1 }\n"
+  "}\n"
+  "#odd(i64 %n) i64 {\n"
+  "  @entry: { %n i64(0) == @yes @no branch }\n"
+  "  @yes: { i64(0) ret/1 }\n"
+  "  @no: { %n i64(1) - even ret/1 }\n"
+  "}\n"
+  "#tick(i64 %n) i64 {\n"
+  "  @entry: { $count load %n + $count store $scale load f52.11(2.0) * $scale store $count load ret/1 }\n"
+  "}\n";
+
+// Vector statements run lane by lane: splat, load<n>, store<n>, pack and extract
+static const char *jit_vector =
+  "#axpy(i32* %x, i32* %y, i32 %k) void {\n"
+  "  @entry: { %k splat<4> %kv = %x load<4> %kv * %y load<4> + %y store<4> ret/0 }\n"
+  "}\n"
+  "#rev(i32* %p, i32* %q) i32 {\n"
+  "  @entry: {\n"
+  "    %p i32(3) index load %p i32(2) index load %p i32(1) index load %p load pack<4> %r =\n"
+  "    %r %q store<4> %r i32(0) extract %r i32(3) extract - ret/1\n"
+  "  }\n"
+  "}\n";
+
+typedef int64_t (*jit_fn_t)(int64_t);
+typedef void (*jit_axpy_t)(int32_t *, int32_t *, int32_t);
+typedef int32_t (*jit_rev_t)(int32_t *, int32_t *);
+
+// Code pointers come back as data pointers
+static jit_fn_t jit_fn(void *entry) {
+  jit_fn_t fn;
+  memcpy(&fn, &entry, sizeof(fn));
+  return fn;
+}
+
+// Permissions of the mapping holding addr, "" if there is none
+static void jit_perms(const void *addr, char perms[5]) {
+  perms[0] = 0;
+  FILE *maps = fopen("/proc/self/maps", "r");
+  if (maps == NULL) return;
+  char line[512];
+  while (fgets(line, sizeof(line), maps)) {
+    unsigned long long from, to;
+    char p[5];
+    if (sscanf(line, "%llx-%llx %4s", &from, &to, p) == 3 && (uintptr_t)addr >= from && (uintptr_t)addr < to) {
+      memcpy(perms, p, 5);
+      break;
+    }
+  }
+  fclose(maps);
+}
+
+TEST(codegen_jit_run, "Compiled functions run, call each other and share globals, code is never writable") {
+  llace_ir_context_t ctx;
+  llace_ir_context_init(&ctx);
+  llace_jit_t jit;
+  size_t fib, even, tick, count, scale;
+
+  if (llace_ir_parse(&ctx, jit_module, strlen(jit_module)) != LLACE_ERROR_NONE || !llace_ir_function_find(&ctx, "fib", &fib) ||
+      !llace_ir_function_find(&ctx, "even", &even) || !llace_ir_function_find(&ctx, "tick", &tick) ||
+      !llace_ir_global_find(&ctx, "count", &count) || !llace_ir_global_find(&ctx, "scale", &scale)) {
+    LLACE_LOG_ERROR("JIT execution test failed: example did not parse");
+  } else if (llace_jit_init(&jit, &ctx, NULL) != LLACE_ERROR_NONE) {
+    LLACE_LOG_ERROR("JIT execution test failed: no address space");
+  } else {
+    void *fib_code = NULL, *even_code = NULL, *tick_code = NULL;
+    llace_error_t err = llace_jit_add(&jit, fib, &fib_code);
+    err |= llace_jit_add(&jit, even, &even_code);
+    err |= llace_jit_add(&jit, tick, &tick_code);
+
+    int64_t fib20 = 0, even7 = -1, even10 = -1, ticked = 0;
+    double *scaled = llace_jit_global(&jit, scale);
+    if (err == LLACE_ERROR_NONE) {
+      fib20 = jit_fn(fib_code)(20);
+      even7 = jit_fn(even_code)(7);
+      even10 = jit_fn(even_code)(10);
+      jit_fn(tick_code)(5);
+      ticked = jit_fn(tick_code)(7);
+    }
+    char perms[5];
+    jit_perms(fib_code, perms);
+
+    // even pulled odd in with it
+    if (err == LLACE_ERROR_NONE && fib20 == 6765 && even7 == 0 && even10 == 1 && ticked == 112 && *(int64_t *)llace_jit_global(&jit, count) == 112 &&
+        scaled && *scaled == 6.0 && jit.stats.functions == 4 && strncmp(perms, "r-x", 3) == 0) {
+      *test_passed = true;
+    } else {
+      LLACE_LOG_ERROR("JIT execution test failed: err=%d fib=%lld even=%lld/%lld tick=%lld perms=%s", err, (long long)fib20, (long long)even7,
+                      (long long)even10, (long long)ticked, perms);
+    }
+    llace_jit_free(&jit);
+  }
+
+  llace_ir_context_free(&ctx);
+}
+
+TEST(codegen_jit_regions, "Removed code gives its pages back, a new function reuses them, first calls are quick") {
+  llace_ir_context_t ctx;
+  llace_ir_context_init(&ctx);
+  llace_jit_t jit;
+  size_t fib, tick;
+
+  if (llace_ir_parse(&ctx, jit_module, strlen(jit_module)) != LLACE_ERROR_NONE || !llace_ir_function_find(&ctx, "fib", &fib) ||
+      !llace_ir_function_find(&ctx, "tick", &tick)) {
+    LLACE_LOG_ERROR("JIT region test failed: example did not parse");
+  } else if (llace_jit_init(&jit, &ctx, NULL) != LLACE_ERROR_NONE) {
+    LLACE_LOG_ERROR("JIT region test failed: no address space");
+  } else {
+    void *first = NULL, *second = NULL, *again = NULL;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    llace_error_t err = llace_jit_add(&jit, fib, &first);
+    int64_t fib10 = err == LLACE_ERROR_NONE ? jit_fn(first)(10) : 0;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double micros = (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3;
+
+    size_t pages = jit.stats.pages;
+    err |= llace_jit_remove(&jit, fib);
+    size_t released = jit.stats.pages;
+    char perms[5];
+    jit_perms(first, perms);
+    err |= llace_jit_add(&jit, tick, &second);
+    err |= llace_jit_add(&jit, fib, &again);
+    bool removed_twice = llace_jit_remove(&jit, fib) == LLACE_ERROR_NONE && llace_jit_remove(&jit, fib) == LLACE_ERROR_BADARG;
+
+    if (err == LLACE_ERROR_NONE && fib10 == 55 && released < pages && strncmp(perms, "---", 3) == 0 && second == first && removed_twice) {
+      *test_passed = true;
+      LLACE_LOG_INFO("JIT: compile and first call of fib in %.1f us", micros);
+    } else {
+      LLACE_LOG_ERROR("JIT region test failed: err=%d fib=%lld pages=%zu/%zu perms=%s reused=%d", err, (long long)fib10, released, pages, perms,
+                      second == first);
+    }
+    llace_jit_free(&jit);
+  }
+
+  llace_ir_context_free(&ctx);
+}
+
+// Runs axpy and rev compiled for the target, false if they compute anything else
+static bool jit_vector_run(const llace_config_t *config, size_t *vector) {
+  llace_ir_context_t ctx;
+  llace_ir_context_init(&ctx);
+  llace_jit_t jit;
+  size_t axpy, rev;
+  bool ok = false;
+
+  if (llace_ir_parse(&ctx, jit_vector, strlen(jit_vector)) != LLACE_ERROR_NONE || !llace_ir_function_find(&ctx, "axpy", &axpy) ||
+      !llace_ir_function_find(&ctx, "rev", &rev)) {
+    LLACE_LOG_ERROR("JIT vector test failed: example did not parse");
+  } else if (llace_jit_init(&jit, &ctx, config) != LLACE_ERROR_NONE) {
+    LLACE_LOG_ERROR("JIT vector test failed: no address space");
+  } else {
+    void *axpy_code = NULL, *rev_code = NULL;
+    llace_error_t err = llace_jit_add(&jit, axpy, &axpy_code);
+    err |= llace_jit_add(&jit, rev, &rev_code);
+
+    int32_t x[5] = { 1, 2, 3, 4, 5 }, y[5] = { 10, 20, 30, 40, 50 }, p[4] = { 7, 8, 9, 10 }, q[4] = {0};
+    int32_t diff = 0;
+    if (err == LLACE_ERROR_NONE) {
+      jit_axpy_t axpy_fn;
+      jit_rev_t rev_fn;
+      memcpy(&axpy_fn, &axpy_code, sizeof(axpy_fn));
+      memcpy(&rev_fn, &rev_code, sizeof(rev_fn));
+      axpy_fn(x, y, 3);
+      diff = rev_fn(p, q);
+    }
+
+    // The fifth element is past the vector
+    ok = err == LLACE_ERROR_NONE && y[0] == 13 && y[1] == 26 && y[2] == 39 && y[3] == 52 && y[4] == 50 &&
+         q[0] == 10 && q[1] == 9 && q[2] == 8 && q[3] == 7 && diff == 3;
+    if (!ok) {
+      LLACE_LOG_ERROR("JIT vector test failed: err=%d y=%d,%d,%d,%d,%d q=%d,%d,%d,%d diff=%d", err, y[0], y[1], y[2], y[3], y[4], q[0], q[1], q[2],
+                      q[3], diff);
+      llace_ir_print(&ctx, stdout);
+    }
+    *vector = jit.stats.vector;
+    llace_jit_free(&jit);
+  }
+
+  llace_ir_context_free(&ctx);
+  return ok;
+}
+
+TEST(codegen_jit_vector, "Vector statements select VEX instructions with AVX2, are scalarized without") {
+  llace_config_t sse;
+  llace_config_init(&sse);
+  bool avx2 = sse.target.features & LLACE_FEATURE_AVX2; // the host's, which NULL configures
+  sse.target.features = LLACE_FEATURE_SSE2;
+  size_t host_vector = 0, sse_vector = 0;
+  bool host = jit_vector_run(NULL, &host_vector), plain = jit_vector_run(&sse, &sse_vector);
+
+  if (host && plain && sse_vector == 0 && (host_vector > 0) == avx2) {
+    *test_passed = true;
+  } else {
+    LLACE_LOG_ERROR("JIT vector test failed: host=%d/%zu sse=%d/%zu avx2=%d", host, host_vector, plain, sse_vector, avx2);
+  }
+}
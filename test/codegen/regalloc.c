@@ -0,0 +1,227 @@
+#include "test.h"
+#include <llace/ir.h>
+#include <llace/codegen/amd64/amd64.h>
+#include <string.h>
+
+// The phis and their inputs can share registers, nothing needs to be spilled
+static const char *ra_loop =
+  "#f(i32 %n, i32 %a, i32 %b) i32 {\n"
+  "  @entry: { i32(0) %i0 = i32(0) %s0 = @head jmp }\n"
+  "  @head: {\n"
+  "    %i0 @entry %i1 @body phi/2/1 %i =\n"
+  "    %s0 @entry %s1 @body phi/2/1 %s =\n"
+  "    %i %n < %c = %c @body @exit branch\n"
+  "  }\n"
+  "  @body: {\n"
+  "    %a %b * %ab =\n"
+  "    %s %ab + %s1 =\n"
+  "    %i i32(1) + %i1 =\n"
+  "    @head jmp\n"
+  "  }\n"
+  "  @exit: { %s ret/1 }\n"
+  "}\n";
+
+// Six values live across the loop, more than the three registers of the test set
+static const char *ra_pressure =
+  "#g(i32 %n, i32 %a, i32 %b) i32 {\n"
+  "  @entry: {\n"
+  "    %a %b + %x1 = %a %b * %x2 = %a %b - %x3 = %x1 %x2 + %x4 = %x2 %x3 * %x5 =\n"
+  "    i32(0) %i0 = @head jmp\n"
+  "  }\n"
+  "  @head: {\n"
+  "    %i0 @entry %i1 @body phi/2/1 %i =\n"
+  "    %i %n < %c = %c @body @exit branch\n"
+  "  }\n"
+  "  @body: { %i %x1 + %i1 = @head jmp }\n"
+  "  @exit: { %x1 %x2 + %x3 + %x4 + %x5 + %i + ret/1 }\n"
+  "}\n";
+
+static const uint8_t ra_tiny_gprs[] = { 0, 1, 2 };
+
+static const llace_regset_t ra_tiny = {
+  .regs = { ra_tiny_gprs, NULL },
+  .count = { 3, 0 },
+  .scratch = { 3, 0 },
+};
+
+// No two variables share a register at once and every read finds its variable somewhere
+static bool ra_valid(const llace_ir_function_t *fn, const llace_regalloc_t *ra) {
+  for (size_t v = 0; v < LLACE_ARRAY_COUNT(ra->segments); ++v) {
+    for (size_t w = v + 1; w < LLACE_ARRAY_COUNT(ra->segments); ++w) {
+      LLACE_ARRAY_FOREACH(llace_ra_segment_t, a, *LLACE_RA_SEGMENTS(ra, v)) {
+        LLACE_ARRAY_FOREACH(llace_ra_segment_t, b, *LLACE_RA_SEGMENTS(ra, w)) {
+          if (a->loc.kind == LLACE_LOC_REG && llace_loc_eq(a->loc, b->loc) && a->from < b->to && b->from < a->to) return false;
+        }
+      }
+    }
+  }
+
+  llace_array_t stmts = LLACE_NEW_ARRAY(llace_ir_stmt_t, 8);
+  bool valid = true;
+  LLACE_ARRAY_FOREACH(size_t, b, ra->order) {
+    const llace_ir_basicblock_t *block = LLACE_IR_BLOCK_AT(fn, *b);
+    llace_ir_block_stmts(block, &stmts);
+    for (size_t k = 0; k < LLACE_ARRAY_COUNT(stmts); ++k) {
+      const llace_ir_stmt_t *stmt = LLACE_ARRAY_GET(llace_ir_stmt_t, stmts, k);
+      const llace_ir_value_t *last = LLACE_IR_STACK_AT(block, stmt->end - 1);
+      if (stmt->end - stmt->begin >= 3 && LLACE_IR_IS_OP(last - 2, LLACE_IR_OP_PHI)) continue;
+      for (size_t i = stmt->begin; i < stmt->end; ++i) {
+        const llace_ir_value_t *value = LLACE_IR_STACK_AT(block, i);
+        if (value->kind != LLACE_IR_VALUE_VAR || (i + 2 == stmt->end && LLACE_IR_IS_OP(last, LLACE_IR_OP_ASSIGN))) continue;
+        if (llace_regalloc_loc(ra, value->var, LLACE_RA_STMT_POS(ra, *b, k)).kind == LLACE_LOC_NONE) valid = false;
+      }
+    }
+  }
+  LLACE_FREE_ARRAY(stmts);
+  return valid;
+}
+
+// A part of a split variable starting inside a block in another place gets a move there
+static bool ra_stored(const llace_regalloc_t *ra) {
+  for (size_t v = 0; v < LLACE_ARRAY_COUNT(ra->segments); ++v) {
+    const llace_array_t *segments = LLACE_RA_SEGMENTS(ra, v);
+    for (size_t s = 1; s < LLACE_ARRAY_COUNT(*segments); ++s) {
+      const llace_ra_segment_t *a = LLACE_ARRAY_GET(llace_ra_segment_t, *segments, s - 1), *b = a + 1;
+      if (a->to != b->from || llace_loc_eq(a->loc, b->loc)) continue;
+      bool entry = false;
+      LLACE_ARRAY_FOREACH(size_t, from, ra->from) entry |= *from == b->from;
+      if (entry) continue;
+
+      bool moved = false;
+      LLACE_ARRAY_FOREACH(llace_ra_moves_t, group, ra->groups) {
+        if (group->position != b->from) continue;
+        for (size_t m = group->first; m < group->first + group->count; ++m) {
+          const llace_ra_move_t *move = LLACE_ARRAY_GET(llace_ra_move_t, ra->moves, m);
+          moved |= move->var == v && llace_loc_eq(move->to, b->loc);
+        }
+      }
+      if (!moved) return false;
+    }
+  }
+  return true;
+}
+
+TEST(codegen_regalloc_loop, "A loop fits the amd64 registers") {
+  llace_ir_context_t ctx;
+  llace_ir_context_init(&ctx);
+  llace_regalloc_t ra = {0};
+  size_t index;
+
+  if (llace_ir_parse(&ctx, ra_loop, strlen(ra_loop)) != LLACE_ERROR_NONE || !llace_ir_function_find(&ctx, "f", &index)) {
+    LLACE_LOG_ERROR("Register allocation loop test failed: example did not parse");
+  } else {
+    llace_ir_function_t *fn = LLACE_IR_FUNCTION(&ctx, index);
+    llace_error_t err = llace_regalloc_linear(&ctx, fn, llace_amd64_regset(), &ra);
+
+    if (err == LLACE_ERROR_NONE && ra.stats.spilled == 0 && ra.stats.reloads == 0 && ra.stats.coalesced >= 2 && ra_valid(fn, &ra)) {
+      *test_passed = true;
+    } else {
+      LLACE_LOG_ERROR("Register allocation loop test failed: spilled=%zu reloads=%zu coalesced=%zu", ra.stats.spilled, ra.stats.reloads, ra.stats.coalesced);
+    }
+    llace_regalloc_free(&ra);
+  }
+
+  llace_ir_context_free(&ctx);
+}
+
+TEST(codegen_regalloc_spill, "Pressure above the register count spills into shared slots") {
+  llace_ir_context_t ctx;
+  llace_ir_context_init(&ctx);
+  llace_regalloc_t ra = {0};
+  size_t index;
+
+  if (llace_ir_parse(&ctx, ra_pressure, strlen(ra_pressure)) != LLACE_ERROR_NONE || !llace_ir_function_find(&ctx, "g", &index)) {
+    LLACE_LOG_ERROR("Register allocation pressure test failed: example did not parse");
+  } else {
+    llace_ir_function_t *fn = LLACE_IR_FUNCTION(&ctx, index);
+    llace_error_t err = llace_regalloc_linear(&ctx, fn, &ra_tiny, &ra);
+
+    if (err == LLACE_ERROR_NONE && ra.stats.spilled > 0 && ra.stats.slots <= ra.stats.spilled && ra.stats.reloads > 0 && ra_valid(fn, &ra)) {
+      *test_passed = true;
+    } else {
+      LLACE_LOG_ERROR("Register allocation pressure test failed: spilled=%zu slots=%zu reloads=%zu", ra.stats.spilled, ra.stats.slots, ra.stats.reloads);
+    }
+    llace_regalloc_free(&ra);
+  }
+
+  llace_ir_context_free(&ctx);
+}
+
+TEST(codegen_regalloc_evict, "Values evicted by a definition are stored before it, splits land between statements") {
+  llace_ir_context_t ctx;
+  llace_ir_context_init(&ctx);
+  llace_regalloc_t ra = {0};
+  size_t index;
+
+  if (llace_ir_parse(&ctx, ra_pressure, strlen(ra_pressure)) != LLACE_ERROR_NONE || !llace_ir_function_find(&ctx, "g", &index)) {
+    LLACE_LOG_ERROR("Register allocation eviction test failed: example did not parse");
+  } else {
+    llace_error_t err = llace_regalloc_linear(&ctx, LLACE_IR_FUNCTION(&ctx, index), &ra_tiny, &ra);
+    size_t odd = 0;
+    LLACE_ARRAY_FOREACH(llace_array_t, segments, ra.segments) {
+      for (size_t s = 1; s < LLACE_ARRAY_COUNT(*segments); ++s) odd += LLACE_ARRAY_GET(llace_ra_segment_t, *segments, s)->from % 2;
+    }
+
+    if (err == LLACE_ERROR_NONE && ra.stats.spill_stores > 0 && odd == 0 && ra_stored(&ra)) {
+      *test_passed = true;
+    } else {
+      LLACE_LOG_ERROR("Register allocation eviction test failed: stores=%zu odd splits=%zu", ra.stats.spill_stores, odd);
+    }
+    llace_regalloc_free(&ra);
+  }
+
+  llace_ir_context_free(&ctx);
+}
+
+TEST(codegen_regalloc_color, "Coloring through the config keeps the loop in registers") {
+  llace_ir_context_t ctx;
+  llace_ir_context_init(&ctx);
+  llace_config_t config;
+  llace_config_init(&config);
+  config.regalloc = LLACE_REGALLOC_COLOR;
+  llace_regalloc_t ra = {0};
+  size_t index;
+
+  if (llace_ir_parse(&ctx, ra_loop, strlen(ra_loop)) != LLACE_ERROR_NONE || !llace_ir_function_find(&ctx, "f", &index)) {
+    LLACE_LOG_ERROR("Register coloring loop test failed: example did not parse");
+  } else {
+    llace_ir_function_t *fn = LLACE_IR_FUNCTION(&ctx, index);
+    llace_error_t err = llace_regalloc(&ctx, &config, fn, llace_amd64_regset(), &ra);
+
+    if (err == LLACE_ERROR_NONE && ra.stats.spilled == 0 && ra.stats.moves == 0 && ra.stats.coalesced >= 2 && ra_valid(fn, &ra)) {
+      *test_passed = true;
+    } else {
+      LLACE_LOG_ERROR("Register coloring loop test failed: spilled=%zu moves=%zu coalesced=%zu", ra.stats.spilled, ra.stats.moves, ra.stats.coalesced);
+    }
+    llace_regalloc_free(&ra);
+  }
+
+  llace_ir_context_free(&ctx);
+}
+
+TEST(codegen_regalloc_pressure, "Coloring spills less than linear scan under pressure") {
+  llace_ir_context_t ctx;
+  llace_ir_context_init(&ctx);
+  llace_regalloc_t linear = {0}, color = {0};
+  size_t index;
+
+  if (llace_ir_parse(&ctx, ra_pressure, strlen(ra_pressure)) != LLACE_ERROR_NONE || !llace_ir_function_find(&ctx, "g", &index)) {
+    LLACE_LOG_ERROR("Register coloring pressure test failed: example did not parse");
+  } else {
+    llace_ir_function_t *fn = LLACE_IR_FUNCTION(&ctx, index);
+    llace_regalloc_linear(&ctx, fn, &ra_tiny, &linear);
+    llace_error_t err = llace_regalloc_color(&ctx, fn, &ra_tiny, &color);
+    size_t linear_traffic = linear.stats.spill_stores + linear.stats.reloads;
+    size_t color_traffic = color.stats.spill_stores + color.stats.reloads;
+
+    if (err == LLACE_ERROR_NONE && color.stats.spilled < linear.stats.spilled && color_traffic < linear_traffic && ra_valid(fn, &color)) {
+      *test_passed = true;
+    } else {
+      LLACE_LOG_ERROR("Register coloring pressure test failed: spilled=%zu/%zu traffic=%zu/%zu", color.stats.spilled, linear.stats.spilled, color_traffic, linear_traffic);
+    }
+    llace_regalloc_free(&linear);
+    llace_regalloc_free(&color);
+  }
+
+  llace_ir_context_free(&ctx);
+}
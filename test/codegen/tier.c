@@ -0,0 +1,127 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+#include "test.h"
+#include <llace/ir.h>
+#include <llace/codegen/tier.h>
+#include <string.h>
+#include <time.h>
+
+// Hot by calls, hot by loop iterations, cold, not compilable, sharing a global
+static const char *tier_module =
+  "$count i64(100)\n"
+  "#fib(i64 %n) i64 {\n"
+  "  @entry: { %n i64(2) < @base @rec branch }\n"
+  "  @base: { %n ret/1 }\n"
+  "  @rec: { %n i64(1) - fib %n i64(2) - fib + ret/1 }\n"
+  "}\n"
+  "#spin(i64 %n) i64 {\n"
+  "  @entry: { i64(0) %i0 = i64(0) %s0 = @head jmp }\n"
+  "  @head: {\n"
+  "    %i0 @entry %i1 @body phi/2/1 %i =\n"
+  "    %s0 @entry %s1 @body phi/2/1 %s =\n"
+  "    %i %n < @body @exit branch\n"
+  "  }\n"
+  "  @body: { %s %i + %s1 = %i i64(1) + %i1 = @head jmp }\n"
+  "  @exit: { %s ret/1 }\n"
+  "}\n"
+  "#once(i64 %x) i64 { @entry: { %x i64(1) + ret/1 } }\n"
+  "#twice(f52.11 %x) f52.11 { @entry: { %x f52.11(2.0) * ret/1 } }\n"
+  "#tick(i64 %n) i64 { @entry: { $count load %n + $count store $count load ret/1 } }\n";
+
+TEST(codegen_tier_thresholds, "Functions move to machine code at the thresholds, cold and float functions stay interpreted, globals are shared") {
+  llace_ir_context_t ctx;
+  llace_ir_context_init(&ctx);
+  llace_config_t config;
+  llace_config_init(&config);
+  config.tier_call_threshold = 3;
+  config.tier_loop_threshold = 50;
+  config.tier_background = 0;
+  llace_tier_t tier;
+  size_t fib, spin, once, twice, tick, count;
+
+  if (llace_ir_parse(&ctx, tier_module, strlen(tier_module)) != LLACE_ERROR_NONE || !llace_ir_function_find(&ctx, "fib", &fib) ||
+      !llace_ir_function_find(&ctx, "spin", &spin) || !llace_ir_function_find(&ctx, "once", &once) ||
+      !llace_ir_function_find(&ctx, "twice", &twice) || !llace_ir_function_find(&ctx, "tick", &tick) ||
+      !llace_ir_global_find(&ctx, "count", &count)) {
+    LLACE_LOG_ERROR("Tiered execution test failed: example did not parse");
+  } else if (llace_tier_init(&tier, &ctx, &config) != LLACE_ERROR_NONE) {
+    LLACE_LOG_ERROR("Tiered execution test failed: no engine");
+  } else {
+    uint64_t fib15 = 0, fib16 = 0, spun = 0, again = 0, plus = 0, ticked = 0, doubled = 0;
+    double x = 1.25;
+    uint64_t xbits;
+    memcpy(&xbits, &x, sizeof(xbits));
+
+    // fib turns hot inside its first call, the rest of the recursion runs compiled
+    llace_error_t err = llace_tier_call(&tier, fib, (uint64_t[]){ 15 }, 1, &fib15);
+    uint64_t native = tier.stats.native_calls;
+    err |= llace_tier_call(&tier, fib, (uint64_t[]){ 16 }, 1, &fib16);
+    err |= llace_tier_call(&tier, spin, (uint64_t[]){ 100 }, 1, &spun);
+    llace_tier_state_t spun_state = llace_tier_state(&tier, spin);
+    err |= llace_tier_call(&tier, spin, (uint64_t[]){ 100 }, 1, &again);
+    err |= llace_tier_call(&tier, once, (uint64_t[]){ 41 }, 1, &plus);
+    for (int i = 0; i < 5; ++i) err |= llace_tier_call(&tier, tick, (uint64_t[]){ 1 }, 1, &ticked);
+    for (int i = 0; i < 4; ++i) err |= llace_tier_call(&tier, twice, (uint64_t[]){ xbits }, 1, &doubled);
+    double twice_x;
+    memcpy(&twice_x, &doubled, sizeof(twice_x));
+
+    if (err == LLACE_ERROR_NONE && fib15 == 610 && fib16 == 987 && native > 0 && spun == 4950 && again == 4950 && plus == 42 &&
+        ticked == 105 && *(int64_t *)llace_tier_global(&tier, count) == 105 && twice_x == 2.5 &&
+        spun_state == LLACE_TIER_COMPILED && llace_tier_state(&tier, fib) == LLACE_TIER_COMPILED &&
+        llace_tier_state(&tier, tick) == LLACE_TIER_COMPILED && llace_tier_state(&tier, once) == LLACE_TIER_INTERP &&
+        llace_tier_state(&tier, twice) == LLACE_TIER_PINNED && tier.jit.stats.functions == 3 && tier.stats.compiled == 3) {
+      *test_passed = true;
+    } else {
+      LLACE_LOG_ERROR("Tiered execution test failed: err=%d fib=%llu/%llu spin=%llu/%llu once=%llu tick=%llu twice=%f compiled=%zu native=%llu",
+                      err, (unsigned long long)fib15, (unsigned long long)fib16, (unsigned long long)spun, (unsigned long long)again,
+                      (unsigned long long)plus, (unsigned long long)ticked, twice_x, tier.stats.compiled, (unsigned long long)native);
+    }
+    llace_tier_free(&tier);
+  }
+
+  llace_ir_context_free(&ctx);
+}
+
+TEST(codegen_tier_background, "A worker compiles in the background while calls keep running, the swap is seen by the next call") {
+  llace_ir_context_t ctx;
+  llace_ir_context_init(&ctx);
+  llace_config_t config;
+  llace_config_init(&config);
+  config.tier_call_threshold = 2;
+  llace_tier_t tier;
+  size_t fib;
+
+  if (llace_ir_parse(&ctx, tier_module, strlen(tier_module)) != LLACE_ERROR_NONE || !llace_ir_function_find(&ctx, "fib", &fib)) {
+    LLACE_LOG_ERROR("Tiered background test failed: example did not parse");
+  } else if (llace_tier_init(&tier, &ctx, &config) != LLACE_ERROR_NONE) {
+    LLACE_LOG_ERROR("Tiered background test failed: no engine");
+  } else {
+    double t0, t1, t2, t3;
+    uint64_t first = 0, value = 0;
+    bool agreed = true;
+    t0 = test_now();
+    llace_error_t err = llace_tier_call(&tier, fib, (uint64_t[]){ 1 }, 1, &first);
+    t1 = test_now();
+    for (int i = 0; i < 20; ++i) {
+      err |= llace_tier_call(&tier, fib, (uint64_t[]){ 18 }, 1, &value);
+      agreed = agreed && value == 2584;
+    }
+    llace_tier_wait(&tier);
+    t2 = test_now();
+    uint64_t native = tier.stats.native_calls;
+    err |= llace_tier_call(&tier, fib, (uint64_t[]){ 18 }, 1, &value);
+    t3 = test_now();
+
+    if (err == LLACE_ERROR_NONE && first == 1 && agreed && value == 2584 && tier.stats.native_calls == native + 1 &&
+        llace_tier_state(&tier, fib) == LLACE_TIER_COMPILED) {
+      *test_passed = true;
+      LLACE_LOG_INFO("Tiered: first call %.1f us, compiled fib(18) %.1f us after %.0f us of mixed calls", 1e3 * (t1 - t0), 1e3 * (t3 - t2),
+                     1e3 * (t2 - t1));
+    } else {
+      LLACE_LOG_ERROR("Tiered background test failed: err=%d first=%llu agreed=%d value=%llu state=%d", err, (unsigned long long)first, agreed,
+                      (unsigned long long)value, llace_tier_state(&tier, fib));
+    }
+    llace_tier_free(&tier);
+  }
+
+  llace_ir_context_free(&ctx);
+}
@@ -0,0 +1,196 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+#include "test.h"
+#include <llace/ir.h>
+#include <llace/codegen/wasm/wasm.h>
+#include <string.h>
+#include <time.h>
+
+// Recursion, a loop with phis, a diamond merging into a phi, memory, globals, narrow and float types, an import
+static const char *wasm_module_src =
+  "$count i64(100)\n"
+  "$scale f52.11(1.5)\n"
+  "#fib(i64 %n) i64 {\n"
+  "  @entry: { %n i64(2) < @base @rec branch }\n"
+  "  @base: { %n ret/1 }\n"
+  "  @rec: { %n i64(1) - fib %n i64(2) - fib + ret/1 }\n"
+  "}\n"
+  "#sum(i32* %p, i32 %n) i32 {\n"
+  "  @entry: { i32(0) %i0 = i32(0) %s0 = @head jmp }\n"
+  "  @head: {\n"
+  "    %i0 @entry %i1 @body phi/2/1 %i =\n"
+  "    %s0 @entry %s1 @body phi/2/1 %s =\n"
+  "    %i %n < @body @exit branch\n"
+  "  }\n"
+  "  @body: {\n"
+  "    %p %i index load %v =\n"
+  "    %s %v + %s1 =\n"
+  "    %v i32(2) * %p %i index store\n"
+  "    %i i32(1) + %i1 =\n"
+  "    @head jmp\n"
+  "  }\n"
+  "  @exit: { %s ret/1 }\n"
+  "}\n"
+  "#pick(i64 %x) i64 {\n"
+  "  @entry: { %x i64(0) < @neg @pos branch }\n"
+  "  @neg: { i64(0) %x - %a = @join jmp }\n"
+  "  @pos: { %x %b = @join jmp }\n"
+  "  @join: { %a @neg %b @pos phi/2/1 %r = ext %r ret/1 }\n"
+  "}\n"
+  "#tick(i64 %n) i64 {\n"
+  "  @entry: { $count load %n + $count store $scale load f52.11(2.0) * $scale store $count load ret/1 }\n"
+  "}\n"
+  "#wrap(i8 %a, i8 %b) i8 { @entry: { %a %b + ret/1 } }\n"
+  "#half(f23.8 %x) f23.8 { @entry: { %x f23.8(0.5) * ret/1 } }\n";
+
+// Split, native, widened lanes, a division without simd128 form, a partial vector and a lane
+static const char *wasm_vector_src =
+  "#axpy(i32* %x, i32* %y, i32 %k) void { @entry: { %k splat<8> %kv = %x load<8> %kv * %y load<8> + %y store<8> ret/0 } }\n"
+  "#vadd(f23.8* %a, f23.8* %b) void { @entry: { %a load<4> %b load<4> + %a store<4> ret/0 } }\n"
+  "#bump(i13* %p) void { @entry: { %p load<8> %p load<8> + %p store<8> ret/0 } }\n"
+  "#quot(i32* %p, i32 %d) void { @entry: { %p load<4> %d splat<4> / %p store<4> ret/0 } }\n"
+  "#tri(i32* %p) i32 { @entry: { %p load<3> %v = %v %v + %w = %w i32(2) extract ret/1 } }\n";
+
+// A loop entered in its middle, neither block dominates the other
+static const char *wasm_irreducible_src =
+  "#tangle(i64 %x) i64 {\n"
+  "  @entry: { %x @a @b branch }\n"
+  "  @a: { %x @b @out branch }\n"
+  "  @b: { @a jmp }\n"
+  "  @out: { %x ret/1 }\n"
+  "}\n";
+
+static bool wasm_read_uleb(const uint8_t *data, size_t size, size_t *at, uint64_t *value) {
+  *value = 0;
+  for (unsigned shift = 0; *at < size && shift < 64; shift += 7) {
+    uint8_t byte = data[(*at)++];
+    *value |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+static bool wasm_has(const llace_codebuf_t *buf, const uint8_t *bytes, size_t size) {
+  for (size_t i = 0; i + size <= buf->size; ++i) {
+    if (memcmp(buf->data + i, bytes, size) == 0) return true;
+  }
+  return false;
+}
+
+TEST(codegen_wasm_leb128, "LEB128 encodes minimally, sizes are padded to five bytes and patched in place") {
+  llace_codebuf_t buf;
+  llace_codebuf_init(&buf, 0);
+  llace_wasm_uleb(&buf, 0);
+  llace_wasm_uleb(&buf, 624485);
+  llace_wasm_sleb(&buf, -1);
+  llace_wasm_sleb(&buf, 63);
+  llace_wasm_sleb(&buf, 64);
+  llace_wasm_sleb(&buf, -123456);
+  size_t at;
+  llace_wasm_size_begin(&buf, &at);
+  for (int i = 0; i < 200; ++i) llace_wasm_uleb(&buf, 1);
+  llace_wasm_size_end(&buf, at);
+
+  static const uint8_t expected[] = {
+    0x00, 0xE5, 0x8E, 0x26, 0x7F, 0x3F, 0xC0, 0x00, 0xC0, 0xBB, 0x78,
+    0xC8, 0x81, 0x80, 0x80, 0x00, // 200, padded
+  };
+  size_t pos = at;
+  uint64_t patched = 0;
+  if (buf.size == sizeof(expected) + 200 && memcmp(buf.data, expected, sizeof(expected)) == 0 &&
+      wasm_read_uleb(buf.data, buf.size, &pos, &patched) && patched == 200 && pos == at + 5) {
+    *test_passed = true;
+  } else {
+    LLACE_LOG_ERROR("WebAssembly LEB128 test failed: size=%zu patched=%llu", buf.size, (unsigned long long)patched);
+  }
+  llace_codebuf_free(&buf);
+}
+
+TEST(codegen_wasm_module, "A module has its sections in order with exact sizes, every function and import, and rejects irreducible flow") {
+  llace_ir_context_t ctx, tangled;
+  llace_ir_context_init(&ctx);
+  llace_ir_context_init(&tangled);
+  llace_codebuf_t out, rejected;
+  llace_codebuf_init(&out, 1024);
+  llace_codebuf_init(&rejected, 0);
+
+  if (llace_ir_parse(&ctx, wasm_module_src, strlen(wasm_module_src)) != LLACE_ERROR_NONE ||
+      llace_ir_parse(&tangled, wasm_irreducible_src, strlen(wasm_irreducible_src)) != LLACE_ERROR_NONE) {
+    LLACE_LOG_ERROR("WebAssembly module test failed: example did not parse");
+  } else {
+    double t0, t1;
+    llace_wasm_stats_t stats = {0};
+    t0 = test_now();
+    llace_error_t err = llace_wasm_emit(&ctx, NULL, &out, &stats);
+    t1 = test_now();
+    bool tangle_rejected = llace_wasm_emit(&tangled, NULL, &rejected, NULL) == LLACE_ERROR_INVLFUNC;
+
+    // Walk the sections, count the defined functions and find the exports
+    static const uint8_t header[] = { 0x00, 0x61, 0x73, 0x6D, 0x01, 0x00, 0x00, 0x00 };
+    bool ordered = err == LLACE_ERROR_NONE && out.size > sizeof(header) && memcmp(out.data, header, sizeof(header)) == 0;
+    uint64_t functions = 0, bodies = 0;
+    bool exported = false;
+    int last = 0;
+    size_t at = sizeof(header);
+    while (ordered && at < out.size) {
+      int id = out.data[at++];
+      uint64_t size = 0, count = 0;
+      ordered = id > last && wasm_read_uleb(out.data, out.size, &at, &size) && at + size <= out.size;
+      if (!ordered) break;
+      size_t end = at + size;
+      wasm_read_uleb(out.data, out.size, &at, &count);
+      if (id == LLACE_WASM_SECTION_FUNCTION) functions = count;
+      if (id == LLACE_WASM_SECTION_CODE) bodies = count;
+      if (id == LLACE_WASM_SECTION_EXPORT) {
+        for (size_t i = at; i + 4 <= end && !exported; ++i) exported = memcmp(out.data + i, "\x03" "fib", 4) == 0;
+      }
+      last = id;
+      at = end;
+    }
+
+    if (ordered && at == out.size && last == LLACE_WASM_SECTION_DATA && functions == 6 && bodies == 6 && stats.functions == 6 &&
+        stats.imports == 1 && stats.data == 16 && exported && tangle_rejected) {
+      *test_passed = true;
+      LLACE_LOG_INFO("WebAssembly: %zu functions in %zu bytes, emitted in %.1f us", stats.functions, out.size, 1e3 * (t1 - t0));
+    } else {
+      LLACE_LOG_ERROR("WebAssembly module test failed: err=%d ordered=%d last=%d functions=%llu/%llu imports=%zu data=%zu exported=%d rejected=%d",
+                      err, ordered, last, (unsigned long long)functions, (unsigned long long)bodies, stats.imports, stats.data, exported,
+                      tangle_rejected);
+    }
+  }
+
+  llace_codebuf_free(&out);
+  llace_codebuf_free(&rejected);
+  llace_ir_context_free(&ctx);
+  llace_ir_context_free(&tangled);
+}
+
+TEST(codegen_wasm_simd, "Vectors take simd128 where it has the op and go lane by lane elsewhere, or everywhere without simd128") {
+  llace_ir_context_t ctx;
+  llace_ir_context_init(&ctx);
+  llace_codebuf_t simd, scalar;
+  llace_codebuf_init(&simd, 512);
+  llace_codebuf_init(&scalar, 512);
+  llace_target_t plain = { .arch = LLACE_ARCH_WASM32, .format = LLACE_OBJFMT_WASM };
+
+  if (llace_ir_parse(&ctx, wasm_vector_src, strlen(wasm_vector_src)) != LLACE_ERROR_NONE) {
+    LLACE_LOG_ERROR("WebAssembly vector test failed: example did not parse");
+  } else {
+    llace_wasm_stats_t with = {0}, without = {0};
+    llace_error_t err = llace_wasm_emit(&ctx, NULL, &simd, &with);
+    llace_error_t plain_err = llace_wasm_emit(&ctx, &plain, &scalar, &without);
+    static const uint8_t f32x4_add[] = { 0xFD, 0xE4, 0x01 }, i32x4_mul[] = { 0xFD, 0xB5, 0x01 };
+
+    if (err == LLACE_ERROR_NONE && plain_err == LLACE_ERROR_NONE && with.vector == 19 && with.scalarized == 2 &&
+        without.vector == 0 && without.scalarized == 21 && wasm_has(&simd, f32x4_add, sizeof(f32x4_add)) &&
+        wasm_has(&simd, i32x4_mul, sizeof(i32x4_mul)) && !wasm_has(&scalar, f32x4_add, sizeof(f32x4_add))) {
+      *test_passed = true;
+    } else {
+      LLACE_LOG_ERROR("WebAssembly vector test failed: err=%d/%d simd=%zu/%zu scalar=%zu/%zu", err, plain_err, with.vector,
+                      with.scalarized, without.vector, without.scalarized);
+    }
+  }
+
+  llace_codebuf_free(&simd);
+  llace_codebuf_free(&scalar);
+  llace_ir_context_free(&ctx);
+}
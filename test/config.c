@@ -1,21 +1,20 @@
+#include "test.h"
 #include <llace/config.h>
 #include <stdbool.h>
 
-void test_config(unsigned *total_tests_passed) { // 2 test
-  { // Target Test
-    llace_target_t target;
-    llace_target_get_host(&target);
-    llace_target_log(&target);
-  } ++(*total_tests_passed);
+TEST(config_target, "The host target is detected") {
+  llace_target_t target;
+  llace_target_get_host(&target);
+  llace_target_log(&target);
+  *test_passed = true;
+}
 
-  { // Config Test
-    llace_config_t conf;
-    llace_config_init(&conf);
-    if (llace_config_valid(&conf)) {
-      ++(*total_tests_passed);
-    } else { 
-      LLACE_LOG_ERROR("Config is not valid");
-    }
-  } 
-  
+TEST(config_defaults, "The default configuration is valid") {
+  llace_config_t conf;
+  llace_config_init(&conf);
+  if (llace_config_valid(&conf)) {
+    *test_passed = true;
+  } else {
+    LLACE_LOG_ERROR("Config is not valid");
+  }
 }
@@ -0,0 +1,104 @@
+#include "test.h"
+#include <llace/ir.h>
+#include <string.h>
+
+// examples/build.c, %a.0 and the whole if/else chain feeding %a.final are dead
+static const char *adce_example =
+  "#add(i32 %a, i32 %b) i32 {\n"
+  "  @entry: { %a %b + %r = %r ret/1 }\n"
+  "}\n"
+  "#main() i32 {\n"
+  "  @entry: {\n"
+  "    i32(10) %x.0 =\n"
+  "    i32(15) %y.0 =\n"
+  "    i32(0) %a.0 =\n"
+  "    %x.0 i32(5) > %cond1 =\n"
+  "    %x.0 !! %cond2 =\n"
+  "    %cond1 %cond2 or %if_condition =\n"
+  "    %if_condition @block_then @block_elif_test branch\n"
+  "  }\n"
+  "  @block_then: { i32(1) %a.1 = @block_merge jmp/1/0 }\n"
+  "  @block_elif_test: { %x.0 i32(15) < %elif_condition = %elif_condition @block_elif @block_else branch }\n"
+  "  @block_elif: { i32(2) %a.2 = @block_merge jmp }\n"
+  "  @block_else: { i32(-1) %a.3 = @block_merge jmp }\n"
+  "  @block_merge: {\n"
+  "    %a.1 @block_then %a.2 @block_elif %a.3 @block_else phi/3/1 %a.final =\n"
+  "    %x.0 %y.0 add %z.0 =\n"
+  "    i32(0) ret/1\n"
+  "  }\n"
+  "}\n";
+
+// Volatile values survive, unreachable blocks go and take their phi inputs with them
+static const char *adce_volatile =
+  "#f(i32 %x) i32 {\n"
+  "  @entry: { i32(1) %v:i32:volatile = i32(2) %k:i32:const = i32(3) %d = %x i32(0) > %c = %c @a @b branch }\n"
+  "  @a: { @join jmp }\n"
+  "  @b: { @join jmp }\n"
+  "  @dead: { %x i32(1) + %y = @join jmp }\n"
+  "  @join: { %x @a %x @b %y @dead phi/3/1 %p = %p ret/1 }\n"
+  "}\n";
+
+static bool adce_has_var(const llace_ir_function_t *fn, const char *name) {
+  LLACE_ARRAY_FOREACH(llace_ir_basicblock_t, block, fn->blocks) {
+    for (size_t i = 0; i + 1 < LLACE_ARRAY_COUNT(block->stack); ++i) {
+      const llace_ir_value_t *value = LLACE_IR_STACK_AT(block, i);
+      if (value->kind == LLACE_IR_VALUE_VAR && strcmp(LLACE_IR_VAR_AT(fn, value->var)->name, name) == 0) return true;
+    }
+  }
+  return false;
+}
+
+TEST(ir_adce_readme, "Mark-sweep over the README example") {
+  llace_ir_context_t ctx;
+  llace_ir_context_init(&ctx);
+  size_t main_index;
+  llace_ir_adce_stats_t stats;
+
+  if (llace_ir_parse(&ctx, adce_example, strlen(adce_example)) != LLACE_ERROR_NONE ||
+      !llace_ir_function_find(&ctx, "main", &main_index)) {
+    LLACE_LOG_ERROR("ADCE test failed: example did not parse");
+  } else {
+    llace_ir_function_t *fn = LLACE_IR_FUNCTION(&ctx, main_index);
+    llace_ir_opt_adce(&ctx, fn, &stats);
+
+    if (stats.stmts_removed == 5 && stats.blocks_removed == 0 &&
+        !adce_has_var(fn, "a.0") && !adce_has_var(fn, "a.final") && !adce_has_var(fn, "a.3") &&
+        adce_has_var(fn, "z.0") && adce_has_var(fn, "cond2") &&
+        llace_ir_function_verify(&ctx, fn) == LLACE_ERROR_NONE) {
+      *test_passed = true;
+    } else {
+      LLACE_LOG_ERROR("ADCE example test failed: removed=%zu blocks=%zu", stats.stmts_removed, stats.blocks_removed);
+      llace_ir_print_function(&ctx, fn, stdout);
+    }
+  }
+
+  llace_ir_context_free(&ctx);
+}
+
+TEST(ir_adce_attributes, "Attributes and unreachable blocks") {
+  llace_ir_context_t ctx;
+  llace_ir_context_init(&ctx);
+  llace_ir_adce_stats_t stats;
+
+  if (llace_ir_parse(&ctx, adce_volatile, strlen(adce_volatile)) != LLACE_ERROR_NONE) {
+    LLACE_LOG_ERROR("ADCE test failed: volatile example did not parse");
+  } else {
+    llace_ir_function_t *fn = LLACE_IR_FUNCTION(&ctx, 0);
+    llace_ir_opt_adce(&ctx, fn, &stats);
+
+    const llace_ir_basicblock_t *join = LLACE_IR_BLOCK_AT(fn, LLACE_ARRAY_COUNT(fn->blocks) - 1);
+    const llace_ir_value_t *phi = LLACE_IR_STACK_AT(join, 4);
+
+    if (stats.blocks_removed == 1 && LLACE_ARRAY_COUNT(fn->blocks) == 4 &&
+        adce_has_var(fn, "v") && adce_has_var(fn, "k") && !adce_has_var(fn, "d") && !adce_has_var(fn, "y") &&
+        phi && LLACE_IR_IS_OP(phi, LLACE_IR_OP_PHI) && phi->instr.in == 4 &&
+        llace_ir_function_verify(&ctx, fn) == LLACE_ERROR_NONE) {
+      *test_passed = true;
+    } else {
+      LLACE_LOG_ERROR("ADCE attribute test failed: removed=%zu blocks=%zu", stats.stmts_removed, stats.blocks_removed);
+      llace_ir_print_function(&ctx, fn, stdout);
+    }
+  }
+
+  llace_ir_context_free(&ctx);
+}
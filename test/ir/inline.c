@@ -0,0 +1,96 @@
+#include "test.h"
+#include <llace/ir.h>
+#include <string.h>
+
+// a and b call each other, c calls into the cycle, d is a leaf
+static const char *inline_graph =
+  "#a(i32 %x) i32 { @entry: { %x b %r = %r ret/1 } }\n"
+  "#b(i32 %x) i32 { @entry: { %x a %r = %r ret/1 } }\n"
+  "#c(i32 %x) i32 { @entry: { %x a %y = %y d %r = %r ret/1 } }\n"
+  "#d(i32 %x) i32 { @entry: { %x i32(1) + %r = %r ret/1 } }\n";
+
+// add is a single block leaf, max merges two returns, both are called from a loop
+static const char *inline_loop =
+  "#add(i32 %a, i32 %b) i32 { @entry: { %a %b + %r = %r ret/1 } }\n"
+  "#max(i32 %a, i32 %b) i32 {\n"
+  "  @entry: { %a %b > %c = %c @l @r branch }\n"
+  "  @l: { %a ret/1 }\n"
+  "  @r: { %b ret/1 }\n"
+  "}\n"
+  "#main(i32 %n) i32 {\n"
+  "  @entry: { i32(0) %i0 = i32(0) %s0 = @head jmp }\n"
+  "  @head: {\n"
+  "    %i0 @entry %i1 @body phi/2/1 %i =\n"
+  "    %s0 @entry %s2 @body phi/2/1 %s =\n"
+  "    %i %n < %c = %c @body @exit branch\n"
+  "  }\n"
+  "  @body: {\n"
+  "    %s %i add %s1 =\n"
+  "    %s1 i32(3) max i32(1) + %s2 =\n"
+  "    %i i32(1) + %i1 =\n"
+  "    @head jmp\n"
+  "  }\n"
+  "  @exit: { %s ret/1 }\n"
+  "}\n";
+
+static size_t inline_count_calls(const llace_ir_function_t *fn) {
+  size_t count = 0;
+  LLACE_ARRAY_FOREACH(llace_ir_basicblock_t, block, fn->blocks) {
+    LLACE_ARRAY_FOREACH(llace_ir_value_t, value, block->stack) {
+      if (LLACE_IR_IS_OP(value, LLACE_IR_OP_CALL)) ++count;
+    }
+  }
+  return count;
+}
+
+TEST(ir_inline_order, "Components come bottom-up") {
+  llace_ir_context_t ctx;
+  llace_ir_context_init(&ctx);
+  llace_ir_callgraph_t cg;
+
+  if (llace_ir_parse(&ctx, inline_graph, strlen(inline_graph)) != LLACE_ERROR_NONE) {
+    LLACE_LOG_ERROR("Call graph test failed: example did not parse");
+  } else {
+    llace_ir_callgraph_build(&ctx, &cg);
+    size_t a = LLACE_IR_CALLGRAPH_SCC(&cg, 0), b = LLACE_IR_CALLGRAPH_SCC(&cg, 1);
+    size_t c = LLACE_IR_CALLGRAPH_SCC(&cg, 2), d = LLACE_IR_CALLGRAPH_SCC(&cg, 3);
+
+    if (LLACE_ARRAY_COUNT(cg.sccs) == 3 && a == b && c > a && c > d &&
+        llace_ir_callgraph_recursive(&cg, 0) && !llace_ir_callgraph_recursive(&cg, 2) && !llace_ir_callgraph_recursive(&cg, 3) &&
+        LLACE_ARRAY_COUNT(*LLACE_IR_CALLGRAPH_CALLERS(&cg, 0)) == 2) {
+      *test_passed = true;
+    } else {
+      LLACE_LOG_ERROR("Call graph test failed: sccs=%zu a=%zu b=%zu c=%zu d=%zu", LLACE_ARRAY_COUNT(cg.sccs), a, b, c, d);
+    }
+    llace_ir_callgraph_free(&cg);
+  }
+
+  llace_ir_context_free(&ctx);
+}
+
+TEST(ir_inline_leaves, "Leaf calls in a loop disappear") {
+  llace_ir_context_t ctx;
+  llace_ir_context_init(&ctx);
+  llace_config_t config;
+  llace_config_init(&config);
+  llace_ir_inline_stats_t stats;
+  size_t main_index;
+
+  if (llace_ir_parse(&ctx, inline_loop, strlen(inline_loop)) != LLACE_ERROR_NONE ||
+      !llace_ir_function_find(&ctx, "main", &main_index)) {
+    LLACE_LOG_ERROR("Inline test failed: example did not parse");
+  } else {
+    llace_ir_opt_inline(&ctx, &config, &stats);
+    llace_ir_function_t *fn = LLACE_IR_FUNCTION(&ctx, main_index);
+
+    if (stats.inlined == 2 && stats.uncalled == 2 && inline_count_calls(fn) == 0 &&
+        llace_ir_function_verify(&ctx, fn) == LLACE_ERROR_NONE) {
+      *test_passed = true;
+    } else {
+      LLACE_LOG_ERROR("Inline test failed: inlined=%zu uncalled=%zu", stats.inlined, stats.uncalled);
+      llace_ir_print_function(&ctx, fn, stdout);
+    }
+  }
+
+  llace_ir_context_free(&ctx);
+}
@@ -0,0 +1,150 @@
+#include "test.h"
+#include <llace/ir.h>
+#include <llace/codegen/jit.h>
+#include <string.h>
+
+// Recursion, phis (swapped in parallel), globals, narrow and float types, memory through a pointer
+static const char *interp_module =
+  "$count i64(100)\n"
+  "$scale f52.11(1.5)\n"
+  "#fib(i64 %n) i64 {\n"
+  "  @entry: { %n i64(2) < @base @rec branch }\n"
+  "  @base: { %n ret/1 }\n"
+  "  @rec: { %n i64(1) - fib %n i64(2) - fib + ret/1 }\n"
+  "}\n"
+  "#swap(i64 %n) i64 {\n"
+  "  @entry: { i64(1) %a0 = i64(2) %b0 = i64(0) %k0 = @head jmp }\n"
+  "  @head: {\n"
+  "    %a0 @entry %b @body phi/2/1 %a =\n"
+  "    %b0 @entry %a @body phi/2/1 %b =\n"
+  "    %k0 @entry %k1 @body phi/2/1 %k =\n"
+  "    %k %n < @body @exit branch\n"
+  "  }\n"
+  "  @body: { %k i64(1) + %k1 = @head jmp }\n"
+  "  @exit: { %a i64(10) * %b + ret/1 }\n"
+  "}\n"
+  "#sum(i32* %p, i32 %n) i32 {\n"
+  "  @entry: { i32(0) %i0 = i32(0) %s0 = @head jmp }\n"
+  "  @head: {\n"
+  "    %i0 @entry %i1 @body phi/2/1 %i =\n"
+  "    %s0 @entry %s1 @body phi/2/1 %s =\n"
+  "    %i %n < @body @exit branch\n"
+  "  }\n"
+  "  @body: {\n"
+  "    %p %i index load %v =\n"
+  "    %s %v + %s1 =\n"
+  "    %v i32(2) * %p %i index store\n"
+  "    %i i32(1) + %i1 =\n"
+  "    @head jmp\n"
+  "  }\n"
+  "  @exit: { %s ret/1 }\n"
+  "}\n"
+  "#tick(i64 %n) i64 {\n"
+  "  @entry: { $count load %n + $count store $scale load f52.11(2.0) * $scale store $count load ret/1 }\n"
+  "}\n"
+  "#wrap(i8 %a, i8 %b) i8 { @entry: { %a %b + ret/1 } }\n"
+  "#udiv(u32 %a, u32 %b) u32 { @entry: { %a %b / ret/1 } }\n"
+  "#half(f23.8 %x) f23.8 { @entry: { %x f23.8(0.5) * ret/1 } }\n"
+  "#outside(i64 %x) i64 { @entry: { %x ext ret/1 } }\n";
+
+TEST(ir_interp_run, "Interpreted functions compute what the IR says and reject what they cannot run") {
+  llace_ir_context_t ctx;
+  llace_ir_context_init(&ctx);
+  llace_interp_t interp;
+  size_t fib, swap, sum, tick, wrap, udiv, half, outside, count, scale;
+
+  if (llace_ir_parse(&ctx, interp_module, strlen(interp_module)) != LLACE_ERROR_NONE || !llace_ir_function_find(&ctx, "fib", &fib) ||
+      !llace_ir_function_find(&ctx, "swap", &swap) || !llace_ir_function_find(&ctx, "sum", &sum) ||
+      !llace_ir_function_find(&ctx, "tick", &tick) || !llace_ir_function_find(&ctx, "wrap", &wrap) ||
+      !llace_ir_function_find(&ctx, "udiv", &udiv) || !llace_ir_function_find(&ctx, "half", &half) ||
+      !llace_ir_function_find(&ctx, "outside", &outside) || !llace_ir_global_find(&ctx, "count", &count) ||
+      !llace_ir_global_find(&ctx, "scale", &scale) || llace_interp_init(&interp, &ctx) != LLACE_ERROR_NONE) {
+    LLACE_LOG_ERROR("Interpreter execution test failed: example did not parse");
+  } else {
+    int32_t data[5] = { 1, -2, 3, -4, 5 };
+    float x = 3.0f;
+    uint32_t xbits;
+    memcpy(&xbits, &x, sizeof(xbits));
+    uint64_t fib20 = 0, swap2 = 0, swap3 = 0, total = 0, ticked = 0, wrapped = 0, quotient = 0, halved = 0, ignored;
+
+    llace_error_t err = llace_interp_call(&interp, fib, (uint64_t[]){ 20 }, 1, &fib20);
+    err |= llace_interp_call(&interp, swap, (uint64_t[]){ 2 }, 1, &swap2);
+    err |= llace_interp_call(&interp, swap, (uint64_t[]){ 3 }, 1, &swap3);
+    err |= llace_interp_call(&interp, sum, (uint64_t[]){ (uint64_t)(uintptr_t)data, 5 }, 2, &total);
+    err |= llace_interp_call(&interp, tick, (uint64_t[]){ 5 }, 1, &ignored);
+    err |= llace_interp_call(&interp, tick, (uint64_t[]){ 7 }, 1, &ticked);
+    err |= llace_interp_call(&interp, wrap, (uint64_t[]){ 100, 100 }, 2, &wrapped);
+    err |= llace_interp_call(&interp, udiv, (uint64_t[]){ 0xFFFFFFFFu, 2 }, 2, &quotient);
+    err |= llace_interp_call(&interp, half, (uint64_t[]){ xbits }, 1, &halved);
+    float half_x;
+    uint32_t half_bits = (uint32_t)halved;
+    memcpy(&half_x, &half_bits, sizeof(half_x));
+    double *scaled = llace_interp_global(&interp, scale);
+
+    bool rejected = llace_interp_call(&interp, outside, (uint64_t[]){ 1 }, 1, &ignored) == LLACE_ERROR_UNRESSYM &&
+                    llace_interp_call(&interp, fib, NULL, 0, &ignored) == LLACE_ERROR_BADARG &&
+                    llace_interp_call(&interp, udiv, (uint64_t[]){ 1, 0 }, 2, &ignored) == LLACE_ERROR_BADARG;
+
+    // wrap gives -56 sign extended, data is doubled in place, fib was decoded once for all its calls
+    if (err == LLACE_ERROR_NONE && fib20 == 6765 && swap2 == 12 && swap3 == 21 && total == 3 && data[3] == -8 && ticked == 112 &&
+        *(int64_t *)llace_interp_global(&interp, count) == 112 && scaled && *scaled == 6.0 && (int64_t)wrapped == -56 &&
+        quotient == 0x7FFFFFFF && half_x == 1.5f && rejected && interp.stats.decoded == 8) {
+      *test_passed = true;
+    } else {
+      LLACE_LOG_ERROR("Interpreter execution test failed: err=%d fib=%llu swap=%llu/%llu sum=%llu tick=%llu wrap=%lld div=%llu half=%f rejected=%d",
+                      err, (unsigned long long)fib20, (unsigned long long)swap2, (unsigned long long)swap3, (unsigned long long)total,
+                      (unsigned long long)ticked, (long long)wrapped, (unsigned long long)quotient, half_x, rejected);
+    }
+    llace_interp_free(&interp);
+  }
+
+  llace_ir_context_free(&ctx);
+}
+
+TEST(ir_interp_compiled, "Interpreted and compiled code agree, the interpreter starts at once and the compiled code runs faster") {
+  llace_ir_context_t ctx;
+  llace_ir_context_init(&ctx);
+  llace_interp_t interp;
+  llace_jit_t jit;
+  size_t fib;
+
+  if (llace_ir_parse(&ctx, interp_module, strlen(interp_module)) != LLACE_ERROR_NONE || !llace_ir_function_find(&ctx, "fib", &fib) ||
+      llace_interp_init(&interp, &ctx) != LLACE_ERROR_NONE) {
+    LLACE_LOG_ERROR("Interpreter benchmark test failed: example did not parse");
+  } else if (llace_jit_init(&jit, &ctx, NULL) != LLACE_ERROR_NONE) {
+    LLACE_LOG_ERROR("Interpreter benchmark test failed: no JIT address space");
+    llace_interp_free(&interp);
+  } else {
+    double t0, t1, t2, t3, t4;
+    uint64_t first = 0, interpreted = 0;
+    int64_t compiled = 0;
+    t0 = test_now();
+    llace_error_t err = llace_interp_call(&interp, fib, (uint64_t[]){ 1 }, 1, &first);
+    t1 = test_now();
+    err |= llace_interp_call(&interp, fib, (uint64_t[]){ 25 }, 1, &interpreted);
+    t2 = test_now();
+
+    void *entry = NULL;
+    err |= llace_jit_add(&jit, fib, &entry);
+    t3 = test_now();
+    if (err == LLACE_ERROR_NONE) {
+      int64_t (*fn)(int64_t);
+      memcpy(&fn, &entry, sizeof(fn));
+      compiled = fn(25);
+    }
+    t4 = test_now();
+
+    if (err == LLACE_ERROR_NONE && first == 1 && interpreted == 75025 && compiled == 75025) {
+      *test_passed = true;
+      LLACE_LOG_INFO("Interpreter: first call %.1f us, fib(25) %.0f us (%zu calls), JIT compile %.1f us, fib(25) %.0f us",
+                     1e3 * (t1 - t0), 1e3 * (t2 - t1), interp.stats.calls - 1, 1e3 * (t3 - t2), 1e3 * (t4 - t3));
+    } else {
+      LLACE_LOG_ERROR("Interpreter benchmark test failed: err=%d first=%llu interpreted=%llu compiled=%lld", err, (unsigned long long)first,
+                      (unsigned long long)interpreted, (long long)compiled);
+    }
+    llace_jit_free(&jit);
+    llace_interp_free(&interp);
+  }
+
+  llace_ir_context_free(&ctx);
+}
@@ -0,0 +1,161 @@
+#include "test.h"
+#include <llace/ir.h>
+#include <string.h>
+
+// Two nested loops, the inner one a self loop. Blocks are numbered on first reference, @exit is 3
+static const char *loop_nested =
+  "#g(i32 %n) void {\n"
+  "  @entry: { @outer jmp }\n"
+  "  @outer: { %n i32(0) > %c = %c @inner @exit branch }\n"
+  "  @inner: { %n i32(1) > %d = %d @inner @latch branch }\n"
+  "  @latch: { @outer jmp }\n"
+  "  @exit: { ret/0 }\n"
+  "}\n";
+
+// %a %b * is invariant, %i i32(4) * is reduced to an additive recurrence
+static const char *loop_sum =
+  "#f(i32 %n, i32 %a, i32 %b) i32 {\n"
+  "  @entry: { i32(0) %i0 = i32(0) %s0 = @head jmp }\n"
+  "  @head: {\n"
+  "    %i0 @entry %i1 @body phi/2/1 %i =\n"
+  "    %s0 @entry %s1 @body phi/2/1 %s =\n"
+  "    %i %n < %c = %c @body @exit branch\n"
+  "  }\n"
+  "  @body: {\n"
+  "    %a %b * %ab =\n"
+  "    %i i32(4) * %off =\n"
+  "    %s %off + %t =\n"
+  "    %t %ab + %s1 =\n"
+  "    %i i32(1) + %i1 =\n"
+  "    @head jmp\n"
+  "  }\n"
+  "  @exit: { %s ret/1 }\n"
+  "}\n";
+
+// Only the divisions by 3 and by the largest u32 may move, the others can trap where the loop never runs
+static const char *loop_divide =
+  "#h(i32 %n, i32 %a, u32 %b) i32 {\n"
+  "  @entry: { i32(0) %i0 = @head jmp }\n"
+  "  @head: {\n"
+  "    %i0 @entry %i1 @body phi/2/1 %i =\n"
+  "    %i %n < %c = %c @body @exit branch\n"
+  "  }\n"
+  "  @body: {\n"
+  "    %a i32(3) / %x =\n"
+  "    %b u32(4294967295) / %v =\n"
+  "    %a i32(-1) / %y =\n"
+  "    %a i32(0) / %z =\n"
+  "    %a %n / %w =\n"
+  "    %i i32(1) + %i1 =\n"
+  "    @head jmp\n"
+  "  }\n"
+  "  @exit: { %i ret/1 }\n"
+  "}\n";
+
+static size_t loop_count_ops(const llace_ir_basicblock_t *block, llace_ir_opcode_t op) {
+  size_t count = 0;
+  LLACE_ARRAY_FOREACH(llace_ir_value_t, value, block->stack) {
+    if (LLACE_IR_IS_OP(value, op)) ++count;
+  }
+  return count;
+}
+
+TEST(ir_loop_forest, "Nesting forest and preheaders") {
+  llace_ir_context_t ctx;
+  llace_ir_context_init(&ctx);
+
+  if (llace_ir_parse(&ctx, loop_nested, strlen(loop_nested)) != LLACE_ERROR_NONE) {
+    LLACE_LOG_ERROR("Loop test failed: nested example did not parse");
+  } else {
+    llace_ir_function_t *fn = LLACE_IR_FUNCTION(&ctx, 0);
+    llace_ir_cfg_t cfg;
+    llace_ir_loopinfo_t info;
+    llace_ir_cfg_build(fn, &cfg);
+    llace_ir_loops_build(&cfg, &info);
+
+    bool ok = LLACE_ARRAY_COUNT(info.loops) == 2;
+    if (ok) {
+      const llace_ir_loop_t *outer = LLACE_IR_LOOP_AT(&info, 0), *inner = LLACE_IR_LOOP_AT(&info, 1);
+      ok = outer->header == 1 && outer->depth == 1 && outer->parent == SIZE_MAX && LLACE_ARRAY_COUNT(outer->blocks) == 3 &&
+           inner->header == 2 && inner->depth == 2 && inner->parent == 0 && LLACE_ARRAY_COUNT(inner->blocks) == 1 &&
+           llace_ir_loop_contains(&info, 0, 4) && !llace_ir_loop_contains(&info, 1, 4) && !llace_ir_loop_contains(&info, 0, 3) &&
+           llace_ir_loop_preheader(&cfg, &info, 0) == 0 && llace_ir_loop_preheader(&cfg, &info, 1) == SIZE_MAX &&
+           LLACE_IR_CFG_IDOM(&cfg, 4) == 2;
+    }
+
+    // The inner loop is entered from a branch, it needs a block of its own
+    ok = ok && llace_ir_loops_make_preheaders(fn, &cfg, &info) && LLACE_ARRAY_COUNT(fn->blocks) == 6;
+    llace_ir_loops_free(&info);
+    llace_ir_cfg_free(&cfg);
+    if (ok) {
+      llace_ir_cfg_build(fn, &cfg);
+      llace_ir_loops_build(&cfg, &info);
+      ok = llace_ir_loop_preheader(&cfg, &info, 1) == 5 && llace_ir_function_verify(&ctx, fn) == LLACE_ERROR_NONE;
+      llace_ir_loops_free(&info);
+      llace_ir_cfg_free(&cfg);
+    }
+
+    if (ok) {
+      *test_passed = true;
+    } else {
+      LLACE_LOG_ERROR("Loop nesting test failed");
+      llace_ir_print_function(&ctx, fn, stdout);
+    }
+  }
+
+  llace_ir_context_free(&ctx);
+}
+
+TEST(ir_loop_licm, "Invariant code motion and strength reduction") {
+  llace_ir_context_t ctx;
+  llace_ir_context_init(&ctx);
+  llace_ir_licm_stats_t licm;
+  llace_ir_indvar_stats_t indvar;
+
+  if (llace_ir_parse(&ctx, loop_sum, strlen(loop_sum)) != LLACE_ERROR_NONE) {
+    LLACE_LOG_ERROR("Loop test failed: sum example did not parse");
+  } else {
+    llace_ir_function_t *fn = LLACE_IR_FUNCTION(&ctx, 0);
+    llace_ir_opt_licm(&ctx, fn, &licm);
+    llace_ir_opt_indvars(&ctx, fn, &indvar);
+
+    const llace_ir_basicblock_t *entry = LLACE_IR_BLOCK_AT(fn, 0);
+    const llace_ir_basicblock_t *head = LLACE_IR_BLOCK_AT(fn, 1);
+    const llace_ir_basicblock_t *body = LLACE_IR_BLOCK_AT(fn, 2);
+
+    if (licm.hoisted == 1 && licm.preheaders == 0 && indvar.reduced == 1 &&
+        loop_count_ops(entry, LLACE_IR_OP_MUL) == 2 && loop_count_ops(body, LLACE_IR_OP_MUL) == 0 &&
+        loop_count_ops(head, LLACE_IR_OP_PHI) == 3 && loop_count_ops(body, LLACE_IR_OP_ADD) == 4 &&
+        llace_ir_function_verify(&ctx, fn) == LLACE_ERROR_NONE) {
+      *test_passed = true;
+    } else {
+      LLACE_LOG_ERROR("LICM test failed: hoisted=%zu reduced=%zu", licm.hoisted, indvar.reduced);
+      llace_ir_print_function(&ctx, fn, stdout);
+    }
+  }
+
+  llace_ir_context_free(&ctx);
+}
+
+TEST(ir_loop_licm_divide, "Divisions are hoisted only where they cannot trap") {
+  llace_ir_context_t ctx;
+  llace_ir_context_init(&ctx);
+  llace_ir_licm_stats_t licm;
+
+  if (llace_ir_parse(&ctx, loop_divide, strlen(loop_divide)) != LLACE_ERROR_NONE) {
+    LLACE_LOG_ERROR("LICM divide test failed: example did not parse");
+  } else {
+    llace_ir_function_t *fn = LLACE_IR_FUNCTION(&ctx, 0);
+    llace_ir_opt_licm(&ctx, fn, &licm);
+
+    if (licm.hoisted == 2 && loop_count_ops(LLACE_IR_BLOCK_AT(fn, 2), LLACE_IR_OP_DIV) == 3 &&
+        llace_ir_function_verify(&ctx, fn) == LLACE_ERROR_NONE) {
+      *test_passed = true;
+    } else {
+      LLACE_LOG_ERROR("LICM divide test failed: hoisted=%zu", licm.hoisted);
+      llace_ir_print_function(&ctx, fn, stdout);
+    }
+  }
+
+  llace_ir_context_free(&ctx);
+}
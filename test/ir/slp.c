@@ -0,0 +1,166 @@
+#include "test.h"
+#include <llace/ir.h>
+#include <llace/codegen/jit.h>
+#include <string.h>
+
+// Four lanes of p[k] = p[k] * s + 1
+static const char *slp_store =
+  "#scale(i32* %p, i32 %s) void {\n"
+  "  @entry: {\n"
+  "    %p i32(0) index load %s * i32(1) + %p i32(0) index store\n"
+  "    %p i32(1) index load %s * i32(1) + %p i32(1) index store\n"
+  "    %p i32(2) index load %s * i32(1) + %p i32(2) index store\n"
+  "    %p i32(3) index load %s * i32(1) + %p i32(3) index store\n"
+  "    ret/0\n"
+  "  }\n"
+  "}\n";
+
+// mulk pays for its extracts with the multiplies, addv would pack four unrelated scalars for four adds
+static const char *slp_assign =
+  "#mulk(i32* %p, i32 %k) i32 {\n"
+  "  @entry: {\n"
+  "    %p i32(0) index load %k * %x0 =\n"
+  "    %p i32(1) index load %k * %x1 =\n"
+  "    %p i32(2) index load %k * %x2 =\n"
+  "    %p i32(3) index load %k * %x3 =\n"
+  "    %x0 %x1 + %x2 + %x3 + ret/1\n"
+  "  }\n"
+  "}\n"
+  "#addv(i32* %p, i32 %a, i32 %b, i32 %c, i32 %d) i32 {\n"
+  "  @entry: {\n"
+  "    %p i32(0) index load %a + %x0 =\n"
+  "    %p i32(1) index load %b + %x1 =\n"
+  "    %p i32(2) index load %c + %x2 =\n"
+  "    %p i32(3) index load %d + %x3 =\n"
+  "    %x0 %x1 + %x2 + %x3 + ret/1\n"
+  "  }\n"
+  "}\n";
+
+static size_t slp_count_op(const llace_ir_function_t *fn, llace_ir_opcode_t op) {
+  size_t count = 0;
+  LLACE_ARRAY_FOREACH(llace_ir_basicblock_t, block, fn->blocks) {
+    LLACE_ARRAY_FOREACH(llace_ir_value_t, value, block->stack) {
+      if (LLACE_IR_IS_OP(value, op)) ++count;
+    }
+  }
+  return count;
+}
+
+// The function compiled by the JIT, packed for AVX2 or not
+static bool slp_jit(const char *src, const char *name, bool pack, void **entry, llace_ir_context_t *ctx, llace_jit_t *jit) {
+  size_t index;
+  if (llace_ir_parse(ctx, src, strlen(src)) != LLACE_ERROR_NONE || !llace_ir_function_find(ctx, name, &index)) return false;
+  if (pack) {
+    llace_config_t config;
+    llace_config_init(&config);
+    config.target = (llace_target_t){ .arch = LLACE_ARCH_AMD64, .features = LLACE_FEATURE_SSE2 | LLACE_FEATURE_AVX | LLACE_FEATURE_AVX2 };
+    llace_ir_slp_stats_t stats;
+    if (llace_ir_opt_slp(ctx, &config, LLACE_IR_FUNCTION(ctx, index), &stats) != LLACE_ERROR_NONE || stats.packed != 1) return false;
+  }
+  return llace_jit_init(jit, ctx, NULL) == LLACE_ERROR_NONE && llace_jit_add(jit, index, entry) == LLACE_ERROR_NONE;
+}
+
+typedef void (*slp_scale_t)(int32_t *, int32_t);
+typedef int32_t (*slp_mulk_t)(int32_t *, int32_t);
+
+TEST(ir_slp_store, "Adjacent stores become one vector store, on targets selecting it") {
+  llace_config_t config, sse;
+  llace_config_init(&config);
+  config.target = (llace_target_t){ .arch = LLACE_ARCH_AMD64, .features = LLACE_FEATURE_SSE2 | LLACE_FEATURE_AVX | LLACE_FEATURE_AVX2 };
+  sse = config;
+  sse.target.features = LLACE_FEATURE_SSE2;
+
+  llace_ir_context_t ctx;
+  llace_ir_context_init(&ctx);
+  llace_ir_slp_stats_t stats, sse_stats;
+  size_t index;
+
+  if (llace_ir_parse(&ctx, slp_store, strlen(slp_store)) != LLACE_ERROR_NONE || !llace_ir_function_find(&ctx, "scale", &index)) {
+    LLACE_LOG_ERROR("SLP store test failed: example did not parse");
+  } else {
+    llace_ir_function_t *fn = LLACE_IR_FUNCTION(&ctx, index);
+    llace_ir_opt_slp(&ctx, &sse, fn, &sse_stats); // the amd64 selector has no SSE vectors
+    llace_ir_opt_slp(&ctx, &config, fn, &stats);
+
+    if (sse_stats.packed == 0 && stats.packed == 1 && stats.scalars == 4 && slp_count_op(fn, LLACE_IR_OP_STORE) == 1 &&
+        slp_count_op(fn, LLACE_IR_OP_SPLAT) == 2 && llace_ir_function_verify(&ctx, fn) == LLACE_ERROR_NONE) {
+      *test_passed = true;
+    } else {
+      LLACE_LOG_ERROR("SLP store test failed: packed=%zu scalars=%zu sse=%zu", stats.packed, stats.scalars, sse_stats.packed);
+      llace_ir_print_function(&ctx, fn, stdout);
+    }
+  }
+
+  llace_ir_context_free(&ctx);
+}
+
+TEST(ir_slp_assign, "Extracts and packs are paid for") {
+  llace_config_t config;
+  llace_config_init(&config);
+  config.target = (llace_target_t){ .arch = LLACE_ARCH_AMD64, .features = LLACE_FEATURE_SSE2 | LLACE_FEATURE_AVX | LLACE_FEATURE_AVX2 };
+
+  llace_ir_context_t ctx;
+  llace_ir_context_init(&ctx);
+  llace_ir_slp_stats_t mulk_stats, addv_stats;
+  size_t mulk, addv;
+
+  if (llace_ir_parse(&ctx, slp_assign, strlen(slp_assign)) != LLACE_ERROR_NONE ||
+      !llace_ir_function_find(&ctx, "mulk", &mulk) || !llace_ir_function_find(&ctx, "addv", &addv)) {
+    LLACE_LOG_ERROR("SLP assign test failed: example did not parse");
+  } else {
+    llace_ir_function_t *mulk_fn = LLACE_IR_FUNCTION(&ctx, mulk), *addv_fn = LLACE_IR_FUNCTION(&ctx, addv);
+    llace_ir_opt_slp(&ctx, &config, mulk_fn, &mulk_stats);
+    llace_ir_opt_slp(&ctx, &config, addv_fn, &addv_stats);
+
+    if (mulk_stats.packed == 1 && slp_count_op(mulk_fn, LLACE_IR_OP_EXTRACT) == 4 && addv_stats.packed == 0 &&
+        llace_ir_function_verify(&ctx, mulk_fn) == LLACE_ERROR_NONE) {
+      *test_passed = true;
+    } else {
+      LLACE_LOG_ERROR("SLP assign test failed: mulk=%zu addv=%zu", mulk_stats.packed, addv_stats.packed);
+      llace_ir_print_function(&ctx, mulk_fn, stdout);
+    }
+  }
+
+  llace_ir_context_free(&ctx);
+}
+
+TEST(ir_slp_jit, "Packed stores and extracts are selected as vector code and compute what the scalar statements do") {
+  llace_ir_context_t ctx[4];
+  llace_jit_t jit[4] = {0};
+  void *entry[4] = {0};
+  bool built = true;
+  for (size_t k = 0; k < 4; ++k) {
+    llace_ir_context_init(&ctx[k]);
+    built = built && slp_jit(k < 2 ? slp_store : slp_assign, k < 2 ? "scale" : "mulk", k % 2 == 1, &entry[k], &ctx[k], &jit[k]);
+  }
+
+  int32_t p[2][5] = { { 3, -4, 5, 1000, 9 }, { 3, -4, 5, 1000, 9 } }, sums[2] = {0};
+  if (built) {
+    for (size_t k = 0; k < 2; ++k) {
+      slp_scale_t scale;
+      slp_mulk_t mulk;
+      memcpy(&scale, &entry[k], sizeof(scale));
+      memcpy(&mulk, &entry[2 + k], sizeof(mulk));
+      scale(p[k], -7);
+      sums[k] = mulk(p[k], 3);
+    }
+  }
+
+  // Packed code is vector code on a host with AVX2, scalarized on one without
+  llace_config_t host;
+  llace_config_init(&host);
+  bool avx2 = host.target.features & LLACE_FEATURE_AVX2, selected = true;
+  for (size_t k = 0; k < 4; ++k) selected = selected && (jit[k].stats.vector > 0) == (avx2 && k % 2 == 1);
+
+  // The fifth element is past the pack
+  if (built && selected && memcmp(p[0], p[1], sizeof(p[0])) == 0 && p[1][0] == -20 && p[1][4] == 9 && sums[0] == sums[1]) {
+    *test_passed = true;
+  } else {
+    LLACE_LOG_ERROR("SLP execution test failed: built=%d selected=%d p=%d,%d,%d,%d,%d sums=%d/%d", built, selected, p[1][0], p[1][1], p[1][2],
+                    p[1][3], p[1][4], sums[0], sums[1]);
+  }
+  for (size_t k = 0; k < 4; ++k) {
+    llace_jit_free(&jit[k]);
+    llace_ir_context_free(&ctx[k]);
+  }
+}
@@ -0,0 +1,163 @@
+#include "test.h"
+#include <llace/ir.h>
+#include <llace/codegen/jit.h>
+#include <string.h>
+
+// Vector types, lane-count loads and stores and splat in the text form
+static const char *vectorize_types =
+  "#axpy(i32* %x, i32* %y, i32 %k) void {\n"
+  "  @entry: { %k splat<8> %kv = %x load<8> %kv * %y load<8> + %y store<8> ret/0 }\n"
+  "}\n";
+
+// c[i] = a[i] + b[i] * k
+static const char *vectorize_loop =
+  "#madd(i32* %a, i32* %b, i32* %c, i32 %k, i32 %n) void {\n"
+  "  @entry: { i32(0) %i0 = @head jmp }\n"
+  "  @head: {\n"
+  "    %i0 @entry %i1 @body phi/2/1 %i =\n"
+  "    %i %n < %t = %t @body @exit branch\n"
+  "  }\n"
+  "  @body: {\n"
+  "    %a %i index load %x =\n"
+  "    %b %i index load %k * %y =\n"
+  "    %x %y + %c %i index store\n"
+  "    %i i32(1) + %i1 =\n"
+  "    @head jmp\n"
+  "  }\n"
+  "  @exit: { ret/0 }\n"
+  "}\n";
+
+static bool vectorize_has_load(const llace_ir_function_t *fn, size_t lanes) {
+  LLACE_ARRAY_FOREACH(llace_ir_basicblock_t, block, fn->blocks) {
+    LLACE_ARRAY_FOREACH(llace_ir_value_t, value, block->stack) {
+      if (LLACE_IR_IS_OP(value, LLACE_IR_OP_LOAD) && value->instr.lanes == lanes) return true;
+    }
+  }
+  return false;
+}
+
+typedef void (*vectorize_madd_t)(int32_t *, int32_t *, int32_t *, int32_t, int32_t);
+
+// madd compiled by the JIT, vectorized for AVX2 or not
+static bool vectorize_jit(bool vectorize, vectorize_madd_t *fn, llace_ir_context_t *ctx, llace_jit_t *jit) {
+  size_t index;
+  void *entry;
+  if (llace_ir_parse(ctx, vectorize_loop, strlen(vectorize_loop)) != LLACE_ERROR_NONE || !llace_ir_function_find(ctx, "madd", &index)) return false;
+  if (vectorize) {
+    llace_config_t config;
+    llace_config_init(&config);
+    config.target = (llace_target_t){ .arch = LLACE_ARCH_AMD64, .features = LLACE_FEATURE_SSE2 | LLACE_FEATURE_AVX | LLACE_FEATURE_AVX2 };
+    llace_ir_vectorize_stats_t stats;
+    if (llace_ir_opt_vectorize(ctx, &config, LLACE_IR_FUNCTION(ctx, index), &stats) != LLACE_ERROR_NONE || stats.vectorized != 1) return false;
+  }
+  if (llace_jit_init(jit, ctx, NULL) != LLACE_ERROR_NONE) return false;
+  if (llace_jit_add(jit, index, &entry) != LLACE_ERROR_NONE) return false;
+  memcpy(fn, &entry, sizeof(*fn));
+  return true;
+}
+
+TEST(ir_vectorize_types, "Vector types and target costs") {
+  llace_ir_context_t ctx;
+  llace_ir_context_init(&ctx);
+  llace_target_t target = { .arch = LLACE_ARCH_AMD64, .features = LLACE_FEATURE_SSE2 | LLACE_FEATURE_AVX | LLACE_FEATURE_AVX2 };
+  llace_target_t sse = { .arch = LLACE_ARCH_AMD64, .features = LLACE_FEATURE_SSE2 };
+  llace_target_t avx512 = { .arch = LLACE_ARCH_AMD64, .features = target.features | LLACE_FEATURE_AVX512 };
+  size_t index, kv;
+
+  if (llace_ir_parse(&ctx, vectorize_types, strlen(vectorize_types)) != LLACE_ERROR_NONE ||
+      !llace_ir_function_find(&ctx, "axpy", &index)) {
+    LLACE_LOG_ERROR("Vector type test failed: example did not parse");
+  } else {
+    llace_ir_function_t *fn = LLACE_IR_FUNCTION(&ctx, index);
+    kv = LLACE_ARRAY_COUNT(fn->vars) - 1;
+    llace_ir_type_t vec = llace_ir_type_vec(LLACE_IR_INT(32), 8);
+
+    if (llace_ir_type_eq(LLACE_IR_VAR_AT(fn, kv)->type, vec) && llace_ir_type_bits(vec) == 256 &&
+        llace_ir_function_verify(&ctx, fn) == LLACE_ERROR_NONE &&
+        llace_target_vector_bits(&target) == 256 && llace_target_vector_bits(&sse) == 128 &&
+        llace_target_cost(&target, LLACE_COST_ALU, 32, 8, false) == 1 &&
+        llace_target_cost(&target, LLACE_COST_DIV, 32, 8, false) == LLACE_COST_UNSUPPORTED &&
+        llace_target_cost(&sse, LLACE_COST_ALU, 32, 8, false) == LLACE_COST_UNSUPPORTED &&
+        // Priced only as the JIT selects it: AVX2 xmm and ymm, no vector shifts or 64 bit multiplies
+        llace_target_cost(&target, LLACE_COST_ALU, 32, 4, false) == 1 &&
+        llace_target_cost(&sse, LLACE_COST_ALU, 32, 4, false) == LLACE_COST_UNSUPPORTED &&
+        llace_target_cost(&avx512, LLACE_COST_ALU, 32, 16, false) == LLACE_COST_UNSUPPORTED &&
+        llace_target_cost(&target, LLACE_COST_SHIFT, 32, 8, false) == LLACE_COST_UNSUPPORTED &&
+        llace_target_cost(&avx512, LLACE_COST_MUL, 64, 4, false) == LLACE_COST_UNSUPPORTED) {
+      *test_passed = true;
+    } else {
+      LLACE_LOG_ERROR("Vector type test failed");
+      llace_ir_print_function(&ctx, fn, stdout);
+    }
+  }
+
+  llace_ir_context_free(&ctx);
+}
+
+TEST(ir_vectorize_loop, "A lane-wise loop gets a vector body and a scalar remainder") {
+  llace_ir_context_t ctx;
+  llace_ir_context_init(&ctx);
+  llace_config_t config;
+  llace_config_init(&config);
+  config.target = (llace_target_t){ .arch = LLACE_ARCH_AMD64, .features = LLACE_FEATURE_SSE2 | LLACE_FEATURE_AVX | LLACE_FEATURE_AVX2 };
+  llace_ir_vectorize_stats_t stats;
+  size_t index;
+
+  if (llace_ir_parse(&ctx, vectorize_loop, strlen(vectorize_loop)) != LLACE_ERROR_NONE ||
+      !llace_ir_function_find(&ctx, "madd", &index)) {
+    LLACE_LOG_ERROR("Vectorize test failed: example did not parse");
+  } else {
+    llace_ir_function_t *fn = LLACE_IR_FUNCTION(&ctx, index);
+    llace_ir_opt_vectorize(&ctx, &config, fn, &stats);
+
+    if (stats.vectorized == 1 && stats.lanes == 8 && vectorize_has_load(fn, 8) && vectorize_has_load(fn, 0) &&
+        llace_ir_function_verify(&ctx, fn) == LLACE_ERROR_NONE) {
+      *test_passed = true;
+    } else {
+      LLACE_LOG_ERROR("Vectorize test failed: vectorized=%zu lanes=%zu", stats.vectorized, stats.lanes);
+      llace_ir_print_function(&ctx, fn, stdout);
+    }
+  }
+
+  llace_ir_context_free(&ctx);
+}
+
+TEST(ir_vectorize_jit, "The vector loop computes what the scalar one does, remainders and overlapping arrays included") {
+  llace_ir_context_t scalar_ctx, vector_ctx;
+  llace_jit_t scalar_jit = {0}, vector_jit = {0};
+  vectorize_madd_t scalar, vector;
+  llace_ir_context_init(&scalar_ctx);
+  llace_ir_context_init(&vector_ctx);
+  bool built = vectorize_jit(false, &scalar, &scalar_ctx, &scalar_jit) && vectorize_jit(true, &vector, &vector_ctx, &vector_jit);
+
+  size_t mismatch = SIZE_MAX;
+  if (built) {
+    static const int32_t counts[] = { 0, 3, 8, 19, 64 };
+    mismatch = 0;
+    for (size_t t = 0; t < 2 * sizeof(counts) / sizeof(counts[0]) && mismatch == 0; ++t) {
+      int32_t n = counts[t / 2], a[2][72], b[2][72], c[2][72];
+      for (size_t k = 0; k < 2; ++k) {
+        for (int32_t i = 0; i < 72; ++i) a[k][i] = i * 7 - 100, b[k][i] = 3 - i, c[k][i] = -1;
+        // Odd runs write c over a, one element ahead
+        int32_t *out = t % 2 ? &a[k][1] : c[k];
+        (k == 0 ? scalar : vector)(a[k], b[k], out, 5, n);
+      }
+      if (memcmp(a[0], a[1], sizeof(a[0])) != 0 || memcmp(c[0], c[1], sizeof(c[0])) != 0) mismatch = t + 1;
+    }
+  }
+
+  // The vector body is selected as vector code on a host with AVX2, scalarized on one without
+  llace_config_t host;
+  llace_config_init(&host);
+  bool avx2 = host.target.features & LLACE_FEATURE_AVX2;
+  if (built && mismatch == 0 && scalar_jit.stats.vector == 0 && (vector_jit.stats.vector > 0) == avx2) {
+    *test_passed = true;
+  } else {
+    LLACE_LOG_ERROR("Vectorize execution test failed: built=%d mismatch in run %zu, %zu vector instructions", built, mismatch,
+                    vector_jit.stats.vector);
+  }
+  llace_jit_free(&vector_jit);
+  llace_jit_free(&scalar_jit);
+  llace_ir_context_free(&vector_ctx);
+  llace_ir_context_free(&scalar_ctx);
+}
@@ -0,0 +1,252 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+#include "test.h"
+#include <llace/log.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#define LOG_THREADS 4
+#define LOG_MESSAGES 5000
+#define LOG_CAPTURED 512 // fewer than the ring holds
+#define LOG_DISABLED 10000000
+
+static int log_debug_line;
+
+static void *log_producer(void *arg) {
+  int id = (int)(intptr_t)arg;
+  for (int i = 0; i < LOG_MESSAGES; ++i) LLACE_LOG_INFO("thread %d message %d", id, i);
+  return NULL;
+}
+
+static void log_sites(int pass) {
+  log_debug_line = __LINE__; LLACE_LOG_DEBUG("site debug %d", pass);
+  LLACE_LOG_WARN("site warn %d", pass);
+}
+
+static double log_nanos(const struct timespec *start, const struct timespec *end) {
+  return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+// Text of the file from the start
+static size_t log_slurp(FILE *file, char *buf, size_t size) {
+  fflush(file);
+  rewind(file);
+  size_t read = fread(buf, 1, size - 1, file);
+  buf[read] = '\0';
+  return read;
+}
+
+TEST(log_capture, "Captured arguments format as printf would, once drained") {
+  FILE *file = tmpfile();
+  static char text[LOG_CAPTURED * 128], expected[512], long_str[300];
+  memset(long_str, 'y', sizeof(long_str) - 1);
+  bool started = file && llace_log_start(false);
+  size_t before = 0;
+  struct timespec t0, t1;
+
+  if (started) {
+    llace_log_output(file);
+    LLACE_LOG_WARN("value %d name '%s' %.2f %zx %c [%5.1s] %-4u| %lld %% %*d %p", -42, "abc", 3.5, (size_t)255, 'q', "xyz", 7u,
+                   -1234567890123ll, 3, 9, (void *)0);
+    LLACE_LOG_INFO("long %s end", long_str);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < LOG_CAPTURED; ++i) LLACE_LOG_DEBUG("pass %s took %d us", "sccp", i);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    before = log_slurp(file, text, sizeof(text));
+    llace_log_drain();
+    llace_log_stop();
+    llace_log_output(NULL);
+    log_slurp(file, text, sizeof(text));
+  }
+  snprintf(expected, sizeof(expected), "value %d name '%s' %.2f %zx %c [%5.1s] %-4u| %lld %% %*d %p", -42, "abc", 3.5, (size_t)255, 'q',
+           "xyz", 7u, -1234567890123ll, 3, 9, (void *)0);
+
+  char *first = strstr(text, "WARN"), *second = first ? strstr(first, "\n") : NULL;
+  if (started && before == 0 && first && strstr(first, expected) && second && strstr(second, "long yyyy") &&
+      strstr(second, "pass sccp took 511 us")) {
+    *test_passed = true;
+    LLACE_LOG_INFO("Async log: %.0f ns to capture a message", log_nanos(&t0, &t1) / LOG_CAPTURED);
+  } else {
+    LLACE_LOG_ERROR("Async log format test failed: started=%d before=%zu text='%s'", started, before, text);
+  }
+  if (file) fclose(file);
+}
+
+TEST(log_layout, "A format parsed once reads every later call's arguments, one with too many is formatted at once") {
+  FILE *file = tmpfile();
+  static char text[4096], expected[256];
+  bool started = file && llace_log_start(false);
+
+  if (started) {
+    llace_log_output(file);
+    for (int i = 0; i < 3; ++i) {
+      LLACE_LOG_INFO("pass %d [%.*s] %hhd %hu %Lf %*s|", i, i + 1, "abcd", (signed char)(-1 - i), (unsigned short)(65535 - i),
+                     (long double)i + 0.5L, -3 - i, "z");
+    }
+    LLACE_LOG_INFO("%d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d end",
+                   1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33);
+    llace_log_stop();
+    llace_log_output(NULL);
+    log_slurp(file, text, sizeof(text));
+  }
+  bool found = true;
+  for (int i = 0; i < 3; ++i) {
+    snprintf(expected, sizeof(expected), "pass %d [%.*s] %hhd %hu %Lf %*s|\n", i, i + 1, "abcd", (signed char)(-1 - i),
+             (unsigned short)(65535 - i), (long double)i + 0.5L, -3 - i, "z");
+    found = found && strstr(text, expected);
+  }
+  if (started && found && strstr(text, " 31 32 33 end\n")) {
+    *test_passed = true;
+  } else {
+    LLACE_LOG_ERROR("Async log layout test failed: started=%d text='%s'", started, text);
+  }
+  if (file) fclose(file);
+}
+
+TEST(log_oversized, "Arguments too large for a slot are written whole, as the synchronous path would") {
+  FILE *file = tmpfile();
+  static char text[8192], expected[4096], huge[2000];
+  memset(huge, 'z', sizeof(huge) - 1);
+  bool started = file && llace_log_start(false);
+
+  if (started) {
+    llace_log_output(file);
+    LLACE_LOG_INFO("huge %s %d %s end", huge, 42, huge);
+    llace_log_stop();
+    llace_log_output(NULL);
+    log_slurp(file, text, sizeof(text));
+  }
+  snprintf(expected, sizeof(expected), "huge %s %d %s end\n", huge, 42, huge);
+
+  if (started && strstr(text, expected)) {
+    *test_passed = true;
+  } else {
+    LLACE_LOG_ERROR("Async log oversized test failed: started=%d wrote=%zu of %zu", started, strlen(text), strlen(expected));
+  }
+  if (file) fclose(file);
+}
+
+TEST(log_ring, "Threads log through a full ring, every message is written in its thread's order") {
+  FILE *file = tmpfile();
+  static char text[LOG_THREADS * LOG_MESSAGES * 128];
+  bool started = file && llace_log_start(true);
+  size_t lines = 0;
+  bool ordered = true;
+
+  if (started) {
+    llace_log_output(file);
+    pthread_t threads[LOG_THREADS];
+    for (int t = 0; t < LOG_THREADS; ++t) pthread_create(&threads[t], NULL, log_producer, (void *)(intptr_t)t);
+    for (int t = 0; t < LOG_THREADS; ++t) pthread_join(threads[t], NULL);
+    llace_log_stop();
+    llace_log_output(NULL);
+    log_slurp(file, text, sizeof(text));
+
+    int next[LOG_THREADS] = {0};
+    for (char *line = strstr(text, "thread "); line; line = strstr(line + 1, "thread ")) {
+      int id, message;
+      if (sscanf(line, "thread %d message %d", &id, &message) != 2 || id < 0 || id >= LOG_THREADS || message != next[id]++) ordered = false;
+      ++lines;
+    }
+  }
+
+  if (started && ordered && lines == LOG_THREADS * LOG_MESSAGES) {
+    *test_passed = true;
+  } else {
+    LLACE_LOG_ERROR("Async log thread test failed: started=%d ordered=%d lines=%zu", started, ordered, lines);
+  }
+  if (file) fclose(file);
+}
+
+TEST(log_levels, "Sites below the runtime level stay quiet until enabled one by one") {
+  FILE *file = tmpfile();
+  static char text[4096];
+  struct timespec t0, t1;
+
+  if (file) {
+    llace_log_output(file);
+    llace_log_level(LLACE_LOG_WARN);
+    log_sites(0);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < LOG_DISABLED; ++i) LLACE_LOG_DEBUG("disabled %d", i);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    llace_log_enable("test/log.c", log_debug_line, true);
+    log_sites(1);
+    llace_log_level(LLACE_LOG_MIN_LEVEL);
+    llace_log_output(NULL);
+    log_slurp(file, text, sizeof(text));
+  }
+
+  if (file && strstr(text, "site warn 0") && !strstr(text, "site debug 0") && !strstr(text, "disabled") &&
+      strstr(text, "site debug 1") && strstr(text, "site warn 1")) {
+    *test_passed = true;
+    LLACE_LOG_INFO("Log sites: %.2f ns per disabled message", log_nanos(&t0, &t1) / LOG_DISABLED);
+  } else {
+    LLACE_LOG_ERROR("Log site test failed: text='%s'", text);
+  }
+  if (file) fclose(file);
+}
+
+TEST(log_trace, "A binary trace from several threads decodes to every message, in a tenth of the text") {
+  FILE *trace = tmpfile(), *decoded = tmpfile();
+  static char text[LOG_THREADS * LOG_MESSAGES * 128];
+  bool started = trace && decoded && llace_log_trace_start(trace), ok = false, ordered = true;
+  size_t lines = 0, trace_size = 0, text_size = 0;
+
+  if (started) {
+    pthread_t threads[LOG_THREADS];
+    for (int t = 0; t < LOG_THREADS; ++t) pthread_create(&threads[t], NULL, log_producer, (void *)(intptr_t)t);
+    for (int t = 0; t < LOG_THREADS; ++t) pthread_join(threads[t], NULL);
+    LLACE_LOG_WARN("traced %s %.3f %*d%%", "name", 2.25, 4, -7);
+    llace_log_trace_stop();
+    trace_size = (size_t)ftell(trace);
+    rewind(trace);
+    ok = llace_log_decode(trace, decoded);
+    text_size = log_slurp(decoded, text, sizeof(text));
+
+    int next[LOG_THREADS] = {0};
+    for (char *line = strstr(text, "thread "); line; line = strstr(line + 1, "thread ")) {
+      int id, message;
+      if (sscanf(line, "thread %d message %d", &id, &message) != 2 || id < 0 || id >= LOG_THREADS || message != next[id]++) ordered = false;
+      ++lines;
+    }
+  }
+
+  if (started && ok && ordered && lines == LOG_THREADS * LOG_MESSAGES && strstr(text, "traced name 2.250   -7%") &&
+      trace_size * 10 <= text_size) {
+    *test_passed = true;
+    LLACE_LOG_INFO("Binary trace: %zu bytes for %zu bytes of text", trace_size, text_size);
+  } else {
+    LLACE_LOG_ERROR("Binary trace test failed: started=%d decoded=%d ordered=%d lines=%zu trace=%zu text=%zu", started, ok, ordered, lines,
+                    trace_size, text_size);
+  }
+  if (trace) fclose(trace);
+  if (decoded) fclose(decoded);
+}
+
+TEST(log_trace_oversized, "Formatted messages longer than a thread's buffer decode whole, in order with the rest") {
+  FILE *trace = tmpfile(), *decoded = tmpfile();
+  static char text[3 * 80000], huge[70000], expected[2 * 70000];
+  memset(huge, 'w', sizeof(huge) - 1);
+  bool started = trace && decoded && llace_log_trace_start(trace), ok = false;
+
+  if (started) {
+    LLACE_LOG_INFO("before %d", 1);
+    LLACE_LOG_INFO("huge %s %d %s end", huge, 42, "tail");
+    LLACE_LOG_INFO("after %d", 2);
+    llace_log_trace_stop();
+    rewind(trace);
+    ok = llace_log_decode(trace, decoded);
+    log_slurp(decoded, text, sizeof(text));
+  }
+  snprintf(expected, sizeof(expected), "huge %s %d %s end\n", huge, 42, "tail");
+  char *before = strstr(text, "before 1"), *whole = strstr(text, expected), *after = strstr(text, "after 2");
+
+  if (started && ok && before && whole && after && before < whole && whole < after) {
+    *test_passed = true;
+  } else {
+    LLACE_LOG_ERROR("Binary trace oversized test failed: started=%d decoded=%d whole=%d", started, ok, whole != NULL);
+  }
+  if (trace) fclose(trace);
+  if (decoded) fclose(decoded);
+}
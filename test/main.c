@@ -1,31 +1,184 @@
-#include <llace/llace.h>
+// Runs every registered test case in its own worker process
+// Usage: test [-j JOBS] [--slowest N] [--list] [FILTER...]
+#define _POSIX_C_SOURCE 200809L // clock_gettime, fileno
+#include "test.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
 
-extern void test_config(unsigned*);
-extern void test_mem(unsigned*);
+typedef struct test_run {
+  test_case_t *test;
+  pid_t pid;     // of the worker, 0 once it has finished
+  FILE *output;  // what the worker printed
+  int result;    // read end of the pipe the worker writes its verdict to
+  double start;
+  double millis;
+  bool passed;
+  int signal;    // that ended the worker, 0 if it exited
+} test_run_t;
+
+static test_case_t *test_cases;
+
+void test_register(test_case_t *test) {
+  test->next = test_cases;
+  test_cases = test;
+}
+
+double test_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+static int test_by_name(const void *a, const void *b) {
+  return strcmp((*(const test_run_t **)a)->test->name, (*(const test_run_t **)b)->test->name);
+}
+
+static int test_by_time(const void *a, const void *b) {
+  double x = (*(const test_run_t **)a)->millis, y = (*(const test_run_t **)b)->millis;
+  return (x < y) - (x > y);
+}
+
+static bool test_selected(const test_case_t *test, char **filters, int count) {
+  for (int i = 0; i < count; ++i) {
+    if (strstr(test->name, filters[i])) return true;
+  }
+  return count == 0;
+}
+
+// ================ Workers ================ //
+
+static void test_start(test_run_t *run) {
+  int fds[2];
+  run->output = tmpfile();
+  if (!run->output || pipe(fds) != 0) { LLACE_LOG_FATAL("Failed to set up worker for '%s'", run->test->name); }
+  fflush(stdout);
+  fflush(stderr);
+  run->start = test_now();
+  run->pid = fork();
+  if (run->pid < 0) { LLACE_LOG_FATAL("Failed to start worker for '%s'", run->test->name); }
+
+  if (run->pid == 0) {
+    close(fds[0]);
+    dup2(fileno(run->output), STDOUT_FILENO);
+    dup2(fileno(run->output), STDERR_FILENO);
+    bool passed = false;
+    run->test->run(&passed);
+    fflush(stdout);
+    fflush(stderr);
+    if (write(fds[1], &passed, sizeof(passed)) != sizeof(passed)) exit(1);
+    exit(0);
+  }
+  close(fds[1]);
+  run->result = fds[0];
+}
+
+// Output of the worker, then its verdict
+static void test_finish(test_run_t *run, int status) {
+  run->millis = test_now() - run->start;
+  run->pid = 0; // a reused pid must not finish this run again
+  if (read(run->result, &run->passed, sizeof(run->passed)) != sizeof(run->passed)) run->passed = false;
+  close(run->result);
+  run->signal = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+
+  char buf[4096];
+  size_t size;
+  rewind(run->output);
+  while ((size = fread(buf, 1, sizeof(buf), run->output)) > 0) fwrite(buf, 1, size, stdout);
+  fclose(run->output);
+
+  const test_case_t *test = run->test;
+  if (run->signal) {
+    run->passed = false;
+    LLACE_LOG_ERROR("%s: crashed with signal %d after %.1f ms (%s)", test->name, run->signal, run->millis, test->description);
+  } else if (!run->passed) {
+    LLACE_LOG_ERROR("%s: failed in %.1f ms (%s)", test->name, run->millis, test->description);
+  } else {
+    LLACE_LOG_INFO("%s: passed in %.1f ms", test->name, run->millis);
+  }
+  fflush(stdout);
+}
+
+// ================ Runner ================ //
+
+static int test_usage(const char *program) {
+  fprintf(stderr, "Usage: %s [-j JOBS] [--slowest N] [--list] [FILTER...]\n", program);
+  return 2;
+}
+
+int main(int argc, char *argv[]) {
+  long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t slowest = 5;
+  bool list = false;
+  char **filters = calloc((size_t)argc, sizeof(char *));
+  int filter_count = 0;
+  if (!filters) { LLACE_LOG_FATAL("Failed to allocate test filters"); }
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--list") == 0) list = true;
+    else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) jobs = strtol(argv[++i], NULL, 10);
+    else if (strcmp(argv[i], "--slowest") == 0 && i + 1 < argc) slowest = strtoul(argv[++i], NULL, 10);
+    else if (argv[i][0] == '-') return test_usage(argv[0]);
+    else filters[filter_count++] = argv[i];
+  }
+  if (jobs < 1) jobs = 1;
+
+  size_t count = 0;
+  for (test_case_t *test = test_cases; test; test = test->next) count += test_selected(test, filters, filter_count);
+  test_run_t *runs = calloc(count ? count : 1, sizeof(test_run_t));
+  test_run_t **order = calloc(count ? count : 1, sizeof(test_run_t *));
+  if (!runs || !order) { LLACE_LOG_FATAL("Failed to allocate test runs"); }
+  size_t index = 0;
+  for (test_case_t *test = test_cases; test; test = test->next) {
+    if (test_selected(test, filters, filter_count)) runs[index].test = test, order[index] = &runs[index], ++index;
+  }
+  qsort(order, count, sizeof(test_run_t *), test_by_name);
+  if ((size_t)jobs > count) jobs = count ? (long)count : 1;
+
+  if (list) {
+    for (size_t i = 0; i < count; ++i) printf("%-28s %s\n", order[i]->test->name, order[i]->test->description);
+    return 0;
+  }
 
-int main(void) {
   LLACE_LOG_INFO("LLACE (Low Level Assembly & Compilation Engine) Tests");
   LLACE_LOG_INFO("========================================================");
-  
-  unsigned total_tests =
-    2+  // memory
-    2+  // config
-    0
-  ;
-  unsigned total_tests_passed = 0;
-
-  LLACE_LOG_INFO("Running memory tests...");
-  test_mem(&total_tests_passed);
-  
-  LLACE_LOG_INFO("Running configuration tests...");
-  test_config(&total_tests_passed);
+  LLACE_LOG_INFO("Running %zu test cases in %ld workers...", count, jobs);
+
+  double start = test_now();
+  size_t started = 0, running = 0;
+  size_t passed = 0;
+  while (started < count || running > 0) {
+    for (; started < count && running < (size_t)jobs; ++started, ++running) test_start(order[started]);
 
+    int status;
+    pid_t pid = wait(&status);
+    if (pid < 0) { LLACE_LOG_FATAL("Lost track of the test workers"); }
+    for (size_t i = 0; i < started; ++i) {
+      if (order[i]->pid != pid) continue;
+      test_finish(order[i], status);
+      --running;
+      break;
+    }
+  }
+  for (size_t i = 0; i < count; ++i) passed += runs[i].passed;
+
+  qsort(order, count, sizeof(test_run_t *), test_by_time);
   LLACE_LOG_INFO("========================================================");
-  if (total_tests == total_tests_passed) {
-    LLACE_LOG_INFO("All %u tests completed successfully!", total_tests_passed);
+  if (slowest > count) slowest = count;
+  if (slowest) LLACE_LOG_INFO("Slowest %zu of %zu:", slowest, count);
+  for (size_t i = 0; i < slowest; ++i) LLACE_LOG_INFO("  %8.1f ms  %s", order[i]->millis, order[i]->test->name);
+  LLACE_LOG_INFO("Wall time %.1f ms", test_now() - start);
+
+  free(order);
+  free(runs);
+  free(filters);
+  if (passed == count) {
+    LLACE_LOG_INFO("All %zu tests completed successfully!", passed);
     return 0;
   } else {
-    LLACE_LOG_ERROR("Tests failed: %u/%u passed", total_tests_passed, total_tests);
+    LLACE_LOG_ERROR("Tests failed: %zu/%zu passed", passed, count);
     return 1;
   }
-}
\ No newline at end of file
+}
@@ -1,4 +1,7 @@
+#include "test.h"
 #include <llace/mem.h>
+#include <llace/ir.h>
+#include <llace/codegen/wasm/wasm.h>
 #include <string.h>
 
 typedef struct {
@@ -7,60 +10,136 @@ typedef struct {
   float value;
 } person_t;
 
-void test_mem(unsigned *total_tests_passed) { // 2 tests
-  {
-    llace_item_t person_handle = LLACE_NEW(person_t);
-
-    if (person_handle.data != NULL) {
-      person_t *person = LLACE_GET(person_t, person_handle);
-      person->id = 1;
-      strcpy(person->name, "John Doe");
-      person->value = 3.14f;
-
-      if (person->id == 1 && strcmp(person->name, "John Doe") == 0 && person->value == 3.14f) {
-        ++(*total_tests_passed);
-      } else {
-        LLACE_LOG_ERROR("Memory item test failed: id=%d, name='%s', value=%f", 
-                        person->id, person->name, person->value);
-      }
+static const char *mem_module_src =
+  "$count i64(0)\n"
+  "#fib(i64 %n) i64 {\n"
+  "  @entry: { %n i64(2) < @base @rec branch }\n"
+  "  @base: { %n ret/1 }\n"
+  "  @rec: { %n i64(1) - fib %n i64(2) - fib + ret/1 }\n"
+  "}\n";
+
+TEST(mem_item, "Items hold what was written to them") {
+  llace_item_t person_handle = LLACE_NEW(person_t);
+
+  if (person_handle.data != NULL) {
+    person_t *person = LLACE_GET(person_t, person_handle);
+    person->id = 1;
+    strcpy(person->name, "John Doe");
+    person->value = 3.14f;
+
+    if (person->id == 1 && strcmp(person->name, "John Doe") == 0 && person->value == 3.14f) {
+      *test_passed = true;
     } else {
-      LLACE_LOG_ERROR("Memory item test failed: allocation returned NULL");
+      LLACE_LOG_ERROR("Memory item test failed: id=%d, name='%s', value=%f", 
+                      person->id, person->name, person->value);
     }
-
-    LLACE_FREE(person_handle);
+  } else {
+    LLACE_LOG_ERROR("Memory item test failed: allocation returned NULL");
   }
 
-  {
-    llace_array_t array_handle = LLACE_NEW_ARRAY(person_t, 16);
+  LLACE_FREE(person_handle);
+}
 
-    if (array_handle.data != NULL) {
-      for (size_t i = 0; i < 16; ++i) {
-        person_t person = { .id=i, .value=3.14 };
-        strcpy(person.name, "John Doe");
-        LLACE_ARRAY_PUSH(array_handle, person);
-      }
+TEST(mem_array, "Arrays keep every item pushed to them") {
+  llace_array_t array_handle = LLACE_NEW_ARRAY(person_t, 16);
 
-      bool all_correct = true;
-      LLACE_ARRAY_FOREACH(person_t, item, array_handle) {
-        if (strcmp(item->name, "John Doe") != 0) {
-          LLACE_LOG_ERROR("Memory array item name mismatch: id=%d, name='%s'", item->id, item->name);
-          all_correct = false;
-        } else if (item->value != 3.14f) {
-          LLACE_LOG_ERROR("Memory array item value mismatch: id=%d, value=%f", item->id, item->value);
-          all_correct = false;
-        }
-      }
+  if (array_handle.data != NULL) {
+    for (size_t i = 0; i < 16; ++i) {
+      person_t person = { .id=i, .value=3.14 };
+      strcpy(person.name, "John Doe");
+      LLACE_ARRAY_PUSH(array_handle, person);
+    }
 
-      if (LLACE_ARRAY_COUNT(array_handle) == 16 && all_correct) {
-        ++(*total_tests_passed);
-      } else {
-        LLACE_LOG_ERROR("Memory array test failed: count=%zu, all_correct=%d", 
-                        LLACE_ARRAY_COUNT(array_handle), all_correct);
+    bool all_correct = true;
+    LLACE_ARRAY_FOREACH(person_t, item, array_handle) {
+      if (strcmp(item->name, "John Doe") != 0) {
+        LLACE_LOG_ERROR("Memory array item name mismatch: id=%d, name='%s'", item->id, item->name);
+        all_correct = false;
+      } else if (item->value != 3.14f) {
+        LLACE_LOG_ERROR("Memory array item value mismatch: id=%d, value=%f", item->id, item->value);
+        all_correct = false;
       }
+    }
+
+    if (LLACE_ARRAY_COUNT(array_handle) == 16 && all_correct) {
+      *test_passed = true;
     } else {
-      LLACE_LOG_ERROR("Memory array test failed: allocation returned NULL");
+      LLACE_LOG_ERROR("Memory array test failed: count=%zu, all_correct=%d", 
+                      LLACE_ARRAY_COUNT(array_handle), all_correct);
     }
+  } else {
+    LLACE_LOG_ERROR("Memory array test failed: allocation returned NULL");
+  }
+
+  LLACE_FREE_ARRAY(array_handle);
+}
+
+TEST(mem_tags, "Arrays count against the tag they were made under until freed, whatever frees them") {
+  llace_mem_stats_t ir0, sym0, cg0, dbg0, ir1, sym1, cg1, dbg1, ir2, sym2, cg2, dbg2;
+  llace_mem_stats(LLACE_MEM_IR, &ir0);
+  llace_mem_stats(LLACE_MEM_SYMBOLS, &sym0);
+  llace_mem_stats(LLACE_MEM_CODEGEN, &cg0);
+  llace_mem_stats(LLACE_MEM_DEBUGINFO, &dbg0);
+
+  llace_ir_context_t ctx;
+  llace_ir_context_init(&ctx);
+  llace_codebuf_t out;
+  llace_codebuf_init(&out, 0);
+  llace_array_t lines;
+  {
+    LLACE_MEM_SCOPE(LLACE_MEM_DEBUGINFO);
+    lines = LLACE_NEW_ARRAY(uint32_t, 100);
+  }
+  bool built = llace_ir_parse(&ctx, mem_module_src, strlen(mem_module_src)) == LLACE_ERROR_NONE &&
+               llace_wasm_emit(&ctx, NULL, &out, NULL) == LLACE_ERROR_NONE;
+  llace_mem_stats(LLACE_MEM_IR, &ir1);
+  llace_mem_stats(LLACE_MEM_SYMBOLS, &sym1);
+  llace_mem_stats(LLACE_MEM_CODEGEN, &cg1);
+  llace_mem_stats(LLACE_MEM_DEBUGINFO, &dbg1);
+
+  llace_codebuf_free(&out);
+  llace_ir_context_free(&ctx);
+  LLACE_FREE_ARRAY(lines);
+  llace_mem_stats(LLACE_MEM_IR, &ir2);
+  llace_mem_stats(LLACE_MEM_SYMBOLS, &sym2);
+  llace_mem_stats(LLACE_MEM_CODEGEN, &cg2);
+  llace_mem_stats(LLACE_MEM_DEBUGINFO, &dbg2);
+
+  if (built && ir1.live > ir0.live && ir1.allocs > ir0.allocs && ir1.peak >= ir1.live && sym1.allocs > sym0.allocs &&
+      cg1.live > cg0.live && dbg1.live == dbg0.live + 100 * sizeof(uint32_t) && ir2.live == ir0.live && sym2.live == sym0.live &&
+      cg2.live == cg0.live && dbg2.live == dbg0.live && cg2.peak >= cg1.live && llace_mem_tag(LLACE_MEM_GENERAL) == LLACE_MEM_GENERAL) {
+    *test_passed = true;
+    llace_config_t config;
+    llace_config_init(&config);
+    config.verbose = 1;
+    llace_mem_report(&config);
+  } else {
+    LLACE_LOG_ERROR("Memory accounting test failed: built=%d ir=%zu/%zu/%zu symbols=%zu/%zu/%zu codegen=%zu/%zu/%zu debug=%zu/%zu/%zu", built,
+                    ir0.live, ir1.live, ir2.live, sym0.live, sym1.live, sym2.live, cg0.live, cg1.live, cg2.live, dbg0.live, dbg1.live,
+                    dbg2.live);
+  }
+}
+
+TEST(mem_total, "The total peaks once for tags that were never live together") {
+  llace_mem_stats_t total, ir, cg;
+  llace_mem_stats_reset();
+  {
+    LLACE_MEM_SCOPE(LLACE_MEM_IR);
+    llace_array_t a = LLACE_NEW_ARRAY(char, 4096);
+    LLACE_FREE_ARRAY(a);
+  }
+  {
+    LLACE_MEM_SCOPE(LLACE_MEM_CODEGEN);
+    llace_array_t b = LLACE_NEW_ARRAY(char, 4096);
+    LLACE_FREE_ARRAY(b);
+  }
+  llace_mem_total(&total);
+  llace_mem_stats(LLACE_MEM_IR, &ir);
+  llace_mem_stats(LLACE_MEM_CODEGEN, &cg);
 
-    LLACE_FREE_ARRAY(array_handle);
+  if (total.peak >= total.live + 4096 && total.peak < total.live + 8192 && ir.peak >= ir.live + 4096 && cg.peak >= cg.live + 4096) {
+    *test_passed = true;
+  } else {
+    LLACE_LOG_ERROR("Memory total test failed: total=%zu/%zu ir=%zu/%zu codegen=%zu/%zu", total.live, total.peak, ir.live, ir.peak, cg.live, cg.peak);
   }
-}
\ No newline at end of file
+}
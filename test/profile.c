@@ -0,0 +1,152 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+#include "test.h"
+#include <llace/profile.h>
+#include <llace/ir.h>
+#include <llace/codegen/wasm/wasm.h>
+#include <pthread.h>
+#include <string.h>
+
+#define PROFILE_THREADS 3
+#define PROFILE_INNER 4
+#define PROFILE_DISABLED 10000000
+
+static const char *profile_src =
+  "#fib(i64 %n) i64 {\n"
+  "  @entry: { %n i64(2) < @base @rec branch }\n"
+  "  @base: { %n ret/1 }\n"
+  "  @rec: { %n i64(1) - fib %n i64(2) - fib + ret/1 }\n"
+  "}\n";
+
+static void profile_inner(void) {
+  LLACE_PROFILE_SCOPE("inner");
+  for (volatile int i = 0; i < 1000; ++i) {}
+}
+
+static void *profile_worker(void *arg) {
+  (void)arg;
+  LLACE_PROFILE_SCOPE("outer");
+  for (int i = 0; i < PROFILE_INNER; ++i) profile_inner();
+  return NULL;
+}
+
+static size_t profile_count(const char *text, const char *needle) {
+  size_t count = 0;
+  for (const char *p = strstr(text, needle); p; p = strstr(p + 1, needle)) ++count;
+  return count;
+}
+
+static size_t profile_slurp(FILE *file, char *buf, size_t size) {
+  fflush(file);
+  rewind(file);
+  size_t read = fread(buf, 1, size - 1, file);
+  buf[read] = '\0';
+  return read;
+}
+
+TEST(profile_zones, "Zones nest per thread, merge into one tree and every one is a trace event") {
+  FILE *trace = tmpfile(), *table = tmpfile();
+  static char json[65536], summary[4096];
+  llace_ir_context_t ctx;
+  llace_ir_context_init(&ctx);
+  llace_codebuf_t out;
+  llace_codebuf_init(&out, 256);
+  llace_config_t config;
+  llace_config_init(&config);
+  config.verbose = 1;
+
+  llace_profile_start();
+  pthread_t threads[PROFILE_THREADS];
+  for (int t = 0; t < PROFILE_THREADS; ++t) pthread_create(&threads[t], NULL, profile_worker, NULL);
+  for (int t = 0; t < PROFILE_THREADS; ++t) pthread_join(threads[t], NULL);
+  bool compiled = llace_ir_parse(&ctx, profile_src, strlen(profile_src)) == LLACE_ERROR_NONE &&
+                  llace_wasm_emit(&ctx, NULL, &out, NULL) == LLACE_ERROR_NONE;
+  llace_profile_stop();
+
+  bool written = trace && table && llace_profile_write(trace) == LLACE_ERROR_NONE;
+  if (written) {
+    llace_profile_summary(table);
+    profile_slurp(trace, json, sizeof(json));
+    profile_slurp(table, summary, sizeof(summary));
+  }
+
+  size_t zones = PROFILE_THREADS * (1 + PROFILE_INNER) + 2;
+  char *outer = written ? strstr(summary, "\nouter ") : NULL;
+  if (compiled && written && profile_count(json, "\"ph\":\"X\"") == zones && profile_count(json, "\"thread_name\"") == PROFILE_THREADS + 1 &&
+      strncmp(json, "{\"displayTimeUnit\"", 17) == 0 && strstr(json, "\n]}\n") && outer && strstr(outer, "\n  inner ") &&
+      strstr(summary, "\nparse ") && strstr(summary, "\nwasm ")) {
+    *test_passed = true;
+    llace_profile_report(&config);
+  } else {
+    LLACE_LOG_ERROR("Profile tree test failed: compiled=%d written=%d zones=%zu/%zu summary='%s'", compiled, written,
+                    profile_count(json, "\"ph\":\"X\""), zones, summary);
+  }
+
+  if (trace) fclose(trace);
+  if (table) fclose(table);
+  llace_codebuf_free(&out);
+  llace_ir_context_free(&ctx);
+}
+
+TEST(profile_stopped, "Zones opened while stopped are not recorded and cost next to nothing") {
+  FILE *trace = tmpfile();
+  static char json[4096];
+  struct timespec t0, t1;
+
+  llace_profile_start();
+  llace_profile_stop();
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (int i = 0; i < PROFILE_DISABLED; ++i) {
+    LLACE_PROFILE_SCOPE("disabled");
+    __asm__ volatile("" ::: "memory");
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  bool written = trace && llace_profile_write(trace) == LLACE_ERROR_NONE;
+  if (written) profile_slurp(trace, json, sizeof(json));
+
+  double nanos = ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / PROFILE_DISABLED;
+  if (written && !strstr(json, "disabled")) {
+    *test_passed = true;
+    LLACE_LOG_INFO("Profile: %.2f ns per disabled zone", nanos);
+  } else {
+    LLACE_LOG_ERROR("Profile disabled test failed: written=%d json='%s'", written, json);
+  }
+  if (trace) fclose(trace);
+}
+
+TEST(profile_counters, "Counters go alongside the timings where the system has them, zones are timed either way") {
+  FILE *trace = tmpfile(), *table = tmpfile();
+  static char json[8192], summary[4096];
+
+  bool counted = llace_profile_counters(true);
+  llace_profile_start();
+  profile_worker(NULL);
+  llace_profile_stop();
+  llace_profile_counters(false);
+
+  bool written = trace && table && llace_profile_write(trace) == LLACE_ERROR_NONE;
+  if (written) {
+    llace_profile_summary(table);
+    profile_slurp(trace, json, sizeof(json));
+    profile_slurp(table, summary, sizeof(summary));
+  }
+
+  char *inner = written ? strstr(summary, "\n  inner ") : NULL;
+  bool columns = strstr(summary, "cycles") || strstr(summary, "instructions") || strstr(summary, "misses");
+  bool args = profile_count(json, "\"args\":{\"") > PROFILE_INNER; // beyond the thread names
+  if (written && inner && profile_count(json, "\"ph\":\"X\"") == 1 + PROFILE_INNER && columns == counted && args == counted) {
+    *test_passed = true;
+    if (counted) {
+      llace_config_t config;
+      llace_config_init(&config);
+      config.verbose = 1;
+      llace_profile_report(&config);
+    } else {
+      LLACE_LOG_INFO("Profile: hardware counters unavailable, zones timed only");
+    }
+  } else {
+    LLACE_LOG_ERROR("Profile counter test failed: counted=%d written=%d columns=%d args=%d summary='%s'", counted, written, columns, args,
+                    summary);
+  }
+  if (trace) fclose(trace);
+  if (table) fclose(table);
+}
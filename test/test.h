@@ -0,0 +1,29 @@
+#ifndef LLACE_TEST_H
+#define LLACE_TEST_H
+
+#include <llace/llace.h>
+
+// A test file defines one case per check with TEST(name, description) { ... },
+// the body sets *test_passed once the check holds. A case that returns
+// without it, or crashes, failed. Cases register themselves before main runs.
+
+typedef struct test_case {
+  const char *name;
+  const char *description;
+  void (*run)(bool *test_passed);
+  struct test_case *next;
+} test_case_t;
+
+void test_register(test_case_t *test);
+// Monotonic clock of the runner, in milliseconds
+double test_now(void);
+
+#define TEST(name_, description_) \
+  static void test_##name_(bool *test_passed); \
+  __attribute__((constructor)) static void test_register_##name_(void) { \
+    static test_case_t test = { #name_, description_, test_##name_, NULL }; \
+    test_register(&test); \
+  } \
+  static void test_##name_(bool *test_passed)
+
+#endif // LLACE_TEST_H